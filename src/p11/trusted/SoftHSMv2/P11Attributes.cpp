@@ -102,6 +102,12 @@ CK_RV P11Attribute::updateAttr(Token *token, bool isPrivate, CK_VOID_PTR pValue,
 	if (value.size() < ulValueLen)
 		return CKR_GENERAL_ERROR;
 	osobject->setAttribute(type, value);
+
+	// Searches match the blind index instead of decrypting the value; if it
+	// cannot be stored here, it is filled in by the next search
+	if (isPrivate)
+		(void) token->setBlindIndex(osobject, type, ByteString((unsigned char*)pValue, ulValueLen), value);
+
 	return CKR_OK;
 }
 
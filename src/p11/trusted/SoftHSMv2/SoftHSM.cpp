@@ -476,6 +476,12 @@ CK_RV SoftHSM::C_Initialize(CK_VOID_PTR pInitArgs)
 			return CKR_ARGUMENTS_BAD;
 		}
 
+		// Keep the token objects in enclave memory only
+		if (args->flags & CKF_MEMORY_OBJECTSTORE)
+		{
+			Configuration::i()->setString("objectstore.backend", "memory");
+		}
+
 		// Can we spawn our own threads?
 		// if (args->flags & CKF_LIBRARY_CANT_CREATE_OS_THREADS)
 		// {
@@ -805,6 +811,13 @@ void SoftHSM::prepareSupportedMechanisms(std::map<std::string, CK_MECHANISM_TYPE
 	t["CKM_SHA256_HMAC"]		= CKM_SHA256_HMAC;
 	t["CKM_SHA384_HMAC"]		= CKM_SHA384_HMAC;
 	t["CKM_SHA512_HMAC"]		= CKM_SHA512_HMAC;
+	// Only derived with C_DeriveKeyBatch
+	t["CKM_HKDF_DERIVE"]		= CKM_HKDF_DERIVE;
+	t["CKM_SP800_108_COUNTER_KDF"]	= CKM_SP800_108_COUNTER_KDF;
+	t["CKM_SP800_108_FEEDBACK_KDF"]	= CKM_SP800_108_FEEDBACK_KDF;
+	t["CKM_TLS12_PRF_SHA256"]	= CKM_TLS12_PRF_SHA256;
+	t["CKM_TLS12_MASTER_KEY_DERIVE"]	= CKM_TLS12_MASTER_KEY_DERIVE;
+	t["CKM_TLS12_KEY_AND_MAC_DERIVE"]	= CKM_TLS12_KEY_AND_MAC_DERIVE;
 	t["CKM_RSA_PKCS_KEY_PAIR_GEN"]	= CKM_RSA_PKCS_KEY_PAIR_GEN;
 	t["CKM_RSA_PKCS"]		= CKM_RSA_PKCS;
 	t["CKM_RSA_PKCS_TLS_SHA256"]		= CKM_RSA_PKCS_TLS_SHA256;
@@ -859,6 +872,7 @@ void SoftHSM::prepareSupportedMechanisms(std::map<std::string, CK_MECHANISM_TYPE
 	t["CKM_AES_CTR"]		= CKM_AES_CTR;
 #ifdef WITH_AES_GCM
 	t["CKM_AES_GCM"]		= CKM_AES_GCM;
+	t["CKM_AES_GCM_STREAM"]		= CKM_AES_GCM_STREAM;
 #endif
 	t["CKM_AES_KEY_WRAP"]		= CKM_AES_KEY_WRAP;
 #ifdef HAVE_AES_KEY_WRAP_PAD
@@ -884,10 +898,9 @@ void SoftHSM::prepareSupportedMechanisms(std::map<std::string, CK_MECHANISM_TYPE
 	t["CKM_EC_KEY_PAIR_GEN"]	= CKM_EC_KEY_PAIR_GEN;
 	t["CKM_ECDSA"]			= CKM_ECDSA;
 #endif
-#if defined(WITH_ECC) || defined(WITH_EDDSA)
-#if 0 // Unsupported by Crypto API Toolkit
+#ifdef WITH_EDDSA
+	// Only X25519 and X448, with C_DeriveKeyBatch
 	t["CKM_ECDH1_DERIVE"]		= CKM_ECDH1_DERIVE;
-#endif // Unsupported by Crypto API Toolkit
 #endif
 #if 0 // Unsupported by Crypto API Toolkit
 #ifdef WITH_GOST
@@ -1188,6 +1201,16 @@ CK_RV SoftHSM::C_GetMechanismInfo(CK_SLOT_ID slotID, CK_MECHANISM_TYPE type, CK_
 			l_pInfo->ulMaxKeySize = 512;
 			l_pInfo->flags = CKF_SIGN | CKF_VERIFY;
 			break;
+		case CKM_HKDF_DERIVE:
+		case CKM_SP800_108_COUNTER_KDF:
+		case CKM_SP800_108_FEEDBACK_KDF:
+		case CKM_TLS12_PRF_SHA256:
+		case CKM_TLS12_MASTER_KEY_DERIVE:
+		case CKM_TLS12_KEY_AND_MAC_DERIVE:
+			l_pInfo->ulMinKeySize = 1;
+			l_pInfo->ulMaxKeySize = 512;
+			l_pInfo->flags = CKF_DERIVE;
+			break;
 		case CKM_RSA_PKCS_KEY_PAIR_GEN:
 			l_pInfo->ulMinKeySize = rsaMinSize;
 			l_pInfo->ulMaxKeySize = rsaMaxSize;
@@ -1284,6 +1307,13 @@ CK_RV SoftHSM::C_GetMechanismInfo(CK_SLOT_ID slotID, CK_MECHANISM_TYPE type, CK_
 			l_pInfo->ulMaxKeySize = 32;
 			l_pInfo->flags = CKF_ENCRYPT | CKF_DECRYPT | CKF_WRAP | CKF_UNWRAP;
 			break;
+#ifdef WITH_AES_GCM
+		case CKM_AES_GCM_STREAM:
+			l_pInfo->ulMinKeySize = 16;
+			l_pInfo->ulMaxKeySize = 32;
+			l_pInfo->flags = CKF_ENCRYPT | CKF_DECRYPT;
+			break;
+#endif
 		case CKM_AES_KEY_WRAP:
 			l_pInfo->ulMinKeySize = 16;
 			l_pInfo->ulMaxKeySize = 0x80000000;
@@ -1420,6 +1450,11 @@ CK_RV SoftHSM::C_GetMechanismInfo(CK_SLOT_ID slotID, CK_MECHANISM_TYPE type, CK_
 			l_pInfo->ulMaxKeySize = eddsaMaxSize;
 			l_pInfo->flags = CKF_SIGN | CKF_VERIFY;
 			break;
+		case CKM_ECDH1_DERIVE:
+			l_pInfo->ulMinKeySize = eddsaMinSize;
+			l_pInfo->ulMaxKeySize = eddsaMaxSize;
+			l_pInfo->flags = CKF_DERIVE;
+			break;
 #endif
 		case CKM_EXPORT_ECDSA_QUOTE_RSA_PUBLIC_KEY:
 			l_pInfo->ulMinKeySize = 0;
@@ -2141,6 +2176,7 @@ CK_RV SoftHSM::C_CopyObject(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject
 				rv = CKR_FUNCTION_FAILED;
 				break;
 			}
+			(void) token->setBlindIndex(newobject, attrType, attr.getByteStringValue(), value);
 		}
 		else
 		{
@@ -2263,6 +2299,9 @@ CK_RV SoftHSM::C_DestroyObject(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObj
 	// Tell the handleManager to forget about the object.
 	handleManager->destroyObject(hObject);
 
+	// Wipe the key state that was kept for the object
+	CryptoFactory::i()->forgetKeyStates(object);
+
 	// Destroy the object
 	if (!object->destroyObject())
 		return CKR_FUNCTION_FAILED;
@@ -2672,12 +2711,109 @@ static bool isSymMechanism(CK_MECHANISM_PTR pMechanism)
 		case CKM_AES_CBC_PAD:
 		case CKM_AES_CTR:
 		case CKM_AES_GCM:
+		case CKM_AES_GCM_STREAM:
 			return true;
 		default:
 			return false;
 	}
 }
 
+#ifdef WITH_AES_GCM
+// Get the parameters of a CKM_AES_GCM_STREAM operation
+static CK_RV getGCMStreamParams(CK_MECHANISM_PTR pMechanism, ByteString& noncePrefix, ByteString& aad, size_t& segmentBytes, size_t& tagBytes)
+{
+	if (pMechanism->pParameter == NULL_PTR ||
+	    pMechanism->ulParameterLen != sizeof(CK_AES_GCM_STREAM_PARAMS))
+	{
+		// DEBUG_MSG("GCM stream mode requires parameters");
+		return CKR_ARGUMENTS_BAD;
+	}
+
+	CK_AES_GCM_STREAM_PARAMS params;
+	memcpy_s(&params, sizeof(CK_AES_GCM_STREAM_PARAMS), pMechanism->pParameter, sizeof(CK_AES_GCM_STREAM_PARAMS));
+
+	if (params.pNoncePrefix == NULL_PTR || params.ulNoncePrefixLen != 7)
+		return CKR_MECHANISM_PARAM_INVALID;
+	if ((params.pAAD == NULL_PTR) != (params.ulAADLen == 0) || params.ulAADLen > CKM_MAX_PARAMETER_LEN)
+		return CKR_MECHANISM_PARAM_INVALID;
+	if (params.ulSegmentSize == 0 || params.ulSegmentSize > 0x100000)
+		return CKR_MECHANISM_PARAM_INVALID;
+	if (params.ulTagBits < 96 || params.ulTagBits > 128 || params.ulTagBits % 8 != 0)
+		return CKR_MECHANISM_PARAM_INVALID;
+
+	if (!validate_user_check_ptr(params.pNoncePrefix, params.ulNoncePrefixLen) ||
+	    (params.ulAADLen && !validate_user_check_ptr(params.pAAD, params.ulAADLen)))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	noncePrefix.resize(params.ulNoncePrefixLen);
+	memcpy_s(&noncePrefix[0], params.ulNoncePrefixLen, params.pNoncePrefix, params.ulNoncePrefixLen);
+	aad.resize(params.ulAADLen);
+	if (params.ulAADLen)
+	{
+		memcpy_s(&aad[0], params.ulAADLen, params.pAAD, params.ulAADLen);
+	}
+	segmentBytes = params.ulSegmentSize;
+	tagBytes = params.ulTagBits / 8;
+
+	return CKR_OK;
+}
+#endif
+
+// The decrypting dual-function operations digest or verify what
+// C_DecryptUpdate returns. Ciphers that hold back plaintext until
+// C_DecryptFinal, the AEAD modes and the padded block modes, would leave
+// that plaintext out and cannot be paired.
+static bool holdsBackPlaintext(SymMode::Type mode, bool padding)
+{
+	return mode == SymMode::GCM || mode == SymMode::GCM_STREAM || padding;
+}
+
+// Work out the operation type once an operation of type inOperation joins
+// the one running in the session. SESSION_OP_NONE means the two cannot run
+// together; only a symmetric cipher pairs up with a digest or a MAC.
+static int getDualOpType(Session* session, int inOperation)
+{
+	switch (session->getOpType())
+	{
+		case SESSION_OP_NONE:
+			return inOperation;
+		case SESSION_OP_ENCRYPT:
+			if (session->getSymmetricCryptoOp() == NULL) break;
+			if (inOperation == SESSION_OP_DIGEST) return SESSION_OP_DIGEST_ENCRYPT;
+			if (inOperation == SESSION_OP_SIGN) return SESSION_OP_SIGN_ENCRYPT;
+			break;
+		case SESSION_OP_DECRYPT:
+			if (session->getSymmetricCryptoOp() == NULL) break;
+			if (holdsBackPlaintext(session->getSymmetricCryptoOp()->getCipherMode(),
+					       session->getSymmetricCryptoOp()->getPaddingMode())) break;
+			if (inOperation == SESSION_OP_DIGEST) return SESSION_OP_DECRYPT_DIGEST;
+			if (inOperation == SESSION_OP_VERIFY) return SESSION_OP_DECRYPT_VERIFY;
+			break;
+		case SESSION_OP_DIGEST:
+			if (inOperation == SESSION_OP_ENCRYPT) return SESSION_OP_DIGEST_ENCRYPT;
+			if (inOperation == SESSION_OP_DECRYPT) return SESSION_OP_DECRYPT_DIGEST;
+			break;
+		case SESSION_OP_SIGN:
+			if (session->getMacOp() == NULL) break;
+			if (inOperation == SESSION_OP_ENCRYPT) return SESSION_OP_SIGN_ENCRYPT;
+			break;
+		case SESSION_OP_VERIFY:
+			if (session->getMacOp() == NULL) break;
+			if (inOperation == SESSION_OP_DECRYPT) return SESSION_OP_DECRYPT_VERIFY;
+			break;
+		default:
+			break;
+	}
+
+	return SESSION_OP_NONE;
+}
+
 // SymAlgorithm version of C_EncryptInit
 CK_RV SoftHSM::SymEncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
 {
@@ -2690,7 +2826,8 @@ CK_RV SoftHSM::SymEncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMech
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
 	// Check if we have another operation
-	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+	int opType = getDualOpType(session, SESSION_OP_ENCRYPT);
+	if (opType == SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
 
 	// Get the token
 	Token* token = session->getToken();
@@ -2732,6 +2869,7 @@ CK_RV SoftHSM::SymEncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMech
 	size_t counterBits = 0;
 	ByteString aad;
 	size_t tagBytes = 0;
+	size_t segmentBytes = 0;
 	switch(pMechanism->mechanism) {
 #if 0 // Unsupported by Crypto API Toolkit
 #ifndef WITH_FIPS
@@ -2902,6 +3040,12 @@ CK_RV SoftHSM::SymEncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMech
 			}
 			tagBytes = tagBytes / 8;
 			break;
+		case CKM_AES_GCM_STREAM:
+			algo = SymAlgo::AES;
+			mode = SymMode::GCM_STREAM;
+			rv = getGCMStreamParams(pMechanism, iv, aad, segmentBytes, tagBytes);
+			if (rv != CKR_OK) return rv;
+			break;
 #endif
 		default:
 			return CKR_MECHANISM_INVALID;
@@ -2922,17 +3066,17 @@ CK_RV SoftHSM::SymEncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMech
 	secretkey->setBitLen(secretkey->getKeyBits().size() * bb);
 
 	// Initialize encryption
-	if (!cipher->encryptInit(secretkey, mode, iv, padding, counterBits, aad, tagBytes))
+	if (!cipher->encryptInit(secretkey, mode, iv, padding, counterBits, aad, tagBytes, segmentBytes))
 	{
 		cipher->recycleKey(secretkey);
 		CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
 		return CKR_MECHANISM_INVALID;
 	}
 
-	session->setOpType(SESSION_OP_ENCRYPT);
+	session->setOpType(opType);
 	session->setSymmetricCryptoOp(cipher);
 	session->setAllowMultiPartOp(true);
-	session->setAllowSinglePartOp(true);
+	session->setAllowSinglePartOp(opType == SESSION_OP_ENCRYPT);
 	session->setSymmetricKey(secretkey);
 
 	return CKR_OK;
@@ -3132,6 +3276,11 @@ static CK_RV SymEncrypt(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen,
 			maxSize = ulDataLen + cipher->getBlockSize();
 		}
 	}
+	// Every segment of a segmented AEAD stream carries its own tag
+	if (cipher->getSegmentBytes() > 0)
+	{
+		maxSize = ulDataLen + (ulDataLen / cipher->getSegmentBytes() + 1) * cipher->getTagBytes();
+	}
 	if (!cipher->checkMaximumBytes(ulDataLen))
 	{
 		session->resetOp();
@@ -3298,6 +3447,27 @@ CK_RV SoftHSM::C_Encrypt(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG
     return rv;
 }
 
+// Largest output of an encryptUpdate() call on ulDataLen bytes
+static CK_ULONG SymEncryptUpdateSize(SymmetricAlgorithm* cipher, CK_ULONG ulDataLen)
+{
+	size_t blockSize = cipher->getBlockSize();
+	size_t remainingSize = cipher->getBufferSize();
+	CK_ULONG maxSize = ulDataLen + remainingSize;
+	if (cipher->isBlockCipher())
+	{
+		int nrOfBlocks = (ulDataLen + remainingSize) / blockSize;
+		maxSize = nrOfBlocks * blockSize;
+	}
+	// Only complete segments are output, each followed by its tag
+	if (cipher->getSegmentBytes() > 0)
+	{
+		size_t segmentBytes = cipher->getSegmentBytes();
+		maxSize = ((ulDataLen + remainingSize) / segmentBytes) * (segmentBytes + cipher->getTagBytes());
+	}
+
+	return maxSize;
+}
+
 // SymAlgorithm version of C_EncryptUpdate
 static CK_RV SymEncryptUpdate(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pEncryptedData, CK_ULONG_PTR pulEncryptedDataLen)
 {
@@ -3309,14 +3479,7 @@ static CK_RV SymEncryptUpdate(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDa
 	}
 
 	// Check data size
-	size_t blockSize = cipher->getBlockSize();
-	size_t remainingSize = cipher->getBufferSize();
-	CK_ULONG maxSize = ulDataLen + remainingSize;
-	if (cipher->isBlockCipher())
-	{
-		int nrOfBlocks = (ulDataLen + remainingSize) / blockSize;
-		maxSize = nrOfBlocks * blockSize;
-	}
+	CK_ULONG maxSize = SymEncryptUpdateSize(cipher, ulDataLen);
 	if (!cipher->checkMaximumBytes(ulDataLen))
 	{
 		session->resetOp();
@@ -3333,8 +3496,8 @@ static CK_RV SymEncryptUpdate(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDa
 	// Check output buffer size
 	if (*pulEncryptedDataLen < maxSize)
 	{
-		// DEBUG_MSG("ulDataLen: %#5x  output buffer size: %#5x  blockSize: %#3x  remainingSize: %#4x  maxSize: %#5x",
-		//	  ulDataLen, *pulEncryptedDataLen, blockSize, remainingSize, maxSize);
+		// DEBUG_MSG("ulDataLen: %#5x  output buffer size: %#5x  maxSize: %#5x",
+		//	  ulDataLen, *pulEncryptedDataLen, maxSize);
 		*pulEncryptedDataLen = maxSize;
 		return CKR_BUFFER_TOO_SMALL;
 	}
@@ -3349,8 +3512,8 @@ static CK_RV SymEncryptUpdate(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDa
 		session->resetOp();
 		return CKR_GENERAL_ERROR;
 	}
-	// DEBUG_MSG("ulDataLen: %#5x  output buffer size: %#5x  blockSize: %#3x  remainingSize: %#4x  maxSize: %#5x  encryptedData.size(): %#5x",
-	//	  ulDataLen, *pulEncryptedDataLen, blockSize, remainingSize, maxSize, encryptedData.size());
+	// DEBUG_MSG("ulDataLen: %#5x  output buffer size: %#5x  maxSize: %#5x  encryptedData.size(): %#5x",
+	//	  ulDataLen, *pulEncryptedDataLen, maxSize, encryptedData.size());
 
 	// Check output size from crypto. Unrecoverable error if to large.
 	if (*pulEncryptedDataLen < encryptedData.size())
@@ -3500,7 +3663,7 @@ static CK_RV SymEncryptFinal(Session* session, CK_BYTE_PTR pEncryptedData, CK_UL
 	}
 	*pulEncryptedDataLen = encryptedFinal.size();
 
-	session->resetOp();
+	session->finishSymmetricCryptoOp();
 	return CKR_OK;
 }
 
@@ -3535,7 +3698,9 @@ CK_RV SoftHSM::C_EncryptFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncrypted
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
 	// Check if we are doing the correct operation
-	if (session->getOpType() != SESSION_OP_ENCRYPT) return CKR_OPERATION_NOT_INITIALIZED;
+	if (session->getOpType() != SESSION_OP_ENCRYPT &&
+	    session->getOpType() != SESSION_OP_DIGEST_ENCRYPT &&
+	    session->getOpType() != SESSION_OP_SIGN_ENCRYPT) return CKR_OPERATION_NOT_INITIALIZED;
 
     CK_RV rv;
 	if (session->getSymmetricCryptoOp() != NULL)
@@ -3564,7 +3729,8 @@ CK_RV SoftHSM::SymDecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMech
 	if (token == NULL) return CKR_GENERAL_ERROR;
 
 	// Check if we have another operation
-	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+	int opType = getDualOpType(session, SESSION_OP_DECRYPT);
+	if (opType == SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
 
 	// Check the key handle.
 	OSObject *key = (OSObject *)handleManager->getObject(hKey);
@@ -3603,6 +3769,7 @@ CK_RV SoftHSM::SymDecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMech
 	size_t counterBits = 0;
 	ByteString aad;
 	size_t tagBytes = 0;
+	size_t segmentBytes = 0;
 	switch(pMechanism->mechanism) {
 #if 0 // Unsupported by Crypto API Toolkit
 #ifndef WITH_FIPS
@@ -3773,10 +3940,21 @@ CK_RV SoftHSM::SymDecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMech
 			}
 			tagBytes = tagBytes / 8;
 			break;
+		case CKM_AES_GCM_STREAM:
+			algo = SymAlgo::AES;
+			mode = SymMode::GCM_STREAM;
+			rv = getGCMStreamParams(pMechanism, iv, aad, segmentBytes, tagBytes);
+			if (rv != CKR_OK) return rv;
+			break;
 #endif
 		default:
 			return CKR_MECHANISM_INVALID;
 	}
+
+	// Check if the cipher can join the running digest or MAC
+	if (opType != SESSION_OP_DECRYPT && holdsBackPlaintext(mode, padding))
+		return CKR_OPERATION_ACTIVE;
+
 	SymmetricAlgorithm* cipher = CryptoFactory::i()->getSymmetricAlgorithm(algo);
 	if (cipher == NULL) return CKR_MECHANISM_INVALID;
 
@@ -3793,17 +3971,17 @@ CK_RV SoftHSM::SymDecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMech
 	secretkey->setBitLen(secretkey->getKeyBits().size() * bb);
 
 	// Initialize decryption
-	if (!cipher->decryptInit(secretkey, mode, iv, padding, counterBits, aad, tagBytes))
+	if (!cipher->decryptInit(secretkey, mode, iv, padding, counterBits, aad, tagBytes, segmentBytes))
 	{
 		cipher->recycleKey(secretkey);
 		CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
 		return CKR_MECHANISM_INVALID;
 	}
 
-	session->setOpType(SESSION_OP_DECRYPT);
+	session->setOpType(opType);
 	session->setSymmetricCryptoOp(cipher);
 	session->setAllowMultiPartOp(true);
-	session->setAllowSinglePartOp(true);
+	session->setAllowSinglePartOp(opType == SESSION_OP_DECRYPT);
 	session->setSymmetricKey(secretkey);
 
 	return CKR_OK;
@@ -4184,17 +4362,9 @@ CK_RV SoftHSM::C_Decrypt(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedData,
     return rv;
 }
 
-// SymAlgorithm version of C_DecryptUpdate
-static CK_RV SymDecryptUpdate(Session* session, CK_BYTE_PTR pEncryptedData, CK_ULONG ulEncryptedDataLen, CK_BYTE_PTR pData, CK_ULONG_PTR pDataLen)
+// Largest output of a decryptUpdate() call on ulEncryptedDataLen bytes
+static CK_ULONG SymDecryptUpdateSize(SymmetricAlgorithm* cipher, CK_ULONG ulEncryptedDataLen)
 {
-	SymmetricAlgorithm* cipher = session->getSymmetricCryptoOp();
-	if (cipher == NULL || !session->getAllowMultiPartOp())
-	{
-		session->resetOp();
-		return CKR_OPERATION_NOT_INITIALIZED;
-	}
-
-	// Check encrypted data size
 	size_t blockSize = cipher->getBlockSize();
 	size_t remainingSize = cipher->getBufferSize();
 	CK_ULONG maxSize = ulEncryptedDataLen + remainingSize;
@@ -4206,6 +4376,22 @@ static CK_RV SymDecryptUpdate(Session* session, CK_BYTE_PTR pEncryptedData, CK_U
 		int nrOfBlocks = (ulEncryptedDataLen + remainingSize - paddingAdjustByte) / blockSize;
 		maxSize = nrOfBlocks * blockSize;
 	}
+
+	return maxSize;
+}
+
+// SymAlgorithm version of C_DecryptUpdate
+static CK_RV SymDecryptUpdate(Session* session, CK_BYTE_PTR pEncryptedData, CK_ULONG ulEncryptedDataLen, CK_BYTE_PTR pData, CK_ULONG_PTR pDataLen)
+{
+	SymmetricAlgorithm* cipher = session->getSymmetricCryptoOp();
+	if (cipher == NULL || !session->getAllowMultiPartOp())
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Check encrypted data size
+	CK_ULONG maxSize = SymDecryptUpdateSize(cipher, ulEncryptedDataLen);
 	if (!cipher->checkMaximumBytes(ulEncryptedDataLen))
 	{
 		session->resetOp();
@@ -4222,8 +4408,8 @@ static CK_RV SymDecryptUpdate(Session* session, CK_BYTE_PTR pEncryptedData, CK_U
 	// Check output buffer size
 	if (*pDataLen < maxSize)
 	{
-		// DEBUG_MSG("Output buffer too short   ulEncryptedDataLen: %#5x  output buffer size: %#5x  blockSize: %#3x  remainingSize: %#4x  maxSize: %#5x",
-		//	  ulEncryptedDataLen, *pDataLen, blockSize, remainingSize, maxSize);
+		// DEBUG_MSG("Output buffer too short   ulEncryptedDataLen: %#5x  output buffer size: %#5x  maxSize: %#5x",
+		//	  ulEncryptedDataLen, *pDataLen, maxSize);
 		*pDataLen = maxSize;
 		return CKR_BUFFER_TOO_SMALL;
 	}
@@ -4238,8 +4424,8 @@ static CK_RV SymDecryptUpdate(Session* session, CK_BYTE_PTR pEncryptedData, CK_U
 		session->resetOp();
 		return CKR_GENERAL_ERROR;
 	}
-	// DEBUG_MSG("ulEncryptedDataLen: %#5x  output buffer size: %#5x  blockSize: %#3x  remainingSize: %#4x  maxSize: %#5x  decryptedData.size(): %#5x",
-	//	  ulEncryptedDataLen, *pDataLen, blockSize, remainingSize, maxSize, decryptedData.size());
+	// DEBUG_MSG("ulEncryptedDataLen: %#5x  output buffer size: %#5x  maxSize: %#5x  decryptedData.size(): %#5x",
+	//	  ulEncryptedDataLen, *pDataLen, maxSize, decryptedData.size());
 
 	// Check output size from crypto. Unrecoverable error if to large.
 	if (*pDataLen < decryptedData.size())
@@ -4386,7 +4572,7 @@ static CK_RV SymDecryptFinal(Session* session, CK_BYTE_PTR pDecryptedData, CK_UL
 	}
 	*pulDecryptedDataLen = decryptedFinal.size();
 
-	session->resetOp();
+	session->finishSymmetricCryptoOp();
 	return CKR_OK;
 }
 
@@ -4420,7 +4606,9 @@ CK_RV SoftHSM::C_DecryptFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
 	// Check if we are doing the correct operation
-	if (session->getOpType() != SESSION_OP_DECRYPT) return CKR_OPERATION_NOT_INITIALIZED;
+	if (session->getOpType() != SESSION_OP_DECRYPT &&
+	    session->getOpType() != SESSION_OP_DECRYPT_DIGEST &&
+	    session->getOpType() != SESSION_OP_DECRYPT_VERIFY) return CKR_OPERATION_NOT_INITIALIZED;
 
     CK_RV rv;
 	if (session->getSymmetricCryptoOp() != NULL)
@@ -4433,8 +4621,9 @@ CK_RV SoftHSM::C_DecryptFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_
     return rv;
 }
 
-// Initialise digesting using the specified mechanism in the specified session
-CK_RV SoftHSM::C_DigestInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism)
+// Set up a message-based AEAD operation; the key is looked up and expanded
+// once and then serves every C_EncryptMessage/C_DecryptMessage call
+CK_RV SoftHSM::MessageCryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey, bool isEncrypt)
 {
 	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
@@ -4448,25 +4637,10 @@ CK_RV SoftHSM::C_DigestInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechan
     CK_MECHANISM l_mechanism;
     memcpy_s(&l_mechanism, sizeof(CK_MECHANISM), pMechanism, sizeof(CK_MECHANISM));
 
-    auto ulParameterLen = l_mechanism.ulParameterLen;
-
-    if (ulParameterLen > CKM_MAX_PARAMETER_LEN)
-    {
-        return CKR_ARGUMENTS_BAD;
-    }
-
-    CK_BYTE parameter[ulParameterLen];
-    if (l_mechanism.pParameter != nullptr)
-    {
-        if (!validate_user_check_ptr(l_mechanism.pParameter, ulParameterLen))
-        {
-            return CKR_DEVICE_MEMORY;
-        }
-
-        memcpy_s(&parameter[0], ulParameterLen, l_mechanism.pParameter, ulParameterLen);
-        l_mechanism.pParameter = &parameter[0];
-    }
-    auto l_pMechanism = &l_mechanism;
+    // The per-message parameters are passed with every message; anything
+    // given here is not used
+    l_mechanism.pParameter = NULL_PTR;
+    l_mechanism.ulParameterLen = 0;
 
 #ifdef ENABLE_MITIGATION
     __builtin_ia32_lfence();
@@ -4479,292 +4653,345 @@ CK_RV SoftHSM::C_DigestInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechan
 	// Check if we have another operation
 	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
 
-	// Get the mechanism
-	HashAlgo::Type algo = HashAlgo::Unknown;
-	switch(l_pMechanism->mechanism) {
-#if 0 // Unsupported by Crypto API Toolkit
-#ifndef WITH_FIPS
-		case CKM_MD5:
-			algo = HashAlgo::MD5;
-			break;
+	// Get the token
+	Token* token = session->getToken();
+	if (token == NULL) return CKR_GENERAL_ERROR;
+
+	// Check the key handle.
+	OSObject *key = (OSObject *)handleManager->getObject(hKey);
+	if (key == NULL_PTR || !key->isValid()) return CKR_OBJECT_HANDLE_INVALID;
+
+#ifdef SGXHSM
+    if (key->getBooleanValue(CKA_USED_FOR_WRAPPING, false))
+    {
+        return CKR_OBJECT_HANDLE_INVALID;
+    }
 #endif
-		case CKM_SHA_1:
-			algo = HashAlgo::SHA1;
-			break;
-		case CKM_SHA224:
-			algo = HashAlgo::SHA224;
-			break;
-#endif // Unsupported by Crypto API Toolkit
-		case CKM_SHA256:
-			algo = HashAlgo::SHA256;
-			break;
-		case CKM_SHA384:
-			algo = HashAlgo::SHA384;
-			break;
-		case CKM_SHA512:
-			algo = HashAlgo::SHA512;
-			break;
-#if 0 // Unsupported by Crypto API Toolkit
-#ifdef WITH_GOST
-		case CKM_GOSTR3411:
-			algo = HashAlgo::GOST;
+
+	CK_BBOOL isOnToken = key->getBooleanValue(CKA_TOKEN, false);
+	CK_BBOOL isPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+
+	// Check read user credentials
+	CK_RV rv = haveRead(session->getState(), isOnToken, isPrivate);
+	if (rv != CKR_OK)
+	{
+		if (rv == CKR_USER_NOT_LOGGED_IN)
+		{
+			// INFO_MSG("User is not authorized");
+		}
+
+		return rv;
+	}
+
+	// Check if key can be used for encryption or decryption
+	if (!key->getBooleanValue(isEncrypt ? CKA_ENCRYPT : CKA_DECRYPT, false))
+		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+
+	// Check if the specified mechanism is allowed for the key
+	if (!isMechanismPermitted(key, &l_mechanism))
+		return CKR_MECHANISM_INVALID;
+
+	// Only AEAD mechanisms have a message-based variant
+	switch (l_mechanism.mechanism)
+	{
+#ifdef WITH_AES_GCM
+		case CKM_AES_GCM:
 			break;
 #endif
-#endif // Unsupported by Crypto API Toolkit
 		default:
 			return CKR_MECHANISM_INVALID;
 	}
-	HashAlgorithm* hash = CryptoFactory::i()->getHashAlgorithm(algo);
-	if (hash == NULL) return CKR_MECHANISM_INVALID;
 
-	// Initialize hashing
-	if (hash->hashInit() == false)
+	// Check the key type
+	if (key->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+		return CKR_KEY_TYPE_INCONSISTENT;
+
+	SymmetricAlgorithm* cipher = CryptoFactory::i()->getSymmetricAlgorithm(SymAlgo::AES);
+	if (cipher == NULL) return CKR_MECHANISM_INVALID;
+
+	SymmetricKey* secretkey = new SymmetricKey();
+
+	if (getSymmetricKey(secretkey, token, key) != CKR_OK)
 	{
-		CryptoFactory::i()->recycleHashAlgorithm(hash);
+		cipher->recycleKey(secretkey);
+		CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
 		return CKR_GENERAL_ERROR;
 	}
 
-	session->setOpType(SESSION_OP_DIGEST);
-	session->setDigestOp(hash);
-	session->setHashAlgo(algo);
+	// adjust key bit length
+	secretkey->setBitLen(secretkey->getKeyBits().size() * 8);
+
+	bool initialised = isEncrypt ? cipher->messageEncryptInit(secretkey, SymMode::GCM)
+				     : cipher->messageDecryptInit(secretkey, SymMode::GCM);
+	if (!initialised)
+	{
+		cipher->recycleKey(secretkey);
+		CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
+		return CKR_MECHANISM_INVALID;
+	}
+
+	session->setOpType(isEncrypt ? SESSION_OP_MESSAGE_ENCRYPT : SESSION_OP_MESSAGE_DECRYPT);
+	session->setSymmetricCryptoOp(cipher);
+	session->setAllowMultiPartOp(false);
+	session->setAllowSinglePartOp(true);
+	session->setSymmetricKey(secretkey);
 
 	return CKR_OK;
 }
 
-// Digest the specified data in a one-pass operation and return the resulting digest
-CK_RV SoftHSM::C_Digest(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pDigest, CK_ULONG_PTR pulDigestLen)
+// Check and copy the CK_GCM_MESSAGE_PARAMS of one message; the IV and tag
+// buffers stay in application memory and are validated here
+static CK_RV getGCMMessageParams(CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_GCM_MESSAGE_PARAMS& params, ByteString& iv, size_t& tagBytes)
 {
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+	if (pParameter == NULL_PTR || ulParameterLen != sizeof(CK_GCM_MESSAGE_PARAMS))
+		return CKR_ARGUMENTS_BAD;
 
-	if (pulDigestLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
-	if (pData == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (!validate_user_check_ptr(pParameter, ulParameterLen))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
 
-    if (ulDataLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
-    {
-        return CKR_ARGUMENTS_BAD;
-    }
+	memcpy_s(&params, sizeof(CK_GCM_MESSAGE_PARAMS), pParameter, sizeof(CK_GCM_MESSAGE_PARAMS));
 
-    if (!validate_user_check_ptr(pData, ulDataLen))
-    {
-        return CKR_DEVICE_MEMORY;
-    }
+	if (params.pIv == NULL_PTR || params.ulIvLen == 0 || params.ulIvLen > CKM_MAX_PARAMETER_LEN)
+		return CKR_ARGUMENTS_BAD;
+	if (params.ulIvFixedBits > params.ulIvLen * 8)
+		return CKR_ARGUMENTS_BAD;
+	if (params.pTag == NULL_PTR || params.ulTagBits == 0 || params.ulTagBits > 128 || params.ulTagBits % 8 != 0)
+		return CKR_ARGUMENTS_BAD;
 
-    if (!validate_user_check_ptr(pulDigestLen, sizeof(CK_ULONG)))
-    {
-        return CKR_DEVICE_MEMORY;
-    }
+	tagBytes = params.ulTagBits / 8;
 
-    CK_ULONG ulDigestLen = *pulDigestLen;
-
-    if (pDigest && ulDigestLen)
-    {
-        if (!validate_user_check_ptr(pDigest, ulDigestLen))
-        {
-            return CKR_DEVICE_MEMORY;
-        }
-    }
+	if (!validate_user_check_ptr(params.pIv, params.ulIvLen) ||
+	    !validate_user_check_ptr(params.pTag, tagBytes))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
 
-#ifdef ENABLE_MITIGATION
-    __builtin_ia32_lfence();
-#endif
+	iv.resize(params.ulIvLen);
+	memcpy_s(&iv[0], params.ulIvLen, params.pIv, params.ulIvLen);
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+	return CKR_OK;
+}
 
-	// Check if we are doing the correct operation
-	if (session->getOpType() != SESSION_OP_DIGEST) return CKR_OPERATION_NOT_INITIALIZED;
+// Check the associated data and the input buffer of one message
+static CK_RV checkMessageBuffers(CK_BYTE_PTR pAssociatedData, CK_ULONG ulAssociatedDataLen, CK_BYTE_PTR pIn, CK_ULONG ulInLen)
+{
+	if ((pAssociatedData == NULL_PTR) != (ulAssociatedDataLen == 0))
+		return CKR_ARGUMENTS_BAD;
+	if (pIn == NULL_PTR && ulInLen != 0)
+		return CKR_ARGUMENTS_BAD;
 
-	// Return size
-	CK_ULONG size = session->getDigestOp()->getHashSize();
-	if (pDigest == NULL_PTR)
+	if (ulAssociatedDataLen > CKM_MAX_CRYPTO_OP_INPUT_LEN || ulInLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
 	{
-		*pulDigestLen = size;
-		return CKR_OK;
+		return CKR_ARGUMENTS_BAD;
 	}
 
-	// Check buffer size
-	if (ulDigestLen < size)
+	if ((ulAssociatedDataLen && !validate_user_check_ptr(pAssociatedData, ulAssociatedDataLen)) ||
+	    (ulInLen && !validate_user_check_ptr(pIn, ulInLen)))
 	{
-		*pulDigestLen = size;
-		return CKR_BUFFER_TOO_SMALL;
+		return CKR_DEVICE_MEMORY;
 	}
 
-	// Get the data
-	ByteString data(pData, ulDataLen);
+	return CKR_OK;
+}
 
-	// Digest the data
-	if (session->getDigestOp()->hashUpdate(data) == false)
+// Fill in the IV bits after the fixed part when the message parameters ask
+// the token to generate them; the IV is also returned in params.pIv
+static CK_RV generateMessageIV(CK_GCM_MESSAGE_PARAMS& params, ByteString& iv)
+{
+	switch (params.ivGenerator)
 	{
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
-	}
+		case CKG_NO_GENERATE:
+			break;
+		case CKG_GENERATE_RANDOM:
+		{
+			size_t fixedBytes = params.ulIvFixedBits / 8;
+			CK_BYTE partialMask = (CK_BYTE)(0xFF >> (params.ulIvFixedBits % 8));
 
-	// Get the digest
-	ByteString digest;
-	if (session->getDigestOp()->hashFinal(digest) == false)
-	{
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
-	}
+			ByteString random;
+			RNG* rng = CryptoFactory::i()->getRNG();
+			if (rng == NULL || !rng->generateRandom(random, iv.size())) return CKR_GENERAL_ERROR;
 
-	// Check size
-	if (digest.size() != size)
-	{
-		// ERROR_MSG("The size of the digest differ from the size of the mechanism");
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
-	}
-    memcpy_s(pDigest, ulDigestLen, digest.byte_str(), size);
-	*pulDigestLen = size;
+			for (size_t i = fixedBytes; i < iv.size(); i++)
+			{
+				CK_BYTE mask = (i == fixedBytes) ? partialMask : 0xFF;
+				iv[i] = (iv[i] & ~mask) | (random[i] & mask);
+			}
 
-	session->resetOp();
+			memcpy_s(params.pIv, params.ulIvLen, iv.const_byte_str(), iv.size());
+			break;
+		}
+		default:
+			return CKR_MECHANISM_PARAM_INVALID;
+	}
 
 	return CKR_OK;
 }
 
-// Update a running digest operation
-CK_RV SoftHSM::C_DigestUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+// Copy application memory into a ByteString that is reused between messages,
+// so its storage is only allocated when a larger message comes along
+static void copyMessageBytes(ByteString& dst, const CK_BYTE* src, CK_ULONG len)
 {
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+	dst.resize(len);
+	if (len > 0)
+	{
+		memcpy_s(&dst[0], len, src, len);
+	}
+}
 
-	if (pPart == NULL_PTR) return CKR_ARGUMENTS_BAD;
+// Process one item of a message batch with the cipher of the session; the
+// ByteStrings are scratch space shared by all items of the batch
+static CK_RV cryptBatchItem(SymmetricAlgorithm* cipher, bool isEncrypt, CK_MESSAGE_BATCH_ITEM& item, ByteString& iv, ByteString& aad, ByteString& in, ByteString& out, ByteString& tag)
+{
+	CK_GCM_MESSAGE_PARAMS params;
+	size_t tagBytes = 0;
+	CK_RV rv = getGCMMessageParams(item.pParameter, item.ulParameterLen, params, iv, tagBytes);
+	if (rv != CKR_OK) return rv;
 
-    if (ulPartLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
-    {
-        return CKR_ARGUMENTS_BAD;
-    }
+	rv = checkMessageBuffers(item.pAssociatedData, item.ulAssociatedDataLen, item.pIn, item.ulInLen);
+	if (rv != CKR_OK) return rv;
 
-    if (!validate_user_check_ptr(pPart, ulPartLen))
-    {
-        return CKR_DEVICE_MEMORY;
+	// GCM output has the size of the input
+	if (item.pOut == NULL_PTR || item.ulOutLen < item.ulInLen)
+	{
+		item.ulOutLen = item.ulInLen;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+	if (!validate_user_check_ptr(item.pOut, item.ulOutLen))
+	{
+		return CKR_DEVICE_MEMORY;
 	}
 
 #ifdef ENABLE_MITIGATION
     __builtin_ia32_lfence();
 #endif
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+	copyMessageBytes(aad, item.pAssociatedData, item.ulAssociatedDataLen);
+	copyMessageBytes(in, item.pIn, item.ulInLen);
 
-	// Check if we are doing the correct operation
-	if (session->getOpType() != SESSION_OP_DIGEST) return CKR_OPERATION_NOT_INITIALIZED;
+	if (isEncrypt)
+	{
+		rv = generateMessageIV(params, iv);
+		if (rv != CKR_OK) return rv;
 
-	// Get the data
-	ByteString data(pPart, ulPartLen);
+		if (!cipher->encryptMessage(iv, aad, in, out, tag, tagBytes))
+		{
+			return CKR_GENERAL_ERROR;
+		}
 
-	// Digest the data
-	if (session->getDigestOp()->hashUpdate(data) == false)
+		memcpy_s(params.pTag, tagBytes, tag.const_byte_str(), tag.size());
+	}
+	else
 	{
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
+		copyMessageBytes(tag, params.pTag, tagBytes);
+
+		if (!cipher->decryptMessage(iv, aad, in, tag, out))
+		{
+			return CKR_ENCRYPTED_DATA_INVALID;
+		}
+	}
+
+	if (out.size() > 0)
+	{
+		memcpy_s(item.pOut, item.ulOutLen, out.const_byte_str(), out.size());
 	}
+	item.ulOutLen = out.size();
 
 	return CKR_OK;
 }
 
-// Update a running digest operation by digesting a secret key with the specified handle
-CK_RV SoftHSM::C_DigestKey(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject)
+// Run a batch of messages through the message-based operation of the
+// session in one call; every item gets its own result and a failed item
+// does not stop the others. The result of the first failed item is returned
+CK_RV SoftHSM::MessageCryptBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount, bool isEncrypt)
 {
-#if 0 // Unsupported by Crypto API Toolkit
 	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
+	if (pItems == NULL_PTR || ulCount == 0 || ulCount > CKM_MAX_MESSAGE_BATCH) return CKR_ARGUMENTS_BAD;
+
+	if (!validate_user_check_ptr(pItems, ulCount * sizeof(CK_MESSAGE_BATCH_ITEM)))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
 	// Get the session
 	Session* session = (Session*)handleManager->getSession(hSession);
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
 	// Check if we are doing the correct operation
-	if (session->getOpType() != SESSION_OP_DIGEST) return CKR_OPERATION_NOT_INITIALIZED;
-
-	// Get the token
-	Token* token = session->getToken();
-	if (token == NULL) return CKR_GENERAL_ERROR;
+	if (session->getOpType() != (isEncrypt ? SESSION_OP_MESSAGE_ENCRYPT : SESSION_OP_MESSAGE_DECRYPT))
+		return CKR_OPERATION_NOT_INITIALIZED;
 
-	// Check the key handle.
-	OSObject *key = (OSObject *)handleManager->getObject(hObject);
-	if (key == NULL_PTR || !key->isValid()) return CKR_KEY_HANDLE_INVALID;
+	SymmetricAlgorithm* cipher = session->getSymmetricCryptoOp();
+	if (cipher == NULL) return CKR_OPERATION_NOT_INITIALIZED;
 
-	CK_BBOOL isOnToken = key->getBooleanValue(CKA_TOKEN, false);
-	CK_BBOOL isPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+	ByteString iv, aad, in, out, tag;
+	CK_RV batchRv = CKR_OK;
 
-	// Check read user credentials
-	CK_RV rv = haveRead(session->getState(), isOnToken, isPrivate);
-	if (rv != CKR_OK)
+	for (CK_ULONG i = 0; i < ulCount; i++)
 	{
-		if (rv == CKR_USER_NOT_LOGGED_IN)
-		{
-			// INFO_MSG("User is not authorized");
-		}
+		// Work on a copy so the application cannot change the item meanwhile
+		CK_MESSAGE_BATCH_ITEM item;
+		memcpy_s(&item, sizeof(CK_MESSAGE_BATCH_ITEM), &pItems[i], sizeof(CK_MESSAGE_BATCH_ITEM));
 
-		// CKR_USER_NOT_LOGGED_IN is not a valid return code for this function,
-		// so we use CKR_GENERAL_ERROR.
-		return CKR_GENERAL_ERROR;
-	}
+		CK_RV rv = cryptBatchItem(cipher, isEncrypt, item, iv, aad, in, out, tag);
 
-	// Whitelist
-	HashAlgo::Type algo = session->getHashAlgo();
-	if (algo != HashAlgo::SHA1 &&
-	    algo != HashAlgo::SHA224 &&
-	    algo != HashAlgo::SHA256 &&
-	    algo != HashAlgo::SHA384 &&
-	    algo != HashAlgo::SHA512)
-	{
-		// Parano...
-		if (!key->getBooleanValue(CKA_EXTRACTABLE, false))
-			return CKR_KEY_INDIGESTIBLE;
-		if (key->getBooleanValue(CKA_SENSITIVE, false))
-			return CKR_KEY_INDIGESTIBLE;
-	}
+		pItems[i].ulOutLen = item.ulOutLen;
+		pItems[i].rv = rv;
 
-	// Get value
-	if (!key->attributeExists(CKA_VALUE))
-		return CKR_KEY_INDIGESTIBLE;
-	ByteString keybits;
-	if (isPrivate)
-	{
-		if (!token->decrypt(key->getByteStringValue(CKA_VALUE), keybits))
-			return CKR_GENERAL_ERROR;
-	}
-	else
-	{
-		keybits = key->getByteStringValue(CKA_VALUE);
+		if (rv != CKR_OK && batchRv == CKR_OK) batchRv = rv;
 	}
 
-	// Digest the value
-	if (session->getDigestOp()->hashUpdate(keybits) == false)
-	{
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
-	}
+	// Do not leave the plaintext of the batch in enclave memory
+	in.wipe();
+	out.wipe();
 
-	return CKR_OK;
-#else
-	return CKR_FUNCTION_NOT_SUPPORTED;
-#endif
+	return batchRv;
 }
 
-// Finalise the digest operation in the specified session and return the digest
-CK_RV SoftHSM::C_DigestFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pDigest, CK_ULONG_PTR pulDigestLen)
+// Initialise message-based encryption using the specified object and mechanism
+CK_RV SoftHSM::C_MessageEncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+	return MessageCryptInit(hSession, pMechanism, hKey, true);
+}
+
+// Encrypt one message with its own IV and associated data; the tag is
+// returned in the pTag buffer of the message parameters
+CK_RV SoftHSM::C_EncryptMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pAssociatedData, CK_ULONG ulAssociatedDataLen, CK_BYTE_PTR pPlaintext, CK_ULONG ulPlaintextLen, CK_BYTE_PTR pCiphertext, CK_ULONG_PTR pulCiphertextLen)
 {
 	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
-	if (pulDigestLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pulCiphertextLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
 
-    if (!validate_user_check_ptr(pulDigestLen, sizeof(CK_ULONG)))
+	CK_GCM_MESSAGE_PARAMS params;
+	ByteString iv;
+	size_t tagBytes = 0;
+	CK_RV rv = getGCMMessageParams(pParameter, ulParameterLen, params, iv, tagBytes);
+	if (rv != CKR_OK) return rv;
+
+	rv = checkMessageBuffers(pAssociatedData, ulAssociatedDataLen, pPlaintext, ulPlaintextLen);
+	if (rv != CKR_OK) return rv;
+
+    if (!validate_user_check_ptr(pulCiphertextLen, sizeof(CK_ULONG)))
     {
         return CKR_DEVICE_MEMORY;
     }
 
-    CK_ULONG ulDigestLen = *pulDigestLen;
+    CK_ULONG ulCiphertextLen = *pulCiphertextLen;
 
-    if (pDigest && ulDigestLen)
-    {
-        if (!validate_user_check_ptr(pDigest, ulDigestLen))
-        {
-            return CKR_DEVICE_MEMORY;
-        }
-    }
+	if (pCiphertext && ulCiphertextLen)
+	{
+		if (!validate_user_check_ptr(pCiphertext, ulCiphertextLen))
+		{
+			return CKR_DEVICE_MEMORY;
+		}
+	}
 
 #ifdef ENABLE_MITIGATION
     __builtin_ia32_lfence();
@@ -4775,322 +5002,2520 @@ CK_RV SoftHSM::C_DigestFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pDigest, CK
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
 	// Check if we are doing the correct operation
-	if (session->getOpType() != SESSION_OP_DIGEST) return CKR_OPERATION_NOT_INITIALIZED;
+	if (session->getOpType() != SESSION_OP_MESSAGE_ENCRYPT) return CKR_OPERATION_NOT_INITIALIZED;
 
-	// Return size
-	CK_ULONG size = session->getDigestOp()->getHashSize();
-	if (pDigest == NULL_PTR)
+	SymmetricAlgorithm* cipher = session->getSymmetricCryptoOp();
+	if (cipher == NULL) return CKR_OPERATION_NOT_INITIALIZED;
+
+	// GCM output has the size of the input
+	if (pCiphertext == NULL_PTR)
 	{
-		*pulDigestLen = size;
+		*pulCiphertextLen = ulPlaintextLen;
 		return CKR_OK;
 	}
 
-	// Check buffer size
-	if (ulDigestLen < size)
+	if (ulCiphertextLen < ulPlaintextLen)
 	{
-		*pulDigestLen = size;
+		*pulCiphertextLen = ulPlaintextLen;
 		return CKR_BUFFER_TOO_SMALL;
 	}
 
-	// Get the digest
-	ByteString digest;
-	if (session->getDigestOp()->hashFinal(digest) == false)
+	// Let the token fill in the IV bits after the fixed part if asked to
+	rv = generateMessageIV(params, iv);
+	if (rv != CKR_OK) return rv;
+
+	ByteString aad(pAssociatedData, ulAssociatedDataLen);
+	ByteString data(pPlaintext, ulPlaintextLen);
+	ByteString encryptedData;
+	ByteString tag;
+
+	// A failed message does not end the message-based operation
+	if (!cipher->encryptMessage(iv, aad, data, encryptedData, tag, tagBytes))
 	{
-		session->resetOp();
 		return CKR_GENERAL_ERROR;
 	}
 
-	// Check size
-	if (digest.size() != size)
+	if (encryptedData.size() > 0)
 	{
-		// ERROR_MSG("The size of the digest differ from the size of the mechanism");
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
+		memcpy_s(pCiphertext, ulCiphertextLen, encryptedData.byte_str(), encryptedData.size());
 	}
-    memcpy_s(pDigest, ulDigestLen, digest.byte_str(), size);
-	*pulDigestLen = size;
-
-	session->resetOp();
+	memcpy_s(params.pTag, tagBytes, tag.const_byte_str(), tag.size());
+	*pulCiphertextLen = encryptedData.size();
 
 	return CKR_OK;
 }
 
-// Sign*/Verify*() is for MACs too
-static bool isMacMechanism(CK_MECHANISM_PTR pMechanism)
+// Encrypt a batch of messages with the key set up by C_MessageEncryptInit
+CK_RV SoftHSM::C_EncryptMessageBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
 {
-	if (pMechanism == NULL_PTR) return false;
+	return MessageCryptBatch(hSession, pItems, ulCount, true);
+}
 
-	switch(pMechanism->mechanism) {
-#if 0 // Unsupported by Crypto API Toolkit
-		case CKM_MD5_HMAC:
-		case CKM_SHA_1_HMAC:
-		case CKM_SHA224_HMAC:
-#endif // Unsupported by Crypto API Toolkit
-		case CKM_SHA256_HMAC:
-		case CKM_SHA384_HMAC:
-		case CKM_SHA512_HMAC:
-#if 0 // Unsupported by Crypto API Toolkit
-#ifdef WITH_GOST
-		case CKM_GOSTR3411_HMAC:
-#endif
-		case CKM_DES3_CMAC:
-		case CKM_AES_CMAC:
-#endif // Unsupported by Crypto API Toolkit
-			return true;
-		default:
-			return false;
-	}
-}
-
-// MacAlgorithm version of C_SignInit
-CK_RV SoftHSM::MacSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+// Finish message-based encryption
+CK_RV SoftHSM::C_MessageEncryptFinal(CK_SESSION_HANDLE hSession)
 {
 	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
-	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
-
 	// Get the session
 	Session* session = (Session*)handleManager->getSession(hSession);
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
-	// Check if we have another operation
-	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_MESSAGE_ENCRYPT) return CKR_OPERATION_NOT_INITIALIZED;
 
-	// Get the token
-	Token* token = session->getToken();
-	if (token == NULL) return CKR_GENERAL_ERROR;
+	SymmetricAlgorithm* cipher = session->getSymmetricCryptoOp();
+	if (cipher != NULL)
+	{
+		cipher->messageEncryptFinal();
+	}
 
-	// Check the key handle.
-	OSObject *key = (OSObject *)handleManager->getObject(hKey);
-	if (key == NULL_PTR || !key->isValid()) return CKR_OBJECT_HANDLE_INVALID;
+	session->resetOp();
 
-	CK_BBOOL isOnToken = key->getBooleanValue(CKA_TOKEN, false);
-	CK_BBOOL isPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+	return CKR_OK;
+}
 
-	// Check read user credentials
-	CK_RV rv = haveRead(session->getState(), isOnToken, isPrivate);
-	if (rv != CKR_OK)
+// Initialise message-based decryption using the specified object and mechanism
+CK_RV SoftHSM::C_MessageDecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+	return MessageCryptInit(hSession, pMechanism, hKey, false);
+}
+
+// Decrypt one message with its own IV, associated data and tag; nothing is
+// returned unless the tag verifies
+CK_RV SoftHSM::C_DecryptMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pAssociatedData, CK_ULONG ulAssociatedDataLen, CK_BYTE_PTR pCiphertext, CK_ULONG ulCiphertextLen, CK_BYTE_PTR pPlaintext, CK_ULONG_PTR pulPlaintextLen)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pulPlaintextLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+	CK_GCM_MESSAGE_PARAMS params;
+	ByteString iv;
+	size_t tagBytes = 0;
+	CK_RV rv = getGCMMessageParams(pParameter, ulParameterLen, params, iv, tagBytes);
+	if (rv != CKR_OK) return rv;
+
+	rv = checkMessageBuffers(pAssociatedData, ulAssociatedDataLen, pCiphertext, ulCiphertextLen);
+	if (rv != CKR_OK) return rv;
+
+    if (!validate_user_check_ptr(pulPlaintextLen, sizeof(CK_ULONG)))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
+
+    CK_ULONG ulPlaintextLen = *pulPlaintextLen;
+
+	if (pPlaintext && ulPlaintextLen)
 	{
-		if (rv == CKR_USER_NOT_LOGGED_IN)
+		if (!validate_user_check_ptr(pPlaintext, ulPlaintextLen))
 		{
-			// INFO_MSG("User is not authorized");
+			return CKR_DEVICE_MEMORY;
 		}
-
-		return rv;
 	}
 
-	// Check if key can be used for signing
-	if (!key->getBooleanValue(CKA_SIGN, false))
-		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
 
-	// Check if the specified mechanism is allowed for the key
-	if (!isMechanismPermitted(key, pMechanism))
-		return CKR_MECHANISM_INVALID;
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
-	// Get key info
-	CK_KEY_TYPE keyType = key->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED);
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_MESSAGE_DECRYPT) return CKR_OPERATION_NOT_INITIALIZED;
 
-	// Get the MAC algorithm matching the mechanism
-	// Also check mechanism constraints
-	MacAlgo::Type algo = MacAlgo::Unknown;
-	size_t bb = 8;
-	size_t minSize = 0;
-	switch(pMechanism->mechanism) {
-#if 0 // Unsupported by Crypto API Toolkit
-#ifndef WITH_FIPS
-		case CKM_MD5_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_MD5_HMAC)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 16;
-			algo = MacAlgo::HMAC_MD5;
-			break;
-#endif
-		case CKM_SHA_1_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA_1_HMAC)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 20;
-			algo = MacAlgo::HMAC_SHA1;
-			break;
-		case CKM_SHA224_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA224_HMAC)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 28;
-			algo = MacAlgo::HMAC_SHA224;
-			break;
-#endif // Unsupported by Crypto API Toolkit
-		case CKM_SHA256_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA256_HMAC)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 32;
-			algo = MacAlgo::HMAC_SHA256;
-			break;
-		case CKM_SHA384_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA384_HMAC)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 48;
-			algo = MacAlgo::HMAC_SHA384;
-			break;
-		case CKM_SHA512_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA512_HMAC)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 64;
-			algo = MacAlgo::HMAC_SHA512;
-			break;
-#if 0 // Unsupported by Crypto API Toolkit
-#ifdef WITH_GOST
-		case CKM_GOSTR3411_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_GOST28147)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 32;
-			algo = MacAlgo::HMAC_GOST;
-			break;
-#endif
-		case CKM_DES3_CMAC:
-			if (keyType != CKK_DES2 && keyType != CKK_DES3)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			algo = MacAlgo::CMAC_DES;
-			bb = 7;
-			break;
-		case CKM_AES_CMAC:
-			if (keyType != CKK_AES)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			algo = MacAlgo::CMAC_AES;
-			break;
-#endif // Unsupported by Crypto API Toolkit
-		default:
-			return CKR_MECHANISM_INVALID;
-	}
-	MacAlgorithm* mac = CryptoFactory::i()->getMacAlgorithm(algo);
-	if (mac == NULL) return CKR_MECHANISM_INVALID;
+	SymmetricAlgorithm* cipher = session->getSymmetricCryptoOp();
+	if (cipher == NULL) return CKR_OPERATION_NOT_INITIALIZED;
 
-	SymmetricKey* privkey = new SymmetricKey();
+	// GCM output has the size of the input
+	if (pPlaintext == NULL_PTR)
+	{
+		*pulPlaintextLen = ulCiphertextLen;
+		return CKR_OK;
+	}
 
-	if (getSymmetricKey(privkey, token, key) != CKR_OK)
+	if (ulPlaintextLen < ulCiphertextLen)
 	{
-		mac->recycleKey(privkey);
-		CryptoFactory::i()->recycleMacAlgorithm(mac);
-		return CKR_GENERAL_ERROR;
+		*pulPlaintextLen = ulCiphertextLen;
+		return CKR_BUFFER_TOO_SMALL;
 	}
 
-	// Adjust key bit length
-	privkey->setBitLen(privkey->getKeyBits().size() * bb);
+	ByteString aad(pAssociatedData, ulAssociatedDataLen);
+	ByteString encryptedData(pCiphertext, ulCiphertextLen);
+	ByteString tag(params.pTag, tagBytes);
+	ByteString data;
 
-	// Check key size
-	if (privkey->getBitLen() < (minSize*8))
+	// A failed message does not end the message-based operation
+	if (!cipher->decryptMessage(iv, aad, encryptedData, tag, data))
 	{
-		mac->recycleKey(privkey);
-		CryptoFactory::i()->recycleMacAlgorithm(mac);
-		return CKR_KEY_SIZE_RANGE;
+		return CKR_ENCRYPTED_DATA_INVALID;
 	}
 
-	// Initialize signing
-	if (!mac->signInit(privkey))
+	if (data.size() > 0)
 	{
-		mac->recycleKey(privkey);
-		CryptoFactory::i()->recycleMacAlgorithm(mac);
-		return CKR_MECHANISM_INVALID;
+		memcpy_s(pPlaintext, ulPlaintextLen, data.byte_str(), data.size());
 	}
-
-	session->setOpType(SESSION_OP_SIGN);
-	session->setMacOp(mac);
-	session->setAllowMultiPartOp(true);
-	session->setAllowSinglePartOp(true);
-	session->setSymmetricKey(privkey);
+	*pulPlaintextLen = data.size();
 
 	return CKR_OK;
 }
 
-// AsymmetricAlgorithm version of C_SignInit
-CK_RV SoftHSM::AsymSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+// Decrypt a batch of messages with the key set up by C_MessageDecryptInit
+CK_RV SoftHSM::C_DecryptMessageBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
 {
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+	return MessageCryptBatch(hSession, pItems, ulCount, false);
+}
 
-	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+// Finish message-based decryption
+CK_RV SoftHSM::C_MessageDecryptFinal(CK_SESSION_HANDLE hSession)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
 	// Get the session
 	Session* session = (Session*)handleManager->getSession(hSession);
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
-	// Check if we have another operation
-	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
-
-	// Get the token
-	Token* token = session->getToken();
-	if (token == NULL) return CKR_GENERAL_ERROR;
-
-	// Check the key handle.
-	OSObject *key = (OSObject *)handleManager->getObject(hKey);
-	if (key == NULL_PTR || !key->isValid()) return CKR_OBJECT_HANDLE_INVALID;
-
-	CK_BBOOL isOnToken = key->getBooleanValue(CKA_TOKEN, false);
-	CK_BBOOL isPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_MESSAGE_DECRYPT) return CKR_OPERATION_NOT_INITIALIZED;
 
-	// Check read user credentials
-	CK_RV rv = haveRead(session->getState(), isOnToken, isPrivate);
-	if (rv != CKR_OK)
+	SymmetricAlgorithm* cipher = session->getSymmetricCryptoOp();
+	if (cipher != NULL)
 	{
-		if (rv == CKR_USER_NOT_LOGGED_IN)
-		{
-			// INFO_MSG("User is not authorized");
-		}
-
-		return rv;
+		cipher->messageDecryptFinal();
 	}
 
-	// Check if key can be used for signing
-	if (!key->getBooleanValue(CKA_SIGN, false))
-		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+	session->resetOp();
 
-	// Check if the specified mechanism is allowed for the key
-	if (!isMechanismPermitted(key, pMechanism))
-		return CKR_MECHANISM_INVALID;
+	return CKR_OK;
+}
 
-	// Get the asymmetric algorithm matching the mechanism
-	AsymMech::Type mechanism = AsymMech::Unknown;
-	void* param = NULL;
-	size_t paramLen = 0;
-	RSA_PKCS_PSS_PARAMS pssParam;
-	bool bAllowMultiPartOp;
-	bool isRSA = false;
-#if 0 // Unsupported by Crypto API Toolkit
-	bool isDSA = false;
-#endif // Unsupported by Crypto API Toolkit
-#ifdef WITH_ECC
-	bool isECDSA = false;
-#endif
-#ifdef WITH_EDDSA
-	bool isEDDSA = false;
-#endif 
-	switch(pMechanism->mechanism) {
-		case CKM_RSA_PKCS_TLS_SHA256:
-			mechanism = AsymMech::RSA_SHA256_PKCS_PSS_TLS;
-			bAllowMultiPartOp = false;
-			isRSA = true;
-			break;
-		case CKM_ECDSA_PKCS_TLS_SHA256:
-			mechanism = AsymMech::ECDSA_TLS_SHA256;
-			bAllowMultiPartOp = false;
-			isECDSA = true;
-			break;
-		case CKM_RSA_PKCS:
-			mechanism = AsymMech::RSA_PKCS;
-			bAllowMultiPartOp = false;
-			isRSA = true;
-			break;
-		case CKM_RSA_X_509:
-			mechanism = AsymMech::RSA;
-			bAllowMultiPartOp = false;
-			isRSA = true;
-			break;
+// Get the hash algorithm of a digest mechanism
+static HashAlgo::Type getDigestAlgo(CK_MECHANISM_TYPE mechanism)
+{
+	switch(mechanism) {
 #if 0 // Unsupported by Crypto API Toolkit
 #ifndef WITH_FIPS
-		case CKM_MD5_RSA_PKCS:
-			mechanism = AsymMech::RSA_MD5_PKCS;
-			bAllowMultiPartOp = true;
-			isRSA = true;
-			break;
+		case CKM_MD5:
+			return HashAlgo::MD5;
 #endif
+		case CKM_SHA_1:
+			return HashAlgo::SHA1;
+		case CKM_SHA224:
+			return HashAlgo::SHA224;
 #endif // Unsupported by Crypto API Toolkit
+		case CKM_SHA256:
+			return HashAlgo::SHA256;
+		case CKM_SHA384:
+			return HashAlgo::SHA384;
+		case CKM_SHA512:
+			return HashAlgo::SHA512;
+#if 0 // Unsupported by Crypto API Toolkit
+#ifdef WITH_GOST
+		case CKM_GOSTR3411:
+			return HashAlgo::GOST;
+#endif
+#endif // Unsupported by Crypto API Toolkit
+		default:
+			return HashAlgo::Unknown;
+	}
+}
+
+// Initialise digesting using the specified mechanism in the specified session
+CK_RV SoftHSM::C_DigestInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+    if (pMechanism == nullptr) return CKR_ARGUMENTS_BAD;
+
+	if (!validate_user_check_mechanism_ptr(pMechanism, 1))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+    CK_MECHANISM l_mechanism;
+    memcpy_s(&l_mechanism, sizeof(CK_MECHANISM), pMechanism, sizeof(CK_MECHANISM));
+
+    auto ulParameterLen = l_mechanism.ulParameterLen;
+
+    if (ulParameterLen > CKM_MAX_PARAMETER_LEN)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
+
+    CK_BYTE parameter[ulParameterLen];
+    if (l_mechanism.pParameter != nullptr)
+    {
+        if (!validate_user_check_ptr(l_mechanism.pParameter, ulParameterLen))
+        {
+            return CKR_DEVICE_MEMORY;
+        }
+
+        memcpy_s(&parameter[0], ulParameterLen, l_mechanism.pParameter, ulParameterLen);
+        l_mechanism.pParameter = &parameter[0];
+    }
+    auto l_pMechanism = &l_mechanism;
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we have another operation
+	int opType = getDualOpType(session, SESSION_OP_DIGEST);
+	if (opType == SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+
+	// Get the mechanism
+	HashAlgo::Type algo = getDigestAlgo(l_pMechanism->mechanism);
+	if (algo == HashAlgo::Unknown) return CKR_MECHANISM_INVALID;
+
+	HashAlgorithm* hash = CryptoFactory::i()->getHashAlgorithm(algo);
+	if (hash == NULL) return CKR_MECHANISM_INVALID;
+
+	// Initialize hashing
+	if (hash->hashInit() == false)
+	{
+		CryptoFactory::i()->recycleHashAlgorithm(hash);
+		return CKR_GENERAL_ERROR;
+	}
+
+	session->setOpType(opType);
+	session->setDigestOp(hash);
+	session->setHashAlgo(algo);
+	if (opType != SESSION_OP_DIGEST) session->setAllowSinglePartOp(false);
+
+	return CKR_OK;
+}
+
+// Digest the specified data in a one-pass operation and return the resulting digest
+CK_RV SoftHSM::C_Digest(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pDigest, CK_ULONG_PTR pulDigestLen)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pulDigestLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pData == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (ulDataLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
+
+    if (!validate_user_check_ptr(pData, ulDataLen))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
+
+    if (!validate_user_check_ptr(pulDigestLen, sizeof(CK_ULONG)))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
+
+    CK_ULONG ulDigestLen = *pulDigestLen;
+
+    if (pDigest && ulDigestLen)
+    {
+        if (!validate_user_check_ptr(pDigest, ulDigestLen))
+        {
+            return CKR_DEVICE_MEMORY;
+        }
+    }
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_DIGEST) return CKR_OPERATION_NOT_INITIALIZED;
+
+	// Return size
+	CK_ULONG size = session->getDigestOp()->getHashSize();
+	if (pDigest == NULL_PTR)
+	{
+		*pulDigestLen = size;
+		return CKR_OK;
+	}
+
+	// Check buffer size
+	if (ulDigestLen < size)
+	{
+		*pulDigestLen = size;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+	// Get the data
+	ByteString data(pData, ulDataLen);
+
+	// Digest the data
+	if (session->getDigestOp()->hashUpdate(data) == false)
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Get the digest
+	ByteString digest;
+	if (session->getDigestOp()->hashFinal(digest) == false)
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Check size
+	if (digest.size() != size)
+	{
+		// ERROR_MSG("The size of the digest differ from the size of the mechanism");
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+    memcpy_s(pDigest, ulDigestLen, digest.byte_str(), size);
+	*pulDigestLen = size;
+
+	session->resetOp();
+
+	return CKR_OK;
+}
+
+// Update a running digest operation
+CK_RV SoftHSM::C_DigestUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pPart == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (ulPartLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
+
+    if (!validate_user_check_ptr(pPart, ulPartLen))
+    {
+        return CKR_DEVICE_MEMORY;
+	}
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_DIGEST) return CKR_OPERATION_NOT_INITIALIZED;
+
+	// Get the data
+	ByteString data(pPart, ulPartLen);
+
+	// Digest the data
+	if (session->getDigestOp()->hashUpdate(data) == false)
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	return CKR_OK;
+}
+
+// Update a running digest operation by digesting a secret key with the specified handle
+CK_RV SoftHSM::C_DigestKey(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject)
+{
+#if 0 // Unsupported by Crypto API Toolkit
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_DIGEST) return CKR_OPERATION_NOT_INITIALIZED;
+
+	// Get the token
+	Token* token = session->getToken();
+	if (token == NULL) return CKR_GENERAL_ERROR;
+
+	// Check the key handle.
+	OSObject *key = (OSObject *)handleManager->getObject(hObject);
+	if (key == NULL_PTR || !key->isValid()) return CKR_KEY_HANDLE_INVALID;
+
+	CK_BBOOL isOnToken = key->getBooleanValue(CKA_TOKEN, false);
+	CK_BBOOL isPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+
+	// Check read user credentials
+	CK_RV rv = haveRead(session->getState(), isOnToken, isPrivate);
+	if (rv != CKR_OK)
+	{
+		if (rv == CKR_USER_NOT_LOGGED_IN)
+		{
+			// INFO_MSG("User is not authorized");
+		}
+
+		// CKR_USER_NOT_LOGGED_IN is not a valid return code for this function,
+		// so we use CKR_GENERAL_ERROR.
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Whitelist
+	HashAlgo::Type algo = session->getHashAlgo();
+	if (algo != HashAlgo::SHA1 &&
+	    algo != HashAlgo::SHA224 &&
+	    algo != HashAlgo::SHA256 &&
+	    algo != HashAlgo::SHA384 &&
+	    algo != HashAlgo::SHA512)
+	{
+		// Parano...
+		if (!key->getBooleanValue(CKA_EXTRACTABLE, false))
+			return CKR_KEY_INDIGESTIBLE;
+		if (key->getBooleanValue(CKA_SENSITIVE, false))
+			return CKR_KEY_INDIGESTIBLE;
+	}
+
+	// Get value
+	if (!key->attributeExists(CKA_VALUE))
+		return CKR_KEY_INDIGESTIBLE;
+	ByteString keybits;
+	if (isPrivate)
+	{
+		if (!token->decrypt(key->getByteStringValue(CKA_VALUE), keybits))
+			return CKR_GENERAL_ERROR;
+	}
+	else
+	{
+		keybits = key->getByteStringValue(CKA_VALUE);
+	}
+
+	// Digest the value
+	if (session->getDigestOp()->hashUpdate(keybits) == false)
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	return CKR_OK;
+#else
+	return CKR_FUNCTION_NOT_SUPPORTED;
+#endif
+}
+
+// Finalise the digest operation in the specified session and return the digest
+CK_RV SoftHSM::C_DigestFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pDigest, CK_ULONG_PTR pulDigestLen)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pulDigestLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (!validate_user_check_ptr(pulDigestLen, sizeof(CK_ULONG)))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
+
+    CK_ULONG ulDigestLen = *pulDigestLen;
+
+    if (pDigest && ulDigestLen)
+    {
+        if (!validate_user_check_ptr(pDigest, ulDigestLen))
+        {
+            return CKR_DEVICE_MEMORY;
+        }
+    }
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_DIGEST &&
+	    session->getOpType() != SESSION_OP_DIGEST_ENCRYPT &&
+	    session->getOpType() != SESSION_OP_DECRYPT_DIGEST) return CKR_OPERATION_NOT_INITIALIZED;
+
+	// Return size
+	CK_ULONG size = session->getDigestOp()->getHashSize();
+	if (pDigest == NULL_PTR)
+	{
+		*pulDigestLen = size;
+		return CKR_OK;
+	}
+
+	// Check buffer size
+	if (ulDigestLen < size)
+	{
+		*pulDigestLen = size;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+	// Get the digest
+	ByteString digest;
+	if (session->getDigestOp()->hashFinal(digest) == false)
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Check size
+	if (digest.size() != size)
+	{
+		// ERROR_MSG("The size of the digest differ from the size of the mechanism");
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+    memcpy_s(pDigest, ulDigestLen, digest.byte_str(), size);
+	*pulDigestLen = size;
+
+	session->finishDigestOp();
+
+	return CKR_OK;
+}
+
+// Digest one record of a batch; the ByteStrings are scratch space shared by
+// all records of the batch
+static CK_RV digestBatchItem(HashAlgorithm* hash, CK_DIGEST_BATCH_ITEM& item, ByteString& data, ByteString& digest)
+{
+	if (item.pData == NULL_PTR && item.ulDataLen != 0) return CKR_ARGUMENTS_BAD;
+	if (item.ulDataLen > CKM_MAX_CRYPTO_OP_INPUT_LEN) return CKR_ARGUMENTS_BAD;
+
+	// Return size
+	CK_ULONG size = hash->getHashSize();
+	if (item.pDigest == NULL_PTR)
+	{
+		item.ulDigestLen = size;
+		return CKR_OK;
+	}
+
+	// Check buffer size
+	if (item.ulDigestLen < size)
+	{
+		item.ulDigestLen = size;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+	if ((item.ulDataLen && !validate_user_check_ptr(item.pData, item.ulDataLen)) ||
+	    !validate_user_check_ptr(item.pDigest, item.ulDigestLen))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	copyMessageBytes(data, item.pData, item.ulDataLen);
+
+	// The hash object keeps its context between records
+	if (!hash->hashInit() || !hash->hashUpdate(data) || !hash->hashFinal(digest) || digest.size() != size)
+	{
+		return CKR_GENERAL_ERROR;
+	}
+
+	memcpy_s(item.pDigest, item.ulDigestLen, digest.const_byte_str(), size);
+	item.ulDigestLen = size;
+
+	return CKR_OK;
+}
+
+// Digest a batch of records in one call, without an active digest operation
+CK_RV SoftHSM::C_DigestBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_DIGEST_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pItems == NULL_PTR || ulCount == 0 || ulCount > CKM_MAX_MESSAGE_BATCH) return CKR_ARGUMENTS_BAD;
+
+	if (!validate_user_check_mechanism_ptr(pMechanism, 1) ||
+	    !validate_user_check_ptr(pItems, ulCount * sizeof(CK_DIGEST_BATCH_ITEM)))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+	CK_MECHANISM_TYPE mechanism = pMechanism->mechanism;
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Get the mechanism
+	HashAlgo::Type algo = getDigestAlgo(mechanism);
+	if (algo == HashAlgo::Unknown) return CKR_MECHANISM_INVALID;
+
+	HashAlgorithm* hash = CryptoFactory::i()->getHashAlgorithm(algo);
+	if (hash == NULL) return CKR_MECHANISM_INVALID;
+
+	ByteString data, digest;
+	CK_RV batchRv = CKR_OK;
+
+	for (CK_ULONG i = 0; i < ulCount; i++)
+	{
+		// Work on a copy so the application cannot change the item meanwhile
+		CK_DIGEST_BATCH_ITEM item;
+		memcpy_s(&item, sizeof(CK_DIGEST_BATCH_ITEM), &pItems[i], sizeof(CK_DIGEST_BATCH_ITEM));
+
+		CK_RV rv = digestBatchItem(hash, item, data, digest);
+
+		pItems[i].ulDigestLen = item.ulDigestLen;
+		pItems[i].rv = rv;
+
+		if (rv != CKR_OK && batchRv == CKR_OK) batchRv = rv;
+	}
+
+	CryptoFactory::i()->recycleHashAlgorithm(hash);
+
+	// Do not leave the records of the batch in enclave memory
+	data.wipe();
+
+	return batchRv;
+}
+
+// Sign*/Verify*() is for MACs too
+static bool isMacMechanism(CK_MECHANISM_PTR pMechanism)
+{
+	if (pMechanism == NULL_PTR) return false;
+
+	switch(pMechanism->mechanism) {
+#if 0 // Unsupported by Crypto API Toolkit
+		case CKM_MD5_HMAC:
+		case CKM_SHA_1_HMAC:
+		case CKM_SHA224_HMAC:
+#endif // Unsupported by Crypto API Toolkit
+		case CKM_SHA256_HMAC:
+		case CKM_SHA384_HMAC:
+		case CKM_SHA512_HMAC:
+#if 0 // Unsupported by Crypto API Toolkit
+#ifdef WITH_GOST
+		case CKM_GOSTR3411_HMAC:
+#endif
+		case CKM_DES3_CMAC:
+		case CKM_AES_CMAC:
+#endif // Unsupported by Crypto API Toolkit
+			return true;
+		default:
+			return false;
+	}
+}
+
+// MacAlgorithm version of C_SignInit
+CK_RV SoftHSM::MacSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we have another operation
+	int opType = getDualOpType(session, SESSION_OP_SIGN);
+	if (opType == SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+
+	// Get the token
+	Token* token = session->getToken();
+	if (token == NULL) return CKR_GENERAL_ERROR;
+
+	// Check the key handle.
+	OSObject *key = (OSObject *)handleManager->getObject(hKey);
+	if (key == NULL_PTR || !key->isValid()) return CKR_OBJECT_HANDLE_INVALID;
+
+	CK_BBOOL isOnToken = key->getBooleanValue(CKA_TOKEN, false);
+	CK_BBOOL isPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+
+	// Check read user credentials
+	CK_RV rv = haveRead(session->getState(), isOnToken, isPrivate);
+	if (rv != CKR_OK)
+	{
+		if (rv == CKR_USER_NOT_LOGGED_IN)
+		{
+			// INFO_MSG("User is not authorized");
+		}
+
+		return rv;
+	}
+
+	// Check if key can be used for signing
+	if (!key->getBooleanValue(CKA_SIGN, false))
+		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+
+	// Check if the specified mechanism is allowed for the key
+	if (!isMechanismPermitted(key, pMechanism))
+		return CKR_MECHANISM_INVALID;
+
+	// Get key info
+	CK_KEY_TYPE keyType = key->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED);
+
+	// Get the MAC algorithm matching the mechanism
+	// Also check mechanism constraints
+	MacAlgo::Type algo = MacAlgo::Unknown;
+	size_t bb = 8;
+	size_t minSize = 0;
+	switch(pMechanism->mechanism) {
+#if 0 // Unsupported by Crypto API Toolkit
+#ifndef WITH_FIPS
+		case CKM_MD5_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_MD5_HMAC)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 16;
+			algo = MacAlgo::HMAC_MD5;
+			break;
+#endif
+		case CKM_SHA_1_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA_1_HMAC)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 20;
+			algo = MacAlgo::HMAC_SHA1;
+			break;
+		case CKM_SHA224_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA224_HMAC)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 28;
+			algo = MacAlgo::HMAC_SHA224;
+			break;
+#endif // Unsupported by Crypto API Toolkit
+		case CKM_SHA256_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA256_HMAC)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 32;
+			algo = MacAlgo::HMAC_SHA256;
+			break;
+		case CKM_SHA384_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA384_HMAC)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 48;
+			algo = MacAlgo::HMAC_SHA384;
+			break;
+		case CKM_SHA512_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA512_HMAC)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 64;
+			algo = MacAlgo::HMAC_SHA512;
+			break;
+#if 0 // Unsupported by Crypto API Toolkit
+#ifdef WITH_GOST
+		case CKM_GOSTR3411_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_GOST28147)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 32;
+			algo = MacAlgo::HMAC_GOST;
+			break;
+#endif
+		case CKM_DES3_CMAC:
+			if (keyType != CKK_DES2 && keyType != CKK_DES3)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			algo = MacAlgo::CMAC_DES;
+			bb = 7;
+			break;
+		case CKM_AES_CMAC:
+			if (keyType != CKK_AES)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			algo = MacAlgo::CMAC_AES;
+			break;
+#endif // Unsupported by Crypto API Toolkit
+		default:
+			return CKR_MECHANISM_INVALID;
+	}
+	MacAlgorithm* mac = CryptoFactory::i()->getMacAlgorithm(algo);
+	if (mac == NULL) return CKR_MECHANISM_INVALID;
+
+	SymmetricKey* privkey = new SymmetricKey();
+
+	if (getSymmetricKey(privkey, token, key) != CKR_OK)
+	{
+		mac->recycleKey(privkey);
+		CryptoFactory::i()->recycleMacAlgorithm(mac);
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Adjust key bit length
+	privkey->setBitLen(privkey->getKeyBits().size() * bb);
+
+	// Let the MAC algorithm reuse the key state of the object
+	privkey->setCacheOwner(key);
+
+	// Check key size
+	if (privkey->getBitLen() < (minSize*8))
+	{
+		mac->recycleKey(privkey);
+		CryptoFactory::i()->recycleMacAlgorithm(mac);
+		return CKR_KEY_SIZE_RANGE;
+	}
+
+	// Initialize signing
+	if (!mac->signInit(privkey))
+	{
+		mac->recycleKey(privkey);
+		CryptoFactory::i()->recycleMacAlgorithm(mac);
+		return CKR_MECHANISM_INVALID;
+	}
+
+	session->setOpType(opType);
+	session->setMacOp(mac);
+	session->setAllowMultiPartOp(true);
+	session->setAllowSinglePartOp(opType == SESSION_OP_SIGN);
+	session->setMacKey(privkey);
+
+	return CKR_OK;
+}
+
+// AsymmetricAlgorithm version of C_SignInit
+CK_RV SoftHSM::AsymSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we have another operation
+	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+
+	// Get the token
+	Token* token = session->getToken();
+	if (token == NULL) return CKR_GENERAL_ERROR;
+
+	// Check the key handle.
+	OSObject *key = (OSObject *)handleManager->getObject(hKey);
+	if (key == NULL_PTR || !key->isValid()) return CKR_OBJECT_HANDLE_INVALID;
+
+	CK_BBOOL isOnToken = key->getBooleanValue(CKA_TOKEN, false);
+	CK_BBOOL isPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+
+	// Check read user credentials
+	CK_RV rv = haveRead(session->getState(), isOnToken, isPrivate);
+	if (rv != CKR_OK)
+	{
+		if (rv == CKR_USER_NOT_LOGGED_IN)
+		{
+			// INFO_MSG("User is not authorized");
+		}
+
+		return rv;
+	}
+
+	// Check if key can be used for signing
+	if (!key->getBooleanValue(CKA_SIGN, false))
+		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+
+	// Check if the specified mechanism is allowed for the key
+	if (!isMechanismPermitted(key, pMechanism))
+		return CKR_MECHANISM_INVALID;
+
+	// Get the asymmetric algorithm matching the mechanism
+	AsymMech::Type mechanism = AsymMech::Unknown;
+	void* param = NULL;
+	size_t paramLen = 0;
+	RSA_PKCS_PSS_PARAMS pssParam;
+	bool bAllowMultiPartOp;
+	bool isRSA = false;
+#if 0 // Unsupported by Crypto API Toolkit
+	bool isDSA = false;
+#endif // Unsupported by Crypto API Toolkit
+#ifdef WITH_ECC
+	bool isECDSA = false;
+#endif
+#ifdef WITH_EDDSA
+	bool isEDDSA = false;
+#endif 
+	switch(pMechanism->mechanism) {
+		case CKM_RSA_PKCS_TLS_SHA256:
+			mechanism = AsymMech::RSA_SHA256_PKCS_PSS_TLS;
+			bAllowMultiPartOp = false;
+			isRSA = true;
+			break;
+		case CKM_ECDSA_PKCS_TLS_SHA256:
+			mechanism = AsymMech::ECDSA_TLS_SHA256;
+			bAllowMultiPartOp = false;
+			isECDSA = true;
+			break;
+		case CKM_RSA_PKCS:
+			mechanism = AsymMech::RSA_PKCS;
+			bAllowMultiPartOp = false;
+			isRSA = true;
+			break;
+		case CKM_RSA_X_509:
+			mechanism = AsymMech::RSA;
+			bAllowMultiPartOp = false;
+			isRSA = true;
+			break;
+#if 0 // Unsupported by Crypto API Toolkit
+#ifndef WITH_FIPS
+		case CKM_MD5_RSA_PKCS:
+			mechanism = AsymMech::RSA_MD5_PKCS;
+			bAllowMultiPartOp = true;
+			isRSA = true;
+			break;
+#endif
+#endif // Unsupported by Crypto API Toolkit
+		case CKM_SHA1_RSA_PKCS:
+			mechanism = AsymMech::RSA_SHA1_PKCS;
+			bAllowMultiPartOp = true;
+			isRSA = true;
+			break;
+		case CKM_SHA224_RSA_PKCS:
+			mechanism = AsymMech::RSA_SHA224_PKCS;
+			bAllowMultiPartOp = true;
+			isRSA = true;
+			break;
+		case CKM_SHA256_RSA_PKCS:
+			mechanism = AsymMech::RSA_SHA256_PKCS;
+			bAllowMultiPartOp = true;
+			isRSA = true;
+			break;
+		case CKM_SHA384_RSA_PKCS:
+			mechanism = AsymMech::RSA_SHA384_PKCS;
+			bAllowMultiPartOp = true;
+			isRSA = true;
+			break;
+		case CKM_SHA512_RSA_PKCS:
+			mechanism = AsymMech::RSA_SHA512_PKCS;
+			bAllowMultiPartOp = true;
+			isRSA = true;
+			break;
+#ifdef WITH_RAW_PSS
+		case CKM_RSA_PKCS_PSS:
+			if (pMechanism->pParameter == NULL_PTR ||
+			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS))
+			{
+				// ERROR_MSG("Invalid RSA-PSS parameters");
+				return CKR_ARGUMENTS_BAD;
+			}
+			mechanism = AsymMech::RSA_PKCS_PSS;
+			unsigned long allowedMgf;
+
+			switch(CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg) {
+				case CKM_SHA_1:
+					pssParam.hashAlg = HashAlgo::SHA1;
+					pssParam.mgf = AsymRSAMGF::MGF1_SHA1;
+					allowedMgf = CKG_MGF1_SHA1;
+					break;
+				case CKM_SHA224:
+					pssParam.hashAlg = HashAlgo::SHA224;
+					pssParam.mgf = AsymRSAMGF::MGF1_SHA224;
+					allowedMgf = CKG_MGF1_SHA224;
+					break;
+				case CKM_SHA256:
+					pssParam.hashAlg = HashAlgo::SHA256;
+					pssParam.mgf = AsymRSAMGF::MGF1_SHA256;
+					allowedMgf = CKG_MGF1_SHA256;
+					break;
+				case CKM_SHA384:
+					pssParam.hashAlg = HashAlgo::SHA384;
+					pssParam.mgf = AsymRSAMGF::MGF1_SHA384;
+					allowedMgf = CKG_MGF1_SHA384;
+					break;
+				case CKM_SHA512:
+					pssParam.hashAlg = HashAlgo::SHA512;
+					pssParam.mgf = AsymRSAMGF::MGF1_SHA512;
+					allowedMgf = CKG_MGF1_SHA512;
+					break;
+				default:
+					// ERROR_MSG("Invalid RSA-PSS hash");
+					return CKR_ARGUMENTS_BAD;
+			}
+
+			if (CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != allowedMgf) {
+				// ERROR_MSG("Hash and MGF don't match");
+				return CKR_ARGUMENTS_BAD;
+			}
+
+			pssParam.sLen = CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->sLen;
+			param = &pssParam;
+			paramLen = sizeof(pssParam);
+			bAllowMultiPartOp = false;
+			isRSA = true;
+			break;
+#endif
+		case CKM_SHA1_RSA_PKCS_PSS:
+			if (pMechanism->pParameter == NULL_PTR ||
+			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS) ||
+			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg != CKM_SHA_1 ||
+			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != CKG_MGF1_SHA1)
+			{
+				// ERROR_MSG("Invalid parameters");
+				return CKR_ARGUMENTS_BAD;
+			}
+			mechanism = AsymMech::RSA_SHA1_PKCS_PSS;
+			pssParam.hashAlg = HashAlgo::SHA1;
+			pssParam.mgf = AsymRSAMGF::MGF1_SHA1;
+			pssParam.sLen = CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->sLen;
+			param = &pssParam;
+			paramLen = sizeof(pssParam);
+			bAllowMultiPartOp = true;
+			isRSA = true;
+			break;
+		case CKM_SHA224_RSA_PKCS_PSS:
+			if (pMechanism->pParameter == NULL_PTR ||
+			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS) ||
+			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg != CKM_SHA224 ||
+			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != CKG_MGF1_SHA224)
+			{
+				// ERROR_MSG("Invalid parameters");
+				return CKR_ARGUMENTS_BAD;
+			}
+			mechanism = AsymMech::RSA_SHA224_PKCS_PSS;
+			pssParam.hashAlg = HashAlgo::SHA224;
+			pssParam.mgf = AsymRSAMGF::MGF1_SHA224;
+			pssParam.sLen = CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->sLen;
+			param = &pssParam;
+			paramLen = sizeof(pssParam);
+			bAllowMultiPartOp = true;
+			isRSA = true;
+			break;
+		case CKM_SHA256_RSA_PKCS_PSS:
+			if (pMechanism->pParameter == NULL_PTR ||
+			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS) ||
+			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg != CKM_SHA256 ||
+			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != CKG_MGF1_SHA256)
+			{
+				// ERROR_MSG("Invalid parameters");
+				return CKR_ARGUMENTS_BAD;
+			}
+			mechanism = AsymMech::RSA_SHA256_PKCS_PSS;
+			pssParam.hashAlg = HashAlgo::SHA256;
+			pssParam.mgf = AsymRSAMGF::MGF1_SHA256;
+			pssParam.sLen = CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->sLen;
+			param = &pssParam;
+			paramLen = sizeof(pssParam);
+			bAllowMultiPartOp = true;
+			isRSA = true;
+			break;
+		case CKM_SHA384_RSA_PKCS_PSS:
+			if (pMechanism->pParameter == NULL_PTR ||
+			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS) ||
+			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg != CKM_SHA384 ||
+			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != CKG_MGF1_SHA384)
+			{
+				// ERROR_MSG("Invalid parameters");
+				return CKR_ARGUMENTS_BAD;
+			}
+			mechanism = AsymMech::RSA_SHA384_PKCS_PSS;
+			pssParam.hashAlg = HashAlgo::SHA384;
+			pssParam.mgf = AsymRSAMGF::MGF1_SHA384;
+			pssParam.sLen = CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->sLen;
+			param = &pssParam;
+			paramLen = sizeof(pssParam);
+			bAllowMultiPartOp = true;
+			isRSA = true;
+			break;
+		case CKM_SHA512_RSA_PKCS_PSS:
+			if (pMechanism->pParameter == NULL_PTR ||
+			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS) ||
+			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg != CKM_SHA512 ||
+			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != CKG_MGF1_SHA512)
+			{
+				// ERROR_MSG("Invalid parameters");
+				return CKR_ARGUMENTS_BAD;
+			}
+			mechanism = AsymMech::RSA_SHA512_PKCS_PSS;
+			pssParam.hashAlg = HashAlgo::SHA512;
+			pssParam.mgf = AsymRSAMGF::MGF1_SHA512;
+			pssParam.sLen = CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->sLen;
+			param = &pssParam;
+			paramLen = sizeof(pssParam);
+			bAllowMultiPartOp = true;
+			isRSA = true;
+			break;
+#if 0 // Unsupported by Crypto API Toolkit
+		case CKM_DSA:
+			mechanism = AsymMech::DSA;
+			bAllowMultiPartOp = false;
+			isDSA = true;
+			break;
+		case CKM_DSA_SHA1:
+			mechanism = AsymMech::DSA_SHA1;
+			bAllowMultiPartOp = true;
+			isDSA = true;
+			break;
+		case CKM_DSA_SHA224:
+			mechanism = AsymMech::DSA_SHA224;
+			bAllowMultiPartOp = true;
+			isDSA = true;
+			break;
+		case CKM_DSA_SHA256:
+			mechanism = AsymMech::DSA_SHA256;
+			bAllowMultiPartOp = true;
+			isDSA = true;
+			break;
+		case CKM_DSA_SHA384:
+			mechanism = AsymMech::DSA_SHA384;
+			bAllowMultiPartOp = true;
+			isDSA = true;
+			break;
+		case CKM_DSA_SHA512:
+			mechanism = AsymMech::DSA_SHA512;
+			bAllowMultiPartOp = true;
+			isDSA = true;
+			break;
+#endif // Unsupported by Crypto API Toolkit
+#ifdef WITH_ECC
+		case CKM_ECDSA:
+			mechanism = AsymMech::ECDSA;
+			bAllowMultiPartOp = false;
+			isECDSA = true;
+			break;
+#endif
+#if 0 // Unsupported by Crypto API Toolkit
+#ifdef WITH_GOST
+		case CKM_GOSTR3410:
+			mechanism = AsymMech::GOST;
+			bAllowMultiPartOp = false;
+			break;
+		case CKM_GOSTR3410_WITH_GOSTR3411:
+			mechanism = AsymMech::GOST_GOST;
+			bAllowMultiPartOp = true;
+			break;
+#endif
+#endif // Unsupported by Crypto API Toolkit
+#ifdef WITH_EDDSA
+		case CKM_EDDSA:
+			mechanism = AsymMech::EDDSA;
+			bAllowMultiPartOp = false;
+			isEDDSA = true;
+			break;
+#endif
+		default:
+			return CKR_MECHANISM_INVALID;
+	}
+
+	AsymmetricAlgorithm* asymCrypto = NULL;
+	PrivateKey* privateKey = NULL;
+	if (isRSA)
+	{
+		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::RSA);
+		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
+
+		privateKey = asymCrypto->newPrivateKey();
+		if (privateKey == NULL)
+		{
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+			return CKR_HOST_MEMORY;
+		}
+
+		if (getRSAPrivateKey((RSAPrivateKey*)privateKey, token, key) != CKR_OK)
+		{
+			asymCrypto->recyclePrivateKey(privateKey);
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+			return CKR_GENERAL_ERROR;
+		}
+	}
+#if 0 // Unsupported by Crypto API Toolki
+	else if (isDSA)
+	{
+		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::DSA);
+		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
+
+		privateKey = asymCrypto->newPrivateKey();
+		if (privateKey == NULL)
+		{
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+			return CKR_HOST_MEMORY;
+		}
+
+		if (getDSAPrivateKey((DSAPrivateKey*)privateKey, token, key) != CKR_OK)
+		{
+			asymCrypto->recyclePrivateKey(privateKey);
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+			return CKR_GENERAL_ERROR;
+		}
+    }
+#endif // Unsupported by Crypto API Toolkit
+#ifdef WITH_ECC
+	else if (isECDSA)
+	{
+		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::ECDSA);
+		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
+
+		privateKey = asymCrypto->newPrivateKey();
+		if (privateKey == NULL)
+		{
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+			return CKR_HOST_MEMORY;
+		}
+
+		if (getECPrivateKey((ECPrivateKey*)privateKey, token, key) != CKR_OK)
+		{
+			asymCrypto->recyclePrivateKey(privateKey);
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+			return CKR_GENERAL_ERROR;
+		}
+	}
+#endif
+#ifdef WITH_EDDSA
+	else if (isEDDSA)
+	{
+		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::EDDSA);
+		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
+
+		privateKey = asymCrypto->newPrivateKey();
+		if (privateKey == NULL)
+		{
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+			return CKR_HOST_MEMORY;
+		}
+
+		if (getEDPrivateKey((EDPrivateKey*)privateKey, token, key) != CKR_OK)
+		{
+			asymCrypto->recyclePrivateKey(privateKey);
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+			return CKR_GENERAL_ERROR;
+		}
+	}
+#endif
+	else
+	{
+#ifdef WITH_GOST
+#if 0 // Unsupported by Crypto API Toolkit
+		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::GOST);
+		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
+
+		privateKey = asymCrypto->newPrivateKey();
+		if (privateKey == NULL)
+		{
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+			return CKR_HOST_MEMORY;
+		}
+
+		if (getGOSTPrivateKey((GOSTPrivateKey*)privateKey, token, key) != CKR_OK)
+		{
+			asymCrypto->recyclePrivateKey(privateKey);
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+			return CKR_GENERAL_ERROR;
+		}
+#endif // Unsupported by Crypto API Toolkit
+#else
+		return CKR_MECHANISM_INVALID;
+#endif
+    }
+
+	// Initialize signing
+	if (bAllowMultiPartOp && !asymCrypto->signInit(privateKey,mechanism,param,paramLen))
+	{
+		asymCrypto->recyclePrivateKey(privateKey);
+		CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+		return CKR_MECHANISM_INVALID;
+	}
+
+	// Check if re-authentication is required
+	if (key->getBooleanValue(CKA_ALWAYS_AUTHENTICATE, false))
+	{
+		session->setReAuthentication(true);
+	}
+
+	session->setOpType(SESSION_OP_SIGN);
+	session->setAsymmetricCryptoOp(asymCrypto);
+	session->setMechanism(mechanism);
+	session->setParameters(param, paramLen);
+	session->setAllowMultiPartOp(bAllowMultiPartOp);
+	session->setAllowSinglePartOp(true);
+	session->setPrivateKey(privateKey);
+
+	return CKR_OK;
+}
+
+// Initialise a signing operation using the specified key and mechanism
+CK_RV SoftHSM::C_SignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    if (pMechanism == nullptr) return CKR_ARGUMENTS_BAD;
+
+	if (!validate_user_check_mechanism_ptr(pMechanism, 1))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+    CK_MECHANISM l_mechanism;
+    memcpy_s(&l_mechanism, sizeof(CK_MECHANISM), pMechanism, sizeof(CK_MECHANISM));
+
+    auto ulParameterLen = l_mechanism.ulParameterLen;
+
+    if (ulParameterLen > CKM_MAX_PARAMETER_LEN)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
+
+    CK_BYTE parameter[ulParameterLen];
+    if (l_mechanism.pParameter != nullptr)
+    {
+        if (!validate_user_check_ptr(l_mechanism.pParameter, ulParameterLen))
+        {
+            return CKR_DEVICE_MEMORY;
+        }
+
+        memcpy_s(&parameter[0], ulParameterLen, l_mechanism.pParameter, ulParameterLen);
+        l_mechanism.pParameter = &parameter[0];
+    }
+    auto l_pMechanism = &l_mechanism;
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+#ifdef DCAP_SUPPORT
+    // Get the session
+    Session* session = (Session*)handleManager->getSession(hSession);
+    if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+    // Check if we have another operation
+    if (getDualOpType(session, SESSION_OP_SIGN) == SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+
+    // Get the token
+    Token* token = session->getToken();
+    if (token == NULL) return CKR_GENERAL_ERROR;
+
+    // If the key is used for quote generation should not be used for signing
+    OSObject *key = (OSObject *)handleManager->getObject(hKey);
+    if (!key || !key->isValid())
+    {
+        return CKR_OBJECT_HANDLE_INVALID;
+    }
+
+    CK_BBOOL isUsedForQuoteGeneration = key->getBooleanValue(CKA_USED_FOR_QUOTE_GENERATION, false);
+
+    if (isUsedForQuoteGeneration)
+    {
+        return CKR_OBJECT_HANDLE_INVALID;
+    }
+#endif
+
+	if (isMacMechanism(l_pMechanism))
+		return MacSignInit(hSession, l_pMechanism, hKey);
+	else
+		return AsymSignInit(hSession, l_pMechanism, hKey);
+}
+
+// MacAlgorithm version of C_Sign
+static CK_RV MacSign(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	MacAlgorithm* mac = session->getMacOp();
+	if (mac == NULL || !session->getAllowSinglePartOp())
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Size of the signature
+	CK_ULONG size = mac->getMacSize();
+	if (pSignature == NULL_PTR)
+	{
+		*pulSignatureLen = size;
+		return CKR_OK;
+	}
+
+	// Check buffer size
+	if (*pulSignatureLen < size)
+	{
+		*pulSignatureLen = size;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+	// Get the data
+	ByteString data(pData, ulDataLen);
+
+	// Sign the data
+	if (!mac->signUpdate(data))
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Get the signature
+	ByteString signature;
+	if (!mac->signFinal(signature))
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Check size
+	if (signature.size() != size)
+	{
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+    memcpy_s(pSignature, *pulSignatureLen, signature.byte_str(), size);
+	*pulSignatureLen = size;
+
+	session->resetOp();
+	return CKR_OK;
+}
+
+// AsymmetricAlgorithm version of C_Sign
+static CK_RV AsymSign(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
+	AsymMech::Type mechanism = session->getMechanism();
+	PrivateKey* privateKey = session->getPrivateKey();
+	size_t paramLen;
+	void* param = session->getParameters(paramLen);
+	
+	if (asymCrypto == NULL || !session->getAllowSinglePartOp() || privateKey == NULL)
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Check if re-authentication is required
+	if (session->getReAuthentication())
+	{
+		session->resetOp();
+		return CKR_USER_NOT_LOGGED_IN;
+	}
+
+	// Size of the signature
+	CK_ULONG size = privateKey->getOutputLength();
+	if (pSignature == NULL_PTR)
+	{
+		*pulSignatureLen = size;
+		return CKR_OK;
+	}
+
+	// Check buffer size
+	if (*pulSignatureLen < size)
+	{
+		*pulSignatureLen = size;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+	// Get the data
+	ByteString data;
+
+	// We must allow input length <= k and therfore need to prepend the data with zeroes.
+	if (mechanism == AsymMech::RSA) {
+		data.wipe(size-ulDataLen);
+	}
+
+	data += ByteString(pData, ulDataLen);
+	ByteString signature;
+
+	// Sign the data
+	if (session->getAllowMultiPartOp())
+	{
+		if (!asymCrypto->signUpdate(data) ||
+		    !asymCrypto->signFinal(signature))
+		{
+			session->resetOp();
+			return CKR_GENERAL_ERROR;
+		}
+	}
+	else if (!asymCrypto->sign(privateKey,data,signature,mechanism,param,paramLen))
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Check size
+	if (signature.size() != size)
+	{
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+    memcpy_s(pSignature, *pulSignatureLen, signature.byte_str(), size);
+	*pulSignatureLen = size;
+
+	session->resetOp();
+	return CKR_OK;
+}
+
+static CK_RV ECTLSSign(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	AsymMech::Type mechanism = session->getMechanism();
+	PrivateKey* privateKey = session->getPrivateKey();
+	size_t paramLen;
+	void* param = session->getParameters(paramLen);
+	
+	if (!session->getAllowSinglePartOp() || privateKey == NULL)
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Check if re-authentication is required
+	if (session->getReAuthentication())
+	{
+		session->resetOp();
+		return CKR_USER_NOT_LOGGED_IN;
+	}
+
+	OSSLECPrivateKey* pk = (OSSLECPrivateKey*) privateKey;
+	EC_KEY* eckey = pk->getOSSLKey();
+
+	if (eckey == NULL)
+	{
+		// ERROR_MSG("Could not get the OpenSSL private key");
+
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	CK_ULONG size = ECDSA_size(eckey);
+	if (pSignature == NULL_PTR)
+	{
+		*pulSignatureLen = size;
+		return CKR_OK;
+	}
+
+	// Check buffer size
+	if (*pulSignatureLen < size)
+	{
+		*pulSignatureLen = size;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+    unsigned int out_len;
+	int ok = 0;
+	BIGNUM* kinv = NULL;
+	BIGNUM* r = NULL;
+	// Use a precomputed nonce if there is one for the curve
+	if (OSSLCryptoFactory::i()->getECDSANoncePool()->take(eckey, &kinv, &r))
+	{
+		ok = ECDSA_sign_ex(0, pData, ulDataLen, pSignature, &out_len, kinv, r, eckey);
+		BN_clear_free(kinv);
+		BN_clear_free(r);
+	}
+	// Top up the pool in the background
+	OSSLCryptoFactory::i()->refillPools();
+	 // Borrow "out" because it has been already initialized to the max_out size.
+    if (!ok && !ECDSA_sign(0, pData, ulDataLen, pSignature, &out_len, eckey)) {
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+    }
+
+    *pulSignatureLen = out_len;
+
+	session->resetOp();
+	return CKR_OK;
+}
+
+static CK_RV TLSSign(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	AsymMech::Type mechanism = session->getMechanism();
+	PrivateKey* privateKey = session->getPrivateKey();
+	size_t paramLen;
+	void* param = session->getParameters(paramLen);
+	
+	if (!session->getAllowSinglePartOp() || privateKey == NULL)
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Check if re-authentication is required
+	if (session->getReAuthentication())
+	{
+		session->resetOp();
+		return CKR_USER_NOT_LOGGED_IN;
+	}
+
+	// Size of the signature
+	CK_ULONG size = privateKey->getOutputLength();
+	if (pSignature == NULL_PTR)
+	{
+		*pulSignatureLen = size;
+		return CKR_OK;
+	}
+
+	// Check buffer size
+	if (*pulSignatureLen < size)
+	{
+		*pulSignatureLen = size;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+	
+	OSSLRSAPrivateKey* osslKey = (OSSLRSAPrivateKey*) privateKey;
+	RSA* rsa = osslKey->getOSSLKey();
+	EVP_PKEY *rsa_pkey = EVP_PKEY_new();
+	if (rsa_pkey)
+		 EVP_PKEY_assign_RSA(rsa_pkey,rsa);
+	else{ 
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	// get digest function
+    const EVP_MD *md_func = EVP_sha256();
+	if (!md_func) {
+		session->resetOp();
+        return CKR_GENERAL_ERROR;
+    }
+
+	// digest sign
+    
+    EVP_PKEY_CTX *pctx;
+
+	EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+	if (ctx == NULL)
+	{
+		// ERROR_MSG("Failed to allocate space for EVP_MD_CTX");
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+    if (!EVP_DigestSignInit(ctx, &pctx, md_func, nullptr, rsa_pkey)) {
+		EVP_MD_CTX_free(ctx);
+		session->resetOp();
+        return CKR_GENERAL_ERROR;
+    }
+    
+	if (!EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PSS_PADDING) ||
+		!EVP_PKEY_CTX_set_rsa_pss_saltlen(pctx, -1 /* salt len = hash len */)) {
+		EVP_MD_CTX_free(ctx);
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	ByteString signature;
+	signature.resize(size);
+	// Check size
+	if (signature.size() != size)
+	{
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
+		EVP_MD_CTX_free(ctx);
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	if (!EVP_DigestSign(ctx, &signature[0], pulSignatureLen, pData, ulDataLen)) {
+		EVP_MD_CTX_free(ctx);
+		session->resetOp();
+        return CKR_GENERAL_ERROR;
+    }
+
+    memcpy_s(pSignature, *pulSignatureLen, signature.byte_str(), size);
+	*pulSignatureLen = size;
+    
+
+	EVP_MD_CTX_free(ctx);
+	session->resetOp();
+	return CKR_OK;
+}
+
+// Sign the data in a single pass operation
+CK_RV SoftHSM::C_Sign(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pData == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pulSignatureLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (ulDataLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
+
+	if (!validate_user_check_ptr(pData, ulDataLen))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+	if (!validate_user_check_ptr(pulSignatureLen, sizeof(CK_ULONG)))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+    CK_ULONG ulSignatureLen = *pulSignatureLen;
+    auto l_pulSignatureLen = &ulSignatureLen;
+
+	if (pSignature && ulSignatureLen)
+	{
+		if (!validate_user_check_ptr(pSignature, ulSignatureLen))
+		{
+			return CKR_DEVICE_MEMORY;
+		}
+	}
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_SIGN)
+		return CKR_OPERATION_NOT_INITIALIZED;
+
+    CK_RV rv;
+	AsymMech::Type mechanism = session->getMechanism();
+	if(mechanism == AsymMech::RSA_SHA256_PKCS_PSS_TLS)
+		rv = TLSSign(session, pData, ulDataLen,
+				pSignature, l_pulSignatureLen);
+	else if(mechanism == AsymMech::ECDSA_TLS_SHA256)
+		rv = ECTLSSign(session, pData, ulDataLen,
+				pSignature, l_pulSignatureLen);
+	else{
+		if (session->getMacOp() != NULL)
+			rv = MacSign(session, pData, ulDataLen,
+			       pSignature, l_pulSignatureLen);
+		else
+			rv = AsymSign(session, pData, ulDataLen,
+					pSignature, l_pulSignatureLen);
+	}
+
+    *pulSignatureLen = ulSignatureLen;
+
+    return rv;
+}
+
+// MacAlgorithm version of C_SignUpdate
+static CK_RV MacSignUpdate(Session* session, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+{
+	MacAlgorithm* mac = session->getMacOp();
+	if (mac == NULL || !session->getAllowMultiPartOp())
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Get the part
+	ByteString part(pPart, ulPartLen);
+
+	// Sign the data
+	if (!mac->signUpdate(part))
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	session->setAllowSinglePartOp(false);
+	return CKR_OK;
+}
+
+// AsymmetricAlgorithm version of C_SignUpdate
+static CK_RV AsymSignUpdate(Session* session, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+{
+	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
+	if (asymCrypto == NULL || !session->getAllowMultiPartOp())
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Check if re-authentication is required
+	if (session->getReAuthentication())
+	{
+		session->resetOp();
+		return CKR_USER_NOT_LOGGED_IN;
+	}
+
+	// Get the part
+	ByteString part(pPart, ulPartLen);
+
+	// Sign the data
+	if (!asymCrypto->signUpdate(part))
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	session->setAllowSinglePartOp(false);
+	return CKR_OK;
+}
+
+// Update a running signing operation with additional data
+CK_RV SoftHSM::C_SignUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pPart == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (ulPartLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
+
+    if (!validate_user_check_ptr(pPart, ulPartLen))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_SIGN)
+		return CKR_OPERATION_NOT_INITIALIZED;
+
+	if (session->getMacOp() != NULL)
+		return MacSignUpdate(session, pPart, ulPartLen);
+	else
+		return AsymSignUpdate(session, pPart, ulPartLen);
+}
+
+// MacAlgorithm version of C_SignFinal
+static CK_RV MacSignFinal(Session* session, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	MacAlgorithm* mac = session->getMacOp();
+	if (mac == NULL)
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Size of the signature
+	CK_ULONG size = mac->getMacSize();
+	if (pSignature == NULL_PTR)
+	{
+		*pulSignatureLen = size;
+		return CKR_OK;
+	}
+
+	// Check buffer size
+	if (*pulSignatureLen < size)
+	{
+		*pulSignatureLen = size;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+	// Get the signature
+	ByteString signature;
+	if (!mac->signFinal(signature))
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Check size
+	if (signature.size() != size)
+	{
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+    memcpy_s(pSignature, *pulSignatureLen, signature.byte_str(), size);
+	*pulSignatureLen = size;
+
+	session->finishMacOp();
+	return CKR_OK;
+}
+
+// AsymmetricAlgorithm version of C_SignFinal
+static CK_RV AsymSignFinal(Session* session, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
+	PrivateKey* privateKey = session->getPrivateKey();
+	if (asymCrypto == NULL || privateKey == NULL)
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Check if re-authentication is required
+	if (session->getReAuthentication())
+	{
+		session->resetOp();
+		return CKR_USER_NOT_LOGGED_IN;
+	}
+
+	// Size of the signature
+	CK_ULONG size = privateKey->getOutputLength();
+	if (pSignature == NULL_PTR)
+	{
+		*pulSignatureLen = size;
+		return CKR_OK;
+	}
+
+	// Check buffer size
+	if (*pulSignatureLen < size)
+	{
+		*pulSignatureLen = size;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+	// Get the signature
+	ByteString signature;
+	if (!asymCrypto->signFinal(signature))
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Check size
+	if (signature.size() != size)
+	{
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+    memcpy_s(pSignature, *pulSignatureLen, signature.byte_str(), size);
+	*pulSignatureLen = size;
+
+	session->resetOp();
+	return CKR_OK;
+}
+
+// Finalise a running signing operation and return the signature
+CK_RV SoftHSM::C_SignFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pulSignatureLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (!validate_user_check_ptr(pulSignatureLen, sizeof(CK_ULONG)))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
+
+    CK_ULONG ulSignatureLen = *pulSignatureLen;
+    auto l_pulSignatureLen = &ulSignatureLen;
+
+	if (pSignature && ulSignatureLen)
+	{
+		if (!validate_user_check_ptr(pSignature, ulSignatureLen))
+		{
+			return CKR_DEVICE_MEMORY;
+		}
+	}
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if ((session->getOpType() != SESSION_OP_SIGN &&
+	     session->getOpType() != SESSION_OP_SIGN_ENCRYPT) || !session->getAllowMultiPartOp())
+		return CKR_OPERATION_NOT_INITIALIZED;
+
+    CK_RV rv;
+	if (session->getMacOp() != NULL)
+		rv = MacSignFinal(session, pSignature, l_pulSignatureLen);
+	else
+		rv = AsymSignFinal(session, pSignature, l_pulSignatureLen);
+
+    *pulSignatureLen = ulSignatureLen;
+
+    return rv;
+}
+
+// Initialise a signing operation that allows recovery of the signed data
+CK_RV SoftHSM::C_SignRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR /*pMechanism*/, CK_OBJECT_HANDLE /*hKey*/)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we have another operation
+	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+// Perform a single part signing operation that allows recovery of the signed data
+CK_RV SoftHSM::C_SignRecover(CK_SESSION_HANDLE hSession, CK_BYTE_PTR /*pData*/, CK_ULONG /*ulDataLen*/, CK_BYTE_PTR /*pSignature*/, CK_ULONG_PTR /*pulSignatureLen*/)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+// Turn a freshly initialised sign or verify operation into a message-based
+// one, so the key and algorithm stay in the session between messages
+static CK_RV setMessageOp(Session* session, int opType)
+{
+	// Keys that need a login per operation cannot serve a stream of messages
+	if (session->getReAuthentication())
+	{
+		session->resetOp();
+		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+	}
+
+	// The TLS vendor mechanisms only have a single-shot implementation
+	if (session->getMacOp() == NULL &&
+	    (session->getMechanism() == AsymMech::RSA_SHA256_PKCS_PSS_TLS ||
+	     session->getMechanism() == AsymMech::ECDSA_TLS_SHA256))
+	{
+		session->resetOp();
+		return CKR_MECHANISM_INVALID;
+	}
+
+	session->setOpType(opType);
+
+	return CKR_OK;
+}
+
+// MacAlgorithm version of C_SignMessage
+static CK_RV MacSignMessage(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	MacAlgorithm* mac = session->getMacOp();
+	SymmetricKey* key = session->getMacKey();
+	if (mac == NULL || key == NULL)
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Size of the signature
+	CK_ULONG size = mac->getMacSize();
+	if (pSignature == NULL_PTR)
+	{
+		*pulSignatureLen = size;
+		return CKR_OK;
+	}
+
+	// Check buffer size
+	if (*pulSignatureLen < size)
+	{
+		*pulSignatureLen = size;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+	// Get the data
+	ByteString data(pData, ulDataLen);
+
+	// Sign the data and re-key the MAC for the next message
+	ByteString signature;
+	if (!mac->signUpdate(data) ||
+	    !mac->signFinal(signature) ||
+	    !mac->signInit(key))
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Check size
+	if (signature.size() != size)
+	{
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+    memcpy_s(pSignature, *pulSignatureLen, signature.byte_str(), size);
+	*pulSignatureLen = size;
+
+	return CKR_OK;
+}
+
+// AsymmetricAlgorithm version of C_SignMessage
+static CK_RV AsymSignMessage(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
+	AsymMech::Type mechanism = session->getMechanism();
+	PrivateKey* privateKey = session->getPrivateKey();
+	size_t paramLen;
+	void* param = session->getParameters(paramLen);
+
+	if (asymCrypto == NULL || privateKey == NULL)
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Size of the signature
+	CK_ULONG size = privateKey->getOutputLength();
+	if (pSignature == NULL_PTR)
+	{
+		*pulSignatureLen = size;
+		return CKR_OK;
+	}
+
+	// Check buffer size
+	if (*pulSignatureLen < size)
+	{
+		*pulSignatureLen = size;
+		return CKR_BUFFER_TOO_SMALL;
+	}
+
+	// Get the data
+	ByteString data;
+
+	// We must allow input length <= k and therfore need to prepend the data with zeroes.
+	if (mechanism == AsymMech::RSA) {
+		if (ulDataLen > size) return CKR_DATA_LEN_RANGE;
+		data.wipe(size-ulDataLen);
+	}
+
+	data += ByteString(pData, ulDataLen);
+	ByteString signature;
+
+	// Sign the data; hashing mechanisms are set up again for the next message
+	if (session->getAllowMultiPartOp())
+	{
+		if (!asymCrypto->signUpdate(data) ||
+		    !asymCrypto->signFinal(signature) ||
+		    !asymCrypto->signInit(privateKey,mechanism,param,paramLen))
+		{
+			session->resetOp();
+			return CKR_GENERAL_ERROR;
+		}
+	}
+	else if (!asymCrypto->sign(privateKey,data,signature,mechanism,param,paramLen))
+	{
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Check size
+	if (signature.size() != size)
+	{
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+    memcpy_s(pSignature, *pulSignatureLen, signature.byte_str(), size);
+	*pulSignatureLen = size;
+
+	return CKR_OK;
+}
+
+// Initialise message-based signing; the key stays loaded until C_MessageSignFinal
+CK_RV SoftHSM::C_MessageSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Message-based operations do not pair up with a running operation
+	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+
+	CK_RV rv = C_SignInit(hSession, pMechanism, hKey);
+	if (rv != CKR_OK) return rv;
+
+	return setMessageOp(session, SESSION_OP_MESSAGE_SIGN);
+}
+
+// Sign one message with the key set up by C_MessageSignInit
+CK_RV SoftHSM::C_SignMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR /*pParameter*/, CK_ULONG /*ulParameterLen*/, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pData == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pulSignatureLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (ulDataLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
+
+	if (!validate_user_check_ptr(pData, ulDataLen))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+	if (!validate_user_check_ptr(pulSignatureLen, sizeof(CK_ULONG)))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+    CK_ULONG ulSignatureLen = *pulSignatureLen;
+    auto l_pulSignatureLen = &ulSignatureLen;
+
+	if (pSignature && ulSignatureLen)
+	{
+		if (!validate_user_check_ptr(pSignature, ulSignatureLen))
+		{
+			return CKR_DEVICE_MEMORY;
+		}
+	}
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_MESSAGE_SIGN)
+		return CKR_OPERATION_NOT_INITIALIZED;
+
+    CK_RV rv;
+	if (session->getMacOp() != NULL)
+		rv = MacSignMessage(session, pData, ulDataLen,
+				    pSignature, l_pulSignatureLen);
+	else
+		rv = AsymSignMessage(session, pData, ulDataLen,
+				     pSignature, l_pulSignatureLen);
+
+    *pulSignatureLen = ulSignatureLen;
+
+    return rv;
+}
+
+// Finish message-based signing and release the key
+CK_RV SoftHSM::C_MessageSignFinal(CK_SESSION_HANDLE hSession)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_MESSAGE_SIGN) return CKR_OPERATION_NOT_INITIALIZED;
+
+	session->resetOp();
+
+	return CKR_OK;
+}
+
+// MacAlgorithm version of C_VerifyInit
+CK_RV SoftHSM::MacVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we have another operation
+	int opType = getDualOpType(session, SESSION_OP_VERIFY);
+	if (opType == SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+
+	// Get the token
+	Token* token = session->getToken();
+	if (token == NULL) return CKR_GENERAL_ERROR;
+
+	// Check the key handle.
+	OSObject *key = (OSObject *)handleManager->getObject(hKey);
+	if (key == NULL_PTR || !key->isValid()) return CKR_OBJECT_HANDLE_INVALID;
+
+	CK_BBOOL isOnToken = key->getBooleanValue(CKA_TOKEN, false);
+	CK_BBOOL isPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+
+	// Check read user credentials
+	CK_RV rv = haveRead(session->getState(), isOnToken, isPrivate);
+	if (rv != CKR_OK)
+	{
+		if (rv == CKR_USER_NOT_LOGGED_IN)
+		{
+			// INFO_MSG("User is not authorized");
+		}
+
+		return rv;
+	}
+
+	// Check if key can be used for verifying
+	if (!key->getBooleanValue(CKA_VERIFY, false))
+		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+
+	// Check if the specified mechanism is allowed for the key
+	if (!isMechanismPermitted(key, pMechanism))
+		return CKR_MECHANISM_INVALID;
+
+	// Get key info
+	CK_KEY_TYPE keyType = key->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED);
+
+	// Get the MAC algorithm matching the mechanism
+	// Also check mechanism constraints
+	MacAlgo::Type algo = MacAlgo::Unknown;
+	size_t bb = 8;
+	size_t minSize = 0;
+	switch(pMechanism->mechanism) {
+#if 0 // Unsupported by Crypto API Toolkit
+#ifndef WITH_FIPS
+		case CKM_MD5_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_MD5_HMAC)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 16;
+			algo = MacAlgo::HMAC_MD5;
+			break;
+#endif
+		case CKM_SHA_1_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA_1_HMAC)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 20;
+			algo = MacAlgo::HMAC_SHA1;
+			break;
+		case CKM_SHA224_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA224_HMAC)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 28;
+			algo = MacAlgo::HMAC_SHA224;
+			break;
+#endif // Unsupported by Crypto API Toolkit
+		case CKM_SHA256_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA256_HMAC)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 32;
+			algo = MacAlgo::HMAC_SHA256;
+			break;
+		case CKM_SHA384_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA384_HMAC)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 48;
+			algo = MacAlgo::HMAC_SHA384;
+			break;
+		case CKM_SHA512_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA512_HMAC)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 64;
+			algo = MacAlgo::HMAC_SHA512;
+			break;
+#if 0 // Unsupported by Crypto API Toolkit
+#ifdef WITH_GOST
+		case CKM_GOSTR3411_HMAC:
+			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_GOST28147)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			minSize = 32;
+			algo = MacAlgo::HMAC_GOST;
+			break;
+#endif
+		case CKM_DES3_CMAC:
+			if (keyType != CKK_DES2 && keyType != CKK_DES3)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			algo = MacAlgo::CMAC_DES;
+			bb = 7;
+			break;
+		case CKM_AES_CMAC:
+			if (keyType != CKK_AES)
+				return CKR_KEY_TYPE_INCONSISTENT;
+			algo = MacAlgo::CMAC_AES;
+			break;
+#endif // Unsupported by Crypto API Toolkit
+		default:
+			return CKR_MECHANISM_INVALID;
+	}
+	MacAlgorithm* mac = CryptoFactory::i()->getMacAlgorithm(algo);
+	if (mac == NULL) return CKR_MECHANISM_INVALID;
+
+	SymmetricKey* pubkey = new SymmetricKey();
+
+	if (getSymmetricKey(pubkey, token, key) != CKR_OK)
+	{
+		mac->recycleKey(pubkey);
+		CryptoFactory::i()->recycleMacAlgorithm(mac);
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Adjust key bit length
+	pubkey->setBitLen(pubkey->getKeyBits().size() * bb);
+
+	// Let the MAC algorithm reuse the key state of the object
+	pubkey->setCacheOwner(key);
+
+	// Check key size
+	if (pubkey->getBitLen() < (minSize*8))
+	{
+		mac->recycleKey(pubkey);
+		CryptoFactory::i()->recycleMacAlgorithm(mac);
+		return CKR_KEY_SIZE_RANGE;
+	}
+
+	// Initialize verifying
+	if (!mac->verifyInit(pubkey))
+	{
+		mac->recycleKey(pubkey);
+		CryptoFactory::i()->recycleMacAlgorithm(mac);
+		return CKR_MECHANISM_INVALID;
+	}
+
+	session->setOpType(opType);
+	session->setMacOp(mac);
+	session->setAllowMultiPartOp(true);
+	session->setAllowSinglePartOp(opType == SESSION_OP_VERIFY);
+	session->setMacKey(pubkey);
+
+	return CKR_OK;
+}
+
+// AsymmetricAlgorithm version of C_VerifyInit
+CK_RV SoftHSM::AsymVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we have another operation
+	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+
+	// Get the token
+	Token* token = session->getToken();
+	if (token == NULL) return CKR_GENERAL_ERROR;
+
+	// Check the key handle.
+	OSObject *key = (OSObject *)handleManager->getObject(hKey);
+	if (key == NULL_PTR || !key->isValid()) return CKR_OBJECT_HANDLE_INVALID;
+
+	CK_BBOOL isOnToken = key->getBooleanValue(CKA_TOKEN, false);
+	CK_BBOOL isPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+
+	// Check read user credentials
+	CK_RV rv = haveRead(session->getState(), isOnToken, isPrivate);
+	if (rv != CKR_OK)
+	{
+		if (rv == CKR_USER_NOT_LOGGED_IN)
+		{
+			// INFO_MSG("User is not authorized");
+		}
+
+		return rv;
+	}
+
+	// Check if key can be used for verifying
+	if (!key->getBooleanValue(CKA_VERIFY, false))
+		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+
+	// Check if the specified mechanism is allowed for the key
+	if (!isMechanismPermitted(key, pMechanism))
+		return CKR_MECHANISM_INVALID;
+
+	// Get the asymmetric algorithm matching the mechanism
+	AsymMech::Type mechanism = AsymMech::Unknown;
+	void* param = NULL;
+	size_t paramLen = 0;
+	RSA_PKCS_PSS_PARAMS pssParam;
+	bool bAllowMultiPartOp;
+	bool isRSA = false;
+#if 0 //Unsupported by Crypto API Toolkit
+	bool isDSA = false;
+#endif // Unsupported by Crypto API Toolkit
+#ifdef WITH_ECC
+	bool isECDSA = false;
+#endif
+#ifdef WITH_EDDSA
+	bool isEDDSA = false;
+#endif
+	switch(pMechanism->mechanism) {
+		case CKM_RSA_PKCS:
+			mechanism = AsymMech::RSA_PKCS;
+			bAllowMultiPartOp = false;
+			isRSA = true;
+			break;
+		case CKM_RSA_X_509:
+			mechanism = AsymMech::RSA;
+			bAllowMultiPartOp = false;
+			isRSA = true;
+			break;
+#ifndef WITH_FIPS
+		case CKM_MD5_RSA_PKCS:
+			mechanism = AsymMech::RSA_MD5_PKCS;
+			bAllowMultiPartOp = true;
+			isRSA = true;
+			break;
+#endif
 		case CKM_SHA1_RSA_PKCS:
 			mechanism = AsymMech::RSA_SHA1_PKCS;
 			bAllowMultiPartOp = true;
@@ -5121,45 +7546,43 @@ CK_RV SoftHSM::AsymSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechan
 			if (pMechanism->pParameter == NULL_PTR ||
 			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS))
 			{
-				// ERROR_MSG("Invalid RSA-PSS parameters");
+				// ERROR_MSG("Invalid parameters");
 				return CKR_ARGUMENTS_BAD;
 			}
 			mechanism = AsymMech::RSA_PKCS_PSS;
-			unsigned long allowedMgf;
 
+			unsigned long expectedMgf;
 			switch(CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg) {
 				case CKM_SHA_1:
 					pssParam.hashAlg = HashAlgo::SHA1;
 					pssParam.mgf = AsymRSAMGF::MGF1_SHA1;
-					allowedMgf = CKG_MGF1_SHA1;
+					expectedMgf = CKG_MGF1_SHA1;
 					break;
 				case CKM_SHA224:
 					pssParam.hashAlg = HashAlgo::SHA224;
 					pssParam.mgf = AsymRSAMGF::MGF1_SHA224;
-					allowedMgf = CKG_MGF1_SHA224;
+					expectedMgf = CKG_MGF1_SHA224;
 					break;
 				case CKM_SHA256:
 					pssParam.hashAlg = HashAlgo::SHA256;
 					pssParam.mgf = AsymRSAMGF::MGF1_SHA256;
-					allowedMgf = CKG_MGF1_SHA256;
+					expectedMgf = CKG_MGF1_SHA256;
 					break;
 				case CKM_SHA384:
 					pssParam.hashAlg = HashAlgo::SHA384;
 					pssParam.mgf = AsymRSAMGF::MGF1_SHA384;
-					allowedMgf = CKG_MGF1_SHA384;
+					expectedMgf = CKG_MGF1_SHA384;
 					break;
 				case CKM_SHA512:
 					pssParam.hashAlg = HashAlgo::SHA512;
 					pssParam.mgf = AsymRSAMGF::MGF1_SHA512;
-					allowedMgf = CKG_MGF1_SHA512;
+					expectedMgf = CKG_MGF1_SHA512;
 					break;
 				default:
-					// ERROR_MSG("Invalid RSA-PSS hash");
 					return CKR_ARGUMENTS_BAD;
 			}
 
-			if (CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != allowedMgf) {
-				// ERROR_MSG("Hash and MGF don't match");
+			if (CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != expectedMgf) {
 				return CKR_ARGUMENTS_BAD;
 			}
 
@@ -5323,42 +7746,42 @@ CK_RV SoftHSM::AsymSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechan
 	}
 
 	AsymmetricAlgorithm* asymCrypto = NULL;
-	PrivateKey* privateKey = NULL;
+	PublicKey* publicKey = NULL;
 	if (isRSA)
 	{
 		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::RSA);
 		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
 
-		privateKey = asymCrypto->newPrivateKey();
-		if (privateKey == NULL)
+		publicKey = asymCrypto->newPublicKey();
+		if (publicKey == NULL)
 		{
 			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
 			return CKR_HOST_MEMORY;
 		}
 
-		if (getRSAPrivateKey((RSAPrivateKey*)privateKey, token, key) != CKR_OK)
+		if (getRSAPublicKey((RSAPublicKey*)publicKey, token, key) != CKR_OK)
 		{
-			asymCrypto->recyclePrivateKey(privateKey);
+			asymCrypto->recyclePublicKey(publicKey);
 			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
 			return CKR_GENERAL_ERROR;
 		}
 	}
-#if 0 // Unsupported by Crypto API Toolki
+#if 0 // Unsupported by Crypto API Toolkit
 	else if (isDSA)
 	{
 		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::DSA);
 		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
 
-		privateKey = asymCrypto->newPrivateKey();
-		if (privateKey == NULL)
+		publicKey = asymCrypto->newPublicKey();
+		if (publicKey == NULL)
 		{
 			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
 			return CKR_HOST_MEMORY;
 		}
 
-		if (getDSAPrivateKey((DSAPrivateKey*)privateKey, token, key) != CKR_OK)
+		if (getDSAPublicKey((DSAPublicKey*)publicKey, token, key) != CKR_OK)
 		{
-			asymCrypto->recyclePrivateKey(privateKey);
+			asymCrypto->recyclePublicKey(publicKey);
 			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
 			return CKR_GENERAL_ERROR;
 		}
@@ -5370,16 +7793,16 @@ CK_RV SoftHSM::AsymSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechan
 		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::ECDSA);
 		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
 
-		privateKey = asymCrypto->newPrivateKey();
-		if (privateKey == NULL)
+		publicKey = asymCrypto->newPublicKey();
+		if (publicKey == NULL)
 		{
 			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
 			return CKR_HOST_MEMORY;
 		}
 
-		if (getECPrivateKey((ECPrivateKey*)privateKey, token, key) != CKR_OK)
+		if (getECPublicKey((ECPublicKey*)publicKey, token, key) != CKR_OK)
 		{
-			asymCrypto->recyclePrivateKey(privateKey);
+			asymCrypto->recyclePublicKey(publicKey);
 			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
 			return CKR_GENERAL_ERROR;
 		}
@@ -5391,16 +7814,16 @@ CK_RV SoftHSM::AsymSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechan
 		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::EDDSA);
 		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
 
-		privateKey = asymCrypto->newPrivateKey();
-		if (privateKey == NULL)
+		publicKey = asymCrypto->newPublicKey();
+		if (publicKey == NULL)
 		{
 			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
 			return CKR_HOST_MEMORY;
 		}
 
-		if (getEDPrivateKey((EDPrivateKey*)privateKey, token, key) != CKR_OK)
+		if (getEDPublicKey((EDPublicKey*)publicKey, token, key) != CKR_OK)
 		{
-			asymCrypto->recyclePrivateKey(privateKey);
+			asymCrypto->recyclePublicKey(publicKey);
 			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
 			return CKR_GENERAL_ERROR;
 		}
@@ -5408,57 +7831,52 @@ CK_RV SoftHSM::AsymSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechan
 #endif
 	else
 	{
-#ifdef WITH_GOST
 #if 0 // Unsupported by Crypto API Toolkit
+#ifdef WITH_GOST
 		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::GOST);
 		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
 
-		privateKey = asymCrypto->newPrivateKey();
-		if (privateKey == NULL)
+		publicKey = asymCrypto->newPublicKey();
+		if (publicKey == NULL)
 		{
 			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
 			return CKR_HOST_MEMORY;
 		}
 
-		if (getGOSTPrivateKey((GOSTPrivateKey*)privateKey, token, key) != CKR_OK)
+		if (getGOSTPublicKey((GOSTPublicKey*)publicKey, token, key) != CKR_OK)
 		{
-			asymCrypto->recyclePrivateKey(privateKey);
+			asymCrypto->recyclePublicKey(publicKey);
 			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
 			return CKR_GENERAL_ERROR;
 		}
-#endif // Unsupported by Crypto API Toolkit
 #else
 		return CKR_MECHANISM_INVALID;
 #endif
+#endif // Unsupported by Crypto API Toolkit
+        return CKR_MECHANISM_INVALID;
     }
 
-	// Initialize signing
-	if (bAllowMultiPartOp && !asymCrypto->signInit(privateKey,mechanism,param,paramLen))
+	// Initialize verifying
+	if (bAllowMultiPartOp && !asymCrypto->verifyInit(publicKey,mechanism,param,paramLen))
 	{
-		asymCrypto->recyclePrivateKey(privateKey);
+		asymCrypto->recyclePublicKey(publicKey);
 		CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
 		return CKR_MECHANISM_INVALID;
 	}
 
-	// Check if re-authentication is required
-	if (key->getBooleanValue(CKA_ALWAYS_AUTHENTICATE, false))
-	{
-		session->setReAuthentication(true);
-	}
-
-	session->setOpType(SESSION_OP_SIGN);
+	session->setOpType(SESSION_OP_VERIFY);
 	session->setAsymmetricCryptoOp(asymCrypto);
 	session->setMechanism(mechanism);
 	session->setParameters(param, paramLen);
 	session->setAllowMultiPartOp(bAllowMultiPartOp);
 	session->setAllowSinglePartOp(true);
-	session->setPrivateKey(privateKey);
+	session->setPublicKey(publicKey);
 
 	return CKR_OK;
 }
 
-// Initialise a signing operation using the specified key and mechanism
-CK_RV SoftHSM::C_SignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+// Initialise a verification operation using the specified key and mechanism
+CK_RV SoftHSM::C_VerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
 {
     if (pMechanism == nullptr) return CKR_ARGUMENTS_BAD;
 
@@ -5500,13 +7918,13 @@ CK_RV SoftHSM::C_SignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanis
     if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
     // Check if we have another operation
-    if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+    if (getDualOpType(session, SESSION_OP_VERIFY) == SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
 
     // Get the token
     Token* token = session->getToken();
     if (token == NULL) return CKR_GENERAL_ERROR;
 
-    // If the key is used for quote generation should not be used for signing
+    // If the key is used for quote generation should not be used for verifying
     OSObject *key = (OSObject *)handleManager->getObject(hKey);
     if (!key || !key->isValid())
     {
@@ -5515,20 +7933,20 @@ CK_RV SoftHSM::C_SignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanis
 
     CK_BBOOL isUsedForQuoteGeneration = key->getBooleanValue(CKA_USED_FOR_QUOTE_GENERATION, false);
 
-    if (isUsedForQuoteGeneration)
+    if(isUsedForQuoteGeneration)
     {
         return CKR_OBJECT_HANDLE_INVALID;
     }
 #endif
 
 	if (isMacMechanism(l_pMechanism))
-		return MacSignInit(hSession, l_pMechanism, hKey);
+		return MacVerifyInit(hSession, l_pMechanism, hKey);
 	else
-		return AsymSignInit(hSession, l_pMechanism, hKey);
+		return AsymVerifyInit(hSession, l_pMechanism, hKey);
 }
 
-// MacAlgorithm version of C_Sign
-static CK_RV MacSign(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+// MacAlgorithm version of C_Verify
+static CK_RV MacVerify(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
 {
 	MacAlgorithm* mac = session->getMacOp();
 	if (mac == NULL || !session->getAllowSinglePartOp())
@@ -5539,316 +7957,500 @@ static CK_RV MacSign(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK
 
 	// Size of the signature
 	CK_ULONG size = mac->getMacSize();
-	if (pSignature == NULL_PTR)
+
+	// Check buffer size
+	if (ulSignatureLen != size)
 	{
-		*pulSignatureLen = size;
-		return CKR_OK;
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
+		session->resetOp();
+		return CKR_SIGNATURE_LEN_RANGE;
+	}
+
+	// Get the data
+	ByteString data(pData, ulDataLen);
+
+	// Verify the data
+	if (!mac->verifyUpdate(data))
+	{
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	// Get the signature
+	ByteString signature(pSignature, ulSignatureLen);
+
+	// Verify the signature
+	if (!mac->verifyFinal(signature))
+	{
+		session->resetOp();
+		return CKR_SIGNATURE_INVALID;
+	}
+
+	session->resetOp();
+	return CKR_OK;
+}
+
+// AsymmetricAlgorithm version of C_Verify
+static CK_RV AsymVerify(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
+{
+	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
+	AsymMech::Type mechanism = session->getMechanism();
+	PublicKey* publicKey = session->getPublicKey();
+	size_t paramLen;
+	void* param = session->getParameters(paramLen);
+	if (asymCrypto == NULL || !session->getAllowSinglePartOp() || publicKey == NULL)
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
 	}
 
+	// Size of the signature
+	CK_ULONG size = publicKey->getOutputLength();
+
 	// Check buffer size
-	if (*pulSignatureLen < size)
+	if (ulSignatureLen != size)
+	{
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
+		session->resetOp();
+		return CKR_SIGNATURE_LEN_RANGE;
+	}
+
+	// Get the data
+	ByteString data;
+
+	// We must allow input length <= k and therfore need to prepend the data with zeroes.
+	if (mechanism == AsymMech::RSA) {
+		data.wipe(size-ulDataLen);
+	}
+
+	data += ByteString(pData, ulDataLen);
+	ByteString signature(pSignature, ulSignatureLen);
+
+	// Verify the data
+	if (session->getAllowMultiPartOp())
+	{
+		if (!asymCrypto->verifyUpdate(data) ||
+		    !asymCrypto->verifyFinal(signature))
+		{
+			session->resetOp();
+			return CKR_SIGNATURE_INVALID;
+		}
+	}
+	else if (!asymCrypto->verify(publicKey,data,signature,mechanism,param,paramLen))
+	{
+		session->resetOp();
+		return CKR_SIGNATURE_INVALID;
+	}
+
+	session->resetOp();
+	return CKR_OK;
+}
+
+// Perform a single pass verification operation
+CK_RV SoftHSM::C_Verify(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pData == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pSignature == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (ulDataLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
+
+    if (!validate_user_check_ptr(pData, ulDataLen))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
+
+	if (ulSignatureLen)
+	{
+		if (!validate_user_check_ptr(pSignature, ulSignatureLen))
+		{
+			return CKR_DEVICE_MEMORY;
+		}
+	}
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_VERIFY)
+		return CKR_OPERATION_NOT_INITIALIZED;
+
+	if (session->getMacOp() != NULL)
+		return MacVerify(session, pData, ulDataLen,
+				 pSignature, ulSignatureLen);
+	else
+		return AsymVerify(session, pData, ulDataLen,
+				  pSignature, ulSignatureLen);
+}
+
+// MacAlgorithm version of C_VerifyUpdate
+static CK_RV MacVerifyUpdate(Session* session, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+{
+	MacAlgorithm* mac = session->getMacOp();
+	if (mac == NULL || !session->getAllowMultiPartOp())
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Get the part
+	ByteString part(pPart, ulPartLen);
+
+	// Verify the data
+	if (!mac->verifyUpdate(part))
+	{
+		// verifyUpdate can't fail for a logical reason, so we assume total breakdown.
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	session->setAllowSinglePartOp(false);
+	return CKR_OK;
+}
+
+// AsymmetricAlgorithm version of C_VerifyUpdate
+static CK_RV AsymVerifyUpdate(Session* session, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+{
+	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
+	if (asymCrypto == NULL || !session->getAllowMultiPartOp())
+	{
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
+	}
+
+	// Get the part
+	ByteString part(pPart, ulPartLen);
+
+	// Verify the data
+	if (!asymCrypto->verifyUpdate(part))
+	{
+		// verifyUpdate can't fail for a logical reason, so we assume total breakdown.
+		session->resetOp();
+		return CKR_GENERAL_ERROR;
+	}
+
+	session->setAllowSinglePartOp(false);
+	return CKR_OK;
+}
+
+// Update a running verification operation with additional data
+CK_RV SoftHSM::C_VerifyUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pPart == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (ulPartLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
+
+    if (!validate_user_check_ptr(pPart, ulPartLen))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_VERIFY)
+		return CKR_OPERATION_NOT_INITIALIZED;
+
+	if (session->getMacOp() != NULL)
+		return MacVerifyUpdate(session, pPart, ulPartLen);
+	else
+		return AsymVerifyUpdate(session, pPart, ulPartLen);
+}
+
+// MacAlgorithm version of C_SignFinal
+static CK_RV MacVerifyFinal(Session* session, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
+{
+	MacAlgorithm* mac = session->getMacOp();
+	if (mac == NULL)
 	{
-		*pulSignatureLen = size;
-		return CKR_BUFFER_TOO_SMALL;
+		session->resetOp();
+		return CKR_OPERATION_NOT_INITIALIZED;
 	}
 
-	// Get the data
-	ByteString data(pData, ulDataLen);
+	// Size of the signature
+	CK_ULONG size = mac->getMacSize();
 
-	// Sign the data
-	if (!mac->signUpdate(data))
+	// Check buffer size
+	if (ulSignatureLen != size)
 	{
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
 		session->resetOp();
-		return CKR_GENERAL_ERROR;
+		return CKR_SIGNATURE_LEN_RANGE;
 	}
 
 	// Get the signature
-	ByteString signature;
-	if (!mac->signFinal(signature))
-	{
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
-	}
+	ByteString signature(pSignature, ulSignatureLen);
 
-	// Check size
-	if (signature.size() != size)
+	// Verify the data
+	if (!mac->verifyFinal(signature))
 	{
-		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
 		session->resetOp();
-		return CKR_GENERAL_ERROR;
+		return CKR_SIGNATURE_INVALID;
 	}
-    memcpy_s(pSignature, *pulSignatureLen, signature.byte_str(), size);
-	*pulSignatureLen = size;
 
-	session->resetOp();
+	session->finishMacOp();
 	return CKR_OK;
 }
 
-// AsymmetricAlgorithm version of C_Sign
-static CK_RV AsymSign(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+// AsymmetricAlgorithm version of C_VerifyFinal
+static CK_RV AsymVerifyFinal(Session* session, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
 {
 	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
-	AsymMech::Type mechanism = session->getMechanism();
-	PrivateKey* privateKey = session->getPrivateKey();
-	size_t paramLen;
-	void* param = session->getParameters(paramLen);
-	
-	if (asymCrypto == NULL || !session->getAllowSinglePartOp() || privateKey == NULL)
+	PublicKey* publicKey = session->getPublicKey();
+	if (asymCrypto == NULL || publicKey == NULL)
 	{
 		session->resetOp();
 		return CKR_OPERATION_NOT_INITIALIZED;
 	}
 
-	// Check if re-authentication is required
-	if (session->getReAuthentication())
-	{
-		session->resetOp();
-		return CKR_USER_NOT_LOGGED_IN;
-	}
-
 	// Size of the signature
-	CK_ULONG size = privateKey->getOutputLength();
-	if (pSignature == NULL_PTR)
-	{
-		*pulSignatureLen = size;
-		return CKR_OK;
-	}
+	CK_ULONG size = publicKey->getOutputLength();
 
 	// Check buffer size
-	if (*pulSignatureLen < size)
+	if (ulSignatureLen != size)
 	{
-		*pulSignatureLen = size;
-		return CKR_BUFFER_TOO_SMALL;
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
+		session->resetOp();
+		return CKR_SIGNATURE_LEN_RANGE;
 	}
 
 	// Get the data
-	ByteString data;
+	ByteString signature(pSignature, ulSignatureLen);
 
-	// We must allow input length <= k and therfore need to prepend the data with zeroes.
-	if (mechanism == AsymMech::RSA) {
-		data.wipe(size-ulDataLen);
+	// Verify the data
+	if (!asymCrypto->verifyFinal(signature))
+	{
+		session->resetOp();
+		return CKR_SIGNATURE_INVALID;
 	}
 
-	data += ByteString(pData, ulDataLen);
-	ByteString signature;
+	session->resetOp();
+	return CKR_OK;
+}
 
-	// Sign the data
-	if (session->getAllowMultiPartOp())
+// Finalise the verification operation and check the signature
+CK_RV SoftHSM::C_VerifyFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pSignature == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (ulSignatureLen)
 	{
-		if (!asymCrypto->signUpdate(data) ||
-		    !asymCrypto->signFinal(signature))
+		if (!validate_user_check_ptr(pSignature, ulSignatureLen))
 		{
-			session->resetOp();
-			return CKR_GENERAL_ERROR;
+			return CKR_DEVICE_MEMORY;
 		}
 	}
-	else if (!asymCrypto->sign(privateKey,data,signature,mechanism,param,paramLen))
-	{
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
-	}
 
-	// Check size
-	if (signature.size() != size)
-	{
-		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
-	}
-    memcpy_s(pSignature, *pulSignatureLen, signature.byte_str(), size);
-	*pulSignatureLen = size;
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
 
-	session->resetOp();
-	return CKR_OK;
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if ((session->getOpType() != SESSION_OP_VERIFY &&
+	     session->getOpType() != SESSION_OP_DECRYPT_VERIFY) || !session->getAllowMultiPartOp())
+		return CKR_OPERATION_NOT_INITIALIZED;
+
+	if (session->getMacOp() != NULL)
+		return MacVerifyFinal(session, pSignature, ulSignatureLen);
+	else
+		return AsymVerifyFinal(session, pSignature, ulSignatureLen);
 }
 
-static CK_RV ECTLSSign(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+// Initialise a verification operation the allows recovery of the signed data from the signature
+CK_RV SoftHSM::C_VerifyRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR /*pMechanism*/, CK_OBJECT_HANDLE /*hKey*/)
 {
-	AsymMech::Type mechanism = session->getMechanism();
-	PrivateKey* privateKey = session->getPrivateKey();
-	size_t paramLen;
-	void* param = session->getParameters(paramLen);
-	
-	if (!session->getAllowSinglePartOp() || privateKey == NULL)
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we have another operation
+	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+// Perform a single part verification operation and recover the signed data
+CK_RV SoftHSM::C_VerifyRecover(CK_SESSION_HANDLE hSession, CK_BYTE_PTR /*pSignature*/, CK_ULONG /*ulSignatureLen*/, CK_BYTE_PTR /*pData*/, CK_ULONG_PTR /*pulDataLen*/)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+// MacAlgorithm version of C_VerifyMessage
+static CK_RV MacVerifyMessage(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
+{
+	MacAlgorithm* mac = session->getMacOp();
+	SymmetricKey* key = session->getMacKey();
+	if (mac == NULL || key == NULL)
 	{
 		session->resetOp();
 		return CKR_OPERATION_NOT_INITIALIZED;
 	}
 
-	// Check if re-authentication is required
-	if (session->getReAuthentication())
+	// Check buffer size
+	if (ulSignatureLen != mac->getMacSize())
 	{
-		session->resetOp();
-		return CKR_USER_NOT_LOGGED_IN;
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
+		return CKR_SIGNATURE_LEN_RANGE;
 	}
 
-	OSSLECPrivateKey* pk = (OSSLECPrivateKey*) privateKey;
-	EC_KEY* eckey = pk->getOSSLKey();
+	// Get the data
+	ByteString data(pData, ulDataLen);
 
-	if (eckey == NULL)
+	// Verify the data
+	if (!mac->verifyUpdate(data))
 	{
-		// ERROR_MSG("Could not get the OpenSSL private key");
-
 		session->resetOp();
 		return CKR_GENERAL_ERROR;
 	}
 
-	CK_ULONG size = ECDSA_size(eckey);
-	if (pSignature == NULL_PTR)
-	{
-		*pulSignatureLen = size;
-		return CKR_OK;
-	}
+	// Get the signature
+	ByteString signature(pSignature, ulSignatureLen);
 
-	// Check buffer size
-	if (*pulSignatureLen < size)
+	// Verify the signature and re-key the MAC for the next message
+	bool verified = mac->verifyFinal(signature);
+	if (!mac->verifyInit(key))
 	{
-		*pulSignatureLen = size;
-		return CKR_BUFFER_TOO_SMALL;
-	}
-
-    unsigned int out_len;
-	 // Borrow "out" because it has been already initialized to the max_out size.
-    if (!ECDSA_sign(0, pData, ulDataLen, pSignature, &out_len, eckey)) {
 		session->resetOp();
 		return CKR_GENERAL_ERROR;
-    }
-
-    *pulSignatureLen = out_len;
+	}
 
-	session->resetOp();
-	return CKR_OK;
+	return verified ? CKR_OK : CKR_SIGNATURE_INVALID;
 }
 
-static CK_RV TLSSign(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+// AsymmetricAlgorithm version of C_VerifyMessage
+static CK_RV AsymVerifyMessage(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
 {
+	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
 	AsymMech::Type mechanism = session->getMechanism();
-	PrivateKey* privateKey = session->getPrivateKey();
+	PublicKey* publicKey = session->getPublicKey();
 	size_t paramLen;
 	void* param = session->getParameters(paramLen);
-	
-	if (!session->getAllowSinglePartOp() || privateKey == NULL)
+	if (asymCrypto == NULL || publicKey == NULL)
 	{
 		session->resetOp();
 		return CKR_OPERATION_NOT_INITIALIZED;
 	}
 
-	// Check if re-authentication is required
-	if (session->getReAuthentication())
-	{
-		session->resetOp();
-		return CKR_USER_NOT_LOGGED_IN;
-	}
-
 	// Size of the signature
-	CK_ULONG size = privateKey->getOutputLength();
-	if (pSignature == NULL_PTR)
-	{
-		*pulSignatureLen = size;
-		return CKR_OK;
-	}
+	CK_ULONG size = publicKey->getOutputLength();
 
 	// Check buffer size
-	if (*pulSignatureLen < size)
+	if (ulSignatureLen != size)
 	{
-		*pulSignatureLen = size;
-		return CKR_BUFFER_TOO_SMALL;
-	}
-	
-	OSSLRSAPrivateKey* osslKey = (OSSLRSAPrivateKey*) privateKey;
-	RSA* rsa = osslKey->getOSSLKey();
-	EVP_PKEY *rsa_pkey = EVP_PKEY_new();
-	if (rsa_pkey)
-		 EVP_PKEY_assign_RSA(rsa_pkey,rsa);
-	else{ 
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
+		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
+		return CKR_SIGNATURE_LEN_RANGE;
 	}
 
-	// get digest function
-    const EVP_MD *md_func = EVP_sha256();
-	if (!md_func) {
-		session->resetOp();
-        return CKR_GENERAL_ERROR;
-    }
+	// Get the data
+	ByteString data;
 
-	// digest sign
-    
-    EVP_PKEY_CTX *pctx;
+	// We must allow input length <= k and therfore need to prepend the data with zeroes.
+	if (mechanism == AsymMech::RSA) {
+		if (ulDataLen > size) return CKR_DATA_LEN_RANGE;
+		data.wipe(size-ulDataLen);
+	}
+
+	data += ByteString(pData, ulDataLen);
+	ByteString signature(pSignature, ulSignatureLen);
 
-	EVP_MD_CTX* ctx = EVP_MD_CTX_new();
-	if (ctx == NULL)
+	// Verify the data; hashing mechanisms are set up again for the next message
+	if (session->getAllowMultiPartOp())
 	{
-		// ERROR_MSG("Failed to allocate space for EVP_MD_CTX");
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
-	}
-    if (!EVP_DigestSignInit(ctx, &pctx, md_func, nullptr, rsa_pkey)) {
-		EVP_MD_CTX_free(ctx);
-		session->resetOp();
-        return CKR_GENERAL_ERROR;
-    }
-    
-	if (!EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PSS_PADDING) ||
-		!EVP_PKEY_CTX_set_rsa_pss_saltlen(pctx, -1 /* salt len = hash len */)) {
-		EVP_MD_CTX_free(ctx);
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
+		if (!asymCrypto->verifyUpdate(data))
+		{
+			session->resetOp();
+			return CKR_GENERAL_ERROR;
+		}
+
+		bool verified = asymCrypto->verifyFinal(signature);
+		if (!asymCrypto->verifyInit(publicKey,mechanism,param,paramLen))
+		{
+			session->resetOp();
+			return CKR_GENERAL_ERROR;
+		}
+
+		return verified ? CKR_OK : CKR_SIGNATURE_INVALID;
 	}
 
-	ByteString signature;
-	signature.resize(size);
-	// Check size
-	if (signature.size() != size)
+	if (!asymCrypto->verify(publicKey,data,signature,mechanism,param,paramLen))
 	{
-		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
-		EVP_MD_CTX_free(ctx);
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
+		return CKR_SIGNATURE_INVALID;
 	}
 
-	if (!EVP_DigestSign(ctx, &signature[0], pulSignatureLen, pData, ulDataLen)) {
-		EVP_MD_CTX_free(ctx);
-		session->resetOp();
-        return CKR_GENERAL_ERROR;
-    }
+	return CKR_OK;
+}
 
-    memcpy_s(pSignature, *pulSignatureLen, signature.byte_str(), size);
-	*pulSignatureLen = size;
-    
+// Initialise message-based verification; the key stays loaded until C_MessageVerifyFinal
+CK_RV SoftHSM::C_MessageVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
-	EVP_MD_CTX_free(ctx);
-	session->resetOp();
-	return CKR_OK;
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Message-based operations do not pair up with a running operation
+	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+
+	CK_RV rv = C_VerifyInit(hSession, pMechanism, hKey);
+	if (rv != CKR_OK) return rv;
+
+	return setMessageOp(session, SESSION_OP_MESSAGE_VERIFY);
 }
 
-// Sign the data in a single pass operation
-CK_RV SoftHSM::C_Sign(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+// Verify one message with the key set up by C_MessageVerifyInit
+CK_RV SoftHSM::C_VerifyMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR /*pParameter*/, CK_ULONG /*ulParameterLen*/, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
 {
 	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
 	if (pData == NULL_PTR) return CKR_ARGUMENTS_BAD;
-	if (pulSignatureLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pSignature == NULL_PTR) return CKR_ARGUMENTS_BAD;
 
     if (ulDataLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
     {
         return CKR_ARGUMENTS_BAD;
     }
 
-	if (!validate_user_check_ptr(pData, ulDataLen))
-	{
-		return CKR_DEVICE_MEMORY;
-	}
-
-	if (!validate_user_check_ptr(pulSignatureLen, sizeof(CK_ULONG)))
-	{
-		return CKR_DEVICE_MEMORY;
-	}
-
-    CK_ULONG ulSignatureLen = *pulSignatureLen;
-    auto l_pulSignatureLen = &ulSignatureLen;
+    if (!validate_user_check_ptr(pData, ulDataLen))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
 
-	if (pSignature && ulSignatureLen)
+	if (ulSignatureLen)
 	{
 		if (!validate_user_check_ptr(pSignature, ulSignatureLen))
 		{
@@ -5865,92 +8467,326 @@ CK_RV SoftHSM::C_Sign(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ul
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
 	// Check if we are doing the correct operation
-	if (session->getOpType() != SESSION_OP_SIGN)
+	if (session->getOpType() != SESSION_OP_MESSAGE_VERIFY)
 		return CKR_OPERATION_NOT_INITIALIZED;
 
-    CK_RV rv;
-	AsymMech::Type mechanism = session->getMechanism();
-	if(mechanism == AsymMech::RSA_SHA256_PKCS_PSS_TLS)
-		rv = TLSSign(session, pData, ulDataLen,
-				pSignature, l_pulSignatureLen);
-	else if(mechanism == AsymMech::ECDSA_TLS_SHA256)
-		rv = ECTLSSign(session, pData, ulDataLen,
-				pSignature, l_pulSignatureLen);
-	else{
-		if (session->getMacOp() != NULL)
-			rv = MacSign(session, pData, ulDataLen,
-			       pSignature, l_pulSignatureLen);
-		else
-			rv = AsymSign(session, pData, ulDataLen,
-					pSignature, l_pulSignatureLen);
+	if (session->getMacOp() != NULL)
+		return MacVerifyMessage(session, pData, ulDataLen,
+					pSignature, ulSignatureLen);
+	else
+		return AsymVerifyMessage(session, pData, ulDataLen,
+					 pSignature, ulSignatureLen);
+}
+
+// Finish message-based verification and release the key
+CK_RV SoftHSM::C_MessageVerifyFinal(CK_SESSION_HANDLE hSession)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_MESSAGE_VERIFY) return CKR_OPERATION_NOT_INITIALIZED;
+
+	session->resetOp();
+
+	return CKR_OK;
+}
+
+// The algorithms and public keys used by one C_VerifyBatch call
+struct VerifyBatchState
+{
+	// A public key taken from the public key cache or built for the batch
+	struct BatchKey
+	{
+		ByteString fingerprint;
+		PublicKey* publicKey;
+	};
+
+	// One algorithm instance per algorithm
+	std::map<AsymAlgo::Type, AsymmetricAlgorithm*> algorithms;
+
+	// The public keys by key object and algorithm
+	std::map<std::pair<OSObject*, AsymAlgo::Type>, BatchKey> keys;
+};
+
+// Get the algorithm and key type of a C_VerifyBatch mechanism
+static bool getVerifyBatchMech(CK_MECHANISM_TYPE type, AsymMech::Type& mechanism, AsymAlgo::Type& algorithm, CK_KEY_TYPE& keyType)
+{
+	algorithm = AsymAlgo::RSA;
+	keyType = CKK_RSA;
+
+	switch(type) {
+		case CKM_RSA_PKCS:
+			mechanism = AsymMech::RSA_PKCS;
+			return true;
+		case CKM_RSA_X_509:
+			mechanism = AsymMech::RSA;
+			return true;
+#ifndef WITH_FIPS
+		case CKM_MD5_RSA_PKCS:
+			mechanism = AsymMech::RSA_MD5_PKCS;
+			return true;
+#endif
+		case CKM_SHA1_RSA_PKCS:
+			mechanism = AsymMech::RSA_SHA1_PKCS;
+			return true;
+		case CKM_SHA224_RSA_PKCS:
+			mechanism = AsymMech::RSA_SHA224_PKCS;
+			return true;
+		case CKM_SHA256_RSA_PKCS:
+			mechanism = AsymMech::RSA_SHA256_PKCS;
+			return true;
+		case CKM_SHA384_RSA_PKCS:
+			mechanism = AsymMech::RSA_SHA384_PKCS;
+			return true;
+		case CKM_SHA512_RSA_PKCS:
+			mechanism = AsymMech::RSA_SHA512_PKCS;
+			return true;
+#ifdef WITH_ECC
+		case CKM_ECDSA:
+			mechanism = AsymMech::ECDSA;
+			algorithm = AsymAlgo::ECDSA;
+			keyType = CKK_EC;
+			return true;
+#endif
+#ifdef WITH_EDDSA
+		case CKM_EDDSA:
+			mechanism = AsymMech::EDDSA;
+			algorithm = AsymAlgo::EDDSA;
+			keyType = CKK_EC_EDWARDS;
+			return true;
+#endif
+		default:
+			return false;
 	}
+}
 
-    *pulSignatureLen = ulSignatureLen;
+// Encode the public key attributes of an object as stored; a cached public
+// key is only used while the attributes encode to the same value
+static ByteString getPublicKeyFingerprint(OSObject* key, CK_KEY_TYPE keyType)
+{
+	ByteString first;
+	ByteString second;
 
-    return rv;
+	if (keyType == CKK_RSA)
+	{
+		first = key->getByteStringValue(CKA_MODULUS);
+		second = key->getByteStringValue(CKA_PUBLIC_EXPONENT);
+	}
+	else
+	{
+		first = key->getByteStringValue(CKA_EC_PARAMS);
+		second = key->getByteStringValue(CKA_EC_POINT);
+	}
+
+	return ByteString((unsigned long)first.size()) + first + second;
 }
 
-// MacAlgorithm version of C_SignUpdate
-static CK_RV MacSignUpdate(Session* session, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+// Verify one signature of a C_VerifyBatch call
+CK_RV SoftHSM::VerifyBatchItem(Session* session, CK_VERIFY_BATCH_ITEM& item, VerifyBatchState& state)
 {
-	MacAlgorithm* mac = session->getMacOp();
-	if (mac == NULL || !session->getAllowMultiPartOp())
+	AsymMech::Type mechanism = AsymMech::Unknown;
+	AsymAlgo::Type algorithm = AsymAlgo::Unknown;
+	CK_KEY_TYPE keyType = CKK_VENDOR_DEFINED;
+	if (!getVerifyBatchMech(item.mechanism, mechanism, algorithm, keyType))
+		return CKR_MECHANISM_INVALID;
+
+	if (item.pData == NULL_PTR || item.pSignature == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+	if (item.ulDataLen > CKM_MAX_CRYPTO_OP_INPUT_LEN || item.ulSignatureLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
 	{
-		session->resetOp();
-		return CKR_OPERATION_NOT_INITIALIZED;
+		return CKR_ARGUMENTS_BAD;
 	}
 
-	// Get the part
-	ByteString part(pPart, ulPartLen);
+	if ((item.ulDataLen && !validate_user_check_ptr(item.pData, item.ulDataLen)) ||
+	    (item.ulSignatureLen && !validate_user_check_ptr(item.pSignature, item.ulSignatureLen)))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
 
-	// Sign the data
-	if (!mac->signUpdate(part))
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Check the key handle.
+	OSObject *key = (OSObject *)handleManager->getObject(item.hKey);
+	if (key == NULL_PTR || !key->isValid()) return CKR_OBJECT_HANDLE_INVALID;
+
+#ifdef DCAP_SUPPORT
+	// A key used for quote generation is not used for verifying
+	if (key->getBooleanValue(CKA_USED_FOR_QUOTE_GENERATION, false)) return CKR_OBJECT_HANDLE_INVALID;
+#endif
+
+	CK_BBOOL isOnToken = key->getBooleanValue(CKA_TOKEN, false);
+	CK_BBOOL isPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+
+	// Check read user credentials
+	CK_RV rv = haveRead(session->getState(), isOnToken, isPrivate);
+	if (rv != CKR_OK) return rv;
+
+	// Check if key can be used for verifying
+	if (!key->getBooleanValue(CKA_VERIFY, false))
+		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+
+	// Check if the specified mechanism is allowed for the key
+	CK_MECHANISM checkMechanism = { item.mechanism, NULL_PTR, 0 };
+	if (!isMechanismPermitted(key, &checkMechanism))
+		return CKR_MECHANISM_INVALID;
+
+	if (key->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != keyType)
+		return CKR_KEY_TYPE_INCONSISTENT;
+
+	// All signatures of an algorithm share one instance
+	AsymmetricAlgorithm* asymCrypto = state.algorithms[algorithm];
+	if (asymCrypto == NULL)
 	{
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
+		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(algorithm);
+		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
+
+		state.algorithms[algorithm] = asymCrypto;
+	}
+
+	// Get the public key: from this batch, from the cache or from the object
+	std::pair<OSObject*, AsymAlgo::Type> tag(key, algorithm);
+	PublicKey* publicKey = NULL;
+	std::map<std::pair<OSObject*, AsymAlgo::Type>, VerifyBatchState::BatchKey>::iterator batchKey = state.keys.find(tag);
+	if (batchKey != state.keys.end())
+	{
+		publicKey = batchKey->second.publicKey;
+	}
+	else
+	{
+		Token* token = session->getToken();
+		if (token == NULL) return CKR_GENERAL_ERROR;
+
+		ByteString fingerprint = getPublicKeyFingerprint(key, keyType);
+
+		PublicKeyCache* cache = CryptoFactory::i()->getPublicKeyCache();
+		if (cache != NULL)
+		{
+			publicKey = cache->take(key, algorithm, fingerprint);
+		}
+
+		if (publicKey == NULL)
+		{
+			publicKey = asymCrypto->newPublicKey();
+			if (publicKey == NULL) return CKR_HOST_MEMORY;
+
+			if (algorithm == AsymAlgo::RSA)
+				rv = getRSAPublicKey((RSAPublicKey*)publicKey, token, key);
+#ifdef WITH_ECC
+			else if (algorithm == AsymAlgo::ECDSA)
+				rv = getECPublicKey((ECPublicKey*)publicKey, token, key);
+#endif
+#ifdef WITH_EDDSA
+			else if (algorithm == AsymAlgo::EDDSA)
+				rv = getEDPublicKey((EDPublicKey*)publicKey, token, key);
+#endif
+			else
+				rv = CKR_MECHANISM_INVALID;
+
+			if (rv != CKR_OK)
+			{
+				asymCrypto->recyclePublicKey(publicKey);
+				return CKR_GENERAL_ERROR;
+			}
+		}
+
+		VerifyBatchState::BatchKey& added = state.keys[tag];
+		added.fingerprint = fingerprint;
+		added.publicKey = publicKey;
+	}
+
+	// Size of the signature
+	CK_ULONG size = publicKey->getOutputLength();
+
+	// Check buffer size
+	if (item.ulSignatureLen != size) return CKR_SIGNATURE_LEN_RANGE;
+
+	// Get the data
+	ByteString data;
+
+	// We must allow input length <= k and therfore need to prepend the data with zeroes.
+	if (mechanism == AsymMech::RSA) {
+		if (item.ulDataLen > size) return CKR_DATA_LEN_RANGE;
+		data.wipe(size-item.ulDataLen);
 	}
 
-	session->setAllowSinglePartOp(false);
+	data += ByteString(item.pData, item.ulDataLen);
+	ByteString signature(item.pSignature, item.ulSignatureLen);
+
+	// Verify the signature
+	if (!asymCrypto->verify(publicKey,data,signature,mechanism))
+		return CKR_SIGNATURE_INVALID;
+
 	return CKR_OK;
 }
 
-// AsymmetricAlgorithm version of C_SignUpdate
-static CK_RV AsymSignUpdate(Session* session, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+// Verify a batch of signatures, each with its own key and mechanism, without an active verify operation
+CK_RV SoftHSM::C_VerifyBatch(CK_SESSION_HANDLE hSession, CK_VERIFY_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
 {
-	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
-	if (asymCrypto == NULL || !session->getAllowMultiPartOp())
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pItems == NULL_PTR || ulCount == 0 || ulCount > CKM_MAX_MESSAGE_BATCH) return CKR_ARGUMENTS_BAD;
+
+	if (!validate_user_check_ptr(pItems, ulCount * sizeof(CK_VERIFY_BATCH_ITEM)))
 	{
-		session->resetOp();
-		return CKR_OPERATION_NOT_INITIALIZED;
+		return CKR_DEVICE_MEMORY;
 	}
 
-	// Check if re-authentication is required
-	if (session->getReAuthentication())
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	VerifyBatchState state;
+	CK_RV batchRv = CKR_OK;
+
+	for (CK_ULONG i = 0; i < ulCount; i++)
 	{
-		session->resetOp();
-		return CKR_USER_NOT_LOGGED_IN;
+		// Work on a copy so the application cannot change the item meanwhile
+		CK_VERIFY_BATCH_ITEM item;
+		memcpy_s(&item, sizeof(CK_VERIFY_BATCH_ITEM), &pItems[i], sizeof(CK_VERIFY_BATCH_ITEM));
+
+		CK_RV rv = VerifyBatchItem(session, item, state);
+
+		pItems[i].rv = rv;
+
+		if (rv != CKR_OK && batchRv == CKR_OK) batchRv = rv;
 	}
 
-	// Get the part
-	ByteString part(pPart, ulPartLen);
+	// Keep the public keys for the next batch
+	PublicKeyCache* cache = CryptoFactory::i()->getPublicKeyCache();
+	std::map<std::pair<OSObject*, AsymAlgo::Type>, VerifyBatchState::BatchKey>::iterator k;
+	for (k = state.keys.begin(); k != state.keys.end(); k++)
+	{
+		if (cache != NULL)
+			cache->put(k->first.first, k->first.second, k->second.fingerprint, k->second.publicKey);
+		else
+			state.algorithms[k->first.second]->recyclePublicKey(k->second.publicKey);
+	}
 
-	// Sign the data
-	if (!asymCrypto->signUpdate(part))
+	std::map<AsymAlgo::Type, AsymmetricAlgorithm*>::iterator a;
+	for (a = state.algorithms.begin(); a != state.algorithms.end(); a++)
 	{
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
+		CryptoFactory::i()->recycleAsymmetricAlgorithm(a->second);
 	}
 
-	session->setAllowSinglePartOp(false);
-	return CKR_OK;
+	return batchRv;
 }
 
-// Update a running signing operation with additional data
-CK_RV SoftHSM::C_SignUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
+// Check the arguments of a dual-function update and take a copy of the
+// output buffer length
+static CK_RV checkDualCryptArgs(CK_BYTE_PTR pPart, CK_ULONG ulPartLen, CK_BYTE_PTR pOutPart, CK_ULONG_PTR pulOutPartLen, CK_ULONG& ulOutPartLen)
 {
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
-
 	if (pPart == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pulOutPartLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
 
     if (ulPartLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
     {
@@ -5962,148 +8798,171 @@ CK_RV SoftHSM::C_SignUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_UL
         return CKR_DEVICE_MEMORY;
     }
 
-#ifdef ENABLE_MITIGATION
-    __builtin_ia32_lfence();
-#endif
+    if (!validate_user_check_ptr(pulOutPartLen, sizeof(CK_ULONG)))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+    ulOutPartLen = *pulOutPartLen;
 
-	// Check if we are doing the correct operation
-	if (session->getOpType() != SESSION_OP_SIGN)
-		return CKR_OPERATION_NOT_INITIALIZED;
+	if (pOutPart && ulOutPartLen)
+	{
+		if (!validate_user_check_ptr(pOutPart, ulOutPartLen))
+		{
+			return CKR_DEVICE_MEMORY;
+		}
+	}
 
-	if (session->getMacOp() != NULL)
-		return MacSignUpdate(session, pPart, ulPartLen);
-	else
-		return AsymSignUpdate(session, pPart, ulPartLen);
+	return CKR_OK;
 }
 
-// MacAlgorithm version of C_SignFinal
-static CK_RV MacSignFinal(Session* session, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+// Feed one part through both halves of a dual-function operation. The part
+// is copied into the enclave once and the cipher and the digest or MAC all
+// work on that copy; the decrypting operations digest or verify the
+// plaintext that comes out of the cipher.
+static CK_RV DualCryptUpdate(Session* session, bool isEncrypt, CK_BYTE_PTR pPart, CK_ULONG ulPartLen, CK_BYTE_PTR pOutPart, CK_ULONG_PTR pulOutPartLen)
 {
+	SymmetricAlgorithm* cipher = session->getSymmetricCryptoOp();
+	HashAlgorithm* hash = session->getDigestOp();
 	MacAlgorithm* mac = session->getMacOp();
-	if (mac == NULL)
+	if (cipher == NULL || (hash == NULL && mac == NULL) || !session->getAllowMultiPartOp())
 	{
 		session->resetOp();
 		return CKR_OPERATION_NOT_INITIALIZED;
 	}
 
-	// Size of the signature
-	CK_ULONG size = mac->getMacSize();
-	if (pSignature == NULL_PTR)
+	// Check data size
+	CK_ULONG maxSize = isEncrypt ? SymEncryptUpdateSize(cipher, ulPartLen) : SymDecryptUpdateSize(cipher, ulPartLen);
+	if (!cipher->checkMaximumBytes(ulPartLen))
 	{
-		*pulSignatureLen = size;
+		session->resetOp();
+		return isEncrypt ? CKR_DATA_LEN_RANGE : CKR_ENCRYPTED_DATA_LEN_RANGE;
+	}
+
+	// Give required output buffer size; nothing is digested or MACed yet
+	if (pOutPart == NULL_PTR)
+	{
+		*pulOutPartLen = maxSize;
 		return CKR_OK;
 	}
 
-	// Check buffer size
-	if (*pulSignatureLen < size)
+	// Check output buffer size
+	if (*pulOutPartLen < maxSize)
 	{
-		*pulSignatureLen = size;
+		*pulOutPartLen = maxSize;
 		return CKR_BUFFER_TOO_SMALL;
 	}
 
-	// Get the signature
-	ByteString signature;
-	if (!mac->signFinal(signature))
+	// Get the part
+	ByteString part(pPart, ulPartLen);
+	ByteString outPart;
+
+	bool ok;
+	if (isEncrypt)
+	{
+		if (hash != NULL)
+			ok = hash->hashUpdate(part);
+		else
+			ok = mac->signUpdate(part);
+
+		ok = ok && cipher->encryptUpdate(part, outPart);
+	}
+	else
+	{
+		ok = cipher->decryptUpdate(part, outPart);
+
+		if (ok && hash != NULL)
+			ok = hash->hashUpdate(outPart);
+		else if (ok)
+			ok = mac->verifyUpdate(outPart);
+	}
+	if (!ok)
 	{
 		session->resetOp();
 		return CKR_GENERAL_ERROR;
 	}
 
-	// Check size
-	if (signature.size() != size)
+	// Check output size from crypto. Unrecoverable error if to large.
+	if (*pulOutPartLen < outPart.size())
 	{
-		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
 		session->resetOp();
+		// ERROR_MSG("Dual-function update returning too much data. Length of output data buffer is %i but %i bytes was returned by the cipher.",
+		//	  *pulOutPartLen, outPart.size());
 		return CKR_GENERAL_ERROR;
 	}
-    memcpy_s(pSignature, *pulSignatureLen, signature.byte_str(), size);
-	*pulSignatureLen = size;
 
-	session->resetOp();
+	if (outPart.size() > 0)
+	{
+        memcpy_s(pOutPart, *pulOutPartLen, outPart.byte_str(), outPart.size());
+	}
+	*pulOutPartLen = outPart.size();
+
+	session->setAllowSinglePartOp(false);
 	return CKR_OK;
 }
 
-// AsymmetricAlgorithm version of C_SignFinal
-static CK_RV AsymSignFinal(Session* session, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+// Update a running multi-part encryption and digesting operation
+CK_RV SoftHSM::C_DigestEncryptUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen, CK_BYTE_PTR pEncryptedPart, CK_ULONG_PTR pulEncryptedPartLen)
 {
-	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
-	PrivateKey* privateKey = session->getPrivateKey();
-	if (asymCrypto == NULL || privateKey == NULL)
-	{
-		session->resetOp();
-		return CKR_OPERATION_NOT_INITIALIZED;
-	}
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
-	// Check if re-authentication is required
-	if (session->getReAuthentication())
-	{
-		session->resetOp();
-		return CKR_USER_NOT_LOGGED_IN;
-	}
+	CK_ULONG ulOutPartLen;
+	CK_RV rv = checkDualCryptArgs(pPart, ulPartLen, pEncryptedPart, pulEncryptedPartLen, ulOutPartLen);
+	if (rv != CKR_OK) return rv;
 
-	// Size of the signature
-	CK_ULONG size = privateKey->getOutputLength();
-	if (pSignature == NULL_PTR)
-	{
-		*pulSignatureLen = size;
-		return CKR_OK;
-	}
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
 
-	// Check buffer size
-	if (*pulSignatureLen < size)
-	{
-		*pulSignatureLen = size;
-		return CKR_BUFFER_TOO_SMALL;
-	}
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
-	// Get the signature
-	ByteString signature;
-	if (!asymCrypto->signFinal(signature))
-	{
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
-	}
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_DIGEST_ENCRYPT) return CKR_OPERATION_NOT_INITIALIZED;
 
-	// Check size
-	if (signature.size() != size)
-	{
-		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
-	}
-    memcpy_s(pSignature, *pulSignatureLen, signature.byte_str(), size);
-	*pulSignatureLen = size;
+	rv = DualCryptUpdate(session, true, pPart, ulPartLen, pEncryptedPart, &ulOutPartLen);
 
-	session->resetOp();
-	return CKR_OK;
+	*pulEncryptedPartLen = ulOutPartLen;
+
+	return rv;
 }
 
-// Finalise a running signing operation and return the signature
-CK_RV SoftHSM::C_SignFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+// Update a running multi-part decryption and digesting operation
+CK_RV SoftHSM::C_DecryptDigestUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedPart, CK_ULONG ulEncryptedPartLen, CK_BYTE_PTR pPart, CK_ULONG_PTR pulPartLen)
 {
 	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
-	if (pulSignatureLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	CK_ULONG ulOutPartLen;
+	CK_RV rv = checkDualCryptArgs(pEncryptedPart, ulEncryptedPartLen, pPart, pulPartLen, ulOutPartLen);
+	if (rv != CKR_OK) return rv;
 
-    if (!validate_user_check_ptr(pulSignatureLen, sizeof(CK_ULONG)))
-    {
-        return CKR_DEVICE_MEMORY;
-    }
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
 
-    CK_ULONG ulSignatureLen = *pulSignatureLen;
-    auto l_pulSignatureLen = &ulSignatureLen;
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
-	if (pSignature && ulSignatureLen)
-	{
-		if (!validate_user_check_ptr(pSignature, ulSignatureLen))
-		{
-			return CKR_DEVICE_MEMORY;
-		}
-	}
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_DECRYPT_DIGEST) return CKR_OPERATION_NOT_INITIALIZED;
+
+	rv = DualCryptUpdate(session, false, pEncryptedPart, ulEncryptedPartLen, pPart, &ulOutPartLen);
+
+	*pulPartLen = ulOutPartLen;
+
+	return rv;
+}
+
+// Update a running multi-part signing and encryption operation
+CK_RV SoftHSM::C_SignEncryptUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen, CK_BYTE_PTR pEncryptedPart, CK_ULONG_PTR pulEncryptedPartLen)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	CK_ULONG ulOutPartLen;
+	CK_RV rv = checkDualCryptArgs(pPart, ulPartLen, pEncryptedPart, pulEncryptedPartLen, ulOutPartLen);
+	if (rv != CKR_OK) return rv;
 
 #ifdef ENABLE_MITIGATION
     __builtin_ia32_lfence();
@@ -6114,926 +8973,1149 @@ CK_RV SoftHSM::C_SignFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, C
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
 	// Check if we are doing the correct operation
-	if (session->getOpType() != SESSION_OP_SIGN || !session->getAllowMultiPartOp())
-		return CKR_OPERATION_NOT_INITIALIZED;
+	if (session->getOpType() != SESSION_OP_SIGN_ENCRYPT) return CKR_OPERATION_NOT_INITIALIZED;
 
-    CK_RV rv;
-	if (session->getMacOp() != NULL)
-		rv = MacSignFinal(session, pSignature, l_pulSignatureLen);
-	else
-		rv = AsymSignFinal(session, pSignature, l_pulSignatureLen);
+	rv = DualCryptUpdate(session, true, pPart, ulPartLen, pEncryptedPart, &ulOutPartLen);
 
-    *pulSignatureLen = ulSignatureLen;
+	*pulEncryptedPartLen = ulOutPartLen;
 
-    return rv;
+	return rv;
 }
 
-// Initialise a signing operation that allows recovery of the signed data
-CK_RV SoftHSM::C_SignRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR /*pMechanism*/, CK_OBJECT_HANDLE /*hKey*/)
+// Update a running multi-part decryption and verification operation
+CK_RV SoftHSM::C_DecryptVerifyUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedPart, CK_ULONG ulEncryptedPartLen, CK_BYTE_PTR pPart, CK_ULONG_PTR pulPartLen)
 {
 	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
+	CK_ULONG ulOutPartLen;
+	CK_RV rv = checkDualCryptArgs(pEncryptedPart, ulEncryptedPartLen, pPart, pulPartLen, ulOutPartLen);
+	if (rv != CKR_OK) return rv;
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
 	// Get the session
 	Session* session = (Session*)handleManager->getSession(hSession);
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
-	// Check if we have another operation
-	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+	// Check if we are doing the correct operation
+	if (session->getOpType() != SESSION_OP_DECRYPT_VERIFY) return CKR_OPERATION_NOT_INITIALIZED;
 
-	return CKR_FUNCTION_NOT_SUPPORTED;
+	rv = DualCryptUpdate(session, false, pEncryptedPart, ulEncryptedPartLen, pPart, &ulOutPartLen);
+
+	*pulPartLen = ulOutPartLen;
+
+	return rv;
 }
 
-// Perform a single part signing operation that allows recovery of the signed data
-CK_RV SoftHSM::C_SignRecover(CK_SESSION_HANDLE hSession, CK_BYTE_PTR /*pData*/, CK_ULONG /*ulDataLen*/, CK_BYTE_PTR /*pSignature*/, CK_ULONG_PTR /*pulSignatureLen*/)
+// Generate a secret key or a domain parameter set using the specified mechanism
+CK_RV SoftHSM::C_GenerateKey(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, CK_OBJECT_HANDLE_PTR phKey)
 {
+    CK_OBJECT_HANDLE hKey;
+    auto l_phKey = &hKey;
+
 	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (nullptr == pTemplate && 0 != ulCount)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
+
+	if (phKey == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (!validate_user_check_ptr(phKey, sizeof(CK_OBJECT_HANDLE)))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
+
+    if (ulCount > CKA_MAX_ATTRIBUTES)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
+
+	if (ulCount && !validate_user_check_attribute_ptr(pTemplate, ulCount))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+    CK_ATTRIBUTE l_template[ulCount];
+    memset_s(l_template, ulCount * sizeof(CK_ATTRIBUTE), 0x00, ulCount * sizeof(CK_ATTRIBUTE));
+    memcpy_s(l_template, ulCount * sizeof(CK_ATTRIBUTE), pTemplate, ulCount * sizeof(CK_ATTRIBUTE));
 
-	return CKR_FUNCTION_NOT_SUPPORTED;
-}
+    std::vector<std::vector<CK_BYTE>> value(ulCount);
 
-// MacAlgorithm version of C_VerifyInit
-CK_RV SoftHSM::MacVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
-{
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+    for (CK_ULONG i = 0; i < ulCount; i++)
+    {
+        if (l_template[i].pValue == nullptr)
+        {
+            continue;
+        }
 
-	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+        auto ulValueLen = l_template[i].ulValueLen;
+        if (!validate_user_check_ptr(l_template[i].pValue, ulValueLen))
+        {
+            return CKR_DEVICE_MEMORY;
+        }
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+        value[i].resize(ulValueLen);
+        memcpy_s(value[i].data(), ulValueLen, l_template[i].pValue, ulValueLen);
+        l_template[i].pValue = value[i].data();
+    }
 
-	// Check if we have another operation
-	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+    auto l_pTemplate = l_template;
 
-	// Get the token
-	Token* token = session->getToken();
-	if (token == NULL) return CKR_GENERAL_ERROR;
+	if (!validate_user_check_mechanism_ptr(pMechanism, 1))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
 
-	// Check the key handle.
-	OSObject *key = (OSObject *)handleManager->getObject(hKey);
-	if (key == NULL_PTR || !key->isValid()) return CKR_OBJECT_HANDLE_INVALID;
+    CK_MECHANISM l_mechanism;
+    memcpy_s(&l_mechanism, sizeof(CK_MECHANISM), pMechanism, sizeof(CK_MECHANISM));
 
-	CK_BBOOL isOnToken = key->getBooleanValue(CKA_TOKEN, false);
-	CK_BBOOL isPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+    auto ulParameterLen = l_mechanism.ulParameterLen;
 
-	// Check read user credentials
-	CK_RV rv = haveRead(session->getState(), isOnToken, isPrivate);
-	if (rv != CKR_OK)
-	{
-		if (rv == CKR_USER_NOT_LOGGED_IN)
-		{
-			// INFO_MSG("User is not authorized");
-		}
+    if (ulParameterLen > CKM_MAX_PARAMETER_LEN)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
 
-		return rv;
-	}
+    CK_BYTE parameter[ulParameterLen];
+    if (l_mechanism.pParameter != nullptr)
+    {
+        if (!validate_user_check_ptr(l_mechanism.pParameter, ulParameterLen))
+        {
+            return CKR_DEVICE_MEMORY;
+        }
 
-	// Check if key can be used for verifying
-	if (!key->getBooleanValue(CKA_VERIFY, false))
-		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+        memcpy_s(&parameter[0], ulParameterLen, l_mechanism.pParameter, ulParameterLen);
+        l_mechanism.pParameter = &parameter[0];
+    }
+    auto l_pMechanism = &l_mechanism;
 
-	// Check if the specified mechanism is allowed for the key
-	if (!isMechanismPermitted(key, pMechanism))
-		return CKR_MECHANISM_INVALID;
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
 
-	// Get key info
-	CK_KEY_TYPE keyType = key->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED);
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
-	// Get the MAC algorithm matching the mechanism
-	// Also check mechanism constraints
-	MacAlgo::Type algo = MacAlgo::Unknown;
-	size_t bb = 8;
-	size_t minSize = 0;
-	switch(pMechanism->mechanism) {
+	// Check the mechanism, only accept DSA and DH parameters
+	// and symmetric ciphers
+	CK_OBJECT_CLASS objClass;
+	CK_KEY_TYPE keyType;
+	switch (l_pMechanism->mechanism)
+	{
 #if 0 // Unsupported by Crypto API Toolkit
+		case CKM_DSA_PARAMETER_GEN:
+			objClass = CKO_DOMAIN_PARAMETERS;
+			keyType = CKK_DSA;
+			break;
+		case CKM_DH_PKCS_PARAMETER_GEN:
+			objClass = CKO_DOMAIN_PARAMETERS;
+			keyType = CKK_DH;
+			break;
 #ifndef WITH_FIPS
-		case CKM_MD5_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_MD5_HMAC)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 16;
-			algo = MacAlgo::HMAC_MD5;
+		case CKM_DES_KEY_GEN:
+			objClass = CKO_SECRET_KEY;
+			keyType = CKK_DES;
 			break;
 #endif
-		case CKM_SHA_1_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA_1_HMAC)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 20;
-			algo = MacAlgo::HMAC_SHA1;
+		case CKM_DES2_KEY_GEN:
+			objClass = CKO_SECRET_KEY;
+			keyType = CKK_DES2;
 			break;
-		case CKM_SHA224_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA224_HMAC)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 28;
-			algo = MacAlgo::HMAC_SHA224;
+		case CKM_DES3_KEY_GEN:
+			objClass = CKO_SECRET_KEY;
+			keyType = CKK_DES3;
 			break;
 #endif // Unsupported by Crypto API Toolkit
-		case CKM_SHA256_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA256_HMAC)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 32;
-			algo = MacAlgo::HMAC_SHA256;
-			break;
-		case CKM_SHA384_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA384_HMAC)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 48;
-			algo = MacAlgo::HMAC_SHA384;
-			break;
-		case CKM_SHA512_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_SHA512_HMAC)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 64;
-			algo = MacAlgo::HMAC_SHA512;
+		case CKM_AES_KEY_GEN:
+			objClass = CKO_SECRET_KEY;
+			keyType = CKK_AES;
 			break;
 #if 0 // Unsupported by Crypto API Toolkit
-#ifdef WITH_GOST
-		case CKM_GOSTR3411_HMAC:
-			if (keyType != CKK_GENERIC_SECRET && keyType != CKK_GOST28147)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			minSize = 32;
-			algo = MacAlgo::HMAC_GOST;
-			break;
-#endif
-		case CKM_DES3_CMAC:
-			if (keyType != CKK_DES2 && keyType != CKK_DES3)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			algo = MacAlgo::CMAC_DES;
-			bb = 7;
-			break;
-		case CKM_AES_CMAC:
-			if (keyType != CKK_AES)
-				return CKR_KEY_TYPE_INCONSISTENT;
-			algo = MacAlgo::CMAC_AES;
+		case CKM_GENERIC_SECRET_KEY_GEN:
+			objClass = CKO_SECRET_KEY;
+			keyType = CKK_GENERIC_SECRET;
 			break;
 #endif // Unsupported by Crypto API Toolkit
 		default:
 			return CKR_MECHANISM_INVALID;
 	}
-	MacAlgorithm* mac = CryptoFactory::i()->getMacAlgorithm(algo);
-	if (mac == NULL) return CKR_MECHANISM_INVALID;
 
-	SymmetricKey* pubkey = new SymmetricKey();
+	// Extract information from the template that is needed to create the object.
+	CK_BBOOL isOnToken = CK_FALSE;
+	CK_BBOOL isPrivate = CK_TRUE;
+	CK_CERTIFICATE_TYPE dummy;
+	bool isImplicit = true;
+	extractObjectInformation(l_pTemplate, ulCount, objClass, keyType, dummy, isOnToken, isPrivate, isImplicit);
 
-	if (getSymmetricKey(pubkey, token, key) != CKR_OK)
+	// Report errors and/or unexpected usage.
+	if (objClass != CKO_SECRET_KEY && objClass != CKO_DOMAIN_PARAMETERS)
+		return CKR_ATTRIBUTE_VALUE_INVALID;
+	if (l_pMechanism->mechanism == CKM_DSA_PARAMETER_GEN &&
+	    (objClass != CKO_DOMAIN_PARAMETERS || keyType != CKK_DSA))
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_DH_PKCS_PARAMETER_GEN &&
+	    (objClass != CKO_DOMAIN_PARAMETERS || keyType != CKK_DH))
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_DES_KEY_GEN &&
+	    (objClass != CKO_SECRET_KEY || keyType != CKK_DES))
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_DES2_KEY_GEN &&
+	    (objClass != CKO_SECRET_KEY || keyType != CKK_DES2))
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_DES3_KEY_GEN &&
+	    (objClass != CKO_SECRET_KEY || keyType != CKK_DES3))
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_AES_KEY_GEN &&
+	    (objClass != CKO_SECRET_KEY || keyType != CKK_AES))
+		return CKR_TEMPLATE_INCONSISTENT;
+#if 0 // Unsupported by Crypto API Toolkit
+	if (l_pMechanism->mechanism == CKM_GENERIC_SECRET_KEY_GEN &&
+	    (objClass != CKO_SECRET_KEY || keyType != CKK_GENERIC_SECRET))
+		return CKR_TEMPLATE_INCONSISTENT;
+#endif // Unsupported by Crypto API Toolkit
+
+	// Check authorization
+	CK_RV rv = haveWrite(session->getState(), isOnToken, isPrivate);
+	if (rv != CKR_OK)
 	{
-		mac->recycleKey(pubkey);
-		CryptoFactory::i()->recycleMacAlgorithm(mac);
-		return CKR_GENERAL_ERROR;
+		if (rv == CKR_USER_NOT_LOGGED_IN)
+		{
+			// INFO_MSG("User is not authorized");
+		}
+		if (rv == CKR_SESSION_READ_ONLY)
+		{
+			// INFO_MSG("Session is read-only");
+		}
+
+		return rv;
+	}
+
+#if 0 // Unsupported by Crypto API Toolkit
+	// Generate DSA domain parameters
+	if (l_pMechanism->mechanism == CKM_DSA_PARAMETER_GEN)
+	{
+		rv = this->generateDSAParameters(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
+        *phKey = hKey;
+        return rv;
+	}
+
+	// Generate DH domain parameters
+	if (l_pMechanism->mechanism == CKM_DH_PKCS_PARAMETER_GEN)
+	{
+		rv = this->generateDHParameters(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
+        *phKey = hKey;
+        return rv;
+	}
+
+	// Generate DES secret key
+	if (l_pMechanism->mechanism == CKM_DES_KEY_GEN)
+	{
+		rv = this->generateDES(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
+        *phKey = hKey;
+        return rv;
 	}
 
-	// Adjust key bit length
-	pubkey->setBitLen(pubkey->getKeyBits().size() * bb);
+	// Generate DES2 secret key
+	if (l_pMechanism->mechanism == CKM_DES2_KEY_GEN)
+	{
+		rv = this->generateDES2(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
+        *phKey = hKey;
+        return rv;
+	}
 
-	// Check key size
-	if (pubkey->getBitLen() < (minSize*8))
+	// Generate DES3 secret key
+	if (l_pMechanism->mechanism == CKM_DES3_KEY_GEN)
 	{
-		mac->recycleKey(pubkey);
-		CryptoFactory::i()->recycleMacAlgorithm(mac);
-		return CKR_KEY_SIZE_RANGE;
+		rv = this->generateDES3(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
+        *phKey = hKey;
+        return rv;
 	}
+#endif // Unsupported by Crypto API Toolkit
 
-	// Initialize verifying
-	if (!mac->verifyInit(pubkey))
+	// Generate AES secret key
+	if (l_pMechanism->mechanism == CKM_AES_KEY_GEN)
 	{
-		mac->recycleKey(pubkey);
-		CryptoFactory::i()->recycleMacAlgorithm(mac);
-		return CKR_MECHANISM_INVALID;
+		rv = this->generateAES(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
+        *phKey = hKey;
+        return rv;
 	}
 
-	session->setOpType(SESSION_OP_VERIFY);
-	session->setMacOp(mac);
-	session->setAllowMultiPartOp(true);
-	session->setAllowSinglePartOp(true);
-	session->setSymmetricKey(pubkey);
+#if 0 // Unsupported by Crypto API Toolkit
+	// Generate generic secret key
+	if (l_pMechanism->mechanism == CKM_GENERIC_SECRET_KEY_GEN)
+	{
+		rv = this->generateGeneric(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
+        *phKey = hKey;
+        return rv;
+	}
+#endif // Unsupported by Crypto API Toolkit
 
-	return CKR_OK;
+	return CKR_GENERAL_ERROR;
 }
 
-// AsymmetricAlgorithm version of C_VerifyInit
-CK_RV SoftHSM::AsymVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+// Generate a key-pair using the specified mechanism
+CK_RV SoftHSM::C_GenerateKeyPair
+(
+	CK_SESSION_HANDLE hSession,
+	CK_MECHANISM_PTR pMechanism,
+	CK_ATTRIBUTE_PTR pPublicKeyTemplate,
+	CK_ULONG ulPublicKeyAttributeCount,
+	CK_ATTRIBUTE_PTR pPrivateKeyTemplate,
+	CK_ULONG ulPrivateKeyAttributeCount,
+	CK_OBJECT_HANDLE_PTR phPublicKey,
+	CK_OBJECT_HANDLE_PTR phPrivateKey
+)
 {
+    CK_OBJECT_HANDLE hPublicKey;
+    auto l_phPublicKey = &hPublicKey;
+
+    CK_OBJECT_HANDLE hPrivateKey;
+    auto l_phPrivateKey = &hPrivateKey;
+
 	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
 	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+    if (nullptr == pPublicKeyTemplate && 0 != ulPublicKeyAttributeCount)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
 
-	// Check if we have another operation
-	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+    if (nullptr == pPrivateKeyTemplate && 0 != ulPrivateKeyAttributeCount)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
 
-	// Get the token
-	Token* token = session->getToken();
-	if (token == NULL) return CKR_GENERAL_ERROR;
+	if (phPublicKey == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (phPrivateKey == NULL_PTR) return CKR_ARGUMENTS_BAD;
 
-	// Check the key handle.
-	OSObject *key = (OSObject *)handleManager->getObject(hKey);
-	if (key == NULL_PTR || !key->isValid()) return CKR_OBJECT_HANDLE_INVALID;
+    if (!validate_user_check_ptr(phPublicKey, sizeof(CK_OBJECT_HANDLE)))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
 
-	CK_BBOOL isOnToken = key->getBooleanValue(CKA_TOKEN, false);
-	CK_BBOOL isPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+	if (ulPublicKeyAttributeCount)
+	{
+        if (ulPublicKeyAttributeCount > CKA_MAX_ATTRIBUTES)
+        {
+            return CKR_ARGUMENTS_BAD;
+        }
 
-	// Check read user credentials
-	CK_RV rv = haveRead(session->getState(), isOnToken, isPrivate);
-	if (rv != CKR_OK)
+		if (!validate_user_check_attribute_ptr(pPublicKeyTemplate, ulPublicKeyAttributeCount))
+		{
+			return CKR_DEVICE_MEMORY;
+		}
+	}
+
+    if (!validate_user_check_ptr(phPrivateKey, sizeof(CK_OBJECT_HANDLE)))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
+
+	if (ulPrivateKeyAttributeCount)
 	{
-		if (rv == CKR_USER_NOT_LOGGED_IN)
+        if (ulPrivateKeyAttributeCount > CKA_MAX_ATTRIBUTES)
+        {
+            return CKR_ARGUMENTS_BAD;
+        }
+
+		if (!validate_user_check_attribute_ptr(pPrivateKeyTemplate, ulPrivateKeyAttributeCount))
 		{
-			// INFO_MSG("User is not authorized");
+			return CKR_DEVICE_MEMORY;
 		}
+	}
 
-		return rv;
+    CK_ATTRIBUTE l_PublicKeyTemplate[ulPublicKeyAttributeCount];
+    memset_s(l_PublicKeyTemplate, ulPublicKeyAttributeCount * sizeof(CK_ATTRIBUTE), 0x00, ulPublicKeyAttributeCount * sizeof(CK_ATTRIBUTE));
+    memcpy_s(l_PublicKeyTemplate, ulPublicKeyAttributeCount * sizeof(CK_ATTRIBUTE), pPublicKeyTemplate, ulPublicKeyAttributeCount * sizeof(CK_ATTRIBUTE));
+
+    std::vector<std::vector<CK_BYTE>> publicValue(ulPublicKeyAttributeCount);
+
+    for (CK_ULONG i = 0; i < ulPublicKeyAttributeCount; i++)
+    {
+        if (l_PublicKeyTemplate[i].pValue == nullptr)
+        {
+            continue;
+        }
+
+        auto ulValueLen = l_PublicKeyTemplate[i].ulValueLen;
+		if (!validate_user_check_ptr(l_PublicKeyTemplate[i].pValue, ulValueLen))
+		{
+			return CKR_DEVICE_MEMORY;
+		}
+
+        publicValue[i].resize(ulValueLen);
+        memcpy_s(publicValue[i].data(), ulValueLen, l_PublicKeyTemplate[i].pValue, ulValueLen);
+        l_PublicKeyTemplate[i].pValue = publicValue[i].data();
+    }
+
+    auto l_pPublicKeyTemplate= l_PublicKeyTemplate;
+
+    CK_ATTRIBUTE l_PrivateKeyTemplate[ulPrivateKeyAttributeCount];
+    memset_s(l_PrivateKeyTemplate, ulPrivateKeyAttributeCount * sizeof(CK_ATTRIBUTE), 0x00, ulPrivateKeyAttributeCount * sizeof(CK_ATTRIBUTE));
+    memcpy_s(l_PrivateKeyTemplate, ulPrivateKeyAttributeCount * sizeof(CK_ATTRIBUTE), pPrivateKeyTemplate, ulPrivateKeyAttributeCount * sizeof(CK_ATTRIBUTE));
+
+    std::vector<std::vector<CK_BYTE>> privateValue(ulPrivateKeyAttributeCount);
+
+    for (CK_ULONG i = 0; i < ulPrivateKeyAttributeCount; i++)
+    {
+        if (l_PrivateKeyTemplate[i].pValue == nullptr)
+        {
+            continue;
+        }
+
+        auto ulValueLen = l_PrivateKeyTemplate[i].ulValueLen;
+		if (!validate_user_check_ptr(l_PrivateKeyTemplate[i].pValue, ulValueLen))
+		{
+			return CKR_DEVICE_MEMORY;
+		}
+
+        privateValue[i].resize(ulValueLen);
+        memcpy_s(privateValue[i].data(), ulValueLen, l_PrivateKeyTemplate[i].pValue, ulValueLen);
+        l_PrivateKeyTemplate[i].pValue = privateValue[i].data();
+    }
+
+    auto l_pPrivateKeyTemplate= l_PrivateKeyTemplate;
+
+	if (!validate_user_check_mechanism_ptr(pMechanism, 1))
+	{
+		return CKR_DEVICE_MEMORY;
 	}
 
-	// Check if key can be used for verifying
-	if (!key->getBooleanValue(CKA_VERIFY, false))
-		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+    CK_MECHANISM l_mechanism;
+    memcpy_s(&l_mechanism, sizeof(CK_MECHANISM), pMechanism, sizeof(CK_MECHANISM));
 
-	// Check if the specified mechanism is allowed for the key
-	if (!isMechanismPermitted(key, pMechanism))
-		return CKR_MECHANISM_INVALID;
+    auto ulParameterLen = l_mechanism.ulParameterLen;
 
-	// Get the asymmetric algorithm matching the mechanism
-	AsymMech::Type mechanism = AsymMech::Unknown;
-	void* param = NULL;
-	size_t paramLen = 0;
-	RSA_PKCS_PSS_PARAMS pssParam;
-	bool bAllowMultiPartOp;
-	bool isRSA = false;
-#if 0 //Unsupported by Crypto API Toolkit
-	bool isDSA = false;
-#endif // Unsupported by Crypto API Toolkit
-#ifdef WITH_ECC
-	bool isECDSA = false;
-#endif
-#ifdef WITH_EDDSA
-	bool isEDDSA = false;
-#endif
-	switch(pMechanism->mechanism) {
-		case CKM_RSA_PKCS:
-			mechanism = AsymMech::RSA_PKCS;
-			bAllowMultiPartOp = false;
-			isRSA = true;
-			break;
-		case CKM_RSA_X_509:
-			mechanism = AsymMech::RSA;
-			bAllowMultiPartOp = false;
-			isRSA = true;
-			break;
-#ifndef WITH_FIPS
-		case CKM_MD5_RSA_PKCS:
-			mechanism = AsymMech::RSA_MD5_PKCS;
-			bAllowMultiPartOp = true;
-			isRSA = true;
-			break;
-#endif
-		case CKM_SHA1_RSA_PKCS:
-			mechanism = AsymMech::RSA_SHA1_PKCS;
-			bAllowMultiPartOp = true;
-			isRSA = true;
-			break;
-		case CKM_SHA224_RSA_PKCS:
-			mechanism = AsymMech::RSA_SHA224_PKCS;
-			bAllowMultiPartOp = true;
-			isRSA = true;
-			break;
-		case CKM_SHA256_RSA_PKCS:
-			mechanism = AsymMech::RSA_SHA256_PKCS;
-			bAllowMultiPartOp = true;
-			isRSA = true;
-			break;
-		case CKM_SHA384_RSA_PKCS:
-			mechanism = AsymMech::RSA_SHA384_PKCS;
-			bAllowMultiPartOp = true;
-			isRSA = true;
-			break;
-		case CKM_SHA512_RSA_PKCS:
-			mechanism = AsymMech::RSA_SHA512_PKCS;
-			bAllowMultiPartOp = true;
-			isRSA = true;
-			break;
-#ifdef WITH_RAW_PSS
-		case CKM_RSA_PKCS_PSS:
-			if (pMechanism->pParameter == NULL_PTR ||
-			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS))
-			{
-				// ERROR_MSG("Invalid parameters");
-				return CKR_ARGUMENTS_BAD;
-			}
-			mechanism = AsymMech::RSA_PKCS_PSS;
+    if (ulParameterLen > CKM_MAX_PARAMETER_LEN)
+    {
+        return CKR_ARGUMENTS_BAD;
+    }
 
-			unsigned long expectedMgf;
-			switch(CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg) {
-				case CKM_SHA_1:
-					pssParam.hashAlg = HashAlgo::SHA1;
-					pssParam.mgf = AsymRSAMGF::MGF1_SHA1;
-					expectedMgf = CKG_MGF1_SHA1;
-					break;
-				case CKM_SHA224:
-					pssParam.hashAlg = HashAlgo::SHA224;
-					pssParam.mgf = AsymRSAMGF::MGF1_SHA224;
-					expectedMgf = CKG_MGF1_SHA224;
-					break;
-				case CKM_SHA256:
-					pssParam.hashAlg = HashAlgo::SHA256;
-					pssParam.mgf = AsymRSAMGF::MGF1_SHA256;
-					expectedMgf = CKG_MGF1_SHA256;
-					break;
-				case CKM_SHA384:
-					pssParam.hashAlg = HashAlgo::SHA384;
-					pssParam.mgf = AsymRSAMGF::MGF1_SHA384;
-					expectedMgf = CKG_MGF1_SHA384;
-					break;
-				case CKM_SHA512:
-					pssParam.hashAlg = HashAlgo::SHA512;
-					pssParam.mgf = AsymRSAMGF::MGF1_SHA512;
-					expectedMgf = CKG_MGF1_SHA512;
-					break;
-				default:
-					return CKR_ARGUMENTS_BAD;
-			}
+    CK_BYTE parameter[ulParameterLen];
+    if (l_mechanism.pParameter != nullptr)
+    {
+        if (!validate_user_check_ptr(l_mechanism.pParameter, ulParameterLen))
+        {
+            return CKR_DEVICE_MEMORY;
+        }
 
-			if (CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != expectedMgf) {
-				return CKR_ARGUMENTS_BAD;
-			}
+        memcpy_s(&parameter[0], ulParameterLen, l_mechanism.pParameter, ulParameterLen);
+        l_mechanism.pParameter = &parameter[0];
+    }
+    auto l_pMechanism = &l_mechanism;
 
-			pssParam.sLen = CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->sLen;
-			param = &pssParam;
-			paramLen = sizeof(pssParam);
-			bAllowMultiPartOp = false;
-			isRSA = true;
-			break;
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
 #endif
-		case CKM_SHA1_RSA_PKCS_PSS:
-			if (pMechanism->pParameter == NULL_PTR ||
-			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS) ||
-			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg != CKM_SHA_1 ||
-			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != CKG_MGF1_SHA1)
-			{
-				// ERROR_MSG("Invalid parameters");
-				return CKR_ARGUMENTS_BAD;
-			}
-			mechanism = AsymMech::RSA_SHA1_PKCS_PSS;
-			pssParam.hashAlg = HashAlgo::SHA1;
-			pssParam.mgf = AsymRSAMGF::MGF1_SHA1;
-			pssParam.sLen = CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->sLen;
-			param = &pssParam;
-			paramLen = sizeof(pssParam);
-			bAllowMultiPartOp = true;
-			isRSA = true;
-			break;
-		case CKM_SHA224_RSA_PKCS_PSS:
-			if (pMechanism->pParameter == NULL_PTR ||
-			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS) ||
-			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg != CKM_SHA224 ||
-			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != CKG_MGF1_SHA224)
-			{
-				// ERROR_MSG("Invalid parameters");
-				return CKR_ARGUMENTS_BAD;
-			}
-			mechanism = AsymMech::RSA_SHA224_PKCS_PSS;
-			pssParam.hashAlg = HashAlgo::SHA224;
-			pssParam.mgf = AsymRSAMGF::MGF1_SHA224;
-			pssParam.sLen = CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->sLen;
-			param = &pssParam;
-			paramLen = sizeof(pssParam);
-			bAllowMultiPartOp = true;
-			isRSA = true;
-			break;
-		case CKM_SHA256_RSA_PKCS_PSS:
-			if (pMechanism->pParameter == NULL_PTR ||
-			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS) ||
-			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg != CKM_SHA256 ||
-			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != CKG_MGF1_SHA256)
-			{
-				// ERROR_MSG("Invalid parameters");
-				return CKR_ARGUMENTS_BAD;
-			}
-			mechanism = AsymMech::RSA_SHA256_PKCS_PSS;
-			pssParam.hashAlg = HashAlgo::SHA256;
-			pssParam.mgf = AsymRSAMGF::MGF1_SHA256;
-			pssParam.sLen = CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->sLen;
-			param = &pssParam;
-			paramLen = sizeof(pssParam);
-			bAllowMultiPartOp = true;
-			isRSA = true;
-			break;
-		case CKM_SHA384_RSA_PKCS_PSS:
-			if (pMechanism->pParameter == NULL_PTR ||
-			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS) ||
-			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg != CKM_SHA384 ||
-			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != CKG_MGF1_SHA384)
-			{
-				// ERROR_MSG("Invalid parameters");
-				return CKR_ARGUMENTS_BAD;
-			}
-			mechanism = AsymMech::RSA_SHA384_PKCS_PSS;
-			pssParam.hashAlg = HashAlgo::SHA384;
-			pssParam.mgf = AsymRSAMGF::MGF1_SHA384;
-			pssParam.sLen = CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->sLen;
-			param = &pssParam;
-			paramLen = sizeof(pssParam);
-			bAllowMultiPartOp = true;
-			isRSA = true;
-			break;
-		case CKM_SHA512_RSA_PKCS_PSS:
-			if (pMechanism->pParameter == NULL_PTR ||
-			    pMechanism->ulParameterLen != sizeof(CK_RSA_PKCS_PSS_PARAMS) ||
-			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->hashAlg != CKM_SHA512 ||
-			    CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->mgf != CKG_MGF1_SHA512)
-			{
-				// ERROR_MSG("Invalid parameters");
-				return CKR_ARGUMENTS_BAD;
-			}
-			mechanism = AsymMech::RSA_SHA512_PKCS_PSS;
-			pssParam.hashAlg = HashAlgo::SHA512;
-			pssParam.mgf = AsymRSAMGF::MGF1_SHA512;
-			pssParam.sLen = CK_RSA_PKCS_PSS_PARAMS_PTR(pMechanism->pParameter)->sLen;
-			param = &pssParam;
-			paramLen = sizeof(pssParam);
-			bAllowMultiPartOp = true;
-			isRSA = true;
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check the mechanism, only accept RSA, DSA, EC and DH key pair generation.
+	CK_KEY_TYPE keyType;
+	switch (l_pMechanism->mechanism)
+	{
+		case CKM_RSA_PKCS_KEY_PAIR_GEN:
+			keyType = CKK_RSA;
 			break;
 #if 0 // Unsupported by Crypto API Toolkit
-		case CKM_DSA:
-			mechanism = AsymMech::DSA;
-			bAllowMultiPartOp = false;
-			isDSA = true;
-			break;
-		case CKM_DSA_SHA1:
-			mechanism = AsymMech::DSA_SHA1;
-			bAllowMultiPartOp = true;
-			isDSA = true;
-			break;
-		case CKM_DSA_SHA224:
-			mechanism = AsymMech::DSA_SHA224;
-			bAllowMultiPartOp = true;
-			isDSA = true;
-			break;
-		case CKM_DSA_SHA256:
-			mechanism = AsymMech::DSA_SHA256;
-			bAllowMultiPartOp = true;
-			isDSA = true;
-			break;
-		case CKM_DSA_SHA384:
-			mechanism = AsymMech::DSA_SHA384;
-			bAllowMultiPartOp = true;
-			isDSA = true;
+		case CKM_DSA_KEY_PAIR_GEN:
+			keyType = CKK_DSA;
 			break;
-		case CKM_DSA_SHA512:
-			mechanism = AsymMech::DSA_SHA512;
-			bAllowMultiPartOp = true;
-			isDSA = true;
+		case CKM_DH_PKCS_KEY_PAIR_GEN:
+			keyType = CKK_DH;
 			break;
 #endif // Unsupported by Crypto API Toolkit
 #ifdef WITH_ECC
-		case CKM_ECDSA:
-			mechanism = AsymMech::ECDSA;
-			bAllowMultiPartOp = false;
-			isECDSA = true;
+		case CKM_EC_KEY_PAIR_GEN:
+			keyType = CKK_EC;
 			break;
 #endif
 #if 0 // Unsupported by Crypto API Toolkit
 #ifdef WITH_GOST
-		case CKM_GOSTR3410:
-			mechanism = AsymMech::GOST;
-			bAllowMultiPartOp = false;
-			break;
-		case CKM_GOSTR3410_WITH_GOSTR3411:
-			mechanism = AsymMech::GOST_GOST;
-			bAllowMultiPartOp = true;
+		case CKM_GOSTR3410_KEY_PAIR_GEN:
+			keyType = CKK_GOSTR3410;
 			break;
 #endif
 #endif // Unsupported by Crypto API Toolkit
 #ifdef WITH_EDDSA
-		case CKM_EDDSA:
-			mechanism = AsymMech::EDDSA;
-			bAllowMultiPartOp = false;
-			isEDDSA = true;
+		case CKM_EC_EDWARDS_KEY_PAIR_GEN:
+			keyType = CKK_EC_EDWARDS;
 			break;
 #endif
 		default:
 			return CKR_MECHANISM_INVALID;
 	}
+	CK_CERTIFICATE_TYPE dummy;
+
+	// Extract information from the public key template that is needed to create the object.
+	CK_OBJECT_CLASS publicKeyClass = CKO_PUBLIC_KEY;
+	CK_BBOOL ispublicKeyToken = CK_FALSE;
+	CK_BBOOL ispublicKeyPrivate = CK_FALSE;
+	bool isPublicKeyImplicit = true;
+	extractObjectInformation(l_pPublicKeyTemplate, ulPublicKeyAttributeCount, publicKeyClass, keyType, dummy, ispublicKeyToken, ispublicKeyPrivate, isPublicKeyImplicit);
+
+	// Report errors caused by accidental template mix-ups in the application using this cryptoki lib.
+	if (publicKeyClass != CKO_PUBLIC_KEY)
+		return CKR_ATTRIBUTE_VALUE_INVALID;
+	if (l_pMechanism->mechanism == CKM_RSA_PKCS_KEY_PAIR_GEN && keyType != CKK_RSA)
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_DSA_KEY_PAIR_GEN && keyType != CKK_DSA)
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_EC_KEY_PAIR_GEN && keyType != CKK_EC)
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_DH_PKCS_KEY_PAIR_GEN && keyType != CKK_DH)
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_GOSTR3410_KEY_PAIR_GEN && keyType != CKK_GOSTR3410)
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_EC_EDWARDS_KEY_PAIR_GEN && keyType != CKK_EC_EDWARDS)
+		return CKR_TEMPLATE_INCONSISTENT;
+
+	// Extract information from the private key template that is needed to create the object.
+	CK_OBJECT_CLASS privateKeyClass = CKO_PRIVATE_KEY;
+	CK_BBOOL isprivateKeyToken = CK_FALSE;
+	CK_BBOOL isprivateKeyPrivate = CK_TRUE;
+	bool isPrivateKeyImplicit = true;
+	extractObjectInformation(l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount, privateKeyClass, keyType, dummy, isprivateKeyToken, isprivateKeyPrivate, isPrivateKeyImplicit);
+
+	// Report errors caused by accidental template mix-ups in the application using this cryptoki lib.
+	if (privateKeyClass != CKO_PRIVATE_KEY)
+		return CKR_ATTRIBUTE_VALUE_INVALID;
+	if (l_pMechanism->mechanism == CKM_RSA_PKCS_KEY_PAIR_GEN && keyType != CKK_RSA)
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_DSA_KEY_PAIR_GEN && keyType != CKK_DSA)
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_EC_KEY_PAIR_GEN && keyType != CKK_EC)
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_DH_PKCS_KEY_PAIR_GEN && keyType != CKK_DH)
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_GOSTR3410_KEY_PAIR_GEN && keyType != CKK_GOSTR3410)
+		return CKR_TEMPLATE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_EC_EDWARDS_KEY_PAIR_GEN && keyType != CKK_EC_EDWARDS)
+		return CKR_TEMPLATE_INCONSISTENT;
 
-	AsymmetricAlgorithm* asymCrypto = NULL;
-	PublicKey* publicKey = NULL;
-	if (isRSA)
+	// Check user credentials
+	CK_RV rv = haveWrite(session->getState(), ispublicKeyToken || isprivateKeyToken, ispublicKeyPrivate || isprivateKeyPrivate);
+	if (rv != CKR_OK)
 	{
-		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::RSA);
-		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
-
-		publicKey = asymCrypto->newPublicKey();
-		if (publicKey == NULL)
+		if (rv == CKR_USER_NOT_LOGGED_IN)
 		{
-			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-			return CKR_HOST_MEMORY;
+			// INFO_MSG("User is not authorized");
 		}
-
-		if (getRSAPublicKey((RSAPublicKey*)publicKey, token, key) != CKR_OK)
+		if (rv == CKR_SESSION_READ_ONLY)
 		{
-			asymCrypto->recyclePublicKey(publicKey);
-			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-			return CKR_GENERAL_ERROR;
+			// INFO_MSG("Session is read-only");
 		}
+
+		return rv;
 	}
-#if 0 // Unsupported by Crypto API Toolkit
-	else if (isDSA)
+
+	// Generate RSA keys
+	if (l_pMechanism->mechanism == CKM_RSA_PKCS_KEY_PAIR_GEN)
 	{
-		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::DSA);
-		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
+			// A multi-prime key is requested through the mechanism parameter
+			CK_ULONG ulPrimes = 2;
+			if (l_pMechanism->pParameter != NULL_PTR)
+			{
+				CK_RSA_MULTI_PRIME_KEY_GEN_PARAMS params;
+				if (l_pMechanism->ulParameterLen != sizeof(params))
+				{
+					// ERROR_MSG("Invalid parameters");
+					return CKR_MECHANISM_PARAM_INVALID;
+				}
+				memcpy_s(&params, sizeof(params), l_pMechanism->pParameter, sizeof(params));
 
-		publicKey = asymCrypto->newPublicKey();
-		if (publicKey == NULL)
-		{
-			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-			return CKR_HOST_MEMORY;
-		}
+				ulPrimes = params.ulPrimes;
+				if (ulPrimes < 2 || ulPrimes > 4)
+				{
+					// ERROR_MSG("Unsupported number of primes");
+					return CKR_MECHANISM_PARAM_INVALID;
+				}
+			}
 
-		if (getDSAPublicKey((DSAPublicKey*)publicKey, token, key) != CKR_OK)
-		{
-			asymCrypto->recyclePublicKey(publicKey);
-			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-			return CKR_GENERAL_ERROR;
-		}
-    }
-#endif // Unsupported by Crypto API Toolkit
-#ifdef WITH_ECC
-	else if (isECDSA)
-	{
-		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::ECDSA);
-		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
+			rv = this->generateRSA(hSession,
+								   l_pPublicKeyTemplate, ulPublicKeyAttributeCount,
+								   l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount,
+								   l_phPublicKey, l_phPrivateKey,
+								   ispublicKeyToken, ispublicKeyPrivate, isprivateKeyToken, isprivateKeyPrivate,
+								   ulPrimes);
+#ifdef SGXHSM
+			if (rv == CKR_OK)
+			{
+				OSObject* osobject = nullptr;
+                CK_ULONG pairKeyIdVal = 0;
 
-		publicKey = asymCrypto->newPublicKey();
-		if (publicKey == NULL)
-		{
-			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-			return CKR_HOST_MEMORY;
-		}
+                if (SGX_SUCCESS != sgx_read_rand(reinterpret_cast<unsigned char*>(&pairKeyIdVal), sizeof(pairKeyIdVal)))
+                {
+                    return CKR_GENERAL_ERROR;
+                }
 
-		if (getECPublicKey((ECPublicKey*)publicKey, token, key) != CKR_OK)
-		{
-			asymCrypto->recyclePublicKey(publicKey);
-			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-			return CKR_GENERAL_ERROR;
-		}
-	}
+                OSAttribute pairKeyId(pairKeyIdVal);
+
+				osobject = (OSObject*)handleManager->getObject(hPublicKey);
+				if (osobject == NULL_PTR || !osobject->isValid()) {
+					rv = CKR_FUNCTION_FAILED;
+				} else if (osobject->startTransaction()) {
+					bool bOK = true;
+
+					// pair key attribute to prevent wrapped key decrypt via C_Decrypt
+                    bOK = bOK && osobject->setAttribute(CKA_ASYMMETRIC_PAIR_ID, pairKeyId);
+
+					if (bOK)
+						bOK = osobject->commitTransaction();
+					else
+						osobject->abortTransaction();
+
+					if (!bOK)
+					{
+						rv = CKR_FUNCTION_FAILED;
+						if (hPublicKey != CK_INVALID_HANDLE)
+						{
+							OSObject* obj = (OSObject*)handleManager->getObject(hPublicKey);
+							handleManager->destroyObject(hPublicKey);
+							if (obj) obj->destroyObject();
+							hPublicKey = CK_INVALID_HANDLE;
+						}
+
+						if (hPrivateKey != CK_INVALID_HANDLE)
+						{
+							OSObject* obj = (OSObject*)handleManager->getObject(hPrivateKey);
+							handleManager->destroyObject(hPrivateKey);
+							if (obj) obj->destroyObject();
+							hPrivateKey = CK_INVALID_HANDLE;
+						}
+					}
+				}
+
+				osobject = (OSObject*)handleManager->getObject(hPrivateKey);
+				if (osobject == NULL_PTR || !osobject->isValid()) {
+					rv = CKR_FUNCTION_FAILED;
+				} else if (osobject->startTransaction()) {
+					bool bOK = true;
+
+					// pair key attribute to prevent wrapped key decrypt via C_Decrypt
+                    bOK = bOK && osobject->setAttribute(CKA_ASYMMETRIC_PAIR_ID, pairKeyId);
+
+					if (bOK)
+						bOK = osobject->commitTransaction();
+					else
+						osobject->abortTransaction();
+
+					if (!bOK)
+					{
+						rv = CKR_FUNCTION_FAILED;
+						if (hPublicKey != CK_INVALID_HANDLE)
+						{
+							OSObject* obj = (OSObject*)handleManager->getObject(hPublicKey);
+							handleManager->destroyObject(hPublicKey);
+							if (obj) obj->destroyObject();
+							hPublicKey = CK_INVALID_HANDLE;
+						}
+
+						if (hPrivateKey != CK_INVALID_HANDLE)
+						{
+							OSObject* obj = (OSObject*)handleManager->getObject(hPrivateKey);
+							handleManager->destroyObject(hPrivateKey);
+							if (obj) obj->destroyObject();
+							hPrivateKey = CK_INVALID_HANDLE;
+						}
+					}
+				}
+			}
 #endif
-#ifdef WITH_EDDSA
-	else if (isEDDSA)
-	{
-		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::EDDSA);
-		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
+            *phPublicKey = hPublicKey;
+            *phPrivateKey = hPrivateKey;
+            return rv;
+	}
 
-		publicKey = asymCrypto->newPublicKey();
-		if (publicKey == NULL)
-		{
-			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-			return CKR_HOST_MEMORY;
-		}
+#if 0 // Unsupported by Crypto API Toolkit
+	// Generate DSA keys
+	if (l_pMechanism->mechanism == CKM_DSA_KEY_PAIR_GEN)
+	{
+		rv = this->generateDSA(hSession,
+								 l_pPublicKeyTemplate, ulPublicKeyAttributeCount,
+								 l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount,
+								 l_phPublicKey, l_phPrivateKey,
+								 ispublicKeyToken, ispublicKeyPrivate, isprivateKeyToken, isprivateKeyPrivate);
+        *phPublicKey = hPublicKey;
+        *phPrivateKey = hPrivateKey;
+        return rv;
 
-		if (getEDPublicKey((EDPublicKey*)publicKey, token, key) != CKR_OK)
-		{
-			asymCrypto->recyclePublicKey(publicKey);
-			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-			return CKR_GENERAL_ERROR;
-		}
 	}
-#endif
-	else
+#endif // Unsupported by Crypto API Toolkit
+
+	// Generate EC keys
+	if (l_pMechanism->mechanism == CKM_EC_KEY_PAIR_GEN)
 	{
-#if 0 // Unsupported by Crypto API Toolkit
-#ifdef WITH_GOST
-		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::GOST);
-		if (asymCrypto == NULL) return CKR_MECHANISM_INVALID;
+        rv = this->generateEC(hSession,
+								l_pPublicKeyTemplate, ulPublicKeyAttributeCount,
+								l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount,
+								l_phPublicKey, l_phPrivateKey,
+								ispublicKeyToken, ispublicKeyPrivate, isprivateKeyToken, isprivateKeyPrivate);
+        *phPublicKey = hPublicKey;
+        *phPrivateKey = hPrivateKey;
+        return rv;
+	}
 
-		publicKey = asymCrypto->newPublicKey();
-		if (publicKey == NULL)
-		{
-			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-			return CKR_HOST_MEMORY;
-		}
+#if 0 // Unsupported by Crypto API Toolkit
+	// Generate DH keys
+	if (l_pMechanism->mechanism == CKM_DH_PKCS_KEY_PAIR_GEN)
+	{
+        rv = this->generateDH(hSession,
+									 l_pPublicKeyTemplate, ulPublicKeyAttributeCount,
+									 l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount,
+									 l_phPublicKey, l_phPrivateKey,
+									 ispublicKeyToken, ispublicKeyPrivate, isprivateKeyToken, isprivateKeyPrivate);
+        *phPublicKey = hPublicKey;
+        *phPrivateKey = hPrivateKey;
+        return rv;
+	}
 
-		if (getGOSTPublicKey((GOSTPublicKey*)publicKey, token, key) != CKR_OK)
-		{
-			asymCrypto->recyclePublicKey(publicKey);
-			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-			return CKR_GENERAL_ERROR;
-		}
-#else
-		return CKR_MECHANISM_INVALID;
-#endif
+	// Generate GOST keys
+	if (l_pMechanism->mechanism == CKM_GOSTR3410_KEY_PAIR_GEN)
+	{
+        rv = this->generateGOST(hSession,
+								  l_pPublicKeyTemplate, ulPublicKeyAttributeCount,
+								  l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount,
+							   	  l_phPublicKey, l_phPrivateKey,
+								  ispublicKeyToken, ispublicKeyPrivate, isprivateKeyToken, isprivateKeyPrivate);
+        *phPublicKey = hPublicKey;
+        *phPrivateKey = hPrivateKey;
+        return rv;
+	}
 #endif // Unsupported by Crypto API Toolkit
-        return CKR_MECHANISM_INVALID;
-    }
 
-	// Initialize verifying
-	if (bAllowMultiPartOp && !asymCrypto->verifyInit(publicKey,mechanism,param,paramLen))
-	{
-		asymCrypto->recyclePublicKey(publicKey);
-		CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-		return CKR_MECHANISM_INVALID;
+	// Generate EDDSA keys
+	if (l_pMechanism->mechanism == CKM_EC_EDWARDS_KEY_PAIR_GEN)
+	{
+        rv = this->generateED(hSession,
+							    l_pPublicKeyTemplate, ulPublicKeyAttributeCount,
+							    l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount,
+							    l_phPublicKey, l_phPrivateKey,
+							    ispublicKeyToken, ispublicKeyPrivate, isprivateKeyToken, isprivateKeyPrivate);
+        *phPublicKey = hPublicKey;
+        *phPrivateKey = hPrivateKey;
+        return rv;
 	}
 
-	session->setOpType(SESSION_OP_VERIFY);
-	session->setAsymmetricCryptoOp(asymCrypto);
-	session->setMechanism(mechanism);
-	session->setParameters(param, paramLen);
-	session->setAllowMultiPartOp(bAllowMultiPartOp);
-	session->setAllowSinglePartOp(true);
-	session->setPublicKey(publicKey);
-
-	return CKR_OK;
+	return CKR_GENERAL_ERROR;
 }
 
-// Initialise a verification operation using the specified key and mechanism
-CK_RV SoftHSM::C_VerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+// Pad the key data to the AES key wrap block size
+static CK_RV padWrapKeyData(CK_MECHANISM_TYPE mechanism, ByteString& keydata)
 {
-    if (pMechanism == nullptr) return CKR_ARGUMENTS_BAD;
+#ifdef HAVE_AES_KEY_WRAP
+	CK_ULONG wrappedlen = keydata.size();
 
-	if (!validate_user_check_mechanism_ptr(pMechanism, 1))
+	// [PKCS#11 v2.40, 2.14.3 AES Key Wrap]
+	// A key whose length is not a multiple of the AES Key Wrap block
+	// size (8 bytes) will be zero padded to fit.
+	CK_ULONG alignment = wrappedlen % 8;
+	if (alignment != 0)
 	{
-		return CKR_DEVICE_MEMORY;
+		keydata.resize(wrappedlen + 8 - alignment);
+		memset(&keydata[wrappedlen], 0, 8 - alignment);
+		wrappedlen = keydata.size();
 	}
 
-    CK_MECHANISM l_mechanism;
-    memcpy_s(&l_mechanism, sizeof(CK_MECHANISM), pMechanism, sizeof(CK_MECHANISM));
+	if (mechanism == CKM_AES_KEY_WRAP && ((wrappedlen < 16) || ((wrappedlen % 8) != 0)))
+		return CKR_KEY_SIZE_RANGE;
+#endif
 
-    auto ulParameterLen = l_mechanism.ulParameterLen;
+	return CKR_OK;
+}
 
-    if (ulParameterLen > CKM_MAX_PARAMETER_LEN)
-    {
-        return CKR_ARGUMENTS_BAD;
-    }
+// Internal: Wrap blob using symmetric key
+CK_RV SoftHSM::WrapKeySym
+(
+	CK_MECHANISM_PTR pMechanism,
+	Token* token,
+	OSObject* wrapKey,
+	ByteString& keydata,
+	ByteString& wrapped
+)
+{
+	// Get the symmetric algorithm matching the mechanism
+	SymAlgo::Type algo = SymAlgo::Unknown;
+	SymWrap::Type mode = SymWrap::Unknown;
+	size_t bb = 8;
+	CK_RV rv = padWrapKeyData(pMechanism->mechanism, keydata);
+	if (rv != CKR_OK)
+		return rv;
+	switch(pMechanism->mechanism) {
+#ifdef HAVE_AES_KEY_WRAP
+		case CKM_AES_KEY_WRAP:
+			algo = SymAlgo::AES;
+			mode = SymWrap::AES_KEYWRAP;
+			break;
+#endif
+#ifdef HAVE_AES_KEY_WRAP_PAD
+		case CKM_AES_KEY_WRAP_PAD:
+			algo = SymAlgo::AES;
+			mode = SymWrap::AES_KEYWRAP_PAD;
+			break;
+#endif
+		default:
+			return CKR_MECHANISM_INVALID;
+	}
+	SymmetricAlgorithm* cipher = CryptoFactory::i()->getSymmetricAlgorithm(algo);
+	if (cipher == NULL) return CKR_MECHANISM_INVALID;
 
-    CK_BYTE parameter[ulParameterLen];
-    if (l_mechanism.pParameter != nullptr)
-    {
-        if (!validate_user_check_ptr(l_mechanism.pParameter, ulParameterLen))
-        {
-            return CKR_DEVICE_MEMORY;
-        }
+	SymmetricKey* wrappingkey = new SymmetricKey();
 
-        memcpy_s(&parameter[0], ulParameterLen, l_mechanism.pParameter, ulParameterLen);
-        l_mechanism.pParameter = &parameter[0];
-    }
-    auto l_pMechanism = &l_mechanism;
+	if (getSymmetricKey(wrappingkey, token, wrapKey) != CKR_OK)
+	{
+		cipher->recycleKey(wrappingkey);
+		CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
+		return CKR_GENERAL_ERROR;
+	}
 
-#ifdef ENABLE_MITIGATION
-    __builtin_ia32_lfence();
-#endif
+	// adjust key bit length
+	wrappingkey->setBitLen(wrappingkey->getKeyBits().size() * bb);
 
-#ifdef DCAP_SUPPORT
-    // Get the session
-    Session* session = (Session*)handleManager->getSession(hSession);
-    if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+	// Wrap the key
+	if (!cipher->wrapKey(wrappingkey, mode, keydata, wrapped))
+	{
+		cipher->recycleKey(wrappingkey);
+		CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
+		return CKR_GENERAL_ERROR;
+	}
 
-    // Check if we have another operation
-    if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+	cipher->recycleKey(wrappingkey);
+	CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
+	return CKR_OK;
+}
 
-    // Get the token
-    Token* token = session->getToken();
-    if (token == NULL) return CKR_GENERAL_ERROR;
+// Internal: Wrap blob using asymmetric key
+CK_RV SoftHSM::WrapKeyAsym
+(
+	CK_MECHANISM_PTR pMechanism,
+	Token* token,
+	OSObject* wrapKey,
+	ByteString& keydata,
+	ByteString& wrapped
+)
+{
+	const size_t bb = 8;
+	AsymAlgo::Type algo = AsymAlgo::Unknown;
+	AsymMech::Type mech = AsymMech::Unknown;
 
-    // If the key is used for quote generation should not be used for verifying
-    OSObject *key = (OSObject *)handleManager->getObject(hKey);
-    if (!key || !key->isValid())
-    {
-        return CKR_OBJECT_HANDLE_INVALID;
-    }
+	CK_ULONG modulus_length;
+	switch(pMechanism->mechanism) {
+		case CKM_RSA_PKCS:
+		case CKM_RSA_PKCS_OAEP:
+			algo = AsymAlgo::RSA;
+			if (!wrapKey->attributeExists(CKA_MODULUS_BITS))
+				return CKR_GENERAL_ERROR;
+			modulus_length = wrapKey->getUnsignedLongValue(CKA_MODULUS_BITS, 0);
+			// adjust key bit length
+			modulus_length /= bb;
+			break;
 
-    CK_BBOOL isUsedForQuoteGeneration = key->getBooleanValue(CKA_USED_FOR_QUOTE_GENERATION, false);
+		default:
+			return CKR_MECHANISM_INVALID;
+	}
 
-    if(isUsedForQuoteGeneration)
-    {
-        return CKR_OBJECT_HANDLE_INVALID;
-    }
-#endif
+	switch(pMechanism->mechanism) {
+		case CKM_RSA_PKCS:
+			mech = AsymMech::RSA_PKCS;
+			// RFC 3447 section 7.2.1
+			if (keydata.size() > modulus_length - 11)
+				return CKR_KEY_SIZE_RANGE;
+			break;
 
-	if (isMacMechanism(l_pMechanism))
-		return MacVerifyInit(hSession, l_pMechanism, hKey);
-	else
-		return AsymVerifyInit(hSession, l_pMechanism, hKey);
-}
+		case CKM_RSA_PKCS_OAEP:
+			mech = AsymMech::RSA_PKCS_OAEP;
+			// SHA-1 is the only supported option
+			// PKCS#11 2.40 draft 2 section 2.1.8: input length <= k-2-2hashLen
+			if (keydata.size() > modulus_length - 2 - 2 * 160 / 8)
+				return CKR_KEY_SIZE_RANGE;
+			break;
 
-// MacAlgorithm version of C_Verify
-static CK_RV MacVerify(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
-{
-	MacAlgorithm* mac = session->getMacOp();
-	if (mac == NULL || !session->getAllowSinglePartOp())
-	{
-		session->resetOp();
-		return CKR_OPERATION_NOT_INITIALIZED;
+		default:
+			return CKR_MECHANISM_INVALID;
 	}
 
-	// Size of the signature
-	CK_ULONG size = mac->getMacSize();
+	AsymmetricAlgorithm* cipher = CryptoFactory::i()->getAsymmetricAlgorithm(algo);
+	if (cipher == NULL) return CKR_MECHANISM_INVALID;
 
-	// Check buffer size
-	if (ulSignatureLen != size)
+	PublicKey* publicKey = cipher->newPublicKey();
+	if (publicKey == NULL)
 	{
-		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
-		session->resetOp();
-		return CKR_SIGNATURE_LEN_RANGE;
+		CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
+		return CKR_HOST_MEMORY;
 	}
 
-	// Get the data
-	ByteString data(pData, ulDataLen);
+	switch(pMechanism->mechanism) {
+		case CKM_RSA_PKCS:
+		case CKM_RSA_PKCS_OAEP:
+			if (getRSAPublicKey((RSAPublicKey*)publicKey, token, wrapKey) != CKR_OK)
+			{
+				cipher->recyclePublicKey(publicKey);
+				CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
+				return CKR_GENERAL_ERROR;
+			}
+			break;
 
-	// Verify the data
-	if (!mac->verifyUpdate(data))
+		default:
+			return CKR_MECHANISM_INVALID;
+	}
+	// Wrap the key
+	if (!cipher->wrapKey(publicKey, keydata, wrapped, mech))
 	{
-		session->resetOp();
+		cipher->recyclePublicKey(publicKey);
+		CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
 		return CKR_GENERAL_ERROR;
 	}
 
-	// Get the signature
-	ByteString signature(pSignature, ulSignatureLen);
+	cipher->recyclePublicKey(publicKey);
+	CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
 
-	// Verify the signature
-	if (!mac->verifyFinal(signature))
+	return CKR_OK;
+}
+
+
+// Internal: Check that the key can be wrapped with the wrapping key and get
+// its key data
+CK_RV SoftHSM::WrapKeyData
+(
+	Session* session,
+	Token* token,
+	OSObject* wrapKey,
+	CK_OBJECT_HANDLE hKey,
+	CK_MECHANISM_TYPE mechanism,
+	ByteString& keydata
+)
+{
+	// Check the to be wrapped key handle.
+	OSObject *key = (OSObject *)handleManager->getObject(hKey);
+	if (key == NULL_PTR || !key->isValid()) return CKR_KEY_HANDLE_INVALID;
+
+	CK_BBOOL isKeyOnToken = key->getBooleanValue(CKA_TOKEN, false);
+	CK_BBOOL isKeyPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+
+	// Check user credentials for the to be wrapped key
+	CK_RV rv = haveRead(session->getState(), isKeyOnToken, isKeyPrivate);
+	if (rv != CKR_OK)
 	{
-		session->resetOp();
-		return CKR_SIGNATURE_INVALID;
+		if (rv == CKR_USER_NOT_LOGGED_IN)
+		{
+			// INFO_MSG("User is not authorized");
+		}
+
+		return rv;
 	}
 
-	session->resetOp();
-	return CKR_OK;
-}
+	// Check if the to be wrapped key can be wrapped
+	if (key->getBooleanValue(CKA_EXTRACTABLE, false) == false)
+		return CKR_KEY_UNEXTRACTABLE;
+	if (key->getBooleanValue(CKA_WRAP_WITH_TRUSTED, false) && wrapKey->getBooleanValue(CKA_TRUSTED, false) == false)
+		return CKR_KEY_NOT_WRAPPABLE;
 
-// AsymmetricAlgorithm version of C_Verify
-static CK_RV AsymVerify(Session* session, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
-{
-	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
-	AsymMech::Type mechanism = session->getMechanism();
-	PublicKey* publicKey = session->getPublicKey();
-	size_t paramLen;
-	void* param = session->getParameters(paramLen);
-	if (asymCrypto == NULL || !session->getAllowSinglePartOp() || publicKey == NULL)
+	// Check the class
+	CK_OBJECT_CLASS keyClass = key->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED);
+	if (keyClass != CKO_SECRET_KEY && keyClass != CKO_PRIVATE_KEY)
+		return CKR_KEY_NOT_WRAPPABLE;
+	// CKM_RSA_PKCS and CKM_RSA_PKCS_OAEP can be used only on SECRET keys: PKCS#11 2.40 draft 2 section 2.1.6 PKCS #1 v1.5 RSA & section 2.1.8 PKCS #1 RSA OAEP
+	if ((mechanism == CKM_RSA_PKCS || mechanism == CKM_RSA_PKCS_OAEP) && keyClass != CKO_SECRET_KEY)
+		return CKR_KEY_NOT_WRAPPABLE;
+
+	// Verify the wrap template attribute
+	if (wrapKey->attributeExists(CKA_WRAP_TEMPLATE))
 	{
-		session->resetOp();
-		return CKR_OPERATION_NOT_INITIALIZED;
-	}
+		OSAttribute attr = wrapKey->getAttribute(CKA_WRAP_TEMPLATE);
 
-	// Size of the signature
-	CK_ULONG size = publicKey->getOutputLength();
+		if (attr.isAttributeMapAttribute())
+		{
+			typedef std::map<CK_ATTRIBUTE_TYPE,OSAttribute> attrmap_type;
 
-	// Check buffer size
-	if (ulSignatureLen != size)
-	{
-		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
-		session->resetOp();
-		return CKR_SIGNATURE_LEN_RANGE;
-	}
+			const attrmap_type& map = attr.getAttributeMapValue();
 
-	// Get the data
-	ByteString data;
+			for (attrmap_type::const_iterator it = map.begin(); it != map.end(); ++it)
+			{
+				if (!key->attributeExists(it->first))
+				{
+					return CKR_KEY_NOT_WRAPPABLE;
+				}
 
-	// We must allow input length <= k and therfore need to prepend the data with zeroes.
-	if (mechanism == AsymMech::RSA) {
-		data.wipe(size-ulDataLen);
+				OSAttribute keyAttr = key->getAttribute(it->first);
+				ByteString v1, v2;
+				if (!keyAttr.peekValue(v1) || !it->second.peekValue(v2) || (v1 != v2))
+				{
+					return CKR_KEY_NOT_WRAPPABLE;
+				}
+			}
+		}
 	}
 
-	data += ByteString(pData, ulDataLen);
-	ByteString signature(pSignature, ulSignatureLen);
-
-	// Verify the data
-	if (session->getAllowMultiPartOp())
+	// Get the key data to encrypt
+	if (keyClass == CKO_SECRET_KEY)
 	{
-		if (!asymCrypto->verifyUpdate(data) ||
-		    !asymCrypto->verifyFinal(signature))
+		if (isKeyPrivate)
 		{
-			session->resetOp();
-			return CKR_SIGNATURE_INVALID;
+			bool bOK = token->decrypt(key->getByteStringValue(CKA_VALUE), keydata);
+			if (!bOK) return CKR_GENERAL_ERROR;
+		}
+		else
+		{
+			keydata = key->getByteStringValue(CKA_VALUE);
 		}
 	}
-	else if (!asymCrypto->verify(publicKey,data,signature,mechanism,param,paramLen))
+	else
 	{
-		session->resetOp();
-		return CKR_SIGNATURE_INVALID;
+		CK_KEY_TYPE keyType = key->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED);
+		AsymAlgo::Type alg = AsymAlgo::Unknown;
+		switch (keyType) {
+			case CKK_RSA:
+				alg = AsymAlgo::RSA;
+				break;
+#if 0 // Unsupported by Crypto API Toolkit
+			case CKK_DSA:
+				alg = AsymAlgo::DSA;
+				break;
+			case CKK_DH:
+				alg = AsymAlgo::DH;
+				break;
+#endif // Unsupported by Crypto API Toolkit
+#ifdef WITH_ECC
+			case CKK_EC:
+				// can be ecdh too but it doesn't matter
+				alg = AsymAlgo::ECDSA;
+				break;
+#endif
+#ifdef WITH_EDDSA
+			// Not yet
+#endif
+#if 0 // Unsupported by Crypto API Toolkit
+#ifdef WITH_GOST
+			case CKK_GOSTR3410:
+				alg = AsymAlgo::GOST;
+				break;
+#endif
+#endif // Unsupported by Crypto API Toolkit
+			default:
+				return CKR_KEY_NOT_WRAPPABLE;
+		}
+		AsymmetricAlgorithm* asymCrypto = NULL;
+		PrivateKey* privateKey = NULL;
+		asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(alg);
+		if (asymCrypto == NULL)
+			return CKR_GENERAL_ERROR;
+		privateKey = asymCrypto->newPrivateKey();
+		if (privateKey == NULL)
+		{
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+			return CKR_HOST_MEMORY;
+		}
+		switch (keyType) {
+			case CKK_RSA:
+				rv = getRSAPrivateKey((RSAPrivateKey*)privateKey, token, key);
+				break;
+#if 0 //Unsupported Crypto API Toolkit
+			case CKK_DSA:
+				rv = getDSAPrivateKey((DSAPrivateKey*)privateKey, token, key);
+				break;
+			case CKK_DH:
+				rv = getDHPrivateKey((DHPrivateKey*)privateKey, token, key);
+				break;
+#endif //Unsupported Crypto API Toolkit
+#ifdef WITH_ECC
+			case CKK_EC:
+				rv = getECPrivateKey((ECPrivateKey*)privateKey, token, key);
+				break;
+#endif
+#if 0 //Unsupported Crypto API Toolkit
+#ifdef WITH_GOST
+			case CKK_GOSTR3410:
+				rv = getGOSTPrivateKey((GOSTPrivateKey*)privateKey, token, key);
+				break;
+#endif
+#endif //Unsupported Crypto API Toolkit
+		}
+		if (rv != CKR_OK)
+		{
+			asymCrypto->recyclePrivateKey(privateKey);
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
+			return CKR_GENERAL_ERROR;
+		}
+		keydata = privateKey->PKCS8Encode();
+		asymCrypto->recyclePrivateKey(privateKey);
+		CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
 	}
+	if (keydata.size() == 0)
+		return CKR_KEY_NOT_WRAPPABLE;
 
-	session->resetOp();
 	return CKR_OK;
 }
 
-// Perform a single pass verification operation
-CK_RV SoftHSM::C_Verify(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
+// Wrap the specified key using the specified wrapping key and mechanism
+CK_RV SoftHSM::C_WrapKey
+(
+	CK_SESSION_HANDLE hSession,
+	CK_MECHANISM_PTR pMechanism,
+	CK_OBJECT_HANDLE hWrappingKey,
+	CK_OBJECT_HANDLE hKey,
+	CK_BYTE_PTR pWrappedKey,
+	CK_ULONG_PTR pulWrappedKeyLen
+)
 {
 	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
-	if (pData == NULL_PTR) return CKR_ARGUMENTS_BAD;
-	if (pSignature == NULL_PTR) return CKR_ARGUMENTS_BAD;
-
-    if (ulDataLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
-    {
-        return CKR_ARGUMENTS_BAD;
-    }
+	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pulWrappedKeyLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
 
-    if (!validate_user_check_ptr(pData, ulDataLen))
+    if (!validate_user_check_ptr(pulWrappedKeyLen, sizeof(CK_ULONG)))
     {
         return CKR_DEVICE_MEMORY;
     }
 
-	if (ulSignatureLen)
+    CK_ULONG ulWrappedKeyLen = *pulWrappedKeyLen;
+    auto l_pulWrappedKeyLen = &ulWrappedKeyLen;
+
+	if (pWrappedKey && ulWrappedKeyLen)
 	{
-		if (!validate_user_check_ptr(pSignature, ulSignatureLen))
+		if (!validate_user_check_ptr(pWrappedKey, ulWrappedKeyLen))
 		{
 			return CKR_DEVICE_MEMORY;
 		}
 	}
 
-#ifdef ENABLE_MITIGATION
-    __builtin_ia32_lfence();
-#endif
-
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
-
-	// Check if we are doing the correct operation
-	if (session->getOpType() != SESSION_OP_VERIFY)
-		return CKR_OPERATION_NOT_INITIALIZED;
-
-	if (session->getMacOp() != NULL)
-		return MacVerify(session, pData, ulDataLen,
-				 pSignature, ulSignatureLen);
-	else
-		return AsymVerify(session, pData, ulDataLen,
-				  pSignature, ulSignatureLen);
-}
-
-// MacAlgorithm version of C_VerifyUpdate
-static CK_RV MacVerifyUpdate(Session* session, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
-{
-	MacAlgorithm* mac = session->getMacOp();
-	if (mac == NULL || !session->getAllowMultiPartOp())
-	{
-		session->resetOp();
-		return CKR_OPERATION_NOT_INITIALIZED;
-	}
-
-	// Get the part
-	ByteString part(pPart, ulPartLen);
-
-	// Verify the data
-	if (!mac->verifyUpdate(part))
-	{
-		// verifyUpdate can't fail for a logical reason, so we assume total breakdown.
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
-	}
-
-	session->setAllowSinglePartOp(false);
-	return CKR_OK;
-}
-
-// AsymmetricAlgorithm version of C_VerifyUpdate
-static CK_RV AsymVerifyUpdate(Session* session, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
-{
-	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
-	if (asymCrypto == NULL || !session->getAllowMultiPartOp())
-	{
-		session->resetOp();
-		return CKR_OPERATION_NOT_INITIALIZED;
-	}
-
-	// Get the part
-	ByteString part(pPart, ulPartLen);
-
-	// Verify the data
-	if (!asymCrypto->verifyUpdate(part))
+	if (!validate_user_check_mechanism_ptr(pMechanism, 1))
 	{
-		// verifyUpdate can't fail for a logical reason, so we assume total breakdown.
-		session->resetOp();
-		return CKR_GENERAL_ERROR;
+		return CKR_DEVICE_MEMORY;
 	}
 
-	session->setAllowSinglePartOp(false);
-	return CKR_OK;
-}
-
-// Update a running verification operation with additional data
-CK_RV SoftHSM::C_VerifyUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen)
-{
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+    CK_MECHANISM l_mechanism;
+    memcpy_s(&l_mechanism, sizeof(CK_MECHANISM), pMechanism, sizeof(CK_MECHANISM));
 
-	if (pPart == NULL_PTR) return CKR_ARGUMENTS_BAD;
+    auto ulParameterLen = l_mechanism.ulParameterLen;
 
-    if (ulPartLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
+    if (ulParameterLen > CKM_MAX_PARAMETER_LEN)
     {
         return CKR_ARGUMENTS_BAD;
     }
 
-    if (!validate_user_check_ptr(pPart, ulPartLen))
+    CK_BYTE parameter[ulParameterLen];
+    if (l_mechanism.pParameter != nullptr)
     {
-        return CKR_DEVICE_MEMORY;
+        if (!validate_user_check_ptr(l_mechanism.pParameter, ulParameterLen))
+        {
+            return CKR_DEVICE_MEMORY;
+        }
+
+        memcpy_s(&parameter[0], ulParameterLen, l_mechanism.pParameter, ulParameterLen);
+        l_mechanism.pParameter = &parameter[0];
     }
+    auto l_pMechanism = &l_mechanism;
 
 #ifdef ENABLE_MITIGATION
     __builtin_ia32_lfence();
@@ -7043,369 +10125,535 @@ CK_RV SoftHSM::C_VerifyUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_
 	Session* session = (Session*)handleManager->getSession(hSession);
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
-	// Check if we are doing the correct operation
-	if (session->getOpType() != SESSION_OP_VERIFY)
-		return CKR_OPERATION_NOT_INITIALIZED;
-
-	if (session->getMacOp() != NULL)
-		return MacVerifyUpdate(session, pPart, ulPartLen);
-	else
-		return AsymVerifyUpdate(session, pPart, ulPartLen);
-}
-
-// MacAlgorithm version of C_SignFinal
-static CK_RV MacVerifyFinal(Session* session, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
-{
-	MacAlgorithm* mac = session->getMacOp();
-	if (mac == NULL)
+	CK_RV rv;
+	// Check the mechanism, only accept advanced AES key wrapping and RSA
+	switch(l_pMechanism->mechanism)
 	{
-		session->resetOp();
-		return CKR_OPERATION_NOT_INITIALIZED;
-	}
-
-	// Size of the signature
-	CK_ULONG size = mac->getMacSize();
+        case CKM_AES_CTR:
+#ifdef WITH_AES_GCM
+        case CKM_AES_GCM:
+#endif
+        case CKM_AES_CBC:
+        case CKM_AES_CBC_PAD:
+        case CKM_EXPORT_ECDSA_QUOTE_RSA_PUBLIC_KEY_INTERNAL:
+            break;
+#ifdef HAVE_AES_KEY_WRAP
+		case CKM_AES_KEY_WRAP:
+#endif
+#ifdef HAVE_AES_KEY_WRAP_PAD
+		case CKM_AES_KEY_WRAP_PAD:
+#endif
+		case CKM_RSA_PKCS:
+			// Does not handle optional init vector
+			if (l_pMechanism->pParameter != NULL_PTR ||
+                l_pMechanism->ulParameterLen != 0)
+			return CKR_ARGUMENTS_BAD;
+			break;
+		case CKM_RSA_PKCS_OAEP:
+			rv = MechParamCheckRSAPKCSOAEP(l_pMechanism);
+			if (rv != CKR_OK)
+				return rv;
+			break;
 
-	// Check buffer size
-	if (ulSignatureLen != size)
-	{
-		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
-		session->resetOp();
-		return CKR_SIGNATURE_LEN_RANGE;
+		default:
+			return CKR_MECHANISM_INVALID;
 	}
 
-	// Get the signature
-	ByteString signature(pSignature, ulSignatureLen);
+	// Get the token
+	Token* token = session->getToken();
+	if (token == NULL) return CKR_GENERAL_ERROR;
 
-	// Verify the data
-	if (!mac->verifyFinal(signature))
-	{
-		session->resetOp();
-		return CKR_SIGNATURE_INVALID;
-	}
+    if(l_pMechanism->mechanism == CKM_EXPORT_ECDSA_QUOTE_RSA_PUBLIC_KEY_INTERNAL)
+    {
+        // Wrapping key Id must be null for RSA quote + public key export
+        if (hWrappingKey || !l_pulWrappedKeyLen)
+        {
+            return CKR_ARGUMENTS_BAD;
+        }
+#ifdef DCAP_SUPPORT
+        OSObject *key = (OSObject *)handleManager->getObject(hKey);
+        if (!key || !key->isValid())
+        {
+            return CKR_KEY_HANDLE_INVALID;
+        }
 
-	session->resetOp();
-	return CKR_OK;
-}
+        // If the key is used for quote generation it should not be used again
+        CK_BBOOL isUsedForQuoteGeneration = key->getBooleanValue(CKA_USED_FOR_QUOTE_GENERATION, false);
 
-// AsymmetricAlgorithm version of C_VerifyFinal
-static CK_RV AsymVerifyFinal(Session* session, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
-{
-	AsymmetricAlgorithm* asymCrypto = session->getAsymmetricCryptoOp();
-	PublicKey* publicKey = session->getPublicKey();
-	if (asymCrypto == NULL || publicKey == NULL)
-	{
-		session->resetOp();
-		return CKR_OPERATION_NOT_INITIALIZED;
-	}
+        if(isUsedForQuoteGeneration)
+        {
+            return CKR_KEY_HANDLE_INVALID;
+        }
 
-	// Size of the signature
-	CK_ULONG size = publicKey->getOutputLength();
+        CK_BBOOL isKeyOnToken = key->getBooleanValue(CKA_TOKEN, false);
+        if (isKeyOnToken)
+        {
+            return CKR_KEY_FUNCTION_NOT_PERMITTED;
+        }
 
-	// Check buffer size
-	if (ulSignatureLen != size)
-	{
-		// ERROR_MSG("The size of the signature differs from the size of the mechanism");
-		session->resetOp();
-		return CKR_SIGNATURE_LEN_RANGE;
-	}
+        rv = exportQuoteWithRsaPublicKey(hSession,
+                                         hKey,
+                                         l_pMechanism,
+                                         pWrappedKey,
+                                         l_pulWrappedKeyLen);
 
-	// Get the data
-	ByteString signature(pSignature, ulSignatureLen);
+        *pulWrappedKeyLen = ulWrappedKeyLen;
 
-	// Verify the data
-	if (!asymCrypto->verifyFinal(signature))
-	{
-		session->resetOp();
-		return CKR_SIGNATURE_INVALID;
-	}
+        if (pWrappedKey)
+        {
+            bool bOK = true;
+            bOK = bOK && key->setAttribute(CKA_USED_FOR_QUOTE_GENERATION, true);
+            if (!bOK)
+            {
+                memset_s(pWrappedKey, ulWrappedKeyLen, 0x00, ulWrappedKeyLen);
+                rv = CKR_FUNCTION_FAILED;
+                return rv;
+            }
 
-	session->resetOp();
-	return CKR_OK;
-}
+            bOK = bOK && key->setAttribute(CKA_USED_FOR_WRAPPING, true);
+            if (!bOK)
+            {
+                memset_s(pWrappedKey, ulWrappedKeyLen, 0x00, ulWrappedKeyLen);
+                rv = CKR_FUNCTION_FAILED;
+                return rv;
+            }
 
-// Finalise the verification operation and check the signature
-CK_RV SoftHSM::C_VerifyFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
-{
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+            CK_OBJECT_HANDLE privateKeyHandle = getRSAPairKey(hSession, hKey);
+            if (CK_INVALID_HANDLE == privateKeyHandle)
+            {
+                memset_s(pWrappedKey, ulWrappedKeyLen, 0x00, ulWrappedKeyLen);
+                return CKR_KEY_HANDLE_INVALID;
+            }
 
-	if (pSignature == NULL_PTR) return CKR_ARGUMENTS_BAD;
+            // Get the OS Object related to the private key
+            OSObject *privateKey = (OSObject*)handleManager->getObject(privateKeyHandle);
+            if (nullptr == privateKey || !privateKey->isValid())
+            {
+                memset_s(pWrappedKey, ulWrappedKeyLen, 0x00, ulWrappedKeyLen);
+                return CKR_OBJECT_HANDLE_INVALID;
+            }
 
-    if (ulSignatureLen)
-	{
-		if (!validate_user_check_ptr(pSignature, ulSignatureLen))
-		{
-			return CKR_DEVICE_MEMORY;
-		}
-	}
+            bOK = bOK && privateKey->setAttribute(CKA_USED_FOR_QUOTE_GENERATION, true);
+            if (!bOK)
+            {
+                memset_s(pWrappedKey, ulWrappedKeyLen, 0x00, ulWrappedKeyLen);
+                rv = CKR_FUNCTION_FAILED;
+            }
 
-#ifdef ENABLE_MITIGATION
-    __builtin_ia32_lfence();
+            bOK = bOK && privateKey->setAttribute(CKA_USED_FOR_WRAPPING, true);
+            if (!bOK)
+            {
+                memset_s(pWrappedKey, ulWrappedKeyLen, 0x00, ulWrappedKeyLen);
+                rv = CKR_FUNCTION_FAILED;
+            }
+        }
+#else
+        rv = CKR_MECHANISM_INVALID;
 #endif
+    }
+    else
+    {
+        // Check the wrapping key handle.
+        OSObject *wrapKey = (OSObject *)handleManager->getObject(hWrappingKey);
+        if (wrapKey == NULL_PTR || !wrapKey->isValid()) return CKR_WRAPPING_KEY_HANDLE_INVALID;
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+        CK_BBOOL isWrapKeyOnToken = wrapKey->getBooleanValue(CKA_TOKEN, false);
+        CK_BBOOL isWrapKeyPrivate = wrapKey->getBooleanValue(CKA_PRIVATE, true);
 
-	// Check if we are doing the correct operation
-	if (session->getOpType() != SESSION_OP_VERIFY || !session->getAllowMultiPartOp())
-		return CKR_OPERATION_NOT_INITIALIZED;
+#ifdef DCAP_SUPPORT
+        // If the key is used for quote generation should not be used for wrapping
+        CK_BBOOL isUsedForQuoteGeneration = wrapKey->getBooleanValue(CKA_USED_FOR_QUOTE_GENERATION, false);
 
-	if (session->getMacOp() != NULL)
-		return MacVerifyFinal(session, pSignature, ulSignatureLen);
-	else
-		return AsymVerifyFinal(session, pSignature, ulSignatureLen);
-}
+        if(isUsedForQuoteGeneration)
+        {
+            return CKR_WRAPPING_KEY_HANDLE_INVALID;
+        }
+#endif
+        // Check user credentials for the wrapping key
+        rv = haveRead(session->getState(), isWrapKeyOnToken, isWrapKeyPrivate);
+        if (rv != CKR_OK)
+        {
+            if (rv == CKR_USER_NOT_LOGGED_IN)
+            {
+                // INFO_MSG("User is not authorized");
+            }
 
-// Initialise a verification operation the allows recovery of the signed data from the signature
-CK_RV SoftHSM::C_VerifyRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR /*pMechanism*/, CK_OBJECT_HANDLE /*hKey*/)
-{
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+            return rv;
+        }
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+        // Check wrapping key class and type
+        if ((l_pMechanism->mechanism == CKM_AES_KEY_WRAP || l_pMechanism->mechanism == CKM_AES_KEY_WRAP_PAD) && wrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) != CKO_SECRET_KEY)
+            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+        if ((l_pMechanism->mechanism == CKM_RSA_PKCS || l_pMechanism->mechanism == CKM_RSA_PKCS_OAEP) && wrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) != CKO_PUBLIC_KEY)
+            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+        if (l_pMechanism->mechanism == CKM_AES_KEY_WRAP && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+        if (l_pMechanism->mechanism == CKM_AES_KEY_WRAP_PAD && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+        if ((l_pMechanism->mechanism == CKM_RSA_PKCS || l_pMechanism->mechanism == CKM_RSA_PKCS_OAEP) && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_RSA)
+            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+        if (l_pMechanism->mechanism == CKM_AES_CTR && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+        if (l_pMechanism->mechanism == CKM_AES_GCM && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+        if (l_pMechanism->mechanism == CKM_AES_CBC && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+        if (l_pMechanism->mechanism == CKM_AES_CBC_PAD && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
 
-	// Check if we have another operation
-	if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+        // Check if the wrapping key can be used for wrapping
+        if (wrapKey->getBooleanValue(CKA_WRAP, false) == false)
+            return CKR_KEY_FUNCTION_NOT_PERMITTED;
 
-	return CKR_FUNCTION_NOT_SUPPORTED;
-}
+        // Check if the specified mechanism is allowed for the wrapping key
+        if (!isMechanismPermitted(wrapKey, l_pMechanism))
+            return CKR_MECHANISM_INVALID;
 
-// Perform a single part verification operation and recover the signed data
-CK_RV SoftHSM::C_VerifyRecover(CK_SESSION_HANDLE hSession, CK_BYTE_PTR /*pSignature*/, CK_ULONG /*ulSignatureLen*/, CK_BYTE_PTR /*pData*/, CK_ULONG_PTR /*pulDataLen*/)
-{
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+        // Get the key data to encrypt
+        ByteString keydata;
+        rv = WrapKeyData(session, token, wrapKey, hKey, l_pMechanism->mechanism, keydata);
+        if (rv != CKR_OK)
+            return rv;
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+        CK_OBJECT_CLASS keyClass = wrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED);
+#ifdef SGXHSM
+        if (keyClass == CKO_SECRET_KEY                  &&
+            (l_pMechanism->mechanism  == CKM_AES_CTR      ||
+             l_pMechanism->mechanism  == CKM_AES_GCM      ||
+             l_pMechanism->mechanism  == CKM_AES_CBC      ||
+             l_pMechanism->mechanism  == CKM_AES_CBC_PAD))
+        {
+            // The wrap borrows the session's cipher slot
+            if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
+
+            if (!pWrappedKey)
+            {
+                rv = SoftHSM::SymEncryptInit(hSession, l_pMechanism, hWrappingKey);
+                if (rv != CKR_OK)
+                {
+                    session->resetOp();
+                    return rv;
+                }
 
-	return CKR_FUNCTION_NOT_SUPPORTED;
-}
+                rv = SymEncrypt(session, (CK_BYTE_PTR) keydata.const_byte_str(), keydata.size(), NULL_PTR, l_pulWrappedKeyLen);
 
-// Update a running multi-part encryption and digesting operation
-CK_RV SoftHSM::C_DigestEncryptUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR /*pPart*/, CK_ULONG /*ulPartLen*/, CK_BYTE_PTR /*pEncryptedPart*/, CK_ULONG_PTR /*pulEncryptedPartLen*/)
-{
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+                session->resetOp();
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+                *pulWrappedKeyLen = ulWrappedKeyLen;
 
-	return CKR_FUNCTION_NOT_SUPPORTED;
-}
+                return rv;
+            }
 
-// Update a running multi-part decryption and digesting operation
-CK_RV SoftHSM::C_DecryptDigestUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR /*pPart*/, CK_ULONG /*ulPartLen*/, CK_BYTE_PTR /*pDecryptedPart*/, CK_ULONG_PTR /*pulDecryptedPartLen*/)
-{
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+            rv = SoftHSM::SymEncryptInit(hSession, l_pMechanism, hWrappingKey);
+            if (rv != CKR_OK)
+            {
+                session->resetOp();
+                return rv;
+            }
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+            rv = SymEncrypt(session, (CK_BYTE_PTR) keydata.const_byte_str(), keydata.size(), pWrappedKey, l_pulWrappedKeyLen);
+            if (rv != CKR_OK)
+            {
+                session->resetOp();
+            }
 
-	return CKR_FUNCTION_NOT_SUPPORTED;
-}
+            wrapKey->setAttribute(CKA_USED_FOR_WRAPPING, true);
+        }
+        else
+        {
+#endif
+            ByteString wrapped;
+            if (keyClass == CKO_SECRET_KEY)
+            {
+                rv = SoftHSM::WrapKeySym(l_pMechanism, token, wrapKey, keydata, wrapped);
+            }
+            else
+            {
+                rv = SoftHSM::WrapKeyAsym(l_pMechanism, token, wrapKey, keydata, wrapped);
+#ifdef SGXHSM
+                if (rv == CKR_OK)
+                {
+                    if (wrapKey->startTransaction())
+                    {
+                        bool bOK = true;
+                        bOK = bOK && wrapKey->setAttribute(CKA_USED_FOR_WRAPPING, true);
 
-// Update a running multi-part signing and encryption operation
-CK_RV SoftHSM::C_SignEncryptUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR /*pPart*/, CK_ULONG /*ulPartLen*/, CK_BYTE_PTR /*pEncryptedPart*/, CK_ULONG_PTR /*pulEncryptedPartLen*/)
-{
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+                        if (bOK)
+                        {
+                            bOK = wrapKey->commitTransaction();
+                        }
+                        else
+                        {
+                            wrapKey->abortTransaction();
+                            wrapped.wipe();
+                            rv = CKR_FUNCTION_FAILED;
+                            return rv;
+                        }
+                    }
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+                    CK_ULONG pairKeyId = wrapKey->getUnsignedLongValue(CKA_ASYMMETRIC_PAIR_ID, 0);
 
-	return CKR_FUNCTION_NOT_SUPPORTED;
-}
+                    if (pairKeyId != 0)
+                    {
+                        CK_ATTRIBUTE pTemplate[] = { { CKA_ASYMMETRIC_PAIR_ID, &pairKeyId, sizeof(pairKeyId) },
+                                                   };
 
-// Update a running multi-part decryption and verification operation
-CK_RV SoftHSM::C_DecryptVerifyUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR /*pEncryptedPart*/, CK_ULONG /*ulEncryptedPartLen*/, CK_BYTE_PTR /*pPart*/, CK_ULONG_PTR /*pulPartLen*/)
-{
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+                        rv = FindObjectsInit(hSession, &pTemplate[0], 1);
+                        if (rv != CKR_OK)
+                        {
+                            wrapped.wipe();
+                            return rv;
+                        }
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+                        CK_OBJECT_HANDLE hObjects[2];
+                        CK_ULONG ulObjectCount = 0;
 
-	return CKR_FUNCTION_NOT_SUPPORTED;
-}
+                        //Finding corresponding private key handle having same pair key id
+                        //Only two objects (RSA public key and corresponding private key)
+                        //are having same pair id key which is generated randomly
+                        rv = FindObjects(hSession, &hObjects[0], 2, &ulObjectCount);
+                        if (rv != CKR_OK)
+                        {
+                            wrapped.wipe();
+                            return rv;
+                        }
 
-// Generate a secret key or a domain parameter set using the specified mechanism
-CK_RV SoftHSM::C_GenerateKey(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, CK_OBJECT_HANDLE_PTR phKey)
-{
-    CK_OBJECT_HANDLE hKey;
-    auto l_phKey = &hKey;
+                        if (ulObjectCount != 2)
+                        {
+                            wrapped.wipe();
+                            rv = CKR_FUNCTION_FAILED;
+                            return rv;
+                        }
 
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+                        CK_OBJECT_HANDLE privateKeyHandle = CK_INVALID_HANDLE;
 
-	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+                        for (CK_ULONG i = 0 ; i < ulObjectCount ; i++)
+                        {
+                            if (hObjects[i] != hWrappingKey)
+                            {
+                                privateKeyHandle = hObjects[i];
+                                break;
+                            }
+                        }
 
-    if (nullptr == pTemplate && 0 != ulCount)
-    {
-        return CKR_ARGUMENTS_BAD;
-    }
+                        if (CK_INVALID_HANDLE == privateKeyHandle)
+                        {
+                            wrapped.wipe();
+                            return CKR_KEY_HANDLE_INVALID;
+                        }
 
-	if (phKey == NULL_PTR) return CKR_ARGUMENTS_BAD;
+                        // Get the OS Object related to the private key
+                        OSObject *privateKey = (OSObject*)handleManager->getObject(privateKeyHandle);
+                        rv = C_FindObjectsFinal(hSession);
+                        if (privateKey == NULL_PTR || !privateKey->isValid())
+                        {
+                            wrapped.wipe();
+                            return CKR_OBJECT_HANDLE_INVALID;
+                        }
 
-    if (!validate_user_check_ptr(phKey, sizeof(CK_OBJECT_HANDLE)))
-    {
-        return CKR_DEVICE_MEMORY;
-    }
+                        if (privateKey->startTransaction())
+                        {
+                            bool bOK = true;
+                            bOK = bOK && privateKey->setAttribute(CKA_USED_FOR_WRAPPING, true);
 
-    if (ulCount > CKA_MAX_ATTRIBUTES)
-    {
-        return CKR_ARGUMENTS_BAD;
-    }
+                            if (bOK)
+                            {
+                                bOK = privateKey->commitTransaction();
+                            }
+                            else
+                            {
+                                privateKey->abortTransaction();
+                            }
 
-	if (ulCount && !validate_user_check_attribute_ptr(pTemplate, ulCount))
-	{
-		return CKR_DEVICE_MEMORY;
-	}
+                            if (!bOK)
+                            {
+                                wrapped.wipe();
+                                rv = CKR_FUNCTION_FAILED;
+                            }
+                        }
+                    }
+                }
+#endif
+            }
 
-    CK_ATTRIBUTE l_template[ulCount];
-    memset_s(l_template, ulCount * sizeof(CK_ATTRIBUTE), 0x00, ulCount * sizeof(CK_ATTRIBUTE));
-    memcpy_s(l_template, ulCount * sizeof(CK_ATTRIBUTE), pTemplate, ulCount * sizeof(CK_ATTRIBUTE));
+            if (rv != CKR_OK)
+            {
+                wrapped.wipe();
+                return rv;
+            }
 
-    std::vector<std::vector<CK_BYTE>> value(ulCount);
+            if (pWrappedKey != NULL)
+            {
+                if (ulWrappedKeyLen >= wrapped.size())
+                {
+                    memcpy_s(pWrappedKey, ulWrappedKeyLen, wrapped.byte_str(), wrapped.size());
+                }
+                else
+                {
+                    rv = CKR_BUFFER_TOO_SMALL;
+                }
+            }
 
-    for (CK_ULONG i = 0; i < ulCount; i++)
-    {
-        if (l_template[i].pValue == nullptr)
-        {
-            continue;
+            *pulWrappedKeyLen = wrapped.size();
+#ifdef SGXHSM
         }
+#endif
+    }
 
-        auto ulValueLen = l_template[i].ulValueLen;
-        if (!validate_user_check_ptr(l_template[i].pValue, ulValueLen))
-        {
-            return CKR_DEVICE_MEMORY;
-        }
+    return rv;
+}
 
-        value[i].resize(ulValueLen);
-        memcpy_s(value[i].data(), ulValueLen, l_template[i].pValue, ulValueLen);
-        l_template[i].pValue = value[i].data();
-    }
+// Internal: Unwrap blob using symmetric key
+CK_RV SoftHSM::UnwrapKeySym
+(
+	CK_MECHANISM_PTR pMechanism,
+	ByteString& wrapped,
+	Token* token,
+	OSObject* unwrapKey,
+	ByteString& keydata
+)
+{
+	// Get the symmetric algorithm matching the mechanism
+	SymAlgo::Type algo = SymAlgo::Unknown;
+	SymWrap::Type mode = SymWrap::Unknown;
+	size_t bb = 8;
+	switch(pMechanism->mechanism) {
+#ifdef HAVE_AES_KEY_WRAP
+		case CKM_AES_KEY_WRAP:
+			algo = SymAlgo::AES;
+			mode = SymWrap::AES_KEYWRAP;
+			break;
+#endif
+#ifdef HAVE_AES_KEY_WRAP_PAD
+		case CKM_AES_KEY_WRAP_PAD:
+			algo = SymAlgo::AES;
+			mode = SymWrap::AES_KEYWRAP_PAD;
+			break;
+#endif
+		default:
+			return CKR_MECHANISM_INVALID;
+	}
+	SymmetricAlgorithm* cipher = CryptoFactory::i()->getSymmetricAlgorithm(algo);
+	if (cipher == NULL) return CKR_MECHANISM_INVALID;
 
-    auto l_pTemplate = l_template;
+	SymmetricKey* unwrappingkey = new SymmetricKey();
 
-	if (!validate_user_check_mechanism_ptr(pMechanism, 1))
+	if (getSymmetricKey(unwrappingkey, token, unwrapKey) != CKR_OK)
 	{
-		return CKR_DEVICE_MEMORY;
+		cipher->recycleKey(unwrappingkey);
+		CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
+		return CKR_GENERAL_ERROR;
 	}
 
-    CK_MECHANISM l_mechanism;
-    memcpy_s(&l_mechanism, sizeof(CK_MECHANISM), pMechanism, sizeof(CK_MECHANISM));
-
-    auto ulParameterLen = l_mechanism.ulParameterLen;
-
-    if (ulParameterLen > CKM_MAX_PARAMETER_LEN)
-    {
-        return CKR_ARGUMENTS_BAD;
-    }
+	// adjust key bit length
+	unwrappingkey->setBitLen(unwrappingkey->getKeyBits().size() * bb);
 
-    CK_BYTE parameter[ulParameterLen];
-    if (l_mechanism.pParameter != nullptr)
-    {
-        if (!validate_user_check_ptr(l_mechanism.pParameter, ulParameterLen))
-        {
-            return CKR_DEVICE_MEMORY;
-        }
+	// Unwrap the key
+	CK_RV rv = CKR_OK;
+	if (!cipher->unwrapKey(unwrappingkey, mode, wrapped, keydata))
+		rv = CKR_GENERAL_ERROR;
+	cipher->recycleKey(unwrappingkey);
+	CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
+	return rv;
+}
 
-        memcpy_s(&parameter[0], ulParameterLen, l_mechanism.pParameter, ulParameterLen);
-        l_mechanism.pParameter = &parameter[0];
-    }
-    auto l_pMechanism = &l_mechanism;
+// Internal: Unwrap blob using asymmetric key
+CK_RV SoftHSM::UnwrapKeyAsym
+(
+	CK_MECHANISM_PTR pMechanism,
+	ByteString& wrapped,
+	Token* token,
+	OSObject* unwrapKey,
+	ByteString& keydata
+)
+{
+	// Get the symmetric algorithm matching the mechanism
+	AsymAlgo::Type algo = AsymAlgo::Unknown;
+	AsymMech::Type mode = AsymMech::Unknown;
+	switch(pMechanism->mechanism) {
+		case CKM_RSA_PKCS:
+			algo = AsymAlgo::RSA;
+			mode = AsymMech::RSA_PKCS;
+			break;
 
-#ifdef ENABLE_MITIGATION
-    __builtin_ia32_lfence();
-#endif
+		case CKM_RSA_PKCS_OAEP:
+			algo = AsymAlgo::RSA;
+			mode = AsymMech::RSA_PKCS_OAEP;
+			break;
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+		default:
+			return CKR_MECHANISM_INVALID;
+	}
+	AsymmetricAlgorithm* cipher = CryptoFactory::i()->getAsymmetricAlgorithm(algo);
+	if (cipher == NULL) return CKR_MECHANISM_INVALID;
 
-	// Check the mechanism, only accept DSA and DH parameters
-	// and symmetric ciphers
-	CK_OBJECT_CLASS objClass;
-	CK_KEY_TYPE keyType;
-	switch (l_pMechanism->mechanism)
+	PrivateKey* unwrappingkey = cipher->newPrivateKey();
+	if (unwrappingkey == NULL)
 	{
-#if 0 // Unsupported by Crypto API Toolkit
-		case CKM_DSA_PARAMETER_GEN:
-			objClass = CKO_DOMAIN_PARAMETERS;
-			keyType = CKK_DSA;
-			break;
-		case CKM_DH_PKCS_PARAMETER_GEN:
-			objClass = CKO_DOMAIN_PARAMETERS;
-			keyType = CKK_DH;
-			break;
-#ifndef WITH_FIPS
-		case CKM_DES_KEY_GEN:
-			objClass = CKO_SECRET_KEY;
-			keyType = CKK_DES;
-			break;
-#endif
-		case CKM_DES2_KEY_GEN:
-			objClass = CKO_SECRET_KEY;
-			keyType = CKK_DES2;
-			break;
-		case CKM_DES3_KEY_GEN:
-			objClass = CKO_SECRET_KEY;
-			keyType = CKK_DES3;
-			break;
-#endif // Unsupported by Crypto API Toolkit
-		case CKM_AES_KEY_GEN:
-			objClass = CKO_SECRET_KEY;
-			keyType = CKK_AES;
-			break;
-#if 0 // Unsupported by Crypto API Toolkit
-		case CKM_GENERIC_SECRET_KEY_GEN:
-			objClass = CKO_SECRET_KEY;
-			keyType = CKK_GENERIC_SECRET;
+		CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
+		return CKR_HOST_MEMORY;
+	}
+
+	switch(pMechanism->mechanism) {
+		case CKM_RSA_PKCS:
+		case CKM_RSA_PKCS_OAEP:
+			if (getRSAPrivateKey((RSAPrivateKey*)unwrappingkey, token, unwrapKey) != CKR_OK)
+			{
+				cipher->recyclePrivateKey(unwrappingkey);
+				CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
+				return CKR_GENERAL_ERROR;
+			}
 			break;
-#endif // Unsupported by Crypto API Toolkit
+
 		default:
 			return CKR_MECHANISM_INVALID;
 	}
 
+	// Unwrap the key
+	CK_RV rv = CKR_OK;
+	if (!cipher->unwrapKey(unwrappingkey, wrapped, keydata, mode))
+		rv = CKR_GENERAL_ERROR;
+	cipher->recyclePrivateKey(unwrappingkey);
+	CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
+	return rv;
+}
+
+// Internal: Check the template of a key to unwrap and build the template of
+// the new object; secretAttribs points to objClass, keyType, isOnToken and
+// isPrivate and has room for MAX_UNWRAP_ATTRIBUTES attributes
+CK_RV SoftHSM::UnwrapKeyTemplate
+(
+	Session* session,
+	OSObject* unwrapKey,
+	CK_ATTRIBUTE_PTR pTemplate,
+	CK_ULONG ulCount,
+	CK_OBJECT_CLASS& objClass,
+	CK_KEY_TYPE& keyType,
+	CK_BBOOL& isOnToken,
+	CK_BBOOL& isPrivate,
+	CK_ATTRIBUTE_PTR secretAttribs,
+	CK_ULONG& secretAttribsCount
+)
+{
 	// Extract information from the template that is needed to create the object.
-	CK_BBOOL isOnToken = CK_FALSE;
-	CK_BBOOL isPrivate = CK_TRUE;
+	isOnToken = CK_FALSE;
+	isPrivate = CK_TRUE;
 	CK_CERTIFICATE_TYPE dummy;
-	bool isImplicit = true;
-	extractObjectInformation(l_pTemplate, ulCount, objClass, keyType, dummy, isOnToken, isPrivate, isImplicit);
+	bool isImplicit = false;
+	CK_RV rv = extractObjectInformation(pTemplate, ulCount, objClass, keyType, dummy, isOnToken, isPrivate, isImplicit);
+	if (rv != CKR_OK)
+	{
+		// ERROR_MSG("Mandatory attribute not present in template");
+		return rv;
+	}
 
 	// Report errors and/or unexpected usage.
-	if (objClass != CKO_SECRET_KEY && objClass != CKO_DOMAIN_PARAMETERS)
+	if (objClass != CKO_SECRET_KEY && objClass != CKO_PRIVATE_KEY)
 		return CKR_ATTRIBUTE_VALUE_INVALID;
-	if (l_pMechanism->mechanism == CKM_DSA_PARAMETER_GEN &&
-	    (objClass != CKO_DOMAIN_PARAMETERS || keyType != CKK_DSA))
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_DH_PKCS_PARAMETER_GEN &&
-	    (objClass != CKO_DOMAIN_PARAMETERS || keyType != CKK_DH))
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_DES_KEY_GEN &&
-	    (objClass != CKO_SECRET_KEY || keyType != CKK_DES))
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_DES2_KEY_GEN &&
-	    (objClass != CKO_SECRET_KEY || keyType != CKK_DES2))
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_DES3_KEY_GEN &&
-	    (objClass != CKO_SECRET_KEY || keyType != CKK_DES3))
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_AES_KEY_GEN &&
-	    (objClass != CKO_SECRET_KEY || keyType != CKK_AES))
-		return CKR_TEMPLATE_INCONSISTENT;
-#if 0 // Unsupported by Crypto API Toolkit
-	if (l_pMechanism->mechanism == CKM_GENERIC_SECRET_KEY_GEN &&
-	    (objClass != CKO_SECRET_KEY || keyType != CKK_GENERIC_SECRET))
-		return CKR_TEMPLATE_INCONSISTENT;
-#endif // Unsupported by Crypto API Toolkit
+	// Key type will be handled at object creation
 
 	// Check authorization
-	CK_RV rv = haveWrite(session->getState(), isOnToken, isPrivate);
+	rv = haveWrite(session->getState(), isOnToken, isPrivate);
 	if (rv != CKR_OK)
 	{
 		if (rv == CKR_USER_NOT_LOGGED_IN)
@@ -7420,192 +10668,265 @@ CK_RV SoftHSM::C_GenerateKey(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMecha
 		return rv;
 	}
 
-#if 0 // Unsupported by Crypto API Toolkit
-	// Generate DSA domain parameters
-	if (l_pMechanism->mechanism == CKM_DSA_PARAMETER_GEN)
-	{
-		rv = this->generateDSAParameters(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
-        *phKey = hKey;
-        return rv;
-	}
+	// Build unwrapped key template
+	secretAttribs[0].type = CKA_CLASS;
+	secretAttribs[0].pValue = &objClass;
+	secretAttribs[0].ulValueLen = sizeof(objClass);
+	secretAttribs[1].type = CKA_TOKEN;
+	secretAttribs[1].pValue = &isOnToken;
+	secretAttribs[1].ulValueLen = sizeof(isOnToken);
+	secretAttribs[2].type = CKA_PRIVATE;
+	secretAttribs[2].pValue = &isPrivate;
+	secretAttribs[2].ulValueLen = sizeof(isPrivate);
+	secretAttribs[3].type = CKA_KEY_TYPE;
+	secretAttribs[3].pValue = &keyType;
+	secretAttribs[3].ulValueLen = sizeof(keyType);
+	secretAttribsCount = 4;
 
-	// Generate DH domain parameters
-	if (l_pMechanism->mechanism == CKM_DH_PKCS_PARAMETER_GEN)
+	// Add the additional
+	if (ulCount > (MAX_UNWRAP_ATTRIBUTES - secretAttribsCount))
+		return CKR_TEMPLATE_INCONSISTENT;
+	for (CK_ULONG i = 0; i < ulCount; ++i)
 	{
-		rv = this->generateDHParameters(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
-        *phKey = hKey;
-        return rv;
+		switch (pTemplate[i].type)
+		{
+			case CKA_CLASS:
+			case CKA_TOKEN:
+			case CKA_PRIVATE:
+			case CKA_KEY_TYPE:
+				continue;
+			default:
+				secretAttribs[secretAttribsCount++] = pTemplate[i];
+		}
 	}
 
-	// Generate DES secret key
-	if (l_pMechanism->mechanism == CKM_DES_KEY_GEN)
+	// Apply the unwrap template
+	if (unwrapKey->attributeExists(CKA_UNWRAP_TEMPLATE))
 	{
-		rv = this->generateDES(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
-        *phKey = hKey;
-        return rv;
+		OSAttribute unwrapAttr = unwrapKey->getAttribute(CKA_UNWRAP_TEMPLATE);
+
+		if (unwrapAttr.isAttributeMapAttribute())
+		{
+			typedef std::map<CK_ATTRIBUTE_TYPE,OSAttribute> attrmap_type;
+
+			const attrmap_type& map = unwrapAttr.getAttributeMapValue();
+
+			for (attrmap_type::const_iterator it = map.begin(); it != map.end(); ++it)
+			{
+				CK_ATTRIBUTE* attr = NULL;
+				for (CK_ULONG i = 0; i < secretAttribsCount; ++i)
+				{
+					if (it->first == secretAttribs[i].type)
+					{
+						if (attr != NULL)
+						{
+							return CKR_TEMPLATE_INCONSISTENT;
+						}
+						attr = &secretAttribs[i];
+						ByteString value;
+						it->second.peekValue(value);
+						if (attr->ulValueLen != value.size())
+						{
+							return CKR_TEMPLATE_INCONSISTENT;
+						}
+						if (memcmp(attr->pValue, value.const_byte_str(), value.size()) != 0)
+						{
+							return CKR_TEMPLATE_INCONSISTENT;
+						}
+					}
+				}
+				if (attr == NULL)
+				{
+					return CKR_TEMPLATE_INCONSISTENT;
+				}
+			}
+		}
 	}
 
-	// Generate DES2 secret key
-	if (l_pMechanism->mechanism == CKM_DES2_KEY_GEN)
-	{
-		rv = this->generateDES2(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
-        *phKey = hKey;
-        return rv;
-	}
+	return CKR_OK;
+}
+
+// Internal: Create the object of an unwrapped key and store the key
+// material; the object is removed again if this fails
+CK_RV SoftHSM::UnwrapKeyStore
+(
+	CK_SESSION_HANDLE hSession,
+	Token* token,
+	CK_ATTRIBUTE_PTR secretAttribs,
+	CK_ULONG secretAttribsCount,
+	CK_OBJECT_CLASS objClass,
+	CK_KEY_TYPE keyType,
+	CK_BBOOL isPrivate,
+	ByteString& keydata,
+	CK_OBJECT_HANDLE& hKey
+)
+{
+	hKey = CK_INVALID_HANDLE;
+
+	// Create the secret object using C_CreateObject
+	CK_RV rv = this->CreateObject(hSession, secretAttribs, secretAttribsCount, &hKey, OBJECT_OP_UNWRAP);
 
-	// Generate DES3 secret key
-	if (l_pMechanism->mechanism == CKM_DES3_KEY_GEN)
+	// Store the attributes that are being supplied
+	if (rv == CKR_OK)
 	{
-		rv = this->generateDES3(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
-        *phKey = hKey;
-        return rv;
-	}
+		OSObject* osobject = (OSObject*)handleManager->getObject(hKey);
+		if (osobject == NULL_PTR || !osobject->isValid())
+        {
+            rv = CKR_FUNCTION_FAILED;
+        }
+		else if (osobject->startTransaction())
+		{
+			bool bOK = true;
+
+			// Common Attributes
+			bOK = bOK && osobject->setAttribute(CKA_LOCAL, false);
+
+			// Common Secret Key Attributes
+			bOK = bOK && osobject->setAttribute(CKA_ALWAYS_SENSITIVE, false);
+			bOK = bOK && osobject->setAttribute(CKA_NEVER_EXTRACTABLE, false);
+
+			// Secret Attributes
+			if (objClass == CKO_SECRET_KEY)
+			{
+				ByteString value;
+				if (isPrivate)
+					token->encrypt(keydata, value);
+				else
+					value = keydata;
+				bOK = bOK && osobject->setAttribute(CKA_VALUE, value);
+			}
+			else if (keyType == CKK_RSA)
+			{
+				bOK = bOK && setRSAPrivateKey(osobject, keydata, token, isPrivate != CK_FALSE);
+			}
+#if 0 // Unsupported by Crypto API Toolkit
+			else if (keyType == CKK_DSA)
+			{
+				bOK = bOK && setDSAPrivateKey(osobject, keydata, token, isPrivate != CK_FALSE);
+			}
+			else if (keyType == CKK_DH)
+			{
+				bOK = bOK && setDHPrivateKey(osobject, keydata, token, isPrivate != CK_FALSE);
+			}
+#endif // Unsupported by Crypto API Toolkit
+#ifdef WITH_ECC
+			else if (keyType == CKK_EC)
+			{
+				bOK = bOK && setECPrivateKey(osobject, keydata, token, isPrivate != CK_FALSE);
+			}
+#endif
+#if 0 // Unsupported by Crypto API Toolkit
+#ifdef WITH_GOST
+			else if (keyType == CKK_GOSTR3410)
+			{
+				bOK = bOK && setGOSTPrivateKey(osobject, keydata, token, isPrivate != CK_FALSE);
+			}
+#endif
 #endif // Unsupported by Crypto API Toolkit
+			else
+				bOK = false;
 
-	// Generate AES secret key
-	if (l_pMechanism->mechanism == CKM_AES_KEY_GEN)
-	{
-		rv = this->generateAES(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
-        *phKey = hKey;
-        return rv;
+			if (bOK)
+            {
+				bOK = osobject->commitTransaction();
+            }
+			else
+            {
+				osobject->abortTransaction();
+            }
+
+			if (!bOK)
+            {
+				rv = CKR_FUNCTION_FAILED;
+            }
+		}
+		else
+        {
+			rv = CKR_FUNCTION_FAILED;
+        }
 	}
 
-#if 0 // Unsupported by Crypto API Toolkit
-	// Generate generic secret key
-	if (l_pMechanism->mechanism == CKM_GENERIC_SECRET_KEY_GEN)
+	// Remove secret that may have been created already when the function fails.
+	if (rv != CKR_OK)
 	{
-		rv = this->generateGeneric(hSession, l_pTemplate, ulCount, l_phKey, isOnToken, isPrivate);
-        *phKey = hKey;
-        return rv;
+		if (hKey != CK_INVALID_HANDLE)
+		{
+			OSObject* obj = (OSObject*)handleManager->getObject(hKey);
+			handleManager->destroyObject(hKey);
+			if (obj) obj->destroyObject();
+			hKey = CK_INVALID_HANDLE;
+		}
 	}
-#endif // Unsupported by Crypto API Toolkit
 
-	return CKR_GENERAL_ERROR;
+	return rv;
 }
 
-// Generate a key-pair using the specified mechanism
-CK_RV SoftHSM::C_GenerateKeyPair
+// Unwrap the specified key using the specified unwrapping key
+CK_RV SoftHSM::C_UnwrapKey
 (
 	CK_SESSION_HANDLE hSession,
 	CK_MECHANISM_PTR pMechanism,
-	CK_ATTRIBUTE_PTR pPublicKeyTemplate,
-	CK_ULONG ulPublicKeyAttributeCount,
-	CK_ATTRIBUTE_PTR pPrivateKeyTemplate,
-	CK_ULONG ulPrivateKeyAttributeCount,
-	CK_OBJECT_HANDLE_PTR phPublicKey,
-	CK_OBJECT_HANDLE_PTR phPrivateKey
+	CK_OBJECT_HANDLE hUnwrappingKey,
+	CK_BYTE_PTR pWrappedKey,
+	CK_ULONG ulWrappedKeyLen,
+	CK_ATTRIBUTE_PTR pTemplate,
+	CK_ULONG ulCount,
+	CK_OBJECT_HANDLE_PTR hKey
 )
 {
-    CK_OBJECT_HANDLE hPublicKey;
-    auto l_phPublicKey = &hPublicKey;
-
-    CK_OBJECT_HANDLE hPrivateKey;
-    auto l_phPrivateKey = &hPrivateKey;
+    CK_OBJECT_HANDLE lhKey;
 
 	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
 	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pWrappedKey == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pTemplate == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (hKey == NULL_PTR) return CKR_ARGUMENTS_BAD;
 
-    if (nullptr == pPublicKeyTemplate && 0 != ulPublicKeyAttributeCount)
+    if (!validate_user_check_ptr(pWrappedKey, ulWrappedKeyLen))
     {
-        return CKR_ARGUMENTS_BAD;
+        return CKR_DEVICE_MEMORY;
     }
 
-    if (nullptr == pPrivateKeyTemplate && 0 != ulPrivateKeyAttributeCount)
+    if (ulCount > CKA_MAX_ATTRIBUTES)
     {
         return CKR_ARGUMENTS_BAD;
     }
 
-	if (phPublicKey == NULL_PTR) return CKR_ARGUMENTS_BAD;
-	if (phPrivateKey == NULL_PTR) return CKR_ARGUMENTS_BAD;
-
-    if (!validate_user_check_ptr(phPublicKey, sizeof(CK_OBJECT_HANDLE)))
-    {
-        return CKR_DEVICE_MEMORY;
-    }
-
-	if (ulPublicKeyAttributeCount)
+	if (!validate_user_check_attribute_ptr(pTemplate, ulCount))
 	{
-        if (ulPublicKeyAttributeCount > CKA_MAX_ATTRIBUTES)
-        {
-            return CKR_ARGUMENTS_BAD;
-        }
-
-		if (!validate_user_check_attribute_ptr(pPublicKeyTemplate, ulPublicKeyAttributeCount))
-		{
-			return CKR_DEVICE_MEMORY;
-		}
+		return CKR_DEVICE_MEMORY;
 	}
 
-    if (!validate_user_check_ptr(phPrivateKey, sizeof(CK_OBJECT_HANDLE)))
+    if (!validate_user_check_ptr(hKey, sizeof(CK_ULONG)))
     {
         return CKR_DEVICE_MEMORY;
     }
 
-	if (ulPrivateKeyAttributeCount)
-	{
-        if (ulPrivateKeyAttributeCount > CKA_MAX_ATTRIBUTES)
-        {
-            return CKR_ARGUMENTS_BAD;
-        }
-
-		if (!validate_user_check_attribute_ptr(pPrivateKeyTemplate, ulPrivateKeyAttributeCount))
-		{
-			return CKR_DEVICE_MEMORY;
-		}
-	}
-
-    CK_ATTRIBUTE l_PublicKeyTemplate[ulPublicKeyAttributeCount];
-    memset_s(l_PublicKeyTemplate, ulPublicKeyAttributeCount * sizeof(CK_ATTRIBUTE), 0x00, ulPublicKeyAttributeCount * sizeof(CK_ATTRIBUTE));
-    memcpy_s(l_PublicKeyTemplate, ulPublicKeyAttributeCount * sizeof(CK_ATTRIBUTE), pPublicKeyTemplate, ulPublicKeyAttributeCount * sizeof(CK_ATTRIBUTE));
+    CK_ATTRIBUTE l_template[ulCount];
+    memcpy_s(l_template, ulCount * sizeof(CK_ATTRIBUTE), pTemplate, ulCount * sizeof(CK_ATTRIBUTE));
 
-    std::vector<std::vector<CK_BYTE>> publicValue(ulPublicKeyAttributeCount);
+    std::vector<std::vector<CK_BYTE>> value(ulCount);
 
-    for (CK_ULONG i = 0; i < ulPublicKeyAttributeCount; i++)
+    for (CK_ULONG i = 0; i < ulCount; i++)
     {
-        if (l_PublicKeyTemplate[i].pValue == nullptr)
+        if (l_template[i].pValue == nullptr)
         {
             continue;
         }
 
-        auto ulValueLen = l_PublicKeyTemplate[i].ulValueLen;
-		if (!validate_user_check_ptr(l_PublicKeyTemplate[i].pValue, ulValueLen))
-		{
-			return CKR_DEVICE_MEMORY;
-		}
-
-        publicValue[i].resize(ulValueLen);
-        memcpy_s(publicValue[i].data(), ulValueLen, l_PublicKeyTemplate[i].pValue, ulValueLen);
-        l_PublicKeyTemplate[i].pValue = publicValue[i].data();
-    }
-
-    auto l_pPublicKeyTemplate= l_PublicKeyTemplate;
-
-    CK_ATTRIBUTE l_PrivateKeyTemplate[ulPrivateKeyAttributeCount];
-    memset_s(l_PrivateKeyTemplate, ulPrivateKeyAttributeCount * sizeof(CK_ATTRIBUTE), 0x00, ulPrivateKeyAttributeCount * sizeof(CK_ATTRIBUTE));
-    memcpy_s(l_PrivateKeyTemplate, ulPrivateKeyAttributeCount * sizeof(CK_ATTRIBUTE), pPrivateKeyTemplate, ulPrivateKeyAttributeCount * sizeof(CK_ATTRIBUTE));
-
-    std::vector<std::vector<CK_BYTE>> privateValue(ulPrivateKeyAttributeCount);
-
-    for (CK_ULONG i = 0; i < ulPrivateKeyAttributeCount; i++)
-    {
-        if (l_PrivateKeyTemplate[i].pValue == nullptr)
+        auto ulValueLen = l_template[i].ulValueLen;
+        if (!validate_user_check_ptr(l_template[i].pValue, ulValueLen))
         {
-            continue;
+            return CKR_DEVICE_MEMORY;
         }
 
-        auto ulValueLen = l_PrivateKeyTemplate[i].ulValueLen;
-		if (!validate_user_check_ptr(l_PrivateKeyTemplate[i].pValue, ulValueLen))
-		{
-			return CKR_DEVICE_MEMORY;
-		}
-
-        privateValue[i].resize(ulValueLen);
-        memcpy_s(privateValue[i].data(), ulValueLen, l_PrivateKeyTemplate[i].pValue, ulValueLen);
-        l_PrivateKeyTemplate[i].pValue = privateValue[i].data();
+        value[i].resize(ulValueLen);
+        memcpy_s(value[i].data(), ulValueLen, l_template[i].pValue, ulValueLen);
+        l_template[i].pValue = value[i].data();
     }
 
-    auto l_pPrivateKeyTemplate= l_PrivateKeyTemplate;
+    auto l_pTemplate = l_template;
 
 	if (!validate_user_check_mechanism_ptr(pMechanism, 1))
 	{
@@ -7643,468 +10964,383 @@ CK_RV SoftHSM::C_GenerateKeyPair
 	Session* session = (Session*)handleManager->getSession(hSession);
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
-	// Check the mechanism, only accept RSA, DSA, EC and DH key pair generation.
-	CK_KEY_TYPE keyType;
-	switch (l_pMechanism->mechanism)
+	CK_RV rv;
+	// Check the mechanism
+	switch(l_pMechanism->mechanism)
 	{
-		case CKM_RSA_PKCS_KEY_PAIR_GEN:
-			keyType = CKK_RSA;
-			break;
-#if 0 // Unsupported by Crypto API Toolkit
-		case CKM_DSA_KEY_PAIR_GEN:
-			keyType = CKK_DSA;
-			break;
-		case CKM_DH_PKCS_KEY_PAIR_GEN:
-			keyType = CKK_DH;
-			break;
-#endif // Unsupported by Crypto API Toolkit
-#ifdef WITH_ECC
-		case CKM_EC_KEY_PAIR_GEN:
-			keyType = CKK_EC;
+        case CKM_AES_CTR:
+#ifdef WITH_AES_GCM		
+        case CKM_AES_GCM:
+#endif
+        case CKM_AES_CBC:
+        case CKM_AES_CBC_PAD: 
+            break;
+#ifdef HAVE_AES_KEY_WRAP
+		case CKM_AES_KEY_WRAP:
+			if ((ulWrappedKeyLen < 24) || ((ulWrappedKeyLen % 8) != 0))
+				return CKR_WRAPPED_KEY_LEN_RANGE;
+			// Does not handle optional init vector
+			if (l_pMechanism->pParameter != NULL_PTR ||
+                l_pMechanism->ulParameterLen != 0)
+				return CKR_ARGUMENTS_BAD;
 			break;
 #endif
-#if 0 // Unsupported by Crypto API Toolkit
-#ifdef WITH_GOST
-		case CKM_GOSTR3410_KEY_PAIR_GEN:
-			keyType = CKK_GOSTR3410;
+#ifdef HAVE_AES_KEY_WRAP_PAD
+		case CKM_AES_KEY_WRAP_PAD:
+			if ((ulWrappedKeyLen < 16) || ((ulWrappedKeyLen % 8) != 0))
+				return CKR_WRAPPED_KEY_LEN_RANGE;
+			// Does not handle optional init vector
+			if (l_pMechanism->pParameter != NULL_PTR ||
+                l_pMechanism->ulParameterLen != 0)
+				return CKR_ARGUMENTS_BAD;
 			break;
 #endif
-#endif // Unsupported by Crypto API Toolkit
-#ifdef WITH_EDDSA
-		case CKM_EC_EDWARDS_KEY_PAIR_GEN:
-			keyType = CKK_EC_EDWARDS;
+		case CKM_RSA_PKCS:
+			// Input length checks needs to be done later when unwrapping key is known
 			break;
-#endif
+		case CKM_RSA_PKCS_OAEP:
+			rv = MechParamCheckRSAPKCSOAEP(l_pMechanism);
+			if (rv != CKR_OK)
+				return rv;
+			break;
+
 		default:
 			return CKR_MECHANISM_INVALID;
 	}
-	CK_CERTIFICATE_TYPE dummy;
-
-	// Extract information from the public key template that is needed to create the object.
-	CK_OBJECT_CLASS publicKeyClass = CKO_PUBLIC_KEY;
-	CK_BBOOL ispublicKeyToken = CK_FALSE;
-	CK_BBOOL ispublicKeyPrivate = CK_FALSE;
-	bool isPublicKeyImplicit = true;
-	extractObjectInformation(l_pPublicKeyTemplate, ulPublicKeyAttributeCount, publicKeyClass, keyType, dummy, ispublicKeyToken, ispublicKeyPrivate, isPublicKeyImplicit);
 
-	// Report errors caused by accidental template mix-ups in the application using this cryptoki lib.
-	if (publicKeyClass != CKO_PUBLIC_KEY)
-		return CKR_ATTRIBUTE_VALUE_INVALID;
-	if (l_pMechanism->mechanism == CKM_RSA_PKCS_KEY_PAIR_GEN && keyType != CKK_RSA)
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_DSA_KEY_PAIR_GEN && keyType != CKK_DSA)
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_EC_KEY_PAIR_GEN && keyType != CKK_EC)
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_DH_PKCS_KEY_PAIR_GEN && keyType != CKK_DH)
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_GOSTR3410_KEY_PAIR_GEN && keyType != CKK_GOSTR3410)
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_EC_EDWARDS_KEY_PAIR_GEN && keyType != CKK_EC_EDWARDS)
-		return CKR_TEMPLATE_INCONSISTENT;
+	// Get the token
+	Token* token = session->getToken();
+	if (token == NULL) return CKR_GENERAL_ERROR;
 
-	// Extract information from the private key template that is needed to create the object.
-	CK_OBJECT_CLASS privateKeyClass = CKO_PRIVATE_KEY;
-	CK_BBOOL isprivateKeyToken = CK_FALSE;
-	CK_BBOOL isprivateKeyPrivate = CK_TRUE;
-	bool isPrivateKeyImplicit = true;
-	extractObjectInformation(l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount, privateKeyClass, keyType, dummy, isprivateKeyToken, isprivateKeyPrivate, isPrivateKeyImplicit);
+	// Check the unwrapping key handle.
+	OSObject *unwrapKey = (OSObject *)handleManager->getObject(hUnwrappingKey);
+	if (unwrapKey == NULL_PTR || !unwrapKey->isValid()) return CKR_UNWRAPPING_KEY_HANDLE_INVALID;
 
-	// Report errors caused by accidental template mix-ups in the application using this cryptoki lib.
-	if (privateKeyClass != CKO_PRIVATE_KEY)
-		return CKR_ATTRIBUTE_VALUE_INVALID;
-	if (l_pMechanism->mechanism == CKM_RSA_PKCS_KEY_PAIR_GEN && keyType != CKK_RSA)
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_DSA_KEY_PAIR_GEN && keyType != CKK_DSA)
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_EC_KEY_PAIR_GEN && keyType != CKK_EC)
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_DH_PKCS_KEY_PAIR_GEN && keyType != CKK_DH)
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_GOSTR3410_KEY_PAIR_GEN && keyType != CKK_GOSTR3410)
-		return CKR_TEMPLATE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_EC_EDWARDS_KEY_PAIR_GEN && keyType != CKK_EC_EDWARDS)
-		return CKR_TEMPLATE_INCONSISTENT;
+	CK_BBOOL isUnwrapKeyOnToken = unwrapKey->getBooleanValue(CKA_TOKEN, false);
+	CK_BBOOL isUnwrapKeyPrivate = unwrapKey->getBooleanValue(CKA_PRIVATE, true);
 
 	// Check user credentials
-	CK_RV rv = haveWrite(session->getState(), ispublicKeyToken || isprivateKeyToken, ispublicKeyPrivate || isprivateKeyPrivate);
+	rv = haveRead(session->getState(), isUnwrapKeyOnToken, isUnwrapKeyPrivate);
 	if (rv != CKR_OK)
 	{
 		if (rv == CKR_USER_NOT_LOGGED_IN)
 		{
 			// INFO_MSG("User is not authorized");
 		}
-		if (rv == CKR_SESSION_READ_ONLY)
-		{
-			// INFO_MSG("Session is read-only");
-		}
 
 		return rv;
 	}
 
-	// Generate RSA keys
-	if (l_pMechanism->mechanism == CKM_RSA_PKCS_KEY_PAIR_GEN)
-	{
-			rv = this->generateRSA(hSession,
-								   l_pPublicKeyTemplate, ulPublicKeyAttributeCount,
-								   l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount,
-								   l_phPublicKey, l_phPrivateKey,
-								   ispublicKeyToken, ispublicKeyPrivate, isprivateKeyToken, isprivateKeyPrivate);
-#ifdef SGXHSM
-			if (rv == CKR_OK)
-			{
-				OSObject* osobject = nullptr;
-                CK_ULONG pairKeyIdVal = 0;
-
-                if (SGX_SUCCESS != sgx_read_rand(reinterpret_cast<unsigned char*>(&pairKeyIdVal), sizeof(pairKeyIdVal)))
-                {
-                    return CKR_GENERAL_ERROR;
-                }
-
-                OSAttribute pairKeyId(pairKeyIdVal);
-
-				osobject = (OSObject*)handleManager->getObject(hPublicKey);
-				if (osobject == NULL_PTR || !osobject->isValid()) {
-					rv = CKR_FUNCTION_FAILED;
-				} else if (osobject->startTransaction()) {
-					bool bOK = true;
-
-					// pair key attribute to prevent wrapped key decrypt via C_Decrypt
-                    bOK = bOK && osobject->setAttribute(CKA_ASYMMETRIC_PAIR_ID, pairKeyId);
+	// Check unwrapping key class and type
+	if ((l_pMechanism->mechanism == CKM_AES_KEY_WRAP || l_pMechanism->mechanism == CKM_AES_KEY_WRAP_PAD) && unwrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) != CKO_SECRET_KEY)
+		return CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_AES_KEY_WRAP && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+		return CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_AES_KEY_WRAP_PAD && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+		return CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
+	if ((l_pMechanism->mechanism == CKM_RSA_PKCS || l_pMechanism->mechanism == CKM_RSA_PKCS_OAEP) && unwrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) != CKO_PRIVATE_KEY)
+		return CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
+	if ((l_pMechanism->mechanism == CKM_RSA_PKCS || l_pMechanism->mechanism == CKM_RSA_PKCS_OAEP) && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_RSA)
+		return CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_AES_CTR && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+		return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_AES_GCM && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+		return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_AES_CBC && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+		return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+	if (l_pMechanism->mechanism == CKM_AES_CBC_PAD && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+		return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
 
-					if (bOK)
-						bOK = osobject->commitTransaction();
-					else
-						osobject->abortTransaction();
+	// Check if the unwrapping key can be used for unwrapping
+	if (unwrapKey->getBooleanValue(CKA_UNWRAP, false) == false)
+		return CKR_KEY_FUNCTION_NOT_PERMITTED;
 
-					if (!bOK)
-					{
-						rv = CKR_FUNCTION_FAILED;
-						if (hPublicKey != CK_INVALID_HANDLE)
-						{
-							OSObject* obj = (OSObject*)handleManager->getObject(hPublicKey);
-							handleManager->destroyObject(hPublicKey);
-							if (obj) obj->destroyObject();
-							hPublicKey = CK_INVALID_HANDLE;
-						}
+	// Check if the specified mechanism is allowed for the unwrap key
+	if (!isMechanismPermitted(unwrapKey, l_pMechanism))
+		return CKR_MECHANISM_INVALID;
 
-						if (hPrivateKey != CK_INVALID_HANDLE)
-						{
-							OSObject* obj = (OSObject*)handleManager->getObject(hPrivateKey);
-							handleManager->destroyObject(hPrivateKey);
-							if (obj) obj->destroyObject();
-							hPrivateKey = CK_INVALID_HANDLE;
-						}
-					}
-				}
+	// Build the template of the unwrapped key
+	CK_OBJECT_CLASS objClass;
+	CK_KEY_TYPE keyType;
+	CK_BBOOL isOnToken = CK_FALSE;
+	CK_BBOOL isPrivate = CK_TRUE;
+	CK_ATTRIBUTE secretAttribs[MAX_UNWRAP_ATTRIBUTES];
+	CK_ULONG secretAttribsCount = 0;
+	rv = UnwrapKeyTemplate(session, unwrapKey, l_pTemplate, ulCount, objClass, keyType, isOnToken, isPrivate, secretAttribs, secretAttribsCount);
+	if (rv != CKR_OK)
+		return rv;
 
-				osobject = (OSObject*)handleManager->getObject(hPrivateKey);
-				if (osobject == NULL_PTR || !osobject->isValid()) {
-					rv = CKR_FUNCTION_FAILED;
-				} else if (osobject->startTransaction()) {
-					bool bOK = true;
+	lhKey = CK_INVALID_HANDLE;
 
-					// pair key attribute to prevent wrapped key decrypt via C_Decrypt
-                    bOK = bOK && osobject->setAttribute(CKA_ASYMMETRIC_PAIR_ID, pairKeyId);
+	// Unwrap the key
+	ByteString keydata;
+    if (unwrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) == CKO_SECRET_KEY &&
+        (l_pMechanism->mechanism  == CKM_AES_CTR    ||
+         l_pMechanism->mechanism  == CKM_AES_GCM    ||
+         l_pMechanism->mechanism  == CKM_AES_CBC    ||
+         l_pMechanism->mechanism  == CKM_AES_CBC_PAD))
+    
+    {
+        // The unwrap borrows the session's cipher slot
+        if (session->getOpType() != SESSION_OP_NONE) return CKR_OPERATION_ACTIVE;
 
-					if (bOK)
-						bOK = osobject->commitTransaction();
-					else
-						osobject->abortTransaction();
+        rv = SoftHSM::SymDecryptInit(hSession, l_pMechanism, hUnwrappingKey);
+        if (rv != CKR_OK)
+        {
+            return rv;
+        }
 
-					if (!bOK)
-					{
-						rv = CKR_FUNCTION_FAILED;
-						if (hPublicKey != CK_INVALID_HANDLE)
-						{
-							OSObject* obj = (OSObject*)handleManager->getObject(hPublicKey);
-							handleManager->destroyObject(hPublicKey);
-							if (obj) obj->destroyObject();
-							hPublicKey = CK_INVALID_HANDLE;
-						}
+        CK_ULONG ulDataLen = 0;
+        rv = SymDecrypt(session, pWrappedKey, ulWrappedKeyLen, NULL_PTR, &ulDataLen);
+        if (rv != CKR_OK)
+        {
+            return rv;
+        }
 
-						if (hPrivateKey != CK_INVALID_HANDLE)
-						{
-							OSObject* obj = (OSObject*)handleManager->getObject(hPrivateKey);
-							handleManager->destroyObject(hPrivateKey);
-							if (obj) obj->destroyObject();
-							hPrivateKey = CK_INVALID_HANDLE;
-						}
-					}
-				}
-			}
-#endif
-            *phPublicKey = hPublicKey;
-            *phPrivateKey = hPrivateKey;
+        keydata.resize(ulDataLen);
+        rv = SymDecrypt(session, pWrappedKey, ulWrappedKeyLen, keydata.byte_str(), &ulDataLen);
+        if (rv != CKR_OK)
+        {
             return rv;
-	}
+        }
 
-#if 0 // Unsupported by Crypto API Toolkit
-	// Generate DSA keys
-	if (l_pMechanism->mechanism == CKM_DSA_KEY_PAIR_GEN)
-	{
-		rv = this->generateDSA(hSession,
-								 l_pPublicKeyTemplate, ulPublicKeyAttributeCount,
-								 l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount,
-								 l_phPublicKey, l_phPrivateKey,
-								 ispublicKeyToken, ispublicKeyPrivate, isprivateKeyToken, isprivateKeyPrivate);
-        *phPublicKey = hPublicKey;
-        *phPrivateKey = hPrivateKey;
-        return rv;
+        keydata.resize(ulDataLen);
+    }
+    else
+    {
+        ByteString wrapped(pWrappedKey, ulWrappedKeyLen);
+        if (unwrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) == CKO_SECRET_KEY)
+        {	 
+            rv = UnwrapKeySym(l_pMechanism, wrapped, token, unwrapKey, keydata);
+        }
+        else if (unwrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) == CKO_PRIVATE_KEY)
+        {
+            rv = UnwrapKeyAsym(l_pMechanism, wrapped, token, unwrapKey, keydata);
+#if defined (DCAP_SUPPORT) && defined (EPHEMERAL_QUOTE)
+            // If the key is used for quote generation should be used for only one unwrap operation
+            // Destroying the key from session
+            CK_BBOOL isUsedForQuoteGeneration = unwrapKey->getBooleanValue(CKA_USED_FOR_QUOTE_GENERATION, false);
 
-	}
-#endif // Unsupported by Crypto API Toolkit
+            if (isUsedForQuoteGeneration)
+            {
+                // get public key and destroying both keys
+                CK_OBJECT_HANDLE publicKeyHandle = getRSAPairKey(hSession, hUnwrappingKey);
+                if (CK_INVALID_HANDLE == publicKeyHandle)
+                {
+                    return CKR_KEY_HANDLE_INVALID;
+                }
 
-	// Generate EC keys
-	if (l_pMechanism->mechanism == CKM_EC_KEY_PAIR_GEN)
-	{
-        rv = this->generateEC(hSession,
-								l_pPublicKeyTemplate, ulPublicKeyAttributeCount,
-								l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount,
-								l_phPublicKey, l_phPrivateKey,
-								ispublicKeyToken, ispublicKeyPrivate, isprivateKeyToken, isprivateKeyPrivate);
-        *phPublicKey = hPublicKey;
-        *phPrivateKey = hPrivateKey;
-        return rv;
-	}
+                // destroying public key
+                OSObject* obj = (OSObject*)handleManager->getObject(publicKeyHandle);
+                if (obj)
+                {
+                    obj->destroyObject();
+                }
+                handleManager->destroyObject(publicKeyHandle);
+                publicKeyHandle = CK_INVALID_HANDLE;
 
-#if 0 // Unsupported by Crypto API Toolkit
-	// Generate DH keys
-	if (l_pMechanism->mechanism == CKM_DH_PKCS_KEY_PAIR_GEN)
-	{
-        rv = this->generateDH(hSession,
-									 l_pPublicKeyTemplate, ulPublicKeyAttributeCount,
-									 l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount,
-									 l_phPublicKey, l_phPrivateKey,
-									 ispublicKeyToken, ispublicKeyPrivate, isprivateKeyToken, isprivateKeyPrivate);
-        *phPublicKey = hPublicKey;
-        *phPrivateKey = hPrivateKey;
-        return rv;
-	}
+                // destroying private key
+                handleManager->destroyObject(hUnwrappingKey);
+                unwrapKey->destroyObject();
+                hUnwrappingKey = CK_INVALID_HANDLE;
+            }
+#endif
+        }
+        else
+        {
+            rv = CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
+        }
+    }
 
-	// Generate GOST keys
-	if (l_pMechanism->mechanism == CKM_GOSTR3410_KEY_PAIR_GEN)
-	{
-        rv = this->generateGOST(hSession,
-								  l_pPublicKeyTemplate, ulPublicKeyAttributeCount,
-								  l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount,
-							   	  l_phPublicKey, l_phPrivateKey,
-								  ispublicKeyToken, ispublicKeyPrivate, isprivateKeyToken, isprivateKeyPrivate);
-        *phPublicKey = hPublicKey;
-        *phPrivateKey = hPrivateKey;
-        return rv;
-	}
-#endif // Unsupported by Crypto API Toolkit
+	if (rv != CKR_OK)
+    {
+		return rv;
+    }
 
-	// Generate EDDSA keys
-	if (l_pMechanism->mechanism == CKM_EC_EDWARDS_KEY_PAIR_GEN)
-	{
-        rv = this->generateED(hSession,
-							    l_pPublicKeyTemplate, ulPublicKeyAttributeCount,
-							    l_pPrivateKeyTemplate, ulPrivateKeyAttributeCount,
-							    l_phPublicKey, l_phPrivateKey,
-							    ispublicKeyToken, ispublicKeyPrivate, isprivateKeyToken, isprivateKeyPrivate);
-        *phPublicKey = hPublicKey;
-        *phPrivateKey = hPrivateKey;
-        return rv;
-	}
+	// Create the secret object and store the key material
+	rv = UnwrapKeyStore(hSession, token, secretAttribs, secretAttribsCount, objClass, keyType, isPrivate, keydata, lhKey);
 
-	return CKR_GENERAL_ERROR;
+    *hKey = lhKey;
+
+	return rv;
 }
 
-// Internal: Wrap blob using symmetric key
-CK_RV SoftHSM::WrapKeySym
-(
-	CK_MECHANISM_PTR pMechanism,
-	Token* token,
-	OSObject* wrapKey,
-	ByteString& keydata,
-	ByteString& wrapped
-)
+// The wrapping or unwrapping key of one C_WrapKeyBatch/C_UnwrapKeyBatch
+// call, set up once for all keys of the batch
+struct WrapBatchState
 {
-	// Get the symmetric algorithm matching the mechanism
-	SymAlgo::Type algo = SymAlgo::Unknown;
-	SymWrap::Type mode = SymWrap::Unknown;
-	size_t bb = 8;
-#ifdef HAVE_AES_KEY_WRAP
-	CK_ULONG wrappedlen = keydata.size();
+	SymmetricAlgorithm* symCipher;
+	SymmetricKey* symKey;
+	SymWrap::Type symMode;
+	AsymmetricAlgorithm* asymCipher;
+	PrivateKey* privateKey;
+	AsymMech::Type asymMode;
 
-	// [PKCS#11 v2.40, 2.14.3 AES Key Wrap]
-	// A key whose length is not a multiple of the AES Key Wrap block
-	// size (8 bytes) will be zero padded to fit.
-	CK_ULONG alignment = wrappedlen % 8;
-	if (alignment != 0)
+	WrapBatchState() : symCipher(NULL), symKey(NULL), symMode(SymWrap::Unknown),
+	                   asymCipher(NULL), privateKey(NULL), asymMode(AsymMech::Unknown) { }
+
+	~WrapBatchState()
 	{
-		keydata.resize(wrappedlen + 8 - alignment);
-		memset(&keydata[wrappedlen], 0, 8 - alignment);
-		wrappedlen = keydata.size();
+		if (symCipher != NULL)
+		{
+			symCipher->recycleKey(symKey);
+			CryptoFactory::i()->recycleSymmetricAlgorithm(symCipher);
+		}
+		if (asymCipher != NULL)
+		{
+			asymCipher->recyclePrivateKey(privateKey);
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCipher);
+		}
 	}
-#endif
-	switch(pMechanism->mechanism) {
+};
+
+// One key of a C_UnwrapKeyBatch call, unwrapped and checked before any key
+// of the batch is created. secretAttribs points into tmpl and value
+struct UnwrapBatchKey
+{
+	std::vector<CK_ATTRIBUTE> tmpl;
+	std::vector<std::vector<CK_BYTE>> value;
+	CK_ATTRIBUTE secretAttribs[MAX_UNWRAP_ATTRIBUTES];
+	CK_ULONG secretAttribsCount;
+	CK_OBJECT_CLASS objClass;
+	CK_KEY_TYPE keyType;
+	CK_BBOOL isPrivate;
+	ByteString keydata;
+
+	UnwrapBatchKey() : secretAttribsCount(0), objClass(CKO_VENDOR_DEFINED),
+	                   keyType(CKK_VENDOR_DEFINED), isPrivate(CK_TRUE) { }
+};
+
+// Internal: Set up the AES key of a key wrap batch
+CK_RV SoftHSM::WrapBatchSymKey(CK_MECHANISM_TYPE mechanism, Token* token, OSObject* key, WrapBatchState& state)
+{
+	switch(mechanism) {
 #ifdef HAVE_AES_KEY_WRAP
 		case CKM_AES_KEY_WRAP:
-			if ((wrappedlen < 16) || ((wrappedlen % 8) != 0))
-				return CKR_KEY_SIZE_RANGE;
-			algo = SymAlgo::AES;
-			mode = SymWrap::AES_KEYWRAP;
+			state.symMode = SymWrap::AES_KEYWRAP;
 			break;
 #endif
 #ifdef HAVE_AES_KEY_WRAP_PAD
 		case CKM_AES_KEY_WRAP_PAD:
-			algo = SymAlgo::AES;
-			mode = SymWrap::AES_KEYWRAP_PAD;
+			state.symMode = SymWrap::AES_KEYWRAP_PAD;
 			break;
 #endif
 		default:
 			return CKR_MECHANISM_INVALID;
 	}
-	SymmetricAlgorithm* cipher = CryptoFactory::i()->getSymmetricAlgorithm(algo);
-	if (cipher == NULL) return CKR_MECHANISM_INVALID;
 
-	SymmetricKey* wrappingkey = new SymmetricKey();
+	state.symCipher = CryptoFactory::i()->getSymmetricAlgorithm(SymAlgo::AES);
+	if (state.symCipher == NULL) return CKR_MECHANISM_INVALID;
 
-	if (getSymmetricKey(wrappingkey, token, wrapKey) != CKR_OK)
-	{
-		cipher->recycleKey(wrappingkey);
-		CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
+	state.symKey = new SymmetricKey();
+
+	if (getSymmetricKey(state.symKey, token, key) != CKR_OK)
 		return CKR_GENERAL_ERROR;
-	}
 
 	// adjust key bit length
-	wrappingkey->setBitLen(wrappingkey->getKeyBits().size() * bb);
-
-	// Wrap the key
-	if (!cipher->wrapKey(wrappingkey, mode, keydata, wrapped))
-	{
-		cipher->recycleKey(wrappingkey);
-		CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
-		return CKR_GENERAL_ERROR;
-	}
+	state.symKey->setBitLen(state.symKey->getKeyBits().size() * 8);
 
-	cipher->recycleKey(wrappingkey);
-	CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
 	return CKR_OK;
 }
 
-// Internal: Wrap blob using asymmetric key
-CK_RV SoftHSM::WrapKeyAsym
+// Internal: Unwrap one key of a C_UnwrapKeyBatch call and check its
+// template, without creating the key
+CK_RV SoftHSM::UnwrapKeyBatchItem
 (
-	CK_MECHANISM_PTR pMechanism,
-	Token* token,
-	OSObject* wrapKey,
-	ByteString& keydata,
-	ByteString& wrapped
+	Session* session,
+	OSObject* unwrapKey,
+	CK_MECHANISM_TYPE mechanism,
+	WrapBatchState& state,
+	const CK_UNWRAP_BATCH_ITEM& item,
+	UnwrapBatchKey& key
 )
 {
-	const size_t bb = 8;
-	AsymAlgo::Type algo = AsymAlgo::Unknown;
-	AsymMech::Type mech = AsymMech::Unknown;
-
-	CK_ULONG modulus_length;
-	switch(pMechanism->mechanism) {
-		case CKM_RSA_PKCS:
-		case CKM_RSA_PKCS_OAEP:
-			algo = AsymAlgo::RSA;
-			if (!wrapKey->attributeExists(CKA_MODULUS_BITS))
-				return CKR_GENERAL_ERROR;
-			modulus_length = wrapKey->getUnsignedLongValue(CKA_MODULUS_BITS, 0);
-			// adjust key bit length
-			modulus_length /= bb;
-			break;
+	if (item.pWrappedKey == NULL_PTR || item.pTemplate == NULL_PTR) return CKR_ARGUMENTS_BAD;
 
-		default:
-			return CKR_MECHANISM_INVALID;
+	if (item.ulWrappedKeyLen > CKM_MAX_CRYPTO_OP_INPUT_LEN || item.ulAttributeCount > CKA_MAX_ATTRIBUTES)
+	{
+		return CKR_ARGUMENTS_BAD;
 	}
 
-	switch(pMechanism->mechanism) {
-		case CKM_RSA_PKCS:
-			mech = AsymMech::RSA_PKCS;
-			// RFC 3447 section 7.2.1
-			if (keydata.size() > modulus_length - 11)
-				return CKR_KEY_SIZE_RANGE;
-			break;
-
-		case CKM_RSA_PKCS_OAEP:
-			mech = AsymMech::RSA_PKCS_OAEP;
-			// SHA-1 is the only supported option
-			// PKCS#11 2.40 draft 2 section 2.1.8: input length <= k-2-2hashLen
-			if (keydata.size() > modulus_length - 2 - 2 * 160 / 8)
-				return CKR_KEY_SIZE_RANGE;
-			break;
-
-		default:
-			return CKR_MECHANISM_INVALID;
+	if (!validate_user_check_ptr(item.pWrappedKey, item.ulWrappedKeyLen))
+	{
+		return CKR_DEVICE_MEMORY;
 	}
 
-	AsymmetricAlgorithm* cipher = CryptoFactory::i()->getAsymmetricAlgorithm(algo);
-	if (cipher == NULL) return CKR_MECHANISM_INVALID;
-
-	PublicKey* publicKey = cipher->newPublicKey();
-	if (publicKey == NULL)
+	if (!validate_user_check_attribute_ptr(item.pTemplate, item.ulAttributeCount))
 	{
-		CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
-		return CKR_HOST_MEMORY;
+		return CKR_DEVICE_MEMORY;
 	}
 
-	switch(pMechanism->mechanism) {
-		case CKM_RSA_PKCS:
-		case CKM_RSA_PKCS_OAEP:
-			if (getRSAPublicKey((RSAPublicKey*)publicKey, token, wrapKey) != CKR_OK)
-			{
-				cipher->recyclePublicKey(publicKey);
-				CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
-				return CKR_GENERAL_ERROR;
-			}
-			break;
+	// Work on a copy of the template and its values
+	CK_ULONG ulCount = item.ulAttributeCount;
+	std::vector<CK_ATTRIBUTE>& l_template = key.tmpl;
+	l_template.resize(ulCount);
+	memcpy_s(l_template.data(), ulCount * sizeof(CK_ATTRIBUTE), item.pTemplate, ulCount * sizeof(CK_ATTRIBUTE));
 
-		default:
-			return CKR_MECHANISM_INVALID;
-	}
-	// Wrap the key
-	if (!cipher->wrapKey(publicKey, keydata, wrapped, mech))
+	std::vector<std::vector<CK_BYTE>>& value = key.value;
+	value.resize(ulCount);
+
+	for (CK_ULONG i = 0; i < ulCount; i++)
 	{
-		cipher->recyclePublicKey(publicKey);
-		CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
-		return CKR_GENERAL_ERROR;
+		if (l_template[i].pValue == nullptr)
+		{
+			continue;
+		}
+
+		auto ulValueLen = l_template[i].ulValueLen;
+		if (!validate_user_check_ptr(l_template[i].pValue, ulValueLen))
+		{
+			return CKR_DEVICE_MEMORY;
+		}
+
+		value[i].resize(ulValueLen);
+		memcpy_s(value[i].data(), ulValueLen, l_template[i].pValue, ulValueLen);
+		l_template[i].pValue = value[i].data();
 	}
 
-	cipher->recyclePublicKey(publicKey);
-	CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
+	ByteString wrapped(item.pWrappedKey, item.ulWrappedKeyLen);
 
-	return CKR_OK;
-}
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
 
+	if (mechanism == CKM_AES_KEY_WRAP && ((wrapped.size() < 24) || ((wrapped.size() % 8) != 0)))
+		return CKR_WRAPPED_KEY_LEN_RANGE;
+	if (mechanism == CKM_AES_KEY_WRAP_PAD && ((wrapped.size() < 16) || ((wrapped.size() % 8) != 0)))
+		return CKR_WRAPPED_KEY_LEN_RANGE;
 
-// Wrap the specified key using the specified wrapping key and mechanism
-CK_RV SoftHSM::C_WrapKey
-(
-	CK_SESSION_HANDLE hSession,
-	CK_MECHANISM_PTR pMechanism,
-	CK_OBJECT_HANDLE hWrappingKey,
-	CK_OBJECT_HANDLE hKey,
-	CK_BYTE_PTR pWrappedKey,
-	CK_ULONG_PTR pulWrappedKeyLen
-)
+	// Build the template of the unwrapped key
+	CK_BBOOL isOnToken = CK_FALSE;
+	CK_RV rv = UnwrapKeyTemplate(session, unwrapKey, l_template.data(), ulCount, key.objClass, key.keyType, isOnToken, key.isPrivate, key.secretAttribs, key.secretAttribsCount);
+	if (rv != CKR_OK)
+		return rv;
+
+	// Unwrap the key with the key of the batch
+	bool bOK;
+	if (state.symCipher != NULL)
+		bOK = state.symCipher->unwrapKey(state.symKey, state.symMode, wrapped, key.keydata);
+	else
+		bOK = state.asymCipher->unwrapKey(state.privateKey, wrapped, key.keydata, state.asymMode);
+	if (!bOK)
+		return CKR_GENERAL_ERROR;
+
+	return CKR_OK;
+}
+
+// Unwrap a batch of keys with one unwrapping key. All keys are unwrapped
+// before the first is created, and created in one object store batch; if
+// one key fails, none is kept
+CK_RV SoftHSM::C_UnwrapKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hUnwrappingKey, CK_UNWRAP_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
 {
 	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
 	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
-	if (pulWrappedKeyLen == NULL_PTR) return CKR_ARGUMENTS_BAD;
-
-    if (!validate_user_check_ptr(pulWrappedKeyLen, sizeof(CK_ULONG)))
-    {
-        return CKR_DEVICE_MEMORY;
-    }
+	if (pItems == NULL_PTR || ulCount == 0 || ulCount > CKM_MAX_MESSAGE_BATCH) return CKR_ARGUMENTS_BAD;
 
-    CK_ULONG ulWrappedKeyLen = *pulWrappedKeyLen;
-    auto l_pulWrappedKeyLen = &ulWrappedKeyLen;
-
-	if (pWrappedKey && ulWrappedKeyLen)
+	if (!validate_user_check_ptr(pItems, ulCount * sizeof(CK_UNWRAP_BATCH_ITEM)))
 	{
-		if (!validate_user_check_ptr(pWrappedKey, ulWrappedKeyLen))
-		{
-			return CKR_DEVICE_MEMORY;
-		}
+		return CKR_DEVICE_MEMORY;
 	}
 
 	if (!validate_user_check_mechanism_ptr(pMechanism, 1))
@@ -8144,28 +11380,21 @@ CK_RV SoftHSM::C_WrapKey
 	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
 
 	CK_RV rv;
-	// Check the mechanism, only accept advanced AES key wrapping and RSA
+	// Check the mechanism, only the key wrap mechanisms that need no session operation
 	switch(l_pMechanism->mechanism)
 	{
-        case CKM_AES_CTR:
-#ifdef WITH_AES_GCM
-        case CKM_AES_GCM:
-#endif
-        case CKM_AES_CBC:
-        case CKM_AES_CBC_PAD:
-        case CKM_EXPORT_ECDSA_QUOTE_RSA_PUBLIC_KEY_INTERNAL:
-            break;
 #ifdef HAVE_AES_KEY_WRAP
 		case CKM_AES_KEY_WRAP:
 #endif
 #ifdef HAVE_AES_KEY_WRAP_PAD
 		case CKM_AES_KEY_WRAP_PAD:
 #endif
-		case CKM_RSA_PKCS:
 			// Does not handle optional init vector
 			if (l_pMechanism->pParameter != NULL_PTR ||
                 l_pMechanism->ulParameterLen != 0)
-			return CKR_ARGUMENTS_BAD;
+				return CKR_ARGUMENTS_BAD;
+			break;
+		case CKM_RSA_PKCS:
 			break;
 		case CKM_RSA_PKCS_OAEP:
 			rv = MechParamCheckRSAPKCSOAEP(l_pMechanism);
@@ -8181,1097 +11410,1364 @@ CK_RV SoftHSM::C_WrapKey
 	Token* token = session->getToken();
 	if (token == NULL) return CKR_GENERAL_ERROR;
 
-    if(l_pMechanism->mechanism == CKM_EXPORT_ECDSA_QUOTE_RSA_PUBLIC_KEY_INTERNAL)
-    {
-        // Wrapping key Id must be null for RSA quote + public key export
-        if (hWrappingKey || !l_pulWrappedKeyLen)
-        {
-            return CKR_ARGUMENTS_BAD;
-        }
+	// Check the unwrapping key handle.
+	OSObject *unwrapKey = (OSObject *)handleManager->getObject(hUnwrappingKey);
+	if (unwrapKey == NULL_PTR || !unwrapKey->isValid()) return CKR_UNWRAPPING_KEY_HANDLE_INVALID;
+
 #ifdef DCAP_SUPPORT
-        OSObject *key = (OSObject *)handleManager->getObject(hKey);
-        if (!key || !key->isValid())
-        {
-            return CKR_KEY_HANDLE_INVALID;
-        }
+	// A key used for quote generation may unwrap only one key
+	if (unwrapKey->getBooleanValue(CKA_USED_FOR_QUOTE_GENERATION, false)) return CKR_UNWRAPPING_KEY_HANDLE_INVALID;
+#endif
 
-        // If the key is used for quote generation it should not be used again
-        CK_BBOOL isUsedForQuoteGeneration = key->getBooleanValue(CKA_USED_FOR_QUOTE_GENERATION, false);
+	CK_BBOOL isUnwrapKeyOnToken = unwrapKey->getBooleanValue(CKA_TOKEN, false);
+	CK_BBOOL isUnwrapKeyPrivate = unwrapKey->getBooleanValue(CKA_PRIVATE, true);
+
+	// Check user credentials
+	rv = haveRead(session->getState(), isUnwrapKeyOnToken, isUnwrapKeyPrivate);
+	if (rv != CKR_OK) return rv;
+
+	// Check unwrapping key class and type
+	CK_OBJECT_CLASS unwrapKeyClass = unwrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED);
+	CK_KEY_TYPE unwrapKeyType = unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED);
+	bool isRSA = (l_pMechanism->mechanism == CKM_RSA_PKCS || l_pMechanism->mechanism == CKM_RSA_PKCS_OAEP);
+	if (unwrapKeyClass != (isRSA ? CKO_PRIVATE_KEY : CKO_SECRET_KEY))
+		return CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
+	if (unwrapKeyType != (isRSA ? CKK_RSA : CKK_AES))
+		return CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
+
+	// Check if the unwrapping key can be used for unwrapping
+	if (unwrapKey->getBooleanValue(CKA_UNWRAP, false) == false)
+		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+
+	// Check if the specified mechanism is allowed for the unwrap key
+	if (!isMechanismPermitted(unwrapKey, l_pMechanism))
+		return CKR_MECHANISM_INVALID;
+
+	// Set up the unwrapping key once for the whole batch
+	WrapBatchState state;
+	if (isRSA)
+	{
+		state.asymMode = (l_pMechanism->mechanism == CKM_RSA_PKCS) ? AsymMech::RSA_PKCS : AsymMech::RSA_PKCS_OAEP;
+
+		state.asymCipher = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::RSA);
+		if (state.asymCipher == NULL) return CKR_MECHANISM_INVALID;
+
+		state.privateKey = state.asymCipher->newPrivateKey();
+		if (state.privateKey == NULL) return CKR_HOST_MEMORY;
+
+		if (getRSAPrivateKey((RSAPrivateKey*)state.privateKey, token, unwrapKey) != CKR_OK)
+			return CKR_GENERAL_ERROR;
+	}
+	else
+	{
+		rv = WrapBatchSymKey(l_pMechanism->mechanism, token, unwrapKey, state);
+		if (rv != CKR_OK) return rv;
+	}
+
+	std::vector<CK_OBJECT_HANDLE> handles(ulCount, CK_INVALID_HANDLE);
+	std::vector<CK_RV> results(ulCount, CKR_FUNCTION_CANCELED);
+	CK_RV batchRv = CKR_OK;
+
+	// Unwrap and check all keys first, so that a bad blob or template
+	// leaves the token untouched
+	std::vector<UnwrapBatchKey> keys(ulCount);
+	for (CK_ULONG i = 0; i < ulCount && batchRv == CKR_OK; i++)
+	{
+		// Work on a copy so the application cannot change the item meanwhile
+		CK_UNWRAP_BATCH_ITEM item;
+		memcpy_s(&item, sizeof(CK_UNWRAP_BATCH_ITEM), &pItems[i], sizeof(CK_UNWRAP_BATCH_ITEM));
+
+		results[i] = UnwrapKeyBatchItem(session, unwrapKey, l_pMechanism->mechanism, state, item, keys[i]);
+		if (results[i] != CKR_OK) batchRv = results[i];
+	}
+
+	// Create all objects in one object store batch
+	if (batchRv == CKR_OK)
+	{
+		if (!token->startBatch()) return CKR_FUNCTION_FAILED;
+
+		for (CK_ULONG i = 0; i < ulCount; i++)
+		{
+			UnwrapBatchKey& key = keys[i];
+			results[i] = UnwrapKeyStore(hSession, token, key.secretAttribs, key.secretAttribsCount, key.objClass, key.keyType, key.isPrivate, key.keydata, handles[i]);
+			if (results[i] != CKR_OK)
+			{
+				batchRv = results[i];
+				break;
+			}
+		}
+
+		// A partial batch is dropped rather than written and deleted again,
+		// so that an interruption leaves no keys of it on the token
+		if (batchRv != CKR_OK)
+			(void) token->abortBatch();
+		else if (!token->commitBatch())
+			batchRv = CKR_FUNCTION_FAILED;
+	}
+
+	// Keep all keys or none. Token keys of a dropped batch are no longer
+	// valid and only lose their handle. A key that cannot be removed again
+	// keeps its handle, so that the application can destroy it
+	for (CK_ULONG i = 0; i < ulCount; i++)
+	{
+		if (batchRv != CKR_OK && handles[i] != CK_INVALID_HANDLE)
+		{
+			OSObject* obj = (OSObject*)handleManager->getObject(handles[i]);
+			if (obj == NULL_PTR || !obj->isValid() || obj->destroyObject())
+			{
+				handleManager->destroyObject(handles[i]);
+				handles[i] = CK_INVALID_HANDLE;
+				results[i] = CKR_FUNCTION_CANCELED;
+			}
+			else
+			{
+				results[i] = CKR_FUNCTION_FAILED;
+			}
+		}
+		else if (batchRv != CKR_OK && results[i] == CKR_OK)
+		{
+			results[i] = CKR_FUNCTION_CANCELED;
+		}
+
+		pItems[i].hKey = handles[i];
+		pItems[i].rv = results[i];
+	}
+
+	return batchRv;
+}
+
+// Wrap a batch of keys with one AES wrapping key; a failed key does not stop
+// the batch
+CK_RV SoftHSM::C_WrapKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hWrappingKey, CK_WRAP_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pItems == NULL_PTR || ulCount == 0 || ulCount > CKM_MAX_MESSAGE_BATCH) return CKR_ARGUMENTS_BAD;
+
+	if (!validate_user_check_ptr(pItems, ulCount * sizeof(CK_WRAP_BATCH_ITEM)))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+	if (!validate_user_check_mechanism_ptr(pMechanism, 1))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
+
+	CK_MECHANISM l_mechanism;
+	memcpy_s(&l_mechanism, sizeof(CK_MECHANISM), pMechanism, sizeof(CK_MECHANISM));
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
+	// Check the mechanism, only accept the AES key wrap mechanisms
+	switch(l_mechanism.mechanism)
+	{
+#ifdef HAVE_AES_KEY_WRAP
+		case CKM_AES_KEY_WRAP:
+#endif
+#ifdef HAVE_AES_KEY_WRAP_PAD
+		case CKM_AES_KEY_WRAP_PAD:
+#endif
+			// Does not handle optional init vector
+			if (l_mechanism.pParameter != NULL_PTR ||
+			    l_mechanism.ulParameterLen != 0)
+				return CKR_ARGUMENTS_BAD;
+			break;
+
+		default:
+			return CKR_MECHANISM_INVALID;
+	}
+
+	// Get the token
+	Token* token = session->getToken();
+	if (token == NULL) return CKR_GENERAL_ERROR;
+
+	// Check the wrapping key handle.
+	OSObject *wrapKey = (OSObject *)handleManager->getObject(hWrappingKey);
+	if (wrapKey == NULL_PTR || !wrapKey->isValid()) return CKR_WRAPPING_KEY_HANDLE_INVALID;
+
+	CK_BBOOL isWrapKeyOnToken = wrapKey->getBooleanValue(CKA_TOKEN, false);
+	CK_BBOOL isWrapKeyPrivate = wrapKey->getBooleanValue(CKA_PRIVATE, true);
+
+	// Check user credentials for the wrapping key
+	CK_RV rv = haveRead(session->getState(), isWrapKeyOnToken, isWrapKeyPrivate);
+	if (rv != CKR_OK) return rv;
+
+	// Check wrapping key class and type
+	if (wrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) != CKO_SECRET_KEY)
+		return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+	if (wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
+		return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+
+	// Check if the wrapping key can be used for wrapping
+	if (wrapKey->getBooleanValue(CKA_WRAP, false) == false)
+		return CKR_KEY_FUNCTION_NOT_PERMITTED;
+
+	// Check if the specified mechanism is allowed for the wrapping key
+	if (!isMechanismPermitted(wrapKey, &l_mechanism))
+		return CKR_MECHANISM_INVALID;
+
+	// Set up the wrapping key once for the whole batch
+	WrapBatchState state;
+	rv = WrapBatchSymKey(l_mechanism.mechanism, token, wrapKey, state);
+	if (rv != CKR_OK) return rv;
+
+	CK_RV batchRv = CKR_OK;
+
+	for (CK_ULONG i = 0; i < ulCount; i++)
+	{
+		// Work on a copy so the application cannot change the item meanwhile
+		CK_WRAP_BATCH_ITEM item;
+		memcpy_s(&item, sizeof(CK_WRAP_BATCH_ITEM), &pItems[i], sizeof(CK_WRAP_BATCH_ITEM));
+
+		ByteString keydata;
+		ByteString wrapped;
+		rv = WrapKeyData(session, token, wrapKey, item.hKey, l_mechanism.mechanism, keydata);
+		if (rv == CKR_OK)
+			rv = padWrapKeyData(l_mechanism.mechanism, keydata);
+		if (rv == CKR_OK && !state.symCipher->wrapKey(state.symKey, state.symMode, keydata, wrapped))
+			rv = CKR_GENERAL_ERROR;
+
+		if (rv == CKR_OK && item.pWrappedKey != NULL_PTR)
+		{
+			if (item.ulWrappedKeyLen < wrapped.size())
+			{
+				rv = CKR_BUFFER_TOO_SMALL;
+			}
+			else if (!validate_user_check_ptr(item.pWrappedKey, item.ulWrappedKeyLen))
+			{
+				rv = CKR_DEVICE_MEMORY;
+			}
+			else
+			{
+				memcpy_s(item.pWrappedKey, item.ulWrappedKeyLen, wrapped.byte_str(), wrapped.size());
+			}
+		}
+
+		if (rv == CKR_OK || rv == CKR_BUFFER_TOO_SMALL)
+			pItems[i].ulWrappedKeyLen = wrapped.size();
+		pItems[i].rv = rv;
+
+		if (rv != CKR_OK && batchRv == CKR_OK) batchRv = rv;
+	}
+
+	return batchRv;
+}
+
+// Get the HMAC mechanism of the hash of a key derivation
+static bool getHmacOfHash(CK_MECHANISM_TYPE hash, CK_MECHANISM_TYPE& prf)
+{
+	switch (hash)
+	{
+		case CKM_SHA_1:  prf = CKM_SHA_1_HMAC;  break;
+		case CKM_SHA224: prf = CKM_SHA224_HMAC; break;
+		case CKM_SHA256: prf = CKM_SHA256_HMAC; break;
+		case CKM_SHA384: prf = CKM_SHA384_HMAC; break;
+		case CKM_SHA512: prf = CKM_SHA512_HMAC; break;
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+// Copy a byte string of a key derivation parameter into the enclave
+static CK_RV copyDeriveParameter(CK_BYTE_PTR pData, CK_ULONG ulDataLen, ByteString& data)
+{
+	if (ulDataLen == 0) return CKR_OK;
+
+	if (pData == NULL_PTR || ulDataLen > CKM_MAX_PARAMETER_LEN)
+		return CKR_MECHANISM_PARAM_INVALID;
+
+	if (!validate_user_check_ptr(pData, ulDataLen))
+		return CKR_DEVICE_MEMORY;
+
+	data = ByteString(pData, ulDataLen);
+
+	return CKR_OK;
+}
+
+// The key derivation of one C_DeriveKeyBatch call, set up once for all keys
+// of the batch
+struct DeriveBatchState
+{
+	CK_MECHANISM_TYPE mechanism;
+	MacAlgorithm* mac;
+	// The base key, or the pseudorandom key of HKDF
+	SymmetricKey* prfKey;
+	// The HKDF info prefix of all keys
+	ByteString info;
+	// The SP 800-108 feedback IV
+	ByteString iv;
+	// The TLS PRF label and seed prefix of all keys
+	ByteString seed;
+	// The key length the mechanism requires, 0 if any
+	size_t keyLen;
+	// The TLS PRF label is that of the Finished verify data
+	bool finishedLabel;
+	// The X25519 or X448 private key of CKM_ECDH1_DERIVE and the length of
+	// its shared secrets
+	AsymmetricAlgorithm* eddsa;
+	PrivateKey* privateKey;
+	size_t secretLen;
+
+	DeriveBatchState() : mechanism(CKM_VENDOR_DEFINED), mac(NULL), prfKey(NULL), keyLen(0), finishedLabel(false),
+	                     eddsa(NULL), privateKey(NULL), secretLen(0) { }
+
+	~DeriveBatchState()
+	{
+		if (mac != NULL)
+		{
+			// The MAC state of the pseudorandom key is of no use after the batch
+			if (prfKey != NULL && prfKey->getCacheOwner() == prfKey)
+				CryptoFactory::i()->forgetKeyStates(prfKey);
+
+			mac->recycleKey(prfKey);
+			CryptoFactory::i()->recycleMacAlgorithm(mac);
+		}
+
+		if (eddsa != NULL)
+		{
+			eddsa->recyclePrivateKey(privateKey);
+			CryptoFactory::i()->recycleAsymmetricAlgorithm(eddsa);
+		}
+	}
+
+	// The maximum length of a key; 255 blocks, as for HKDF, or the shared
+	// secret
+	size_t getMaxLength() const
+	{
+		if (mac == NULL) return secretLen;
+
+		return 255 * mac->getMacSize();
+	}
+
+	// Compute len bytes of key material from the data of a key. Every block
+	// copies the cached MAC state of the key instead of hashing it again.
+	bool derive(const ByteString& data, size_t len, ByteString& value)
+	{
+		if (len == 0 || len > getMaxLength()) return false;
+
+		if (mechanism == CKM_ECDH1_DERIVE)
+			return deriveEcdh(data, len, value);
+
+		if (mechanism == CKM_TLS12_PRF_SHA256 ||
+		    mechanism == CKM_TLS12_MASTER_KEY_DERIVE ||
+		    mechanism == CKM_TLS12_KEY_AND_MAC_DERIVE)
+			return deriveTls(data, len, value);
+
+		value.wipe();
+		ByteString block;
+		for (unsigned long i = 1; value.size() < len; i++)
+		{
+			ByteString input;
+			if (mechanism == CKM_HKDF_DERIVE)
+			{
+				// T(i) = HMAC(PRK, T(i-1) || info || i)
+				input = block + info + data;
+				input += (unsigned char) i;
+			}
+			else
+			{
+				// K(i) = HMAC(KI, [K(i-1) ||] [i]32 || fixed input)
+				if (mechanism == CKM_SP800_108_FEEDBACK_KDF)
+					input = (i == 1) ? iv : block;
+				input += (unsigned char) (i >> 24);
+				input += (unsigned char) (i >> 16);
+				input += (unsigned char) (i >> 8);
+				input += (unsigned char) i;
+				input += data;
+			}
+
+			if (!mac->signInit(prfKey) ||
+			    !mac->signUpdate(input) ||
+			    !mac->signFinal(block))
+				return false;
+
+			value += block;
+		}
+		value.resize(len);
+
+		return true;
+	}
+
+	// P_hash(secret, label || seed) of RFC 5246, section 5
+	bool deriveTls(const ByteString& data, size_t len, ByteString& value)
+	{
+		ByteString labelSeed;
+		if (mechanism == CKM_TLS12_MASTER_KEY_DERIVE && data.size() > 0)
+		{
+			// The extended master secret of RFC 7627 uses the session hash
+			const char label[] = "extended master secret";
+			labelSeed = ByteString((const unsigned char*) label, sizeof(label) - 1) + data;
+		}
+		else
+		{
+			labelSeed = seed + data;
+		}
+
+		value.wipe();
+		ByteString a = labelSeed;
+		ByteString next;
+		ByteString block;
+		while (value.size() < len)
+		{
+			// A(i) = HMAC(secret, A(i-1)), block i = HMAC(secret, A(i) || seed)
+			if (!mac->signInit(prfKey) ||
+			    !mac->signUpdate(a) ||
+			    !mac->signFinal(next))
+				return false;
+			a = next;
+
+			if (!mac->signInit(prfKey) ||
+			    !mac->signUpdate(a + labelSeed) ||
+			    !mac->signFinal(block))
+				return false;
+
+			value += block;
+		}
+		value.resize(len);
+
+		return true;
+	}
+
+	// The shared secret with the public key of a peer, truncated from the
+	// leading end as by C_DeriveKey. The private key is set up once for the
+	// batch and the algorithm keeps the last peer key parsed
+	bool deriveEcdh(const ByteString& data, size_t len, ByteString& value)
+	{
+		// The raw X25519 or X448 public key, or its DER octet string
+		ByteString publicData = data;
+		if (publicData.size() != secretLen)
+			publicData = DERUTIL::octet2Raw(publicData);
+
+		SymmetricKey* secret = NULL;
+		if (!eddsa->deriveRawKey(&secret, publicData, privateKey))
+			return false;
+
+		value = secret->getKeyBits();
+		eddsa->recycleSymmetricKey(secret);
+		if (value.size() != secretLen) return false;
+
+		if (len < value.size())
+			value.split(value.size() - len);
 
-        if(isUsedForQuoteGeneration)
-        {
-            return CKR_KEY_HANDLE_INVALID;
-        }
+		return true;
+	}
+};
 
-        CK_BBOOL isKeyOnToken = key->getBooleanValue(CKA_TOKEN, false);
-        if (isKeyOnToken)
-        {
-            return CKR_KEY_FUNCTION_NOT_PERMITTED;
-        }
+// Internal: Set up the PRF and key of a C_DeriveKeyBatch call
+CK_RV SoftHSM::DeriveBatchSetup(Token* token, OSObject* baseKey, CK_MECHANISM_PTR pMechanism, DeriveBatchState& state)
+{
+	MacAlgo::Type algo = MacAlgo::Unknown;
+	CK_MECHANISM_TYPE prf;
+	bool extract = false;
+	ByteString salt;
+	CK_VERSION_PTR pVersion = NULL_PTR;
+	CK_RV rv;
 
-        rv = exportQuoteWithRsaPublicKey(hSession,
-                                         hKey,
-                                         l_pMechanism,
-                                         pWrappedKey,
-                                         l_pulWrappedKeyLen);
+	switch (pMechanism->mechanism)
+	{
+		case CKM_HKDF_DERIVE:
+		{
+			if (pMechanism->pParameter == NULL_PTR ||
+			    pMechanism->ulParameterLen != sizeof(CK_HKDF_PARAMS))
+				return CKR_MECHANISM_PARAM_INVALID;
 
-        *pulWrappedKeyLen = ulWrappedKeyLen;
+			CK_HKDF_PARAMS_PTR params = (CK_HKDF_PARAMS_PTR) pMechanism->pParameter;
 
-        if (pWrappedKey)
-        {
-            bool bOK = true;
-            bOK = bOK && key->setAttribute(CKA_USED_FOR_QUOTE_GENERATION, true);
-            if (!bOK)
-            {
-                memset_s(pWrappedKey, ulWrappedKeyLen, 0x00, ulWrappedKeyLen);
-                rv = CKR_FUNCTION_FAILED;
-                return rv;
-            }
+			// Every key is expanded from the same pseudorandom key
+			if (params->bExpand == CK_FALSE)
+				return CKR_MECHANISM_PARAM_INVALID;
 
-            bOK = bOK && key->setAttribute(CKA_USED_FOR_WRAPPING, true);
-            if (!bOK)
-            {
-                memset_s(pWrappedKey, ulWrappedKeyLen, 0x00, ulWrappedKeyLen);
-                rv = CKR_FUNCTION_FAILED;
-                return rv;
-            }
+			if (!getHmacOfHash(params->prfHashMechanism, prf))
+				return CKR_MECHANISM_PARAM_INVALID;
 
-            CK_OBJECT_HANDLE privateKeyHandle = getRSAPairKey(hSession, hKey);
-            if (CK_INVALID_HANDLE == privateKeyHandle)
-            {
-                memset_s(pWrappedKey, ulWrappedKeyLen, 0x00, ulWrappedKeyLen);
-                return CKR_KEY_HANDLE_INVALID;
-            }
+			if (params->bExtract != CK_FALSE)
+			{
+				extract = true;
 
-            // Get the OS Object related to the private key
-            OSObject *privateKey = (OSObject*)handleManager->getObject(privateKeyHandle);
-            if (nullptr == privateKey || !privateKey->isValid())
-            {
-                memset_s(pWrappedKey, ulWrappedKeyLen, 0x00, ulWrappedKeyLen);
-                return CKR_OBJECT_HANDLE_INVALID;
-            }
+				// Salt keys are not supported
+				if (params->ulSaltType == CKF_HKDF_SALT_DATA)
+				{
+					if (params->pSalt == NULL_PTR || params->ulSaltLen == 0 ||
+					    params->ulSaltLen > CKM_MAX_PARAMETER_LEN)
+						return CKR_MECHANISM_PARAM_INVALID;
 
-            bOK = bOK && privateKey->setAttribute(CKA_USED_FOR_QUOTE_GENERATION, true);
-            if (!bOK)
-            {
-                memset_s(pWrappedKey, ulWrappedKeyLen, 0x00, ulWrappedKeyLen);
-                rv = CKR_FUNCTION_FAILED;
-            }
+					if (!validate_user_check_ptr(params->pSalt, params->ulSaltLen))
+						return CKR_DEVICE_MEMORY;
 
-            bOK = bOK && privateKey->setAttribute(CKA_USED_FOR_WRAPPING, true);
-            if (!bOK)
-            {
-                memset_s(pWrappedKey, ulWrappedKeyLen, 0x00, ulWrappedKeyLen);
-                rv = CKR_FUNCTION_FAILED;
-            }
-        }
-#else
-        rv = CKR_MECHANISM_INVALID;
-#endif
-    }
-    else
-    {
-        // Check the wrapping key handle.
-        OSObject *wrapKey = (OSObject *)handleManager->getObject(hWrappingKey);
-        if (wrapKey == NULL_PTR || !wrapKey->isValid()) return CKR_WRAPPING_KEY_HANDLE_INVALID;
+					salt = ByteString(params->pSalt, params->ulSaltLen);
+				}
+				else if (params->ulSaltType != CKF_HKDF_SALT_NULL)
+				{
+					return CKR_MECHANISM_PARAM_INVALID;
+				}
+			}
 
-        CK_BBOOL isWrapKeyOnToken = wrapKey->getBooleanValue(CKA_TOKEN, false);
-        CK_BBOOL isWrapKeyPrivate = wrapKey->getBooleanValue(CKA_PRIVATE, true);
+			if (params->ulInfoLen > 0)
+			{
+				if (params->pInfo == NULL_PTR || params->ulInfoLen > CKM_MAX_PARAMETER_LEN)
+					return CKR_MECHANISM_PARAM_INVALID;
 
-#ifdef DCAP_SUPPORT
-        // If the key is used for quote generation should not be used for wrapping
-        CK_BBOOL isUsedForQuoteGeneration = wrapKey->getBooleanValue(CKA_USED_FOR_QUOTE_GENERATION, false);
+				if (!validate_user_check_ptr(params->pInfo, params->ulInfoLen))
+					return CKR_DEVICE_MEMORY;
 
-        if(isUsedForQuoteGeneration)
-        {
-            return CKR_WRAPPING_KEY_HANDLE_INVALID;
-        }
-#endif
-        // Check user credentials for the wrapping key
-        rv = haveRead(session->getState(), isWrapKeyOnToken, isWrapKeyPrivate);
-        if (rv != CKR_OK)
-        {
-            if (rv == CKR_USER_NOT_LOGGED_IN)
-            {
-                // INFO_MSG("User is not authorized");
-            }
+				state.info = ByteString(params->pInfo, params->ulInfoLen);
+			}
+			break;
+		}
+		case CKM_SP800_108_COUNTER_KDF:
+		case CKM_SP800_108_FEEDBACK_KDF:
+		{
+			if (pMechanism->pParameter == NULL_PTR ||
+			    pMechanism->ulParameterLen != sizeof(CK_SP800_108_BATCH_PARAMS))
+				return CKR_MECHANISM_PARAM_INVALID;
 
-            return rv;
-        }
+			CK_SP800_108_BATCH_PARAMS_PTR params = (CK_SP800_108_BATCH_PARAMS_PTR) pMechanism->pParameter;
+			prf = params->prfType;
 
-        // Check wrapping key class and type
-        if ((l_pMechanism->mechanism == CKM_AES_KEY_WRAP || l_pMechanism->mechanism == CKM_AES_KEY_WRAP_PAD) && wrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) != CKO_SECRET_KEY)
-            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
-        if ((l_pMechanism->mechanism == CKM_RSA_PKCS || l_pMechanism->mechanism == CKM_RSA_PKCS_OAEP) && wrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) != CKO_PUBLIC_KEY)
-            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
-        if (l_pMechanism->mechanism == CKM_AES_KEY_WRAP && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
-            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
-        if (l_pMechanism->mechanism == CKM_AES_KEY_WRAP_PAD && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
-            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
-        if ((l_pMechanism->mechanism == CKM_RSA_PKCS || l_pMechanism->mechanism == CKM_RSA_PKCS_OAEP) && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_RSA)
-            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
-        if (l_pMechanism->mechanism == CKM_AES_CTR && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
-            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
-        if (l_pMechanism->mechanism == CKM_AES_GCM && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
-            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
-        if (l_pMechanism->mechanism == CKM_AES_CBC && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
-            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
-        if (l_pMechanism->mechanism == CKM_AES_CBC_PAD && wrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
-            return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
+			if (params->ulIVLen > 0)
+			{
+				// Counter mode has no IV
+				if (pMechanism->mechanism != CKM_SP800_108_FEEDBACK_KDF ||
+				    params->pIV == NULL_PTR || params->ulIVLen > CKM_MAX_PARAMETER_LEN)
+					return CKR_MECHANISM_PARAM_INVALID;
 
-        // Check if the wrapping key can be used for wrapping
-        if (wrapKey->getBooleanValue(CKA_WRAP, false) == false)
-            return CKR_KEY_FUNCTION_NOT_PERMITTED;
+				if (!validate_user_check_ptr(params->pIV, params->ulIVLen))
+					return CKR_DEVICE_MEMORY;
 
-        // Check if the specified mechanism is allowed for the wrapping key
-        if (!isMechanismPermitted(wrapKey, l_pMechanism))
-            return CKR_MECHANISM_INVALID;
+				state.iv = ByteString(params->pIV, params->ulIVLen);
+			}
+			break;
+		}
+#ifdef WITH_EDDSA
+		case CKM_ECDH1_DERIVE:
+		{
+			if (pMechanism->pParameter == NULL_PTR ||
+			    pMechanism->ulParameterLen != sizeof(CK_ECDH1_DERIVE_PARAMS))
+				return CKR_MECHANISM_PARAM_INVALID;
 
-        // Check the to be wrapped key handle.
-        OSObject *key = (OSObject *)handleManager->getObject(hKey);
-        if (key == NULL_PTR || !key->isValid()) return CKR_KEY_HANDLE_INVALID;
+			// The public key of the peer is the data of every key and the
+			// shared secret is used as it is
+			CK_ECDH1_DERIVE_PARAMS_PTR params = (CK_ECDH1_DERIVE_PARAMS_PTR) pMechanism->pParameter;
+			if (params->kdf != CKD_NULL || params->ulSharedDataLen != 0 ||
+			    params->ulPublicDataLen != 0)
+				return CKR_MECHANISM_PARAM_INVALID;
 
-        CK_BBOOL isKeyOnToken = key->getBooleanValue(CKA_TOKEN, false);
-        CK_BBOOL isKeyPrivate = key->getBooleanValue(CKA_PRIVATE, true);
+#ifdef ENABLE_MITIGATION
+			__builtin_ia32_lfence();
+#endif
 
-        // Check user credentials for the to be wrapped key
-        rv = haveRead(session->getState(), isKeyOnToken, isKeyPrivate);
-        if (rv != CKR_OK)
-        {
-            if (rv == CKR_USER_NOT_LOGGED_IN)
-            {
-                // INFO_MSG("User is not authorized");
-            }
+			return DeriveBatchSetupEcdh(token, baseKey, state);
+		}
+#endif
+		case CKM_TLS12_PRF_SHA256:
+		{
+			if (pMechanism->pParameter == NULL_PTR ||
+			    pMechanism->ulParameterLen != sizeof(CK_TLS_PRF_PARAMS))
+				return CKR_MECHANISM_PARAM_INVALID;
 
-            return rv;
-        }
+			// The output goes to the items, pOutput is not used
+			CK_TLS_PRF_PARAMS_PTR params = (CK_TLS_PRF_PARAMS_PTR) pMechanism->pParameter;
+			if (params->ulLabelLen == 0)
+				return CKR_MECHANISM_PARAM_INVALID;
 
-        // Check if the to be wrapped key can be wrapped
-        if (key->getBooleanValue(CKA_EXTRACTABLE, false) == false)
-            return CKR_KEY_UNEXTRACTABLE;
-        if (key->getBooleanValue(CKA_WRAP_WITH_TRUSTED, false) && wrapKey->getBooleanValue(CKA_TRUSTED, false) == false)
-            return CKR_KEY_NOT_WRAPPABLE;
-
-        // Check the class
-        CK_OBJECT_CLASS keyClass = key->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED);
-        if (keyClass != CKO_SECRET_KEY && keyClass != CKO_PRIVATE_KEY)
-            return CKR_KEY_NOT_WRAPPABLE;
-        // CKM_RSA_PKCS and CKM_RSA_PKCS_OAEP can be used only on SECRET keys: PKCS#11 2.40 draft 2 section 2.1.6 PKCS #1 v1.5 RSA & section 2.1.8 PKCS #1 RSA OAEP
-        if ((l_pMechanism->mechanism == CKM_RSA_PKCS || l_pMechanism->mechanism == CKM_RSA_PKCS_OAEP) && keyClass != CKO_SECRET_KEY)
-            return CKR_KEY_NOT_WRAPPABLE;
-
-        // Verify the wrap template attribute
-        if (wrapKey->attributeExists(CKA_WRAP_TEMPLATE))
-        {
-            OSAttribute attr = wrapKey->getAttribute(CKA_WRAP_TEMPLATE);
+			ByteString seed;
+			rv = copyDeriveParameter(params->pLabel, params->ulLabelLen, state.seed);
+			if (rv == CKR_OK)
+				rv = copyDeriveParameter(params->pSeed, params->ulSeedLen, seed);
+			if (rv != CKR_OK) return rv;
 
-            if (attr.isAttributeMapAttribute())
-            {
-                typedef std::map<CK_ATTRIBUTE_TYPE,OSAttribute> attrmap_type;
+			const char clientLabel[] = "client finished";
+			const char serverLabel[] = "server finished";
+			state.finishedLabel = (state.seed == ByteString((const unsigned char*) clientLabel, sizeof(clientLabel) - 1) ||
+			                       state.seed == ByteString((const unsigned char*) serverLabel, sizeof(serverLabel) - 1));
 
-                const attrmap_type& map = attr.getAttributeMapValue();
+			state.seed += seed;
+			prf = CKM_SHA256_HMAC;
+			break;
+		}
+		case CKM_TLS12_MASTER_KEY_DERIVE:
+		{
+			if (pMechanism->pParameter == NULL_PTR ||
+			    pMechanism->ulParameterLen != sizeof(CK_TLS12_MASTER_KEY_DERIVE_PARAMS))
+				return CKR_MECHANISM_PARAM_INVALID;
 
-                for (attrmap_type::const_iterator it = map.begin(); it != map.end(); ++it)
-                {
-                    if (!key->attributeExists(it->first))
-                    {
-                        return CKR_KEY_NOT_WRAPPABLE;
-                    }
+			CK_TLS12_MASTER_KEY_DERIVE_PARAMS_PTR params = (CK_TLS12_MASTER_KEY_DERIVE_PARAMS_PTR) pMechanism->pParameter;
+			if (!getHmacOfHash(params->prfHashMechanism, prf))
+				return CKR_MECHANISM_PARAM_INVALID;
 
-                    OSAttribute keyAttr = key->getAttribute(it->first);
-                    ByteString v1, v2;
-                    if (!keyAttr.peekValue(v1) || !it->second.peekValue(v2) || (v1 != v2))
-                    {
-                        return CKR_KEY_NOT_WRAPPABLE;
-                    }
-                }
-            }
-        }
+			if (params->RandomInfo.ulClientRandomLen == 0 ||
+			    params->RandomInfo.ulServerRandomLen == 0)
+				return CKR_MECHANISM_PARAM_INVALID;
 
-        // Get the key data to encrypt
-        ByteString keydata;
-        if (keyClass == CKO_SECRET_KEY)
-        {
-            if (isKeyPrivate)
-            {
-                bool bOK = token->decrypt(key->getByteStringValue(CKA_VALUE), keydata);
-                if (!bOK) return CKR_GENERAL_ERROR;
-            }
-            else
-            {
-                keydata = key->getByteStringValue(CKA_VALUE);
-            }
-        }
-        else
-        {
-            CK_KEY_TYPE keyType = key->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED);
-            AsymAlgo::Type alg = AsymAlgo::Unknown;
-            switch (keyType) {
-                case CKK_RSA:
-                    alg = AsymAlgo::RSA;
-                    break;
-#if 0 // Unsupported by Crypto API Toolkit
-                case CKK_DSA:
-                    alg = AsymAlgo::DSA;
-                    break;
-                case CKK_DH:
-                    alg = AsymAlgo::DH;
-                    break;
-#endif // Unsupported by Crypto API Toolkit
-#ifdef WITH_ECC
-                case CKK_EC:
-                    // can be ecdh too but it doesn't matter
-                    alg = AsymAlgo::ECDSA;
-                    break;
-#endif
-#ifdef WITH_EDDSA
-                // Not yet
-#endif
-#if 0 // Unsupported by Crypto API Toolkit
-#ifdef WITH_GOST
-                case CKK_GOSTR3410:
-                    alg = AsymAlgo::GOST;
-                    break;
-#endif
-#endif // Unsupported by Crypto API Toolkit
-                default:
-                    return CKR_KEY_NOT_WRAPPABLE;
-            }
-            AsymmetricAlgorithm* asymCrypto = NULL;
-            PrivateKey* privateKey = NULL;
-            asymCrypto = CryptoFactory::i()->getAsymmetricAlgorithm(alg);
-            if (asymCrypto == NULL)
-                return CKR_GENERAL_ERROR;
-            privateKey = asymCrypto->newPrivateKey();
-            if (privateKey == NULL)
-            {
-                CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-                return CKR_HOST_MEMORY;
-            }
-            switch (keyType) {
-                case CKK_RSA:
-                    rv = getRSAPrivateKey((RSAPrivateKey*)privateKey, token, key);
-                    break;
-#if 0 //Unsupported Crypto API Toolkit
-                case CKK_DSA:
-                    rv = getDSAPrivateKey((DSAPrivateKey*)privateKey, token, key);
-                    break;
-                case CKK_DH:
-                    rv = getDHPrivateKey((DHPrivateKey*)privateKey, token, key);
-                    break;
-#endif //Unsupported Crypto API Toolkit
-#ifdef WITH_ECC
-                case CKK_EC:
-                    rv = getECPrivateKey((ECPrivateKey*)privateKey, token, key);
-                    break;
-#endif
-#if 0 //Unsupported Crypto API Toolkit
-#ifdef WITH_GOST
-                case CKK_GOSTR3410:
-                    rv = getGOSTPrivateKey((GOSTPrivateKey*)privateKey, token, key);
-                    break;
-#endif
-#endif //Unsupported Crypto API Toolkit
-            }
-            if (rv != CKR_OK)
-            {
-                asymCrypto->recyclePrivateKey(privateKey);
-                CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-                return CKR_GENERAL_ERROR;
-            }
-            keydata = privateKey->PKCS8Encode();
-            asymCrypto->recyclePrivateKey(privateKey);
-            CryptoFactory::i()->recycleAsymmetricAlgorithm(asymCrypto);
-        }
-        if (keydata.size() == 0)
-            return CKR_KEY_NOT_WRAPPABLE;
+			// "master secret" || ClientHello.random || ServerHello.random
+			const char label[] = "master secret";
+			ByteString clientRandom;
+			ByteString serverRandom;
+			rv = copyDeriveParameter(params->RandomInfo.pClientRandom, params->RandomInfo.ulClientRandomLen, clientRandom);
+			if (rv == CKR_OK)
+				rv = copyDeriveParameter(params->RandomInfo.pServerRandom, params->RandomInfo.ulServerRandomLen, serverRandom);
+			if (rv != CKR_OK) return rv;
 
-        keyClass = wrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED);
-#ifdef SGXHSM
-        if (keyClass == CKO_SECRET_KEY                  &&
-            (l_pMechanism->mechanism  == CKM_AES_CTR      ||
-             l_pMechanism->mechanism  == CKM_AES_GCM      ||
-             l_pMechanism->mechanism  == CKM_AES_CBC      ||
-             l_pMechanism->mechanism  == CKM_AES_CBC_PAD))
-        {
-            if (!pWrappedKey)
-            {
-                rv = SoftHSM::SymEncryptInit(hSession, l_pMechanism, hWrappingKey);
-                if (rv != CKR_OK)
-                {
-                    session->resetOp();
-                    return rv;
-                }
+			state.seed = ByteString((const unsigned char*) label, sizeof(label) - 1) + clientRandom + serverRandom;
+			state.keyLen = 48;
+			pVersion = params->pVersion;
+			break;
+		}
+		case CKM_TLS12_KEY_AND_MAC_DERIVE:
+		{
+			if (pMechanism->pParameter == NULL_PTR ||
+			    pMechanism->ulParameterLen != sizeof(CK_TLS12_KEY_MAT_PARAMS))
+				return CKR_MECHANISM_PARAM_INVALID;
 
-                rv = SymEncrypt(session, (CK_BYTE_PTR) keydata.const_byte_str(), keydata.size(), NULL_PTR, l_pulWrappedKeyLen);
+			CK_TLS12_KEY_MAT_PARAMS_PTR params = (CK_TLS12_KEY_MAT_PARAMS_PTR) pMechanism->pParameter;
+			if (!getHmacOfHash(params->prfHashMechanism, prf))
+				return CKR_MECHANISM_PARAM_INVALID;
 
-                session->resetOp();
+			// TLS 1.2 has no export ciphers
+			if (params->bIsExport != CK_FALSE ||
+			    params->ulMacSizeInBits % 8 != 0 ||
+			    params->ulKeySizeInBits % 8 != 0 ||
+			    params->ulIVSizeInBits % 8 != 0 ||
+			    params->ulMacSizeInBits + params->ulKeySizeInBits + params->ulIVSizeInBits == 0)
+				return CKR_MECHANISM_PARAM_INVALID;
 
-                *pulWrappedKeyLen = ulWrappedKeyLen;
+			if (params->RandomInfo.ulClientRandomLen == 0 ||
+			    params->RandomInfo.ulServerRandomLen == 0)
+				return CKR_MECHANISM_PARAM_INVALID;
 
-                return rv;
-            }
+			// "key expansion" || ServerHello.random || ClientHello.random
+			const char label[] = "key expansion";
+			ByteString clientRandom;
+			ByteString serverRandom;
+			rv = copyDeriveParameter(params->RandomInfo.pClientRandom, params->RandomInfo.ulClientRandomLen, clientRandom);
+			if (rv == CKR_OK)
+				rv = copyDeriveParameter(params->RandomInfo.pServerRandom, params->RandomInfo.ulServerRandomLen, serverRandom);
+			if (rv != CKR_OK) return rv;
 
-            rv = SoftHSM::SymEncryptInit(hSession, l_pMechanism, hWrappingKey);
-            if (rv != CKR_OK)
-            {
-                session->resetOp();
-                return rv;
-            }
+			state.seed = ByteString((const unsigned char*) label, sizeof(label) - 1) + serverRandom + clientRandom;
+			state.keyLen = params->ulKeySizeInBits / 8;
+			break;
+		}
+		default:
+			return CKR_MECHANISM_INVALID;
+	}
 
-            rv = SymEncrypt(session, (CK_BYTE_PTR) keydata.const_byte_str(), keydata.size(), pWrappedKey, l_pulWrappedKeyLen);
-            if (rv != CKR_OK)
-            {
-                session->resetOp();
-            }
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
 
-            wrapKey->setAttribute(CKA_USED_FOR_WRAPPING, true);
-        }
-        else
-        {
+	switch (prf)
+	{
+#ifndef WITH_FIPS
+		case CKM_SHA_1_HMAC:
+			algo = MacAlgo::HMAC_SHA1;
+			break;
 #endif
-            ByteString wrapped;
-            if (keyClass == CKO_SECRET_KEY)
-            {
-                rv = SoftHSM::WrapKeySym(l_pMechanism, token, wrapKey, keydata, wrapped);
-            }
-            else
-            {
-                rv = SoftHSM::WrapKeyAsym(l_pMechanism, token, wrapKey, keydata, wrapped);
-#ifdef SGXHSM
-                if (rv == CKR_OK)
-                {
-                    if (wrapKey->startTransaction())
-                    {
-                        bool bOK = true;
-                        bOK = bOK && wrapKey->setAttribute(CKA_USED_FOR_WRAPPING, true);
+		case CKM_SHA224_HMAC:
+			algo = MacAlgo::HMAC_SHA224;
+			break;
+		case CKM_SHA256_HMAC:
+			algo = MacAlgo::HMAC_SHA256;
+			break;
+		case CKM_SHA384_HMAC:
+			algo = MacAlgo::HMAC_SHA384;
+			break;
+		case CKM_SHA512_HMAC:
+			algo = MacAlgo::HMAC_SHA512;
+			break;
+		default:
+			return CKR_MECHANISM_PARAM_INVALID;
+	}
 
-                        if (bOK)
-                        {
-                            bOK = wrapKey->commitTransaction();
-                        }
-                        else
-                        {
-                            wrapKey->abortTransaction();
-                            wrapped.wipe();
-                            rv = CKR_FUNCTION_FAILED;
-                            return rv;
-                        }
-                    }
+	state.mechanism = pMechanism->mechanism;
+	state.mac = CryptoFactory::i()->getMacAlgorithm(algo);
+	if (state.mac == NULL) return CKR_MECHANISM_INVALID;
 
-                    CK_ULONG pairKeyId = wrapKey->getUnsignedLongValue(CKA_ASYMMETRIC_PAIR_ID, 0);
+	state.prfKey = new SymmetricKey();
 
-                    if (pairKeyId != 0)
-                    {
-                        CK_ATTRIBUTE pTemplate[] = { { CKA_ASYMMETRIC_PAIR_ID, &pairKeyId, sizeof(pairKeyId) },
-                                                   };
+	if (getSymmetricKey(state.prfKey, token, baseKey) != CKR_OK)
+		return CKR_GENERAL_ERROR;
 
-                        rv = FindObjectsInit(hSession, &pTemplate[0], 1);
-                        if (rv != CKR_OK)
-                        {
-                            wrapped.wipe();
-                            return rv;
-                        }
+	state.prfKey->setBitLen(state.prfKey->getKeyBits().size() * 8);
 
-                        CK_OBJECT_HANDLE hObjects[2];
-                        CK_ULONG ulObjectCount = 0;
+	// Return the client version of an RSA pre-master secret
+	if (pVersion != NULL_PTR)
+	{
+		if (state.prfKey->getKeyBits().size() != 48)
+			return CKR_KEY_SIZE_RANGE;
 
-                        //Finding corresponding private key handle having same pair key id
-                        //Only two objects (RSA public key and corresponding private key)
-                        //are having same pair id key which is generated randomly
-                        rv = FindObjects(hSession, &hObjects[0], 2, &ulObjectCount);
-                        if (rv != CKR_OK)
-                        {
-                            wrapped.wipe();
-                            return rv;
-                        }
+		if (!validate_user_check_ptr(pVersion, sizeof(CK_VERSION)))
+			return CKR_DEVICE_MEMORY;
 
-                        if (ulObjectCount != 2)
-                        {
-                            wrapped.wipe();
-                            rv = CKR_FUNCTION_FAILED;
-                            return rv;
-                        }
+		pVersion->major = state.prfKey->getKeyBits().const_byte_str()[0];
+		pVersion->minor = state.prfKey->getKeyBits().const_byte_str()[1];
+	}
 
-                        CK_OBJECT_HANDLE privateKeyHandle = CK_INVALID_HANDLE;
+	if (!extract)
+	{
+		// Let the MAC algorithm reuse the key state of the object
+		state.prfKey->setCacheOwner(baseKey);
 
-                        for (CK_ULONG i = 0 ; i < ulObjectCount ; i++)
-                        {
-                            if (hObjects[i] != hWrappingKey)
-                            {
-                                privateKeyHandle = hObjects[i];
-                                break;
-                            }
-                        }
+		return CKR_OK;
+	}
 
-                        if (CK_INVALID_HANDLE == privateKeyHandle)
-                        {
-                            wrapped.wipe();
-                            return CKR_KEY_HANDLE_INVALID;
-                        }
+	// PRK = HMAC(salt, IKM); the NULL salt is a string of zeros
+	if (salt.size() == 0)
+		salt.wipe(state.mac->getMacSize());
 
-                        // Get the OS Object related to the private key
-                        OSObject *privateKey = (OSObject*)handleManager->getObject(privateKeyHandle);
-                        rv = C_FindObjectsFinal(hSession);
-                        if (privateKey == NULL_PTR || !privateKey->isValid())
-                        {
-                            wrapped.wipe();
-                            return CKR_OBJECT_HANDLE_INVALID;
-                        }
+	SymmetricKey saltKey(salt.size() * 8);
+	ByteString prk;
+	if (!saltKey.setKeyBits(salt) ||
+	    !state.mac->signInit(&saltKey) ||
+	    !state.mac->signUpdate(state.prfKey->getKeyBits()) ||
+	    !state.mac->signFinal(prk))
+		return CKR_GENERAL_ERROR;
 
-                        if (privateKey->startTransaction())
-                        {
-                            bool bOK = true;
-                            bOK = bOK && privateKey->setAttribute(CKA_USED_FOR_WRAPPING, true);
+	state.prfKey->setKeyBits(prk);
+	state.prfKey->setBitLen(prk.size() * 8);
 
-                            if (bOK)
-                            {
-                                bOK = privateKey->commitTransaction();
-                            }
-                            else
-                            {
-                                privateKey->abortTransaction();
-                            }
+	// The key state of the pseudorandom key is kept for the batch only
+	state.prfKey->setCacheOwner(state.prfKey);
 
-                            if (!bOK)
-                            {
-                                wrapped.wipe();
-                                rv = CKR_FUNCTION_FAILED;
-                            }
-                        }
-                    }
-                }
-#endif
-            }
+	return CKR_OK;
+}
 
-            if (rv != CKR_OK)
-            {
-                wrapped.wipe();
-                return rv;
-            }
+#ifdef WITH_EDDSA
+// Internal: Set up the X25519 or X448 private key of a C_DeriveKeyBatch call
+CK_RV SoftHSM::DeriveBatchSetupEcdh(Token* token, OSObject* baseKey, DeriveBatchState& state)
+{
+	state.mechanism = CKM_ECDH1_DERIVE;
+	state.eddsa = CryptoFactory::i()->getAsymmetricAlgorithm(AsymAlgo::EDDSA);
+	if (state.eddsa == NULL) return CKR_MECHANISM_INVALID;
 
-            if (pWrappedKey != NULL)
-            {
-                if (ulWrappedKeyLen >= wrapped.size())
-                {
-                    memcpy_s(pWrappedKey, ulWrappedKeyLen, wrapped.byte_str(), wrapped.size());
-                }
-                else
-                {
-                    rv = CKR_BUFFER_TOO_SMALL;
-                }
-            }
+	state.privateKey = state.eddsa->newPrivateKey();
+	if (state.privateKey == NULL) return CKR_HOST_MEMORY;
 
-            *pulWrappedKeyLen = wrapped.size();
-#ifdef SGXHSM
-        }
-#endif
-    }
+	if (getEDPrivateKey((EDPrivateKey*)state.privateKey, token, baseKey) != CKR_OK)
+		return CKR_GENERAL_ERROR;
 
-    return rv;
+	// Ed25519 and Ed448 keys only sign
+	const unsigned char x25519[] = { 0x06, 0x03, 0x2B, 0x65, 0x6E };
+	const unsigned char x448[] = { 0x06, 0x03, 0x2B, 0x65, 0x6F };
+	const ByteString& ec = ((EDPrivateKey*)state.privateKey)->getEC();
+	if (ec == ByteString(x25519, sizeof(x25519)))
+		state.secretLen = 32;
+	else if (ec == ByteString(x448, sizeof(x448)))
+		state.secretLen = 56;
+	else
+		return CKR_KEY_TYPE_INCONSISTENT;
+
+	return CKR_OK;
 }
+#endif
 
-// Internal: Unwrap blob using symmetric key
-CK_RV SoftHSM::UnwrapKeySym
+// Internal: Create the object of a derived secret key and store the key
+// material; the object is removed again if this fails
+CK_RV SoftHSM::DeriveKeyStore
 (
-	CK_MECHANISM_PTR pMechanism,
-	ByteString& wrapped,
+	CK_SESSION_HANDLE hSession,
+	OSObject* baseKey,
 	Token* token,
-	OSObject* unwrapKey,
-	ByteString& keydata
+	CK_ATTRIBUTE_PTR secretAttribs,
+	CK_ULONG secretAttribsCount,
+	CK_KEY_TYPE keyType,
+	CK_BBOOL isPrivate,
+	bool checkValue,
+	ByteString& secretValue,
+	CK_OBJECT_HANDLE& hKey
 )
 {
-	// Get the symmetric algorithm matching the mechanism
-	SymAlgo::Type algo = SymAlgo::Unknown;
-	SymWrap::Type mode = SymWrap::Unknown;
-	size_t bb = 8;
-	switch(pMechanism->mechanism) {
-#ifdef HAVE_AES_KEY_WRAP
-		case CKM_AES_KEY_WRAP:
-			algo = SymAlgo::AES;
-			mode = SymWrap::AES_KEYWRAP;
-			break;
-#endif
-#ifdef HAVE_AES_KEY_WRAP_PAD
-		case CKM_AES_KEY_WRAP_PAD:
-			algo = SymAlgo::AES;
-			mode = SymWrap::AES_KEYWRAP_PAD;
-			break;
-#endif
-		default:
-			return CKR_MECHANISM_INVALID;
-	}
-	SymmetricAlgorithm* cipher = CryptoFactory::i()->getSymmetricAlgorithm(algo);
-	if (cipher == NULL) return CKR_MECHANISM_INVALID;
+	hKey = CK_INVALID_HANDLE;
+
+	// Create the secret object using C_CreateObject
+	CK_RV rv = this->CreateObject(hSession, secretAttribs, secretAttribsCount, &hKey, OBJECT_OP_DERIVE);
+
+	// Store the attributes that are being supplied
+	if (rv == CKR_OK)
+	{
+		OSObject* osobject = (OSObject*)handleManager->getObject(hKey);
+		if (osobject == NULL_PTR || !osobject->isValid())
+		{
+			rv = CKR_FUNCTION_FAILED;
+		}
+		else if (osobject->startTransaction())
+		{
+			bool bOK = true;
+
+			// Common Attributes
+			bOK = bOK && osobject->setAttribute(CKA_LOCAL, false);
+
+			// Common Secret Key Attributes
+			if (baseKey->getBooleanValue(CKA_ALWAYS_SENSITIVE, false))
+			{
+				bool bAlwaysSensitive = osobject->getBooleanValue(CKA_SENSITIVE, false);
+				bOK = bOK && osobject->setAttribute(CKA_ALWAYS_SENSITIVE, bAlwaysSensitive);
+			}
+			else
+			{
+				bOK = bOK && osobject->setAttribute(CKA_ALWAYS_SENSITIVE, false);
+			}
+			if (baseKey->getBooleanValue(CKA_NEVER_EXTRACTABLE, true))
+			{
+				bool bNeverExtractable = osobject->getBooleanValue(CKA_EXTRACTABLE, false) == false;
+				bOK = bOK && osobject->setAttribute(CKA_NEVER_EXTRACTABLE, bNeverExtractable);
+			}
+			else
+			{
+				bOK = bOK && osobject->setAttribute(CKA_NEVER_EXTRACTABLE, false);
+			}
+
+			// Get the KCV
+			ByteString plainKCV;
+			if (keyType == CKK_AES)
+			{
+				AESKey secret(secretValue.size() * 8);
+				secret.setKeyBits(secretValue);
+				plainKCV = secret.getKeyCheckValue();
+			}
+			else
+			{
+				SymmetricKey secret(secretValue.size() * 8);
+				secret.setKeyBits(secretValue);
+				plainKCV = secret.getKeyCheckValue();
+			}
+
+			// Secret Attributes
+			ByteString value;
+			ByteString kcv;
+			if (isPrivate)
+			{
+				token->encrypt(secretValue, value);
+				token->encrypt(plainKCV, kcv);
+			}
+			else
+			{
+				value = secretValue;
+				kcv = plainKCV;
+			}
+			bOK = bOK && osobject->setAttribute(CKA_VALUE, value);
+			if (checkValue)
+				bOK = bOK && osobject->setAttribute(CKA_CHECK_VALUE, kcv);
 
-	SymmetricKey* unwrappingkey = new SymmetricKey();
+			if (bOK)
+				bOK = osobject->commitTransaction();
+			else
+				osobject->abortTransaction();
 
-	if (getSymmetricKey(unwrappingkey, token, unwrapKey) != CKR_OK)
-	{
-		cipher->recycleKey(unwrappingkey);
-		CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
-		return CKR_GENERAL_ERROR;
+			if (!bOK)
+				rv = CKR_FUNCTION_FAILED;
+		}
+		else
+		{
+			rv = CKR_FUNCTION_FAILED;
+		}
 	}
 
-	// adjust key bit length
-	unwrappingkey->setBitLen(unwrappingkey->getKeyBits().size() * bb);
+	// Remove the secret that may have been created already
+	if (rv != CKR_OK && hKey != CK_INVALID_HANDLE)
+	{
+		OSObject* ossecret = (OSObject*)handleManager->getObject(hKey);
+		handleManager->destroyObject(hKey);
+		if (ossecret) ossecret->destroyObject();
+		hKey = CK_INVALID_HANDLE;
+	}
 
-	// Unwrap the key
-	CK_RV rv = CKR_OK;
-	if (!cipher->unwrapKey(unwrappingkey, mode, wrapped, keydata))
-		rv = CKR_GENERAL_ERROR;
-	cipher->recycleKey(unwrappingkey);
-	CryptoFactory::i()->recycleSymmetricAlgorithm(cipher);
 	return rv;
 }
 
-// Internal: Unwrap blob using asymmetric key
-CK_RV SoftHSM::UnwrapKeyAsym
+// Internal: Create the MAC and cipher keys of both sides of a TLS 1.2
+// connection from the key block and return the IVs; all or nothing
+CK_RV SoftHSM::DeriveTlsKeyMaterial
 (
-	CK_MECHANISM_PTR pMechanism,
-	ByteString& wrapped,
+	CK_SESSION_HANDLE hSession,
+	OSObject* baseKey,
 	Token* token,
-	OSObject* unwrapKey,
-	ByteString& keydata
+	CK_MECHANISM_PTR pMechanism,
+	DeriveBatchState& state,
+	CK_ATTRIBUTE_PTR secretAttribs,
+	CK_ULONG secretAttribsCount,
+	CK_KEY_TYPE keyType,
+	CK_BBOOL isOnToken,
+	CK_BBOOL isPrivate,
+	bool checkValue,
+	CK_OBJECT_HANDLE& hClientKey
 )
 {
-	// Get the symmetric algorithm matching the mechanism
-	AsymAlgo::Type algo = AsymAlgo::Unknown;
-	AsymMech::Type mode = AsymMech::Unknown;
-	switch(pMechanism->mechanism) {
-		case CKM_RSA_PKCS:
-			algo = AsymAlgo::RSA;
-			mode = AsymMech::RSA_PKCS;
-			break;
+	CK_TLS12_KEY_MAT_PARAMS_PTR params = (CK_TLS12_KEY_MAT_PARAMS_PTR) pMechanism->pParameter;
+	size_t macLen = params->ulMacSizeInBits / 8;
+	size_t keyLen = params->ulKeySizeInBits / 8;
+	size_t ivLen = params->ulIVSizeInBits / 8;
 
-		case CKM_RSA_PKCS_OAEP:
-			algo = AsymAlgo::RSA;
-			mode = AsymMech::RSA_PKCS_OAEP;
-			break;
+	hClientKey = CK_INVALID_HANDLE;
 
-		default:
-			return CKR_MECHANISM_INVALID;
-	}
-	AsymmetricAlgorithm* cipher = CryptoFactory::i()->getAsymmetricAlgorithm(algo);
-	if (cipher == NULL) return CKR_MECHANISM_INVALID;
+	size_t maxLen = state.getMaxLength();
+	if (macLen > maxLen || keyLen > maxLen || ivLen > maxLen ||
+	    2 * (macLen + keyLen + ivLen) > maxLen)
+		return CKR_MECHANISM_PARAM_INVALID;
 
-	PrivateKey* unwrappingkey = cipher->newPrivateKey();
-	if (unwrappingkey == NULL)
+	CK_SSL3_KEY_MAT_OUT_PTR pOut = params->pReturnedKeyMaterial;
+	if (pOut == NULL_PTR) return CKR_MECHANISM_PARAM_INVALID;
+	if (!validate_user_check_ptr(pOut, sizeof(CK_SSL3_KEY_MAT_OUT)))
+		return CKR_DEVICE_MEMORY;
+
+	CK_SSL3_KEY_MAT_OUT l_out;
+	memcpy_s(&l_out, sizeof(CK_SSL3_KEY_MAT_OUT), pOut, sizeof(CK_SSL3_KEY_MAT_OUT));
+
+	if (ivLen > 0)
 	{
-		CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
-		return CKR_HOST_MEMORY;
+		if (l_out.pIVClient == NULL_PTR || l_out.pIVServer == NULL_PTR)
+			return CKR_MECHANISM_PARAM_INVALID;
+
+		if (!validate_user_check_ptr(l_out.pIVClient, ivLen) ||
+		    !validate_user_check_ptr(l_out.pIVServer, ivLen))
+			return CKR_DEVICE_MEMORY;
 	}
 
-	switch(pMechanism->mechanism) {
-		case CKM_RSA_PKCS:
-		case CKM_RSA_PKCS_OAEP:
-			if (getRSAPrivateKey((RSAPrivateKey*)unwrappingkey, token, unwrapKey) != CKR_OK)
-			{
-				cipher->recyclePrivateKey(unwrappingkey);
-				CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
-				return CKR_GENERAL_ERROR;
-			}
-			break;
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
 
-		default:
-			return CKR_MECHANISM_INVALID;
+	// client_write_MAC_key || server_write_MAC_key || client_write_key ||
+	// server_write_key || client_write_IV || server_write_IV
+	ByteString keyBlock;
+	if (!state.derive(ByteString(), 2 * (macLen + keyLen + ivLen), keyBlock))
+		return CKR_GENERAL_ERROR;
+
+	// The MAC keys are generic secrets for signing and verification; their
+	// sensitivity follows the template
+	CK_OBJECT_CLASS objClass = CKO_SECRET_KEY;
+	CK_KEY_TYPE macKeyType = CKK_GENERIC_SECRET;
+	CK_BBOOL bTrue = CK_TRUE;
+	CK_ATTRIBUTE macAttribs[9] = {
+		{ CKA_CLASS, &objClass, sizeof(objClass) },
+		{ CKA_TOKEN, &isOnToken, sizeof(isOnToken) },
+		{ CKA_PRIVATE, &isPrivate, sizeof(isPrivate) },
+		{ CKA_KEY_TYPE, &macKeyType, sizeof(macKeyType) },
+		{ CKA_SIGN, &bTrue, sizeof(bTrue) },
+		{ CKA_VERIFY, &bTrue, sizeof(bTrue) },
+		{ CKA_DERIVE, &bTrue, sizeof(bTrue) }
+	};
+	CK_ULONG macAttribsCount = 7;
+	for (CK_ULONG i = 0; i < secretAttribsCount && macAttribsCount < 9; i++)
+	{
+		if (secretAttribs[i].type == CKA_SENSITIVE || secretAttribs[i].type == CKA_EXTRACTABLE)
+			macAttribs[macAttribsCount++] = secretAttribs[i];
 	}
 
-	// Unwrap the key
+	// Client MAC key, server MAC key, client key, server key
+	CK_OBJECT_HANDLE handles[4] = { CK_INVALID_HANDLE, CK_INVALID_HANDLE, CK_INVALID_HANDLE, CK_INVALID_HANDLE };
+	size_t offset = 0;
 	CK_RV rv = CKR_OK;
-	if (!cipher->unwrapKey(unwrappingkey, wrapped, keydata, mode))
-		rv = CKR_GENERAL_ERROR;
-	cipher->recyclePrivateKey(unwrappingkey);
-	CryptoFactory::i()->recycleAsymmetricAlgorithm(cipher);
-	return rv;
-}
+	for (int i = 0; i < 4 && rv == CKR_OK; i++)
+	{
+		bool isMacKey = i < 2;
+		size_t len = isMacKey ? macLen : keyLen;
+		if (len == 0) continue;
 
-// Unwrap the specified key using the specified unwrapping key
-CK_RV SoftHSM::C_UnwrapKey
-(
-	CK_SESSION_HANDLE hSession,
-	CK_MECHANISM_PTR pMechanism,
-	CK_OBJECT_HANDLE hUnwrappingKey,
-	CK_BYTE_PTR pWrappedKey,
-	CK_ULONG ulWrappedKeyLen,
-	CK_ATTRIBUTE_PTR pTemplate,
-	CK_ULONG ulCount,
-	CK_OBJECT_HANDLE_PTR hKey
-)
-{
-    CK_OBJECT_HANDLE lhKey;
-    auto l_hKey = &lhKey;
+		ByteString secretValue = keyBlock.substr(offset, len);
+		offset += len;
 
-	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+		if (isMacKey)
+			rv = DeriveKeyStore(hSession, baseKey, token, macAttribs, macAttribsCount, macKeyType, isPrivate, true, secretValue, handles[i]);
+		else
+			rv = DeriveKeyStore(hSession, baseKey, token, secretAttribs, secretAttribsCount, keyType, isPrivate, checkValue, secretValue, handles[i]);
+	}
 
-	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
-	if (pWrappedKey == NULL_PTR) return CKR_ARGUMENTS_BAD;
-	if (pTemplate == NULL_PTR) return CKR_ARGUMENTS_BAD;
-	if (hKey == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (rv != CKR_OK)
+	{
+		// Remove the keys that have been created already
+		for (int i = 0; i < 4; i++)
+		{
+			if (handles[i] == CK_INVALID_HANDLE) continue;
 
-    if (!validate_user_check_ptr(pWrappedKey, ulWrappedKeyLen))
-    {
-        return CKR_DEVICE_MEMORY;
-    }
+			OSObject* ossecret = (OSObject*)handleManager->getObject(handles[i]);
+			handleManager->destroyObject(handles[i]);
+			if (ossecret) ossecret->destroyObject();
+		}
 
-    if (ulCount > CKA_MAX_ATTRIBUTES)
-    {
-        return CKR_ARGUMENTS_BAD;
-    }
+		return rv;
+	}
 
-	if (!validate_user_check_attribute_ptr(pTemplate, ulCount))
+	if (ivLen > 0)
 	{
-		return CKR_DEVICE_MEMORY;
+		memcpy_s(l_out.pIVClient, ivLen, keyBlock.const_byte_str() + offset, ivLen);
+		memcpy_s(l_out.pIVServer, ivLen, keyBlock.const_byte_str() + offset + ivLen, ivLen);
 	}
 
-    if (!validate_user_check_ptr(hKey, sizeof(CK_ULONG)))
-    {
-        return CKR_DEVICE_MEMORY;
-    }
-
-    CK_ATTRIBUTE l_template[ulCount];
-    memcpy_s(l_template, ulCount * sizeof(CK_ATTRIBUTE), pTemplate, ulCount * sizeof(CK_ATTRIBUTE));
+	pOut->hClientMacSecret = handles[0];
+	pOut->hServerMacSecret = handles[1];
+	pOut->hClientKey = handles[2];
+	pOut->hServerKey = handles[3];
 
-    std::vector<std::vector<CK_BYTE>> value(ulCount);
+	hClientKey = handles[2];
 
-    for (CK_ULONG i = 0; i < ulCount; i++)
-    {
-        if (l_template[i].pValue == nullptr)
-        {
-            continue;
-        }
+	return CKR_OK;
+}
 
-        auto ulValueLen = l_template[i].ulValueLen;
-        if (!validate_user_check_ptr(l_template[i].pValue, ulValueLen))
-        {
-            return CKR_DEVICE_MEMORY;
-        }
+// Derive a batch of keys from one base key; a failed key does not stop the
+// batch
+CK_RV SoftHSM::C_DeriveKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hBaseKey, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulAttributeCount, CK_DERIVE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
 
-        value[i].resize(ulValueLen);
-        memcpy_s(value[i].data(), ulValueLen, l_template[i].pValue, ulValueLen);
-        l_template[i].pValue = value[i].data();
-    }
+	if (pMechanism == NULL_PTR) return CKR_ARGUMENTS_BAD;
+	if (pItems == NULL_PTR || ulCount == 0 || ulCount > CKM_MAX_MESSAGE_BATCH) return CKR_ARGUMENTS_BAD;
+	if (pTemplate == NULL_PTR && ulAttributeCount != 0) return CKR_ARGUMENTS_BAD;
+	if (ulAttributeCount > CKA_MAX_ATTRIBUTES) return CKR_ARGUMENTS_BAD;
 
-    auto l_pTemplate = l_template;
+	if (!validate_user_check_ptr(pItems, ulCount * sizeof(CK_DERIVE_BATCH_ITEM)))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
 
 	if (!validate_user_check_mechanism_ptr(pMechanism, 1))
 	{
 		return CKR_DEVICE_MEMORY;
 	}
 
-    CK_MECHANISM l_mechanism;
-    memcpy_s(&l_mechanism, sizeof(CK_MECHANISM), pMechanism, sizeof(CK_MECHANISM));
+	if (pTemplate != NULL_PTR && !validate_user_check_attribute_ptr(pTemplate, ulAttributeCount))
+	{
+		return CKR_DEVICE_MEMORY;
+	}
 
-    auto ulParameterLen = l_mechanism.ulParameterLen;
+	CK_MECHANISM l_mechanism;
+	memcpy_s(&l_mechanism, sizeof(CK_MECHANISM), pMechanism, sizeof(CK_MECHANISM));
 
-    if (ulParameterLen > CKM_MAX_PARAMETER_LEN)
-    {
-        return CKR_ARGUMENTS_BAD;
-    }
+	auto ulParameterLen = l_mechanism.ulParameterLen;
 
-    CK_BYTE parameter[ulParameterLen];
-    if (l_mechanism.pParameter != nullptr)
-    {
-        if (!validate_user_check_ptr(l_mechanism.pParameter, ulParameterLen))
-        {
-            return CKR_DEVICE_MEMORY;
-        }
+	if (ulParameterLen > CKM_MAX_PARAMETER_LEN)
+	{
+		return CKR_ARGUMENTS_BAD;
+	}
 
-        memcpy_s(&parameter[0], ulParameterLen, l_mechanism.pParameter, ulParameterLen);
-        l_mechanism.pParameter = &parameter[0];
-    }
-    auto l_pMechanism = &l_mechanism;
+	CK_BYTE parameter[ulParameterLen];
+	if (l_mechanism.pParameter != nullptr)
+	{
+		if (!validate_user_check_ptr(l_mechanism.pParameter, ulParameterLen))
+		{
+			return CKR_DEVICE_MEMORY;
+		}
 
-#ifdef ENABLE_MITIGATION
-    __builtin_ia32_lfence();
-#endif
+		memcpy_s(&parameter[0], ulParameterLen, l_mechanism.pParameter, ulParameterLen);
+		l_mechanism.pParameter = &parameter[0];
+	}
 
-	// Get the session
-	Session* session = (Session*)handleManager->getSession(hSession);
-	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+	// Work on a copy of the template and its values
+	std::vector<CK_ATTRIBUTE> l_template(ulAttributeCount);
+	std::vector<std::vector<CK_BYTE>> value(ulAttributeCount);
+	if (ulAttributeCount > 0)
+	{
+		memcpy_s(l_template.data(), ulAttributeCount * sizeof(CK_ATTRIBUTE), pTemplate, ulAttributeCount * sizeof(CK_ATTRIBUTE));
+	}
 
-	CK_RV rv;
-	// Check the mechanism
-	switch(l_pMechanism->mechanism)
+	for (CK_ULONG i = 0; i < ulAttributeCount; i++)
 	{
-        case CKM_AES_CTR:
-#ifdef WITH_AES_GCM		
-        case CKM_AES_GCM:
-#endif
-        case CKM_AES_CBC:
-        case CKM_AES_CBC_PAD: 
-            break;
-#ifdef HAVE_AES_KEY_WRAP
-		case CKM_AES_KEY_WRAP:
-			if ((ulWrappedKeyLen < 24) || ((ulWrappedKeyLen % 8) != 0))
-				return CKR_WRAPPED_KEY_LEN_RANGE;
-			// Does not handle optional init vector
-			if (l_pMechanism->pParameter != NULL_PTR ||
-                l_pMechanism->ulParameterLen != 0)
-				return CKR_ARGUMENTS_BAD;
-			break;
-#endif
-#ifdef HAVE_AES_KEY_WRAP_PAD
-		case CKM_AES_KEY_WRAP_PAD:
-			if ((ulWrappedKeyLen < 16) || ((ulWrappedKeyLen % 8) != 0))
-				return CKR_WRAPPED_KEY_LEN_RANGE;
-			// Does not handle optional init vector
-			if (l_pMechanism->pParameter != NULL_PTR ||
-                l_pMechanism->ulParameterLen != 0)
-				return CKR_ARGUMENTS_BAD;
-			break;
-#endif
-		case CKM_RSA_PKCS:
-			// Input length checks needs to be done later when unwrapping key is known
-			break;
-		case CKM_RSA_PKCS_OAEP:
-			rv = MechParamCheckRSAPKCSOAEP(l_pMechanism);
-			if (rv != CKR_OK)
-				return rv;
-			break;
+		if (l_template[i].pValue == nullptr)
+		{
+			continue;
+		}
+
+		auto ulValueLen = l_template[i].ulValueLen;
+		if (!validate_user_check_ptr(l_template[i].pValue, ulValueLen))
+		{
+			return CKR_DEVICE_MEMORY;
+		}
 
-		default:
-			return CKR_MECHANISM_INVALID;
+		value[i].resize(ulValueLen);
+		memcpy_s(value[i].data(), ulValueLen, l_template[i].pValue, ulValueLen);
+		l_template[i].pValue = value[i].data();
 	}
 
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	// Get the session
+	Session* session = (Session*)handleManager->getSession(hSession);
+	if (session == NULL) return CKR_SESSION_HANDLE_INVALID;
+
 	// Get the token
 	Token* token = session->getToken();
 	if (token == NULL) return CKR_GENERAL_ERROR;
 
-	// Check the unwrapping key handle.
-	OSObject *unwrapKey = (OSObject *)handleManager->getObject(hUnwrappingKey);
-	if (unwrapKey == NULL_PTR || !unwrapKey->isValid()) return CKR_UNWRAPPING_KEY_HANDLE_INVALID;
+	// Check the base key handle
+	OSObject *baseKey = (OSObject *)handleManager->getObject(hBaseKey);
+	if (baseKey == NULL_PTR || !baseKey->isValid()) return CKR_KEY_HANDLE_INVALID;
 
-	CK_BBOOL isUnwrapKeyOnToken = unwrapKey->getBooleanValue(CKA_TOKEN, false);
-	CK_BBOOL isUnwrapKeyPrivate = unwrapKey->getBooleanValue(CKA_PRIVATE, true);
+	CK_BBOOL isBaseKeyOnToken = baseKey->getBooleanValue(CKA_TOKEN, false);
+	CK_BBOOL isBaseKeyPrivate = baseKey->getBooleanValue(CKA_PRIVATE, true);
 
-	// Check user credentials
-	rv = haveRead(session->getState(), isUnwrapKeyOnToken, isUnwrapKeyPrivate);
-	if (rv != CKR_OK)
+	// Check user credentials for the base key
+	CK_RV rv = haveRead(session->getState(), isBaseKeyOnToken, isBaseKeyPrivate);
+	if (rv != CKR_OK) return rv;
+
+	// Check the base key class and type
+	CK_OBJECT_CLASS baseKeyClass = baseKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED);
+	CK_KEY_TYPE baseKeyType = baseKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED);
+	if (l_mechanism.mechanism == CKM_ECDH1_DERIVE)
 	{
-		if (rv == CKR_USER_NOT_LOGGED_IN)
+		// The X25519 and X448 keys of CKM_EC_EDWARDS_KEY_PAIR_GEN
+		if (baseKeyClass != CKO_PRIVATE_KEY || baseKeyType != CKK_EC_EDWARDS)
+			return CKR_KEY_TYPE_INCONSISTENT;
+	}
+	else if (baseKeyClass != CKO_SECRET_KEY)
+	{
+		return CKR_KEY_TYPE_INCONSISTENT;
+	}
+	else
+	{
+		switch (baseKeyType)
 		{
-			// INFO_MSG("User is not authorized");
+			case CKK_GENERIC_SECRET:
+			case CKK_AES:
+			// The secret keys that C_CreateObject makes for HMAC
+			case CKK_SHA256_HMAC:
+			case CKK_SHA384_HMAC:
+			case CKK_SHA512_HMAC:
+				break;
+			default:
+				return CKR_KEY_TYPE_INCONSISTENT;
 		}
-
-		return rv;
 	}
 
-	// Check unwrapping key class and type
-	if ((l_pMechanism->mechanism == CKM_AES_KEY_WRAP || l_pMechanism->mechanism == CKM_AES_KEY_WRAP_PAD) && unwrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) != CKO_SECRET_KEY)
-		return CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_AES_KEY_WRAP && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
-		return CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_AES_KEY_WRAP_PAD && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
-		return CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
-	if ((l_pMechanism->mechanism == CKM_RSA_PKCS || l_pMechanism->mechanism == CKM_RSA_PKCS_OAEP) && unwrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) != CKO_PRIVATE_KEY)
-		return CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
-	if ((l_pMechanism->mechanism == CKM_RSA_PKCS || l_pMechanism->mechanism == CKM_RSA_PKCS_OAEP) && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_RSA)
-		return CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_AES_CTR && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
-		return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_AES_GCM && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
-		return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_AES_CBC && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
-		return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
-	if (l_pMechanism->mechanism == CKM_AES_CBC_PAD && unwrapKey->getUnsignedLongValue(CKA_KEY_TYPE, CKK_VENDOR_DEFINED) != CKK_AES)
-		return CKR_WRAPPING_KEY_TYPE_INCONSISTENT;
-
-	// Check if the unwrapping key can be used for unwrapping
-	if (unwrapKey->getBooleanValue(CKA_UNWRAP, false) == false)
+	// Check if the base key can be used for derivation
+	if (baseKey->getBooleanValue(CKA_DERIVE, false) == false)
 		return CKR_KEY_FUNCTION_NOT_PERMITTED;
 
-	// Check if the specified mechanism is allowed for the unwrap key
-	if (!isMechanismPermitted(unwrapKey, l_pMechanism))
+	// Check if the specified mechanism is allowed for the base key
+	if (!isMechanismPermitted(baseKey, &l_mechanism))
 		return CKR_MECHANISM_INVALID;
 
-	// Extract information from the template that is needed to create the object.
-	CK_OBJECT_CLASS objClass;
-	CK_KEY_TYPE keyType;
+	// Key material may only leave the enclave if the base key could
+	bool rawAllowed = baseKey->getBooleanValue(CKA_EXTRACTABLE, false) &&
+	                  !baseKey->getBooleanValue(CKA_SENSITIVE, true);
+
+	// Extract the key template
+	CK_OBJECT_CLASS objClass = CKO_SECRET_KEY;
+	CK_KEY_TYPE keyType = CKK_VENDOR_DEFINED;
 	CK_BBOOL isOnToken = CK_FALSE;
 	CK_BBOOL isPrivate = CK_TRUE;
-	CK_CERTIFICATE_TYPE dummy;
-	bool isImplicit = false;
-	rv = extractObjectInformation(l_pTemplate, ulCount, objClass, keyType, dummy, isOnToken, isPrivate, isImplicit);
-	if (rv != CKR_OK)
+	size_t byteLen = 0;
+	bool haveValueLen = false;
+	bool checkValue = true;
+	for (CK_ULONG i = 0; i < ulAttributeCount; i++)
 	{
-		// ERROR_MSG("Mandatory attribute not present in template");
-		return rv;
+		switch (l_template[i].type)
+		{
+			case CKA_CLASS:
+				if (l_template[i].pValue == NULL_PTR || l_template[i].ulValueLen != sizeof(CK_OBJECT_CLASS) ||
+				    *(CK_OBJECT_CLASS*)l_template[i].pValue != CKO_SECRET_KEY)
+					return CKR_TEMPLATE_INCONSISTENT;
+				break;
+			case CKA_KEY_TYPE:
+				if (l_template[i].pValue == NULL_PTR || l_template[i].ulValueLen != sizeof(CK_KEY_TYPE))
+					return CKR_ATTRIBUTE_VALUE_INVALID;
+				keyType = *(CK_KEY_TYPE*)l_template[i].pValue;
+				break;
+			case CKA_TOKEN:
+				if (l_template[i].pValue == NULL_PTR || l_template[i].ulValueLen != sizeof(CK_BBOOL))
+					return CKR_ATTRIBUTE_VALUE_INVALID;
+				isOnToken = *(CK_BBOOL*)l_template[i].pValue;
+				break;
+			case CKA_PRIVATE:
+				if (l_template[i].pValue == NULL_PTR || l_template[i].ulValueLen != sizeof(CK_BBOOL))
+					return CKR_ATTRIBUTE_VALUE_INVALID;
+				isPrivate = *(CK_BBOOL*)l_template[i].pValue;
+				break;
+			case CKA_VALUE:
+				return CKR_ATTRIBUTE_READ_ONLY;
+			case CKA_VALUE_LEN:
+				if (l_template[i].pValue == NULL_PTR || l_template[i].ulValueLen != sizeof(CK_ULONG))
+					return CKR_ATTRIBUTE_VALUE_INVALID;
+				byteLen = *(CK_ULONG*)l_template[i].pValue;
+				haveValueLen = true;
+				break;
+			case CKA_CHECK_VALUE:
+				if (l_template[i].ulValueLen > 0)
+					return CKR_ATTRIBUTE_VALUE_INVALID;
+				checkValue = false;
+				break;
+			default:
+				break;
+		}
 	}
 
-	// Report errors and/or unexpected usage.
-	if (objClass != CKO_SECRET_KEY && objClass != CKO_PRIVATE_KEY)
-		return CKR_ATTRIBUTE_VALUE_INVALID;
-	// Key type will be handled at object creation
+	// Set up the PRF and its key once for the whole batch
+	DeriveBatchState state;
+	rv = DeriveBatchSetup(token, baseKey, &l_mechanism, state);
+	if (rv != CKR_OK) return rv;
 
-	// Check authorization
-	rv = haveWrite(session->getState(), isOnToken, isPrivate);
-	if (rv != CKR_OK)
+	// The TLS key derivations fix the length of the keys
+	if (state.keyLen > 0)
 	{
-		if (rv == CKR_USER_NOT_LOGGED_IN)
-		{
-			// INFO_MSG("User is not authorized");
-		}
-		if (rv == CKR_SESSION_READ_ONLY)
-		{
-			// INFO_MSG("Session is read-only");
-		}
+		if (haveValueLen && byteLen != state.keyLen)
+			return CKR_TEMPLATE_INCONSISTENT;
+		byteLen = state.keyLen;
 
-		return rv;
+		// A master secret is a generic secret
+		if (keyType == CKK_VENDOR_DEFINED && l_mechanism.mechanism == CKM_TLS12_MASTER_KEY_DERIVE)
+			keyType = CKK_GENERIC_SECRET;
 	}
 
-	// Build unwrapped key template
+	// Check the length
+	CK_RV templateRv = CKR_OK;
+	switch (keyType)
+	{
+		case CKK_GENERIC_SECRET:
+			if (byteLen == 0)
+				templateRv = CKR_TEMPLATE_INCOMPLETE;
+			break;
+		case CKK_AES:
+			if (byteLen != 16 && byteLen != 24 && byteLen != 32)
+				templateRv = CKR_ATTRIBUTE_VALUE_INVALID;
+			break;
+		case CKK_VENDOR_DEFINED:
+			// Only raw key material can be derived without a template
+			templateRv = CKR_TEMPLATE_INCOMPLETE;
+			break;
+		default:
+			return CKR_ATTRIBUTE_VALUE_INVALID;
+	}
+	if (templateRv == CKR_ATTRIBUTE_VALUE_INVALID) return templateRv;
+
+	// Build the template of the derived keys
 	const CK_ULONG maxAttribs = 32;
 	CK_ATTRIBUTE secretAttribs[maxAttribs] = {
 		{ CKA_CLASS, &objClass, sizeof(objClass) },
 		{ CKA_TOKEN, &isOnToken, sizeof(isOnToken) },
 		{ CKA_PRIVATE, &isPrivate, sizeof(isPrivate) },
-		{ CKA_KEY_TYPE, &keyType, sizeof(keyType) }
+		{ CKA_KEY_TYPE, &keyType, sizeof(keyType) },
 	};
 	CK_ULONG secretAttribsCount = 4;
 
-	// Add the additional
-	if (ulCount > (maxAttribs - secretAttribsCount))
-		return CKR_TEMPLATE_INCONSISTENT;
-	for (CK_ULONG i = 0; i < ulCount; ++i)
+	for (CK_ULONG i = 0; i < ulAttributeCount; i++)
 	{
-		switch (l_pTemplate[i].type)
+		switch (l_template[i].type)
 		{
 			case CKA_CLASS:
 			case CKA_TOKEN:
 			case CKA_PRIVATE:
 			case CKA_KEY_TYPE:
+			case CKA_CHECK_VALUE:
 				continue;
 			default:
-				secretAttribs[secretAttribsCount++] = l_pTemplate[i];
-		}
-	}
-
-	// Apply the unwrap template
-	if (unwrapKey->attributeExists(CKA_UNWRAP_TEMPLATE))
-	{
-		OSAttribute unwrapAttr = unwrapKey->getAttribute(CKA_UNWRAP_TEMPLATE);
-
-		if (unwrapAttr.isAttributeMapAttribute())
-		{
-			typedef std::map<CK_ATTRIBUTE_TYPE,OSAttribute> attrmap_type;
-
-			const attrmap_type& map = unwrapAttr.getAttributeMapValue();
-
-			for (attrmap_type::const_iterator it = map.begin(); it != map.end(); ++it)
-			{
-				CK_ATTRIBUTE* attr = NULL;
-				for (CK_ULONG i = 0; i < secretAttribsCount; ++i)
-				{
-					if (it->first == secretAttribs[i].type)
-					{
-						if (attr != NULL)
-						{
-							return CKR_TEMPLATE_INCONSISTENT;
-						}
-						attr = &secretAttribs[i];
-						ByteString value;
-						it->second.peekValue(value);
-						if (attr->ulValueLen != value.size())
-						{
-							return CKR_TEMPLATE_INCONSISTENT;
-						}
-						if (memcmp(attr->pValue, value.const_byte_str(), value.size()) != 0)
-						{
-							return CKR_TEMPLATE_INCONSISTENT;
-						}
-					}
-				}
-				if (attr == NULL)
-				{
+				if (secretAttribsCount == maxAttribs)
 					return CKR_TEMPLATE_INCONSISTENT;
-				}
-			}
+				secretAttribs[secretAttribsCount++] = l_template[i];
 		}
 	}
 
-	lhKey = CK_INVALID_HANDLE;
-
-	// Unwrap the key
-	ByteString keydata;
-    if (unwrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) == CKO_SECRET_KEY &&
-        (l_pMechanism->mechanism  == CKM_AES_CTR    ||
-         l_pMechanism->mechanism  == CKM_AES_GCM    ||
-         l_pMechanism->mechanism  == CKM_AES_CBC    ||
-         l_pMechanism->mechanism  == CKM_AES_CBC_PAD))
-    
-    {
-        rv = SoftHSM::SymDecryptInit(hSession, l_pMechanism, hUnwrappingKey);
-        if (rv != CKR_OK)
-        {
-            return rv;
-        }
-
-        CK_ULONG ulDataLen = 0;
-        rv = SymDecrypt(session, pWrappedKey, ulWrappedKeyLen, NULL_PTR, &ulDataLen);
-        if (rv != CKR_OK)
-        {
-            return rv;
-        }
-
-        keydata.resize(ulDataLen);
-        rv = SymDecrypt(session, pWrappedKey, ulWrappedKeyLen, keydata.byte_str(), &ulDataLen);
-        if (rv != CKR_OK)
-        {
-            return rv;
-        }
-
-        keydata.resize(ulDataLen);
-    }
-    else
-    {
-        ByteString wrapped(pWrappedKey, ulWrappedKeyLen);
-        if (unwrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) == CKO_SECRET_KEY)
-        {	 
-            rv = UnwrapKeySym(l_pMechanism, wrapped, token, unwrapKey, keydata);
-        }
-        else if (unwrapKey->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) == CKO_PRIVATE_KEY)
-        {
-            rv = UnwrapKeyAsym(l_pMechanism, wrapped, token, unwrapKey, keydata);
-#if defined (DCAP_SUPPORT) && defined (EPHEMERAL_QUOTE)
-            // If the key is used for quote generation should be used for only one unwrap operation
-            // Destroying the key from session
-            CK_BBOOL isUsedForQuoteGeneration = unwrapKey->getBooleanValue(CKA_USED_FOR_QUOTE_GENERATION, false);
-
-            if (isUsedForQuoteGeneration)
-            {
-                // get public key and destroying both keys
-                CK_OBJECT_HANDLE publicKeyHandle = getRSAPairKey(hSession, hUnwrappingKey);
-                if (CK_INVALID_HANDLE == publicKeyHandle)
-                {
-                    return CKR_KEY_HANDLE_INVALID;
-                }
-
-                // destroying public key
-                OSObject* obj = (OSObject*)handleManager->getObject(publicKeyHandle);
-                if (obj)
-                {
-                    obj->destroyObject();
-                }
-                handleManager->destroyObject(publicKeyHandle);
-                publicKeyHandle = CK_INVALID_HANDLE;
-
-                // destroying private key
-                handleManager->destroyObject(hUnwrappingKey);
-                unwrapKey->destroyObject();
-                hUnwrappingKey = CK_INVALID_HANDLE;
-            }
-#endif
-        }
-        else
-        {
-            rv = CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT;
-        }
-    }
-
-	if (rv != CKR_OK)
-    {
+	if (templateRv == CKR_OK && byteLen > state.getMaxLength())
+		templateRv = CKR_ATTRIBUTE_VALUE_INVALID;
+
+	if (l_mechanism.mechanism == CKM_TLS12_KEY_AND_MAC_DERIVE)
+	{
+		// The whole key block belongs to one item
+		CK_DERIVE_BATCH_ITEM item;
+		memcpy_s(&item, sizeof(CK_DERIVE_BATCH_ITEM), &pItems[0], sizeof(CK_DERIVE_BATCH_ITEM));
+		if (ulCount != 1 || item.ulDataLen != 0 || item.pValue != NULL_PTR)
+			return CKR_ARGUMENTS_BAD;
+
+		// The cipher keys need a template
+		if (state.keyLen > 0 && templateRv != CKR_OK) return templateRv;
+
+		CK_OBJECT_HANDLE hClientKey = CK_INVALID_HANDLE;
+		if (!token->startBatch()) return CKR_FUNCTION_FAILED;
+		rv = DeriveTlsKeyMaterial(hSession, baseKey, token, &l_mechanism, state, secretAttribs, secretAttribsCount, keyType, isOnToken, isPrivate, checkValue, hClientKey);
+		if (!token->commitBatch() && rv == CKR_OK) rv = CKR_FUNCTION_FAILED;
+
+		pItems[0].hKey = hClientKey;
+		pItems[0].rv = rv;
+
 		return rv;
-    }
+	}
 
-	// Create the secret object using C_CreateObject
-	rv = this->CreateObject(hSession, secretAttribs, secretAttribsCount, l_hKey, OBJECT_OP_UNWRAP);
+	CK_RV batchRv = CKR_OK;
 
-	// Store the attributes that are being supplied
-	if (rv == CKR_OK)
+	// Create all objects in one object store batch
+	if (!token->startBatch()) return CKR_FUNCTION_FAILED;
+
+	for (CK_ULONG i = 0; i < ulCount; i++)
 	{
-		OSObject* osobject = (OSObject*)handleManager->getObject(lhKey);
-		if (osobject == NULL_PTR || !osobject->isValid())
-        {
-            return CKR_FUNCTION_FAILED;
-        }
-		if (osobject->startTransaction())
-		{
-			bool bOK = true;
+		// Work on a copy so the application cannot change the item meanwhile
+		CK_DERIVE_BATCH_ITEM item;
+		memcpy_s(&item, sizeof(CK_DERIVE_BATCH_ITEM), &pItems[i], sizeof(CK_DERIVE_BATCH_ITEM));
 
-			// Common Attributes
-			bOK = bOK && osobject->setAttribute(CKA_LOCAL, false);
+		CK_OBJECT_HANDLE hKey = CK_INVALID_HANDLE;
+		ByteString data;
+		ByteString secretValue;
+		rv = CKR_OK;
 
-			// Common Secret Key Attributes
-			bOK = bOK && osobject->setAttribute(CKA_ALWAYS_SENSITIVE, false);
-			bOK = bOK && osobject->setAttribute(CKA_NEVER_EXTRACTABLE, false);
+		if ((item.pData == NULL_PTR && item.ulDataLen != 0) ||
+		    item.ulDataLen > CKM_MAX_CRYPTO_OP_INPUT_LEN)
+		{
+			rv = CKR_ARGUMENTS_BAD;
+		}
+		else if (item.ulDataLen > 0 && !validate_user_check_ptr(item.pData, item.ulDataLen))
+		{
+			rv = CKR_DEVICE_MEMORY;
+		}
+		else if (item.ulDataLen > 0)
+		{
+			data = ByteString(item.pData, item.ulDataLen);
+		}
 
-			// Secret Attributes
-			if (objClass == CKO_SECRET_KEY)
-			{
-				ByteString value;
-				if (isPrivate)
-					token->encrypt(keydata, value);
-				else
-					value = keydata;
-				bOK = bOK && osobject->setAttribute(CKA_VALUE, value);
-			}
-			else if (keyType == CKK_RSA)
-			{
-				bOK = bOK && setRSAPrivateKey(osobject, keydata, token, isPrivate != CK_FALSE);
-			}
-#if 0 // Unsupported by Crypto API Toolkit
-			else if (keyType == CKK_DSA)
-			{
-				bOK = bOK && setDSAPrivateKey(osobject, keydata, token, isPrivate != CK_FALSE);
-			}
-			else if (keyType == CKK_DH)
-			{
-				bOK = bOK && setDHPrivateKey(osobject, keydata, token, isPrivate != CK_FALSE);
-			}
-#endif // Unsupported by Crypto API Toolkit
-#ifdef WITH_ECC
-			else if (keyType == CKK_EC)
-			{
-				bOK = bOK && setECPrivateKey(osobject, keydata, token, isPrivate != CK_FALSE);
-			}
-#endif
-#if 0 // Unsupported by Crypto API Toolkit
-#ifdef WITH_GOST
-			else if (keyType == CKK_GOSTR3410)
-			{
-				bOK = bOK && setGOSTPrivateKey(osobject, keydata, token, isPrivate != CK_FALSE);
-			}
+#ifdef ENABLE_MITIGATION
+		__builtin_ia32_lfence();
 #endif
-#endif // Unsupported by Crypto API Toolkit
-			else
-				bOK = false;
 
-			if (bOK)
-            {
-				bOK = osobject->commitTransaction();
-            }
+		if (rv != CKR_OK)
+		{
+			// The item is invalid
+		}
+		else if (item.pValue != NULL_PTR)
+		{
+			// Return the key material. The 12 bytes of Finished verify data
+			// of any master secret are no key material
+			if (!rawAllowed && !(state.finishedLabel && item.ulValueLen == TLS_VERIFY_DATA_LEN))
+				rv = CKR_KEY_FUNCTION_NOT_PERMITTED;
+			else if (item.ulValueLen == 0 || item.ulValueLen > state.getMaxLength() ||
+			         (state.keyLen > 0 && item.ulValueLen != state.keyLen))
+				rv = CKR_ARGUMENTS_BAD;
+			else if (!validate_user_check_ptr(item.pValue, item.ulValueLen))
+				rv = CKR_DEVICE_MEMORY;
+			else if (!state.derive(data, item.ulValueLen, secretValue))
+				rv = CKR_GENERAL_ERROR;
 			else
-            {
-				osobject->abortTransaction();
-            }
-
-			if (!bOK)
-            {
-				rv = CKR_FUNCTION_FAILED;
-            }
+				memcpy_s(item.pValue, item.ulValueLen, secretValue.const_byte_str(), secretValue.size());
+		}
+		else if (templateRv != CKR_OK)
+		{
+			rv = templateRv;
+		}
+		else if (!state.derive(data, byteLen, secretValue))
+		{
+			rv = CKR_GENERAL_ERROR;
 		}
 		else
-        {
-			rv = CKR_FUNCTION_FAILED;
-        }
-	}
-
-	// Remove secret that may have been created already when the function fails.
-	if (rv != CKR_OK)
-	{
-		if (lhKey != CK_INVALID_HANDLE)
 		{
-			OSObject* obj = (OSObject*)handleManager->getObject(lhKey);
-			handleManager->destroyObject(lhKey);
-			if (obj) obj->destroyObject();
-			lhKey = CK_INVALID_HANDLE;
+			rv = DeriveKeyStore(hSession, baseKey, token, secretAttribs, secretAttribsCount, keyType, isPrivate, checkValue, secretValue, hKey);
 		}
+
+		pItems[i].hKey = hKey;
+		pItems[i].rv = rv;
+
+		if (rv != CKR_OK && batchRv == CKR_OK) batchRv = rv;
 	}
 
-    *hKey = lhKey;
+	if (!token->commitBatch() && batchRv == CKR_OK) batchRv = CKR_FUNCTION_FAILED;
 
-	return rv;
+	return batchRv;
 }
 
 // Derive a key from the specified base key
@@ -9529,6 +13025,30 @@ CK_RV SoftHSM::C_GenerateRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pRandomD
 	return CKR_OK;
 }
 
+// Refill the precomputation pools of the crypto backend. The pools are also
+// refilled by a background thread once they run low; this fills them ahead of
+// time, for instance at startup, and whenever no spare TCS is left for the
+// background thread
+CK_RV SoftHSM::C_PrecomputePools(CK_ULONG ulMaxCount, CK_ULONG_PTR pulCount)
+{
+	if (!isInitialised) return CKR_CRYPTOKI_NOT_INITIALIZED;
+
+	if (pulCount == NULL_PTR) return CKR_ARGUMENTS_BAD;
+
+    if (!validate_user_check_ptr(pulCount, sizeof(CK_ULONG)))
+    {
+        return CKR_DEVICE_MEMORY;
+    }
+
+#ifdef ENABLE_MITIGATION
+    __builtin_ia32_lfence();
+#endif
+
+	*pulCount = CryptoFactory::i()->precompute(ulMaxCount);
+
+	return CKR_OK;
+}
+
 #if 0 // Unsupported by Crypto API Toolkit
 // Legacy function
 CK_RV SoftHSM::C_GetFunctionStatus(CK_SESSION_HANDLE hSession)
@@ -10440,7 +13960,8 @@ CK_RV SoftHSM::generateRSA
 	CK_BBOOL isPublicKeyOnToken,
 	CK_BBOOL isPublicKeyPrivate,
 	CK_BBOOL isPrivateKeyOnToken,
-	CK_BBOOL isPrivateKeyPrivate
+	CK_BBOOL isPrivateKeyPrivate,
+	CK_ULONG ulPrimes
 )
 {
 	*phPublicKey = CK_INVALID_HANDLE;
@@ -10489,6 +14010,7 @@ CK_RV SoftHSM::generateRSA
 	RSAParameters p;
 	p.setE(exponent);
 	p.setBitLength(bitLen);
+	p.setPrimes(ulPrimes);
 
 	// Generate key pair
 	AsymmetricKeyPair* kp = NULL;
@@ -10645,6 +14167,7 @@ CK_RV SoftHSM::generateRSA
 				ByteString exponent1;
 				ByteString exponent2;
 				ByteString coefficient;
+				ByteString otherPrimes;
 				if (isPrivateKeyPrivate)
 				{
 					token->encrypt(priv->getN(), modulus);
@@ -10655,6 +14178,8 @@ CK_RV SoftHSM::generateRSA
 					token->encrypt(priv->getDP1(), exponent1);
 					token->encrypt(priv->getDQ1(), exponent2);
 					token->encrypt(priv->getPQ(), coefficient);
+					if (priv->getOtherPrimes().size() > 0)
+						token->encrypt(priv->getOtherPrimes(), otherPrimes);
 				}
 				else
 				{
@@ -10666,6 +14191,7 @@ CK_RV SoftHSM::generateRSA
 					exponent1 =  priv->getDP1();
 					exponent2 = priv->getDQ1();
 					coefficient = priv->getPQ();
+					otherPrimes = priv->getOtherPrimes();
 				}
 				bOK = bOK && osobject->setAttribute(CKA_MODULUS, modulus);
 				bOK = bOK && osobject->setAttribute(CKA_PUBLIC_EXPONENT, publicExponent);
@@ -10675,6 +14201,8 @@ CK_RV SoftHSM::generateRSA
 				bOK = bOK && osobject->setAttribute(CKA_EXPONENT_1,exponent1);
 				bOK = bOK && osobject->setAttribute(CKA_EXPONENT_2, exponent2);
 				bOK = bOK && osobject->setAttribute(CKA_COEFFICIENT, coefficient);
+				if (otherPrimes.size() > 0)
+					bOK = bOK && osobject->setAttribute(CKA_OS_RSA_OTHERPRIMES, otherPrimes);
 
 				if (bOK)
 					bOK = osobject->commitTransaction();
@@ -13990,6 +17518,8 @@ CK_RV SoftHSM::getRSAPrivateKey(RSAPrivateKey* privateKey, Token* token, OSObjec
 	ByteString exponent1;
 	ByteString exponent2;
 	ByteString coefficient;
+	ByteString otherPrimes;
+	bool isMultiPrime = key->attributeExists(CKA_OS_RSA_OTHERPRIMES);
 	if (isKeyPrivate)
 	{
 		bool bOK = true;
@@ -14001,6 +17531,8 @@ CK_RV SoftHSM::getRSAPrivateKey(RSAPrivateKey* privateKey, Token* token, OSObjec
 		bOK = bOK && token->decrypt(key->getByteStringValue(CKA_EXPONENT_1), exponent1);
 		bOK = bOK && token->decrypt(key->getByteStringValue(CKA_EXPONENT_2), exponent2);
 		bOK = bOK && token->decrypt(key->getByteStringValue(CKA_COEFFICIENT), coefficient);
+		if (isMultiPrime)
+			bOK = bOK && token->decrypt(key->getByteStringValue(CKA_OS_RSA_OTHERPRIMES), otherPrimes);
 		if (!bOK)
 			return CKR_GENERAL_ERROR;
 	}
@@ -14014,6 +17546,8 @@ CK_RV SoftHSM::getRSAPrivateKey(RSAPrivateKey* privateKey, Token* token, OSObjec
 		exponent1 =  key->getByteStringValue(CKA_EXPONENT_1);
 		exponent2 = key->getByteStringValue(CKA_EXPONENT_2);
 		coefficient = key->getByteStringValue(CKA_COEFFICIENT);
+		if (isMultiPrime)
+			otherPrimes = key->getByteStringValue(CKA_OS_RSA_OTHERPRIMES);
 	}
 
 	privateKey->setN(modulus);
@@ -14024,6 +17558,7 @@ CK_RV SoftHSM::getRSAPrivateKey(RSAPrivateKey* privateKey, Token* token, OSObjec
 	privateKey->setDP1(exponent1);
 	privateKey->setDQ1(exponent2);
 	privateKey->setPQ(coefficient);
+	privateKey->setOtherPrimes(otherPrimes);
 
 	return CKR_OK;
 }
@@ -14519,6 +18054,7 @@ bool SoftHSM::setRSAPrivateKey(OSObject* key, const ByteString &ber, Token* toke
 	ByteString exponent1;
 	ByteString exponent2;
 	ByteString coefficient;
+	ByteString otherPrimes;
 	if (isPrivate)
 	{
 		token->encrypt(((RSAPrivateKey*)priv)->getN(), modulus);
@@ -14529,6 +18065,8 @@ bool SoftHSM::setRSAPrivateKey(OSObject* key, const ByteString &ber, Token* toke
 		token->encrypt(((RSAPrivateKey*)priv)->getDP1(), exponent1);
 		token->encrypt(((RSAPrivateKey*)priv)->getDQ1(), exponent2);
 		token->encrypt(((RSAPrivateKey*)priv)->getPQ(), coefficient);
+		if (((RSAPrivateKey*)priv)->getOtherPrimes().size() > 0)
+			token->encrypt(((RSAPrivateKey*)priv)->getOtherPrimes(), otherPrimes);
 	}
 	else
 	{
@@ -14540,6 +18078,7 @@ bool SoftHSM::setRSAPrivateKey(OSObject* key, const ByteString &ber, Token* toke
 		exponent1 =  ((RSAPrivateKey*)priv)->getDP1();
 		exponent2 = ((RSAPrivateKey*)priv)->getDQ1();
 		coefficient = ((RSAPrivateKey*)priv)->getPQ();
+		otherPrimes = ((RSAPrivateKey*)priv)->getOtherPrimes();
 	}
 	bool bOK = true;
 	bOK = bOK && key->setAttribute(CKA_MODULUS, modulus);
@@ -14550,6 +18089,8 @@ bool SoftHSM::setRSAPrivateKey(OSObject* key, const ByteString &ber, Token* toke
 	bOK = bOK && key->setAttribute(CKA_EXPONENT_1,exponent1);
 	bOK = bOK && key->setAttribute(CKA_EXPONENT_2, exponent2);
 	bOK = bOK && key->setAttribute(CKA_COEFFICIENT, coefficient);
+	if (otherPrimes.size() > 0)
+		bOK = bOK && key->setAttribute(CKA_OS_RSA_OTHERPRIMES, otherPrimes);
 
 	rsa->recyclePrivateKey(priv);
 	CryptoFactory::i()->recycleAsymmetricAlgorithm(rsa);
@@ -15367,6 +18908,114 @@ CK_BBOOL SoftHSM::isPrivateObject(const CK_ATTRIBUTE_PTR pTemplate,
 }
 #endif
 
+// Match an object against the template of a find operation
+static CK_RV matchFindTemplate(Token* token, OSObject* object, bool isPublicSession,
+                               CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount,
+                               const std::map<CK_ATTRIBUTE_TYPE, ByteString>& blindMACs,
+                               bool& bAttrMatch)
+{
+    bAttrMatch = false;
+
+    // Refresh object and check if it is valid
+    if (!object->isValid()) {
+        // DEBUG_MSG("Object is not valid, skipping");
+        return CKR_OK;
+    }
+
+    // Determine if the object has CKA_PRIVATE set to CK_TRUE
+    bool isPrivateObject = object->getBooleanValue(CKA_PRIVATE, true);
+
+    // If the object is private, and we are in a public session then skip it !
+    if (isPublicSession && isPrivateObject)
+        return CKR_OK; // skip object
+
+    // Perform the actual attribute matching.
+    bAttrMatch = true; // We let an empty template match everything.
+    for (CK_ULONG i=0; i<ulCount; ++i)
+    {
+        bAttrMatch = false;
+
+        // The blind indexes are internal to the object store
+        if (ObjectIndex::isBlindIndex(pTemplate[i].type))
+            break;
+
+        if (!object->attributeExists(pTemplate[i].type))
+            break;
+
+        OSAttribute attr = object->getAttribute(pTemplate[i].type);
+
+        if (attr.isBooleanAttribute())
+        {
+            if (sizeof(CK_BBOOL) != pTemplate[i].ulValueLen)
+                break;
+            bool bTemplateValue = (*(CK_BBOOL*)pTemplate[i].pValue == CK_TRUE);
+            if (attr.getBooleanValue() != bTemplateValue)
+                break;
+        }
+        else
+        {
+            if (attr.isUnsignedLongAttribute())
+            {
+                if (sizeof(CK_ULONG) != pTemplate[i].ulValueLen)
+                    break;
+                CK_ULONG ulTemplateValue = *(CK_ULONG_PTR)pTemplate[i].pValue;
+                if (attr.getUnsignedLongValue() != ulTemplateValue)
+                    break;
+            }
+            else
+            {
+                if (attr.isByteStringAttribute())
+                {
+                    ByteString bsAttrValue;
+                    if (isPrivateObject && attr.getByteStringValue().size() != 0)
+                    {
+                        // Compare the blind index if the object has a current one
+                        CK_ATTRIBUTE_TYPE blindType;
+                        std::map<CK_ATTRIBUTE_TYPE, ByteString>::const_iterator mac = blindMACs.find(pTemplate[i].type);
+                        if (mac != blindMACs.end() &&
+                            ObjectIndex::getBlindIndexType(pTemplate[i].type, blindType) &&
+                            object->attributeExists(blindType))
+                        {
+                            ByteString bsBlindMAC;
+                            if (ObjectIndex::getBlindIndexMAC(object->getByteStringValue(blindType), attr.getByteStringValue(), bsBlindMAC))
+                            {
+                                if (bsBlindMAC != mac->second)
+                                    break;
+                                bAttrMatch = true;
+                                continue;
+                            }
+                        }
+
+                        // Objects are given their blind indexes when they
+                        // are written or at login; a search does not write
+                        if (!token->decrypt(attr.getByteStringValue(), bsAttrValue))
+                        {
+                            return CKR_GENERAL_ERROR;
+                        }
+                    }
+                    else
+                        bsAttrValue = attr.getByteStringValue();
+
+                    if (bsAttrValue.size() != pTemplate[i].ulValueLen)
+                        break;
+                    if (pTemplate[i].ulValueLen != 0)
+                    {
+                        ByteString bsTemplateValue((const unsigned char*)pTemplate[i].pValue, pTemplate[i].ulValueLen);
+                        if (bsAttrValue != bsTemplateValue)
+                            break;
+                    }
+                }
+                else
+                    break;
+            }
+        }
+        // The attribute matched !
+        bAttrMatch = true;
+    }
+
+    return CKR_OK;
+}
+
 CK_RV SoftHSM::FindObjectsInit(const CK_SESSION_HANDLE& hSession,
                                const CK_ATTRIBUTE_PTR pTemplate,
                                const CK_ULONG& ulCount)
@@ -15405,112 +19054,48 @@ CK_RV SoftHSM::FindObjectsInit(const CK_SESSION_HANDLE& hSession,
     // Check if we are out of memory
     if (findOp == NULL_PTR) return CKR_HOST_MEMORY;
 
-    std::set<OSObject*> allObjects;
-    token->getObjects(allObjects);
-    sessionObjectStore->getObjects(slot->getSlotID(),allObjects);
-
-    std::set<CK_OBJECT_HANDLE> handles;
-    std::set<OSObject*>::iterator it;
-    for (it=allObjects.begin(); it != allObjects.end(); ++it)
+    // Compute the blind index MACs of the template byte strings, so the
+    // encrypted values of private objects can be matched without decrypting
+    // them; without the MACs, private objects cannot be found by the index
+    std::map<CK_ATTRIBUTE_TYPE, ByteString> blindMACs;
+    bool haveBlindMACs = !isPublicSession;
+    for (CK_ULONG i=0; haveBlindMACs && i<ulCount; ++i)
     {
-        // Refresh object and check if it is valid
-        if (!(*it)->isValid()) {
-            // DEBUG_MSG("Object is not valid, skipping");
+        CK_ATTRIBUTE_TYPE blindType;
+        if (!ObjectIndex::getBlindIndexType(pTemplate[i].type, blindType) ||
+            (pTemplate[i].pValue == NULL_PTR && pTemplate[i].ulValueLen != 0))
             continue;
-        }
-
-        // Determine if the object has CKA_PRIVATE set to CK_TRUE
-        bool isPrivateObject = (*it)->getBooleanValue(CKA_PRIVATE, true);
-
-        // If the object is private, and we are in a public session then skip it !
-        if (isPublicSession && isPrivateObject)
-            continue; // skip object
-
-        // Perform the actual attribute matching.
-        bool bAttrMatch = true; // We let an empty template match everything.
-        for (CK_ULONG i=0; i<ulCount; ++i)
-        {
-            bAttrMatch = false;
-
-            if (!(*it)->attributeExists(pTemplate[i].type))
-                break;
-
-            OSAttribute attr = (*it)->getAttribute(pTemplate[i].type);
-
-            if (attr.isBooleanAttribute())
-            {
-                if (sizeof(CK_BBOOL) != pTemplate[i].ulValueLen)
-                    break;
-                bool bTemplateValue = (*(CK_BBOOL*)pTemplate[i].pValue == CK_TRUE);
-                if (attr.getBooleanValue() != bTemplateValue)
-                    break;
-            }
-            else
-            {
-                if (attr.isUnsignedLongAttribute())
-                {
-                    if (sizeof(CK_ULONG) != pTemplate[i].ulValueLen)
-                        break;
-                    CK_ULONG ulTemplateValue = *(CK_ULONG_PTR)pTemplate[i].pValue;
-                    if (attr.getUnsignedLongValue() != ulTemplateValue)
-                        break;
-                }
-                else
-                {
-                    if (attr.isByteStringAttribute())
-                    {
-                        ByteString bsAttrValue;
-                        if (isPrivateObject && attr.getByteStringValue().size() != 0)
-                        {
-                            if (!token->decrypt(attr.getByteStringValue(), bsAttrValue))
-                            {
-                                delete findOp;
-                                return CKR_GENERAL_ERROR;
-                            }
-                        }
-                        else
-                            bsAttrValue = attr.getByteStringValue();
 
-                        if (bsAttrValue.size() != pTemplate[i].ulValueLen)
-                            break;
-                        if (pTemplate[i].ulValueLen != 0)
-                        {
-                            ByteString bsTemplateValue((const unsigned char*)pTemplate[i].pValue, pTemplate[i].ulValueLen);
-                            if (bsAttrValue != bsTemplateValue)
-                                break;
-                        }
-                    }
-                    else
-                        break;
-                }
-            }
-            // The attribute matched !
-            bAttrMatch = true;
-        }
+        ByteString mac;
+        haveBlindMACs = token->blindIndexMAC(pTemplate[i].type,
+                                             ByteString((const unsigned char*)pTemplate[i].pValue, pTemplate[i].ulValueLen),
+                                             mac);
+        blindMACs[pTemplate[i].type] = mac;
+    }
+    if (!haveBlindMACs) blindMACs.clear();
 
-        if (bAttrMatch)
-        {
-            CK_SLOT_ID slotID = slot->getSlotID();
-            bool isOnToken = (*it)->getBooleanValue(CKA_TOKEN, false);
-            bool isPrivate = (*it)->getBooleanValue(CKA_PRIVATE, true);
-            // Create an object handle for every returned object.
-            CK_OBJECT_HANDLE hObject;
-            if (isOnToken)
-                hObject = handleManager->addTokenObject(slotID,isPrivate,*it);
-            else
-                hObject = handleManager->addSessionObject(slotID,hSession,isPrivate,*it);
-            if (hObject == CK_INVALID_HANDLE)
-            {
-                delete findOp;
-                return CKR_GENERAL_ERROR;
-            }
-            handles.insert(hObject);
-        }
+    // Narrow down the objects by the attribute indexes where possible; the
+    // candidates are matched against the full template by FindObjects
+    std::set<OSObject*> allObjects;
+    if (isPublicSession || haveBlindMACs)
+    {
+        if (!token->findObjects(pTemplate, ulCount, allObjects, &blindMACs))
+            token->getObjects(allObjects);
+        if (!sessionObjectStore->findObjects(slot->getSlotID(), pTemplate, ulCount, allObjects, &blindMACs))
+            sessionObjectStore->getObjects(slot->getSlotID(),allObjects);
+    }
+    else
+    {
+        token->getObjects(allObjects);
+        sessionObjectStore->getObjects(slot->getSlotID(),allObjects);
     }
 
-    // Storing the object handles for the find will protect the library
-    // whenever a stale object handle is used to access the library.
-    findOp->setHandles(handles);
+    // The find operation is a cursor over the candidates; matching them and
+    // creating their object handles is left to FindObjects, so a caller that
+    // only reads the first results does not pay for the others
+    findOp->setTemplate(pTemplate, ulCount);
+    findOp->setBlindMACs(blindMACs);
+    findOp->setCandidates(allObjects);
 
     session->setFindOp(findOp);
 
@@ -15529,15 +19114,63 @@ CK_RV SoftHSM::FindObjects(const CK_SESSION_HANDLE hSession,
     // Check if we are doing the correct operation
     if (session->getOpType() != SESSION_OP_FIND) return CKR_OPERATION_NOT_INITIALIZED;
 
-    // return the object handles that have been added to the find operation.
     FindOperation *findOp = session->getFindOp();
     if (findOp == NULL) return CKR_GENERAL_ERROR;
 
-    // Ask the find operation to retrieve the object handles
-    *pulObjectCount = findOp->retrieveHandles(phObject,ulMaxObjectCount);
+    // Get the slot
+    Slot* slot = session->getSlot();
+    if (slot == NULL_PTR) return CKR_GENERAL_ERROR;
+
+    // Get the token
+    Token* token = session->getToken();
+    if (token == NULL_PTR) return CKR_GENERAL_ERROR;
+
+    // The login state may have changed since the search was started
+    bool isPublicSession;
+    switch (session->getState()) {
+        case CKS_RO_USER_FUNCTIONS:
+        case CKS_RW_USER_FUNCTIONS:
+            isPublicSession = false;
+            break;
+        default:
+            isPublicSession = true;
+    }
+
+    // Advance the cursor until enough matching objects have been found
+    CK_SLOT_ID slotID = slot->getSlotID();
+    CK_ULONG ulObjectCount = 0;
+    OSObject* object;
+    while (ulObjectCount < ulMaxObjectCount && (object = findOp->nextCandidate()) != NULL)
+    {
+        bool bAttrMatch;
+        CK_RV rv = matchFindTemplate(token, object, isPublicSession,
+                                     findOp->getTemplate(), findOp->getTemplateCount(),
+                                     findOp->getBlindMACs(), bAttrMatch);
+        if (rv != CKR_OK)
+        {
+            *pulObjectCount = ulObjectCount;
+            return rv;
+        }
+
+        if (!bAttrMatch) continue;
+
+        bool isOnToken = object->getBooleanValue(CKA_TOKEN, false);
+        bool isPrivate = object->getBooleanValue(CKA_PRIVATE, true);
+        // Create an object handle for every returned object.
+        CK_OBJECT_HANDLE hObject;
+        if (isOnToken)
+            hObject = handleManager->addTokenObject(slotID,isPrivate,object);
+        else
+            hObject = handleManager->addSessionObject(slotID,hSession,isPrivate,object);
+        if (hObject == CK_INVALID_HANDLE)
+        {
+            *pulObjectCount = ulObjectCount;
+            return CKR_GENERAL_ERROR;
+        }
+        phObject[ulObjectCount++] = hObject;
+    }
 
-    // Erase the object handles from the find operation.
-    findOp->eraseHandles(0,*pulObjectCount);
+    *pulObjectCount = ulObjectCount;
 
     return CKR_OK;
 }
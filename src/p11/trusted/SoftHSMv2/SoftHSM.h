@@ -95,6 +95,7 @@
 #include "QuoteGeneration.h"
 #endif
 #include "QuoteGenerationDefs.h"
+#include "VendorDefs.h"
 #include <memory>
 
 /* limiting the maximum for attribute template count */
@@ -106,6 +107,9 @@
 /* limiting the maximum length for the buffers passed on for crypto operations to 50MB */
 #define CKM_MAX_CRYPTO_OP_INPUT_LEN     0x3200000
 
+/* limiting the maximum number of messages in one message batch */
+#define CKM_MAX_MESSAGE_BATCH           0x400
+
 /* limiting the maximum number of slots */
 #define MAX_SLOTS 0x1000
 
@@ -115,6 +119,24 @@
 /* limiting the maximum number of object count */
 #define MAX_OBJECT_COUNT 0x80000000UL
 
+/* limiting the number of attributes of an unwrapped key */
+#define MAX_UNWRAP_ATTRIBUTES 32
+
+/* the length of the TLS 1.2 Finished verify data */
+#define TLS_VERIFY_DATA_LEN 12
+
+// The algorithms and public keys used by one C_VerifyBatch call
+struct VerifyBatchState;
+
+// The wrapping or unwrapping key of one C_WrapKeyBatch/C_UnwrapKeyBatch call
+struct WrapBatchState;
+
+// One unwrapped key of a C_UnwrapKeyBatch call
+struct UnwrapBatchKey;
+
+// The key derivation of one C_DeriveKeyBatch call
+struct DeriveBatchState;
+
 class SoftHSM
 {
 public:
@@ -168,21 +190,37 @@ public:
 	CK_RV C_Decrypt(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedData, CK_ULONG ulEncryptedDataLen, CK_BYTE_PTR pData, CK_ULONG_PTR pulDataLen);
 	CK_RV C_DecryptUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedData, CK_ULONG ulEncryptedDataLen, CK_BYTE_PTR pData, CK_ULONG_PTR pDataLen);
 	CK_RV C_DecryptFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG_PTR pDataLen);
+	CK_RV C_MessageEncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+	CK_RV C_EncryptMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pAssociatedData, CK_ULONG ulAssociatedDataLen, CK_BYTE_PTR pPlaintext, CK_ULONG ulPlaintextLen, CK_BYTE_PTR pCiphertext, CK_ULONG_PTR pulCiphertextLen);
+	CK_RV C_EncryptMessageBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+	CK_RV C_MessageEncryptFinal(CK_SESSION_HANDLE hSession);
+	CK_RV C_MessageDecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+	CK_RV C_DecryptMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pAssociatedData, CK_ULONG ulAssociatedDataLen, CK_BYTE_PTR pCiphertext, CK_ULONG ulCiphertextLen, CK_BYTE_PTR pPlaintext, CK_ULONG_PTR pulPlaintextLen);
+	CK_RV C_DecryptMessageBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+	CK_RV C_MessageDecryptFinal(CK_SESSION_HANDLE hSession);
 	CK_RV C_DigestInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism);
 	CK_RV C_Digest(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pDigest, CK_ULONG_PTR pulDigestLen);
 	CK_RV C_DigestUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen);
 	CK_RV C_DigestKey(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject);
 	CK_RV C_DigestFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pDigest, CK_ULONG_PTR pulDigestLen);
+	CK_RV C_DigestBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_DIGEST_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
 	CK_RV C_SignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
 	CK_RV C_Sign(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen);
 	CK_RV C_SignUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen);
 	CK_RV C_SignFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen);
+	CK_RV C_MessageSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+	CK_RV C_SignMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen);
+	CK_RV C_MessageSignFinal(CK_SESSION_HANDLE hSession);
 	CK_RV C_SignRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
 	CK_RV C_SignRecover(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen);
 	CK_RV C_VerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
 	CK_RV C_Verify(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen);
 	CK_RV C_VerifyUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen);
 	CK_RV C_VerifyFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen);
+	CK_RV C_MessageVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+	CK_RV C_VerifyMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen);
+	CK_RV C_MessageVerifyFinal(CK_SESSION_HANDLE hSession);
+	CK_RV C_VerifyBatch(CK_SESSION_HANDLE hSession, CK_VERIFY_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
 	CK_RV C_VerifyRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
 	CK_RV C_VerifyRecover(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen, CK_BYTE_PTR pData, CK_ULONG_PTR pulDataLen);
 	CK_RV C_DigestEncryptUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen, CK_BYTE_PTR pEncryptedPart, CK_ULONG_PTR pulEncryptedPartLen);
@@ -221,6 +259,9 @@ public:
 		CK_ULONG ulCount,
 		CK_OBJECT_HANDLE_PTR hKey
 	);
+	CK_RV C_WrapKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hWrappingKey, CK_WRAP_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+	CK_RV C_UnwrapKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hUnwrappingKey, CK_UNWRAP_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+	CK_RV C_DeriveKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hBaseKey, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulAttributeCount, CK_DERIVE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
 	CK_RV C_DeriveKey
 	(
 		CK_SESSION_HANDLE hSession,
@@ -234,6 +275,7 @@ public:
 	CK_RV C_SeedRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSeed, CK_ULONG ulSeedLen);
 #endif // Unsupported by Crypto API Toolkit
     CK_RV C_GenerateRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pRandomData, CK_ULONG ulRandomLen);
+	CK_RV C_PrecomputePools(CK_ULONG ulMaxCount, CK_ULONG_PTR pulCount);
 #if 0 // Unsupported by Crypto API Toolkit
 	CK_RV C_GetFunctionStatus(CK_SESSION_HANDLE hSession);
 	CK_RV C_CancelFunction(CK_SESSION_HANDLE hSession);
@@ -262,12 +304,15 @@ private:
 	CK_RV AsymEncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
 	CK_RV SymDecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
 	CK_RV AsymDecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+	CK_RV MessageCryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey, bool isEncrypt);
+	CK_RV MessageCryptBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount, bool isEncrypt);
 
 	// Sign/Verify variants
 	CK_RV MacSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
 	CK_RV AsymSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
 	CK_RV MacVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
 	CK_RV AsymVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+	CK_RV VerifyBatchItem(Session* session, CK_VERIFY_BATCH_ITEM& item, VerifyBatchState& state);
 #ifdef SGXHSM
     CK_BBOOL isTemplateSetPrivateAttribute(const CK_ATTRIBUTE_PTR pTemplate,
                                            const CK_ULONG& ulCount);
@@ -342,7 +387,8 @@ private:
 		CK_BBOOL isPublicKeyOnToken,
 		CK_BBOOL isPublicKeyPrivate,
 		CK_BBOOL isPrivateKeyOnToken,
-		CK_BBOOL isPrivateKeyPrivate
+		CK_BBOOL isPrivateKeyPrivate,
+		CK_ULONG ulPrimes
 	);
 #if 0 // Unsupported by Crypto API Toolkit
 	CK_RV generateDSA
@@ -577,6 +623,79 @@ private:
 		ByteString &keydata
 	);
 
+	CK_RV WrapKeyData
+	(
+		Session* session,
+		Token* token,
+		OSObject* wrapKey,
+		CK_OBJECT_HANDLE hKey,
+		CK_MECHANISM_TYPE mechanism,
+		ByteString& keydata
+	);
+
+	CK_RV UnwrapKeyTemplate
+	(
+		Session* session,
+		OSObject* unwrapKey,
+		CK_ATTRIBUTE_PTR pTemplate,
+		CK_ULONG ulCount,
+		CK_OBJECT_CLASS& objClass,
+		CK_KEY_TYPE& keyType,
+		CK_BBOOL& isOnToken,
+		CK_BBOOL& isPrivate,
+		CK_ATTRIBUTE_PTR secretAttribs,
+		CK_ULONG& secretAttribsCount
+	);
+
+	CK_RV UnwrapKeyStore
+	(
+		CK_SESSION_HANDLE hSession,
+		Token* token,
+		CK_ATTRIBUTE_PTR secretAttribs,
+		CK_ULONG secretAttribsCount,
+		CK_OBJECT_CLASS objClass,
+		CK_KEY_TYPE keyType,
+		CK_BBOOL isPrivate,
+		ByteString& keydata,
+		CK_OBJECT_HANDLE& hKey
+	);
+
+	CK_RV WrapBatchSymKey(CK_MECHANISM_TYPE mechanism, Token* token, OSObject* key, WrapBatchState& state);
+	CK_RV UnwrapKeyBatchItem(Session* session, OSObject* unwrapKey, CK_MECHANISM_TYPE mechanism, WrapBatchState& state, const CK_UNWRAP_BATCH_ITEM& item, UnwrapBatchKey& key);
+
+	CK_RV DeriveBatchSetup(Token* token, OSObject* baseKey, CK_MECHANISM_PTR pMechanism, DeriveBatchState& state);
+#ifdef WITH_EDDSA
+	CK_RV DeriveBatchSetupEcdh(Token* token, OSObject* baseKey, DeriveBatchState& state);
+#endif
+	CK_RV DeriveKeyStore
+	(
+		CK_SESSION_HANDLE hSession,
+		OSObject* baseKey,
+		Token* token,
+		CK_ATTRIBUTE_PTR secretAttribs,
+		CK_ULONG secretAttribsCount,
+		CK_KEY_TYPE keyType,
+		CK_BBOOL isPrivate,
+		bool checkValue,
+		ByteString& secretValue,
+		CK_OBJECT_HANDLE& hKey
+	);
+	CK_RV DeriveTlsKeyMaterial
+	(
+		CK_SESSION_HANDLE hSession,
+		OSObject* baseKey,
+		Token* token,
+		CK_MECHANISM_PTR pMechanism,
+		DeriveBatchState& state,
+		CK_ATTRIBUTE_PTR secretAttribs,
+		CK_ULONG secretAttribsCount,
+		CK_KEY_TYPE keyType,
+		CK_BBOOL isOnToken,
+		CK_BBOOL isPrivate,
+		bool checkValue,
+		CK_OBJECT_HANDLE& hClientKey
+	);
+
 	CK_RV MechParamCheckRSAPKCSOAEP(CK_MECHANISM_PTR pMechanism);
 
 	static bool isMechanismPermitted(OSObject* key, CK_MECHANISM_PTR pMechanism);
@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*****************************************************************************
+VendorDefs.h
+
+ This file contains Crypto API Toolkit vendor specific definitions
+ *****************************************************************************/
+#ifndef _VENDORDEFS_H
+#define _VENDORDEFS_H
+
+// Crypto API Toolkit custom C_Initialize flags (CK_C_INITIALIZE_ARGS.flags)
+
+// Keep all token objects in enclave memory; nothing is written to the token
+// directory and all tokens are discarded on C_Finalize
+#define CKF_MEMORY_OBJECTSTORE 0x80000000UL
+
+// Crypto API Toolkit vendor mechanism parameters
+
+// Optional parameter of CKM_RSA_PKCS_KEY_PAIR_GEN; requests a multi-prime
+// RSA key (RFC 8017) with ulPrimes primes, from 2 to 4. Multi-prime keys
+// have cheaper private key operations and ordinary public keys.
+typedef struct CK_RSA_MULTI_PRIME_KEY_GEN_PARAMS {
+	CK_ULONG ulPrimes;
+} CK_RSA_MULTI_PRIME_KEY_GEN_PARAMS;
+
+typedef CK_RSA_MULTI_PRIME_KEY_GEN_PARAMS CK_PTR CK_RSA_MULTI_PRIME_KEY_GEN_PARAMS_PTR;
+
+// Segmented AES-GCM for large objects (the STREAM construction). The data is
+// cut into segments of ulSegmentSize bytes (at most 1 MiB), each sealed with
+// its own ulTagBits tag under the nonce pNoncePrefix (7 bytes) || segment
+// number (32-bit big endian) || last segment flag; the AAD is bound to every
+// segment. C_DecryptUpdate releases a segment once it is authenticated, and
+// C_DecryptFinal fails if the stream was truncated.
+#define CKM_AES_GCM_STREAM (CKM_VENDOR_DEFINED + 0x0000210FUL)
+
+typedef struct CK_AES_GCM_STREAM_PARAMS {
+	CK_BYTE_PTR pNoncePrefix;
+	CK_ULONG    ulNoncePrefixLen;
+	CK_BYTE_PTR pAAD;
+	CK_ULONG    ulAADLen;
+	CK_ULONG    ulSegmentSize;
+	CK_ULONG    ulTagBits;
+} CK_AES_GCM_STREAM_PARAMS;
+
+typedef CK_AES_GCM_STREAM_PARAMS CK_PTR CK_AES_GCM_STREAM_PARAMS_PTR;
+
+// PKCS #11 v3.0 message-based encryption definitions, missing from the
+// v2.40 headers
+
+#ifndef CKG_NO_GENERATE
+typedef CK_ULONG CK_GENERATOR_FUNCTION;
+
+#define CKG_NO_GENERATE			0x00000000UL
+#define CKG_GENERATE			0x00000001UL
+#define CKG_GENERATE_COUNTER		0x00000002UL
+#define CKG_GENERATE_RANDOM		0x00000003UL
+
+typedef struct CK_GCM_MESSAGE_PARAMS {
+	CK_BYTE_PTR           pIv;
+	CK_ULONG              ulIvLen;
+	CK_ULONG              ulIvFixedBits;
+	CK_GENERATOR_FUNCTION ivGenerator;
+	CK_BYTE_PTR           pTag;
+	CK_ULONG              ulTagBits;
+} CK_GCM_MESSAGE_PARAMS;
+
+typedef CK_GCM_MESSAGE_PARAMS CK_PTR CK_GCM_MESSAGE_PARAMS_PTR;
+#endif // !CKG_NO_GENERATE
+
+// One message of a C_EncryptMessageBatch/C_DecryptMessageBatch call.
+// pParameter points to the CK_GCM_MESSAGE_PARAMS of the message, pIn is the
+// plaintext (ciphertext) and pOut receives the ciphertext (plaintext).
+// ulOutLen is the size of pOut on input and the output length on return;
+// rv receives the result of the message
+typedef struct CK_MESSAGE_BATCH_ITEM {
+	CK_VOID_PTR pParameter;
+	CK_ULONG ulParameterLen;
+	CK_BYTE_PTR pAssociatedData;
+	CK_ULONG ulAssociatedDataLen;
+	CK_BYTE_PTR pIn;
+	CK_ULONG ulInLen;
+	CK_BYTE_PTR pOut;
+	CK_ULONG ulOutLen;
+	CK_RV rv;
+} CK_MESSAGE_BATCH_ITEM;
+
+typedef CK_MESSAGE_BATCH_ITEM CK_PTR CK_MESSAGE_BATCH_ITEM_PTR;
+
+// One record of a C_DigestBatch call. ulDigestLen is the size of pDigest on
+// input and the digest length on return; rv receives the result of the record
+typedef struct CK_DIGEST_BATCH_ITEM {
+	CK_BYTE_PTR pData;
+	CK_ULONG ulDataLen;
+	CK_BYTE_PTR pDigest;
+	CK_ULONG ulDigestLen;
+	CK_RV rv;
+} CK_DIGEST_BATCH_ITEM;
+
+typedef CK_DIGEST_BATCH_ITEM CK_PTR CK_DIGEST_BATCH_ITEM_PTR;
+
+// One signature of a C_VerifyBatch call. The mechanism takes no parameter;
+// rv receives the result of the signature
+typedef struct CK_VERIFY_BATCH_ITEM {
+	CK_OBJECT_HANDLE hKey;
+	CK_MECHANISM_TYPE mechanism;
+	CK_BYTE_PTR pData;
+	CK_ULONG ulDataLen;
+	CK_BYTE_PTR pSignature;
+	CK_ULONG ulSignatureLen;
+	CK_RV rv;
+} CK_VERIFY_BATCH_ITEM;
+
+typedef CK_VERIFY_BATCH_ITEM CK_PTR CK_VERIFY_BATCH_ITEM_PTR;
+
+// One key of a C_WrapKeyBatch call. ulWrappedKeyLen is the size of
+// pWrappedKey on input and the wrapped key length on return; rv receives the
+// result of the key
+typedef struct CK_WRAP_BATCH_ITEM {
+	CK_OBJECT_HANDLE hKey;
+	CK_BYTE_PTR pWrappedKey;
+	CK_ULONG ulWrappedKeyLen;
+	CK_RV rv;
+} CK_WRAP_BATCH_ITEM;
+
+typedef CK_WRAP_BATCH_ITEM CK_PTR CK_WRAP_BATCH_ITEM_PTR;
+
+// One key of a C_UnwrapKeyBatch call. hKey receives the handle of the
+// unwrapped key and rv the result of the key
+typedef struct CK_UNWRAP_BATCH_ITEM {
+	CK_BYTE_PTR pWrappedKey;
+	CK_ULONG ulWrappedKeyLen;
+	CK_ATTRIBUTE_PTR pTemplate;
+	CK_ULONG ulAttributeCount;
+	CK_OBJECT_HANDLE hKey;
+	CK_RV rv;
+} CK_UNWRAP_BATCH_ITEM;
+
+typedef CK_UNWRAP_BATCH_ITEM CK_PTR CK_UNWRAP_BATCH_ITEM_PTR;
+
+// PKCS #11 v3.0 key derivation definitions, missing from the v2.40 headers
+
+#ifndef CKM_HKDF_DERIVE
+#define CKM_SP800_108_COUNTER_KDF	0x000003ACUL
+#define CKM_SP800_108_FEEDBACK_KDF	0x000003ADUL
+#define CKM_HKDF_DERIVE			0x0000402AUL
+
+#define CKF_HKDF_SALT_NULL		0x00000001UL
+#define CKF_HKDF_SALT_DATA		0x00000002UL
+#define CKF_HKDF_SALT_KEY		0x00000004UL
+
+typedef struct CK_HKDF_PARAMS {
+	CK_BBOOL          bExtract;
+	CK_BBOOL          bExpand;
+	CK_MECHANISM_TYPE prfHashMechanism;
+	CK_ULONG          ulSaltType;
+	CK_BYTE_PTR       pSalt;
+	CK_ULONG          ulSaltLen;
+	CK_OBJECT_HANDLE  hSaltKey;
+	CK_BYTE_PTR       pInfo;
+	CK_ULONG          ulInfoLen;
+} CK_HKDF_PARAMS;
+
+typedef CK_HKDF_PARAMS CK_PTR CK_HKDF_PARAMS_PTR;
+#endif // !CKM_HKDF_DERIVE
+
+// The TLS 1.2 PRF of RFC 5246 with HMAC-SHA256 in a C_DeriveKeyBatch call.
+// CKM_TLS_PRF is the TLS 1.0/1.1 PRF (MD5 and SHA-1); this mechanism takes
+// the same CK_TLS_PRF_PARAMS, whose pOutput is not used
+#define CKM_TLS12_PRF_SHA256 (CKM_VENDOR_DEFINED + 0x00002110UL)
+
+// Parameter of CKM_SP800_108_COUNTER_KDF and CKM_SP800_108_FEEDBACK_KDF in a
+// C_DeriveKeyBatch call, in place of the data parameter list of v3.0. Block i
+// is the prfType HMAC of [K(i-1) ||] i as 32-bit big endian || the data of
+// the item; K(0) is pIV, which is only used in feedback mode
+typedef struct CK_SP800_108_BATCH_PARAMS {
+	CK_MECHANISM_TYPE prfType;
+	CK_BYTE_PTR       pIV;
+	CK_ULONG          ulIVLen;
+} CK_SP800_108_BATCH_PARAMS;
+
+typedef CK_SP800_108_BATCH_PARAMS CK_PTR CK_SP800_108_BATCH_PARAMS_PTR;
+
+// One key of a C_DeriveKeyBatch call. pData is the HKDF info (appended to
+// pInfo of CK_HKDF_PARAMS), the SP 800-108 fixed input, the
+// CKM_TLS12_PRF_SHA256 seed (appended to pSeed of CK_TLS_PRF_PARAMS), the
+// session hash of an extended master secret (RFC 7627) or the
+// CKM_ECDH1_DERIVE public key of the peer of the key. With a NULL pValue a key is created from the template of the
+// batch and hKey receives its handle; otherwise ulValueLen bytes of key
+// material are returned in pValue. rv receives the result of the key
+typedef struct CK_DERIVE_BATCH_ITEM {
+	CK_BYTE_PTR pData;
+	CK_ULONG ulDataLen;
+	CK_BYTE_PTR pValue;
+	CK_ULONG ulValueLen;
+	CK_OBJECT_HANDLE hKey;
+	CK_RV rv;
+} CK_DERIVE_BATCH_ITEM;
+
+typedef CK_DERIVE_BATCH_ITEM CK_PTR CK_DERIVE_BATCH_ITEM_PTR;
+
+// Crypto API Toolkit vendor functions (not part of CK_FUNCTION_LIST)
+
+// Refill the enclave precomputation pools with at most ulMaxCount entries;
+// meant to be called while the application is idle. The ECDSA nonce and EC key
+// pools are refilled in the background as well once they run low, as long as
+// the enclave has a spare TCS for it; RSA key pairs are only generated by this
+// call. The number of entries added is returned in pulCount
+CK_RV C_PrecomputePools(CK_ULONG ulMaxCount, CK_ULONG_PTR pulCount);
+
+// Digest up to 1024 records with one of the C_DigestInit mechanisms in one
+// call; the session needs no active digest operation. A failed record does
+// not stop the batch; the result of the first failed record is returned and
+// every item has its own rv. A NULL pDigest only returns the digest length
+CK_RV C_DigestBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_DIGEST_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
+// Verify up to 1024 signatures, each with its own public key and one of
+// CKM_RSA_PKCS, CKM_RSA_X_509, CKM_SHA*_RSA_PKCS, CKM_ECDSA or CKM_EDDSA, in
+// one call; the session needs no active verify operation. Public keys are
+// kept between calls. Every item has its own rv; the result of the first
+// failed signature is returned
+CK_RV C_VerifyBatch(CK_SESSION_HANDLE hSession, CK_VERIFY_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
+// Wrap up to 1024 keys with one CKM_AES_KEY_WRAP or CKM_AES_KEY_WRAP_PAD
+// wrapping key, which is set up once for the batch. A failed key does not
+// stop the batch; the result of the first failed key is returned and every
+// item has its own rv. A NULL pWrappedKey only returns the wrapped key length
+CK_RV C_WrapKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hWrappingKey, CK_WRAP_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
+// Unwrap up to 1024 keys with one CKM_AES_KEY_WRAP, CKM_AES_KEY_WRAP_PAD,
+// CKM_RSA_PKCS or CKM_RSA_PKCS_OAEP unwrapping key, which is set up once for
+// the batch. All keys are unwrapped and their templates checked before the
+// first key is created, so a bad blob or template creates no key. The keys
+// are then created in one object store batch, all or nothing: if a key
+// fails, its result is returned, the keys already created are dropped and
+// the other items get CKR_FUNCTION_CANCELED. A created key that cannot be
+// dropped again keeps its hKey and gets CKR_FUNCTION_FAILED.
+// With the log object store the token keys are written in one batch when the
+// last key has been created, and a failed batch is never written, so an
+// interruption leaves none or all of them on the token. With the file object
+// store every token key is its own file; the keys of a failed batch are
+// deleted again, but if the process or enclave stops meanwhile, the token
+// keys written so far stay on the token. Session keys are lost with the
+// session either way
+CK_RV C_UnwrapKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hUnwrappingKey, CK_UNWRAP_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
+// Derive up to 1024 keys from one base key with CKM_HKDF_DERIVE,
+// CKM_SP800_108_COUNTER_KDF, CKM_SP800_108_FEEDBACK_KDF, CKM_TLS12_PRF_SHA256
+// or CKM_TLS12_MASTER_KEY_DERIVE; the HMAC state of the (pseudorandom) key is
+// computed once. The base key is a generic secret, AES, CKK_SHA256_HMAC,
+// CKK_SHA384_HMAC or CKK_SHA512_HMAC key. Keys share pTemplate, which needs
+// CKA_KEY_TYPE (CKK_GENERIC_SECRET or CKK_AES) and CKA_VALUE_LEN; a master
+// secret is a 48 byte generic secret by default. CKM_TLS_PRF, the TLS 1.0/1.1
+// PRF, is not supported. Raw key material needs an extractable, non-sensitive
+// base key; the only exception is the 12 byte Finished verify data, i.e.
+// CKM_TLS12_PRF_SHA256 with the label "client finished" or "server finished"
+// and a ulValueLen of 12. Every item has its own rv; the result of the first
+// failed key is returned.
+// CKM_TLS12_KEY_AND_MAC_DERIVE takes exactly one item without data or value;
+// it creates the MAC and cipher keys of both sides (the cipher keys from
+// pTemplate) and returns them and the IVs in pReturnedKeyMaterial. hKey
+// receives the client cipher key. The keys are created all or nothing
+// CKM_ECDH1_DERIVE takes an X25519 or X448 private key as the base key,
+// which is loaded once for the batch, and CK_ECDH1_DERIVE_PARAMS with CKD_NULL
+// and neither shared data nor public data. The public key of the peer is the
+// data of each item, raw or as a DER octet string; the shared secret is
+// truncated from the leading end to the key length. The keys are created
+// like the other derived keys, so session keys get the full attribute checks
+CK_RV C_DeriveKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hBaseKey, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulAttributeCount, CK_DERIVE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
+// PKCS #11 v3.0 message-based encryption for CKM_AES_GCM. The key is set up
+// once by the init function; every message passes a CK_GCM_MESSAGE_PARAMS
+// with its own IV and tag buffer. The IV generators CKG_NO_GENERATE and
+// CKG_GENERATE_RANDOM are supported
+CK_RV C_MessageEncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+CK_RV C_EncryptMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pAssociatedData, CK_ULONG ulAssociatedDataLen, CK_BYTE_PTR pPlaintext, CK_ULONG ulPlaintextLen, CK_BYTE_PTR pCiphertext, CK_ULONG_PTR pulCiphertextLen);
+CK_RV C_MessageEncryptFinal(CK_SESSION_HANDLE hSession);
+CK_RV C_MessageDecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+CK_RV C_DecryptMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pAssociatedData, CK_ULONG ulAssociatedDataLen, CK_BYTE_PTR pCiphertext, CK_ULONG ulCiphertextLen, CK_BYTE_PTR pPlaintext, CK_ULONG_PTR pulPlaintextLen);
+CK_RV C_MessageDecryptFinal(CK_SESSION_HANDLE hSession);
+
+// Batched message-based encryption: process up to 1024 messages of an
+// active C_MessageEncryptInit/C_MessageDecryptInit operation in one call.
+// A failed message does not stop the batch; the result of the first
+// failed message is returned and every item has its own rv
+CK_RV C_EncryptMessageBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+CK_RV C_DecryptMessageBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
+// PKCS #11 v3.0 message-based signing and verification. The mechanism and
+// key are set up once by the init function and stay loaded until the final
+// function, so each message is a single call; the per-message parameter is
+// not used by the supported mechanisms
+CK_RV C_MessageSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+CK_RV C_SignMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen);
+CK_RV C_MessageSignFinal(CK_SESSION_HANDLE hSession);
+CK_RV C_MessageVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+CK_RV C_VerifyMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen);
+CK_RV C_MessageVerifyFinal(CK_SESSION_HANDLE hSession);
+
+#endif // !_VENDORDEFS_H
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*****************************************************************************
+ AlgorithmPool.h
+
+ Pool of idle algorithm instances. An instance that is recycled is reset,
+ which wipes its key and operation state but keeps its OpenSSL context
+ allocated, and is then handed out again for the next operation of the same
+ type instead of being deleted.
+ *****************************************************************************/
+
+#ifndef _SOFTHSM_V2_ALGORITHMPOOL_H
+#define _SOFTHSM_V2_ALGORITHMPOOL_H
+
+#include "config.h"
+#include "MutexFactory.h"
+#include <map>
+#include <vector>
+
+template <class T>
+class AlgorithmPool
+{
+public:
+	// Constructor; poolSize is the number of idle instances kept per type
+	AlgorithmPool(unsigned long poolSize) : poolSize(poolSize), hits(0), misses(0)
+	{
+		poolMutex = MutexFactory::i()->getMutex();
+	}
+
+	AlgorithmPool(const AlgorithmPool&) = delete;
+
+	AlgorithmPool& operator=(const AlgorithmPool&) = delete;
+
+	// Destructor; deletes the idle instances
+	virtual ~AlgorithmPool()
+	{
+		typename std::map<int, std::vector<T*> >::iterator i;
+		for (i = idle.begin(); i != idle.end(); i++)
+		{
+			for (size_t n = 0; n < i->second.size(); n++)
+			{
+				delete i->second[n];
+			}
+		}
+
+		MutexFactory::i()->recycleMutex(poolMutex);
+	}
+
+	// Take an idle instance of the type; returns NULL if there is none
+	T* take(int type)
+	{
+		MutexLocker lock(poolMutex);
+
+		std::vector<T*>& instances = idle[type];
+		if (instances.empty())
+		{
+			misses++;
+
+			return NULL;
+		}
+
+		hits++;
+
+		T* instance = instances.back();
+		instances.pop_back();
+
+		return instance;
+	}
+
+	// Remember the type of a new instance, so that it can be put back
+	void add(T* instance, int type)
+	{
+		MutexLocker lock(poolMutex);
+
+		types[instance] = type;
+	}
+
+	// Reset the instance and keep it for the next operation of its type;
+	// returns false if the instance is unknown or its type is full, the
+	// caller must then delete it
+	bool put(T* instance)
+	{
+		// Wipe the state outside the lock; resetting may recycle other
+		// algorithms, e.g. the hashes of an RSA operation
+		instance->reset();
+
+		MutexLocker lock(poolMutex);
+
+		typename std::map<const T*, int>::iterator type = types.find(instance);
+		if (type == types.end())
+		{
+			return false;
+		}
+
+		std::vector<T*>& instances = idle[type->second];
+		if (instances.size() >= poolSize)
+		{
+			types.erase(type);
+
+			return false;
+		}
+
+		instances.push_back(instance);
+
+		return true;
+	}
+
+	// Statistics
+	unsigned long getHits()
+	{
+		MutexLocker lock(poolMutex);
+
+		return hits;
+	}
+
+	unsigned long getMisses()
+	{
+		MutexLocker lock(poolMutex);
+
+		return misses;
+	}
+
+	unsigned long getSize()
+	{
+		MutexLocker lock(poolMutex);
+
+		unsigned long size = 0;
+		typename std::map<int, std::vector<T*> >::iterator i;
+		for (i = idle.begin(); i != idle.end(); i++)
+		{
+			size += i->second.size();
+		}
+
+		return size;
+	}
+
+private:
+	// The number of idle instances kept per type
+	unsigned long poolSize;
+
+	// The idle instances by type
+	std::map<int, std::vector<T*> > idle;
+
+	// The type of every instance that was handed out
+	std::map<const T*, int> types;
+
+	// Statistics
+	unsigned long hits;
+	unsigned long misses;
+
+	// For thread safeness
+	Mutex* poolMutex;
+};
+
+#endif // !_SOFTHSM_V2_ALGORITHMPOOL_H
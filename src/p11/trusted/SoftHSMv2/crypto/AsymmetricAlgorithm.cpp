@@ -213,6 +213,11 @@ bool AsymmetricAlgorithm::deriveKey(SymmetricKey** /*ppSymmetricKey*/, PublicKey
 	return false;
 }
 
+bool AsymmetricAlgorithm::deriveRawKey(SymmetricKey** /*ppSymmetricKey*/, const ByteString& /*publicData*/, PrivateKey* /*privateKey*/)
+{
+	return false;
+}
+
 bool AsymmetricAlgorithm::reconstructParameters(AsymmetricParameters** /*ppParams*/, ByteString& /*serialisedData*/)
 {
 	return false;
@@ -249,3 +254,12 @@ void AsymmetricAlgorithm::recycleSymmetricKey(SymmetricKey* toRecycle)
 	delete toRecycle;
 }
 
+void AsymmetricAlgorithm::reset()
+{
+	currentOperation = NONE;
+	currentMechanism = AsymMech::Unknown;
+	currentPadding = AsymMech::Unknown;
+	currentPublicKey = NULL;
+	currentPrivateKey = NULL;
+}
+
@@ -150,6 +150,7 @@ public:
 	virtual unsigned long getMaxKeySize() = 0;
 	virtual bool generateParameters(AsymmetricParameters** ppParams, void* parameters = NULL, RNG* rng = NULL);
 	virtual bool deriveKey(SymmetricKey **ppSymmetricKey, PublicKey* publicKey, PrivateKey* privateKey);
+	virtual bool deriveRawKey(SymmetricKey **ppSymmetricKey, const ByteString& publicData, PrivateKey* privateKey);
 	virtual bool reconstructKeyPair(AsymmetricKeyPair** ppKeyPair, ByteString& serialisedData) = 0;
 	virtual bool reconstructPublicKey(PublicKey** ppPublicKey, ByteString& serialisedData) = 0;
 	virtual bool reconstructPrivateKey(PrivateKey** ppPrivateKey, ByteString& serialisedData) = 0;
@@ -165,6 +166,10 @@ public:
 	virtual void recyclePrivateKey(PrivateKey* toRecycle);
 	virtual void recycleSymmetricKey(SymmetricKey* toRecycle);
 
+	// Return to the idle state and wipe the operation state, so that the
+	// instance can be handed out again
+	virtual void reset();
+
 protected:
 	PublicKey* currentPublicKey;
 	PrivateKey* currentPrivateKey;
@@ -107,3 +107,23 @@ void CryptoFactory::recycleMacAlgorithm(MacAlgorithm* toRecycle)
 {
 	delete toRecycle;
 }
+
+// Use idle time to compute values ahead of the operations that need them --
+// override this function in the derived class if it keeps precomputed values
+unsigned long CryptoFactory::precompute(unsigned long /*maxCount*/)
+{
+	return 0;
+}
+
+// Wipe the state kept for keys -- override this function in the derived
+// class if it keeps state that is derived from keys
+void CryptoFactory::forgetKeyStates(const void* /*owner*/)
+{
+}
+
+// Get the cache of public keys -- override this function in the derived
+// class if it keeps one
+PublicKeyCache* CryptoFactory::getPublicKeyCache()
+{
+	return NULL;
+}
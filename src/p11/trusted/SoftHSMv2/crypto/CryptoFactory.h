@@ -41,6 +41,7 @@
 #include "HashAlgorithm.h"
 #include "MacAlgorithm.h"
 #include "RNG.h"
+#include "PublicKeyCache.h"
 
 class CryptoFactory
 {
@@ -87,6 +88,18 @@ public:
 	// Get the global RNG (may be an unique RNG per thread)
 	virtual RNG* getRNG(RNGImpl::Type name = RNGImpl::Default) = 0;
 
+	// Use idle time to compute at most maxCount values ahead of the
+	// operations that need them; returns the number of values computed
+	virtual unsigned long precompute(unsigned long maxCount);
+
+	// Wipe the state kept for the keys of the object owner, or for all
+	// keys if owner is NULL
+	virtual void forgetKeyStates(const void* owner);
+
+	// Get the cache of public keys built from key objects; NULL if the
+	// implementation does not keep one
+	virtual PublicKeyCache* getPublicKeyCache();
+
 	// Destructor
 	virtual ~CryptoFactory() { }
 
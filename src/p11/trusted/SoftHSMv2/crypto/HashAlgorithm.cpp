@@ -74,3 +74,8 @@ bool HashAlgorithm::hashFinal(ByteString& /*hashedData*/)
 	return true;
 }
 
+void HashAlgorithm::reset()
+{
+	currentOperation = NONE;
+}
+
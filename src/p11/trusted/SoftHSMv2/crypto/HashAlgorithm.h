@@ -66,6 +66,11 @@ public:
 	virtual bool hashFinal(ByteString& hashedData);
 
 	virtual int getHashSize() = 0;
+
+	// Return to the idle state and wipe the operation state, so that the
+	// instance can be handed out again
+	virtual void reset();
+
 protected:
 	// The current operation
 	enum
@@ -126,3 +126,9 @@ void MacAlgorithm::recycleKey(SymmetricKey* toRecycle)
 {
 	delete toRecycle;
 }
+
+void MacAlgorithm::reset()
+{
+	currentOperation = NONE;
+	currentKey = NULL;
+}
@@ -82,6 +82,10 @@ public:
 	// Return the MAC size
 	virtual size_t getMacSize() const = 0;
 
+	// Return to the idle state and wipe the operation state, so that the
+	// instance can be handed out again
+	virtual void reset();
+
 protected:
 	// The current key
 	const SymmetricKey* currentKey;
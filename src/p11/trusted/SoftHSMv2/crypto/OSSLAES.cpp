@@ -282,7 +282,7 @@ const EVP_CIPHER* OSSLAES::getCipher() const
 				return EVP_aes_256_ctr();
 		};
 	}
-	else if (currentCipherMode == SymMode::GCM)
+	else if ((currentCipherMode == SymMode::GCM) || (currentCipherMode == SymMode::GCM_STREAM))
 	{
 		switch(currentKey->getBitLen())
 		{
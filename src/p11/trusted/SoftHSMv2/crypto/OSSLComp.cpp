@@ -77,6 +77,24 @@ void EVP_MD_CTX_free(EVP_MD_CTX *ctx)
 	}
 }
 
+int EVP_MD_CTX_reset(EVP_MD_CTX *ctx)
+{
+	if (ctx == NULL) return 1;
+
+	EVP_MD_CTX_cleanup(ctx);
+	EVP_MD_CTX_init(ctx);
+
+	return 1;
+}
+
+// EVP cipher routines
+int EVP_CIPHER_CTX_reset(EVP_CIPHER_CTX *ctx)
+{
+	if (ctx == NULL) return 1;
+
+	return EVP_CIPHER_CTX_cleanup(ctx);
+}
+
 // HMAC routines
 HMAC_CTX *HMAC_CTX_new(void)
 {
@@ -96,6 +114,16 @@ void HMAC_CTX_free(HMAC_CTX *ctx)
 	OPENSSL_free(ctx);
 }
 
+int HMAC_CTX_reset(HMAC_CTX *ctx)
+{
+	if (ctx == NULL) return 1;
+
+	HMAC_CTX_cleanup(ctx);
+	HMAC_CTX_init(ctx);
+
+	return 1;
+}
+
 // DH routines
 void DH_get0_pqg(const DH *dh,
                  const BIGNUM **p, const BIGNUM **q, const BIGNUM **g)
@@ -50,10 +50,15 @@
 // EVP digest routines
 EVP_MD_CTX *EVP_MD_CTX_new(void);
 void EVP_MD_CTX_free(EVP_MD_CTX *ctx);
+int EVP_MD_CTX_reset(EVP_MD_CTX *ctx);
+
+// EVP cipher routines
+int EVP_CIPHER_CTX_reset(EVP_CIPHER_CTX *ctx);
 
 // HMAC routines
 HMAC_CTX *HMAC_CTX_new(void);
 void HMAC_CTX_free(HMAC_CTX *ctx);
+int HMAC_CTX_reset(HMAC_CTX *ctx);
 
 // DH routines
 void DH_get0_pqg(const DH *dh,
@@ -91,6 +91,7 @@
 #include "OSSLECDH.h"
 #endif // Unsupported by Crypto API Toolkit
 #include "OSSLECDSA.h"
+#include "OSSLECDSANoncePool.h"
 #endif
 #if 0 // Unsupported by Crypto API Toolkit
 #ifdef WITH_GOST
@@ -110,6 +111,42 @@
 #include <openssl/crypto.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
+
+// The number of pre-generated RSA key pairs kept per key size; the pool is
+// only kept when built with --enable-rsa-key-pool
+#ifdef WITH_RSA_KEY_POOL
+#define RSA_KEY_POOL_SIZE		4
+#else
+#define RSA_KEY_POOL_SIZE		0
+#endif
+
+// The number of initialised MAC states kept
+#define MAC_KEY_CACHE_SIZE		64
+
+// The number of public keys kept for verification
+#define PUBLIC_KEY_CACHE_SIZE		512
+
+// The number of idle algorithm instances kept per algorithm; can be
+// overridden at build time, 0 disables the pools
+#ifndef ALGORITHM_POOL_SIZE
+#define ALGORITHM_POOL_SIZE		16
+#endif
+
+#ifdef WITH_ECC
+// The number of precomputed ECDSA nonces kept per curve; can be overridden
+// at build time, 0 disables the pool
+#ifndef ECDSA_NONCE_POOL_SIZE
+#define ECDSA_NONCE_POOL_SIZE		32
+#endif
+#endif
+
+#if defined(WITH_ECC) || defined(WITH_EDDSA)
+// The number of pre-generated EC and EdDSA key pairs kept per curve; can be
+// overridden at build time
+#ifndef EC_KEY_POOL_SIZE
+#define EC_KEY_POOL_SIZE		16
+#endif
+#endif
 #if 0 // Unsupported by Crypto API Toolkit
 #ifdef WITH_GOST
 #include <openssl/objects.h>
@@ -215,6 +252,40 @@ OSSLCryptoFactory::OSSLCryptoFactory()
 	// Initialise the one-and-only RNG
 	rng = new OSSLRNG();
 
+	// Initialise the pool of pre-generated RSA key pairs
+	rsaKeyPool = new OSSLRSAKeyPool(RSA_KEY_POOL_SIZE);
+
+	// Initialise the cache of MAC states
+	macKeyCache = new OSSLMacKeyCache(MAC_KEY_CACHE_SIZE);
+
+	// Initialise the cache of public keys
+	publicKeyCache = new PublicKeyCache(PUBLIC_KEY_CACHE_SIZE);
+
+	// Initialise the pools of idle algorithm instances
+	symmetricPool = new AlgorithmPool<SymmetricAlgorithm>(ALGORITHM_POOL_SIZE);
+	asymmetricPool = new AlgorithmPool<AsymmetricAlgorithm>(ALGORITHM_POOL_SIZE);
+	hashPool = new AlgorithmPool<HashAlgorithm>(ALGORITHM_POOL_SIZE);
+	macPool = new AlgorithmPool<MacAlgorithm>(ALGORITHM_POOL_SIZE);
+
+#ifdef WITH_ECC
+	// Initialise the pool of precomputed ECDSA nonces
+	ecdsaNoncePool = new OSSLECDSANoncePool(ECDSA_NONCE_POOL_SIZE);
+#endif
+
+#if defined(WITH_ECC) || defined(WITH_EDDSA)
+	// Initialise the pool of pre-generated EC and EdDSA key pairs
+	ecKeyPool = new OSSLECKeyPool(EC_KEY_POOL_SIZE);
+#endif
+
+	// No worker or refill thread is running yet
+	workerMutex = MutexFactory::i()->getMutex();
+	workerThreads = 0;
+	refillMutex = MutexFactory::i()->getMutex();
+	refillStarted = false;
+	refillRunning = false;
+	refillPending = false;
+	refillStop = false;
+
 
 #if 0 // Unsupported by Crypto API Toolkit
 
@@ -292,6 +363,46 @@ OSSLCryptoFactory::~OSSLCryptoFactory()
 #endif
 #endif // Unsupported by Crypto API Toolkit
 
+	// Stop the background refill before the pools go away
+	{
+		MutexLocker lock(refillMutex);
+
+		refillStop = true;
+	}
+
+	if (refillStarted)
+	{
+		pthread_join(refillThread, NULL);
+	}
+
+	MutexFactory::i()->recycleMutex(refillMutex);
+	MutexFactory::i()->recycleMutex(workerMutex);
+
+#ifdef WITH_ECC
+	// Wipe the precomputed ECDSA nonces
+	delete ecdsaNoncePool;
+#endif
+
+#if defined(WITH_ECC) || defined(WITH_EDDSA)
+	// Wipe the pre-generated EC and EdDSA key pairs
+	delete ecKeyPool;
+#endif
+
+	// Wipe the pre-generated RSA key pairs
+	delete rsaKeyPool;
+
+	// Wipe the cached MAC states
+	delete macKeyCache;
+
+	// Delete the cached public keys
+	delete publicKeyCache;
+
+	// Delete the idle algorithm instances
+	delete asymmetricPool;
+	delete symmetricPool;
+	delete macPool;
+	delete hashPool;
+
 	// Destroy the one-and-only RNG
 	delete rng;
 
@@ -335,8 +446,8 @@ bool OSSLCryptoFactory::getFipsSelfTestStatus() const
 #endif
 #endif // Unsupported by Crypto API Toolkit
 
-// Create a concrete instance of a symmetric algorithm
-SymmetricAlgorithm* OSSLCryptoFactory::getSymmetricAlgorithm(SymAlgo::Type algorithm)
+// Create a new instance of a symmetric algorithm
+SymmetricAlgorithm* OSSLCryptoFactory::newSymmetricAlgorithm(SymAlgo::Type algorithm)
 {
 	switch (algorithm)
 	{
@@ -358,8 +469,8 @@ SymmetricAlgorithm* OSSLCryptoFactory::getSymmetricAlgorithm(SymAlgo::Type algor
 	return NULL;
 }
 
-// Create a concrete instance of an asymmetric algorithm
-AsymmetricAlgorithm* OSSLCryptoFactory::getAsymmetricAlgorithm(AsymAlgo::Type algorithm)
+// Create a new instance of an asymmetric algorithm
+AsymmetricAlgorithm* OSSLCryptoFactory::newAsymmetricAlgorithm(AsymAlgo::Type algorithm)
 {
 	switch (algorithm)
 	{
@@ -401,8 +512,8 @@ AsymmetricAlgorithm* OSSLCryptoFactory::getAsymmetricAlgorithm(AsymAlgo::Type al
 	return NULL;
 }
 
-// Create a concrete instance of a hash algorithm
-HashAlgorithm* OSSLCryptoFactory::getHashAlgorithm(HashAlgo::Type algorithm)
+// Create a new instance of a hash algorithm
+HashAlgorithm* OSSLCryptoFactory::newHashAlgorithm(HashAlgo::Type algorithm)
 {
 	switch (algorithm)
 	{
@@ -438,8 +549,8 @@ HashAlgorithm* OSSLCryptoFactory::getHashAlgorithm(HashAlgo::Type algorithm)
 	return NULL;
 }
 
-// Create a concrete instance of a MAC algorithm
-MacAlgorithm* OSSLCryptoFactory::getMacAlgorithm(MacAlgo::Type algorithm)
+// Create a new instance of a MAC algorithm
+MacAlgorithm* OSSLCryptoFactory::newMacAlgorithm(MacAlgo::Type algorithm)
 {
 	switch (algorithm)
 	{
@@ -478,6 +589,110 @@ MacAlgorithm* OSSLCryptoFactory::getMacAlgorithm(MacAlgo::Type algorithm)
 	return NULL;
 }
 
+// Create a concrete instance of a symmetric algorithm; an idle instance is reused
+SymmetricAlgorithm* OSSLCryptoFactory::getSymmetricAlgorithm(SymAlgo::Type algorithm)
+{
+	SymmetricAlgorithm* instance = symmetricPool->take(algorithm);
+
+	if (instance == NULL)
+	{
+		instance = newSymmetricAlgorithm(algorithm);
+
+		if (instance != NULL)
+		{
+			symmetricPool->add(instance, algorithm);
+		}
+	}
+
+	return instance;
+}
+
+void OSSLCryptoFactory::recycleSymmetricAlgorithm(SymmetricAlgorithm* toRecycle)
+{
+	if (toRecycle != NULL && !symmetricPool->put(toRecycle))
+	{
+		delete toRecycle;
+	}
+}
+
+// Create a concrete instance of an asymmetric algorithm; an idle instance is reused
+AsymmetricAlgorithm* OSSLCryptoFactory::getAsymmetricAlgorithm(AsymAlgo::Type algorithm)
+{
+	AsymmetricAlgorithm* instance = asymmetricPool->take(algorithm);
+
+	if (instance == NULL)
+	{
+		instance = newAsymmetricAlgorithm(algorithm);
+
+		if (instance != NULL)
+		{
+			asymmetricPool->add(instance, algorithm);
+		}
+	}
+
+	return instance;
+}
+
+void OSSLCryptoFactory::recycleAsymmetricAlgorithm(AsymmetricAlgorithm* toRecycle)
+{
+	if (toRecycle != NULL && !asymmetricPool->put(toRecycle))
+	{
+		delete toRecycle;
+	}
+}
+
+// Create a concrete instance of a hash algorithm; an idle instance is reused
+HashAlgorithm* OSSLCryptoFactory::getHashAlgorithm(HashAlgo::Type algorithm)
+{
+	HashAlgorithm* instance = hashPool->take(algorithm);
+
+	if (instance == NULL)
+	{
+		instance = newHashAlgorithm(algorithm);
+
+		if (instance != NULL)
+		{
+			hashPool->add(instance, algorithm);
+		}
+	}
+
+	return instance;
+}
+
+void OSSLCryptoFactory::recycleHashAlgorithm(HashAlgorithm* toRecycle)
+{
+	if (toRecycle != NULL && !hashPool->put(toRecycle))
+	{
+		delete toRecycle;
+	}
+}
+
+// Create a concrete instance of a MAC algorithm; an idle instance is reused
+MacAlgorithm* OSSLCryptoFactory::getMacAlgorithm(MacAlgo::Type algorithm)
+{
+	MacAlgorithm* instance = macPool->take(algorithm);
+
+	if (instance == NULL)
+	{
+		instance = newMacAlgorithm(algorithm);
+
+		if (instance != NULL)
+		{
+			macPool->add(instance, algorithm);
+		}
+	}
+
+	return instance;
+}
+
+void OSSLCryptoFactory::recycleMacAlgorithm(MacAlgorithm* toRecycle)
+{
+	if (toRecycle != NULL && !macPool->put(toRecycle))
+	{
+		delete toRecycle;
+	}
+}
+
 // Get the global RNG (may be an unique RNG per thread)
 RNG* OSSLCryptoFactory::getRNG(RNGImpl::Type name /* = RNGImpl::Default */)
 {
@@ -493,3 +708,209 @@ RNG* OSSLCryptoFactory::getRNG(RNGImpl::Type name /* = RNGImpl::Default */)
 		return NULL;
 	}
 }
+
+// Fill the precomputation pools
+unsigned long OSSLCryptoFactory::precompute(unsigned long maxCount)
+{
+	unsigned long count = 0;
+
+	// The cheap ECDSA nonces and EC key pairs first, then the RSA key pairs
+#ifdef WITH_ECC
+	count += ecdsaNoncePool->fill(maxCount - count);
+#endif
+#if defined(WITH_ECC) || defined(WITH_EDDSA)
+	count += ecKeyPool->fill(maxCount - count);
+#endif
+	count += rsaKeyPool->fill(maxCount - count);
+
+	return count;
+}
+
+// A worker thread and its argument
+struct WorkerStart
+{
+	OSSLCryptoFactory* factory;
+	void* (*worker)(void*);
+	void* arg;
+};
+
+// Start a worker thread if the enclave has a spare TCS for it
+bool OSSLCryptoFactory::startWorker(pthread_t* thread, void* (*worker)(void*), void* arg)
+{
+	{
+		MutexLocker lock(workerMutex);
+
+		if (workerThreads >= MAX_WORKER_THREADS) return false;
+
+		workerThreads++;
+	}
+
+	WorkerStart* start = new WorkerStart;
+	start->factory = this;
+	start->worker = worker;
+	start->arg = arg;
+
+	// The TCS may all be held by application calls
+	if (pthread_create(thread, NULL, runWorker, start) != 0)
+	{
+		delete start;
+
+		MutexLocker lock(workerMutex);
+
+		workerThreads--;
+
+		return false;
+	}
+
+	return true;
+}
+
+// Run a worker and give its TCS back once it is done
+/*static*/ void* OSSLCryptoFactory::runWorker(void* start)
+{
+	WorkerStart* self = (WorkerStart*) start;
+	void* rv = self->worker(self->arg);
+
+	{
+		MutexLocker lock(self->factory->workerMutex);
+
+		self->factory->workerThreads--;
+	}
+
+	delete self;
+
+	return rv;
+}
+
+// Add one entry to the pools that are refilled in the background
+unsigned long OSSLCryptoFactory::refillOne()
+{
+	unsigned long count = 0;
+
+#ifdef WITH_ECC
+	count += ecdsaNoncePool->fill(1);
+#endif
+#if defined(WITH_ECC) || defined(WITH_EDDSA)
+	count += ecKeyPool->fill(1 - count);
+#endif
+
+	return count;
+}
+
+// Start refilling the precomputation pools in the background
+void OSSLCryptoFactory::refillPools()
+{
+	// Nothing to do while every pool is more than half full
+	bool isLow = false;
+#ifdef WITH_ECC
+	isLow = isLow || ecdsaNoncePool->isLow();
+#endif
+#if defined(WITH_ECC) || defined(WITH_EDDSA)
+	isLow = isLow || ecKeyPool->isLow();
+#endif
+
+	if (!isLow) return;
+
+	MutexLocker lock(refillMutex);
+
+	if (refillStop) return;
+
+	// The running refill picks up the entry that was just taken
+	if (refillRunning)
+	{
+		refillPending = true;
+
+		return;
+	}
+
+	// Reclaim the thread of the previous refill; it has finished
+	if (refillStarted)
+	{
+		pthread_join(refillThread, NULL);
+	}
+
+	// Without a spare TCS the pools are refilled by C_PrecomputePools only
+	refillStarted = startWorker(&refillThread, refillWorker, this);
+	refillRunning = refillStarted;
+	refillPending = false;
+}
+
+// The thread that refills the precomputation pools
+/*static*/ void* OSSLCryptoFactory::refillWorker(void* factory)
+{
+	OSSLCryptoFactory* self = (OSSLCryptoFactory*) factory;
+
+	for (;;)
+	{
+		{
+			MutexLocker lock(self->refillMutex);
+
+			if (self->refillStop)
+			{
+				self->refillRunning = false;
+
+				break;
+			}
+		}
+
+		// One entry at a time, so the teardown does not wait for a whole fill
+		if (self->refillOne() > 0) continue;
+
+		MutexLocker lock(self->refillMutex);
+
+		// An entry was taken while the last pool was checked
+		if (self->refillPending && !self->refillStop)
+		{
+			self->refillPending = false;
+
+			continue;
+		}
+
+		self->refillRunning = false;
+
+		break;
+	}
+
+	return NULL;
+}
+
+// Wipe the cached MAC states and public keys of the object, or all of them
+void OSSLCryptoFactory::forgetKeyStates(const void* owner)
+{
+	macKeyCache->forget(owner);
+	publicKeyCache->forget(owner);
+}
+
+// Get the cache of public keys
+PublicKeyCache* OSSLCryptoFactory::getPublicKeyCache()
+{
+	return publicKeyCache;
+}
+
+// Get the pool of pre-generated RSA key pairs
+OSSLRSAKeyPool* OSSLCryptoFactory::getRSAKeyPool()
+{
+	return rsaKeyPool;
+}
+
+// Get the cache of initialised MAC states
+OSSLMacKeyCache* OSSLCryptoFactory::getMacKeyCache()
+{
+	return macKeyCache;
+}
+
+#ifdef WITH_ECC
+// Get the pool of precomputed ECDSA nonces
+OSSLECDSANoncePool* OSSLCryptoFactory::getECDSANoncePool()
+{
+	return ecdsaNoncePool;
+}
+#endif
+
+#if defined(WITH_ECC) || defined(WITH_EDDSA)
+// Get the pool of pre-generated EC and EdDSA key pairs
+OSSLECKeyPool* OSSLCryptoFactory::getECKeyPool()
+{
+	return ecKeyPool;
+}
+#endif
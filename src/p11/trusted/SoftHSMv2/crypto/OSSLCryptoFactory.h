@@ -71,10 +71,25 @@
 #include "HashAlgorithm.h"
 #include "MacAlgorithm.h"
 #include "RNG.h"
+#include "OSSLRSAKeyPool.h"
+#include "OSSLMacKeyCache.h"
+#include "PublicKeyCache.h"
+#include "AlgorithmPool.h"
+#ifdef WITH_ECC
+#include "OSSLECDSANoncePool.h"
+#endif
+#if defined(WITH_ECC) || defined(WITH_EDDSA)
+#include "OSSLECKeyPool.h"
+#endif
 #include <memory>
+#include <pthread.h>
 #include <openssl/conf.h>
 #include <openssl/engine.h>
 
+// The number of threads the enclave starts for itself; TCSNum in
+// p11Enclave.config.xml is 4, which leaves two TCS for application calls
+#define MAX_WORKER_THREADS		2
+
 class OSSLCryptoFactory : public CryptoFactory
 {
 public:
@@ -106,9 +121,50 @@ public:
 	// Create a concrete instance of a MAC algorithm
 	virtual MacAlgorithm* getMacAlgorithm(MacAlgo::Type algorithm);
 
+	// Recycle instances; they are kept for the next operation of their type
+	virtual void recycleSymmetricAlgorithm(SymmetricAlgorithm* toRecycle);
+	virtual void recycleAsymmetricAlgorithm(AsymmetricAlgorithm* toRecycle);
+	virtual void recycleHashAlgorithm(HashAlgorithm* toRecycle);
+	virtual void recycleMacAlgorithm(MacAlgorithm* toRecycle);
+
 	// Get the global RNG (may be an unique RNG per thread)
 	virtual RNG* getRNG(RNGImpl::Type name = RNGImpl::Default);
 
+	// Fill the precomputation pools
+	virtual unsigned long precompute(unsigned long maxCount);
+
+	// Start a worker thread if the enclave has a spare TCS for it; returns
+	// false if there is none and the caller has to do the work itself
+	bool startWorker(pthread_t* thread, void* (*worker)(void*), void* arg);
+
+	// Start refilling the ECDSA nonce and EC key pools in the background
+	// once one of them is down to half; called after an entry was taken from
+	// a pool. RSA key pairs take too long for a thread that C_Finalize waits
+	// for, so they are only generated by precompute()
+	void refillPools();
+
+	// Wipe the cached MAC states and public keys of the object, or all of them
+	virtual void forgetKeyStates(const void* owner);
+
+	// Get the cache of public keys
+	virtual PublicKeyCache* getPublicKeyCache();
+
+	// Get the pool of pre-generated RSA key pairs
+	OSSLRSAKeyPool* getRSAKeyPool();
+
+	// Get the cache of initialised MAC states
+	OSSLMacKeyCache* getMacKeyCache();
+
+#ifdef WITH_ECC
+	// Get the pool of precomputed ECDSA nonces
+	OSSLECDSANoncePool* getECDSANoncePool();
+#endif
+
+#if defined(WITH_ECC) || defined(WITH_EDDSA)
+	// Get the pool of pre-generated EC and EdDSA key pairs
+	OSSLECKeyPool* getECKeyPool();
+#endif
+
 	// Destructor
 	virtual ~OSSLCryptoFactory();
 
@@ -124,6 +180,22 @@ private:
 	// The one-and-only instance
 	static std::unique_ptr<OSSLCryptoFactory> instance;
 
+	// Create new algorithm instances
+	static SymmetricAlgorithm* newSymmetricAlgorithm(SymAlgo::Type algorithm);
+	static AsymmetricAlgorithm* newAsymmetricAlgorithm(AsymAlgo::Type algorithm);
+	static HashAlgorithm* newHashAlgorithm(HashAlgo::Type algorithm);
+	static MacAlgorithm* newMacAlgorithm(MacAlgo::Type algorithm);
+
+	// The thread that refills the precomputation pools
+	static void* refillWorker(void* factory);
+
+	// Add one entry to the pools that are refilled in the background;
+	// returns the number of entries added
+	unsigned long refillOne();
+
+	// Run a worker and give its TCS back once it is done
+	static void* runWorker(void* start);
+
 #if OPENSSL_VERSION_NUMBER < 0x10100000L || defined(LIBRESSL_VERSION_NUMBER)
 	bool setLockingCallback;
 #endif
@@ -135,6 +207,45 @@ private:
 
 	// The one-and-only RNG instance
 	RNG* rng;
+
+	// The pre-generated RSA key pairs
+	OSSLRSAKeyPool* rsaKeyPool;
+
+	// The initialised MAC states
+	OSSLMacKeyCache* macKeyCache;
+
+	// The public keys built from key objects
+	PublicKeyCache* publicKeyCache;
+
+	// The idle algorithm instances
+	AlgorithmPool<SymmetricAlgorithm>* symmetricPool;
+	AlgorithmPool<AsymmetricAlgorithm>* asymmetricPool;
+	AlgorithmPool<HashAlgorithm>* hashPool;
+	AlgorithmPool<MacAlgorithm>* macPool;
+
+#ifdef WITH_ECC
+	// The precomputed ECDSA nonces
+	OSSLECDSANoncePool* ecdsaNoncePool;
+#endif
+
+#if defined(WITH_ECC) || defined(WITH_EDDSA)
+	// The pre-generated EC and EdDSA key pairs
+	OSSLECKeyPool* ecKeyPool;
+#endif
+
+	// The number of running worker threads
+	Mutex* workerMutex;
+	unsigned long workerThreads;
+
+	// The background refill; at most one refill thread runs at a time and
+	// it exits once all pools are full
+	Mutex* refillMutex;
+	pthread_t refillThread;
+	bool refillStarted;
+	bool refillRunning;
+	bool refillPending;
+	bool refillStop;
+
 #ifndef SGXHSM
 	// And RDRAND engine to use with it
 	ENGINE *rdrand_engine;
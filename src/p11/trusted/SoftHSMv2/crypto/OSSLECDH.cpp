@@ -65,6 +65,7 @@
 #ifdef WITH_ECC
 #include "OSSLECDH.h"
 #include "CryptoFactory.h"
+#include "OSSLCryptoFactory.h"
 #include "ECParameters.h"
 #include "OSSLECKeyPair.h"
 #include "OSSLUtil.h"
@@ -159,28 +160,37 @@ bool OSSLECDH::generateKeyPair(AsymmetricKeyPair** ppKeyPair, AsymmetricParamete
 
 	ECParameters* params = (ECParameters*) parameters;
 
-	// Generate the key-pair
-	EC_KEY* eckey = EC_KEY_new();
+	EC_GROUP* grp = OSSL::byteString2grp(params->getEC());
 
-	if (eckey == NULL)
+	// Use a pre-generated key-pair if there is one
+	EC_KEY* eckey = NULL;
+	if (grp == NULL ||
+	    !OSSLCryptoFactory::i()->getECKeyPool()->takeEC(EC_GROUP_get_curve_name(grp), &eckey))
 	{
-		// ERROR_MSG("Failed to instantiate OpenSSL ECDH object");
+		// Generate the key-pair
+		eckey = EC_KEY_new();
+		if (eckey == NULL)
+		{
+			// ERROR_MSG("Failed to instantiate OpenSSL ECDH object");
 
-		return false;
-	}
+			EC_GROUP_free(grp);
 
-	EC_GROUP* grp = OSSL::byteString2grp(params->getEC());
-	EC_KEY_set_group(eckey, grp);
-	EC_GROUP_free(grp);
+			return false;
+		}
 
-	if (!EC_KEY_generate_key(eckey))
-	{
-		// ERROR_MSG("ECDH key generation failed (0x%08X)", ERR_get_error());
+		EC_KEY_set_group(eckey, grp);
 
-		EC_KEY_free(eckey);
+		if (!EC_KEY_generate_key(eckey))
+		{
+			// ERROR_MSG("ECDH key generation failed (0x%08X)", ERR_get_error());
 
-		return false;
+			EC_GROUP_free(grp);
+			EC_KEY_free(eckey);
+
+			return false;
+		}
 	}
+	EC_GROUP_free(grp);
 
 	// Create an asymmetric key-pair object to return
 	OSSLECKeyPair* kp = new OSSLECKeyPair();
@@ -67,6 +67,7 @@
 #include "CryptoFactory.h"
 #include "ECParameters.h"
 #include "OSSLECKeyPair.h"
+#include "OSSLCryptoFactory.h"
 #include "OSSLComp.h"
 #include "OSSLUtil.h"
 #include <algorithm>
@@ -132,7 +133,20 @@ bool OSSLECDSA::sign(PrivateKey* privateKey, const ByteString& dataToSign,
 	}
 	signature.resize(2 * len);
 	memset(&signature[0], 0, 2 * len);
-	ECDSA_SIG *sig = ECDSA_do_sign(dataToSign.const_byte_str(), dataToSign.size(), eckey);
+	ECDSA_SIG *sig = NULL;
+	BIGNUM* kinv = NULL;
+	BIGNUM* r = NULL;
+	// Use a precomputed nonce if there is one for the curve
+	if (OSSLCryptoFactory::i()->getECDSANoncePool()->take(eckey, &kinv, &r))
+	{
+		sig = ECDSA_do_sign_ex(dataToSign.const_byte_str(), dataToSign.size(), kinv, r, eckey);
+		BN_clear_free(kinv);
+		BN_clear_free(r);
+	}
+	// Top up the pool in the background
+	OSSLCryptoFactory::i()->refillPools();
+	if (sig == NULL)
+		sig = ECDSA_do_sign(dataToSign.const_byte_str(), dataToSign.size(), eckey);
 	if (sig == NULL)
 	{
 		// ERROR_MSG("ECDSA sign failed (0x%08X)", ERR_get_error());
@@ -316,27 +330,40 @@ bool OSSLECDSA::generateKeyPair(AsymmetricKeyPair** ppKeyPair, AsymmetricParamet
 
 	ECParameters* params = (ECParameters*) parameters;
 
-	// Generate the key-pair
-	EC_KEY* eckey = EC_KEY_new();
-	if (eckey == NULL)
+	EC_GROUP* grp = OSSL::byteString2grp(params->getEC());
+
+	// Use a pre-generated key-pair if there is one
+	EC_KEY* eckey = NULL;
+	if (grp == NULL ||
+	    !OSSLCryptoFactory::i()->getECKeyPool()->takeEC(EC_GROUP_get_curve_name(grp), &eckey))
 	{
-		// ERROR_MSG("Failed to instantiate OpenSSL ECDSA object");
+		// Generate the key-pair
+		eckey = EC_KEY_new();
+		if (eckey == NULL)
+		{
+			// ERROR_MSG("Failed to instantiate OpenSSL ECDSA object");
 
-		return false;
-	}
+			EC_GROUP_free(grp);
 
-	EC_GROUP* grp = OSSL::byteString2grp(params->getEC());
-	EC_KEY_set_group(eckey, grp);
-	EC_GROUP_free(grp);
+			return false;
+		}
 
-	if (!EC_KEY_generate_key(eckey))
-	{
-		// ERROR_MSG("ECDSA key generation failed (0x%08X)", ERR_get_error());
+		EC_KEY_set_group(eckey, grp);
 
-		EC_KEY_free(eckey);
+		if (!EC_KEY_generate_key(eckey))
+		{
+			// ERROR_MSG("ECDSA key generation failed (0x%08X)", ERR_get_error());
 
-		return false;
+			EC_GROUP_free(grp);
+			EC_KEY_free(eckey);
+
+			return false;
+		}
 	}
+	EC_GROUP_free(grp);
+
+	// Top up the pool in the background
+	OSSLCryptoFactory::i()->refillPools();
 
 	// Create an asymmetric key-pair object to return
 	OSSLECKeyPair* kp = new OSSLECKeyPair();
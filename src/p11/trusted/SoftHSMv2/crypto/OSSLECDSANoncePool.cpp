@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*****************************************************************************
+ OSSLECDSANoncePool.cpp
+
+ Pool of precomputed ECDSA signing values
+ *****************************************************************************/
+
+#include "config.h"
+#ifdef WITH_ECC
+#include "OSSLECDSANoncePool.h"
+#include <openssl/ecdsa.h>
+#include <openssl/objects.h>
+
+// The maximum number of curves that get a pool
+#define MAX_POOL_CURVES		4
+
+// Constructor
+OSSLECDSANoncePool::OSSLECDSANoncePool(unsigned long poolSize)
+{
+	this->poolSize = poolSize;
+	hits = 0;
+	misses = 0;
+	poolMutex = MutexFactory::i()->getMutex();
+}
+
+// Destructor
+OSSLECDSANoncePool::~OSSLECDSANoncePool()
+{
+	clear();
+
+	for (std::map<int, CurvePool>::iterator i = pools.begin(); i != pools.end(); i++)
+	{
+		EC_KEY_free(i->second.setupKey);
+	}
+
+	MutexFactory::i()->recycleMutex(poolMutex);
+}
+
+// Take a precomputed pair for the curve of the key
+bool OSSLECDSANoncePool::take(const EC_KEY* eckey, BIGNUM** kinv, BIGNUM** r)
+{
+	if (poolSize == 0 || eckey == NULL) return false;
+
+	const EC_GROUP* group = EC_KEY_get0_group(eckey);
+	if (group == NULL) return false;
+
+	// Only named curves are pooled
+	int nid = EC_GROUP_get_curve_name(group);
+	if (nid == NID_undef) return false;
+
+	MutexLocker lock(poolMutex);
+
+	std::map<int, CurvePool>::iterator i = pools.find(nid);
+	if (i == pools.end())
+	{
+		// Remember the curve, so the next fill() computes pairs for it
+		if (pools.size() < MAX_POOL_CURVES)
+		{
+			CurvePool pool;
+			pool.setupKey = NULL;
+			pools[nid] = pool;
+		}
+
+		misses++;
+
+		return false;
+	}
+
+	if (i->second.pairs.empty())
+	{
+		misses++;
+
+		return false;
+	}
+
+	*kinv = i->second.pairs.front().kinv;
+	*r = i->second.pairs.front().r;
+	i->second.pairs.pop_front();
+
+	hits++;
+
+	return true;
+}
+
+// Compute at most maxCount pairs for the curves that were used for signing
+unsigned long OSSLECDSANoncePool::fill(unsigned long maxCount)
+{
+	unsigned long count = 0;
+
+	while (count < maxCount)
+	{
+		int nid = NID_undef;
+		EC_KEY* setupKey = NULL;
+
+		// Find the curve with the fewest pairs
+		{
+			MutexLocker lock(poolMutex);
+
+			size_t fewest = poolSize;
+			for (std::map<int, CurvePool>::iterator i = pools.begin(); i != pools.end(); i++)
+			{
+				if (i->second.pairs.size() < fewest)
+				{
+					fewest = i->second.pairs.size();
+					nid = i->first;
+				}
+			}
+
+			if (nid == NID_undef) break;
+
+			if (pools[nid].setupKey == NULL)
+			{
+				EC_KEY* newKey = EC_KEY_new_by_curve_name(nid);
+
+				if (newKey == NULL || !EC_KEY_generate_key(newKey))
+				{
+					// ERROR_MSG("Could not create the ECDSA setup key for curve %d", nid);
+
+					EC_KEY_free(newKey);
+					freeCurvePool(pools[nid]);
+					pools.erase(nid);
+
+					continue;
+				}
+
+				// Use the OpenSSL implementation and not any engine
+#if OPENSSL_VERSION_NUMBER < 0x10100000L || defined(LIBRESSL_VERSION_NUMBER)
+				ECDSA_set_method(newKey, ECDSA_OpenSSL());
+#else
+				EC_KEY_set_method(newKey, EC_KEY_OpenSSL());
+#endif
+
+				pools[nid].setupKey = newKey;
+			}
+
+			setupKey = pools[nid].setupKey;
+		}
+
+		// The expensive part is done without holding the mutex; setup keys
+		// are only freed by the destructor
+		NoncePair pair;
+		pair.kinv = NULL;
+		pair.r = NULL;
+
+		if (!ECDSA_sign_setup(setupKey, NULL, &pair.kinv, &pair.r))
+		{
+			// ERROR_MSG("ECDSA sign setup failed (0x%08X)", ERR_get_error());
+
+			break;
+		}
+
+		MutexLocker lock(poolMutex);
+
+		std::map<int, CurvePool>::iterator i = pools.find(nid);
+		if (i == pools.end() || i->second.pairs.size() >= poolSize)
+		{
+			BN_clear_free(pair.kinv);
+			BN_clear_free(pair.r);
+
+			break;
+		}
+
+		i->second.pairs.push_back(pair);
+
+		count++;
+	}
+
+	return count;
+}
+
+// Wipe all pairs
+void OSSLECDSANoncePool::clear()
+{
+	MutexLocker lock(poolMutex);
+
+	for (std::map<int, CurvePool>::iterator i = pools.begin(); i != pools.end(); i++)
+	{
+		freeCurvePool(i->second);
+	}
+}
+
+// Is the pool of a curve down to half of its size?
+bool OSSLECDSANoncePool::isLow()
+{
+	if (poolSize == 0) return false;
+
+	MutexLocker lock(poolMutex);
+
+	for (std::map<int, CurvePool>::iterator i = pools.begin(); i != pools.end(); i++)
+	{
+		if (i->second.pairs.size() <= poolSize / 2)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Statistics
+unsigned long OSSLECDSANoncePool::getHits()
+{
+	MutexLocker lock(poolMutex);
+
+	return hits;
+}
+
+unsigned long OSSLECDSANoncePool::getMisses()
+{
+	MutexLocker lock(poolMutex);
+
+	return misses;
+}
+
+unsigned long OSSLECDSANoncePool::getSize()
+{
+	MutexLocker lock(poolMutex);
+
+	unsigned long size = 0;
+	for (std::map<int, CurvePool>::iterator i = pools.begin(); i != pools.end(); i++)
+	{
+		size += i->second.pairs.size();
+	}
+
+	return size;
+}
+
+// Free the pairs of a curve pool; the caller holds the mutex
+/*static*/ void OSSLECDSANoncePool::freeCurvePool(CurvePool& pool)
+{
+	for (std::deque<NoncePair>::iterator i = pool.pairs.begin(); i != pool.pairs.end(); i++)
+	{
+		BN_clear_free(i->kinv);
+		BN_clear_free(i->r);
+	}
+
+	pool.pairs.clear();
+}
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*****************************************************************************
+ OSSLECDSANoncePool.h
+
+ Pool of precomputed ECDSA signing values. Most of the cost of an ECDSA
+ signature is the computation of a random nonce k, its inverse and the
+ x-coordinate r of kG. These depend on the curve only, so they are
+ computed ahead of time, per curve, while the token is idle and each pair is
+ used for exactly one signature.
+ *****************************************************************************/
+
+#ifndef _SOFTHSM_V2_OSSLECDSANONCEPOOL_H
+#define _SOFTHSM_V2_OSSLECDSANONCEPOOL_H
+
+#include "config.h"
+#include "MutexFactory.h"
+#include <deque>
+#include <map>
+#include <openssl/ec.h>
+#include <openssl/bn.h>
+
+class OSSLECDSANoncePool
+{
+public:
+	// Constructor; poolSize is the number of pairs kept per curve
+	OSSLECDSANoncePool(unsigned long poolSize);
+
+	OSSLECDSANoncePool(const OSSLECDSANoncePool&) = delete;
+
+	OSSLECDSANoncePool& operator=(const OSSLECDSANoncePool&) = delete;
+
+	// Destructor; wipes all pairs
+	virtual ~OSSLECDSANoncePool();
+
+	// Take a precomputed pair for the curve of the key; the caller owns the
+	// values and must free them with BN_clear_free. Returns false if the pool
+	// of the curve is empty; the curve is then filled by the next fill().
+	bool take(const EC_KEY* eckey, BIGNUM** kinv, BIGNUM** r);
+
+	// Compute at most maxCount pairs for the curves that were used for
+	// signing; returns the number of pairs computed
+	unsigned long fill(unsigned long maxCount);
+
+	// Is the pool of a curve down to half of its size?
+	bool isLow();
+
+	// Wipe all pairs
+	void clear();
+
+	// Statistics
+	unsigned long getHits();
+	unsigned long getMisses();
+	unsigned long getSize();
+
+private:
+	// A precomputed pair
+	struct NoncePair
+	{
+		BIGNUM* kinv;
+		BIGNUM* r;
+	};
+
+	// The pairs of a curve
+	struct CurvePool
+	{
+		// Key on the curve that is used to compute the pairs; it is not
+		// used for signing
+		EC_KEY* setupKey;
+
+		std::deque<NoncePair> pairs;
+	};
+
+	// Wipe the pairs of a curve pool; the caller holds the mutex
+	static void freeCurvePool(CurvePool& pool);
+
+	// The number of pairs kept per curve
+	unsigned long poolSize;
+
+	// The pools by curve NID
+	std::map<int, CurvePool> pools;
+
+	// Statistics
+	unsigned long hits;
+	unsigned long misses;
+
+	// For thread safeness
+	Mutex* poolMutex;
+};
+
+#endif // !_SOFTHSM_V2_OSSLECDSANONCEPOOL_H
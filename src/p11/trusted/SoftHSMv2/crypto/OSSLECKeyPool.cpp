@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*****************************************************************************
+ OSSLECKeyPool.cpp
+
+ Pool of pre-generated elliptic curve key pairs
+ *****************************************************************************/
+
+#include "config.h"
+#if defined(WITH_ECC) || defined(WITH_EDDSA)
+#include "OSSLECKeyPool.h"
+#include <openssl/objects.h>
+
+// Constructor
+OSSLECKeyPool::OSSLECKeyPool(unsigned long poolSize)
+{
+	this->poolSize = poolSize;
+	hits = 0;
+	misses = 0;
+	poolMutex = MutexFactory::i()->getMutex();
+}
+
+// Destructor
+OSSLECKeyPool::~OSSLECKeyPool()
+{
+	clear();
+
+	MutexFactory::i()->recycleMutex(poolMutex);
+}
+
+#ifdef WITH_ECC
+// Take a pre-generated key pair on the named curve
+bool OSSLECKeyPool::takeEC(int nid, EC_KEY** eckey)
+{
+	if (eckey == NULL) return false;
+
+	PooledKey key;
+	if (!take(nid, key)) return false;
+
+	*eckey = key.eckey;
+
+	return true;
+}
+#endif
+
+#ifdef WITH_EDDSA
+// Take a pre-generated Edwards or Montgomery key pair
+bool OSSLECKeyPool::takeED(int nid, EVP_PKEY** pkey)
+{
+	if (pkey == NULL) return false;
+
+	PooledKey key;
+	if (!take(nid, key)) return false;
+
+	*pkey = key.pkey;
+
+	return true;
+}
+#endif
+
+// Take a key pair for the curve
+bool OSSLECKeyPool::take(int nid, PooledKey& key)
+{
+	if (poolSize == 0 || !isPooled(nid)) return false;
+
+	MutexLocker lock(poolMutex);
+
+	std::map<int, std::deque<PooledKey> >::iterator i = pools.find(nid);
+	if (i == pools.end())
+	{
+		// Remember the curve, so the next fill() generates keys for it
+		pools[nid] = std::deque<PooledKey>();
+
+		misses++;
+
+		return false;
+	}
+
+	if (i->second.empty())
+	{
+		misses++;
+
+		return false;
+	}
+
+	key = i->second.front();
+	i->second.pop_front();
+
+	hits++;
+
+	return true;
+}
+
+// Generate at most maxCount key pairs for the curves that were requested
+unsigned long OSSLECKeyPool::fill(unsigned long maxCount)
+{
+	unsigned long count = 0;
+
+	while (count < maxCount)
+	{
+		int nid = NID_undef;
+
+		// Find the curve with the fewest key pairs
+		{
+			MutexLocker lock(poolMutex);
+
+			size_t fewest = poolSize;
+			for (std::map<int, std::deque<PooledKey> >::iterator i = pools.begin(); i != pools.end(); i++)
+			{
+				if (i->second.size() < fewest)
+				{
+					fewest = i->second.size();
+					nid = i->first;
+				}
+			}
+		}
+
+		if (nid == NID_undef) break;
+
+		// The key is generated without holding the mutex
+		PooledKey key;
+		if (!generate(nid, key))
+		{
+			// ERROR_MSG("Could not generate a key pair for curve %d", nid);
+
+			break;
+		}
+
+		MutexLocker lock(poolMutex);
+
+		std::map<int, std::deque<PooledKey> >::iterator i = pools.find(nid);
+		if (i == pools.end() || i->second.size() >= poolSize)
+		{
+			freeKey(key);
+
+			break;
+		}
+
+		i->second.push_back(key);
+
+		count++;
+	}
+
+	return count;
+}
+
+// Wipe all key pairs
+void OSSLECKeyPool::clear()
+{
+	MutexLocker lock(poolMutex);
+
+	for (std::map<int, std::deque<PooledKey> >::iterator i = pools.begin(); i != pools.end(); i++)
+	{
+		for (std::deque<PooledKey>::iterator j = i->second.begin(); j != i->second.end(); j++)
+		{
+			freeKey(*j);
+		}
+
+		i->second.clear();
+	}
+}
+
+// Is the pool of a curve down to half of its size?
+bool OSSLECKeyPool::isLow()
+{
+	if (poolSize == 0) return false;
+
+	MutexLocker lock(poolMutex);
+
+	for (std::map<int, std::deque<PooledKey> >::iterator i = pools.begin(); i != pools.end(); i++)
+	{
+		if (i->second.size() <= poolSize / 2)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Statistics
+unsigned long OSSLECKeyPool::getHits()
+{
+	MutexLocker lock(poolMutex);
+
+	return hits;
+}
+
+unsigned long OSSLECKeyPool::getMisses()
+{
+	MutexLocker lock(poolMutex);
+
+	return misses;
+}
+
+unsigned long OSSLECKeyPool::getSize()
+{
+	MutexLocker lock(poolMutex);
+
+	unsigned long size = 0;
+	for (std::map<int, std::deque<PooledKey> >::iterator i = pools.begin(); i != pools.end(); i++)
+	{
+		size += i->second.size();
+	}
+
+	return size;
+}
+
+// Is the curve pooled?
+/*static*/ bool OSSLECKeyPool::isPooled(int nid)
+{
+	switch (nid)
+	{
+#ifdef WITH_ECC
+		case NID_X9_62_prime256v1:
+		case NID_secp384r1:
+			return true;
+#endif
+#ifdef WITH_EDDSA
+		case NID_ED25519:
+		case NID_X25519:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+// Generate a key pair on the curve
+/*static*/ bool OSSLECKeyPool::generate(int nid, PooledKey& key)
+{
+	key.eckey = NULL;
+	key.pkey = NULL;
+
+	switch (nid)
+	{
+#ifdef WITH_ECC
+		case NID_X9_62_prime256v1:
+		case NID_secp384r1:
+			key.eckey = EC_KEY_new_by_curve_name(nid);
+			if (key.eckey == NULL || !EC_KEY_generate_key(key.eckey))
+			{
+				freeKey(key);
+
+				return false;
+			}
+
+			return true;
+#endif
+#ifdef WITH_EDDSA
+		case NID_ED25519:
+		case NID_X25519:
+		{
+			EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(nid, NULL);
+			if (ctx == NULL) return false;
+
+			if (EVP_PKEY_keygen_init(ctx) != 1 ||
+			    EVP_PKEY_keygen(ctx, &key.pkey) != 1)
+			{
+				EVP_PKEY_CTX_free(ctx);
+				freeKey(key);
+
+				return false;
+			}
+
+			EVP_PKEY_CTX_free(ctx);
+
+			return true;
+		}
+#endif
+		default:
+			return false;
+	}
+}
+
+// Wipe a key pair; the OpenSSL free functions clear the private values
+/*static*/ void OSSLECKeyPool::freeKey(PooledKey& key)
+{
+	EC_KEY_free(key.eckey);
+	EVP_PKEY_free(key.pkey);
+
+	key.eckey = NULL;
+	key.pkey = NULL;
+}
+#endif
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*****************************************************************************
+ OSSLECKeyPool.h
+
+ Pool of pre-generated elliptic curve key pairs for the curves that are used
+ for ephemeral keys: P-256 and P-384 (ECDSA and ECDH), and Ed25519 and X25519.
+ Key pairs are generated ahead of time, while the token is idle, and every
+ key pair is handed out exactly once.
+ *****************************************************************************/
+
+#ifndef _SOFTHSM_V2_OSSLECKEYPOOL_H
+#define _SOFTHSM_V2_OSSLECKEYPOOL_H
+
+#include "config.h"
+#include "MutexFactory.h"
+#include <deque>
+#include <map>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+
+class OSSLECKeyPool
+{
+public:
+	// Constructor; poolSize is the number of key pairs kept per curve
+	OSSLECKeyPool(unsigned long poolSize);
+
+	OSSLECKeyPool(const OSSLECKeyPool&) = delete;
+
+	OSSLECKeyPool& operator=(const OSSLECKeyPool&) = delete;
+
+	// Destructor; wipes all key pairs
+	virtual ~OSSLECKeyPool();
+
+#ifdef WITH_ECC
+	// Take a pre-generated key pair on the named curve; the caller owns the
+	// key and must free it with EC_KEY_free. Returns false if there is none;
+	// the curve is then filled by the next fill().
+	bool takeEC(int nid, EC_KEY** eckey);
+#endif
+
+#ifdef WITH_EDDSA
+	// Take a pre-generated Edwards or Montgomery key pair; the caller owns
+	// the key and must free it with EVP_PKEY_free. Returns false if there is
+	// none; the curve is then filled by the next fill().
+	bool takeED(int nid, EVP_PKEY** pkey);
+#endif
+
+	// Generate at most maxCount key pairs for the curves that were
+	// requested; returns the number of key pairs generated
+	unsigned long fill(unsigned long maxCount);
+
+	// Is the pool of a curve down to half of its size?
+	bool isLow();
+
+	// Wipe all key pairs
+	void clear();
+
+	// Statistics
+	unsigned long getHits();
+	unsigned long getMisses();
+	unsigned long getSize();
+
+private:
+	// A pooled key pair; eckey is used for the Weierstrass curves and pkey
+	// for the Edwards and Montgomery curves
+	struct PooledKey
+	{
+		EC_KEY* eckey;
+		EVP_PKEY* pkey;
+	};
+
+	// Is the curve pooled?
+	static bool isPooled(int nid);
+
+	// Generate a key pair on the curve
+	static bool generate(int nid, PooledKey& key);
+
+	// Wipe a key pair
+	static void freeKey(PooledKey& key);
+
+	// Take a key pair for the curve
+	bool take(int nid, PooledKey& key);
+
+	// The number of key pairs kept per curve
+	unsigned long poolSize;
+
+	// The key pairs by curve NID
+	std::map<int, std::deque<PooledKey> > pools;
+
+	// Statistics
+	unsigned long hits;
+	unsigned long misses;
+
+	// For thread safeness
+	Mutex* poolMutex;
+};
+
+#endif // !_SOFTHSM_V2_OSSLECKEYPOOL_H
@@ -65,6 +65,7 @@
 #ifdef WITH_EDDSA
 #include "OSSLEDDSA.h"
 #include "CryptoFactory.h"
+#include "OSSLCryptoFactory.h"
 #include "ECParameters.h"
 #include "OSSLEDKeyPair.h"
 #include "OSSLComp.h"
@@ -75,6 +76,18 @@
 #include <openssl/err.h>
 #include <string.h>
 
+// Constructor
+OSSLEDDSA::OSSLEDDSA()
+{
+	peerKey = NULL;
+}
+
+// Destructor
+OSSLEDDSA::~OSSLEDDSA()
+{
+	EVP_PKEY_free(peerKey);
+}
+
 // Signing functions
 bool OSSLEDDSA::sign(PrivateKey* privateKey, const ByteString& dataToSign,
 		     ByteString& signature, const AsymMech::Type mechanism,
@@ -286,30 +299,37 @@ bool OSSLEDDSA::generateKeyPair(AsymmetricKeyPair** ppKeyPair, AsymmetricParamet
 	ECParameters* params = (ECParameters*) parameters;
 	int nid = OSSL::byteString2oid(params->getEC());
 
-	// Generate the key-pair
+	// Use a pre-generated key-pair if there is one
 	EVP_PKEY* pkey = NULL;
-	EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(nid, NULL);
-	if (ctx == NULL)
-	{
-		// ERROR_MSG("Failed to instantiate OpenSSL EDDSA context");
-
-		return false;
-	}
-	int ret = EVP_PKEY_keygen_init(ctx);
-	if (ret != 1)
-	{
-		// ERROR_MSG("EDDSA key generation init failed (0x%08X)", ERR_get_error());
+	if (!OSSLCryptoFactory::i()->getECKeyPool()->takeED(nid, &pkey))
+	{
+		// Generate the key-pair
+		EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(nid, NULL);
+		if (ctx == NULL)
+		{
+			// ERROR_MSG("Failed to instantiate OpenSSL EDDSA context");
+
+			return false;
+		}
+		int ret = EVP_PKEY_keygen_init(ctx);
+		if (ret != 1)
+		{
+			// ERROR_MSG("EDDSA key generation init failed (0x%08X)", ERR_get_error());
+			EVP_PKEY_CTX_free(ctx);
+			return false;
+		}
+		ret = EVP_PKEY_keygen(ctx, &pkey);
+		if (ret != 1)
+		{
+			// ERROR_MSG("EDDSA key generation failed (0x%08X)", ERR_get_error());
+			EVP_PKEY_CTX_free(ctx);
+			return false;
+		}
 		EVP_PKEY_CTX_free(ctx);
-		return false;
 	}
-	ret = EVP_PKEY_keygen(ctx, &pkey);
-	if (ret != 1)
-	{
-		// ERROR_MSG("EDDSA key generation failed (0x%08X)", ERR_get_error());
-		EVP_PKEY_CTX_free(ctx);
-		return false;
-	}
-	EVP_PKEY_CTX_free(ctx);
+
+	// Top up the pool in the background
+	OSSLCryptoFactory::i()->refillPools();
 
 	// Create an asymmetric key-pair object to return
 	OSSLEDKeyPair* kp = new OSSLEDKeyPair();
@@ -345,6 +365,55 @@ bool OSSLEDDSA::deriveKey(SymmetricKey **ppSymmetricKey, PublicKey* publicKey, P
 		return false;
 	}
 
+	return derive(ppSymmetricKey, pub, priv);
+}
+
+// Derive with the raw X25519 or X448 public key of the peer, without
+// building a public key object for it
+bool OSSLEDDSA::deriveRawKey(SymmetricKey **ppSymmetricKey, const ByteString& publicData, PrivateKey* privateKey)
+{
+	// Check parameters
+	if ((ppSymmetricKey == NULL) ||
+	    (privateKey == NULL))
+	{
+		return false;
+	}
+
+	EVP_PKEY *priv = ((OSSLEDPrivateKey *)privateKey)->getOSSLKey();
+	if (priv == NULL)
+	{
+		// ERROR_MSG("Failed to get OpenSSL ECDH keys");
+
+		return false;
+	}
+
+	int type = EVP_PKEY_id(priv);
+	if (type != NID_X25519 && type != NID_X448)
+	{
+		// ERROR_MSG("Key type does not support key derivation");
+
+		return false;
+	}
+
+	if (peerKey == NULL || EVP_PKEY_id(peerKey) != type || peerData != publicData)
+	{
+		EVP_PKEY_free(peerKey);
+		peerKey = EVP_PKEY_new_raw_public_key(type, NULL, publicData.const_byte_str(), publicData.size());
+		peerData = publicData;
+		if (peerKey == NULL)
+		{
+			// ERROR_MSG("Invalid public key of the peer");
+
+			return false;
+		}
+	}
+
+	return derive(ppSymmetricKey, peerKey, priv);
+}
+
+// Derive the secret of the keys
+bool OSSLEDDSA::derive(SymmetricKey **ppSymmetricKey, EVP_PKEY* pub, EVP_PKEY* priv)
+{
 	// Get and set context
 	EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(priv, NULL);
 	if (ctx == NULL)
@@ -368,9 +437,10 @@ bool OSSLEDDSA::deriveKey(SymmetricKey **ppSymmetricKey, PublicKey* publicKey, P
 		return false;
 	}
 
-	// Derive the secret
-	size_t len;
-	if (EVP_PKEY_derive(ctx, NULL, &len) <= 0)
+	// Derive the secret; the length is known for X25519 and X448
+	size_t len = (EVP_PKEY_id(priv) == NID_X448) ? 56 : 32;
+	if (EVP_PKEY_id(priv) != NID_X25519 && EVP_PKEY_id(priv) != NID_X448 &&
+	    EVP_PKEY_derive(ctx, NULL, &len) <= 0)
 	{
 		// ERROR_MSG("Failed to get OpenSSL ECDH key length");
 
@@ -387,6 +457,7 @@ bool OSSLEDDSA::deriveKey(SymmetricKey **ppSymmetricKey, PublicKey* publicKey, P
 		return false;
 	}
 	EVP_PKEY_CTX_free(ctx);
+	secret.resize(len);
 
 	// Create derived key
 	*ppSymmetricKey = new SymmetricKey(secret.size() * 8);
@@ -40,8 +40,11 @@
 class OSSLEDDSA : public AsymmetricAlgorithm
 {
 public:
+	// Constructor
+	OSSLEDDSA();
+
 	// Destructor
-	virtual ~OSSLEDDSA() { }
+	virtual ~OSSLEDDSA();
 
 	// Signing functions
 	virtual bool sign(PrivateKey* privateKey, const ByteString& dataToSign, ByteString& signature, const AsymMech::Type mechanism, const void* param = NULL, const size_t paramLen = 0);
@@ -66,6 +69,7 @@ public:
 	virtual unsigned long getMinKeySize();
 	virtual unsigned long getMaxKeySize();
 	virtual bool deriveKey(SymmetricKey **ppSymmetricKey, PublicKey* publicKey, PrivateKey* privateKey);
+	virtual bool deriveRawKey(SymmetricKey **ppSymmetricKey, const ByteString& publicData, PrivateKey* privateKey);
 	virtual bool reconstructKeyPair(AsymmetricKeyPair** ppKeyPair, ByteString& serialisedData);
 	virtual bool reconstructPublicKey(PublicKey** ppPublicKey, ByteString& serialisedData);
 	virtual bool reconstructPrivateKey(PrivateKey** ppPrivateKey, ByteString& serialisedData);
@@ -75,6 +79,13 @@ public:
 	virtual AsymmetricParameters* newParameters();
 
 private:
+	// Derive the secret of the keys
+	static bool derive(SymmetricKey **ppSymmetricKey, EVP_PKEY* pub, EVP_PKEY* priv);
+
+	// The last raw public key of a peer; a peer deriving several keys is
+	// only parsed once
+	ByteString peerData;
+	EVP_PKEY* peerKey;
 };
 
 #endif // !_SOFTHSM_V2_OSSLEDDSA_H
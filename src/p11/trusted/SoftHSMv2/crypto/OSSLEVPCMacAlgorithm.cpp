@@ -66,6 +66,7 @@
 #include "config.h"
 #include "OSSLEVPCMacAlgorithm.h"
 #include "OSSLComp.h"
+#include "OSSLCryptoFactory.h"
 #include <openssl/err.h>
 
 // Destructor
@@ -105,8 +106,8 @@ bool OSSLEVPCMacAlgorithm::signInit(const SymmetricKey* key)
 		return false;
 	}
 
-	// Initialize EVP signing
-	if (!CMAC_Init(curCTX, key->getKeyBits().const_byte_str(), key->getKeyBits().size(), cipher, NULL))
+	// Initialize EVP signing from the cached key state
+	if (!OSSLCryptoFactory::i()->getMacKeyCache()->initCMAC(curCTX, key, cipher))
 	{
 		// ERROR_MSG("CMAC_Init failed: %s", ERR_error_string(ERR_get_error(), NULL));
 
@@ -205,8 +206,8 @@ bool OSSLEVPCMacAlgorithm::verifyInit(const SymmetricKey* key)
 		return false;
 	}
 
-	// Initialize EVP signing
-	if (!CMAC_Init(curCTX, key->getKeyBits().const_byte_str(), key->getKeyBits().size(), cipher, NULL))
+	// Initialize EVP signing from the cached key state
+	if (!OSSLCryptoFactory::i()->getMacKeyCache()->initCMAC(curCTX, key, cipher))
 	{
 		// ERROR_MSG("CMAC_Init failed: %s", ERR_error_string(ERR_get_error(), NULL));
 
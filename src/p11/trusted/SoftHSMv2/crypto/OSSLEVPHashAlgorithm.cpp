@@ -79,8 +79,11 @@ bool OSSLEVPHashAlgorithm::hashInit()
 		return false;
 	}
 
-	// Initialize the context
-	curCTX = EVP_MD_CTX_new();
+	// Initialize the context; it is kept for the next operation on this object
+	if (curCTX == NULL)
+	{
+		curCTX = EVP_MD_CTX_new();
+	}
 	if (curCTX == NULL)
 	{
 		// ERROR_MSG("Failed to allocate space for EVP_MD_CTX");
@@ -156,9 +159,15 @@ bool OSSLEVPHashAlgorithm::hashFinal(ByteString& hashedData)
 
 	hashedData.resize(outLen);
 
-	EVP_MD_CTX_free(curCTX);
-	curCTX = NULL;
-
 	return true;
 }
 
+void OSSLEVPHashAlgorithm::reset()
+{
+	HashAlgorithm::reset();
+
+	if (curCTX != NULL)
+	{
+		EVP_MD_CTX_reset(curCTX);
+	}
+}
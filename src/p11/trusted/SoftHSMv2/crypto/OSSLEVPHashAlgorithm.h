@@ -54,6 +54,10 @@ public:
 	virtual bool hashFinal(ByteString& hashedData);
 
 	virtual int getHashSize() = 0;
+
+	// Wipe the context but keep it allocated
+	virtual void reset();
+
 protected:
 	virtual const EVP_MD* getEVPHash() const = 0;
 
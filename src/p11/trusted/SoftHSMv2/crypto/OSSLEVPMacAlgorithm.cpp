@@ -66,6 +66,7 @@
 #include "config.h"
 #include "OSSLEVPMacAlgorithm.h"
 #include "OSSLComp.h"
+#include "OSSLCryptoFactory.h"
 
 // Destructor
 OSSLEVPMacAlgorithm::~OSSLEVPMacAlgorithm()
@@ -82,8 +83,11 @@ bool OSSLEVPMacAlgorithm::signInit(const SymmetricKey* key)
 		return false;
 	}
 
-	// Initialize the context
-	curCTX = HMAC_CTX_new();
+	// Initialize the context; it is kept for the next operation on this object
+	if (curCTX == NULL)
+	{
+		curCTX = HMAC_CTX_new();
+	}
 	if (curCTX == NULL)
 	{
 		// ERROR_MSG("Failed to allocate space for HMAC_CTX");
@@ -91,8 +95,8 @@ bool OSSLEVPMacAlgorithm::signInit(const SymmetricKey* key)
 		return false;
 	}
 
-	// Initialize EVP signing
-	if (!HMAC_Init_ex(curCTX, key->getKeyBits().const_byte_str(), key->getKeyBits().size(), getEVPHash(), NULL))
+	// Initialize EVP signing from the cached key state
+	if (!OSSLCryptoFactory::i()->getMacKeyCache()->initHMAC(curCTX, key, getEVPHash()))
 	{
 		// ERROR_MSG("HMAC_Init failed");
 
@@ -156,8 +160,8 @@ bool OSSLEVPMacAlgorithm::signFinal(ByteString& signature)
 
 	signature.resize(outLen);
 
-	HMAC_CTX_free(curCTX);
-	curCTX = NULL;
+	// Wipe the key state
+	HMAC_CTX_reset(curCTX);
 
 	return true;
 }
@@ -171,8 +175,11 @@ bool OSSLEVPMacAlgorithm::verifyInit(const SymmetricKey* key)
 		return false;
 	}
 
-	// Initialize the context
-	curCTX = HMAC_CTX_new();
+	// Initialize the context; it is kept for the next operation on this object
+	if (curCTX == NULL)
+	{
+		curCTX = HMAC_CTX_new();
+	}
 	if (curCTX == NULL)
 	{
 		// ERROR_MSG("Failed to allocate space for HMAC_CTX");
@@ -180,8 +187,8 @@ bool OSSLEVPMacAlgorithm::verifyInit(const SymmetricKey* key)
 		return false;
 	}
 
-	// Initialize EVP signing
-	if (!HMAC_Init_ex(curCTX, key->getKeyBits().const_byte_str(), key->getKeyBits().size(), getEVPHash(), NULL))
+	// Initialize EVP signing from the cached key state
+	if (!OSSLCryptoFactory::i()->getMacKeyCache()->initHMAC(curCTX, key, getEVPHash()))
 	{
 		// ERROR_MSG("HMAC_Init failed");
 
@@ -244,8 +251,18 @@ bool OSSLEVPMacAlgorithm::verifyFinal(ByteString& signature)
 		return false;
 	}
 
-	HMAC_CTX_free(curCTX);
-	curCTX = NULL;
+	// Wipe the key state
+	HMAC_CTX_reset(curCTX);
 
 	return macResult == signature;
 }
+
+void OSSLEVPMacAlgorithm::reset()
+{
+	MacAlgorithm::reset();
+
+	if (curCTX != NULL)
+	{
+		HMAC_CTX_reset(curCTX);
+	}
+}
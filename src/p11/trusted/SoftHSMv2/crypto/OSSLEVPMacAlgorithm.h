@@ -64,6 +64,9 @@ public:
 	// Return the MAC size
 	virtual size_t getMacSize() const = 0;
 
+	// Wipe the context but keep it allocated
+	virtual void reset();
+
 protected:
 	// Return the right hash for the operation
 	virtual const EVP_MD* getEVPHash() const = 0;
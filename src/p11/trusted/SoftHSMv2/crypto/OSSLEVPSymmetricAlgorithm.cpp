@@ -65,8 +65,63 @@
 
 #include "config.h"
 #include "OSSLEVPSymmetricAlgorithm.h"
+#include "OSSLCryptoFactory.h"
 #include "OSSLUtil.h"
+#include "OSSLComp.h"
 #include <openssl/err.h>
+#include <string.h>
+#include <pthread.h>
+
+// Updates of at least this size are split over worker threads
+#define PARALLEL_CRYPT_MIN_BYTES	(1024 * 1024)
+
+// Worker threads besides the calling one; each takes a spare TCS
+#define PARALLEL_CRYPT_WORKERS		MAX_WORKER_THREADS
+
+// One slice of a parallel CTR or ECB update
+struct ParallelCryptJob
+{
+	const EVP_CIPHER* cipher;
+	const unsigned char* key;
+	unsigned char iv[EVP_MAX_IV_LENGTH];
+	int enc;
+	const unsigned char* in;
+	unsigned char* out;
+	size_t len;
+	bool ok;
+};
+
+static void* parallelCryptWorker(void* arg)
+{
+	ParallelCryptJob* job = (ParallelCryptJob*) arg;
+	EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+	int outLen = 0;
+
+	job->ok = (ctx != NULL) &&
+		  EVP_CipherInit_ex(ctx, job->cipher, NULL, job->key, job->iv, job->enc) &&
+		  EVP_CIPHER_CTX_set_padding(ctx, 0) &&
+		  EVP_CipherUpdate(ctx, job->out, &outLen, job->in, job->len) &&
+		  ((size_t) outLen == job->len);
+
+	EVP_CIPHER_CTX_free(ctx);
+
+	return NULL;
+}
+
+// Add a number of blocks to a big endian counter block
+static void addCounter(unsigned char* counter, size_t len, unsigned long long blocks)
+{
+	unsigned int carry = 0;
+
+	for (size_t i = len; i > 0 && (blocks > 0 || carry > 0); i--)
+	{
+		unsigned int sum = counter[i - 1] + (unsigned int) (blocks & 0xFF) + carry;
+
+		counter[i - 1] = (unsigned char) sum;
+		carry = sum >> 8;
+		blocks >>= 8;
+	}
+}
 
 // Constructor
 OSSLEVPSymmetricAlgorithm::OSSLEVPSymmetricAlgorithm()
@@ -74,6 +129,8 @@ OSSLEVPSymmetricAlgorithm::OSSLEVPSymmetricAlgorithm()
 	pCurCTX = NULL;
 	maximumBytes = NULL;
 	counterBytes = NULL;
+	processedBytes = 0;
+	streamSegmentNumber = 0;
 }
 
 // Destructor
@@ -129,25 +186,314 @@ void OSSLEVPSymmetricAlgorithm::counterBitsInit(const ByteString& iv, size_t cou
 	}
 }
 
+// Return a clean EVP context; the context of an earlier operation is reused
+EVP_CIPHER_CTX* OSSLEVPSymmetricAlgorithm::newContext()
+{
+	if (pCurCTX == NULL)
+	{
+		return EVP_CIPHER_CTX_new();
+	}
+
+	EVP_CIPHER_CTX_reset(pCurCTX);
+
+	return pCurCTX;
+}
+
 void OSSLEVPSymmetricAlgorithm::clean()
 {
-		EVP_CIPHER_CTX_free(pCurCTX);
-		pCurCTX = NULL;
+		// Wipe the key schedule but keep the context allocated
+		EVP_CIPHER_CTX_reset(pCurCTX);
 		BN_free(maximumBytes);
 		maximumBytes = NULL;
 		BN_free(counterBytes);
 		counterBytes = NULL;
+		streamNonce.wipe();
+		streamAAD.wipe();
+}
+
+// Segmented AEAD (STREAM) construction: every segment is sealed with its own
+// GCM tag under the nonce prefix || segment number (32 bits) || last flag, so
+// that plaintext can be released per segment and truncation is detected
+bool OSSLEVPSymmetricAlgorithm::streamInit(const ByteString& noncePrefix, const ByteString& aad)
+{
+	if ((noncePrefix.size() != 7) || (currentSegmentBytes == 0) || (currentTagBytes == 0) || (currentTagBytes > 16))
+	{
+		// ERROR_MSG("Invalid nonce prefix (%d bytes), segment size (%d bytes) or tag size (%d bytes)", noncePrefix.size(), currentSegmentBytes, currentTagBytes);
+
+		return false;
+	}
+
+	const EVP_CIPHER* cipher = getCipher();
+
+	if (cipher == NULL)
+	{
+		return false;
+	}
+
+	pCurCTX = newContext();
+
+	if (pCurCTX == NULL)
+	{
+		// ERROR_MSG("Failed to allocate space for EVP_CIPHER_CTX");
+
+		return false;
+	}
+
+	// Key the context once; the nonce is set for each segment
+	int enc = (currentOperation == ENCRYPT) ? 1 : 0;
+	if (!EVP_CipherInit_ex(pCurCTX, cipher, NULL, NULL, NULL, enc) ||
+	    !EVP_CIPHER_CTX_ctrl(pCurCTX, EVP_CTRL_GCM_SET_IVLEN, 12, NULL) ||
+	    !EVP_CipherInit_ex(pCurCTX, NULL, NULL, (unsigned char*) currentKey->getKeyBits().const_byte_str(), NULL, enc))
+	{
+		// ERROR_MSG("Failed to initialise EVP stream operation: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		return false;
+	}
+
+	streamNonce = noncePrefix;
+	streamNonce.resize(12);
+	streamAAD = aad;
+	streamSegmentNumber = 0;
+	currentAEADBuffer.wipe();
+
+	return true;
+}
+
+bool OSSLEVPSymmetricAlgorithm::streamSegment(const unsigned char* in, size_t inLen, bool last, ByteString& out)
+{
+	bool encrypt = (currentOperation == ENCRYPT);
+	size_t tagBytes = currentTagBytes;
+
+	if ((streamSegmentNumber > 0xFFFFFFFFULL) || (!encrypt && inLen < tagBytes))
+	{
+		return false;
+	}
+
+	streamNonce[7] = (unsigned char) (streamSegmentNumber >> 24);
+	streamNonce[8] = (unsigned char) (streamSegmentNumber >> 16);
+	streamNonce[9] = (unsigned char) (streamSegmentNumber >> 8);
+	streamNonce[10] = (unsigned char) streamSegmentNumber;
+	streamNonce[11] = last ? 1 : 0;
+
+	if (!EVP_CipherInit_ex(pCurCTX, NULL, NULL, NULL, streamNonce.const_byte_str(), -1))
+	{
+		return false;
+	}
+
+	int outLen = 0;
+	if (streamAAD.size() && !EVP_CipherUpdate(pCurCTX, NULL, &outLen, streamAAD.const_byte_str(), streamAAD.size()))
+	{
+		return false;
+	}
+
+	size_t dataLen = encrypt ? inLen : inLen - tagBytes;
+	size_t offset = out.size();
+	out.resize(offset + dataLen + (encrypt ? tagBytes : 0));
+
+	outLen = 0;
+	bool ok = (dataLen == 0) || EVP_CipherUpdate(pCurCTX, &out[offset], &outLen, in, dataLen);
+
+	if (ok && !encrypt)
+	{
+		ok = EVP_CIPHER_CTX_ctrl(pCurCTX, EVP_CTRL_GCM_SET_TAG, tagBytes, (void*) (in + dataLen));
+	}
+
+	ByteString finalBlock;
+	finalBlock.resize(getBlockSize());
+
+	int finalLen = 0;
+	ok = ok && EVP_CipherFinal_ex(pCurCTX, &finalBlock[0], &finalLen) && ((size_t) (outLen + finalLen) == dataLen);
+
+	if (ok && encrypt)
+	{
+		ok = EVP_CIPHER_CTX_ctrl(pCurCTX, EVP_CTRL_GCM_GET_TAG, tagBytes, &out[offset + dataLen]);
+	}
+
+	if (!ok)
+	{
+		// Never release a segment that did not authenticate
+		// ERROR_MSG("Failed to process stream segment %llu", streamSegmentNumber);
+
+		if (out.size() > offset)
+		{
+			memset(&out[offset], 0, out.size() - offset);
+		}
+		out.resize(offset);
+
+		return false;
+	}
+
+	streamSegmentNumber++;
+
+	return true;
+}
+
+// The workers must start on a block boundary with nothing buffered by EVP
+bool OSSLEVPSymmetricAlgorithm::canUpdateInParallel(size_t len)
+{
+	if (len < PARALLEL_CRYPT_MIN_BYTES)
+	{
+		return false;
+	}
+
+	switch (currentCipherMode)
+	{
+		case SymMode::CTR:
+			return (processedBytes % getBlockSize()) == 0;
+		case SymMode::ECB:
+			// Padded ECB decryption holds back the last block
+			return !currentPaddingMode && (currentBufferSize == len);
+		default:
+			return false;
+	}
+}
+
+// Split an update over worker threads, each with its own context and counter
+// offset, writing straight into the output. The calling thread does the last
+// slice with the context of the operation, which leaves that context where a
+// serial update would have.
+bool OSSLEVPSymmetricAlgorithm::parallelUpdate(const ByteString& in, unsigned char* out, int& outLen)
+{
+	size_t blockSize = getBlockSize();
+	size_t sliceLen = (in.size() / (PARALLEL_CRYPT_WORKERS + 1)) / blockSize * blockSize;
+	int enc = (currentOperation == ENCRYPT) ? 1 : 0;
+
+	ParallelCryptJob jobs[PARALLEL_CRYPT_WORKERS];
+	pthread_t threads[PARALLEL_CRYPT_WORKERS];
+	bool started[PARALLEL_CRYPT_WORKERS];
+
+	for (size_t i = 0; i < PARALLEL_CRYPT_WORKERS; i++)
+	{
+		jobs[i].cipher = getCipher();
+		jobs[i].key = currentKey->getKeyBits().const_byte_str();
+		memset(jobs[i].iv, 0, sizeof(jobs[i].iv));
+		if (currentCipherMode == SymMode::CTR)
+		{
+			memcpy(jobs[i].iv, initialIV.const_byte_str(), blockSize);
+			addCounter(jobs[i].iv, blockSize, (processedBytes + i * sliceLen) / blockSize);
+		}
+		jobs[i].enc = enc;
+		jobs[i].in = in.const_byte_str() + i * sliceLen;
+		jobs[i].out = out + i * sliceLen;
+		jobs[i].len = sliceLen;
+		jobs[i].ok = false;
+
+		started[i] = OSSLCryptoFactory::i()->startWorker(&threads[i], parallelCryptWorker, &jobs[i]);
+	}
+
+	// Slices without a spare TCS are done by the calling thread
+	for (size_t i = 0; i < PARALLEL_CRYPT_WORKERS; i++)
+	{
+		if (!started[i])
+		{
+			parallelCryptWorker(&jobs[i]);
+		}
+	}
+
+	size_t offset = PARALLEL_CRYPT_WORKERS * sliceLen;
+	bool rv = true;
+
+	if (currentCipherMode == SymMode::CTR)
+	{
+		unsigned char iv[EVP_MAX_IV_LENGTH];
+
+		memcpy(iv, initialIV.const_byte_str(), blockSize);
+		addCounter(iv, blockSize, (processedBytes + offset) / blockSize);
+		rv = EVP_CipherInit_ex(pCurCTX, NULL, NULL, NULL, iv, -1);
+	}
+
+	outLen = 0;
+	rv = rv && EVP_CipherUpdate(pCurCTX, out + offset, &outLen, in.const_byte_str() + offset, in.size() - offset);
+
+	for (size_t i = 0; i < PARALLEL_CRYPT_WORKERS; i++)
+	{
+		if (started[i])
+		{
+			pthread_join(threads[i], NULL);
+		}
+
+		rv = rv && jobs[i].ok;
+	}
+
+	outLen += offset;
+
+	return rv;
+}
+
+bool OSSLEVPSymmetricAlgorithm::streamUpdate(const ByteString& in, size_t chunkBytes, ByteString& out)
+{
+	size_t pos = 0;
+
+	out.resize(0);
+
+	// Complete the pending segment first
+	if (currentAEADBuffer.size() > 0)
+	{
+		pos = chunkBytes - currentAEADBuffer.size();
+		if (pos > in.size())
+		{
+			pos = in.size();
+		}
+
+		currentAEADBuffer += in.substr(0, pos);
+
+		if (currentAEADBuffer.size() == chunkBytes)
+		{
+			if (!streamSegment(currentAEADBuffer.const_byte_str(), chunkBytes, false, out))
+			{
+				return false;
+			}
+
+			currentAEADBuffer.wipe();
+		}
+	}
+
+	// Complete segments are processed in place. A complete chunk is never the
+	// last one, since the final segment is always shorter than a full one.
+	while (in.size() - pos >= chunkBytes)
+	{
+		if (!streamSegment(in.const_byte_str() + pos, chunkBytes, false, out))
+		{
+			return false;
+		}
+
+		pos += chunkBytes;
+	}
+
+	if (pos < in.size())
+	{
+		currentAEADBuffer += in.substr(pos);
+	}
+
+	currentBufferSize = currentAEADBuffer.size();
+
+	return true;
 }
 
 // Encryption functions
-bool OSSLEVPSymmetricAlgorithm::encryptInit(const SymmetricKey* key, const SymMode::Type mode /* = SymMode::CBC */, const ByteString& IV /* = ByteString()*/, bool padding /* = true */, size_t counterBits /* = 0 */, const ByteString& aad /* = ByteString() */, size_t tagBytes /* = 0 */)
+bool OSSLEVPSymmetricAlgorithm::encryptInit(const SymmetricKey* key, const SymMode::Type mode /* = SymMode::CBC */, const ByteString& IV /* = ByteString()*/, bool padding /* = true */, size_t counterBits /* = 0 */, const ByteString& aad /* = ByteString() */, size_t tagBytes /* = 0 */, size_t segmentBytes /* = 0 */)
 {
 	// Call the superclass initialiser
-	if (!SymmetricAlgorithm::encryptInit(key, mode, IV, padding, counterBits, aad, tagBytes))
+	if (!SymmetricAlgorithm::encryptInit(key, mode, IV, padding, counterBits, aad, tagBytes, segmentBytes))
 	{
 		return false;
 	}
 
+	if (mode == SymMode::GCM_STREAM)
+	{
+		if (!streamInit(IV, aad))
+		{
+			clean();
+
+			ByteString dummy;
+			SymmetricAlgorithm::encryptFinal(dummy);
+
+			return false;
+		}
+
+		return true;
+	}
+
 	// Check the IV
 	if (mode != SymMode::GCM && (IV.size() > 0) && (IV.size() != getBlockSize()))
 	{
@@ -171,6 +517,8 @@ bool OSSLEVPSymmetricAlgorithm::encryptInit(const SymmetricKey* key, const SymMo
 	}
 
 	counterBitsInit(iv, counterBits);
+	initialIV = iv;
+	processedBytes = 0;
 
 	// Determine the cipher class
 	const EVP_CIPHER* cipher = getCipher();
@@ -186,7 +534,7 @@ bool OSSLEVPSymmetricAlgorithm::encryptInit(const SymmetricKey* key, const SymMo
 	}
 
 	// Allocate the EVP context
-	pCurCTX = EVP_CIPHER_CTX_new();
+	pCurCTX = newContext();
 
 	if (pCurCTX == NULL)
 	{
@@ -262,6 +610,22 @@ bool OSSLEVPSymmetricAlgorithm::encryptUpdate(const ByteString& data, ByteString
 		return true;
 	}
 
+	if (currentCipherMode == SymMode::GCM_STREAM)
+	{
+		if (!streamUpdate(data, currentSegmentBytes, encryptedData))
+		{
+			clean();
+			currentAEADBuffer.wipe();
+
+			ByteString dummy;
+			SymmetricAlgorithm::encryptFinal(dummy);
+
+			return false;
+		}
+
+		return true;
+	}
+
 	// Count number of bytes written
 	if (maximumBytes)
 	{
@@ -272,7 +636,20 @@ bool OSSLEVPSymmetricAlgorithm::encryptUpdate(const ByteString& data, ByteString
 	encryptedData.resize(data.size() + getBlockSize() - 1);
 
 	int outLen = encryptedData.size();
-	if (!EVP_EncryptUpdate(pCurCTX, &encryptedData[0], &outLen, (unsigned char*) data.const_byte_str(), data.size()))
+	bool rv;
+
+	// Large CTR and ECB updates are split over worker threads
+	if (canUpdateInParallel(data.size()))
+	{
+		rv = parallelUpdate(data, &encryptedData[0], outLen);
+	}
+	else
+	{
+		rv = EVP_EncryptUpdate(pCurCTX, &encryptedData[0], &outLen, (unsigned char*) data.const_byte_str(), data.size());
+	}
+	processedBytes += data.size();
+
+	if (!rv)
 	{
 		// ERROR_MSG("EVP_EncryptUpdate failed: %s", ERR_error_string(ERR_get_error(), NULL));
 
@@ -293,6 +670,22 @@ bool OSSLEVPSymmetricAlgorithm::encryptUpdate(const ByteString& data, ByteString
 
 bool OSSLEVPSymmetricAlgorithm::encryptFinal(ByteString& encryptedData)
 {
+	// The last segment carries the remaining bytes, possibly none
+	if ((currentCipherMode == SymMode::GCM_STREAM) && (currentOperation == ENCRYPT))
+	{
+		encryptedData.resize(0);
+
+		bool rv = streamSegment(currentAEADBuffer.size() ? currentAEADBuffer.const_byte_str() : NULL, currentAEADBuffer.size(), true, encryptedData);
+
+		currentAEADBuffer.wipe();
+
+		ByteString dummy;
+		SymmetricAlgorithm::encryptFinal(dummy);
+		clean();
+
+		return rv;
+	}
+
 	SymMode::Type mode = currentCipherMode;
 	size_t tagBytes = currentTagBytes;
 
@@ -333,14 +726,29 @@ bool OSSLEVPSymmetricAlgorithm::encryptFinal(ByteString& encryptedData)
 }
 
 // Decryption functions
-bool OSSLEVPSymmetricAlgorithm::decryptInit(const SymmetricKey* key, const SymMode::Type mode /* = SymMode::CBC */, const ByteString& IV /* = ByteString() */, bool padding /* = true */, size_t counterBits /* = 0 */, const ByteString& aad /* = ByteString() */, size_t tagBytes /* = 0 */)
+bool OSSLEVPSymmetricAlgorithm::decryptInit(const SymmetricKey* key, const SymMode::Type mode /* = SymMode::CBC */, const ByteString& IV /* = ByteString() */, bool padding /* = true */, size_t counterBits /* = 0 */, const ByteString& aad /* = ByteString() */, size_t tagBytes /* = 0 */, size_t segmentBytes /* = 0 */)
 {
 	// Call the superclass initialiser
-	if (!SymmetricAlgorithm::decryptInit(key, mode, IV, padding, counterBits, aad, tagBytes))
+	if (!SymmetricAlgorithm::decryptInit(key, mode, IV, padding, counterBits, aad, tagBytes, segmentBytes))
 	{
 		return false;
 	}
 
+	if (mode == SymMode::GCM_STREAM)
+	{
+		if (!streamInit(IV, aad))
+		{
+			clean();
+
+			ByteString dummy;
+			SymmetricAlgorithm::decryptFinal(dummy);
+
+			return false;
+		}
+
+		return true;
+	}
+
 	// Check the IV
 	if (mode != SymMode::GCM && (IV.size() > 0) && (IV.size() != getBlockSize()))
 	{
@@ -364,6 +772,8 @@ bool OSSLEVPSymmetricAlgorithm::decryptInit(const SymmetricKey* key, const SymMo
 	}
 
 	counterBitsInit(iv, counterBits);
+	initialIV = iv;
+	processedBytes = 0;
 
 	// Determine the cipher class
 	const EVP_CIPHER* cipher = getCipher();
@@ -379,7 +789,7 @@ bool OSSLEVPSymmetricAlgorithm::decryptInit(const SymmetricKey* key, const SymMo
 	}
 
 	// Allocate the EVP context
-	pCurCTX = EVP_CIPHER_CTX_new();
+	pCurCTX = newContext();
 
 	if (pCurCTX == NULL)
 	{
@@ -448,6 +858,22 @@ bool OSSLEVPSymmetricAlgorithm::decryptUpdate(const ByteString& encryptedData, B
 		return false;
 	}
 
+	// Segmented AEAD releases every segment once its tag is verified
+	if (currentCipherMode == SymMode::GCM_STREAM)
+	{
+		if (!streamUpdate(encryptedData, currentSegmentBytes + currentTagBytes, data))
+		{
+			clean();
+
+			ByteString dummy;
+			SymmetricAlgorithm::decryptFinal(dummy);
+
+			return false;
+		}
+
+		return true;
+	}
+
 	// AEAD ciphers should not return decrypted data until final is called
 	if (currentCipherMode == SymMode::GCM)
 	{
@@ -468,7 +894,20 @@ bool OSSLEVPSymmetricAlgorithm::decryptUpdate(const ByteString& encryptedData, B
 
 	// DEBUG_MSG("Decrypting %d bytes into buffer of %d bytes", encryptedData.size(), data.size());
 
-	if (!EVP_DecryptUpdate(pCurCTX, &data[0], &outLen, (unsigned char*) encryptedData.const_byte_str(), encryptedData.size()))
+	bool rv;
+
+	// Large CTR and ECB updates are split over worker threads
+	if (canUpdateInParallel(encryptedData.size()))
+	{
+		rv = parallelUpdate(encryptedData, &data[0], outLen);
+	}
+	else
+	{
+		rv = EVP_DecryptUpdate(pCurCTX, &data[0], &outLen, (unsigned char*) encryptedData.const_byte_str(), encryptedData.size());
+	}
+	processedBytes += encryptedData.size();
+
+	if (!rv)
 	{
 		// ERROR_MSG("EVP_DecryptUpdate failed: %s", ERR_error_string(ERR_get_error(), NULL));
 
@@ -491,6 +930,25 @@ bool OSSLEVPSymmetricAlgorithm::decryptUpdate(const ByteString& encryptedData, B
 
 bool OSSLEVPSymmetricAlgorithm::decryptFinal(ByteString& data)
 {
+	// Only a short segment can be the last one; anything else is truncated
+	if ((currentCipherMode == SymMode::GCM_STREAM) && (currentOperation == DECRYPT))
+	{
+		size_t pending = currentAEADBuffer.size();
+		bool rv = (pending >= currentTagBytes) && (pending < currentSegmentBytes + currentTagBytes);
+
+		data.resize(0);
+		if (rv)
+		{
+			rv = streamSegment(currentAEADBuffer.const_byte_str(), pending, true, data);
+		}
+
+		ByteString dummy;
+		SymmetricAlgorithm::decryptFinal(dummy);
+		clean();
+
+		return rv;
+	}
+
 	SymMode::Type mode = currentCipherMode;
 	size_t tagBytes = currentTagBytes;
 	ByteString aeadBuffer = currentAEADBuffer;
@@ -557,6 +1015,258 @@ bool OSSLEVPSymmetricAlgorithm::decryptFinal(ByteString& data)
 	return true;
 }
 
+// Message-based encryption functions
+bool OSSLEVPSymmetricAlgorithm::messageEncryptInit(const SymmetricKey* key, const SymMode::Type mode /* = SymMode::GCM */)
+{
+	// Call the superclass initialiser
+	if (!SymmetricAlgorithm::messageEncryptInit(key, mode))
+	{
+		return false;
+	}
+
+	// Only AEAD modes carry a per-message IV and tag
+	const EVP_CIPHER* cipher = (mode == SymMode::GCM) ? getCipher() : NULL;
+
+	if (cipher == NULL)
+	{
+		// ERROR_MSG("Failed to initialise EVP message encrypt operation");
+
+		SymmetricAlgorithm::messageEncryptFinal();
+
+		return false;
+	}
+
+	// Allocate the EVP context
+	pCurCTX = newContext();
+
+	if (pCurCTX == NULL)
+	{
+		// ERROR_MSG("Failed to allocate space for EVP_CIPHER_CTX");
+
+		SymmetricAlgorithm::messageEncryptFinal();
+
+		return false;
+	}
+
+	// Expand the key once; every message only sets a new IV
+	if (!EVP_EncryptInit_ex(pCurCTX, cipher, NULL, (unsigned char*) currentKey->getKeyBits().const_byte_str(), NULL))
+	{
+		// ERROR_MSG("Failed to initialise EVP message encrypt operation: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		clean();
+
+		SymmetricAlgorithm::messageEncryptFinal();
+
+		return false;
+	}
+
+	return true;
+}
+
+bool OSSLEVPSymmetricAlgorithm::encryptMessage(const ByteString& IV, const ByteString& aad, const ByteString& data, ByteString& encryptedData, ByteString& tag, size_t tagBytes)
+{
+	if (!SymmetricAlgorithm::encryptMessage(IV, aad, data, encryptedData, tag, tagBytes))
+	{
+		return false;
+	}
+
+	if (IV.size() == 0 || tagBytes == 0 || tagBytes > 16)
+	{
+		// ERROR_MSG("Invalid IV size (%d bytes) or tag size (%d bytes)", IV.size(), tagBytes);
+
+		return false;
+	}
+
+	// A failed message leaves the key set up for the next one
+	if (!EVP_CIPHER_CTX_ctrl(pCurCTX, EVP_CTRL_GCM_SET_IVLEN, IV.size(), NULL) ||
+	    !EVP_EncryptInit_ex(pCurCTX, NULL, NULL, NULL, (unsigned char*) IV.const_byte_str()))
+	{
+		// ERROR_MSG("Failed to set the message IV: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		return false;
+	}
+
+	int outLen = 0;
+	if (aad.size() && !EVP_EncryptUpdate(pCurCTX, NULL, &outLen, (unsigned char*) aad.const_byte_str(), aad.size()))
+	{
+		// ERROR_MSG("Failed to update with AAD: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		return false;
+	}
+
+	// GCM is a stream mode; the output has the size of the input
+	encryptedData.resize(data.size());
+
+	outLen = 0;
+	if (data.size() && !EVP_EncryptUpdate(pCurCTX, &encryptedData[0], &outLen, (unsigned char*) data.const_byte_str(), data.size()))
+	{
+		// ERROR_MSG("EVP_EncryptUpdate failed: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		encryptedData.wipe();
+
+		return false;
+	}
+
+	ByteString finalBlock;
+	finalBlock.resize(getBlockSize());
+
+	int finalLen = 0;
+	if (!EVP_EncryptFinal_ex(pCurCTX, &finalBlock[0], &finalLen) || (outLen + finalLen) != (int) data.size())
+	{
+		// ERROR_MSG("EVP_EncryptFinal failed: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		encryptedData.wipe();
+
+		return false;
+	}
+
+	tag.resize(tagBytes);
+	if (!EVP_CIPHER_CTX_ctrl(pCurCTX, EVP_CTRL_GCM_GET_TAG, tagBytes, &tag[0]))
+	{
+		// ERROR_MSG("Failed to get the message tag: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		encryptedData.wipe();
+		tag.wipe();
+
+		return false;
+	}
+
+	return true;
+}
+
+bool OSSLEVPSymmetricAlgorithm::messageEncryptFinal()
+{
+	clean();
+
+	return SymmetricAlgorithm::messageEncryptFinal();
+}
+
+// Message-based decryption functions
+bool OSSLEVPSymmetricAlgorithm::messageDecryptInit(const SymmetricKey* key, const SymMode::Type mode /* = SymMode::GCM */)
+{
+	// Call the superclass initialiser
+	if (!SymmetricAlgorithm::messageDecryptInit(key, mode))
+	{
+		return false;
+	}
+
+	// Only AEAD modes carry a per-message IV and tag
+	const EVP_CIPHER* cipher = (mode == SymMode::GCM) ? getCipher() : NULL;
+
+	if (cipher == NULL)
+	{
+		// ERROR_MSG("Failed to initialise EVP message decrypt operation");
+
+		SymmetricAlgorithm::messageDecryptFinal();
+
+		return false;
+	}
+
+	// Allocate the EVP context
+	pCurCTX = newContext();
+
+	if (pCurCTX == NULL)
+	{
+		// ERROR_MSG("Failed to allocate space for EVP_CIPHER_CTX");
+
+		SymmetricAlgorithm::messageDecryptFinal();
+
+		return false;
+	}
+
+	// Expand the key once; every message only sets a new IV
+	if (!EVP_DecryptInit_ex(pCurCTX, cipher, NULL, (unsigned char*) currentKey->getKeyBits().const_byte_str(), NULL))
+	{
+		// ERROR_MSG("Failed to initialise EVP message decrypt operation: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		clean();
+
+		SymmetricAlgorithm::messageDecryptFinal();
+
+		return false;
+	}
+
+	return true;
+}
+
+bool OSSLEVPSymmetricAlgorithm::decryptMessage(const ByteString& IV, const ByteString& aad, const ByteString& encryptedData, const ByteString& tag, ByteString& data)
+{
+	if (!SymmetricAlgorithm::decryptMessage(IV, aad, encryptedData, tag, data))
+	{
+		return false;
+	}
+
+	if (IV.size() == 0 || tag.size() == 0 || tag.size() > 16)
+	{
+		// ERROR_MSG("Invalid IV size (%d bytes) or tag size (%d bytes)", IV.size(), tag.size());
+
+		return false;
+	}
+
+	// A failed message leaves the key set up for the next one
+	if (!EVP_CIPHER_CTX_ctrl(pCurCTX, EVP_CTRL_GCM_SET_IVLEN, IV.size(), NULL) ||
+	    !EVP_DecryptInit_ex(pCurCTX, NULL, NULL, NULL, (unsigned char*) IV.const_byte_str()))
+	{
+		// ERROR_MSG("Failed to set the message IV: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		return false;
+	}
+
+	int outLen = 0;
+	if (aad.size() && !EVP_DecryptUpdate(pCurCTX, NULL, &outLen, (unsigned char*) aad.const_byte_str(), aad.size()))
+	{
+		// ERROR_MSG("Failed to update with AAD: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		return false;
+	}
+
+	data.resize(encryptedData.size());
+
+	outLen = 0;
+	if (encryptedData.size() && !EVP_DecryptUpdate(pCurCTX, &data[0], &outLen, (unsigned char*) encryptedData.const_byte_str(), encryptedData.size()))
+	{
+		// ERROR_MSG("EVP_DecryptUpdate failed: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		data.wipe();
+
+		return false;
+	}
+
+	// Set the expected tag
+	ByteString expectedTag(tag);
+	if (!EVP_CIPHER_CTX_ctrl(pCurCTX, EVP_CTRL_GCM_SET_TAG, expectedTag.size(), &expectedTag[0]))
+	{
+		// ERROR_MSG("Failed to set the message tag: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		data.wipe();
+
+		return false;
+	}
+
+	ByteString finalBlock;
+	finalBlock.resize(getBlockSize());
+
+	// Never release plaintext whose tag does not verify
+	int finalLen = 0;
+	if (!EVP_DecryptFinal_ex(pCurCTX, &finalBlock[0], &finalLen) || (outLen + finalLen) != (int) encryptedData.size())
+	{
+		// ERROR_MSG("EVP_DecryptFinal failed: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		data.wipe();
+
+		return false;
+	}
+
+	return true;
+}
+
+bool OSSLEVPSymmetricAlgorithm::messageDecryptFinal()
+{
+	clean();
+
+	return SymmetricAlgorithm::messageDecryptFinal();
+}
+
 // Check if more bytes of data can be encrypted
 bool OSSLEVPSymmetricAlgorithm::checkMaximumBytes(unsigned long bytes)
 {
@@ -573,3 +1283,13 @@ bool OSSLEVPSymmetricAlgorithm::checkMaximumBytes(unsigned long bytes)
 
 	return rv;
 }
+
+void OSSLEVPSymmetricAlgorithm::reset()
+{
+	SymmetricAlgorithm::reset();
+
+	clean();
+	initialIV.wipe();
+	processedBytes = 0;
+	streamSegmentNumber = 0;
+}
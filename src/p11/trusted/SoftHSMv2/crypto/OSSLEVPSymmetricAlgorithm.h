@@ -49,35 +49,66 @@ public:
 	virtual ~OSSLEVPSymmetricAlgorithm();
 
 	// Encryption functions
-	virtual bool encryptInit(const SymmetricKey* key, const SymMode::Type mode = SymMode::CBC, const ByteString& IV = ByteString(), bool padding = true, size_t counterBits = 0, const ByteString& aad = ByteString(), size_t tagBytes = 0);
+	virtual bool encryptInit(const SymmetricKey* key, const SymMode::Type mode = SymMode::CBC, const ByteString& IV = ByteString(), bool padding = true, size_t counterBits = 0, const ByteString& aad = ByteString(), size_t tagBytes = 0, size_t segmentBytes = 0);
 	virtual bool encryptUpdate(const ByteString& data, ByteString& encryptedData);
 	virtual bool encryptFinal(ByteString& encryptedData);
 
 	// Decryption functions
-	virtual bool decryptInit(const SymmetricKey* key, const SymMode::Type mode = SymMode::CBC, const ByteString& IV = ByteString(), bool padding = true, size_t counterBits = 0, const ByteString& aad = ByteString(), size_t tagBytes = 0);
+	virtual bool decryptInit(const SymmetricKey* key, const SymMode::Type mode = SymMode::CBC, const ByteString& IV = ByteString(), bool padding = true, size_t counterBits = 0, const ByteString& aad = ByteString(), size_t tagBytes = 0, size_t segmentBytes = 0);
 	virtual bool decryptUpdate(const ByteString& encryptedData, ByteString& data);
 	virtual bool decryptFinal(ByteString& data);
 
+	// Message-based AEAD functions
+	virtual bool messageEncryptInit(const SymmetricKey* key, const SymMode::Type mode = SymMode::GCM);
+	virtual bool encryptMessage(const ByteString& IV, const ByteString& aad, const ByteString& data, ByteString& encryptedData, ByteString& tag, size_t tagBytes);
+	virtual bool messageEncryptFinal();
+
+	virtual bool messageDecryptInit(const SymmetricKey* key, const SymMode::Type mode = SymMode::GCM);
+	virtual bool decryptMessage(const ByteString& IV, const ByteString& aad, const ByteString& encryptedData, const ByteString& tag, ByteString& data);
+	virtual bool messageDecryptFinal();
+
 	// Return the block size
 	virtual size_t getBlockSize() const = 0;
 
 	// Check if more bytes of data can be encrypted
 	virtual bool checkMaximumBytes(unsigned long bytes);
 
+	// Wipe the context but keep it allocated
+	virtual void reset();
+
 protected:
 	// Return the right EVP cipher for the operation
 	virtual const EVP_CIPHER* getCipher() const = 0;
 
 private:
 	void counterBitsInit(const ByteString& IV, size_t counterBits);
+	EVP_CIPHER_CTX* newContext();
 	void clean();
 
+	// Segmented AEAD stream helpers
+	bool streamInit(const ByteString& noncePrefix, const ByteString& aad);
+	bool streamSegment(const unsigned char* in, size_t inLen, bool last, ByteString& out);
+	bool streamUpdate(const ByteString& in, size_t chunkBytes, ByteString& out);
+
+	// Multi-threaded CTR and ECB for large buffers
+	bool canUpdateInParallel(size_t len);
+	bool parallelUpdate(const ByteString& in, unsigned char* out, int& outLen);
+
 	// The current EVP context
 	EVP_CIPHER_CTX* pCurCTX;
 
 	// The maximum bytes to encrypt/decrypt
 	BIGNUM* maximumBytes;
 	BIGNUM* counterBytes;
+
+	// The initial IV and the number of bytes processed since
+	ByteString initialIV;
+	unsigned long long processedBytes;
+
+	// The nonce, AAD and segment number of a segmented AEAD stream
+	ByteString streamNonce;
+	ByteString streamAAD;
+	unsigned long long streamSegmentNumber;
 };
 
 #endif // !_SOFTHSM_V2_OSSLEVPSYMMETRICALGORITHM_H
@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*****************************************************************************
+ OSSLMacKeyCache.cpp
+
+ Cache of initialised MAC states
+ *****************************************************************************/
+
+#include "config.h"
+#include "OSSLMacKeyCache.h"
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+// Constructor
+OSSLMacKeyCache::OSSLMacKeyCache(unsigned long maxEntries)
+{
+	this->maxEntries = maxEntries;
+	useCounter = 0;
+	hits = 0;
+	misses = 0;
+	cacheMutex = MutexFactory::i()->getMutex();
+
+	// Without a salt the states are not cached
+	salt.resize(32);
+	if (RAND_bytes(&salt[0], salt.size()) != 1)
+	{
+		this->maxEntries = 0;
+	}
+}
+
+// Destructor
+OSSLMacKeyCache::~OSSLMacKeyCache()
+{
+	forget(NULL);
+
+	MutexFactory::i()->recycleMutex(cacheMutex);
+}
+
+// Initialise an HMAC context for the key
+bool OSSLMacKeyCache::initHMAC(HMAC_CTX* ctx, const SymmetricKey* key, const EVP_MD* md)
+{
+	const ByteString& keyBits = key->getKeyBits();
+
+	if (maxEntries == 0 || key->getCacheOwner() == NULL)
+	{
+		return HMAC_Init_ex(ctx, keyBits.const_byte_str(), keyBits.size(), md, NULL);
+	}
+
+	ByteString keyDigest;
+	if (!digestKey(keyBits, keyDigest))
+	{
+		return HMAC_Init_ex(ctx, keyBits.const_byte_str(), keyBits.size(), md, NULL);
+	}
+
+	MutexLocker lock(cacheMutex);
+
+	StateTag tag(key->getCacheOwner(), md);
+	KeyState* state = findState(tag, keyDigest);
+	if (state != NULL && state->hmacCTX != NULL)
+	{
+		hits++;
+
+		return HMAC_CTX_copy(ctx, state->hmacCTX);
+	}
+
+	misses++;
+
+	// Compute the state in the context of the operation and keep a copy
+	if (!HMAC_Init_ex(ctx, keyBits.const_byte_str(), keyBits.size(), md, NULL))
+	{
+		return false;
+	}
+
+	HMAC_CTX* cached = HMAC_CTX_new();
+	if (cached == NULL || !HMAC_CTX_copy(cached, ctx))
+	{
+		// The operation can go on without caching the state
+		HMAC_CTX_free(cached);
+
+		return true;
+	}
+
+	state = addState(tag, keyDigest);
+	state->hmacCTX = cached;
+
+	return true;
+}
+
+// Initialise a CMAC context for the key
+bool OSSLMacKeyCache::initCMAC(CMAC_CTX* ctx, const SymmetricKey* key, const EVP_CIPHER* cipher)
+{
+	const ByteString& keyBits = key->getKeyBits();
+
+	if (maxEntries == 0 || key->getCacheOwner() == NULL)
+	{
+		return CMAC_Init(ctx, keyBits.const_byte_str(), keyBits.size(), cipher, NULL);
+	}
+
+	ByteString keyDigest;
+	if (!digestKey(keyBits, keyDigest))
+	{
+		return CMAC_Init(ctx, keyBits.const_byte_str(), keyBits.size(), cipher, NULL);
+	}
+
+	MutexLocker lock(cacheMutex);
+
+	StateTag tag(key->getCacheOwner(), cipher);
+	KeyState* state = findState(tag, keyDigest);
+	if (state != NULL && state->cmacCTX != NULL)
+	{
+		hits++;
+
+		return CMAC_CTX_copy(ctx, state->cmacCTX);
+	}
+
+	misses++;
+
+	// Compute the state in the context of the operation and keep a copy
+	if (!CMAC_Init(ctx, keyBits.const_byte_str(), keyBits.size(), cipher, NULL))
+	{
+		return false;
+	}
+
+	CMAC_CTX* cached = CMAC_CTX_new();
+	if (cached == NULL || !CMAC_CTX_copy(cached, ctx))
+	{
+		// The operation can go on without caching the state
+		if (cached != NULL) CMAC_CTX_free(cached);
+
+		return true;
+	}
+
+	state = addState(tag, keyDigest);
+	state->cmacCTX = cached;
+
+	return true;
+}
+
+// Wipe the states of the key object, or all states
+void OSSLMacKeyCache::forget(const void* owner)
+{
+	MutexLocker lock(cacheMutex);
+
+	std::map<StateTag, KeyState>::iterator i = states.begin();
+	while (i != states.end())
+	{
+		if (owner == NULL || i->first.first == owner)
+		{
+			freeState(i->second);
+			states.erase(i++);
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+// Statistics
+unsigned long OSSLMacKeyCache::getHits()
+{
+	MutexLocker lock(cacheMutex);
+
+	return hits;
+}
+
+unsigned long OSSLMacKeyCache::getMisses()
+{
+	MutexLocker lock(cacheMutex);
+
+	return misses;
+}
+
+unsigned long OSSLMacKeyCache::getSize()
+{
+	MutexLocker lock(cacheMutex);
+
+	return states.size();
+}
+
+// Compute the salted digest of the key bits
+bool OSSLMacKeyCache::digestKey(const ByteString& keyBits, ByteString& keyDigest)
+{
+	EVP_MD_CTX* mdCTX = EVP_MD_CTX_new();
+	if (mdCTX == NULL) return false;
+
+	unsigned int len = EVP_MAX_MD_SIZE;
+	keyDigest.resize(len);
+
+	bool rv = EVP_DigestInit_ex(mdCTX, EVP_sha256(), NULL) &&
+		  EVP_DigestUpdate(mdCTX, salt.const_byte_str(), salt.size()) &&
+		  EVP_DigestUpdate(mdCTX, keyBits.const_byte_str(), keyBits.size()) &&
+		  EVP_DigestFinal_ex(mdCTX, &keyDigest[0], &len);
+
+	EVP_MD_CTX_free(mdCTX);
+
+	keyDigest.resize(rv ? len : 0);
+
+	return rv;
+}
+
+// Find the state of the tag for the key digest
+OSSLMacKeyCache::KeyState* OSSLMacKeyCache::findState(const StateTag& tag, const ByteString& keyDigest)
+{
+	std::map<StateTag, KeyState>::iterator i = states.find(tag);
+	if (i == states.end()) return NULL;
+
+	// The object may have been changed, or another object may have been
+	// created at the same address; compare in constant time
+	if (i->second.keyDigest.size() != keyDigest.size() ||
+	    CRYPTO_memcmp(i->second.keyDigest.const_byte_str(), keyDigest.const_byte_str(), keyDigest.size()) != 0)
+	{
+		freeState(i->second);
+		states.erase(i);
+
+		return NULL;
+	}
+
+	i->second.lastUse = ++useCounter;
+
+	return &i->second;
+}
+
+// Make room for a new state and add it
+OSSLMacKeyCache::KeyState* OSSLMacKeyCache::addState(const StateTag& tag, const ByteString& keyDigest)
+{
+	std::map<StateTag, KeyState>::iterator i = states.find(tag);
+	if (i != states.end())
+	{
+		freeState(i->second);
+		states.erase(i);
+	}
+
+	if (states.size() >= maxEntries)
+	{
+		std::map<StateTag, KeyState>::iterator lru = states.begin();
+		for (i = states.begin(); i != states.end(); i++)
+		{
+			if (i->second.lastUse < lru->second.lastUse) lru = i;
+		}
+
+		freeState(lru->second);
+		states.erase(lru);
+	}
+
+	KeyState& state = states[tag];
+	state.keyDigest = keyDigest;
+	state.hmacCTX = NULL;
+	state.cmacCTX = NULL;
+	state.lastUse = ++useCounter;
+
+	return &state;
+}
+
+// Wipe a state; the OpenSSL free functions cleanse the contexts
+void OSSLMacKeyCache::freeState(KeyState& state)
+{
+	if (state.hmacCTX != NULL) HMAC_CTX_free(state.hmacCTX);
+	if (state.cmacCTX != NULL) CMAC_CTX_free(state.cmacCTX);
+	state.hmacCTX = NULL;
+	state.cmacCTX = NULL;
+	state.keyDigest.wipe();
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*****************************************************************************
+ OSSLMacKeyCache.h
+
+ Cache of initialised MAC states. Initialising HMAC hashes the padded key
+ twice and initialising CMAC runs the key schedule and derives the subkeys.
+ Both depend on the key only, so the state is computed once per key object
+ and copied into the context of every later operation with that key.
+ *****************************************************************************/
+
+#ifndef _SOFTHSM_V2_OSSLMACKEYCACHE_H
+#define _SOFTHSM_V2_OSSLMACKEYCACHE_H
+
+#include "config.h"
+#include "ByteString.h"
+#include "SymmetricKey.h"
+#include "MutexFactory.h"
+#include <map>
+#include <utility>
+#include <openssl/hmac.h>
+#include <openssl/cmac.h>
+
+class OSSLMacKeyCache
+{
+public:
+	// Constructor; maxEntries is the number of key states kept
+	OSSLMacKeyCache(unsigned long maxEntries);
+
+	OSSLMacKeyCache(const OSSLMacKeyCache&) = delete;
+
+	OSSLMacKeyCache& operator=(const OSSLMacKeyCache&) = delete;
+
+	// Destructor; wipes all states
+	virtual ~OSSLMacKeyCache();
+
+	// Initialise ctx for the key, copying the cached state of the key if
+	// there is one. Keys that were not read from an object are initialised
+	// the regular way and not cached.
+	bool initHMAC(HMAC_CTX* ctx, const SymmetricKey* key, const EVP_MD* md);
+	bool initCMAC(CMAC_CTX* ctx, const SymmetricKey* key, const EVP_CIPHER* cipher);
+
+	// Wipe the states of the key object, or all states if owner is NULL
+	void forget(const void* owner);
+
+	// Statistics
+	unsigned long getHits();
+	unsigned long getMisses();
+	unsigned long getSize();
+
+private:
+	// A cached state; exactly one of the contexts is set
+	struct KeyState
+	{
+		// Salted digest of the key bits the state was computed from; an
+		// object whose value changed no longer matches its state. The key
+		// bits themselves are not kept.
+		ByteString keyDigest;
+
+		HMAC_CTX* hmacCTX;
+		CMAC_CTX* cmacCTX;
+
+		// For evicting the least recently used state
+		unsigned long lastUse;
+	};
+
+	// States are cached per key object and per digest or cipher
+	typedef std::pair<const void*, const void*> StateTag;
+
+	// Compute the salted digest of the key bits
+	bool digestKey(const ByteString& keyBits, ByteString& keyDigest);
+
+	// Find the state of the tag for the key digest; a stale state of the
+	// tag is wiped. The caller holds the mutex.
+	KeyState* findState(const StateTag& tag, const ByteString& keyDigest);
+
+	// Make room for a new state and add it; the caller holds the mutex
+	KeyState* addState(const StateTag& tag, const ByteString& keyDigest);
+
+	// Wipe a state; the caller holds the mutex
+	static void freeState(KeyState& state);
+
+	// The number of states kept
+	unsigned long maxEntries;
+
+	// Random salt of the key digests
+	ByteString salt;
+
+	// The states
+	std::map<StateTag, KeyState> states;
+
+	// Use counter for the LRU eviction
+	unsigned long useCounter;
+
+	// Statistics
+	unsigned long hits;
+	unsigned long misses;
+
+	// For thread safeness
+	Mutex* cacheMutex;
+};
+
+#endif // !_SOFTHSM_V2_OSSLMACKEYCACHE_H
@@ -63,6 +63,11 @@
 
 #include "config.h"
 #include "OSSLRNG.h"
+#include "OSSLCryptoFactory.h"
+#include <string.h>
+#include <pthread.h>
+#include <vector>
+#include <openssl/crypto.h>
 
 #ifndef SGXHSM
 #include <openssl/rand.h>
@@ -70,6 +75,305 @@
 #include <sgx_trts.h>
 #endif
 
+// The number of generate requests between two reseeds from the entropy
+// source; can be overridden at build time
+#ifndef RNG_RESEED_INTERVAL
+#define RNG_RESEED_INTERVAL		1024
+#endif
+
+// Requests larger than this are split into several generate calls whose
+// output is produced without holding the lock
+#define RNG_DIRECT_MAX_BYTES		4096
+
+// SP 800-90A limits one generate call of CTR_DRBG to 2^19 bits
+#define RNG_MAX_GENERATE_BYTES		(1 << 16)
+
+// Requests of at least this size are split over worker threads
+#define RNG_PARALLEL_MIN_BYTES		(1024 * 1024)
+
+// Worker threads besides the calling one; each takes a spare TCS
+#define RNG_PARALLEL_WORKERS		MAX_WORKER_THREADS
+
+// The seed length of AES-256 CTR_DRBG: key and counter block
+#define RNG_SEED_LEN			48
+
+// The output of one generate call
+struct KeystreamJob
+{
+	unsigned char key[32];
+	unsigned char iv[16];
+	unsigned char* out;
+	size_t len;
+	bool ok;
+};
+
+// The generate calls done by one thread
+struct KeystreamSlice
+{
+	KeystreamJob* jobs;
+	size_t count;
+	bool ok;
+};
+
+// Add a number of blocks to a big endian counter block
+static void addCounter(unsigned char* counter, unsigned long long blocks)
+{
+	unsigned int carry = 0;
+
+	for (size_t i = 16; i > 0 && (blocks > 0 || carry > 0); i--)
+	{
+		unsigned int sum = counter[i - 1] + (unsigned int) (blocks & 0xFF) + carry;
+
+		counter[i - 1] = (unsigned char) sum;
+		carry = sum >> 8;
+		blocks >>= 8;
+	}
+}
+
+// Encrypt zeroes in CTR mode; the first counter block is iv + 1
+static void keystreamJob(KeystreamJob* job)
+{
+	EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+	int outLen = 0;
+
+	addCounter(job->iv, 1);
+	memset(job->out, 0, job->len);
+
+	job->ok = (ctx != NULL) &&
+		  EVP_EncryptInit_ex(ctx, EVP_aes_256_ctr(), NULL, job->key, job->iv) &&
+		  EVP_EncryptUpdate(ctx, job->out, &outLen, job->out, job->len) &&
+		  ((size_t) outLen == job->len);
+
+	EVP_CIPHER_CTX_free(ctx);
+	OPENSSL_cleanse(job->key, sizeof(job->key));
+	OPENSSL_cleanse(job->iv, sizeof(job->iv));
+}
+
+static void* keystreamWorker(void* arg)
+{
+	KeystreamSlice* slice = (KeystreamSlice*) arg;
+
+	slice->ok = true;
+
+	for (size_t i = 0; i < slice->count; i++)
+	{
+		keystreamJob(&slice->jobs[i]);
+
+		slice->ok = slice->ok && slice->jobs[i].ok;
+	}
+
+	return NULL;
+}
+
+// Constructor
+OSSLRNG::OSSLRNG()
+{
+	memset(key, 0, sizeof(key));
+	memset(v, 0, sizeof(v));
+	reseedCounter = 0;
+	instantiated = false;
+	memset(buffer, 0, sizeof(buffer));
+	bufferPos = RNG_BUFFER_SIZE;
+	reseeds = 0;
+
+	rngMutex = MutexFactory::i()->getMutex();
+}
+
+// Destructor
+OSSLRNG::~OSSLRNG()
+{
+	OPENSSL_cleanse(key, sizeof(key));
+	OPENSSL_cleanse(v, sizeof(v));
+	OPENSSL_cleanse(buffer, sizeof(buffer));
+
+	MutexFactory::i()->recycleMutex(rngMutex);
+}
+
+// Read seed material from the entropy source
+bool OSSLRNG::getEntropy(unsigned char* out, size_t len)
+{
+#ifndef SGXHSM
+	return RAND_bytes(out, len) == 1;
+#else
+	return (SGX_SUCCESS == sgx_read_rand(out, len));
+#endif
+}
+
+// Fill the buffer with AES-256-CTR keystream
+bool OSSLRNG::keystream(const unsigned char* streamKey, const unsigned char* iv, unsigned char* out, size_t len)
+{
+	KeystreamJob job;
+
+	memcpy(job.key, streamKey, sizeof(job.key));
+	memcpy(job.iv, iv, sizeof(job.iv));
+	job.out = out;
+	job.len = len;
+	job.ok = false;
+
+	keystreamJob(&job);
+
+	return job.ok;
+}
+
+// Produce the output of a number of generate calls; many calls are split
+// over worker threads
+bool OSSLRNG::keystreams(KeystreamJob* jobs, size_t count, size_t len)
+{
+	KeystreamSlice slices[RNG_PARALLEL_WORKERS + 1];
+	pthread_t threads[RNG_PARALLEL_WORKERS];
+	bool started[RNG_PARALLEL_WORKERS];
+	size_t workers = (len < RNG_PARALLEL_MIN_BYTES) ? 0 : RNG_PARALLEL_WORKERS;
+	size_t perSlice = count / (workers + 1);
+
+	// The calling thread does the last slice
+	for (size_t i = 0; i <= workers; i++)
+	{
+		slices[i].jobs = jobs + i * perSlice;
+		slices[i].count = (i < workers) ? perSlice : count - i * perSlice;
+		slices[i].ok = false;
+	}
+
+	for (size_t i = 0; i < workers; i++)
+	{
+		started[i] = OSSLCryptoFactory::i()->startWorker(&threads[i], keystreamWorker, &slices[i]);
+	}
+
+	// Slices without a spare TCS are done by the calling thread
+	for (size_t i = 0; i < workers; i++)
+	{
+		if (!started[i])
+		{
+			keystreamWorker(&slices[i]);
+		}
+	}
+
+	keystreamWorker(&slices[workers]);
+
+	bool rv = slices[workers].ok;
+
+	for (size_t i = 0; i < workers; i++)
+	{
+		if (started[i])
+		{
+			pthread_join(threads[i], NULL);
+		}
+
+		rv = rv && slices[i].ok;
+	}
+
+	return rv;
+}
+
+// CTR_DRBG_Update: derive a new key and counter block, mixing in the
+// provided data (RNG_SEED_LEN bytes)
+bool OSSLRNG::update(const unsigned char* provided)
+{
+	unsigned char temp[RNG_SEED_LEN];
+
+	if (!keystream(key, v, temp, sizeof(temp)))
+	{
+		OPENSSL_cleanse(temp, sizeof(temp));
+
+		return false;
+	}
+
+	for (size_t i = 0; i < sizeof(temp); i++)
+	{
+		temp[i] ^= provided[i];
+	}
+
+	memcpy(key, temp, sizeof(key));
+	memcpy(v, temp + sizeof(key), sizeof(v));
+	OPENSSL_cleanse(temp, sizeof(temp));
+
+	return true;
+}
+
+// Instantiate or reseed from the entropy source; the additional input is
+// mixed into the seed material
+bool OSSLRNG::reseed(const unsigned char* additional, size_t additionalLen)
+{
+	unsigned char seedMaterial[RNG_SEED_LEN];
+
+	if (!getEntropy(seedMaterial, sizeof(seedMaterial)))
+	{
+		// ERROR_MSG("Could not read entropy for the DRBG");
+
+		OPENSSL_cleanse(seedMaterial, sizeof(seedMaterial));
+
+		return false;
+	}
+
+	for (size_t i = 0; i < additionalLen; i++)
+	{
+		seedMaterial[i % sizeof(seedMaterial)] ^= additional[i];
+	}
+
+	bool rv = update(seedMaterial);
+	OPENSSL_cleanse(seedMaterial, sizeof(seedMaterial));
+
+	if (rv)
+	{
+		reseedCounter = 1;
+		instantiated = true;
+		reseeds++;
+	}
+
+	return rv;
+}
+
+// CTR_DRBG_Generate, without additional input
+bool OSSLRNG::drbgGenerate(unsigned char* out, size_t len)
+{
+	KeystreamJob job;
+
+	job.out = out;
+	job.len = len;
+	job.ok = false;
+
+	if (!drbgReserve(job))
+	{
+		return false;
+	}
+
+	keystreamJob(&job);
+
+	return job.ok;
+}
+
+// The state changes of CTR_DRBG_Generate; the output is the keystream of
+// the job, which the caller produces
+bool OSSLRNG::drbgReserve(KeystreamJob& job)
+{
+	if (!instantiated || reseedCounter > RNG_RESEED_INTERVAL)
+	{
+		if (!reseed(NULL, 0))
+		{
+			return false;
+		}
+	}
+
+	memcpy(job.key, key, sizeof(job.key));
+	memcpy(job.iv, v, sizeof(job.iv));
+
+	addCounter(v, (job.len + 15) / 16);
+
+	// Backtracking resistance: the state that produced the output is gone
+	unsigned char zeroes[RNG_SEED_LEN];
+	memset(zeroes, 0, sizeof(zeroes));
+	if (!update(zeroes))
+	{
+		OPENSSL_cleanse(job.key, sizeof(job.key));
+		OPENSSL_cleanse(job.iv, sizeof(job.iv));
+
+		return false;
+	}
+
+	reseedCounter++;
+
+	return true;
+}
+
 // Generate random data
 bool OSSLRNG::generateRandom(ByteString& data, const size_t len)
 {
@@ -77,11 +381,69 @@ bool OSSLRNG::generateRandom(ByteString& data, const size_t len)
 
 	if (len == 0)
 		return true;
-#ifndef SGXHSM
-	return RAND_bytes(&data[0], len) == 1;
-#else
-        return (SGX_SUCCESS == sgx_read_rand(reinterpret_cast<unsigned char*>(&data[0]), len));
-#endif
+
+	unsigned char* out = &data[0];
+
+	if (len <= RNG_BUFFER_SIZE / 4)
+	{
+		// Serve small requests from the buffer
+		MutexLocker lock(rngMutex);
+
+		if (RNG_BUFFER_SIZE - bufferPos < len)
+		{
+			if (!drbgGenerate(buffer, RNG_BUFFER_SIZE))
+			{
+				return false;
+			}
+
+			bufferPos = 0;
+		}
+
+		memcpy(out, buffer + bufferPos, len);
+		OPENSSL_cleanse(buffer + bufferPos, len);
+		bufferPos += len;
+
+		return true;
+	}
+
+	if (len <= RNG_DIRECT_MAX_BYTES)
+	{
+		MutexLocker lock(rngMutex);
+
+		return drbgGenerate(out, len);
+	}
+
+	// Do the state changes of one generate call per RNG_MAX_GENERATE_BYTES
+	// under the lock; the output of the calls is produced without it
+	size_t count = (len + RNG_MAX_GENERATE_BYTES - 1) / RNG_MAX_GENERATE_BYTES;
+	std::vector<KeystreamJob> jobs(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		jobs[i].out = out + i * RNG_MAX_GENERATE_BYTES;
+		jobs[i].len = (i + 1 < count) ? RNG_MAX_GENERATE_BYTES : len - i * RNG_MAX_GENERATE_BYTES;
+		jobs[i].ok = false;
+	}
+
+	bool rv = true;
+	{
+		MutexLocker lock(rngMutex);
+
+		for (size_t i = 0; rv && i < count; i++)
+		{
+			rv = drbgReserve(jobs[i]);
+		}
+	}
+
+	if (rv)
+	{
+		rv = keystreams(&jobs[0], count, len);
+	}
+
+	// Jobs that were not run still hold their key
+	OPENSSL_cleanse(&jobs[0], count * sizeof(KeystreamJob));
+
+	return rv;
 }
 
 #ifndef SGXHSM
@@ -89,6 +451,18 @@ bool OSSLRNG::generateRandom(ByteString& data, const size_t len)
 void OSSLRNG::seed(ByteString& seedData)
 {
 	RAND_seed(seedData.byte_str(), seedData.size());
+
+	// Mix the seed into the generator with fresh entropy
+	MutexLocker lock(rngMutex);
+
+	reseed(seedData.const_byte_str(), seedData.size());
 }
 #endif
 
+// Statistics
+unsigned long OSSLRNG::getReseeds()
+{
+	MutexLocker lock(rngMutex);
+
+	return reseeds;
+}
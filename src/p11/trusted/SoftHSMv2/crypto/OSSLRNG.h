@@ -58,7 +58,11 @@
 /*****************************************************************************
  OSSLRNG.h
 
- OpenSSL random number generator class
+ OpenSSL random number generator class. Random data comes from an AES-256
+ CTR_DRBG (NIST SP 800-90A, without derivation function) that is seeded
+ and periodically reseeded from the platform entropy source. Small requests
+ are served from a buffer of generator output; large requests are split
+ into generate calls of at most 2^19 bits.
  *****************************************************************************/
 
 #ifndef _SOFTHSM_V2_OSSLRNG_H
@@ -67,10 +71,27 @@
 #include "config.h"
 #include "ByteString.h"
 #include "RNG.h"
+#include "MutexFactory.h"
+#include <openssl/evp.h>
+
+// The number of bytes of generator output buffered for small requests
+#define RNG_BUFFER_SIZE		1024
+
+struct KeystreamJob;
 
 class OSSLRNG : public RNG
 {
 public:
+	// Constructor
+	OSSLRNG();
+
+	OSSLRNG(const OSSLRNG&) = delete;
+
+	OSSLRNG& operator=(const OSSLRNG&) = delete;
+
+	// Destructor; wipes the generator state
+	virtual ~OSSLRNG();
+
 	// Generate random data
 	virtual bool generateRandom(ByteString& data, const size_t len);
 
@@ -79,8 +100,42 @@ public:
 	virtual void seed(ByteString& seedData);
 #endif
 
+	// Statistics
+	unsigned long getReseeds();
+
 private:
+	// Read seed material from the entropy source
+	static bool getEntropy(unsigned char* out, size_t len);
+
+	// Fill the buffer with AES-256-CTR keystream under key, starting at the
+	// counter block after iv
+	static bool keystream(const unsigned char* key, const unsigned char* iv, unsigned char* out, size_t len);
+
+	// Produce the output of count generate calls of len bytes in total;
+	// many calls are split over worker threads
+	static bool keystreams(KeystreamJob* jobs, size_t count, size_t len);
+
+	// CTR_DRBG functions
+	bool update(const unsigned char* provided);
+	bool reseed(const unsigned char* additional, size_t additionalLen);
+	bool drbgGenerate(unsigned char* out, size_t len);
+	bool drbgReserve(KeystreamJob& job);
+
+	// The working state
+	unsigned char key[32];
+	unsigned char v[16];
+	unsigned long reseedCounter;
+	bool instantiated;
+
+	// Buffered generator output; bytes are wiped once handed out
+	unsigned char buffer[RNG_BUFFER_SIZE];
+	size_t bufferPos;
+
+	// Statistics
+	unsigned long reseeds;
+
+	// For thread safeness
+	Mutex* rngMutex;
 };
 
 #endif // !_SOFTHSM_V2_OSSLRNG_H
-
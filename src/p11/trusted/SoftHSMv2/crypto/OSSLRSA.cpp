@@ -65,6 +65,7 @@
 #include "OSSLRSA.h"
 #include "OSSLUtil.h"
 #include "CryptoFactory.h"
+#include "OSSLCryptoFactory.h"
 #include "RSAParameters.h"
 #include "OSSLRSAKeyPair.h"
 #include <algorithm>
@@ -94,6 +95,26 @@ OSSLRSA::~OSSLRSA()
 	}
 }
 
+// Recycle the hashes of an unfinished multi-part operation
+void OSSLRSA::reset()
+{
+	AsymmetricAlgorithm::reset();
+
+	if (pCurrentHash != NULL)
+	{
+		CryptoFactory::i()->recycleHashAlgorithm(pCurrentHash);
+		pCurrentHash = NULL;
+	}
+
+	if (pSecondHash != NULL)
+	{
+		CryptoFactory::i()->recycleHashAlgorithm(pSecondHash);
+		pSecondHash = NULL;
+	}
+
+	sLen = 0;
+}
+
 // Signing functions
 bool OSSLRSA::sign(PrivateKey* privateKey, const ByteString& dataToSign,
 		   ByteString& signature, const AsymMech::Type mechanism,
@@ -479,7 +500,7 @@ bool OSSLRSA::signInit(PrivateKey* privateKey, const AsymMech::Type mechanism,
 	{
 		if (pCurrentHash != NULL)
 		{
-			delete pCurrentHash;
+			CryptoFactory::i()->recycleHashAlgorithm(pCurrentHash);
 			pCurrentHash = NULL;
 		}
 
@@ -495,12 +516,12 @@ bool OSSLRSA::signInit(PrivateKey* privateKey, const AsymMech::Type mechanism,
 
 		if (pSecondHash == NULL || !pSecondHash->hashInit())
 		{
-			delete pCurrentHash;
+			CryptoFactory::i()->recycleHashAlgorithm(pCurrentHash);
 			pCurrentHash = NULL;
 
 			if (pSecondHash != NULL)
 			{
-				delete pSecondHash;
+				CryptoFactory::i()->recycleHashAlgorithm(pSecondHash);
 				pSecondHash = NULL;
 			}
 
@@ -523,7 +544,7 @@ bool OSSLRSA::signUpdate(const ByteString& dataToSign)
 
 	if (!pCurrentHash->hashUpdate(dataToSign))
 	{
-		delete pCurrentHash;
+		CryptoFactory::i()->recycleHashAlgorithm(pCurrentHash);
 		pCurrentHash = NULL;
 
 		ByteString dummy;
@@ -534,10 +555,10 @@ bool OSSLRSA::signUpdate(const ByteString& dataToSign)
 
 	if ((pSecondHash != NULL) && !pSecondHash->hashUpdate(dataToSign))
 	{
-		delete pCurrentHash;
+		CryptoFactory::i()->recycleHashAlgorithm(pCurrentHash);
 		pCurrentHash = NULL;
 
-		delete pSecondHash;
+		CryptoFactory::i()->recycleHashAlgorithm(pSecondHash);
 		pSecondHash = NULL;
 
 		ByteString dummy;
@@ -565,12 +586,12 @@ bool OSSLRSA::signFinal(ByteString& signature)
 	bool bFirstResult = pCurrentHash->hashFinal(firstHash);
 	bool bSecondResult = (pSecondHash != NULL) ? pSecondHash->hashFinal(secondHash) : true;
 
-	delete pCurrentHash;
+	CryptoFactory::i()->recycleHashAlgorithm(pCurrentHash);
 	pCurrentHash = NULL;
 
 	if (pSecondHash != NULL)
 	{
-		delete pSecondHash;
+		CryptoFactory::i()->recycleHashAlgorithm(pSecondHash);
 
 		pSecondHash = NULL;
 	}
@@ -1036,7 +1057,7 @@ bool OSSLRSA::verifyInit(PublicKey* publicKey, const AsymMech::Type mechanism,
 	{
 		if (pCurrentHash != NULL)
 		{
-			delete pCurrentHash;
+			CryptoFactory::i()->recycleHashAlgorithm(pCurrentHash);
 			pCurrentHash = NULL;
 		}
 
@@ -1052,12 +1073,12 @@ bool OSSLRSA::verifyInit(PublicKey* publicKey, const AsymMech::Type mechanism,
 
 		if (pSecondHash == NULL || !pSecondHash->hashInit())
 		{
-			delete pCurrentHash;
+			CryptoFactory::i()->recycleHashAlgorithm(pCurrentHash);
 			pCurrentHash = NULL;
 
 			if (pSecondHash != NULL)
 			{
-				delete pSecondHash;
+				CryptoFactory::i()->recycleHashAlgorithm(pSecondHash);
 				pSecondHash = NULL;
 			}
 
@@ -1080,7 +1101,7 @@ bool OSSLRSA::verifyUpdate(const ByteString& originalData)
 
 	if (!pCurrentHash->hashUpdate(originalData))
 	{
-		delete pCurrentHash;
+		CryptoFactory::i()->recycleHashAlgorithm(pCurrentHash);
 		pCurrentHash = NULL;
 
 		ByteString dummy;
@@ -1091,10 +1112,10 @@ bool OSSLRSA::verifyUpdate(const ByteString& originalData)
 
 	if ((pSecondHash != NULL) && !pSecondHash->hashUpdate(originalData))
 	{
-		delete pCurrentHash;
+		CryptoFactory::i()->recycleHashAlgorithm(pCurrentHash);
 		pCurrentHash = NULL;
 
-		delete pSecondHash;
+		CryptoFactory::i()->recycleHashAlgorithm(pSecondHash);
 		pSecondHash = NULL;
 
 		ByteString dummy;
@@ -1122,12 +1143,12 @@ bool OSSLRSA::verifyFinal(const ByteString& signature)
 	bool bFirstResult = pCurrentHash->hashFinal(firstHash);
 	bool bSecondResult = (pSecondHash != NULL) ? pSecondHash->hashFinal(secondHash) : true;
 
-	delete pCurrentHash;
+	CryptoFactory::i()->recycleHashAlgorithm(pCurrentHash);
 	pCurrentHash = NULL;
 
 	if (pSecondHash != NULL)
 	{
-		delete pSecondHash;
+		CryptoFactory::i()->recycleHashAlgorithm(pSecondHash);
 
 		pSecondHash = NULL;
 	}
@@ -1414,27 +1435,51 @@ bool OSSLRSA::generateKeyPair(AsymmetricKeyPair** ppKeyPair, AsymmetricParameter
 		return false;
 	}
 
-	// Generate the key-pair
-	RSA* rsa = RSA_new();
-	if (rsa == NULL)
+	// Check the number of primes; OpenSSL limits it further by key size
+	size_t primes = params->getPrimes();
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+	if (primes < RSA_DEFAULT_PRIME_NUM)
+#else
+	if (primes != 2)
+#endif
 	{
-		// ERROR_MSG("Failed to instantiate OpenSSL RSA object");
+		// ERROR_MSG("Unsupported number of RSA primes %lu", primes);
 
 		return false;
 	}
 
-	BIGNUM* bn_e = OSSL::byteString2bn(params->getE());
-
-	// Check if the key was successfully generated
-	if (!RSA_generate_key_ex(rsa, params->getBitLength(), bn_e, NULL))
+	// Use a pre-generated key-pair if there is one; the pool only holds
+	// two-prime keys
+	RSA* rsa = NULL;
+	if (primes != 2 ||
+	    !OSSLCryptoFactory::i()->getRSAKeyPool()->take(params->getBitLength(), e, &rsa))
 	{
-		// ERROR_MSG("RSA key generation failed (0x%08X)", ERR_get_error());
-		BN_free(bn_e);
-		RSA_free(rsa);
+		// Generate the key-pair
+		rsa = RSA_new();
+		if (rsa == NULL)
+		{
+			// ERROR_MSG("Failed to instantiate OpenSSL RSA object");
 
-		return false;
+			return false;
+		}
+
+		BIGNUM* bn_e = OSSL::byteString2bn(params->getE());
+
+		// Check if the key was successfully generated
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+		if (!RSA_generate_multi_prime_key(rsa, params->getBitLength(), primes, bn_e, NULL))
+#else
+		if (!RSA_generate_key_ex(rsa, params->getBitLength(), bn_e, NULL))
+#endif
+		{
+			// ERROR_MSG("RSA key generation failed (0x%08X)", ERR_get_error());
+			BN_free(bn_e);
+			RSA_free(rsa);
+
+			return false;
+		}
+		BN_free(bn_e);
 	}
-	BN_free(bn_e);
 
 	// Create an asymmetric key-pair object to return
 	OSSLRSAKeyPair* kp = new OSSLRSAKeyPair();
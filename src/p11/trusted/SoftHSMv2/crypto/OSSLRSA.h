@@ -112,6 +112,9 @@ public:
 	virtual PrivateKey* newPrivateKey();
 	virtual AsymmetricParameters* newParameters();
 
+	// Recycle the hashes of an unfinished operation
+	virtual void reset();
+
 private:
 	HashAlgorithm* pCurrentHash;
 	HashAlgorithm* pSecondHash;
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*****************************************************************************
+ OSSLRSAKeyPool.cpp
+
+ Pool of pre-generated RSA key pairs
+ *****************************************************************************/
+
+#include "config.h"
+#include "OSSLRSAKeyPool.h"
+#include <openssl/bn.h>
+
+// The maximum number of key sizes that get a pool
+#define MAX_POOL_KEY_SIZES	4
+
+// Constructor
+OSSLRSAKeyPool::OSSLRSAKeyPool(unsigned long poolSize)
+{
+	this->poolSize = poolSize;
+	hits = 0;
+	misses = 0;
+	poolMutex = MutexFactory::i()->getMutex();
+}
+
+// Destructor
+OSSLRSAKeyPool::~OSSLRSAKeyPool()
+{
+	clear();
+
+	MutexFactory::i()->recycleMutex(poolMutex);
+}
+
+// Take a pre-generated key pair
+bool OSSLRSAKeyPool::take(unsigned long bitLen, unsigned long e, RSA** rsa)
+{
+	if (poolSize == 0 || rsa == NULL) return false;
+
+	MutexLocker lock(poolMutex);
+
+	KeySize size(bitLen, e);
+
+	std::map<KeySize, std::deque<RSA*> >::iterator i = pools.find(size);
+	if (i == pools.end())
+	{
+		// Remember the size, so the next fill() generates keys for it
+		if (pools.size() < MAX_POOL_KEY_SIZES)
+		{
+			pools[size] = std::deque<RSA*>();
+		}
+
+		misses++;
+
+		return false;
+	}
+
+	if (i->second.empty())
+	{
+		misses++;
+
+		return false;
+	}
+
+	*rsa = i->second.front();
+	i->second.pop_front();
+
+	hits++;
+
+	return true;
+}
+
+// Generate at most maxCount key pairs for the sizes that were requested
+unsigned long OSSLRSAKeyPool::fill(unsigned long maxCount)
+{
+	unsigned long count = 0;
+
+	while (count < maxCount)
+	{
+		KeySize size(0, 0);
+
+		// Find the size with the fewest key pairs
+		{
+			MutexLocker lock(poolMutex);
+
+			size_t fewest = poolSize;
+			for (std::map<KeySize, std::deque<RSA*> >::iterator i = pools.begin(); i != pools.end(); i++)
+			{
+				if (i->second.size() < fewest)
+				{
+					fewest = i->second.size();
+					size = i->first;
+				}
+			}
+		}
+
+		if (size.first == 0) break;
+
+		// The key is generated without holding the mutex
+		RSA* rsa = RSA_new();
+		BIGNUM* bn_e = BN_new();
+
+		if (rsa == NULL || bn_e == NULL ||
+		    !BN_set_word(bn_e, size.second) ||
+		    !RSA_generate_key_ex(rsa, size.first, bn_e, NULL))
+		{
+			// ERROR_MSG("RSA key generation failed (0x%08X)", ERR_get_error());
+
+			BN_free(bn_e);
+			RSA_free(rsa);
+
+			break;
+		}
+
+		BN_free(bn_e);
+
+		MutexLocker lock(poolMutex);
+
+		std::map<KeySize, std::deque<RSA*> >::iterator i = pools.find(size);
+		if (i == pools.end() || i->second.size() >= poolSize)
+		{
+			RSA_free(rsa);
+
+			break;
+		}
+
+		i->second.push_back(rsa);
+
+		count++;
+	}
+
+	return count;
+}
+
+// Wipe all key pairs
+void OSSLRSAKeyPool::clear()
+{
+	MutexLocker lock(poolMutex);
+
+	for (std::map<KeySize, std::deque<RSA*> >::iterator i = pools.begin(); i != pools.end(); i++)
+	{
+		freeKeys(i->second);
+	}
+}
+
+// Is the pool of a key size down to half of its size?
+bool OSSLRSAKeyPool::isLow()
+{
+	if (poolSize == 0) return false;
+
+	MutexLocker lock(poolMutex);
+
+	for (std::map<KeySize, std::deque<RSA*> >::iterator i = pools.begin(); i != pools.end(); i++)
+	{
+		if (i->second.size() <= poolSize / 2)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Statistics
+unsigned long OSSLRSAKeyPool::getHits()
+{
+	MutexLocker lock(poolMutex);
+
+	return hits;
+}
+
+unsigned long OSSLRSAKeyPool::getMisses()
+{
+	MutexLocker lock(poolMutex);
+
+	return misses;
+}
+
+unsigned long OSSLRSAKeyPool::getSize()
+{
+	MutexLocker lock(poolMutex);
+
+	unsigned long size = 0;
+	for (std::map<KeySize, std::deque<RSA*> >::iterator i = pools.begin(); i != pools.end(); i++)
+	{
+		size += i->second.size();
+	}
+
+	return size;
+}
+
+// Wipe the key pairs of a key size; the caller holds the mutex. RSA_free
+// clears the private components before releasing them.
+/*static*/ void OSSLRSAKeyPool::freeKeys(std::deque<RSA*>& keys)
+{
+	for (std::deque<RSA*>::iterator i = keys.begin(); i != keys.end(); i++)
+	{
+		RSA_free(*i);
+	}
+
+	keys.clear();
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*****************************************************************************
+ OSSLRSAKeyPool.h
+
+ Pool of pre-generated RSA key pairs. Generating an RSA key is dominated by
+ the search for the primes, which takes long and varies a lot with the key
+ size. Key pairs for the sizes that the application uses are therefore
+ generated ahead of time, while the token is idle, and every key pair is
+ handed out exactly once.
+ *****************************************************************************/
+
+#ifndef _SOFTHSM_V2_OSSLRSAKEYPOOL_H
+#define _SOFTHSM_V2_OSSLRSAKEYPOOL_H
+
+#include "config.h"
+#include "MutexFactory.h"
+#include <deque>
+#include <map>
+#include <utility>
+#include <openssl/rsa.h>
+
+class OSSLRSAKeyPool
+{
+public:
+	// Constructor; poolSize is the number of key pairs kept per key size
+	OSSLRSAKeyPool(unsigned long poolSize);
+
+	OSSLRSAKeyPool(const OSSLRSAKeyPool&) = delete;
+
+	OSSLRSAKeyPool& operator=(const OSSLRSAKeyPool&) = delete;
+
+	// Destructor; wipes all key pairs
+	virtual ~OSSLRSAKeyPool();
+
+	// Take a pre-generated key pair with the given modulus length and public
+	// exponent; the caller owns the key and must free it with RSA_free.
+	// Returns false if there is none; the size is then filled by the next
+	// fill().
+	bool take(unsigned long bitLen, unsigned long e, RSA** rsa);
+
+	// Generate at most maxCount key pairs for the sizes that were requested;
+	// returns the number of key pairs generated
+	unsigned long fill(unsigned long maxCount);
+
+	// Is the pool of a key size down to half of its size?
+	bool isLow();
+
+	// Wipe all key pairs
+	void clear();
+
+	// Statistics
+	unsigned long getHits();
+	unsigned long getMisses();
+	unsigned long getSize();
+
+private:
+	// Modulus length and public exponent
+	typedef std::pair<unsigned long, unsigned long> KeySize;
+
+	// Wipe the key pairs of a key size; the caller holds the mutex
+	static void freeKeys(std::deque<RSA*>& keys);
+
+	// The number of key pairs kept per key size
+	unsigned long poolSize;
+
+	// The key pairs by key size
+	std::map<KeySize, std::deque<RSA*> > pools;
+
+	// Statistics
+	unsigned long hits;
+	unsigned long misses;
+
+	// For thread safeness
+	Mutex* poolMutex;
+};
+
+#endif // !_SOFTHSM_V2_OSSLRSAKEYPOOL_H
@@ -67,6 +67,7 @@
 #include "OSSLUtil.h"
 #include <openssl/bn.h>
 #include <openssl/x509.h>
+#include <vector>
 #ifdef WITH_FIPS
 #include <openssl/fips.h>
 #endif
@@ -150,6 +151,30 @@ void OSSLRSAPrivateKey::setFromOSSL(const RSA* inRSA)
 		ByteString inD = OSSL::bn2ByteString(bn_d);
 		setD(inD);
 	}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+	// The additional primes of a multi-prime key
+	ByteString inOtherPrimes;
+	int extra = RSA_get_multi_prime_extra_count(inRSA);
+	if (extra > 0)
+	{
+		std::vector<const BIGNUM*> bn_primes(extra);
+		std::vector<const BIGNUM*> bn_exps(extra);
+		std::vector<const BIGNUM*> bn_coeffs(extra);
+
+		if (RSA_get0_multi_prime_factors(inRSA, &bn_primes[0]) &&
+		    RSA_get0_multi_prime_crt_params(inRSA, &bn_exps[0], &bn_coeffs[0]))
+		{
+			for (int i = 0; i < extra; i++)
+			{
+				inOtherPrimes += OSSL::bn2ByteString(bn_primes[i]).serialise();
+				inOtherPrimes += OSSL::bn2ByteString(bn_exps[i]).serialise();
+				inOtherPrimes += OSSL::bn2ByteString(bn_coeffs[i]).serialise();
+			}
+		}
+	}
+	setOtherPrimes(inOtherPrimes);
+#endif
 }
 
 // Check if the key is of the given type
@@ -225,6 +250,17 @@ void OSSLRSAPrivateKey::setD(const ByteString& inD)
 	}
 }
 
+void OSSLRSAPrivateKey::setOtherPrimes(const ByteString& inOtherPrimes)
+{
+	RSAPrivateKey::setOtherPrimes(inOtherPrimes);
+
+	if (rsa)
+	{
+		RSA_free(rsa);
+		rsa = NULL;
+	}
+}
+
 
 // Setters for the RSA public key components
 void OSSLRSAPrivateKey::setN(const ByteString& inN)
@@ -346,5 +382,38 @@ void OSSLRSAPrivateKey::createOSSLKey()
 	RSA_set0_factors(rsa, bn_p, bn_q);
 	RSA_set0_crt_params(rsa, bn_dmp1, bn_dmq1, bn_iqmp);
 	RSA_set0_key(rsa, bn_n, bn_e, bn_d);
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+	// The additional primes of a multi-prime key
+	if (otherPrimes.size() > 0)
+	{
+		ByteString serialised = otherPrimes;
+		std::vector<BIGNUM*> bn_primes;
+		std::vector<BIGNUM*> bn_exps;
+		std::vector<BIGNUM*> bn_coeffs;
+
+		while (serialised.size() > 0)
+		{
+			bn_primes.push_back(OSSL::byteString2bn(ByteString::chainDeserialise(serialised)));
+			bn_exps.push_back(OSSL::byteString2bn(ByteString::chainDeserialise(serialised)));
+			bn_coeffs.push_back(OSSL::byteString2bn(ByteString::chainDeserialise(serialised)));
+		}
+
+		if (!RSA_set0_multi_prime_params(rsa, &bn_primes[0], &bn_exps[0], &bn_coeffs[0], bn_primes.size()))
+		{
+			// ERROR_MSG("Could not set the additional RSA primes");
+
+			for (size_t i = 0; i < bn_primes.size(); i++)
+			{
+				BN_clear_free(bn_primes[i]);
+				BN_clear_free(bn_exps[i]);
+				BN_clear_free(bn_coeffs[i]);
+			}
+
+			RSA_free(rsa);
+			rsa = NULL;
+		}
+	}
+#endif
 }
 
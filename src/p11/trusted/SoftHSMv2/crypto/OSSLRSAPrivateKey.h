@@ -61,6 +61,7 @@ public:
 	virtual void setDP1(const ByteString& inDP1);
 	virtual void setDQ1(const ByteString& inDQ1);
 	virtual void setD(const ByteString& inD);
+	virtual void setOtherPrimes(const ByteString& inOtherPrimes);
 
 	// Setters for the RSA public key components
 	virtual void setN(const ByteString& inN);
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*****************************************************************************
+ PublicKeyCache.cpp
+
+ Cache of public keys built from key objects
+ *****************************************************************************/
+
+#include "config.h"
+#include "PublicKeyCache.h"
+
+// Constructor
+PublicKeyCache::PublicKeyCache(unsigned long maxEntries)
+{
+	this->maxEntries = maxEntries;
+	useCounter = 0;
+	hits = 0;
+	misses = 0;
+	cacheMutex = MutexFactory::i()->getMutex();
+}
+
+// Destructor
+PublicKeyCache::~PublicKeyCache()
+{
+	forget(NULL);
+
+	MutexFactory::i()->recycleMutex(cacheMutex);
+}
+
+// Take the public key of the object out of the cache
+PublicKey* PublicKeyCache::take(const void* owner, AsymAlgo::Type algorithm, const ByteString& fingerprint)
+{
+	MutexLocker lock(cacheMutex);
+
+	std::map<KeyTag, CachedKey>::iterator i = keys.find(KeyTag(owner, algorithm));
+	if (i == keys.end())
+	{
+		misses++;
+
+		return NULL;
+	}
+
+	// The attributes of the object changed, or another object was created
+	// at the same address
+	if (i->second.fingerprint != fingerprint)
+	{
+		delete i->second.publicKey;
+		keys.erase(i);
+
+		misses++;
+
+		return NULL;
+	}
+
+	PublicKey* publicKey = i->second.publicKey;
+	keys.erase(i);
+
+	hits++;
+
+	return publicKey;
+}
+
+// Put a public key built for the object into the cache
+void PublicKeyCache::put(const void* owner, AsymAlgo::Type algorithm, const ByteString& fingerprint, PublicKey* publicKey)
+{
+	if (publicKey == NULL) return;
+
+	if (maxEntries == 0)
+	{
+		delete publicKey;
+
+		return;
+	}
+
+	MutexLocker lock(cacheMutex);
+
+	KeyTag tag(owner, algorithm);
+
+	// Another caller put a key for the object back first
+	std::map<KeyTag, CachedKey>::iterator i = keys.find(tag);
+	if (i != keys.end())
+	{
+		delete i->second.publicKey;
+		keys.erase(i);
+	}
+
+	if (keys.size() >= maxEntries)
+	{
+		std::map<KeyTag, CachedKey>::iterator lru = keys.begin();
+		for (i = keys.begin(); i != keys.end(); i++)
+		{
+			if (i->second.lastUse < lru->second.lastUse) lru = i;
+		}
+
+		delete lru->second.publicKey;
+		keys.erase(lru);
+	}
+
+	CachedKey& cached = keys[tag];
+	cached.fingerprint = fingerprint;
+	cached.publicKey = publicKey;
+	cached.lastUse = ++useCounter;
+}
+
+// Drop the public keys of the object, or all keys
+void PublicKeyCache::forget(const void* owner)
+{
+	MutexLocker lock(cacheMutex);
+
+	std::map<KeyTag, CachedKey>::iterator i = keys.begin();
+	while (i != keys.end())
+	{
+		if (owner == NULL || i->first.first == owner)
+		{
+			delete i->second.publicKey;
+			keys.erase(i++);
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+// Statistics
+unsigned long PublicKeyCache::getHits()
+{
+	MutexLocker lock(cacheMutex);
+
+	return hits;
+}
+
+unsigned long PublicKeyCache::getMisses()
+{
+	MutexLocker lock(cacheMutex);
+
+	return misses;
+}
+
+unsigned long PublicKeyCache::getSize()
+{
+	MutexLocker lock(cacheMutex);
+
+	return keys.size();
+}
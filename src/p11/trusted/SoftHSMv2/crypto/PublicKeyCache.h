@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*****************************************************************************
+ PublicKeyCache.h
+
+ Cache of public keys built from key objects. Building a public key parses
+ the key attributes and, for EC and EdDSA keys, decodes and checks the point.
+ Keys verifying many signatures are kept so the work is done once per key
+ object. A cached key is used by one caller at a time: it is taken out of
+ the cache and put back after use.
+ *****************************************************************************/
+
+#ifndef _SOFTHSM_V2_PUBLICKEYCACHE_H
+#define _SOFTHSM_V2_PUBLICKEYCACHE_H
+
+#include "config.h"
+#include "ByteString.h"
+#include "PublicKey.h"
+#include "AsymmetricAlgorithm.h"
+#include "MutexFactory.h"
+#include <map>
+#include <utility>
+
+class PublicKeyCache
+{
+public:
+	// Constructor; maxEntries is the number of public keys kept
+	PublicKeyCache(unsigned long maxEntries);
+
+	PublicKeyCache(const PublicKeyCache&) = delete;
+
+	PublicKeyCache& operator=(const PublicKeyCache&) = delete;
+
+	// Destructor; deletes all public keys
+	virtual ~PublicKeyCache();
+
+	// Take the public key of the object out of the cache; the caller owns
+	// the key until it is put back. The fingerprint holds the encoded key
+	// attributes; a key built from other attribute values is dropped and
+	// NULL is returned.
+	PublicKey* take(const void* owner, AsymAlgo::Type algorithm, const ByteString& fingerprint);
+
+	// Put a public key built for the object into the cache; the cache takes
+	// ownership and deletes the key if it keeps another one for the object
+	void put(const void* owner, AsymAlgo::Type algorithm, const ByteString& fingerprint, PublicKey* publicKey);
+
+	// Drop the public keys of the object, or all keys if owner is NULL
+	void forget(const void* owner);
+
+	// Statistics
+	unsigned long getHits();
+	unsigned long getMisses();
+	unsigned long getSize();
+
+private:
+	// A cached public key
+	struct CachedKey
+	{
+		ByteString fingerprint;
+		PublicKey* publicKey;
+
+		// For evicting the least recently used key
+		unsigned long lastUse;
+	};
+
+	// Keys are cached per key object and algorithm
+	typedef std::pair<const void*, AsymAlgo::Type> KeyTag;
+
+	// The number of keys kept
+	unsigned long maxEntries;
+
+	// The keys
+	std::map<KeyTag, CachedKey> keys;
+
+	// Use counter for the LRU eviction
+	unsigned long useCounter;
+
+	// Statistics
+	unsigned long hits;
+	unsigned long misses;
+
+	// For thread safeness
+	Mutex* cacheMutex;
+};
+
+#endif // !_SOFTHSM_V2_PUBLICKEYCACHE_H
@@ -80,6 +80,12 @@ void RSAParameters::setBitLength(const size_t inBitLen)
 	bitLen = inBitLen;
 }
 
+// Set the number of primes
+void RSAParameters::setPrimes(const size_t inPrimes)
+{
+	primes = inPrimes;
+}
+
 // Get the public exponent
 const ByteString& RSAParameters::getE() const
 {
@@ -92,6 +98,12 @@ size_t RSAParameters::getBitLength() const
 	return bitLen;
 }
 
+// Get the number of primes
+size_t RSAParameters::getPrimes() const
+{
+	return primes;
+}
+
 // Are the parameters of the given type?
 bool RSAParameters::areOfType(const char* inType)
 {
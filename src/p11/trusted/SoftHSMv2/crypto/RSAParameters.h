@@ -41,7 +41,7 @@ class RSAParameters : public AsymmetricParameters
 {
 public:
 	// Base constructor
-	RSAParameters() : bitLen(0) { }
+	RSAParameters() : bitLen(0), primes(2) { }
 
 	// The type
 	static const char* type;
@@ -52,12 +52,18 @@ public:
 	// Set the bit length
 	void setBitLength(const size_t inBitLen);
 
+	// Set the number of primes; more than 2 gives a multi-prime key
+	void setPrimes(const size_t inPrimes);
+
 	// Get the public exponent
 	const ByteString& getE() const;
 
 	// Get the bit length
 	size_t getBitLength() const;
 
+	// Get the number of primes
+	size_t getPrimes() const;
+
 	// Are the parameters of the given type?
 	virtual bool areOfType(const char* inType);
 
@@ -68,6 +74,7 @@ public:
 private:
 	ByteString e;
 	size_t bitLen;
+	size_t primes;
 };
 
 #endif // !_SOFTHSM_V2_RSAPARAMETERS_H
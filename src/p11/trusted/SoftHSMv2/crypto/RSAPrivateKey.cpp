@@ -118,6 +118,11 @@ void RSAPrivateKey::setD(const ByteString& inD)
 	d = inD;
 }
 
+void RSAPrivateKey::setOtherPrimes(const ByteString& inOtherPrimes)
+{
+	otherPrimes = inOtherPrimes;
+}
+
 // Setters for the RSA public key components
 void RSAPrivateKey::setN(const ByteString& inN)
 {
@@ -160,6 +165,11 @@ const ByteString& RSAPrivateKey::getD() const
 	return d;
 }
 
+const ByteString& RSAPrivateKey::getOtherPrimes() const
+{
+	return otherPrimes;
+}
+
 // Getters for the RSA public key components
 const ByteString& RSAPrivateKey::getN() const
 {
@@ -181,7 +191,8 @@ ByteString RSAPrivateKey::serialise() const
 	       dq1.serialise() +
 	       d.serialise() +
 	       n.serialise() +
-	       e.serialise();
+	       e.serialise() +
+	       otherPrimes.serialise();
 }
 
 bool RSAPrivateKey::deserialise(ByteString& serialised)
@@ -194,6 +205,9 @@ bool RSAPrivateKey::deserialise(ByteString& serialised)
 	ByteString dD = ByteString::chainDeserialise(serialised);
 	ByteString dN = ByteString::chainDeserialise(serialised);
 	ByteString dE = ByteString::chainDeserialise(serialised);
+	// Empty for two-prime keys and for keys serialised before multi-prime
+	// support
+	ByteString dOtherPrimes = ByteString::chainDeserialise(serialised);
 
 	if ((dD.size() == 0) ||
 	    (dN.size() == 0) ||
@@ -210,6 +224,7 @@ bool RSAPrivateKey::deserialise(ByteString& serialised)
 	setD(dD);
 	setN(dN);
 	setE(dE);
+	setOtherPrimes(dOtherPrimes);
 
 	return true;
 }
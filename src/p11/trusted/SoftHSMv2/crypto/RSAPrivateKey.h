@@ -59,6 +59,10 @@ public:
 	virtual void setDQ1(const ByteString& inDQ1);
 	virtual void setD(const ByteString& inD);
 
+	// Setter for the additional primes of a multi-prime key; a chain of
+	// serialised (prime, exponent, coefficient) triplets
+	virtual void setOtherPrimes(const ByteString& inOtherPrimes);
+
 	// Setters for the RSA public key components
 	virtual void setN(const ByteString& inN);
 	virtual void setE(const ByteString& inE);
@@ -70,6 +74,7 @@ public:
 	virtual const ByteString& getDP1() const;
 	virtual const ByteString& getDQ1() const;
 	virtual const ByteString& getD() const;
+	virtual const ByteString& getOtherPrimes() const;
 
 	// Getters for the RSA public key components
 	virtual const ByteString& getN() const;
@@ -83,6 +88,9 @@ protected:
 	// Private components
 	ByteString p,q,pq,dp1,dq1,d;
 
+	// Additional primes of a multi-prime key; empty for two-prime keys
+	ByteString otherPrimes;
+
 	// Public components
 	ByteString n,e;
 };
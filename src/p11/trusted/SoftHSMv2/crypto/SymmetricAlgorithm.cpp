@@ -41,11 +41,12 @@ SymmetricAlgorithm::SymmetricAlgorithm()
 	currentPaddingMode = true;
 	currentCounterBits = 0;
 	currentTagBytes = 0;
+	currentSegmentBytes = 0;
 	currentOperation = NONE;
 	currentBufferSize = 0;
 }
 
-bool SymmetricAlgorithm::encryptInit(const SymmetricKey* key, const SymMode::Type mode /* = SymMode::CBC */, const ByteString& /*IV = ByteString() */, bool padding /* = true */, size_t counterBits /* = 0 */, const ByteString& /*aad = ByteString()*/, size_t tagBytes /* = 0 */)
+bool SymmetricAlgorithm::encryptInit(const SymmetricKey* key, const SymMode::Type mode /* = SymMode::CBC */, const ByteString& /*IV = ByteString() */, bool padding /* = true */, size_t counterBits /* = 0 */, const ByteString& /*aad = ByteString()*/, size_t tagBytes /* = 0 */, size_t segmentBytes /* = 0 */)
 {
 	if ((key == NULL) || (currentOperation != NONE))
 	{
@@ -57,6 +58,7 @@ bool SymmetricAlgorithm::encryptInit(const SymmetricKey* key, const SymMode::Typ
 	currentPaddingMode = padding;
 	currentCounterBits = counterBits;
 	currentTagBytes = tagBytes;
+	currentSegmentBytes = segmentBytes;
 	currentOperation = ENCRYPT;
 	currentBufferSize = 0;
 
@@ -87,13 +89,14 @@ bool SymmetricAlgorithm::encryptFinal(ByteString& /*encryptedData*/)
 	currentPaddingMode = true;
 	currentCounterBits = 0;
 	currentTagBytes = 0;
+	currentSegmentBytes = 0;
 	currentOperation = NONE;
 	currentBufferSize = 0;
 
 	return true;
 }
 
-bool SymmetricAlgorithm::decryptInit(const SymmetricKey* key, const SymMode::Type mode /* = SymMode::CBC */, const ByteString& /*IV = ByteString() */, bool padding /* = true */, size_t counterBits /* = 0 */, const ByteString& /*aad = ByteString()*/, size_t tagBytes /* = 0 */)
+bool SymmetricAlgorithm::decryptInit(const SymmetricKey* key, const SymMode::Type mode /* = SymMode::CBC */, const ByteString& /*IV = ByteString() */, bool padding /* = true */, size_t counterBits /* = 0 */, const ByteString& /*aad = ByteString()*/, size_t tagBytes /* = 0 */, size_t segmentBytes /* = 0 */)
 {
 	if ((key == NULL) || (currentOperation != NONE))
 	{
@@ -105,6 +108,7 @@ bool SymmetricAlgorithm::decryptInit(const SymmetricKey* key, const SymMode::Typ
 	currentPaddingMode = padding;
 	currentCounterBits = counterBits;
 	currentTagBytes = tagBytes;
+	currentSegmentBytes = segmentBytes;
 	currentOperation = DECRYPT;
 	currentBufferSize = 0;
 	currentAEADBuffer.wipe();
@@ -121,7 +125,12 @@ bool SymmetricAlgorithm::decryptUpdate(const ByteString& encryptedData, ByteStri
 	}
 
 	currentBufferSize += encryptedData.size();
-	currentAEADBuffer += encryptedData;
+
+	// Only GCM holds back the ciphertext until the tag can be checked
+	if (currentCipherMode == SymMode::GCM)
+	{
+		currentAEADBuffer += encryptedData;
+	}
 
 	return true;
 }
@@ -138,6 +147,7 @@ bool SymmetricAlgorithm::decryptFinal(ByteString& /*data*/)
 	currentPaddingMode = true;
 	currentCounterBits = 0;
 	currentTagBytes = 0;
+	currentSegmentBytes = 0;
 	currentOperation = NONE;
 	currentBufferSize = 0;
 	currentAEADBuffer.wipe();
@@ -145,6 +155,72 @@ bool SymmetricAlgorithm::decryptFinal(ByteString& /*data*/)
 	return true;
 }
 
+bool SymmetricAlgorithm::messageEncryptInit(const SymmetricKey* key, const SymMode::Type mode /* = SymMode::GCM */)
+{
+	if ((key == NULL) || (currentOperation != NONE))
+	{
+		return false;
+	}
+
+	currentKey = key;
+	currentCipherMode = mode;
+	currentOperation = MESSAGE_ENCRYPT;
+
+	return true;
+}
+
+bool SymmetricAlgorithm::encryptMessage(const ByteString& /*IV*/, const ByteString& /*aad*/, const ByteString& /*data*/, ByteString& /*encryptedData*/, ByteString& /*tag*/, size_t /*tagBytes*/)
+{
+	return (currentOperation == MESSAGE_ENCRYPT);
+}
+
+bool SymmetricAlgorithm::messageEncryptFinal()
+{
+	if (currentOperation != MESSAGE_ENCRYPT)
+	{
+		return false;
+	}
+
+	currentKey = NULL;
+	currentCipherMode = SymMode::Unknown;
+	currentOperation = NONE;
+
+	return true;
+}
+
+bool SymmetricAlgorithm::messageDecryptInit(const SymmetricKey* key, const SymMode::Type mode /* = SymMode::GCM */)
+{
+	if ((key == NULL) || (currentOperation != NONE))
+	{
+		return false;
+	}
+
+	currentKey = key;
+	currentCipherMode = mode;
+	currentOperation = MESSAGE_DECRYPT;
+
+	return true;
+}
+
+bool SymmetricAlgorithm::decryptMessage(const ByteString& /*IV*/, const ByteString& /*aad*/, const ByteString& /*encryptedData*/, const ByteString& /*tag*/, ByteString& /*data*/)
+{
+	return (currentOperation == MESSAGE_DECRYPT);
+}
+
+bool SymmetricAlgorithm::messageDecryptFinal()
+{
+	if (currentOperation != MESSAGE_DECRYPT)
+	{
+		return false;
+	}
+
+	currentKey = NULL;
+	currentCipherMode = SymMode::Unknown;
+	currentOperation = NONE;
+
+	return true;
+}
+
 // Key factory
 void SymmetricAlgorithm::recycleKey(SymmetricKey* toRecycle)
 {
@@ -198,6 +274,11 @@ size_t SymmetricAlgorithm::getTagBytes()
 	return currentTagBytes;
 }
 
+size_t SymmetricAlgorithm::getSegmentBytes()
+{
+	return currentSegmentBytes;
+}
+
 bool SymmetricAlgorithm::isStreamCipher()
 {
 	switch (currentCipherMode)
@@ -205,6 +286,7 @@ bool SymmetricAlgorithm::isStreamCipher()
 		case SymMode::CFB:
 		case SymMode::CTR:
 		case SymMode::GCM:
+		case SymMode::GCM_STREAM:
 		case SymMode::OFB:
 			return true;
 		default:
@@ -227,3 +309,16 @@ bool SymmetricAlgorithm::isBlockCipher()
 
 	return false;
 }
+
+void SymmetricAlgorithm::reset()
+{
+	currentKey = NULL;
+	currentCipherMode = SymMode::Unknown;
+	currentPaddingMode = true;
+	currentCounterBits = 0;
+	currentTagBytes = 0;
+	currentSegmentBytes = 0;
+	currentOperation = NONE;
+	currentBufferSize = 0;
+	currentAEADBuffer.wipe();
+}
@@ -59,6 +59,7 @@ struct SymMode
 		CTR,
 		ECB,
 		GCM,
+		GCM_STREAM,
 		OFB
 	};
 };
@@ -83,15 +84,25 @@ public:
 	virtual ~SymmetricAlgorithm() { }
 
 	// Encryption functions
-	virtual bool encryptInit(const SymmetricKey* key, const SymMode::Type mode = SymMode::CBC, const ByteString& IV = ByteString(), bool padding = true, size_t counterBits = 0, const ByteString& aad = ByteString(), size_t tagBytes = 0);
+	virtual bool encryptInit(const SymmetricKey* key, const SymMode::Type mode = SymMode::CBC, const ByteString& IV = ByteString(), bool padding = true, size_t counterBits = 0, const ByteString& aad = ByteString(), size_t tagBytes = 0, size_t segmentBytes = 0);
 	virtual bool encryptUpdate(const ByteString& data, ByteString& encryptedData);
 	virtual bool encryptFinal(ByteString& encryptedData);
 
 	// Decryption functions
-	virtual bool decryptInit(const SymmetricKey* key, const SymMode::Type mode = SymMode::CBC, const ByteString& IV = ByteString(), bool padding = true, size_t counterBits = 0, const ByteString& aad = ByteString(), size_t tagBytes = 0);
+	virtual bool decryptInit(const SymmetricKey* key, const SymMode::Type mode = SymMode::CBC, const ByteString& IV = ByteString(), bool padding = true, size_t counterBits = 0, const ByteString& aad = ByteString(), size_t tagBytes = 0, size_t segmentBytes = 0);
 	virtual bool decryptUpdate(const ByteString& encryptedData, ByteString& data);
 	virtual bool decryptFinal(ByteString& data);
 
+	// Message-based AEAD functions; the key is set up once by the init
+	// function and every message brings its own IV, AAD and tag
+	virtual bool messageEncryptInit(const SymmetricKey* key, const SymMode::Type mode = SymMode::GCM);
+	virtual bool encryptMessage(const ByteString& IV, const ByteString& aad, const ByteString& data, ByteString& encryptedData, ByteString& tag, size_t tagBytes);
+	virtual bool messageEncryptFinal();
+
+	virtual bool messageDecryptInit(const SymmetricKey* key, const SymMode::Type mode = SymMode::GCM);
+	virtual bool decryptMessage(const ByteString& IV, const ByteString& aad, const ByteString& encryptedData, const ByteString& tag, ByteString& data);
+	virtual bool messageDecryptFinal();
+
 	// Wrap/Unwrap keys
 	virtual bool wrapKey(const SymmetricKey* key, const SymWrap::Type mode, const ByteString& in, ByteString& out) = 0;
 
@@ -108,10 +119,15 @@ public:
 	virtual bool getPaddingMode();
 	virtual unsigned long getBufferSize();
 	virtual size_t getTagBytes();
+	virtual size_t getSegmentBytes();
 	virtual bool isStreamCipher();
 	virtual bool isBlockCipher();
 	virtual bool checkMaximumBytes(unsigned long bytes) = 0;
 
+	// Return to the idle state and wipe the operation state, so that the
+	// instance can be handed out again
+	virtual void reset();
+
 protected:
 	// The current key
 	const SymmetricKey* currentKey;
@@ -128,12 +144,17 @@ protected:
 	// The current tag bytes
 	size_t currentTagBytes;
 
+	// The current segment size of a segmented AEAD stream
+	size_t currentSegmentBytes;
+
 	// The current operation
 	enum
 	{
 		NONE,
 		ENCRYPT,
-		DECRYPT
+		DECRYPT,
+		MESSAGE_ENCRYPT,
+		MESSAGE_DECRYPT
 	}
 	currentOperation;
 
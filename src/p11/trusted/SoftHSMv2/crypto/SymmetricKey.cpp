@@ -71,6 +71,7 @@
 SymmetricKey::SymmetricKey(size_t inBitLen /* = 0 */)
 {
 	bitLen = inBitLen;
+	cacheOwner = NULL;
 }
 
 // Set the key
@@ -132,3 +133,14 @@ size_t SymmetricKey::getBitLen() const
 	return bitLen;
 }
 
+// Set the object the key was read from
+void SymmetricKey::setCacheOwner(const void* owner)
+{
+	cacheOwner = owner;
+}
+
+// Retrieve the object the key was read from
+const void* SymmetricKey::getCacheOwner() const
+{
+	return cacheOwner;
+}
@@ -92,12 +92,20 @@ public:
 	// Retrieve the bit length
 	virtual size_t getBitLen() const;
 
+	// The object the key was read from, if any; crypto implementations
+	// may keep state that is derived from the key by this object
+	virtual void setCacheOwner(const void* owner);
+	virtual const void* getCacheOwner() const;
+
 protected:
 	// The key
 	ByteString keyData;
 
 	// The key length in bits
 	size_t bitLen;
+
+	// The object the key was read from
+	const void* cacheOwner;
 };
 
 #endif // !_SOFTHSM_V2_SYMMETRICKEY_H
@@ -75,6 +75,7 @@
 #include "CryptoFactory.h"
 #include "AESKey.h"
 #include "SymmetricAlgorithm.h"
+#include "MacAlgorithm.h"
 #include "RFC4880.h"
 
 // Constructors
@@ -95,6 +96,7 @@ void SecureDataManager::initObject()
 
 	// Set the initial login state
 	soLoggedIn = userLoggedIn = false;
+	blindKey = NULL;
 
 	// Set the magic
 	magic = ByteString("534758"); // SGX
@@ -129,6 +131,9 @@ SecureDataManager::~SecureDataManager()
 	// Clean up the mask
 	delete mask;
 
+	// Wipe the key of the blind indexes
+	delete blindKey;
+
 	MutexFactory::i()->recycleMutex(dataMgrMutex);
 }
 
@@ -337,6 +342,13 @@ bool SecureDataManager::login(const ByteString& passphrase, const ByteString& en
 	decryptedKeyData.wipe();
 
 	MutexLocker lock(dataMgrMutex);
+	if (!deriveBlindKey(key))
+	{
+		key.wipe();
+
+		return false;
+	}
+
 	remask(key);
 
 	return true;
@@ -429,6 +441,10 @@ void SecureDataManager::logout()
 
 	// Clear the masked key
 	maskedKey.wipe();
+
+	// Wipe the key of the blind indexes
+	delete blindKey;
+	blindKey = NULL;
 }
 
 // Decrypt the supplied data
@@ -531,6 +547,66 @@ bool SecureDataManager::encrypt(const ByteString& plaintext, ByteString& encrypt
 	return true;
 }
 
+// Compute the blind index MAC of the supplied data
+bool SecureDataManager::blindIndex(const ByteString& data, ByteString& mac)
+{
+	// Check the object logged in state
+	if (!userLoggedIn && !soLoggedIn)
+	{
+		return false;
+	}
+
+	MacAlgorithm* hmac = CryptoFactory::i()->getMacAlgorithm(MacAlgo::HMAC_SHA256);
+	if (hmac == NULL) return false;
+
+	bool rv;
+
+	{
+		MutexLocker lock(dataMgrMutex);
+
+		rv = (blindKey != NULL) &&
+		     hmac->signInit(blindKey) &&
+		     hmac->signUpdate(data) &&
+		     hmac->signFinal(mac);
+	}
+
+	CryptoFactory::i()->recycleMacAlgorithm(hmac);
+
+	return rv;
+}
+
+// Derive a separate key for the blind indexes, so the MACs are not computed
+// with the key that encrypts the values
+bool SecureDataManager::deriveBlindKey(const ByteString& key)
+{
+	delete blindKey;
+	blindKey = NULL;
+
+	MacAlgorithm* hmac = CryptoFactory::i()->getMacAlgorithm(MacAlgo::HMAC_SHA256);
+	if (hmac == NULL) return false;
+
+	SymmetricKey theKey(256);
+	ByteString blindKeyBits;
+	ByteString label((const unsigned char*)"blind index", 11);
+
+	bool rv = theKey.setKeyBits(key) &&
+		  hmac->signInit(&theKey) &&
+		  hmac->signUpdate(label) &&
+		  hmac->signFinal(blindKeyBits);
+
+	CryptoFactory::i()->recycleMacAlgorithm(hmac);
+
+	if (rv)
+	{
+		blindKey = new SymmetricKey(256);
+		rv = blindKey->setKeyBits(blindKeyBits);
+	}
+
+	blindKeyBits.wipe();
+
+	return rv;
+}
+
 // Returns the key blob for the SO PIN
 ByteString SecureDataManager::getSOPINBlob()
 {
@@ -128,6 +128,10 @@ public:
 	// Encrypt the supplied data
 	bool encrypt(const ByteString& plaintext, ByteString& encrypted);
 
+	// Compute the blind index MAC of the supplied data, using a key that is
+	// derived from the key that encrypts the data at login
+	bool blindIndex(const ByteString& data, ByteString& mac);
+
 	// Returns the key blob for the SO PIN
 	ByteString getSOPINBlob();
 
@@ -153,6 +157,10 @@ private:
 	// Remask the key
 	void remask(ByteString& key);
 
+	// Derive the key of the blind indexes from the key; the caller holds
+	// the mutex
+	bool deriveBlindKey(const ByteString& key);
+
 	// The user PIN encrypted key
 	ByteString userEncryptedKey;
 
@@ -166,6 +174,9 @@ private:
 	// The masked version of the actual key
 	ByteString maskedKey;
 
+	// The key of the blind indexes while a user is logged in
+	SymmetricKey* blindKey;
+
 	// The "magic" data used to detect if a PIN was likely to be correct
 	ByteString magic;
 
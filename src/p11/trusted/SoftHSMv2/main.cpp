@@ -1124,6 +1124,51 @@ PKCS_API CK_RV C_UnwrapKey
 	return CKR_FUNCTION_FAILED;
 }
 
+// Wrap a batch of keys with one wrapping key (vendor extension)
+PKCS_API CK_RV C_WrapKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hWrappingKey, CK_WRAP_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+	try
+	{
+		return SoftHSM::i()->C_WrapKeyBatch(hSession, pMechanism, hWrappingKey, pItems, ulCount);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Unwrap a batch of keys with one unwrapping key (vendor extension)
+PKCS_API CK_RV C_UnwrapKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hUnwrappingKey, CK_UNWRAP_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+	try
+	{
+		return SoftHSM::i()->C_UnwrapKeyBatch(hSession, pMechanism, hUnwrappingKey, pItems, ulCount);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Derive a batch of keys from one base key (vendor extension)
+PKCS_API CK_RV C_DeriveKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hBaseKey, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulAttributeCount, CK_DERIVE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+	try
+	{
+		return SoftHSM::i()->C_DeriveKeyBatch(hSession, pMechanism, hBaseKey, pTemplate, ulAttributeCount, pItems, ulCount);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
 #if 0 // Unsupported by Crypto API Toolkit
 // Derive a key from the specified base key
 PKCS_API CK_RV C_DeriveKey
@@ -1179,6 +1224,261 @@ PKCS_API CK_RV C_GenerateRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pRandomD
 	return CKR_FUNCTION_FAILED;
 }
 
+// Initialise message-based encryption (PKCS #11 v3.0)
+PKCS_API CK_RV C_MessageEncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+	try
+	{
+		return SoftHSM::i()->C_MessageEncryptInit(hSession, pMechanism, hKey);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Encrypt one message (PKCS #11 v3.0)
+PKCS_API CK_RV C_EncryptMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pAssociatedData, CK_ULONG ulAssociatedDataLen, CK_BYTE_PTR pPlaintext, CK_ULONG ulPlaintextLen, CK_BYTE_PTR pCiphertext, CK_ULONG_PTR pulCiphertextLen)
+{
+	try
+	{
+		return SoftHSM::i()->C_EncryptMessage(hSession, pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen, pPlaintext, ulPlaintextLen, pCiphertext, pulCiphertextLen);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Encrypt a batch of messages (vendor extension)
+PKCS_API CK_RV C_EncryptMessageBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+	try
+	{
+		return SoftHSM::i()->C_EncryptMessageBatch(hSession, pItems, ulCount);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Finish message-based encryption (PKCS #11 v3.0)
+PKCS_API CK_RV C_MessageEncryptFinal(CK_SESSION_HANDLE hSession)
+{
+	try
+	{
+		return SoftHSM::i()->C_MessageEncryptFinal(hSession);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Initialise message-based decryption (PKCS #11 v3.0)
+PKCS_API CK_RV C_MessageDecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+	try
+	{
+		return SoftHSM::i()->C_MessageDecryptInit(hSession, pMechanism, hKey);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Decrypt one message (PKCS #11 v3.0)
+PKCS_API CK_RV C_DecryptMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pAssociatedData, CK_ULONG ulAssociatedDataLen, CK_BYTE_PTR pCiphertext, CK_ULONG ulCiphertextLen, CK_BYTE_PTR pPlaintext, CK_ULONG_PTR pulPlaintextLen)
+{
+	try
+	{
+		return SoftHSM::i()->C_DecryptMessage(hSession, pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen, pCiphertext, ulCiphertextLen, pPlaintext, pulPlaintextLen);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Decrypt a batch of messages (vendor extension)
+PKCS_API CK_RV C_DecryptMessageBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+	try
+	{
+		return SoftHSM::i()->C_DecryptMessageBatch(hSession, pItems, ulCount);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Finish message-based decryption (PKCS #11 v3.0)
+PKCS_API CK_RV C_MessageDecryptFinal(CK_SESSION_HANDLE hSession)
+{
+	try
+	{
+		return SoftHSM::i()->C_MessageDecryptFinal(hSession);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Initialise message-based signing (PKCS #11 v3.0)
+PKCS_API CK_RV C_MessageSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+	try
+	{
+		return SoftHSM::i()->C_MessageSignInit(hSession, pMechanism, hKey);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Sign one message (PKCS #11 v3.0)
+PKCS_API CK_RV C_SignMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	try
+	{
+		return SoftHSM::i()->C_SignMessage(hSession, pParameter, ulParameterLen, pData, ulDataLen, pSignature, pulSignatureLen);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Finish message-based signing (PKCS #11 v3.0)
+PKCS_API CK_RV C_MessageSignFinal(CK_SESSION_HANDLE hSession)
+{
+	try
+	{
+		return SoftHSM::i()->C_MessageSignFinal(hSession);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Initialise message-based verification (PKCS #11 v3.0)
+PKCS_API CK_RV C_MessageVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+	try
+	{
+		return SoftHSM::i()->C_MessageVerifyInit(hSession, pMechanism, hKey);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Verify one message (PKCS #11 v3.0)
+PKCS_API CK_RV C_VerifyMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
+{
+	try
+	{
+		return SoftHSM::i()->C_VerifyMessage(hSession, pParameter, ulParameterLen, pData, ulDataLen, pSignature, ulSignatureLen);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Finish message-based verification (PKCS #11 v3.0)
+PKCS_API CK_RV C_MessageVerifyFinal(CK_SESSION_HANDLE hSession)
+{
+	try
+	{
+		return SoftHSM::i()->C_MessageVerifyFinal(hSession);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Verify a batch of signatures in one call (vendor extension)
+PKCS_API CK_RV C_VerifyBatch(CK_SESSION_HANDLE hSession, CK_VERIFY_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+	try
+	{
+		return SoftHSM::i()->C_VerifyBatch(hSession, pItems, ulCount);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Digest a batch of records in one call (vendor extension)
+PKCS_API CK_RV C_DigestBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_DIGEST_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+	try
+	{
+		return SoftHSM::i()->C_DigestBatch(hSession, pMechanism, pItems, ulCount);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
+// Refill the precomputation pools (vendor extension)
+PKCS_API CK_RV C_PrecomputePools(CK_ULONG ulMaxCount, CK_ULONG_PTR pulCount)
+{
+	try
+	{
+		return SoftHSM::i()->C_PrecomputePools(ulMaxCount, pulCount);
+	}
+	catch (...)
+	{
+		FatalException();
+	}
+
+	return CKR_FUNCTION_FAILED;
+}
+
 #if 0 // Unsupported by Crypto API Toolkit
 // Legacy function
 PKCS_API CK_RV C_GetFunctionStatus(CK_SESSION_HANDLE hSession)
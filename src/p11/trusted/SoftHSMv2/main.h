@@ -70,6 +70,7 @@
 
 #include "config.h"
 #include "cryptoki.h"
+#include "VendorDefs.h"
 
 // PKCS #11 initialisation function
 CK_RV C_Initialize(CK_VOID_PTR pInitArgs);
@@ -282,6 +283,15 @@ CK_RV C_UnwrapKey
 	CK_OBJECT_HANDLE_PTR phKey
 );
 
+// Wrap a batch of keys with one wrapping key (vendor extension)
+CK_RV C_WrapKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hWrappingKey, CK_WRAP_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
+// Unwrap a batch of keys with one unwrapping key (vendor extension)
+CK_RV C_UnwrapKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hUnwrappingKey, CK_UNWRAP_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
+// Derive a batch of keys from one base key (vendor extension)
+CK_RV C_DeriveKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hBaseKey, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulAttributeCount, CK_DERIVE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
 #if 0 // Unsupported by Crypto API Toolkit
 // Derive a key from the specified base key
 CK_RV C_DeriveKey
@@ -300,6 +310,57 @@ CK_RV C_SeedRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSeed, CK_ULONG ulSee
 // Generate the specified amount of random data
 CK_RV C_GenerateRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pRandomData, CK_ULONG ulRandomLen);
 
+// Initialise message-based encryption (PKCS #11 v3.0)
+CK_RV C_MessageEncryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+
+// Encrypt one message (PKCS #11 v3.0)
+CK_RV C_EncryptMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pAssociatedData, CK_ULONG ulAssociatedDataLen, CK_BYTE_PTR pPlaintext, CK_ULONG ulPlaintextLen, CK_BYTE_PTR pCiphertext, CK_ULONG_PTR pulCiphertextLen);
+
+// Encrypt a batch of messages (vendor extension)
+CK_RV C_EncryptMessageBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
+// Finish message-based encryption (PKCS #11 v3.0)
+CK_RV C_MessageEncryptFinal(CK_SESSION_HANDLE hSession);
+
+// Initialise message-based decryption (PKCS #11 v3.0)
+CK_RV C_MessageDecryptInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+
+// Decrypt one message (PKCS #11 v3.0)
+CK_RV C_DecryptMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pAssociatedData, CK_ULONG ulAssociatedDataLen, CK_BYTE_PTR pCiphertext, CK_ULONG ulCiphertextLen, CK_BYTE_PTR pPlaintext, CK_ULONG_PTR pulPlaintextLen);
+
+// Decrypt a batch of messages (vendor extension)
+CK_RV C_DecryptMessageBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
+// Finish message-based decryption (PKCS #11 v3.0)
+CK_RV C_MessageDecryptFinal(CK_SESSION_HANDLE hSession);
+
+// Initialise message-based signing (PKCS #11 v3.0)
+CK_RV C_MessageSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+
+// Sign one message (PKCS #11 v3.0)
+CK_RV C_SignMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen);
+
+// Finish message-based signing (PKCS #11 v3.0)
+CK_RV C_MessageSignFinal(CK_SESSION_HANDLE hSession);
+
+// Initialise message-based verification (PKCS #11 v3.0)
+CK_RV C_MessageVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+
+// Verify one message (PKCS #11 v3.0)
+CK_RV C_VerifyMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen);
+
+// Finish message-based verification (PKCS #11 v3.0)
+CK_RV C_MessageVerifyFinal(CK_SESSION_HANDLE hSession);
+
+// Verify a batch of signatures in one call (vendor extension)
+CK_RV C_VerifyBatch(CK_SESSION_HANDLE hSession, CK_VERIFY_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
+// Digest a batch of records in one call (vendor extension)
+CK_RV C_DigestBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_DIGEST_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
+// Refill the precomputation pools (vendor extension)
+CK_RV C_PrecomputePools(CK_ULONG ulMaxCount, CK_ULONG_PTR pulCount);
+
 #if 0 // Unsupported by Crypto API Toolkit
 // Legacy function
 CK_RV C_GetFunctionStatus(CK_SESSION_HANDLE hSession);
@@ -831,6 +831,26 @@ bool File::seek(long offset /* = -1 */)
 	}
 }
 
+// Retrieve the current position relative to the start of the file
+bool File::tell(unsigned long& offset)
+{
+	if (!valid) return false;
+
+#ifdef SGXHSM
+	int64_t position = sgx_ftell(stream);
+#else
+	long position = ftell(stream);
+#endif
+	if (position < 0)
+	{
+		return false;
+	}
+
+	offset = (unsigned long) position;
+
+	return true;
+}
+
 // Lock the file
 bool File::lock(bool block /* = true */)
 {
@@ -114,6 +114,9 @@ public:
 	// argument is specified this operation seeks to the end of the file
 	bool seek(long offset = -1);
 
+	// Retrieve the current position relative to the start of the file
+	bool tell(unsigned long& offset);
+
 	// Lock the file
 	bool lock(bool block = true);
 
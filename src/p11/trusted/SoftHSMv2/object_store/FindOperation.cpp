@@ -34,8 +34,13 @@
 #include "config.h"
 #include "FindOperation.h"
 
+// The value of an empty template attribute; it must not point into an empty
+// ByteString
+static CK_BYTE emptyValue = 0;
+
 FindOperation::FindOperation()
 {
+    _position = 0;
 }
 
 FindOperation *FindOperation::create()
@@ -48,33 +53,64 @@ void FindOperation::recycle()
     delete this;
 }
 
-void FindOperation::setHandles(const std::set<CK_OBJECT_HANDLE> &handles)
+void FindOperation::setTemplate(const CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount)
 {
-    _handles = handles;
+    _values.clear();
+    _template.clear();
+
+    // Copy the values first; the template points into them
+    _values.reserve(ulCount);
+    for (CK_ULONG i = 0; i < ulCount; ++i) {
+        if (pTemplate[i].pValue != NULL_PTR)
+            _values.push_back(ByteString((const unsigned char*)pTemplate[i].pValue, pTemplate[i].ulValueLen));
+        else
+            _values.push_back(ByteString());
+    }
+
+    _template.reserve(ulCount);
+    for (CK_ULONG i = 0; i < ulCount; ++i) {
+        CK_ATTRIBUTE attr;
+        attr.type = pTemplate[i].type;
+        if (pTemplate[i].pValue == NULL_PTR)
+            attr.pValue = NULL_PTR;
+        else if (pTemplate[i].ulValueLen == 0)
+            attr.pValue = &emptyValue;
+        else
+            attr.pValue = _values[i].byte_str();
+        attr.ulValueLen = pTemplate[i].ulValueLen;
+        _template.push_back(attr);
+    }
 }
 
-CK_ULONG FindOperation::retrieveHandles(CK_OBJECT_HANDLE_PTR phObject, CK_ULONG ulCount)
+CK_ATTRIBUTE_PTR FindOperation::getTemplate()
 {
-    CK_ULONG ulReturn = 0;
-    std::set<CK_OBJECT_HANDLE>::const_iterator it;
-    for (it=_handles.begin(); it != _handles.end(); ++it) {
-        if (ulReturn >= ulCount) break;
+    return _template.empty() ? NULL_PTR : &_template[0];
+}
 
-        phObject[ulReturn++] = *it;
-    }
-    return ulReturn;
+CK_ULONG FindOperation::getTemplateCount()
+{
+    return _template.size();
 }
 
-CK_ULONG FindOperation::eraseHandles(CK_ULONG ulIndex, CK_ULONG ulCount)
+void FindOperation::setBlindMACs(const std::map<CK_ATTRIBUTE_TYPE, ByteString> &blindMACs)
 {
-    std::set<CK_OBJECT_HANDLE>::const_iterator it;
-    for (it=_handles.begin(); it != _handles.end() && ulIndex != 0; --ulIndex) {
-        ++it;
-    }
+    _blindMACs = blindMACs;
+}
 
-    CK_ULONG ulReturn = 0;
-    for ( ; it != _handles.end() && ulReturn < ulCount; ++ulReturn) {
-        _handles.erase(it++);
-    }
-    return ulReturn;
+const std::map<CK_ATTRIBUTE_TYPE, ByteString> &FindOperation::getBlindMACs()
+{
+    return _blindMACs;
+}
+
+void FindOperation::setCandidates(const std::set<OSObject*> &candidates)
+{
+    _candidates.assign(candidates.begin(), candidates.end());
+    _position = 0;
+}
+
+OSObject* FindOperation::nextCandidate()
+{
+    if (_position >= _candidates.size()) return NULL;
+
+    return _candidates[_position++];
 }
@@ -28,7 +28,9 @@
  FindOperation.h
 
  This class represents the find operation that can be used to collect
- objects that match the attributes contained in a given template.
+ objects that match the attributes contained in a given template. It acts
+ as a cursor over the candidate objects; the candidates are matched and
+ their handles created as the caller pages through the results.
  *****************************************************************************/
 
 #ifndef _SOFTHSM_V2_FINDOPERATION_H
@@ -37,6 +39,9 @@
 #include "config.h"
 
 #include <set>
+#include <map>
+#include <vector>
+#include "ByteString.h"
 #include "OSObject.h"
 
 class FindOperation
@@ -48,20 +53,39 @@ public:
     // Hand this operation back to the factory for recycling.
     void recycle();
 
-    // Add the objects from thet set that match the attributes in the given template to the find operation.
-    void setHandles(const std::set<CK_OBJECT_HANDLE> &handles);
+    // Set the template that the candidates are matched against; the
+    // template is copied
+    void setTemplate(const CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount);
 
-    // Retrieve handles
-    CK_ULONG retrieveHandles(CK_OBJECT_HANDLE_PTR phObject, CK_ULONG ulCount);
+    // Get the copy of the template
+    CK_ATTRIBUTE_PTR getTemplate();
+    CK_ULONG getTemplateCount();
 
-    // Erase handles from the handles set.
-    CK_ULONG eraseHandles(CK_ULONG ulIndex, CK_ULONG ulCount);
+    // Set the blind index MACs of the template values, by attribute type
+    void setBlindMACs(const std::map<CK_ATTRIBUTE_TYPE, ByteString> &blindMACs);
+
+    // Get the blind index MACs of the template values
+    const std::map<CK_ATTRIBUTE_TYPE, ByteString> &getBlindMACs();
+
+    // Set the objects that may match the template
+    void setCandidates(const std::set<OSObject*> &candidates);
+
+    // Retrieve the next candidate; returns NULL when all candidates were retrieved
+    OSObject* nextCandidate();
 
 protected:
     // Use a protected constructor to force creation via factory method.
     FindOperation();
 
-    std::set<CK_OBJECT_HANDLE> _handles;
+    // The copy of the template and of its values
+    std::vector<CK_ATTRIBUTE> _template;
+    std::vector<ByteString> _values;
+
+    std::map<CK_ATTRIBUTE_TYPE, ByteString> _blindMACs;
+
+    // The candidates and the position of the cursor
+    std::vector<OSObject*> _candidates;
+    size_t _position;
 };
 
 #endif // _SOFTHSM_V2_FINDOPERATION_H
@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*****************************************************************************
+ LogObject.cpp
+
+ This class represents an object of a log-structured token. The attributes
+ are kept in enclave memory; every committed change is appended to the token
+ log by the owning LogToken instance.
+ *****************************************************************************/
+
+#include "config.h"
+#include "LogObject.h"
+#include "LogToken.h"
+#include "CryptoFactory.h"
+
+// Constructor
+LogObject::LogObject(LogToken* inToken, unsigned long inId, Mutex* inMutex)
+{
+	token = inToken;
+	id = inId;
+	objectMutex = inMutex;
+	valid = (objectMutex != NULL);
+	objectIndex = NULL;
+	inTransaction = false;
+}
+
+// Destructor
+LogObject::~LogObject()
+{
+	discardAttributes();
+
+	// Wipe the key state that was kept for the object
+	CryptoFactory::i()->forgetKeyStates(this);
+}
+
+// Check if the specified attribute exists
+bool LogObject::attributeExists(CK_ATTRIBUTE_TYPE type)
+{
+	MutexLocker lock(objectMutex);
+
+	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::iterator i = attributes.find(type);
+
+	return valid && (i != attributes.end()) && (i->second != NULL);
+}
+
+// Retrieve the specified attribute
+OSAttribute LogObject::getAttribute(CK_ATTRIBUTE_TYPE type)
+{
+	MutexLocker lock(objectMutex);
+
+	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::iterator i = attributes.find(type);
+	if (i == attributes.end() || i->second == NULL)
+	{
+		// ERROR_MSG("The attribute does not exist: 0x%08X", type);
+		return OSAttribute((unsigned long)0);
+	}
+
+	return *i->second;
+}
+
+bool LogObject::getBooleanValue(CK_ATTRIBUTE_TYPE type, bool val)
+{
+	MutexLocker lock(objectMutex);
+
+	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::iterator i = attributes.find(type);
+	if (i == attributes.end() || i->second == NULL)
+	{
+		// ERROR_MSG("The attribute does not exist: 0x%08X", type);
+		return val;
+	}
+
+	if (i->second->isBooleanAttribute())
+	{
+		return i->second->getBooleanValue();
+	}
+	else
+	{
+		// ERROR_MSG("The attribute is not a boolean: 0x%08X", type);
+		return val;
+	}
+}
+
+unsigned long LogObject::getUnsignedLongValue(CK_ATTRIBUTE_TYPE type, unsigned long val)
+{
+	MutexLocker lock(objectMutex);
+
+	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::iterator i = attributes.find(type);
+	if (i == attributes.end() || i->second == NULL)
+	{
+		// ERROR_MSG("The attribute does not exist: 0x%08X", type);
+		return val;
+	}
+
+	if (i->second->isUnsignedLongAttribute())
+	{
+		return i->second->getUnsignedLongValue();
+	}
+	else
+	{
+		// ERROR_MSG("The attribute is not an unsigned long: 0x%08X", type);
+		return val;
+	}
+}
+
+ByteString LogObject::getByteStringValue(CK_ATTRIBUTE_TYPE type)
+{
+	MutexLocker lock(objectMutex);
+
+	ByteString val;
+
+	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::iterator i = attributes.find(type);
+	if (i == attributes.end() || i->second == NULL)
+	{
+		// ERROR_MSG("The attribute does not exist: 0x%08X", type);
+		return val;
+	}
+
+	if (i->second->isByteStringAttribute())
+	{
+		return i->second->getByteStringValue();
+	}
+	else
+	{
+		// ERROR_MSG("The attribute is not a byte string: 0x%08X", type);
+		return val;
+	}
+}
+
+// Retrieve the next attribute type
+CK_ATTRIBUTE_TYPE LogObject::nextAttributeType(CK_ATTRIBUTE_TYPE type)
+{
+	MutexLocker lock(objectMutex);
+
+	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::iterator n = attributes.upper_bound(type);
+
+	// skip null attributes
+	while ((n != attributes.end()) && (n->second == NULL))
+		++n;
+
+	// return type or CKA_CLASS (= 0)
+	if (n == attributes.end())
+	{
+		return CKA_CLASS;
+	}
+	else
+	{
+		return n->first;
+	}
+}
+
+// Set the specified attribute
+bool LogObject::setAttribute(CK_ATTRIBUTE_TYPE type, const OSAttribute& attribute)
+{
+	MutexLocker lock(objectMutex);
+
+	if (!valid)
+	{
+		// DEBUG_MSG("Cannot update invalid log object %lu", id);
+
+		return false;
+	}
+
+	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::iterator i = attributes.find(type);
+	if (i != attributes.end() && i->second != NULL)
+	{
+		delete i->second;
+
+		i->second = NULL;
+	}
+
+	attributes[type] = new OSAttribute(attribute);
+
+	if (objectIndex != NULL)
+	{
+		objectIndex->update(this, type, attributes[type]);
+	}
+
+	if (inTransaction)
+	{
+		return true;
+	}
+
+	return token->storeObject(this);
+}
+
+// Delete the specified attribute
+bool LogObject::deleteAttribute(CK_ATTRIBUTE_TYPE type)
+{
+	MutexLocker lock(objectMutex);
+
+	if (!valid)
+	{
+		// DEBUG_MSG("Cannot update invalid log object %lu", id);
+
+		return false;
+	}
+
+	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::iterator i = attributes.find(type);
+	if (i == attributes.end() || i->second == NULL)
+	{
+		// DEBUG_MSG("Cannot delete attribute that doesn't exist in log object %lu", id);
+
+		return false;
+	}
+
+	delete i->second;
+	attributes.erase(i);
+
+	if (objectIndex != NULL)
+	{
+		objectIndex->update(this, type, NULL);
+	}
+
+	if (inTransaction)
+	{
+		return true;
+	}
+
+	return token->storeObject(this);
+}
+
+// The validity state of the object
+bool LogObject::isValid()
+{
+	return valid;
+}
+
+// Start an attribute set transaction
+bool LogObject::startTransaction(Access)
+{
+	MutexLocker lock(objectMutex);
+
+	if (inTransaction)
+	{
+		return false;
+	}
+
+	savedAttributes.clear();
+
+	for (std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::iterator i = attributes.begin(); i != attributes.end(); i++)
+	{
+		if (i->second != NULL)
+		{
+			savedAttributes.insert(std::make_pair(i->first, *i->second));
+		}
+	}
+
+	inTransaction = true;
+
+	return true;
+}
+
+// Commit an attribute transaction
+bool LogObject::commitTransaction()
+{
+	MutexLocker lock(objectMutex);
+
+	if (!inTransaction)
+	{
+		return false;
+	}
+
+	inTransaction = false;
+	savedAttributes.clear();
+
+	return valid && token->storeObject(this);
+}
+
+// Abort an attribute transaction; restores the previous attributes
+bool LogObject::abortTransaction()
+{
+	MutexLocker lock(objectMutex);
+
+	if (!inTransaction)
+	{
+		return false;
+	}
+
+	discardAttributes();
+
+	for (std::map<CK_ATTRIBUTE_TYPE, OSAttribute>::iterator i = savedAttributes.begin(); i != savedAttributes.end(); i++)
+	{
+		attributes[i->first] = new OSAttribute(i->second);
+	}
+
+	if (objectIndex != NULL)
+	{
+		objectIndex->update(this, attributes);
+	}
+
+	savedAttributes.clear();
+	inTransaction = false;
+
+	return true;
+}
+
+// Destroy the object; WARNING: pointers to the object become invalid after this call
+bool LogObject::destroyObject()
+{
+	if (token == NULL)
+	{
+		// ERROR_MSG("Cannot destroy an object that is not associated with a token");
+
+		return false;
+	}
+
+	return token->deleteObject(this);
+}
+
+// Returns the log identifier of the object
+unsigned long LogObject::getId() const
+{
+	return id;
+}
+
+// Invalidate the object; the caller holds the mutex
+void LogObject::invalidate()
+{
+	valid = false;
+	inTransaction = false;
+	savedAttributes.clear();
+	discardAttributes();
+}
+
+// Attach the object to the attribute index of the token; the caller holds the mutex
+void LogObject::setIndex(ObjectIndex* inIndex)
+{
+	objectIndex = inIndex;
+
+	if (objectIndex != NULL)
+	{
+		objectIndex->update(this, attributes);
+	}
+}
+
+// Discard the attributes; the caller holds the mutex
+void LogObject::discardAttributes()
+{
+	if (objectIndex != NULL)
+	{
+		objectIndex->remove(this);
+	}
+
+	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*> cleanUp = attributes;
+	attributes.clear();
+
+	for (std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::iterator i = cleanUp.begin(); i != cleanUp.end(); i++)
+	{
+		if (i->second == NULL)
+		{
+			continue;
+		}
+
+		delete i->second;
+		i->second = NULL;
+	}
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*****************************************************************************
+ LogObject.h
+
+ This class represents an object of a log-structured token. The attributes
+ are kept in enclave memory; every committed change is appended to the token
+ log by the owning LogToken instance.
+ *****************************************************************************/
+
+#ifndef _SOFTHSM_V2_LOGOBJECT_H
+#define _SOFTHSM_V2_LOGOBJECT_H
+
+#include "config.h"
+#include "ByteString.h"
+#include "OSAttribute.h"
+#include "MutexFactory.h"
+#include <map>
+#include "cryptoki.h"
+#include "OSObject.h"
+#include "ObjectIndex.h"
+
+// LogToken forward declaration
+class LogToken;
+
+class LogObject : public OSObject
+{
+public:
+	// Constructor
+	LogObject(LogToken* inToken, unsigned long inId, Mutex* inMutex);
+
+	LogObject(const LogObject&) = delete;
+
+	LogObject& operator=(const LogObject&) = delete;
+
+	// Destructor
+	virtual ~LogObject();
+
+	// Check if the specified attribute exists
+	virtual bool attributeExists(CK_ATTRIBUTE_TYPE type);
+
+	// Retrieve the specified attribute
+	virtual OSAttribute getAttribute(CK_ATTRIBUTE_TYPE type);
+	virtual bool getBooleanValue(CK_ATTRIBUTE_TYPE type, bool val);
+	virtual unsigned long getUnsignedLongValue(CK_ATTRIBUTE_TYPE type, unsigned long val);
+	virtual ByteString getByteStringValue(CK_ATTRIBUTE_TYPE type);
+
+	// Retrieve the next attribute type
+	virtual CK_ATTRIBUTE_TYPE nextAttributeType(CK_ATTRIBUTE_TYPE type);
+
+	// Set the specified attribute
+	virtual bool setAttribute(CK_ATTRIBUTE_TYPE type, const OSAttribute& attribute);
+
+	// Delete the specified attribute
+	virtual bool deleteAttribute(CK_ATTRIBUTE_TYPE type);
+
+	// The validity state of the object; no storage access is needed
+	virtual bool isValid();
+
+	// Start an attribute set transaction; the changes are appended to
+	// the log as a single record on commit
+	virtual bool startTransaction(Access access);
+
+	// Commit an attribute transaction; returns false if no transaction is in progress
+	virtual bool commitTransaction();
+
+	// Abort an attribute transaction; restores the attributes as they were when
+	// the transaction was started
+	virtual bool abortTransaction();
+
+	// Destroys the object; WARNING: pointers to the object become invalid after this
+	// call!
+	virtual bool destroyObject();
+
+	// Returns the log identifier of the object
+	unsigned long getId() const;
+
+private:
+	// LogToken instances serialise and replay the attributes
+	friend class LogToken;
+
+	// Invalidate the object; called by the token when the object is deleted
+	void invalidate();
+
+	// Attach the object to the attribute index of the token; the caller
+	// holds the mutex
+	void setIndex(ObjectIndex* inIndex);
+
+	// Discard the attributes; the caller holds the mutex
+	void discardAttributes();
+
+	// The object's raw attributes
+	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*> attributes{};
+
+	// The attributes at the start of a transaction
+	std::map<CK_ATTRIBUTE_TYPE, OSAttribute> savedAttributes{};
+
+	// The object's validity state
+	bool valid;
+
+	// The identifier of the object in the token log
+	unsigned long id;
+
+	// The token this object is associated with
+	LogToken* token;
+
+	// The attribute index of the token
+	ObjectIndex* objectIndex;
+
+	// The token mutex; all objects of a token share it with the token so the
+	// token can serialise them without taking a second lock
+	Mutex* objectMutex;
+
+	// Is the object undergoing an attribute transaction?
+	bool inTransaction;
+};
+
+#endif // !_SOFTHSM_V2_LOGOBJECT_H
@@ -0,0 +1,1557 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*****************************************************************************
+ LogToken.cpp
+
+ The log-structured token class; all objects of a token are stored in a
+ single append-only protected file. Each commit appends one framed batch of
+ records, the objects are indexed in enclave memory and the log is compacted
+ into a fresh snapshot once it holds mostly superseded records.
+
+ The log starts with a header (magic, version, epoch) followed by batches of
+ the form (record count, length prefixed records, end marker). A log is only
+ used if it holds a checkpoint record, which closes every snapshot. Compaction
+ writes the snapshot to the log of the next epoch and then removes the old
+ log, so an interrupted compaction leaves the previous log in place. Every
+ thread collects its own batch, which only reaches the log on its commit.
+ *****************************************************************************/
+
+#include "config.h"
+#include "OSAttributes.h"
+#include "LogToken.h"
+#include "OSToken.h"
+#include "File.h"
+#include "OSPathSep.h"
+#include <vector>
+
+// Log header and batch markers
+#define LOG_MAGIC			0x43544b4c4f47UL // 'CTKLOG'
+#define LOG_VERSION			0x1
+#define LOG_BATCH_END			0x454e44UL // 'END'
+
+// Record types
+#define LOG_RECORD_STORE		0x1
+#define LOG_RECORD_DELETE		0x2
+#define LOG_RECORD_CHECKPOINT		0x3
+
+// Attribute types; these match the ones used in object files
+#define BOOLEAN_ATTR			0x1
+#define ULONG_ATTR			0x2
+#define BYTESTR_ATTR			0x3
+#define ATTRMAP_ATTR			0x4
+#define MECHSET_ATTR			0x5
+
+// The log identifier of the token object
+#define LOG_TOKEN_OBJECT_ID		0x0
+
+// Compact once the log holds at least this many records and this many
+// records per current object
+#define LOG_COMPACT_MIN_RECORDS		0x400
+#define LOG_COMPACT_RATIO		0x4
+
+// The number of objects written per batch in a snapshot
+#define LOG_SNAPSHOT_BATCH		0x100
+
+// Append an unsigned long value to a record
+static void putULong(ByteString& record, const unsigned long value)
+{
+	record += ByteString(value);
+}
+
+// Append an attribute value to a record
+static bool putAttribute(ByteString& record, const OSAttribute& attribute)
+{
+	if (attribute.isBooleanAttribute())
+	{
+		putULong(record, BOOLEAN_ATTR);
+		record += (unsigned char) (attribute.getBooleanValue() ? 0xFF : 0x00);
+	}
+	else if (attribute.isUnsignedLongAttribute())
+	{
+		putULong(record, ULONG_ATTR);
+		putULong(record, attribute.getUnsignedLongValue());
+	}
+	else if (attribute.isByteStringAttribute())
+	{
+		putULong(record, BYTESTR_ATTR);
+		record += attribute.getByteStringValue().serialise();
+	}
+	else if (attribute.isMechanismTypeSetAttribute())
+	{
+		const std::set<CK_MECHANISM_TYPE>& value = attribute.getMechanismTypeSetValue();
+
+		putULong(record, MECHSET_ATTR);
+		putULong(record, value.size());
+
+		for (std::set<CK_MECHANISM_TYPE>::const_iterator i = value.begin(); i != value.end(); i++)
+		{
+			putULong(record, *i);
+		}
+	}
+	else if (attribute.isAttributeMapAttribute())
+	{
+		const std::map<CK_ATTRIBUTE_TYPE,OSAttribute>& value = attribute.getAttributeMapValue();
+
+		putULong(record, ATTRMAP_ATTR);
+		putULong(record, value.size());
+
+		for (std::map<CK_ATTRIBUTE_TYPE,OSAttribute>::const_iterator i = value.begin(); i != value.end(); i++)
+		{
+			putULong(record, i->first);
+
+			if (!putAttribute(record, i->second))
+			{
+				return false;
+			}
+		}
+	}
+	else
+	{
+		// DEBUG_MSG("Unknown attribute type");
+
+		return false;
+	}
+
+	return true;
+}
+
+// Sequential reader for the records of a batch
+class LogReader
+{
+public:
+	LogReader(const ByteString& inRecords) : records(inRecords), pos(0) { }
+
+	bool isEnd() const
+	{
+		return pos >= records.size();
+	}
+
+	bool readULong(unsigned long& value)
+	{
+		if (records.size() - pos < 8)
+		{
+			return false;
+		}
+
+		const unsigned char* bytes = records.const_byte_str() + pos;
+
+		value = 0;
+
+		for (size_t i = 0; i < 8; i++)
+		{
+			value = (value << 8) | bytes[i];
+		}
+
+		pos += 8;
+
+		return true;
+	}
+
+	bool readByteString(ByteString& value)
+	{
+		unsigned long len;
+
+		if (!readULong(len) || (len > records.size() - pos))
+		{
+			return false;
+		}
+
+		value = ByteString(records.const_byte_str() + pos, len);
+		pos += len;
+
+		return true;
+	}
+
+	// Returns a new attribute or NULL if the records are malformed
+	OSAttribute* readAttribute()
+	{
+		unsigned long osAttrType;
+
+		if (!readULong(osAttrType))
+		{
+			return NULL;
+		}
+
+		if (osAttrType == BOOLEAN_ATTR)
+		{
+			if (isEnd())
+			{
+				return NULL;
+			}
+
+			bool value = (records.const_byte_str()[pos++] != 0x00);
+
+			return new OSAttribute(value);
+		}
+		else if (osAttrType == ULONG_ATTR)
+		{
+			unsigned long value;
+
+			return readULong(value) ? new OSAttribute(value) : NULL;
+		}
+		else if (osAttrType == BYTESTR_ATTR)
+		{
+			ByteString value;
+
+			return readByteString(value) ? new OSAttribute(value) : NULL;
+		}
+		else if (osAttrType == MECHSET_ATTR)
+		{
+			std::set<CK_MECHANISM_TYPE> value;
+			unsigned long count;
+
+			if (!readULong(count))
+			{
+				return NULL;
+			}
+
+			for (unsigned long i = 0; i < count; i++)
+			{
+				unsigned long mechType;
+
+				if (!readULong(mechType))
+				{
+					return NULL;
+				}
+
+				value.insert(mechType);
+			}
+
+			return new OSAttribute(value);
+		}
+		else if (osAttrType == ATTRMAP_ATTR)
+		{
+			std::map<CK_ATTRIBUTE_TYPE,OSAttribute> value;
+			unsigned long count;
+
+			if (!readULong(count))
+			{
+				return NULL;
+			}
+
+			for (unsigned long i = 0; i < count; i++)
+			{
+				unsigned long p11AttrType;
+
+				if (!readULong(p11AttrType))
+				{
+					return NULL;
+				}
+
+				OSAttribute* attribute = readAttribute();
+				if (attribute == NULL)
+				{
+					return NULL;
+				}
+
+				value.insert(std::make_pair(p11AttrType, *attribute));
+				delete attribute;
+			}
+
+			return new OSAttribute(value);
+		}
+
+		// DEBUG_MSG("Unknown attribute type 0x%08X in token log", osAttrType);
+
+		return NULL;
+	}
+
+private:
+	const ByteString& records;
+
+	size_t pos;
+};
+
+// Write one framed batch at the current position of the log
+static bool writeFrame(File& logFile, const ByteString& records, const unsigned long count)
+{
+	return logFile.writeULong(count) &&
+	       logFile.writeByteString(records) &&
+	       logFile.writeULong(LOG_BATCH_END);
+}
+
+// Constructor
+LogToken::LogToken(const std::string inTokenPath)
+{
+	tokenPath = inTokenPath;
+	tokenObject = NULL;
+	nextId = LOG_TOKEN_OBJECT_ID + 1;
+	epoch = 0;
+	logRecords = 0;
+
+	tokenDir = new Directory(tokenPath);
+	tokenMutex = MutexFactory::i()->getMutex();
+	valid = (tokenMutex != NULL) && tokenDir->isValid();
+}
+
+// Create a new token
+/*static*/ LogToken* LogToken::createToken(const std::string basePath, const std::string tokenDir, const ByteString& label, const ByteString& serial)
+{
+	Directory baseDir(basePath);
+
+	if (!baseDir.isValid())
+	{
+		// ERROR_MSG("Could not create the Directory object");
+		return NULL;
+	}
+
+	// Create the token directory
+	if (!baseDir.mkdir(tokenDir))
+	{
+		// Error msg is generated by mkdir
+		return NULL;
+	}
+
+	LogToken* token = new LogToken(basePath + OS_PATHSEP + tokenDir);
+
+	// Set the initial attributes
+	CK_ULONG flags =
+		CKF_RNG |
+		CKF_LOGIN_REQUIRED | // FIXME: check
+		CKF_RESTORE_KEY_NOT_NEEDED |
+		CKF_TOKEN_INITIALIZED |
+		CKF_SO_PIN_LOCKED |
+		CKF_SO_PIN_TO_BE_CHANGED;
+
+	bool bOK = token->valid;
+
+	if (bOK)
+	{
+		MutexLocker lock(token->tokenMutex);
+
+		token->tokenObject = new LogObject(token, LOG_TOKEN_OBJECT_ID, token->tokenMutex);
+		token->tokenObject->attributes[CKA_OS_TOKENLABEL] = new OSAttribute(label);
+		token->tokenObject->attributes[CKA_OS_TOKENSERIAL] = new OSAttribute(serial);
+		token->tokenObject->attributes[CKA_OS_TOKENFLAGS] = new OSAttribute(flags);
+
+		// The initial snapshot is the first log of the token
+		bOK = token->compact();
+	}
+
+	if (!bOK)
+	{
+		// ERROR_MSG("Failed to create the token log");
+
+		delete token;
+
+		baseDir.remove(tokenDir + OS_PATHSEP + logName(1));
+		baseDir.rmdir(tokenDir);
+
+		return NULL;
+	}
+
+	// DEBUG_MSG("Created new token %s", tokenDir.c_str());
+
+	return token;
+}
+
+// Access an existing token
+/*static*/ LogToken* LogToken::accessToken(const std::string &basePath, const std::string &tokenDir)
+{
+	LogToken* token = new LogToken(basePath + OS_PATHSEP + tokenDir);
+
+	if (token->valid)
+	{
+		MutexLocker lock(token->tokenMutex);
+
+		token->valid = token->open();
+	}
+
+	return token;
+}
+
+// Destructor
+LogToken::~LogToken()
+{
+	// Clean up
+	std::set<OSObject*> cleanUp = allObjects;
+	allObjects.clear();
+
+	for (std::set<OSObject*>::iterator i = cleanUp.begin(); i != cleanUp.end(); i++)
+	{
+		delete *i;
+	}
+
+	delete tokenObject;
+	delete tokenDir;
+
+	for (std::map<pthread_t, LogBatch>::iterator i = batches.begin(); i != batches.end(); i++)
+	{
+		i->second.records.wipe();
+	}
+
+	MutexFactory::i()->recycleMutex(tokenMutex);
+}
+
+// Set the SO PIN
+bool LogToken::setSOPIN(const ByteString& soPINBlob)
+{
+	if (!valid) return false;
+
+	OSAttribute soPIN(soPINBlob);
+
+	CK_ULONG flags;
+
+	if (tokenObject->setAttribute(CKA_OS_SOPIN, soPIN) &&
+	    getTokenFlags(flags))
+	{
+		flags &= ~CKF_SO_PIN_COUNT_LOW;
+		flags &= ~CKF_SO_PIN_FINAL_TRY;
+		flags &= ~CKF_SO_PIN_LOCKED;
+		flags &= ~CKF_SO_PIN_TO_BE_CHANGED;
+
+		return setTokenFlags(flags);
+	}
+
+	return false;
+}
+
+// Get the SO PIN
+bool LogToken::getSOPIN(ByteString& soPINBlob)
+{
+	if (!valid || !tokenObject->isValid())
+	{
+		return false;
+	}
+
+	if (tokenObject->attributeExists(CKA_OS_SOPIN))
+	{
+		soPINBlob = tokenObject->getAttribute(CKA_OS_SOPIN).getByteStringValue();
+
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+// Set the user PIN
+bool LogToken::setUserPIN(ByteString userPINBlob)
+{
+	if (!valid) return false;
+
+	OSAttribute userPIN(userPINBlob);
+
+	CK_ULONG flags;
+
+	if (tokenObject->setAttribute(CKA_OS_USERPIN, userPIN) &&
+	    getTokenFlags(flags))
+	{
+		flags |= CKF_USER_PIN_INITIALIZED;
+		flags &= ~CKF_USER_PIN_COUNT_LOW;
+		flags &= ~CKF_USER_PIN_FINAL_TRY;
+		flags &= ~CKF_USER_PIN_LOCKED;
+		flags &= ~CKF_USER_PIN_TO_BE_CHANGED;
+
+		return setTokenFlags(flags);
+	}
+
+	return false;
+}
+
+// Get the user PIN
+bool LogToken::getUserPIN(ByteString& userPINBlob)
+{
+	if (!valid || !tokenObject->isValid())
+	{
+		return false;
+	}
+
+	if (tokenObject->attributeExists(CKA_OS_USERPIN))
+	{
+		userPINBlob = tokenObject->getAttribute(CKA_OS_USERPIN).getByteStringValue();
+
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+// Retrieve the token label
+bool LogToken::getTokenLabel(ByteString& label)
+{
+	if (!valid || !tokenObject->isValid())
+	{
+		return false;
+	}
+
+	if (tokenObject->attributeExists(CKA_OS_TOKENLABEL))
+	{
+		label = tokenObject->getAttribute(CKA_OS_TOKENLABEL).getByteStringValue();
+
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+// Retrieve the token serial
+bool LogToken::getTokenSerial(ByteString& serial)
+{
+	if (!valid || !tokenObject->isValid())
+	{
+		return false;
+	}
+
+	if (tokenObject->attributeExists(CKA_OS_TOKENSERIAL))
+	{
+		serial = tokenObject->getAttribute(CKA_OS_TOKENSERIAL).getByteStringValue();
+
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+// Get the token flags
+bool LogToken::getTokenFlags(CK_ULONG& flags)
+{
+	if (!valid || !tokenObject->isValid())
+	{
+		return false;
+	}
+
+	if (tokenObject->attributeExists(CKA_OS_TOKENFLAGS))
+	{
+		flags = tokenObject->getAttribute(CKA_OS_TOKENFLAGS).getUnsignedLongValue();
+
+		// Check if the user PIN is initialised
+		if (tokenObject->attributeExists(CKA_OS_USERPIN))
+		{
+			flags |= CKF_USER_PIN_INITIALIZED;
+		}
+
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+// Set the token flags
+bool LogToken::setTokenFlags(const CK_ULONG flags)
+{
+	if (!valid) return false;
+
+	OSAttribute tokenFlags(flags);
+
+	return tokenObject->setAttribute(CKA_OS_TOKENFLAGS, tokenFlags);
+}
+
+// Retrieve objects
+std::set<OSObject*> LogToken::getObjects()
+{
+	std::set<OSObject*> currentObjects;
+
+	getObjects(currentObjects);
+
+	return currentObjects;
+}
+
+void LogToken::getObjects(std::set<OSObject*> &inObjects)
+{
+	// Make sure that no other thread is in the process of changing
+	// the object list when we return it
+	MutexLocker lock(tokenMutex);
+
+	for (std::map<unsigned long, LogObject*>::iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		inObjects.insert(i->second);
+	}
+}
+
+// Create a new object
+OSObject* LogToken::createObject()
+{
+	if (!valid) return NULL;
+
+	MutexLocker lock(tokenMutex);
+
+	// The object is written to the log by its first commit
+	LogObject* newObject = new LogObject(this, nextId++, tokenMutex);
+	newObject->setIndex(&objectIndex);
+
+	objects[newObject->getId()] = newObject;
+	allObjects.insert(newObject);
+
+	// DEBUG_MSG("Created new log object %lu", newObject->getId());
+
+	return newObject;
+}
+
+// Delete an object
+bool LogToken::deleteObject(OSObject* object)
+{
+	if (!valid) return false;
+
+	MutexLocker lock(tokenMutex);
+
+	LogObject* logObject = dynamic_cast<LogObject*>(object);
+	if (logObject == NULL)
+	{
+		// ERROR_MSG("Object type not compatible with this token class 0x%08X", object);
+
+		return false;
+	}
+
+	std::map<unsigned long, LogObject*>::iterator i = objects.find(logObject->getId());
+	if ((i == objects.end()) || (i->second != logObject))
+	{
+		// ERROR_MSG("Cannot delete non-existent object 0x%08X", object);
+
+		return false;
+	}
+
+	if (!appendDelete(logObject->getId()))
+	{
+		// ERROR_MSG("Failed to append delete record for object %lu", logObject->getId());
+
+		return false;
+	}
+
+	// Invalidate the object instance
+	logObject->invalidate();
+
+	objects.erase(i);
+
+	// DEBUG_MSG("Deleted log object %lu", logObject->getId());
+
+	return true;
+}
+
+// Group the following object updates into one log batch
+bool LogToken::startBatch()
+{
+	if (!valid) return false;
+
+	MutexLocker lock(tokenMutex);
+
+	batches[pthread_self()].depth++;
+
+	return true;
+}
+
+// Append the grouped updates to the log in one go
+bool LogToken::commitBatch()
+{
+	MutexLocker lock(tokenMutex);
+
+	std::map<pthread_t, LogBatch>::iterator batch = batches.find(pthread_self());
+
+	if (batch == batches.end())
+	{
+		return false;
+	}
+
+	if (--batch->second.depth > 0)
+	{
+		return true;
+	}
+
+	// A nested batch was aborted, so the outer one is dropped as well
+	if (batch->second.aborted)
+	{
+		std::set<unsigned long> changed = batch->second.stored;
+		changed.insert(batch->second.deleted.begin(), batch->second.deleted.end());
+
+		batch->second.records.wipe();
+		batches.erase(batch);
+
+		(void) rollback(changed);
+
+		return false;
+	}
+
+	// The stored objects are written in their current state, followed by
+	// the delete records; objects deleted in the meantime are skipped
+	ByteString records;
+	unsigned long count = 0;
+	bool rv = true;
+
+	for (std::set<unsigned long>::iterator i = batch->second.stored.begin(); rv && i != batch->second.stored.end(); i++)
+	{
+		LogObject* object = tokenObject;
+
+		if (*i != LOG_TOKEN_OBJECT_ID)
+		{
+			std::map<unsigned long, LogObject*>::iterator j = objects.find(*i);
+
+			if (j == objects.end())
+			{
+				continue;
+			}
+
+			object = j->second;
+		}
+
+		rv = serialiseObject(object, records);
+		count++;
+	}
+
+	records += batch->second.records;
+	count += batch->second.count;
+
+	std::set<unsigned long> changed = batch->second.stored;
+	changed.insert(batch->second.deleted.begin(), batch->second.deleted.end());
+
+	batch->second.records.wipe();
+	batches.erase(batch);
+
+	if (rv && count > 0)
+	{
+		rv = writeBatch(records, count);
+	}
+
+	records.wipe();
+
+	// The objects in memory must not run ahead of the log
+	if (!rv)
+	{
+		(void) rollback(changed);
+	}
+
+	return rv;
+}
+
+// Drop the grouped updates
+bool LogToken::abortBatch()
+{
+	MutexLocker lock(tokenMutex);
+
+	std::map<pthread_t, LogBatch>::iterator batch = batches.find(pthread_self());
+
+	if (batch == batches.end())
+	{
+		return false;
+	}
+
+	// An outer batch is dropped when it ends
+	if (--batch->second.depth > 0)
+	{
+		batch->second.aborted = true;
+
+		return true;
+	}
+
+	std::set<unsigned long> changed = batch->second.stored;
+	changed.insert(batch->second.deleted.begin(), batch->second.deleted.end());
+
+	batch->second.records.wipe();
+	batches.erase(batch);
+
+	// Nothing of the batch reached the log
+	return rollback(changed);
+}
+
+// The attribute index of the objects
+ObjectIndex* LogToken::getObjectIndex()
+{
+	return &objectIndex;
+}
+
+// Checks if the token is consistent
+bool LogToken::isValid()
+{
+	return valid;
+}
+
+// Invalidate the token (for instance if it is deleted)
+void LogToken::invalidate()
+{
+	valid = false;
+}
+
+// Delete the token
+bool LogToken::clearToken()
+{
+	MutexLocker lock(tokenMutex);
+
+	// Invalidate the token
+	invalidate();
+
+	// First, clear out all objects
+	for (std::map<unsigned long, LogObject*>::iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		i->second->invalidate();
+	}
+
+	objects.clear();
+
+	// Now, delete all files in the token directory
+	if (!tokenDir->refresh())
+	{
+		return false;
+	}
+
+	std::vector<std::string> tokenFiles = tokenDir->getFiles();
+
+	for (std::vector<std::string>::iterator i = tokenFiles.begin(); i != tokenFiles.end(); i++)
+	{
+		if (!tokenDir->remove(*i))
+		{
+			// ERROR_MSG("Failed to remove %s from token directory %s", i->c_str(), tokenPath.c_str());
+
+			return false;
+		}
+	}
+
+	// Now remove the token directory
+	if (!tokenDir->rmdir(""))
+	{
+		// ERROR_MSG("Failed to remove the token directory %s", tokenPath.c_str());
+
+		return false;
+	}
+
+	// DEBUG_MSG("Token instance %s was succesfully cleared", tokenPath.c_str());
+
+	return true;
+}
+
+// Reset the token
+bool LogToken::resetToken(const ByteString& label)
+{
+	CK_ULONG flags;
+
+	if (!getTokenFlags(flags))
+	{
+		// ERROR_MSG("Failed to get the token attributes");
+
+		return false;
+	}
+
+	// The objects and the token attributes are reset in one batch
+	if (!startBatch())
+	{
+		return false;
+	}
+
+	bool bOK = true;
+
+	{
+		MutexLocker lock(tokenMutex);
+
+		for (std::map<unsigned long, LogObject*>::iterator i = objects.begin(); i != objects.end(); i++)
+		{
+			bOK = bOK && appendDelete(i->first);
+
+			// Invalidate the object instance
+			i->second->invalidate();
+		}
+
+		objects.clear();
+	}
+
+	// The user PIN has been removed
+	flags &= ~CKF_USER_PIN_INITIALIZED;
+	flags &= ~CKF_USER_PIN_COUNT_LOW;
+	flags &= ~CKF_USER_PIN_FINAL_TRY;
+	flags &= ~CKF_USER_PIN_LOCKED;
+	flags &= ~CKF_USER_PIN_TO_BE_CHANGED;
+
+	// Set new token attributes
+	OSAttribute tokenLabel(label);
+	OSAttribute tokenFlags(flags);
+
+	if (!tokenObject->setAttribute(CKA_OS_TOKENLABEL, tokenLabel) ||
+	    !tokenObject->setAttribute(CKA_OS_TOKENFLAGS, tokenFlags))
+	{
+		// ERROR_MSG("Failed to set the token attributes");
+
+		bOK = false;
+	}
+
+	if (tokenObject->attributeExists(CKA_OS_USERPIN) &&
+	    !tokenObject->deleteAttribute(CKA_OS_USERPIN))
+	{
+		// ERROR_MSG("Failed to remove USERPIN");
+
+		bOK = false;
+	}
+
+	bOK = commitBatch() && bOK;
+
+	// DEBUG_MSG("Token instance %s was succesfully reset", tokenPath.c_str());
+
+	return bOK;
+}
+
+// Load the newest consistent log from the token directory
+bool LogToken::open()
+{
+	if (!tokenDir->refresh())
+	{
+		// ERROR_MSG("Token integrity check failed");
+
+		return false;
+	}
+
+	std::vector<std::string> tokenFiles = tokenDir->getFiles();
+	std::vector<std::string> logNames;
+	bool isLegacy = false;
+
+	for (std::vector<std::string>::iterator i = tokenFiles.begin(); i != tokenFiles.end(); i++)
+	{
+		if (*i == logName(0) || *i == logName(1))
+		{
+			logNames.push_back(*i);
+		}
+		else if (*i == "token.object")
+		{
+			isLegacy = true;
+		}
+	}
+
+	if (logNames.empty())
+	{
+		// A token of the file backend is imported once
+		return isLegacy && migrate();
+	}
+
+	// An interrupted compaction may leave two logs; take the newest complete one
+	std::map<unsigned long, LogObject*> current;
+	std::string currentName;
+	bool currentTorn = false;
+	bool found = false;
+
+	for (std::vector<std::string>::iterator i = logNames.begin(); i != logNames.end(); i++)
+	{
+		std::map<unsigned long, LogObject*> candidate;
+		unsigned long candidateEpoch = 0;
+		unsigned long candidateRecords = 0;
+		unsigned long maxId = LOG_TOKEN_OBJECT_ID;
+		bool isTorn = false;
+
+		bool isComplete = replay(*i, candidateEpoch, candidate, candidateRecords, maxId, isTorn) &&
+		                  (candidate.find(LOG_TOKEN_OBJECT_ID) != candidate.end());
+
+		if (isComplete && (!found || candidateEpoch > epoch))
+		{
+			candidate.swap(current);
+			currentName = *i;
+			currentTorn = isTorn;
+			epoch = candidateEpoch;
+			logRecords = candidateRecords;
+			nextId = maxId + 1;
+			found = true;
+		}
+
+		for (std::map<unsigned long, LogObject*>::iterator j = candidate.begin(); j != candidate.end(); j++)
+		{
+			delete j->second;
+		}
+	}
+
+	if (!found)
+	{
+		// ERROR_MSG("No consistent log in token %s", tokenPath.c_str());
+
+		return false;
+	}
+
+	// Remove the log that was superseded or never completed
+	for (std::vector<std::string>::iterator i = logNames.begin(); i != logNames.end(); i++)
+	{
+		if (*i != currentName)
+		{
+			tokenDir->remove(*i);
+		}
+	}
+
+	tokenObject = current[LOG_TOKEN_OBJECT_ID];
+	current.erase(LOG_TOKEN_OBJECT_ID);
+
+	objects = current;
+
+	for (std::map<unsigned long, LogObject*>::iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		i->second->setIndex(&objectIndex);
+		allObjects.insert(i->second);
+	}
+
+	// DEBUG_MSG("The token now contains %d objects", objects.size());
+
+	// New batches are appended at the end of the log, so a partially written
+	// batch has to be cut off by rewriting the log
+	if (currentTorn)
+	{
+		return compact();
+	}
+
+	return true;
+}
+
+// Import the objects of a token created by the file backend
+bool LogToken::migrate()
+{
+	OSToken fileToken(tokenPath);
+
+	ByteString label;
+	ByteString serial;
+	CK_ULONG flags;
+
+	if (!fileToken.isValid() ||
+	    !fileToken.getTokenLabel(label) ||
+	    !fileToken.getTokenSerial(serial) ||
+	    !fileToken.getTokenFlags(flags))
+	{
+		// ERROR_MSG("Failed to read the token attributes of %s", tokenPath.c_str());
+
+		return false;
+	}
+
+	tokenObject = new LogObject(this, LOG_TOKEN_OBJECT_ID, tokenMutex);
+	tokenObject->attributes[CKA_OS_TOKENLABEL] = new OSAttribute(label);
+	tokenObject->attributes[CKA_OS_TOKENSERIAL] = new OSAttribute(serial);
+	tokenObject->attributes[CKA_OS_TOKENFLAGS] = new OSAttribute(flags);
+
+	ByteString pin;
+
+	if (fileToken.getSOPIN(pin))
+	{
+		tokenObject->attributes[CKA_OS_SOPIN] = new OSAttribute(pin);
+	}
+
+	if (fileToken.getUserPIN(pin))
+	{
+		tokenObject->attributes[CKA_OS_USERPIN] = new OSAttribute(pin);
+	}
+
+	std::set<OSObject*> fileObjects = fileToken.getObjects();
+
+	for (std::set<OSObject*>::iterator i = fileObjects.begin(); i != fileObjects.end(); i++)
+	{
+		if (!(*i)->isValid())
+		{
+			continue;
+		}
+
+		LogObject* newObject = new LogObject(this, nextId++, tokenMutex);
+
+		copyAttributes(*i, newObject);
+		newObject->setIndex(&objectIndex);
+
+		objects[newObject->getId()] = newObject;
+		allObjects.insert(newObject);
+	}
+
+	// DEBUG_MSG("Imported %d objects into token log %s", objects.size(), tokenPath.c_str());
+
+	// The object files are left in place; the log takes precedence from now on
+	return compact();
+}
+
+// Replay a log file into the given object map
+bool LogToken::replay(const std::string& name, unsigned long& logEpoch, std::map<unsigned long, LogObject*>& logObjects, unsigned long& records, unsigned long& maxId, bool& isTorn)
+{
+	File logFile(tokenPath + OS_PATHSEP + name);
+
+	if (!logFile.isValid())
+	{
+		return false;
+	}
+
+	logFile.lock();
+
+	unsigned long logSize = 0;
+	unsigned long magic = 0;
+	unsigned long version = 0;
+
+	if (!logFile.seek() || !logFile.tell(logSize) || !logFile.rewind() ||
+	    !logFile.readULong(magic) || !logFile.readULong(version) || !logFile.readULong(logEpoch) ||
+	    (magic != LOG_MAGIC) || (version != LOG_VERSION))
+	{
+		// DEBUG_MSG("Invalid token log header in %s", name.c_str());
+
+		logFile.unlock();
+
+		return false;
+	}
+
+	bool isCheckpoint = false;
+	unsigned long position = 0;
+
+	isTorn = false;
+	records = 0;
+
+	while (logFile.tell(position) && (position < logSize))
+	{
+		unsigned long count;
+		unsigned long end;
+		ByteString batch;
+
+		if (!logFile.readULong(count) || !logFile.readByteString(batch) ||
+		    !logFile.readULong(end) || (end != LOG_BATCH_END))
+		{
+			// The rest of the log was never completely written
+			isTorn = true;
+
+			break;
+		}
+
+		LogReader reader(batch);
+
+		for (unsigned long n = 0; n < count; n++)
+		{
+			unsigned long recordType;
+			unsigned long id;
+
+			if (!reader.readULong(recordType) || !reader.readULong(id))
+			{
+				logFile.unlock();
+
+				return false;
+			}
+
+			if (id > maxId)
+			{
+				maxId = id;
+			}
+
+			std::map<unsigned long, LogObject*>::iterator i = logObjects.find(id);
+
+			if (recordType == LOG_RECORD_STORE)
+			{
+				unsigned long attrCount;
+
+				if (!reader.readULong(attrCount))
+				{
+					logFile.unlock();
+
+					return false;
+				}
+
+				LogObject* object = NULL;
+
+				if (i == logObjects.end())
+				{
+					object = new LogObject(this, id, tokenMutex);
+					logObjects[id] = object;
+				}
+				else
+				{
+					object = i->second;
+					object->discardAttributes();
+				}
+
+				for (unsigned long a = 0; a < attrCount; a++)
+				{
+					unsigned long p11AttrType;
+					OSAttribute* attribute = NULL;
+
+					if (!reader.readULong(p11AttrType) || (attribute = reader.readAttribute()) == NULL)
+					{
+						// DEBUG_MSG("Corrupt record in token log %s", name.c_str());
+
+						logFile.unlock();
+
+						return false;
+					}
+
+					object->attributes[p11AttrType] = attribute;
+				}
+			}
+			else if (recordType == LOG_RECORD_DELETE)
+			{
+				if (i != logObjects.end())
+				{
+					delete i->second;
+					logObjects.erase(i);
+				}
+			}
+			else if (recordType == LOG_RECORD_CHECKPOINT)
+			{
+				isCheckpoint = true;
+			}
+			else
+			{
+				// DEBUG_MSG("Unknown record type in token log %s", name.c_str());
+
+				logFile.unlock();
+
+				return false;
+			}
+		}
+
+		records += count;
+	}
+
+	logFile.unlock();
+
+	return isCheckpoint;
+}
+
+// Serialise the store record of an object
+/*static*/ bool LogToken::serialiseObject(LogObject* object, ByteString& record)
+{
+	unsigned long attrCount = 0;
+
+	for (std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::iterator i = object->attributes.begin(); i != object->attributes.end(); i++)
+	{
+		if (i->second != NULL)
+		{
+			attrCount++;
+		}
+	}
+
+	putULong(record, LOG_RECORD_STORE);
+	putULong(record, object->getId());
+	putULong(record, attrCount);
+
+	for (std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::iterator i = object->attributes.begin(); i != object->attributes.end(); i++)
+	{
+		if (i->second == NULL)
+		{
+			continue;
+		}
+
+		putULong(record, i->first);
+
+		if (!putAttribute(record, *i->second))
+		{
+			// DEBUG_MSG("Failed to serialise attribute 0x%08X of log object %lu", i->first, object->getId());
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Copy all attributes of an object
+/*static*/ void LogToken::copyAttributes(OSObject* from, LogObject* to)
+{
+	CK_ATTRIBUTE_TYPE type = CKA_CLASS;
+
+	do
+	{
+		if (from->attributeExists(type))
+		{
+			to->attributes[type] = new OSAttribute(from->getAttribute(type));
+		}
+
+		type = from->nextAttributeType(type);
+	}
+	while (type != CKA_CLASS);
+}
+
+// Append a store record for the object
+bool LogToken::storeObject(LogObject* object)
+{
+	std::map<pthread_t, LogBatch>::iterator batch = batches.find(pthread_self());
+
+	if (batch != batches.end())
+	{
+		batch->second.stored.insert(object->getId());
+
+		return true;
+	}
+
+	ByteString record;
+
+	if (!serialiseObject(object, record) || !writeBatch(record, 1))
+	{
+		std::set<unsigned long> changed;
+
+		changed.insert(object->getId());
+		(void) rollback(changed);
+
+		return false;
+	}
+
+	return true;
+}
+
+// Append a delete record for the object
+bool LogToken::appendDelete(unsigned long id)
+{
+	std::map<pthread_t, LogBatch>::iterator batch = batches.find(pthread_self());
+	ByteString record;
+
+	putULong(record, LOG_RECORD_DELETE);
+	putULong(record, id);
+
+	if (batch != batches.end())
+	{
+		batch->second.records += record;
+		batch->second.count++;
+		batch->second.deleted.insert(id);
+
+		return true;
+	}
+
+	if (!writeBatch(record, 1))
+	{
+		// A partly written record is cut off
+		std::set<unsigned long> changed;
+
+		changed.insert(id);
+		(void) rollback(changed);
+
+		return false;
+	}
+
+	return true;
+}
+
+// Write a batch to the end of the log
+bool LogToken::writeBatch(const ByteString& records, unsigned long count)
+{
+	bool isMissing = false;
+
+	{
+		File logFile(tokenPath + OS_PATHSEP + logName(epoch), true, true);
+
+		// The protected file layer creates a missing file on open; appending
+		// to it would leave a log without header and snapshot
+		isMissing = !logFile.isValid() || logFile.isEmpty();
+
+		if (!isMissing)
+		{
+			logFile.lock();
+
+			bool bOK = logFile.seek() && writeFrame(logFile, records, count) && logFile.flush();
+
+			logFile.unlock();
+
+			if (!bOK)
+			{
+				// ERROR_MSG("Failed to append to token log in %s", tokenPath.c_str());
+
+				return false;
+			}
+		}
+	}
+
+	// The objects in memory already hold the batch, so a fresh snapshot
+	// replaces the lost log; an open batch of another thread would end up
+	// in that snapshot as well, so the write fails instead
+	if (isMissing)
+	{
+		if (!batches.empty())
+		{
+			// ERROR_MSG("Token log of %s is missing while batches are open", tokenPath.c_str());
+
+			return false;
+		}
+
+		// DEBUG_MSG("Token log of %s is missing, writing a new snapshot", tokenPath.c_str());
+
+		return compact();
+	}
+
+	logRecords += count;
+
+	// Compact the log once most of its records have been superseded; an
+	// open batch of another thread is not yet part of the log, so its
+	// objects must not end up in a snapshot
+	if (batches.empty() &&
+	    (logRecords >= LOG_COMPACT_MIN_RECORDS) &&
+	    (logRecords >= LOG_COMPACT_RATIO * (objects.size() + 1)))
+	{
+		// The current log stays valid if this fails
+		(void) compact();
+	}
+
+	return true;
+}
+
+// Restore the given objects to their state in the log
+bool LogToken::rollback(const std::set<unsigned long>& ids)
+{
+	std::map<unsigned long, LogObject*> logged;
+	unsigned long logEpoch = 0;
+	unsigned long records = 0;
+	unsigned long maxId = LOG_TOKEN_OBJECT_ID;
+	bool isTorn = false;
+
+	bool bOK = replay(logName(epoch), logEpoch, logged, records, maxId, isTorn) &&
+	           (logEpoch == epoch) &&
+	           (logged.find(LOG_TOKEN_OBJECT_ID) != logged.end());
+
+	for (std::set<unsigned long>::const_iterator i = ids.begin(); bOK && i != ids.end(); i++)
+	{
+		std::map<unsigned long, LogObject*>::iterator found = logged.find(*i);
+		LogObject* current = tokenObject;
+
+		if (*i != LOG_TOKEN_OBJECT_ID)
+		{
+			std::map<unsigned long, LogObject*>::iterator j = objects.find(*i);
+
+			current = (j == objects.end()) ? NULL : j->second;
+		}
+
+		if (found == logged.end())
+		{
+			// The object never reached the log
+			if (current != NULL)
+			{
+				current->invalidate();
+				objects.erase(*i);
+			}
+
+			continue;
+		}
+
+		if (current != NULL)
+		{
+			current->discardAttributes();
+			current->attributes.swap(found->second->attributes);
+			current->setIndex(&objectIndex);
+		}
+		else
+		{
+			// The object was deleted; the logged state comes back as a new
+			// instance, since the old one has been invalidated
+			current = found->second;
+			logged.erase(found);
+
+			current->setIndex(&objectIndex);
+			objects[*i] = current;
+			allObjects.insert(current);
+		}
+	}
+
+	for (std::map<unsigned long, LogObject*>::iterator i = logged.begin(); i != logged.end(); i++)
+	{
+		delete i->second;
+	}
+
+	// New batches are appended at the end of the log, so a partly written
+	// batch is cut off; a snapshot would also hold the open batches of
+	// other threads
+	if (bOK && isTorn)
+	{
+		bOK = batches.empty() && compact();
+	}
+
+	// The objects in memory can no longer be matched with the log
+	if (!bOK)
+	{
+		// ERROR_MSG("Failed to restore token %s from its log", tokenPath.c_str());
+
+		invalidate();
+	}
+
+	return bOK;
+}
+
+// Write a snapshot of all objects to a new log and drop the old one
+bool LogToken::compact()
+{
+	unsigned long newEpoch = epoch + 1;
+	unsigned long count = 0;
+	unsigned long total = 0;
+	bool bOK = true;
+
+	{
+		File logFile(tokenPath + OS_PATHSEP + logName(newEpoch), true, true, true);
+
+		bOK = logFile.isValid();
+
+		logFile.lock();
+
+		// A log left behind by an interrupted compaction is overwritten
+		bOK = bOK && logFile.truncate();
+
+		bOK = bOK &&
+		      logFile.writeULong(LOG_MAGIC) &&
+		      logFile.writeULong(LOG_VERSION) &&
+		      logFile.writeULong(newEpoch);
+
+		ByteString records;
+
+		bOK = bOK && serialiseObject(tokenObject, records);
+		count++;
+
+		for (std::map<unsigned long, LogObject*>::iterator i = objects.begin(); bOK && i != objects.end(); i++)
+		{
+			bOK = serialiseObject(i->second, records);
+			count++;
+
+			if (bOK && count >= LOG_SNAPSHOT_BATCH)
+			{
+				bOK = writeFrame(logFile, records, count);
+				total += count;
+
+				records.wipe();
+				count = 0;
+			}
+		}
+
+		// The checkpoint closes the snapshot
+		putULong(records, LOG_RECORD_CHECKPOINT);
+		putULong(records, LOG_TOKEN_OBJECT_ID);
+		count++;
+
+		bOK = bOK && writeFrame(logFile, records, count) && logFile.flush();
+		total += count;
+
+		records.wipe();
+
+		logFile.unlock();
+	}
+
+	if (!bOK)
+	{
+		// ERROR_MSG("Failed to compact token log in %s", tokenPath.c_str());
+
+		tokenDir->remove(logName(newEpoch));
+
+		return false;
+	}
+
+	// The new log is complete; the old one may be missing for a new token
+	tokenDir->remove(logName(epoch));
+
+	epoch = newEpoch;
+	logRecords = total;
+
+	// DEBUG_MSG("Compacted token log %s to %lu records", tokenPath.c_str(), logRecords);
+
+	return true;
+}
+
+// Return the file name of the log for the given epoch
+/*static*/ std::string LogToken::logName(unsigned long logEpoch)
+{
+	return (logEpoch & 1) ? "token.1.log" : "token.0.log";
+}
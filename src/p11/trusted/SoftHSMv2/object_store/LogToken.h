@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*****************************************************************************
+ LogToken.h
+
+ The log-structured token class; all objects of a token are stored in a
+ single append-only protected file. Each commit appends one framed batch of
+ records, the objects are indexed in enclave memory and the log is compacted
+ into a fresh snapshot once it holds mostly superseded records.
+ *****************************************************************************/
+
+#ifndef _SOFTHSM_V2_LOGTOKEN_H
+#define _SOFTHSM_V2_LOGTOKEN_H
+
+#include "config.h"
+#include "ObjectStoreToken.h"
+#include "OSAttribute.h"
+#include "LogObject.h"
+#include "Directory.h"
+#include "MutexFactory.h"
+#include "cryptoki.h"
+#include <string>
+#include <set>
+#include <map>
+#include <pthread.h>
+
+class LogToken : public ObjectStoreToken
+{
+public:
+	// Create a new token
+	static LogToken* createToken(const std::string basePath, const std::string tokenDir, const ByteString& label, const ByteString& serial);
+
+	// Access an existing token; a token created by the file backend is
+	// imported into a new log on first access
+	static LogToken* accessToken(const std::string &basePath, const std::string &tokenDir);
+
+	LogToken(const LogToken&) = delete;
+
+	LogToken& operator=(const LogToken&) = delete;
+
+	// Set the SO PIN
+	virtual bool setSOPIN(const ByteString& soPINBlob);
+
+	// Get the SO PIN
+	virtual bool getSOPIN(ByteString& soPINBlob);
+
+	// Set the user PIN
+	virtual bool setUserPIN(ByteString userPINBlob);
+
+	// Get the user PIN
+	virtual bool getUserPIN(ByteString& userPINBlob);
+
+	// Get the token flags
+	virtual bool getTokenFlags(CK_ULONG& flags);
+
+	// Set the token flags
+	virtual bool setTokenFlags(const CK_ULONG flags);
+
+	// Retrieve the token label
+	virtual bool getTokenLabel(ByteString& label);
+
+	// Retrieve the token serial
+	virtual bool getTokenSerial(ByteString& serial);
+
+	// Retrieve objects
+	virtual std::set<OSObject*> getObjects();
+
+	// Insert objects into the given set
+	virtual void getObjects(std::set<OSObject*> &inObjects);
+
+	// Create a new object
+	virtual OSObject* createObject();
+
+	// Delete an object
+	virtual bool deleteObject(OSObject* object);
+
+	// The attribute index of the objects
+	virtual ObjectIndex* getObjectIndex();
+
+	// Group the following object updates into one log batch
+	virtual bool startBatch();
+
+	// Append the grouped updates to the log in one go
+	virtual bool commitBatch();
+
+	// Drop the grouped updates; the objects return to their state in the log
+	virtual bool abortBatch();
+
+	// Destructor
+	virtual ~LogToken();
+
+	// Checks if the token is consistent
+	virtual bool isValid();
+
+	// Invalidate the token (for instance if it is deleted)
+	virtual void invalidate();
+
+	// Delete the token
+	virtual bool clearToken();
+
+	// Reset the token
+	virtual bool resetToken(const ByteString& label);
+
+private:
+	// LogObject instances append their changes through the token
+	friend class LogObject;
+
+	// Constructor
+	LogToken(const std::string inTokenPath);
+
+	// Load the newest consistent log from the token directory
+	bool open();
+
+	// Import the objects of a token created by the file backend
+	bool migrate();
+
+	// Replay a log file into the given object map; returns false if the log
+	// does not hold a complete snapshot
+	bool replay(const std::string& name, unsigned long& logEpoch, std::map<unsigned long, LogObject*>& logObjects, unsigned long& records, unsigned long& maxId, bool& isTorn);
+
+	// Serialise the store record of an object
+	static bool serialiseObject(LogObject* object, ByteString& record);
+
+	// Copy all attributes of an object
+	static void copyAttributes(OSObject* from, LogObject* to);
+
+	// Append a store record for the object; the caller holds the token mutex
+	bool storeObject(LogObject* object);
+
+	// Append a delete record for the object; the caller holds the token mutex
+	bool appendDelete(unsigned long id);
+
+	// Write a batch to the end of the log; the caller holds the token mutex
+	bool writeBatch(const ByteString& records, unsigned long count);
+
+	// Restore the given objects to their state in the log after a write
+	// failed; invalidates the token if the log cannot be read back. The
+	// caller holds the token mutex
+	bool rollback(const std::set<unsigned long>& ids);
+
+	// Write a snapshot of all objects to a new log and drop the old one;
+	// the caller holds the token mutex
+	bool compact();
+
+	// Return the file name of the log for the given epoch
+	static std::string logName(unsigned long logEpoch);
+
+	// Is the token consistent and valid?
+	bool valid;
+
+	// The token path
+	std::string tokenPath;
+
+	// The token object; it has the token specific attributes
+	LogObject* tokenObject;
+
+	// The index of the current objects of the token
+	std::map<unsigned long, LogObject*> objects;
+
+	// All the objects ever associated with this token; deleted objects
+	// may still be referenced from outside of this class
+	std::set<OSObject*> allObjects;
+
+	// The identifier for the next new object
+	unsigned long nextId;
+
+	// The epoch of the current log; it is incremented by compaction
+	unsigned long epoch;
+
+	// The number of records in the current log
+	unsigned long logRecords;
+
+	// An open batch; the objects it stores are serialised when it is
+	// committed, so a batch never writes an older state than the log has
+	struct LogBatch
+	{
+		LogBatch() : count(0), depth(0), aborted(false) { }
+
+		std::set<unsigned long> stored;
+		std::set<unsigned long> deleted;
+		ByteString records;
+		unsigned long count;
+		unsigned long depth;
+		bool aborted;
+	};
+
+	// The open batches; every calling thread has its own
+	std::map<pthread_t, LogBatch> batches;
+
+	// The directory object for this token
+	Directory* tokenDir;
+
+	// The attribute index of the objects
+	ObjectIndex objectIndex;
+
+	// For thread safeness
+	Mutex* tokenMutex;
+};
+
+#endif // !_SOFTHSM_V2_LOGTOKEN_H
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*****************************************************************************
+ MemToken.h
+
+ The in-memory token class; the token and its objects only live in enclave
+ memory and are discarded when the library is finalized. No files are used.
+ *****************************************************************************/
+
+#ifndef _SOFTHSM_V2_MEMTOKEN_H
+#define _SOFTHSM_V2_MEMTOKEN_H
+
+#include "config.h"
+#include "ObjectStoreToken.h"
+#include "OSAttribute.h"
+#include "MemObject.h"
+#include "MutexFactory.h"
+#include "cryptoki.h"
+#include <string>
+#include <set>
+
+class MemToken : public ObjectStoreToken
+{
+public:
+	// Create a new token; the paths are not used
+	static MemToken* createToken(const std::string basePath, const std::string tokenDir, const ByteString& label, const ByteString& serial);
+
+	// Access an existing token; memory tokens never exist on disk, so the
+	// returned token is invalid
+	static MemToken* accessToken(const std::string &basePath, const std::string &tokenDir);
+
+	MemToken(const MemToken&) = delete;
+
+	MemToken& operator=(const MemToken&) = delete;
+
+	// Set the SO PIN
+	virtual bool setSOPIN(const ByteString& soPINBlob);
+
+	// Get the SO PIN
+	virtual bool getSOPIN(ByteString& soPINBlob);
+
+	// Set the user PIN
+	virtual bool setUserPIN(ByteString userPINBlob);
+
+	// Get the user PIN
+	virtual bool getUserPIN(ByteString& userPINBlob);
+
+	// Get the token flags
+	virtual bool getTokenFlags(CK_ULONG& flags);
+
+	// Set the token flags
+	virtual bool setTokenFlags(const CK_ULONG flags);
+
+	// Retrieve the token label
+	virtual bool getTokenLabel(ByteString& label);
+
+	// Retrieve the token serial
+	virtual bool getTokenSerial(ByteString& serial);
+
+	// Retrieve objects
+	virtual std::set<OSObject*> getObjects();
+
+	// Insert objects into the given set
+	virtual void getObjects(std::set<OSObject*> &inObjects);
+
+	// Create a new object
+	virtual OSObject* createObject();
+
+	// Delete an object
+	virtual bool deleteObject(OSObject* object);
+
+	// The attribute index of the objects
+	virtual ObjectIndex* getObjectIndex();
+
+	// Destructor
+	virtual ~MemToken();
+
+	// Checks if the token is consistent
+	virtual bool isValid();
+
+	// Invalidate the token (for instance if it is deleted)
+	virtual void invalidate();
+
+	// Delete the token
+	virtual bool clearToken();
+
+	// Reset the token
+	virtual bool resetToken(const ByteString& label);
+
+private:
+	// Constructor
+	MemToken();
+
+	// Is the token consistent and valid?
+	bool valid;
+
+	// The token object; it has the token specific attributes
+	MemObject* tokenObject;
+
+	// The current objects of the token
+	std::set<OSObject*> objects;
+
+	// All the objects ever associated with this token; deleted objects
+	// may still be referenced from outside of this class
+	std::set<OSObject*> allObjects;
+
+	// The attribute index of the objects
+	ObjectIndex objectIndex;
+
+	// For thread safeness
+	Mutex* tokenMutex;
+};
+
+#endif // !_SOFTHSM_V2_MEMTOKEN_H
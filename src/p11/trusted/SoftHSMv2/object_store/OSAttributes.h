@@ -77,6 +77,15 @@
 #define CKA_OS_SOPIN		(CKA_VENDOR_SOFTHSM + 4)
 #define CKA_OS_USERPIN		(CKA_VENDOR_SOFTHSM + 5)
 
+// Vendor defined attribute types for the blind indexes (keyed MACs) of the
+// encrypted byte strings of private objects; see ObjectIndex
+#define CKA_OS_BLINDID		(CKA_VENDOR_SOFTHSM + 0x10)
+#define CKA_OS_BLINDLABEL	(CKA_VENDOR_SOFTHSM + 0x11)
+
+// Vendor defined attribute type for the additional primes of a multi-prime
+// RSA private key; see RSAPrivateKey::getOtherPrimes()
+#define CKA_OS_RSA_OTHERPRIMES	(CKA_VENDOR_SOFTHSM + 0x12)
+
 #ifdef SGXHSM
 // Crypto API Tollkit custome attribute for checking if this key used for wrapping
 //TODO: Find an appropriate place
@@ -93,6 +93,8 @@ OSToken::OSToken(const std::string inTokenPath)
 #endif
                                 );
 	tokenMutex = MutexFactory::i()->getMutex();
+	batchDepth = 0;
+	batchUpdated = false;
 	valid = (gen != NULL) && (tokenMutex != NULL) && tokenDir->isValid() && tokenObject->valid;
 
 	// DEBUG_MSG("Opened token %s", tokenPath.c_str());
@@ -406,6 +408,8 @@ OSObject* OSToken::createObject()
 		return NULL;
 	}
 
+	newObject->setIndex(getObjectIndex());
+
 	// Now add it to the set of objects
 	MutexLocker lock(tokenMutex);
 
@@ -415,9 +419,7 @@ OSObject* OSToken::createObject()
 
 	// DEBUG_MSG("(0x%08X) Created new object %s (0x%08X)", this, objectPath.c_str(), newObject);
 
-	gen->update();
-
-	gen->commit();
+	updateGeneration();
 
 	return newObject;
 }
@@ -475,13 +477,80 @@ bool OSToken::deleteObject(OSObject* object)
 
 	// DEBUG_MSG("Deleted object %s", objectFilename.c_str());
 
-	gen->update();
+	updateGeneration();
+
+	return true;
+}
+
+// Defer the generation bumps of the following object updates
+bool OSToken::startBatch()
+{
+	if (!valid) return false;
+
+	MutexLocker lock(tokenMutex);
+
+	batchDepth++;
+
+	return true;
+}
+
+// Bump the generation once for the grouped updates
+bool OSToken::commitBatch()
+{
+	MutexLocker lock(tokenMutex);
+
+	if (batchDepth == 0)
+	{
+		return false;
+	}
+
+	if (--batchDepth > 0 || !batchUpdated)
+	{
+		return true;
+	}
+
+	batchUpdated = false;
 
 	gen->commit();
 
 	return true;
 }
 
+// End the batch; the object files have been written already
+bool OSToken::abortBatch()
+{
+	(void) commitBatch();
+
+	return false;
+}
+
+// Note a change of the object set; the caller holds the token mutex
+void OSToken::updateGeneration()
+{
+	gen->update();
+
+	if (batchDepth > 0)
+	{
+		batchUpdated = true;
+
+		return;
+	}
+
+	gen->commit();
+}
+
+// The attribute index of the objects; objects may be changed by other
+// processes without this instance noticing, so the index is only kept if
+// the token is not shared
+ObjectIndex* OSToken::getObjectIndex()
+{
+#ifdef MULTIPROCESS_SUPPORT_DISABLED
+	return &objectIndex;
+#else
+	return NULL;
+#endif
+}
+
 // Checks if the token is consistent
 bool OSToken::isValid()
 {
@@ -733,6 +802,8 @@ bool OSToken::index(bool isFirstTime /* = false */)
 #endif
                                                );
 
+		newObject->setIndex(getObjectIndex());
+
 		// Add the object, even invalid ones.
 		// This is so the we can read the attributes once
 		// the other process has finished writing to disc.
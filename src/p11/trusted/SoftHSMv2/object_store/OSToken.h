@@ -135,6 +135,19 @@ public:
 	// Delete an object
 	virtual bool deleteObject(OSObject* object);
 
+	// The attribute index of the objects
+	virtual ObjectIndex* getObjectIndex();
+
+	// Defer the generation bumps of the following object updates
+	virtual bool startBatch();
+
+	// Bump the generation once for the grouped updates
+	virtual bool commitBatch();
+
+	// End the batch; every update has been stored already, so this returns
+	// false
+	virtual bool abortBatch();
+
 	// Destructor
 	virtual ~OSToken();
 
@@ -184,9 +197,19 @@ private:
 	// Generation control
 	Generation* gen;
 
+	// Nesting depth of the open batches and whether they changed the token
+	unsigned long batchDepth;
+	bool batchUpdated;
+
+	// Note a change of the object set; commits unless a batch is open
+	void updateGeneration();
+
 	// The directory object for this token
 	Directory* tokenDir;
 
+	// The attribute index of the objects
+	ObjectIndex objectIndex;
+
 	// For thread safeness
 	Mutex* tokenMutex;
 };
@@ -65,6 +65,7 @@
 #include "ObjectFile.h"
 #include "OSToken.h"
 #include "OSPathSep.h"
+#include "CryptoFactory.h"
 #include <set>
 
 // Attribute types
@@ -86,6 +87,7 @@ ObjectFile::ObjectFile(OSToken* parent, std::string inPath,
 	objectMutex = MutexFactory::i()->getMutex();
 	valid = (gen != NULL) && (objectMutex != NULL);
 	token = parent;
+	objectIndex = NULL;
 	inTransaction = false;
 #ifndef SGXHSM
 	transactionLockFile = NULL;
@@ -115,6 +117,9 @@ ObjectFile::~ObjectFile()
 {
 	discardAttributes();
 
+	// Wipe the key state that was kept for the object
+	CryptoFactory::i()->forgetKeyStates(this);
+
 	if (gen != NULL)
 	{
 		delete gen;
@@ -257,6 +262,11 @@ bool ObjectFile::setAttribute(CK_ATTRIBUTE_TYPE type, const OSAttribute& attribu
 		}
 
 		attributes[type] = new OSAttribute(attribute);
+
+		if (objectIndex != NULL)
+		{
+			objectIndex->update(this, type, attributes[type]);
+		}
 	}
 
 	store();
@@ -286,6 +296,11 @@ bool ObjectFile::deleteAttribute(CK_ATTRIBUTE_TYPE type)
 
 		delete attributes[type];
 		attributes.erase(type);
+
+		if (objectIndex != NULL)
+		{
+			objectIndex->update(this, type, NULL);
+		}
 	}
 
 	store();
@@ -545,6 +560,11 @@ void ObjectFile::refresh(bool isFirstTime /* = false */)
 
 	objectFile.unlock();
 
+	if (objectIndex != NULL)
+	{
+		objectIndex->update(this, attributes);
+	}
+
 	valid = true;
 }
 
@@ -749,6 +769,11 @@ void ObjectFile::discardAttributes()
 {
 	MutexLocker lock(objectMutex);
 
+	if (objectIndex != NULL)
+	{
+		objectIndex->remove(this);
+	}
+
 	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*> cleanUp = attributes;
 	attributes.clear();
 
@@ -779,6 +804,19 @@ std::string ObjectFile::getFilename() const
 	}
 }
 
+// Attach the object to the attribute index of its token
+void ObjectFile::setIndex(ObjectIndex* inIndex)
+{
+	MutexLocker lock(objectMutex);
+
+	objectIndex = inIndex;
+
+	if (objectIndex != NULL && valid)
+	{
+		objectIndex->update(this, attributes);
+	}
+}
+
 #ifndef SGXHSM
 // Returns the file name of the lock
 std::string ObjectFile::getLockname() const
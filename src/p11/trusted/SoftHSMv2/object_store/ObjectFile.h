@@ -75,6 +75,7 @@
 #include <time.h>
 #include "cryptoki.h"
 #include "OSObject.h"
+#include "ObjectIndex.h"
 
 // OSToken forward declaration
 class OSToken;
@@ -125,6 +126,9 @@ public:
 	// Returns the file name of the object
 	std::string getFilename() const;
 
+	// Attach the object to the attribute index of its token
+	void setIndex(ObjectIndex* inIndex);
+
 #ifndef SGXHSM
 	// Returns the file name of the lock
 	std::string getLockname() const;
@@ -182,6 +186,9 @@ private:
 	// The token this object is associated with
 	OSToken* token;
 
+	// The attribute index of the token, if it keeps one
+	ObjectIndex* objectIndex;
+
 	// Mutex object for thread-safeness
 	Mutex* objectMutex;
 
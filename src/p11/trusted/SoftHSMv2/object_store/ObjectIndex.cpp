@@ -0,0 +1,531 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*****************************************************************************
+ ObjectIndex.cpp
+
+ Attribute index of the objects of a token or of the session object store
+ *****************************************************************************/
+
+#include "config.h"
+#include "ObjectIndex.h"
+#include <vector>
+
+// Kinds of indexed values
+#define INDEX_ULONG			0x1
+#define INDEX_BYTESTR			0x2
+#define INDEX_OTHER			0x3
+
+// Layout of a blind index: the version, the IV of the encrypted value that
+// the MAC was computed for and the MAC itself
+#define BLIND_INDEX_VERSION		0x01
+#define BLIND_INDEX_IV_LEN		16
+
+// Constructor
+ObjectIndex::ObjectIndex()
+{
+	indexMutex = MutexFactory::i()->getMutex();
+}
+
+// Destructor
+ObjectIndex::~ObjectIndex()
+{
+	MutexFactory::i()->recycleMutex(indexMutex);
+}
+
+// Is the attribute type used to narrow down searches?
+/*static*/ bool ObjectIndex::isIndexed(CK_ATTRIBUTE_TYPE type)
+{
+	switch (type)
+	{
+		case CKA_CLASS:
+		case CKA_KEY_TYPE:
+		case CKA_ID:
+		case CKA_LABEL:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Get the type of the blind index attribute of a byte string attribute
+/*static*/ bool ObjectIndex::getBlindIndexType(CK_ATTRIBUTE_TYPE type, CK_ATTRIBUTE_TYPE& blindType)
+{
+	switch (type)
+	{
+		case CKA_ID:
+			blindType = CKA_OS_BLINDID;
+			return true;
+		case CKA_LABEL:
+			blindType = CKA_OS_BLINDLABEL;
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Is the attribute type a blind index?
+/*static*/ bool ObjectIndex::isBlindIndex(CK_ATTRIBUTE_TYPE type)
+{
+	return (type == CKA_OS_BLINDID) || (type == CKA_OS_BLINDLABEL);
+}
+
+// Get the attribute type that a blind index belongs to; the caller checks isBlindIndex
+static CK_ATTRIBUTE_TYPE blindIndexBaseType(CK_ATTRIBUTE_TYPE blindType)
+{
+	return (blindType == CKA_OS_BLINDID) ? CKA_ID : CKA_LABEL;
+}
+
+// Compose the value of a blind index attribute
+/*static*/ ByteString ObjectIndex::makeBlindIndex(const ByteString& mac, const ByteString& encrypted)
+{
+	ByteString blindIndex;
+
+	blindIndex += (unsigned char)BLIND_INDEX_VERSION;
+	blindIndex += encrypted.substr(0, BLIND_INDEX_IV_LEN);
+	blindIndex += mac;
+
+	return blindIndex;
+}
+
+// Get the MAC of a blind index attribute
+/*static*/ bool ObjectIndex::getBlindIndexMAC(const ByteString& blindIndex, const ByteString& encrypted, ByteString& mac)
+{
+	std::string rawMAC;
+
+	if (!getBlindIndexMAC(std::string((const char*)blindIndex.const_byte_str(), blindIndex.size()),
+			      std::string((const char*)encrypted.const_byte_str(), encrypted.size()),
+			      rawMAC))
+	{
+		return false;
+	}
+
+	mac = ByteString((const unsigned char*)rawMAC.data(), rawMAC.size());
+
+	return true;
+}
+
+// Get the MAC of a blind index if it belongs to the encrypted value
+/*static*/ bool ObjectIndex::getBlindIndexMAC(const std::string& blindIndex, const std::string& encrypted, std::string& mac)
+{
+	// A blind index of another version is treated as missing, so it
+	// gets replaced the next time the plaintext is known
+	if (blindIndex.size() <= 1 + BLIND_INDEX_IV_LEN ||
+	    (unsigned char)blindIndex[0] != BLIND_INDEX_VERSION)
+	{
+		return false;
+	}
+
+	// The encrypted value starts with a random IV; if it differs, the
+	// attribute was replaced after the blind index was computed
+	if (encrypted.size() < BLIND_INDEX_IV_LEN ||
+	    blindIndex.compare(1, BLIND_INDEX_IV_LEN, encrypted, 0, BLIND_INDEX_IV_LEN) != 0)
+	{
+		return false;
+	}
+
+	mac = blindIndex.substr(1 + BLIND_INDEX_IV_LEN);
+
+	return true;
+}
+
+// Update the index after an attribute of the object was set or deleted
+void ObjectIndex::update(OSObject* object, CK_ATTRIBUTE_TYPE type, const OSAttribute* attribute)
+{
+	if (!isIndexed(type) && !isBlindIndex(type) && type != CKA_PRIVATE)
+	{
+		return;
+	}
+
+	MutexLocker lock(indexMutex);
+
+	updateAttribute(object, type, attribute);
+}
+
+// Index all attributes of the object
+void ObjectIndex::update(OSObject* object, const std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>& attributes)
+{
+	MutexLocker lock(indexMutex);
+
+	removeObject(object);
+
+	// CKA_PRIVATE first, so the byte strings are placed correctly right away
+	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>::const_iterator i = attributes.find(CKA_PRIVATE);
+	updateAttribute(object, CKA_PRIVATE, (i != attributes.end()) ? i->second : NULL);
+
+	for (i = attributes.begin(); i != attributes.end(); i++)
+	{
+		if ((isIndexed(i->first) || isBlindIndex(i->first)) && i->second != NULL)
+		{
+			updateAttribute(object, i->first, i->second);
+		}
+	}
+}
+
+// Remove the object from the index
+void ObjectIndex::remove(OSObject* object)
+{
+	MutexLocker lock(indexMutex);
+
+	removeObject(object);
+}
+
+// Remove all objects from the index
+void ObjectIndex::clear()
+{
+	MutexLocker lock(indexMutex);
+
+	objects.clear();
+	buckets.clear();
+	blindBuckets.clear();
+	unindexed.clear();
+}
+
+// Insert the objects that may match the template into the given set
+bool ObjectIndex::find(CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, std::set<OSObject*>& candidates, const std::map<CK_ATTRIBUTE_TYPE, ByteString>* blindMACs /* = NULL */)
+{
+	MutexLocker lock(indexMutex);
+
+	// The objects matching an attribute are the ones in the bucket of the
+	// value, the ones in the bucket of its blind index and the ones that
+	// could not be indexed by value
+	std::vector<std::vector<const std::set<OSObject*>*> > matches;
+	size_t smallest = 0;
+	size_t smallestSize = 0;
+
+	for (CK_ULONG i = 0; i < ulCount; i++)
+	{
+		if (!isIndexed(pTemplate[i].type) ||
+		    (pTemplate[i].pValue == NULL_PTR && pTemplate[i].ulValueLen != 0))
+		{
+			continue;
+		}
+
+		std::vector<const std::set<OSObject*>*> sets;
+		size_t size = 0;
+
+		std::map<CK_ATTRIBUTE_TYPE, std::unordered_map<std::string, std::set<OSObject*> > >::iterator bucket = buckets.find(pTemplate[i].type);
+		if (bucket != buckets.end())
+		{
+			std::string value((const char*)pTemplate[i].pValue, pTemplate[i].ulValueLen);
+
+			std::unordered_map<std::string, std::set<OSObject*> >::iterator j = bucket->second.find(value);
+			if (j != bucket->second.end())
+			{
+				sets.push_back(&j->second);
+				size += j->second.size();
+			}
+		}
+
+		std::map<CK_ATTRIBUTE_TYPE, ByteString>::const_iterator mac;
+		if (blindMACs != NULL &&
+		    (mac = blindMACs->find(pTemplate[i].type)) != blindMACs->end() &&
+		    (bucket = blindBuckets.find(pTemplate[i].type)) != blindBuckets.end())
+		{
+			std::string value((const char*)mac->second.const_byte_str(), mac->second.size());
+
+			std::unordered_map<std::string, std::set<OSObject*> >::iterator j = bucket->second.find(value);
+			if (j != bucket->second.end())
+			{
+				sets.push_back(&j->second);
+				size += j->second.size();
+			}
+		}
+
+		std::map<CK_ATTRIBUTE_TYPE, std::set<OSObject*> >::iterator other = unindexed.find(pTemplate[i].type);
+		if (other != unindexed.end())
+		{
+			sets.push_back(&other->second);
+			size += other->second.size();
+		}
+
+		if (matches.empty() || size < smallestSize)
+		{
+			smallest = matches.size();
+			smallestSize = size;
+		}
+
+		matches.push_back(sets);
+	}
+
+	if (matches.empty())
+	{
+		return false;
+	}
+
+	// Walk the smallest candidate set and keep the objects that match all
+	// other indexed attributes as well
+	for (size_t w = 0; w < matches[smallest].size(); w++)
+	{
+		const std::set<OSObject*>* walk = matches[smallest][w];
+
+		for (std::set<OSObject*>::const_iterator o = walk->begin(); o != walk->end(); o++)
+		{
+			bool isCandidate = true;
+
+			for (size_t m = 0; isCandidate && m < matches.size(); m++)
+			{
+				if (m == smallest)
+				{
+					continue;
+				}
+
+				isCandidate = false;
+
+				for (size_t n = 0; !isCandidate && n < matches[m].size(); n++)
+				{
+					isCandidate = (matches[m][n]->count(*o) != 0);
+				}
+			}
+
+			if (isCandidate)
+			{
+				candidates.insert(*o);
+			}
+		}
+	}
+
+	return true;
+}
+
+// Determine where the attribute of the object is kept
+std::map<CK_ATTRIBUTE_TYPE, std::unordered_map<std::string, std::set<OSObject*> > >* ObjectIndex::placeEntry(CK_ATTRIBUTE_TYPE type, const IndexEntry& entry, const ObjectEntry& objectEntry, std::string& key)
+{
+	// Byte strings of private objects are encrypted, unless empty
+	if (entry.kind == INDEX_ULONG ||
+	    (entry.kind == INDEX_BYTESTR && (!objectEntry.isPrivate || entry.value.empty())))
+	{
+		key = entry.value;
+
+		return &buckets;
+	}
+
+	// Encrypted byte strings are kept by their blind index, if it is current
+	if (entry.kind == INDEX_BYTESTR)
+	{
+		std::map<CK_ATTRIBUTE_TYPE, std::string>::const_iterator i = objectEntry.blindIndexes.find(type);
+
+		if (i != objectEntry.blindIndexes.end() && getBlindIndexMAC(i->second, entry.value, key))
+		{
+			return &blindBuckets;
+		}
+	}
+
+	return NULL;
+}
+
+// Add the object to the bucket of the attribute
+void ObjectIndex::insertEntry(OSObject* object, CK_ATTRIBUTE_TYPE type, const IndexEntry& entry, const ObjectEntry& objectEntry)
+{
+	std::string key;
+	std::map<CK_ATTRIBUTE_TYPE, std::unordered_map<std::string, std::set<OSObject*> > >* place = placeEntry(type, entry, objectEntry, key);
+
+	if (place != NULL)
+	{
+		(*place)[type][key].insert(object);
+	}
+	else
+	{
+		unindexed[type].insert(object);
+	}
+}
+
+// Remove the object from the bucket of the attribute
+void ObjectIndex::eraseEntry(OSObject* object, CK_ATTRIBUTE_TYPE type, const IndexEntry& entry, const ObjectEntry& objectEntry)
+{
+	std::string key;
+	std::map<CK_ATTRIBUTE_TYPE, std::unordered_map<std::string, std::set<OSObject*> > >* place = placeEntry(type, entry, objectEntry, key);
+
+	if (place != NULL)
+	{
+		std::map<CK_ATTRIBUTE_TYPE, std::unordered_map<std::string, std::set<OSObject*> > >::iterator bucket = place->find(type);
+		if (bucket == place->end())
+		{
+			return;
+		}
+
+		std::unordered_map<std::string, std::set<OSObject*> >::iterator i = bucket->second.find(key);
+		if (i == bucket->second.end())
+		{
+			return;
+		}
+
+		i->second.erase(object);
+
+		if (i->second.empty())
+		{
+			bucket->second.erase(i);
+		}
+	}
+	else
+	{
+		std::map<CK_ATTRIBUTE_TYPE, std::set<OSObject*> >::iterator other = unindexed.find(type);
+		if (other != unindexed.end())
+		{
+			other->second.erase(object);
+		}
+	}
+}
+
+// Update a single attribute; the caller holds the mutex
+void ObjectIndex::updateAttribute(OSObject* object, CK_ATTRIBUTE_TYPE type, const OSAttribute* attribute)
+{
+	std::map<OSObject*, ObjectEntry>::iterator i = objects.find(object);
+	if (i == objects.end())
+	{
+		// Objects without CKA_PRIVATE are treated as private
+		ObjectEntry newEntry;
+		newEntry.isPrivate = true;
+
+		i = objects.insert(std::make_pair(object, newEntry)).first;
+	}
+
+	ObjectEntry& objectEntry = i->second;
+
+	if (type == CKA_PRIVATE)
+	{
+		bool isPrivate = true;
+
+		if (attribute != NULL && attribute->isBooleanAttribute())
+		{
+			isPrivate = attribute->getBooleanValue();
+		}
+
+		if (isPrivate == objectEntry.isPrivate)
+		{
+			return;
+		}
+
+		// Move the byte strings to where they belong now
+		for (std::map<CK_ATTRIBUTE_TYPE, IndexEntry>::iterator j = objectEntry.attributes.begin(); j != objectEntry.attributes.end(); j++)
+		{
+			eraseEntry(object, j->first, j->second, objectEntry);
+		}
+
+		objectEntry.isPrivate = isPrivate;
+
+		for (std::map<CK_ATTRIBUTE_TYPE, IndexEntry>::iterator j = objectEntry.attributes.begin(); j != objectEntry.attributes.end(); j++)
+		{
+			insertEntry(object, j->first, j->second, objectEntry);
+		}
+
+		return;
+	}
+
+	if (isBlindIndex(type))
+	{
+		CK_ATTRIBUTE_TYPE baseType = blindIndexBaseType(type);
+
+		// Move the attribute the blind index belongs to, if it is indexed
+		std::map<CK_ATTRIBUTE_TYPE, IndexEntry>::iterator j = objectEntry.attributes.find(baseType);
+		if (j != objectEntry.attributes.end())
+		{
+			eraseEntry(object, baseType, j->second, objectEntry);
+		}
+
+		if (attribute != NULL && attribute->isByteStringAttribute())
+		{
+			const ByteString& value = attribute->getByteStringValue();
+
+			objectEntry.blindIndexes[baseType].assign((const char*)value.const_byte_str(), value.size());
+		}
+		else
+		{
+			objectEntry.blindIndexes.erase(baseType);
+		}
+
+		if (j != objectEntry.attributes.end())
+		{
+			insertEntry(object, baseType, j->second, objectEntry);
+		}
+
+		return;
+	}
+
+	std::map<CK_ATTRIBUTE_TYPE, IndexEntry>::iterator j = objectEntry.attributes.find(type);
+	if (j != objectEntry.attributes.end())
+	{
+		eraseEntry(object, type, j->second, objectEntry);
+		objectEntry.attributes.erase(j);
+	}
+
+	if (attribute == NULL)
+	{
+		return;
+	}
+
+	IndexEntry entry;
+
+	if (attribute->isUnsignedLongAttribute())
+	{
+		// Stored the way the value appears in a template
+		CK_ULONG value = attribute->getUnsignedLongValue();
+
+		entry.kind = INDEX_ULONG;
+		entry.value.assign((const char*)&value, sizeof(value));
+	}
+	else if (attribute->isByteStringAttribute())
+	{
+		const ByteString& value = attribute->getByteStringValue();
+
+		entry.kind = INDEX_BYTESTR;
+
+		if (value.size() > 0)
+		{
+			entry.value.assign((const char*)value.const_byte_str(), value.size());
+		}
+	}
+	else
+	{
+		entry.kind = INDEX_OTHER;
+	}
+
+	insertEntry(object, type, entry, objectEntry);
+	objectEntry.attributes[type] = entry;
+}
+
+// Remove an object; the caller holds the mutex
+void ObjectIndex::removeObject(OSObject* object)
+{
+	std::map<OSObject*, ObjectEntry>::iterator i = objects.find(object);
+	if (i == objects.end())
+	{
+		return;
+	}
+
+	for (std::map<CK_ATTRIBUTE_TYPE, IndexEntry>::iterator j = i->second.attributes.begin(); j != i->second.attributes.end(); j++)
+	{
+		eraseEntry(object, j->first, j->second, i->second);
+	}
+
+	objects.erase(i);
+}
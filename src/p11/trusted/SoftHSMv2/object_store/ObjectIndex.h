@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*****************************************************************************
+ ObjectIndex.h
+
+ Attribute index of the objects of a token or of the session object store.
+ The objects report every change of an indexed attribute, so a search can
+ narrow down the candidate objects without reading every object. Byte string
+ values of private objects are stored encrypted and cannot be indexed by
+ value. Instead they are indexed by their blind index, a keyed MAC of the
+ plaintext that is stored next to the encrypted value; private objects
+ without a current blind index are always returned as candidates.
+ *****************************************************************************/
+
+#ifndef _SOFTHSM_V2_OBJECTINDEX_H
+#define _SOFTHSM_V2_OBJECTINDEX_H
+
+#include "config.h"
+#include "OSAttribute.h"
+#include "OSObject.h"
+#include "OSAttributes.h"
+#include "ByteString.h"
+#include "MutexFactory.h"
+#include "cryptoki.h"
+#include <string>
+#include <set>
+#include <map>
+#include <unordered_map>
+
+class ObjectIndex
+{
+public:
+	// Constructor
+	ObjectIndex();
+
+	ObjectIndex(const ObjectIndex&) = delete;
+
+	ObjectIndex& operator=(const ObjectIndex&) = delete;
+
+	// Destructor
+	virtual ~ObjectIndex();
+
+	// Is the attribute type used to narrow down searches?
+	static bool isIndexed(CK_ATTRIBUTE_TYPE type);
+
+	// Get the type of the blind index attribute that goes with a byte string
+	// attribute of a private object; returns false if it has none
+	static bool getBlindIndexType(CK_ATTRIBUTE_TYPE type, CK_ATTRIBUTE_TYPE& blindType);
+
+	// Is the attribute type a blind index?
+	static bool isBlindIndex(CK_ATTRIBUTE_TYPE type);
+
+	// Compose the value of a blind index attribute from the MAC of the
+	// plaintext and the encrypted value that it belongs to
+	static ByteString makeBlindIndex(const ByteString& mac, const ByteString& encrypted);
+
+	// Get the MAC of a blind index attribute; returns false if the blind
+	// index is of an unknown version or does not belong to the encrypted value
+	static bool getBlindIndexMAC(const ByteString& blindIndex, const ByteString& encrypted, ByteString& mac);
+
+	// Update the index after an attribute of the object was set (or deleted
+	// if attribute is NULL)
+	void update(OSObject* object, CK_ATTRIBUTE_TYPE type, const OSAttribute* attribute);
+
+	// Index all attributes of the object, replacing what was indexed before
+	void update(OSObject* object, const std::map<CK_ATTRIBUTE_TYPE, OSAttribute*>& attributes);
+
+	// Remove the object from the index
+	void remove(OSObject* object);
+
+	// Remove all objects from the index
+	void clear();
+
+	// Insert the objects that may match the template into the given set; the
+	// candidates still have to be matched against the full template. Returns
+	// false if the template has no indexed attribute. Private objects that
+	// are indexed by blind index are only returned if the MACs of the
+	// template values are given, by attribute type.
+	bool find(CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, std::set<OSObject*>& candidates, const std::map<CK_ATTRIBUTE_TYPE, ByteString>* blindMACs = NULL);
+
+private:
+	// The indexed state of one attribute of an object
+	struct IndexEntry
+	{
+		// The kind of value; only unsigned longs and byte strings can be
+		// compared with the raw template value
+		unsigned long kind;
+
+		// The raw value
+		std::string value;
+	};
+
+	// The indexed state of an object
+	struct ObjectEntry
+	{
+		// CKA_PRIVATE of the object; byte strings of private objects are encrypted
+		bool isPrivate;
+
+		// The indexed attributes
+		std::map<CK_ATTRIBUTE_TYPE, IndexEntry> attributes;
+
+		// The blind indexes, by the type of the attribute they belong to
+		std::map<CK_ATTRIBUTE_TYPE, std::string> blindIndexes;
+	};
+
+	// Get the MAC of a blind index if it belongs to the encrypted value
+	static bool getBlindIndexMAC(const std::string& blindIndex, const std::string& encrypted, std::string& mac);
+
+	// Determine where the attribute of the object is kept; returns the
+	// buckets holding it and sets the key of its bucket, or returns NULL if
+	// it is kept in the unindexed objects
+	std::map<CK_ATTRIBUTE_TYPE, std::unordered_map<std::string, std::set<OSObject*> > >* placeEntry(CK_ATTRIBUTE_TYPE type, const IndexEntry& entry, const ObjectEntry& objectEntry, std::string& key);
+
+	// Add or remove the object from the bucket of the attribute
+	void insertEntry(OSObject* object, CK_ATTRIBUTE_TYPE type, const IndexEntry& entry, const ObjectEntry& objectEntry);
+	void eraseEntry(OSObject* object, CK_ATTRIBUTE_TYPE type, const IndexEntry& entry, const ObjectEntry& objectEntry);
+
+	// Update a single attribute; the caller holds the mutex
+	void updateAttribute(OSObject* object, CK_ATTRIBUTE_TYPE type, const OSAttribute* attribute);
+
+	// Remove an object; the caller holds the mutex
+	void removeObject(OSObject* object);
+
+	// The indexed objects
+	std::map<OSObject*, ObjectEntry> objects;
+
+	// Per attribute type, the objects by raw value
+	std::map<CK_ATTRIBUTE_TYPE, std::unordered_map<std::string, std::set<OSObject*> > > buckets;
+
+	// Per attribute type, the private objects by the MAC of their blind index
+	std::map<CK_ATTRIBUTE_TYPE, std::unordered_map<std::string, std::set<OSObject*> > > blindBuckets;
+
+	// Per attribute type, the objects whose value cannot be indexed
+	std::map<CK_ATTRIBUTE_TYPE, std::set<OSObject*> > unindexed;
+
+	// For thread safeness
+	Mutex* indexMutex;
+};
+
+#endif // !_SOFTHSM_V2_OBJECTINDEX_H
+
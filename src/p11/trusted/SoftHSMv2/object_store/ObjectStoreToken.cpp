@@ -67,6 +67,12 @@
 // OSToken is a concrete implementation of ObjectStoreToken base class.
 #include "OSToken.h"
 
+// LogToken is a concrete implementation of ObjectStoreToken that stores all objects of a token in a single log file.
+#include "LogToken.h"
+
+// MemToken is a concrete implementation of ObjectStoreToken that keeps all objects of a token in enclave memory only.
+#include "MemToken.h"
+
 #ifdef HAVE_OBJECTSTORE_BACKEND_DB
 // DBToken is a concrete implementation of ObjectSToreToken that stores the objects and attributes in an SQLite3 database.
 #include "DBToken.h"
@@ -86,6 +92,16 @@ static AccessToken static_accessToken = reinterpret_cast<AccessToken>(OSToken::a
 		static_createToken = reinterpret_cast<CreateToken>(OSToken::createToken);
 		static_accessToken = reinterpret_cast<AccessToken>(OSToken::accessToken);
 	}
+	else if (backend == "log")
+	{
+		static_createToken = reinterpret_cast<CreateToken>(LogToken::createToken);
+		static_accessToken = reinterpret_cast<AccessToken>(LogToken::accessToken);
+	}
+	else if (backend == "memory")
+	{
+		static_createToken = reinterpret_cast<CreateToken>(MemToken::createToken);
+		static_accessToken = reinterpret_cast<AccessToken>(MemToken::accessToken);
+	}
 #ifdef HAVE_OBJECTSTORE_BACKEND_DB
 	else if (backend == "db")
 	{
@@ -112,3 +128,16 @@ ObjectStoreToken* ObjectStoreToken::createToken(const std::string basePath, cons
 {
 	return static_accessToken(basePath, tokenDir);
 }
+
+// Insert the objects that may match the template into the given set
+bool ObjectStoreToken::findObjects(CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, std::set<OSObject*> &objects, const std::map<CK_ATTRIBUTE_TYPE, ByteString>* blindMACs /* = NULL */)
+{
+	ObjectIndex* objectIndex = getObjectIndex();
+
+	if (objectIndex == NULL)
+	{
+		return false;
+	}
+
+	return objectIndex->find(pTemplate, ulCount, objects, blindMACs);
+}
@@ -35,6 +35,7 @@
 
 #include "config.h"
 #include "OSObject.h"
+#include "ObjectIndex.h"
 #include <string>
 #include <set>
 
@@ -86,6 +87,25 @@ public:
 	// Delete an object
 	virtual bool deleteObject(OSObject* object) = 0;
 
+	// The attribute index of the objects; backends that cannot keep an index
+	// up to date return NULL and are searched object by object
+	virtual ObjectIndex* getObjectIndex() { return NULL; }
+
+	// Insert the objects that may match the template into the given set;
+	// returns false if the objects cannot be narrowed down by the index.
+	// Private objects are only found by their blind index if the MACs of
+	// the template values are given.
+	virtual bool findObjects(CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, std::set<OSObject*> &objects, const std::map<CK_ATTRIBUTE_TYPE, ByteString>* blindMACs = NULL);
+
+	// Group the following object updates into one atomic commit; backends
+	// that persist every update on its own keep these defaults
+	virtual bool startBatch() { return true; }
+	virtual bool commitBatch() { return true; }
+
+	// End the batch without committing it; returns false if the updates
+	// were already stored and have to be undone by the caller
+	virtual bool abortBatch() { return false; }
+
 	// Destructor
 	virtual ~ObjectStoreToken() {};
 
@@ -64,6 +64,7 @@
 #include "config.h"
 #include "SessionObject.h"
 #include "SessionObjectStore.h"
+#include "CryptoFactory.h"
 
 // Constructor
 SessionObject::SessionObject(SessionObjectStore* inParent, CK_SLOT_ID inSlotID, CK_SESSION_HANDLE inHSession, bool inIsPrivate)
@@ -74,6 +75,7 @@ SessionObject::SessionObject(SessionObjectStore* inParent, CK_SLOT_ID inSlotID,
 	objectMutex = MutexFactory::i()->getMutex();
 	valid = (objectMutex != NULL);
 	parent = inParent;
+	objectIndex = (parent != NULL) ? parent->getObjectIndex() : NULL;
 }
 
 // Destructor
@@ -219,6 +221,11 @@ bool SessionObject::setAttribute(CK_ATTRIBUTE_TYPE type, const OSAttribute& attr
 
 	attributes[type] = new OSAttribute(attribute);
 
+	if (objectIndex != NULL)
+	{
+		objectIndex->update(this, type, attributes[type]);
+	}
+
 	return true;
 }
 
@@ -244,6 +251,11 @@ bool SessionObject::deleteAttribute(CK_ATTRIBUTE_TYPE type)
 	delete attributes[type];
 	attributes.erase(type);
 
+	if (objectIndex != NULL)
+	{
+		objectIndex->update(this, type, NULL);
+	}
+
 	return true;
 }
 
@@ -313,6 +325,15 @@ void SessionObject::discardAttributes()
 {
 	MutexLocker lock(objectMutex);
 
+	if (objectIndex != NULL)
+	{
+		objectIndex->remove(this);
+	}
+
+	// Wipe the key state that was kept for the object; every way a
+	// session object is removed ends here
+	CryptoFactory::i()->forgetKeyStates(this);
+
 	std::map<CK_ATTRIBUTE_TYPE, OSAttribute*> cleanUp = attributes;
 	attributes.clear();
 
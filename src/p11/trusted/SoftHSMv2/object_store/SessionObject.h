@@ -72,6 +72,7 @@
 #include <map>
 #include "cryptoki.h"
 #include "OSObject.h"
+#include "ObjectIndex.h"
 
 // Forward declaration of the session object store
 class SessionObjectStore;
@@ -161,6 +162,9 @@ private:
 
 	// The parent SessionObjectStore
 	SessionObjectStore* parent;
+
+	// The attribute index of the parent
+	ObjectIndex* objectIndex;
 };
 
 #endif // !_SOFTHSM_V2_SESSIONOBJECT_H
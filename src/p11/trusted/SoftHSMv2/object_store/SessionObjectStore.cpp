@@ -123,6 +123,34 @@ void SessionObjectStore::getObjects(CK_SLOT_ID slotID, std::set<OSObject*> &inOb
 	}
 }
 
+bool SessionObjectStore::findObjects(CK_SLOT_ID slotID, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, std::set<OSObject*> &inObjects, const std::map<CK_ATTRIBUTE_TYPE, ByteString>* blindMACs /* = NULL */)
+{
+	std::set<OSObject*> candidates;
+
+	if (!objectIndex.find(pTemplate, ulCount, candidates, blindMACs))
+	{
+		return false;
+	}
+
+	MutexLocker lock(storeMutex);
+
+	std::set<OSObject*>::iterator it;
+	for (it=candidates.begin(); it!=candidates.end(); ++it) {
+		SessionObject* object = static_cast<SessionObject*>(*it);
+
+		if (objects.find(object) != objects.end() && object->hasSlotID(slotID))
+			inObjects.insert(object);
+	}
+
+	return true;
+}
+
+// The attribute index of the session objects
+ObjectIndex* SessionObjectStore::getObjectIndex()
+{
+	return &objectIndex;
+}
+
 // Create a new object
 SessionObject* SessionObjectStore::createObject(CK_SLOT_ID slotID, CK_SESSION_HANDLE hSession, bool isPrivate)
 {
@@ -238,5 +266,7 @@ void SessionObjectStore::clearStore()
 	{
 		delete *i;
 	}
+
+	objectIndex.clear();
 }
 
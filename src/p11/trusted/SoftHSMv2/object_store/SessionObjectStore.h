@@ -69,6 +69,7 @@
 #include "config.h"
 #include "OSAttribute.h"
 #include "SessionObject.h"
+#include "ObjectIndex.h"
 #include "MutexFactory.h"
 #include "cryptoki.h"
 #include <string>
@@ -93,6 +94,15 @@ public:
 	// Insert the session objects for the given slotID into the given OSObject set
 	void getObjects(CK_SLOT_ID slotID, std::set<OSObject*> &inObjects);
 
+	// Insert the session objects for the given slotID that may match the
+	// template into the given set; returns false if the template has no
+	// indexed attribute. Private objects are only found by their blind
+	// index if the MACs of the template values are given.
+	bool findObjects(CK_SLOT_ID slotID, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, std::set<OSObject*> &inObjects, const std::map<CK_ATTRIBUTE_TYPE, ByteString>* blindMACs = NULL);
+
+	// The attribute index of the session objects
+	ObjectIndex* getObjectIndex();
+
 	// Create a new object
 	SessionObject* createObject(CK_SLOT_ID slotID, CK_SESSION_HANDLE hSession, bool isPrivate = false);
 
@@ -127,6 +137,9 @@ private:
 	// The current list of files
 	std::set<std::string> currentFiles;
 
+	// The attribute index of the session objects
+	ObjectIndex objectIndex;
+
 	// For thread safeness
 	Mutex* storeMutex;
 };
@@ -0,0 +1,460 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*****************************************************************************
+ LogTokenTests.cpp
+
+ Contains test cases to test the log-structured token class
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "LogTokenTests.h"
+#include "LogToken.h"
+#include "OSToken.h"
+#include "OSObject.h"
+#include "OSAttribute.h"
+#include "OSAttributes.h"
+#include "Directory.h"
+#include "cryptoki.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LogTokenTests);
+
+#define TOKEN_PATH "./testdir/newToken"
+
+// Find the object with the given label
+static OSObject* findObject(LogToken* token, const ByteString& label)
+{
+	std::set<OSObject*> objects = token->getObjects();
+
+	for (std::set<OSObject*>::iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		if ((*i)->attributeExists(CKA_LABEL) && (*i)->getByteStringValue(CKA_LABEL) == label)
+		{
+			return *i;
+		}
+	}
+
+	return NULL;
+}
+
+// Create an object with the given label
+static OSObject* createObject(LogToken* token, const ByteString& label)
+{
+	OSObject* object = token->createObject();
+
+	CPPUNIT_ASSERT(object != NULL);
+	CPPUNIT_ASSERT(object->startTransaction());
+	CPPUNIT_ASSERT(object->setAttribute(CKA_CLASS, OSAttribute((unsigned long) CKO_DATA)));
+	CPPUNIT_ASSERT(object->setAttribute(CKA_TOKEN, OSAttribute(true)));
+	CPPUNIT_ASSERT(object->setAttribute(CKA_LABEL, OSAttribute(label)));
+	CPPUNIT_ASSERT(object->commitTransaction());
+
+	return object;
+}
+
+// Read the CKA_VALUE_LEN of the object with the given label as another
+// instance of the token sees it in the log; an unusable log gives -1
+static unsigned long persistedValue(const ByteString& label)
+{
+	LogToken* token = LogToken::accessToken("./testdir", "newToken");
+	unsigned long value = (unsigned long) -1;
+
+	if (token->isValid())
+	{
+		OSObject* object = findObject(token, label);
+
+		value = (object != NULL) ? object->getUnsignedLongValue(CKA_VALUE_LEN, 0) : 0;
+	}
+
+	delete token;
+
+	return value;
+}
+
+void LogTokenTests::setUp()
+{
+	CPPUNIT_ASSERT(!system("mkdir testdir"));
+}
+
+void LogTokenTests::tearDown()
+{
+	CPPUNIT_ASSERT(!system("rm -rf testdir"));
+}
+
+std::string LogTokenTests::currentLog()
+{
+	Directory tokenDir(TOKEN_PATH);
+	std::vector<std::string> files = tokenDir.getFiles();
+	std::string name;
+	size_t count = 0;
+
+	for (std::vector<std::string>::iterator i = files.begin(); i != files.end(); i++)
+	{
+		if (*i == "token.0.log" || *i == "token.1.log")
+		{
+			name = *i;
+			count++;
+		}
+	}
+
+	CPPUNIT_ASSERT(count == 1);
+
+	return name;
+}
+
+void LogTokenTests::testReplay()
+{
+	ByteString tokenLabel = "40414243";
+	ByteString tokenSerial = "0102030405060708";
+	ByteString soPIN = "3132333435363738";
+	ByteString label1 = "0102";
+	ByteString label2 = "0304";
+	ByteString label3 = "0506";
+	ByteString value = "A1A2A3A4A5";
+
+	LogToken* token = LogToken::createToken("./testdir", "newToken", tokenLabel, tokenSerial);
+
+	CPPUNIT_ASSERT(token != NULL);
+	CPPUNIT_ASSERT(token->isValid());
+	CPPUNIT_ASSERT(token->setSOPIN(soPIN));
+
+	createObject(token, label1);
+	OSObject* object2 = createObject(token, label2);
+	OSObject* object3 = createObject(token, label3);
+
+	// Later records supersede earlier ones of the same object
+	CPPUNIT_ASSERT(object2->setAttribute(CKA_VALUE, OSAttribute(value)));
+	CPPUNIT_ASSERT(object2->setAttribute(CKA_LABEL, OSAttribute(label3)));
+	CPPUNIT_ASSERT(object3->destroyObject());
+
+	delete token;
+
+	token = LogToken::accessToken("./testdir", "newToken");
+
+	CPPUNIT_ASSERT(token->isValid());
+	CPPUNIT_ASSERT(token->getObjects().size() == 2);
+
+	ByteString retrieved;
+
+	CPPUNIT_ASSERT(token->getTokenLabel(retrieved) && retrieved == tokenLabel);
+	CPPUNIT_ASSERT(token->getTokenSerial(retrieved) && retrieved == tokenSerial);
+	CPPUNIT_ASSERT(token->getSOPIN(retrieved) && retrieved == soPIN);
+
+	OSObject* object = findObject(token, label1);
+
+	CPPUNIT_ASSERT(object != NULL);
+	CPPUNIT_ASSERT(object->getUnsignedLongValue(CKA_CLASS, CKO_VENDOR_DEFINED) == CKO_DATA);
+	CPPUNIT_ASSERT(object->getBooleanValue(CKA_TOKEN, false));
+
+	object = findObject(token, label3);
+
+	CPPUNIT_ASSERT(object != NULL);
+	CPPUNIT_ASSERT(object->getByteStringValue(CKA_VALUE) == value);
+	CPPUNIT_ASSERT(findObject(token, label2) == NULL);
+
+	delete token;
+}
+
+void LogTokenTests::testTornTail()
+{
+	ByteString label1 = "0102";
+	ByteString label2 = "0304";
+
+	LogToken* token = LogToken::createToken("./testdir", "newToken", ByteString("40414243"), ByteString("0102030405060708"));
+
+	CPPUNIT_ASSERT(token != NULL);
+
+	createObject(token, label1);
+
+	delete token;
+
+	// Cut off a batch in the middle of its records
+	std::string logPath = std::string(TOKEN_PATH) + "/" + currentLog();
+	const unsigned char torn[] = { 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0 };
+	FILE* logFile = fopen(logPath.c_str(), "ab");
+
+	CPPUNIT_ASSERT(logFile != NULL);
+	CPPUNIT_ASSERT(fwrite(torn, 1, sizeof(torn), logFile) == sizeof(torn));
+	CPPUNIT_ASSERT(!fclose(logFile));
+
+	token = LogToken::accessToken("./testdir", "newToken");
+
+	CPPUNIT_ASSERT(token->isValid());
+	CPPUNIT_ASSERT(findObject(token, label1) != NULL);
+
+	// New batches follow the cut off log
+	createObject(token, label2);
+
+	delete token;
+
+	token = LogToken::accessToken("./testdir", "newToken");
+
+	CPPUNIT_ASSERT(token->isValid());
+	CPPUNIT_ASSERT(token->getObjects().size() == 2);
+	CPPUNIT_ASSERT(findObject(token, label1) != NULL);
+	CPPUNIT_ASSERT(findObject(token, label2) != NULL);
+
+	delete token;
+}
+
+void LogTokenTests::testCompaction()
+{
+	ByteString label1 = "0102";
+
+	LogToken* token = LogToken::createToken("./testdir", "newToken", ByteString("40414243"), ByteString("0102030405060708"));
+
+	CPPUNIT_ASSERT(token != NULL);
+
+	OSObject* object = createObject(token, label1);
+	std::string firstLog = currentLog();
+
+	// Supersede the record of the object until the log is compacted
+	for (unsigned long i = 1; i <= 0x400; i++)
+	{
+		CPPUNIT_ASSERT(object->setAttribute(CKA_VALUE_LEN, OSAttribute(i)));
+	}
+
+	CPPUNIT_ASSERT(currentLog() != firstLog);
+
+	delete token;
+
+	token = LogToken::accessToken("./testdir", "newToken");
+
+	CPPUNIT_ASSERT(token->isValid());
+	CPPUNIT_ASSERT(token->getObjects().size() == 1);
+
+	object = findObject(token, label1);
+
+	CPPUNIT_ASSERT(object != NULL);
+	CPPUNIT_ASSERT(object->getUnsignedLongValue(CKA_VALUE_LEN, 0) == 0x400);
+
+	delete token;
+}
+
+void LogTokenTests::testMigration()
+{
+	ByteString tokenLabel = "40414243";
+	ByteString tokenSerial = "0102030405060708";
+	ByteString soPIN = "3132333435363738";
+	ByteString userPIN = "4142434445464748";
+	ByteString label1 = "0102";
+
+	OSToken* fileToken = OSToken::createToken("./testdir", "newToken", tokenLabel, tokenSerial);
+
+	CPPUNIT_ASSERT(fileToken != NULL);
+	CPPUNIT_ASSERT(fileToken->setSOPIN(soPIN));
+	CPPUNIT_ASSERT(fileToken->setUserPIN(userPIN));
+
+	OSObject* fileObject = fileToken->createObject();
+
+	CPPUNIT_ASSERT(fileObject != NULL);
+	CPPUNIT_ASSERT(fileObject->setAttribute(CKA_LABEL, OSAttribute(label1)));
+	CPPUNIT_ASSERT(fileObject->setAttribute(CKA_VALUE_LEN, OSAttribute((unsigned long) 16)));
+
+	delete fileToken;
+
+	LogToken* token = LogToken::accessToken("./testdir", "newToken");
+
+	CPPUNIT_ASSERT(token->isValid());
+	CPPUNIT_ASSERT(!currentLog().empty());
+
+	ByteString retrieved;
+
+	CPPUNIT_ASSERT(token->getTokenLabel(retrieved) && retrieved == tokenLabel);
+	CPPUNIT_ASSERT(token->getTokenSerial(retrieved) && retrieved == tokenSerial);
+	CPPUNIT_ASSERT(token->getSOPIN(retrieved) && retrieved == soPIN);
+	CPPUNIT_ASSERT(token->getUserPIN(retrieved) && retrieved == userPIN);
+	CPPUNIT_ASSERT(token->getObjects().size() == 1);
+
+	OSObject* object = findObject(token, label1);
+
+	CPPUNIT_ASSERT(object != NULL);
+	CPPUNIT_ASSERT(object->getUnsignedLongValue(CKA_VALUE_LEN, 0) == 16);
+	CPPUNIT_ASSERT(object->setAttribute(CKA_VALUE_LEN, OSAttribute((unsigned long) 32)));
+
+	delete token;
+
+	// The log takes precedence over the object files left in place
+	token = LogToken::accessToken("./testdir", "newToken");
+
+	CPPUNIT_ASSERT(token->isValid());
+	CPPUNIT_ASSERT(token->getObjects().size() == 1);
+	CPPUNIT_ASSERT(findObject(token, label1)->getUnsignedLongValue(CKA_VALUE_LEN, 0) == 32);
+
+	delete token;
+}
+
+void LogTokenTests::testBatchAtomicity()
+{
+	ByteString label1 = "0102";
+	ByteString label2 = "0304";
+	ByteString label3 = "0506";
+
+	LogToken* token = LogToken::createToken("./testdir", "newToken", ByteString("40414243"), ByteString("0102030405060708"));
+
+	CPPUNIT_ASSERT(token != NULL);
+
+	OSObject* object1 = createObject(token, label1);
+	OSObject* object3 = createObject(token, label3);
+
+	CPPUNIT_ASSERT(object3->setAttribute(CKA_VALUE_LEN, OSAttribute((unsigned long) 3)));
+
+	// Nothing of a batch reaches the log before its outermost commit
+	CPPUNIT_ASSERT(token->startBatch());
+	CPPUNIT_ASSERT(token->startBatch());
+	CPPUNIT_ASSERT(object1->setAttribute(CKA_VALUE_LEN, OSAttribute((unsigned long) 1)));
+	OSObject* object2 = createObject(token, label2);
+	CPPUNIT_ASSERT(object2->setAttribute(CKA_VALUE_LEN, OSAttribute((unsigned long) 2)));
+	CPPUNIT_ASSERT(object3->destroyObject());
+	CPPUNIT_ASSERT(token->commitBatch());
+
+	CPPUNIT_ASSERT(persistedValue(label1) == 0);
+	CPPUNIT_ASSERT(persistedValue(label2) == 0);
+	CPPUNIT_ASSERT(persistedValue(label3) == 3);
+
+	CPPUNIT_ASSERT(token->commitBatch());
+
+	CPPUNIT_ASSERT(persistedValue(label1) == 1);
+	CPPUNIT_ASSERT(persistedValue(label2) == 2);
+	CPPUNIT_ASSERT(persistedValue(label3) == 0);
+
+	// There is no batch left to commit
+	CPPUNIT_ASSERT(!token->commitBatch());
+
+	delete token;
+}
+
+struct BatchIsolationJob
+{
+	LogToken* token;
+	OSObject* object;
+	bool directOK;
+	bool directPersisted;
+	bool batchOK;
+	bool batchPersisted;
+	bool foreignCommit;
+	ByteString label;
+};
+
+// Update an object while another thread has a batch open
+static void* batchIsolationWorker(void* arg)
+{
+	BatchIsolationJob* job = (BatchIsolationJob*) arg;
+
+	// Not part of the open batch of the other thread
+	job->directOK = job->object->setAttribute(CKA_VALUE_LEN, OSAttribute((unsigned long) 2));
+	job->directPersisted = (persistedValue(job->label) == 2);
+
+	// The batch of the other thread cannot be committed from here
+	job->foreignCommit = job->token->commitBatch();
+
+	// A batch of its own is committed independently
+	job->batchOK = job->token->startBatch() &&
+	               job->object->setAttribute(CKA_VALUE_LEN, OSAttribute((unsigned long) 3)) &&
+	               job->token->commitBatch();
+	job->batchPersisted = (persistedValue(job->label) == 3);
+
+	return NULL;
+}
+
+void LogTokenTests::testBatchIsolation()
+{
+	ByteString label1 = "0102";
+	ByteString label2 = "0304";
+
+	LogToken* token = LogToken::createToken("./testdir", "newToken", ByteString("40414243"), ByteString("0102030405060708"));
+
+	CPPUNIT_ASSERT(token != NULL);
+
+	OSObject* object1 = createObject(token, label1);
+	OSObject* object2 = createObject(token, label2);
+
+	CPPUNIT_ASSERT(token->startBatch());
+	CPPUNIT_ASSERT(object1->setAttribute(CKA_VALUE_LEN, OSAttribute((unsigned long) 1)));
+
+	BatchIsolationJob job;
+	pthread_t thread;
+
+	job.token = token;
+	job.object = object2;
+	job.label = label2;
+
+	CPPUNIT_ASSERT(!pthread_create(&thread, NULL, batchIsolationWorker, &job));
+	CPPUNIT_ASSERT(!pthread_join(thread, NULL));
+
+	CPPUNIT_ASSERT(job.directOK);
+	CPPUNIT_ASSERT(job.directPersisted);
+	CPPUNIT_ASSERT(!job.foreignCommit);
+	CPPUNIT_ASSERT(job.batchOK);
+	CPPUNIT_ASSERT(job.batchPersisted);
+
+	// The open batch is still held back
+	CPPUNIT_ASSERT(persistedValue(label1) == 0);
+
+	CPPUNIT_ASSERT(token->commitBatch());
+
+	CPPUNIT_ASSERT(persistedValue(label1) == 1);
+	CPPUNIT_ASSERT(persistedValue(label2) == 3);
+
+	delete token;
+}
+
+void LogTokenTests::testMissingLog()
+{
+	ByteString label1 = "0102";
+
+	LogToken* token = LogToken::createToken("./testdir", "newToken", ByteString("40414243"), ByteString("0102030405060708"));
+
+	CPPUNIT_ASSERT(token != NULL);
+
+	OSObject* object = createObject(token, label1);
+
+	Directory tokenDir(TOKEN_PATH);
+
+	CPPUNIT_ASSERT(tokenDir.remove(currentLog()));
+
+	// A new snapshot is written instead of a log without header
+	CPPUNIT_ASSERT(object->setAttribute(CKA_VALUE_LEN, OSAttribute((unsigned long) 5)));
+
+	delete token;
+
+	token = LogToken::accessToken("./testdir", "newToken");
+
+	CPPUNIT_ASSERT(token->isValid());
+	CPPUNIT_ASSERT(token->getObjects().size() == 1);
+	CPPUNIT_ASSERT(findObject(token, label1)->getUnsignedLongValue(CKA_VALUE_LEN, 0) == 5);
+
+	delete token;
+}
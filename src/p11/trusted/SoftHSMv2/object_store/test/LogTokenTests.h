@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*****************************************************************************
+ LogTokenTests.h
+
+ Contains test cases to test the log-structured token class
+ *****************************************************************************/
+
+#ifndef _SOFTHSM_V2_LOGTOKENTESTS_H
+#define _SOFTHSM_V2_LOGTOKENTESTS_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+
+class LogTokenTests : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(LogTokenTests);
+	CPPUNIT_TEST(testReplay);
+	CPPUNIT_TEST(testTornTail);
+	CPPUNIT_TEST(testCompaction);
+	CPPUNIT_TEST(testMigration);
+	CPPUNIT_TEST(testBatchAtomicity);
+	CPPUNIT_TEST(testBatchIsolation);
+	CPPUNIT_TEST(testMissingLog);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void testReplay();
+	void testTornTail();
+	void testCompaction();
+	void testMigration();
+	void testBatchAtomicity();
+	void testBatchIsolation();
+	void testMissingLog();
+
+	void setUp();
+	void tearDown();
+
+private:
+	// Return the name of the single log in the token directory
+	std::string currentLog();
+};
+
+#endif // !_SOFTHSM_V2_LOGTOKENTESTS_H
@@ -89,6 +89,7 @@ Session::Session(Slot* inSlot, bool inIsReadWrite, CK_VOID_PTR inPApplication, C
 	publicKey = NULL;
 	privateKey = NULL;
 	symmetricKey = NULL;
+	macKey = NULL;
 	param = NULL;
 	paramLen = 0;
 }
@@ -116,6 +117,7 @@ Session::Session()
 	publicKey = NULL;
 	privateKey = NULL;
 	symmetricKey = NULL;
+	macKey = NULL;
 	param = NULL;
 	paramLen = 0;
 }
@@ -224,17 +226,18 @@ void Session::resetOp()
 		paramLen = 0;
 	}
 
+	// A dual-function operation holds two of the operators below
 	if (digestOp != NULL)
 	{
 		CryptoFactory::i()->recycleHashAlgorithm(digestOp);
 		digestOp = NULL;
 	}
-	else if (findOp != NULL)
+	if (findOp != NULL)
 	{
 		findOp->recycle();
 		findOp = NULL;
 	}
-	else if (asymmetricCryptoOp != NULL)
+	if (asymmetricCryptoOp != NULL)
 	{
 		if (publicKey != NULL)
 		{
@@ -249,7 +252,7 @@ void Session::resetOp()
 		CryptoFactory::i()->recycleAsymmetricAlgorithm(asymmetricCryptoOp);
 		asymmetricCryptoOp = NULL;
 	}
-	else if (symmetricCryptoOp != NULL)
+	if (symmetricCryptoOp != NULL)
 	{
 		if (symmetricKey != NULL)
 		{
@@ -259,12 +262,12 @@ void Session::resetOp()
 		CryptoFactory::i()->recycleSymmetricAlgorithm(symmetricCryptoOp);
 		symmetricCryptoOp = NULL;
 	}
-	else if (macOp != NULL)
+	if (macOp != NULL)
 	{
-		if (symmetricKey != NULL)
+		if (macKey != NULL)
 		{
-			macOp->recycleKey(symmetricKey);
-			symmetricKey = NULL;
+			macOp->recycleKey(macKey);
+			macKey = NULL;
 		}
 		CryptoFactory::i()->recycleMacAlgorithm(macOp);
 		macOp = NULL;
@@ -274,6 +277,65 @@ void Session::resetOp()
 	reAuthentication = false;
 }
 
+// Finish the digest half of a dual-function operation
+void Session::finishDigestOp()
+{
+	switch (operation)
+	{
+		case SESSION_OP_DIGEST_ENCRYPT:
+			setDigestOp(NULL);
+			operation = SESSION_OP_ENCRYPT;
+			break;
+		case SESSION_OP_DECRYPT_DIGEST:
+			setDigestOp(NULL);
+			operation = SESSION_OP_DECRYPT;
+			break;
+		default:
+			resetOp();
+	}
+}
+
+// Finish the cipher half of a dual-function operation
+void Session::finishSymmetricCryptoOp()
+{
+	switch (operation)
+	{
+		case SESSION_OP_DIGEST_ENCRYPT:
+		case SESSION_OP_DECRYPT_DIGEST:
+			setSymmetricCryptoOp(NULL);
+			operation = SESSION_OP_DIGEST;
+			break;
+		case SESSION_OP_SIGN_ENCRYPT:
+			setSymmetricCryptoOp(NULL);
+			operation = SESSION_OP_SIGN;
+			break;
+		case SESSION_OP_DECRYPT_VERIFY:
+			setSymmetricCryptoOp(NULL);
+			operation = SESSION_OP_VERIFY;
+			break;
+		default:
+			resetOp();
+	}
+}
+
+// Finish the MAC half of a dual-function operation
+void Session::finishMacOp()
+{
+	switch (operation)
+	{
+		case SESSION_OP_SIGN_ENCRYPT:
+			setMacOp(NULL);
+			operation = SESSION_OP_ENCRYPT;
+			break;
+		case SESSION_OP_DECRYPT_VERIFY:
+			setMacOp(NULL);
+			operation = SESSION_OP_DECRYPT;
+			break;
+		default:
+			resetOp();
+	}
+}
+
 void Session::setFindOp(FindOperation *inFindOp)
 {
 	if (findOp != NULL) {
@@ -319,7 +381,7 @@ void Session::setMacOp(MacAlgorithm *inMacOp)
 {
 	if (macOp != NULL)
 	{
-		setSymmetricKey(NULL);
+		setMacKey(NULL);
 		CryptoFactory::i()->recycleMacAlgorithm(macOp);
 	}
 
@@ -469,9 +531,7 @@ void Session::setSymmetricKey(SymmetricKey* inSymmetricKey)
 {
 	if (symmetricKey != NULL)
 	{
-		if (macOp) {
-			macOp->recycleKey(symmetricKey);
-		} else if (symmetricCryptoOp) {
+		if (symmetricCryptoOp) {
 			symmetricCryptoOp->recycleKey(symmetricKey);
 		} else {
 			return;
@@ -485,3 +545,22 @@ SymmetricKey* Session::getSymmetricKey()
 {
 	return symmetricKey;
 }
+
+void Session::setMacKey(SymmetricKey* inMacKey)
+{
+	if (macKey != NULL)
+	{
+		if (macOp) {
+			macOp->recycleKey(macKey);
+		} else {
+			return;
+		}
+	}
+
+	macKey = inMacKey;
+}
+
+SymmetricKey* Session::getMacKey()
+{
+	return macKey;
+}
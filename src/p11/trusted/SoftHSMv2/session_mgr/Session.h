@@ -84,6 +84,10 @@
 #define SESSION_OP_DECRYPT_DIGEST	0x8
 #define SESSION_OP_SIGN_ENCRYPT		0x9
 #define SESSION_OP_DECRYPT_VERIFY	0x10
+#define SESSION_OP_MESSAGE_ENCRYPT	0x11
+#define SESSION_OP_MESSAGE_DECRYPT	0x12
+#define SESSION_OP_MESSAGE_SIGN		0x13
+#define SESSION_OP_MESSAGE_VERIFY	0x14
 
 class Session
 {
@@ -113,6 +117,11 @@ public:
 	void setOpType(int inOperation);
 	void resetOp();
 
+	// Dual-function operations; finishing one half leaves the other running
+	void finishDigestOp();
+	void finishSymmetricCryptoOp();
+	void finishMacOp();
+
 	// Find
 	void setFindOp(FindOperation *inFindOp);
 	FindOperation *getFindOp();
@@ -159,6 +168,9 @@ public:
 	void setSymmetricKey(SymmetricKey* inSymmetricKey);
 	SymmetricKey* getSymmetricKey();
 
+	void setMacKey(SymmetricKey* inMacKey);
+	SymmetricKey* getMacKey();
+
 private:
 	// Constructor
 	Session();
@@ -205,6 +217,9 @@ private:
 
 	// Symmetric Crypto
 	SymmetricKey* symmetricKey;
+
+	// Mac
+	SymmetricKey* macKey;
 };
 
 #endif // !_SOFTHSM_V2_SESSION_H
@@ -61,6 +61,7 @@
 #include "OSAttribute.h"
 #include "ByteString.h"
 #include "SecureDataManager.h"
+#include "CryptoFactory.h"
 #include <mbusafecrt.h>
 //#include <cstdio>
 
@@ -207,6 +208,10 @@ CK_RV Token::loginUser(ByteString& pin)
 
 	flags &= ~CKF_USER_PIN_COUNT_LOW;
 	token->setTokenFlags(flags);
+
+	// Objects from before the blind indexes get theirs now, not by a search
+	backfillBlindIndexes();
+
 	return CKR_OK;
 }
 
@@ -273,6 +278,9 @@ void Token::logout()
 	if (sdm == NULL) return;
 
 	sdm->logout();
+
+	// Wipe the key state that was kept for the objects of the token
+	CryptoFactory::i()->forgetKeyStates(NULL);
 }
 
 // Change SO PIN
@@ -508,6 +516,9 @@ CK_RV Token::getTokenInfo(CK_TOKEN_INFO_PTR info)
 			return CKR_GENERAL_ERROR;
 		}
 
+		// Symmetric ciphers pair up with digests and MACs on every token
+		info->flags |= CKF_DUAL_CRYPTO_OPERATIONS;
+
 		if (token->getTokenLabel(label))
 		{
             if(memcpy_s((char*) info->label, sizeof(info->label), (char*) label.byte_str(), label.size()))
@@ -589,6 +600,27 @@ void Token::getObjects(std::set<OSObject *> &objects)
 	token->getObjects(objects);
 }
 
+bool Token::findObjects(CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, std::set<OSObject *> &objects, const std::map<CK_ATTRIBUTE_TYPE, ByteString>* blindMACs /* = NULL */)
+{
+	return token->findObjects(pTemplate, ulCount, objects, blindMACs);
+}
+
+// Group the following token object updates into one store commit
+bool Token::startBatch()
+{
+	return token->startBatch();
+}
+
+bool Token::commitBatch()
+{
+	return token->commitBatch();
+}
+
+bool Token::abortBatch()
+{
+	return token->abortBatch();
+}
+
 bool Token::decrypt(const ByteString &encrypted, ByteString &plaintext)
 {
 	// Lock access to the token
@@ -608,3 +640,86 @@ bool Token::encrypt(const ByteString &plaintext, ByteString &encrypted)
 
 	return sdm->encrypt(plaintext,encrypted);
 }
+
+bool Token::blindIndexMAC(CK_ATTRIBUTE_TYPE type, const ByteString &plaintext, ByteString &mac)
+{
+	// The MAC covers the attribute type, so equal values of different
+	// attributes do not share a blind index
+	// Lock access to the token
+	MutexLocker lock(tokenMutex);
+
+	return computeBlindIndexMAC(type, plaintext, mac);
+}
+
+// Compute the MAC of a blind index; the caller holds the token mutex
+bool Token::computeBlindIndexMAC(CK_ATTRIBUTE_TYPE type, const ByteString &plaintext, ByteString &mac)
+{
+	ByteString data;
+	CK_ULONG ulType = type;
+
+	data += ByteString((const unsigned char*)&ulType, sizeof(ulType));
+	data += plaintext;
+
+	if (sdm == NULL) return false;
+
+	return sdm->blindIndex(data,mac);
+}
+
+// Store the missing blind indexes of the private token objects; the caller
+// holds the token mutex and the user is logged in
+void Token::backfillBlindIndexes()
+{
+	const CK_ATTRIBUTE_TYPE types[] = { CKA_ID, CKA_LABEL };
+	std::set<OSObject*> objects;
+
+	token->getObjects(objects);
+
+	if (!token->startBatch()) return;
+
+	for (std::set<OSObject*>::iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		OSObject* object = *i;
+
+		if (!object->isValid() || !object->getBooleanValue(CKA_PRIVATE, true)) continue;
+
+		for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+		{
+			CK_ATTRIBUTE_TYPE blindType;
+
+			if (!ObjectIndex::getBlindIndexType(types[t], blindType) ||
+			    !object->attributeExists(types[t]))
+				continue;
+
+			ByteString encrypted = object->getByteStringValue(types[t]);
+			if (encrypted.size() == 0) continue;
+
+			// Keep a blind index that belongs to the current value
+			ByteString mac;
+			if (object->attributeExists(blindType) &&
+			    ObjectIndex::getBlindIndexMAC(object->getByteStringValue(blindType), encrypted, mac))
+				continue;
+
+			ByteString plaintext;
+			if (!sdm->decrypt(encrypted, plaintext) ||
+			    !computeBlindIndexMAC(types[t], plaintext, mac))
+				continue;
+
+			(void) object->setAttribute(blindType, ObjectIndex::makeBlindIndex(mac, encrypted));
+		}
+	}
+
+	(void) token->commitBatch();
+}
+
+bool Token::setBlindIndex(OSObject *object, CK_ATTRIBUTE_TYPE type, const ByteString &plaintext, const ByteString &encrypted)
+{
+	CK_ATTRIBUTE_TYPE blindType;
+
+	if (!ObjectIndex::getBlindIndexType(type, blindType)) return true;
+
+	ByteString mac;
+
+	if (!blindIndexMAC(type, plaintext, mac)) return false;
+
+	return object->setAttribute(blindType, ObjectIndex::makeBlindIndex(mac, encrypted));
+}
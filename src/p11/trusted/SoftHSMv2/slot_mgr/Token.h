@@ -124,13 +124,37 @@ public:
 	// Insert all token objects into the given set.
 	void getObjects(std::set<OSObject *> &objects);
 
+	// Insert the token objects that may match the template into the given
+	// set; returns false if the token objects cannot be narrowed down
+	bool findObjects(CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount, std::set<OSObject *> &objects, const std::map<CK_ATTRIBUTE_TYPE, ByteString>* blindMACs = NULL);
+
+	// Group the following token object updates into one store commit
+	bool startBatch();
+	bool commitBatch();
+
+	// Drop the grouped updates; returns false if they were already stored
+	bool abortBatch();
+
 	// Decrypt the supplied data
 	bool decrypt(const ByteString& encrypted, ByteString& plaintext);
 
 	// Encrypt the supplied data
 	bool encrypt(const ByteString& plaintext, ByteString& encrypted);
 
+	// Compute the MAC of the blind index of a byte string attribute
+	bool blindIndexMAC(CK_ATTRIBUTE_TYPE type, const ByteString& plaintext, ByteString& mac);
+
+	// Compute the blind index of a byte string attribute that was encrypted
+	// and store it in the object; does nothing for attributes without one
+	bool setBlindIndex(OSObject* object, CK_ATTRIBUTE_TYPE type, const ByteString& plaintext, const ByteString& encrypted);
+
 private:
+	// Compute the MAC of a blind index; the caller holds the token mutex
+	bool computeBlindIndexMAC(CK_ATTRIBUTE_TYPE type, const ByteString& plaintext, ByteString& mac);
+
+	// Store the missing blind indexes of the private token objects
+	void backfillBlindIndexes();
+
 	// Token validity
 	bool valid;
 
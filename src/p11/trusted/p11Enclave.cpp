@@ -42,7 +42,7 @@
 void configure()
 {
     Configuration::i()->setString(TOKENDIR_CONFIGSTR, DEFAULT_TOKENDIR);
-    Configuration::i()->setString(OBJECTSTORE_CONFIGSTR, "file");
+    Configuration::i()->setString(OBJECTSTORE_CONFIGSTR, DEFAULT_OBJECTSTORE_BACKEND);
     Configuration::i()->setBool(SLOTREMOVABLE_CONFIGSTR, false);
 }
 
@@ -163,6 +163,78 @@ CK_RV sgx_C_DecryptFinal(CK_SESSION_HANDLE hSession,
     return C_DecryptFinal(hSession, pData, pDataLen);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_MessageEncryptInit(CK_SESSION_HANDLE hSession,
+                               CK_MECHANISM_PTR  pMechanism,
+                               CK_OBJECT_HANDLE  hKey)
+{
+    return C_MessageEncryptInit(hSession, pMechanism, hKey);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_EncryptMessage(CK_SESSION_HANDLE hSession,
+                           CK_VOID_PTR       pParameter,
+                           CK_ULONG          ulParameterLen,
+                           CK_BYTE_PTR       pAssociatedData,
+                           CK_ULONG          ulAssociatedDataLen,
+                           CK_BYTE_PTR       pPlaintext,
+                           CK_ULONG          ulPlaintextLen,
+                           CK_BYTE_PTR       pCiphertext,
+                           CK_ULONG_PTR      pulCiphertextLen)
+{
+    return C_EncryptMessage(hSession, pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen, pPlaintext, ulPlaintextLen, pCiphertext, pulCiphertextLen);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_EncryptMessageBatch(CK_SESSION_HANDLE         hSession,
+                                CK_MESSAGE_BATCH_ITEM_PTR pItems,
+                                CK_ULONG                  ulCount)
+{
+    return C_EncryptMessageBatch(hSession, pItems, ulCount);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_MessageEncryptFinal(CK_SESSION_HANDLE hSession)
+{
+    return C_MessageEncryptFinal(hSession);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_MessageDecryptInit(CK_SESSION_HANDLE hSession,
+                               CK_MECHANISM_PTR  pMechanism,
+                               CK_OBJECT_HANDLE  hKey)
+{
+    return C_MessageDecryptInit(hSession, pMechanism, hKey);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_DecryptMessage(CK_SESSION_HANDLE hSession,
+                           CK_VOID_PTR       pParameter,
+                           CK_ULONG          ulParameterLen,
+                           CK_BYTE_PTR       pAssociatedData,
+                           CK_ULONG          ulAssociatedDataLen,
+                           CK_BYTE_PTR       pCiphertext,
+                           CK_ULONG          ulCiphertextLen,
+                           CK_BYTE_PTR       pPlaintext,
+                           CK_ULONG_PTR      pulPlaintextLen)
+{
+    return C_DecryptMessage(hSession, pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen, pCiphertext, ulCiphertextLen, pPlaintext, pulPlaintextLen);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_DecryptMessageBatch(CK_SESSION_HANDLE         hSession,
+                                CK_MESSAGE_BATCH_ITEM_PTR pItems,
+                                CK_ULONG                  ulCount)
+{
+    return C_DecryptMessageBatch(hSession, pItems, ulCount);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_MessageDecryptFinal(CK_SESSION_HANDLE hSession)
+{
+    return C_MessageDecryptFinal(hSession);
+}
+
 //---------------------------------------------------------------------------------------------
 CK_RV sgx_C_DigestInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism)
 {
@@ -196,6 +268,15 @@ CK_RV sgx_C_DigestFinal(CK_SESSION_HANDLE hSession,
     return C_DigestFinal(hSession, pDigest,pulDigestLen);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_DigestBatch(CK_SESSION_HANDLE        hSession,
+                        CK_MECHANISM_PTR         pMechanism,
+                        CK_DIGEST_BATCH_ITEM_PTR pItems,
+                        CK_ULONG                 ulCount)
+{
+    return C_DigestBatch(hSession, pMechanism, pItems, ulCount);
+}
+
 //---------------------------------------------------------------------------------------------
 CK_RV sgx_C_SignInit(CK_SESSION_HANDLE hSession,
                      CK_MECHANISM_PTR  pMechanism,
@@ -287,6 +368,38 @@ CK_RV sgx_C_UnwrapKey(CK_SESSION_HANDLE    hSession,
                        pTemplate, ulCount, hKey);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_WrapKeyBatch(CK_SESSION_HANDLE      hSession,
+                         CK_MECHANISM_PTR       pMechanism,
+                         CK_OBJECT_HANDLE       hWrappingKey,
+                         CK_WRAP_BATCH_ITEM_PTR pItems,
+                         CK_ULONG               ulCount)
+{
+    return C_WrapKeyBatch(hSession, pMechanism, hWrappingKey, pItems, ulCount);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_UnwrapKeyBatch(CK_SESSION_HANDLE        hSession,
+                           CK_MECHANISM_PTR         pMechanism,
+                           CK_OBJECT_HANDLE         hUnwrappingKey,
+                           CK_UNWRAP_BATCH_ITEM_PTR pItems,
+                           CK_ULONG                 ulCount)
+{
+    return C_UnwrapKeyBatch(hSession, pMechanism, hUnwrappingKey, pItems, ulCount);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_DeriveKeyBatch(CK_SESSION_HANDLE        hSession,
+                           CK_MECHANISM_PTR         pMechanism,
+                           CK_OBJECT_HANDLE         hBaseKey,
+                           CK_ATTRIBUTE_PTR         pTemplate,
+                           CK_ULONG                 ulAttributeCount,
+                           CK_DERIVE_BATCH_ITEM_PTR pItems,
+                           CK_ULONG                 ulCount)
+{
+    return C_DeriveKeyBatch(hSession, pMechanism, hBaseKey, pTemplate, ulAttributeCount, pItems, ulCount);
+}
+
 //---------------------------------------------------------------------------------------------
 CK_RV sgx_C_GetTokenInfo(CK_SLOT_ID        slotID,
                          CK_TOKEN_INFO_PTR pInfo)
@@ -513,6 +626,24 @@ CK_RV sgx_C_SignFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULO
     return C_SignFinal(hSession, pSignature, pulSignatureLen);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_MessageSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    return C_MessageSignInit(hSession, pMechanism, hKey);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_SignMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+    return C_SignMessage(hSession, pParameter, ulParameterLen, pData, ulDataLen, pSignature, pulSignatureLen);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_MessageSignFinal(CK_SESSION_HANDLE hSession)
+{
+    return C_MessageSignFinal(hSession);
+}
+
 #if 0 // Unsupported by Crypto API Toolkit
 //---------------------------------------------------------------------------------------------
 CK_RV sgx_C_SignRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
@@ -539,6 +670,32 @@ CK_RV sgx_C_VerifyFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_U
     return C_VerifyFinal(hSession, pSignature, ulSignatureLen);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_MessageVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    return C_MessageVerifyInit(hSession, pMechanism, hKey);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_VerifyMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
+{
+    return C_VerifyMessage(hSession, pParameter, ulParameterLen, pData, ulDataLen, pSignature, ulSignatureLen);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_MessageVerifyFinal(CK_SESSION_HANDLE hSession)
+{
+    return C_MessageVerifyFinal(hSession);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_VerifyBatch(CK_SESSION_HANDLE        hSession,
+                        CK_VERIFY_BATCH_ITEM_PTR pItems,
+                        CK_ULONG                 ulCount)
+{
+    return C_VerifyBatch(hSession, pItems, ulCount);
+}
+
 #if 0 // Unsupported by Crypto API Toolkit
 //---------------------------------------------------------------------------------------------
 CK_RV sgx_C_VerifyRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
@@ -595,6 +752,12 @@ CK_RV sgx_C_GenerateRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pRandomData,
     return C_GenerateRandom(hSession, pRandomData, ulRandomLen);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV sgx_C_PrecomputePools(CK_ULONG ulMaxCount, CK_ULONG_PTR pulCount)
+{
+    return C_PrecomputePools(ulMaxCount, pulCount);
+}
+
 #if 0 // Unsupported by Crypto API Toolkit
 //---------------------------------------------------------------------------------------------
 CK_RV sgx_C_CancelFunction(CK_SESSION_HANDLE hSession)
@@ -101,4 +101,72 @@ CK_RV decryptFinal(CK_SESSION_HANDLE hSession,
     return EnclaveInterface::decryptFinal(hSession,
                                        pData,
                                        pDataLen);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV messageDecryptInit(CK_SESSION_HANDLE hSession,
+                         CK_MECHANISM_PTR  pMechanism,
+                         CK_OBJECT_HANDLE  hKey)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::messageDecryptInit(hSession,
+                                                pMechanism,
+                                                hKey);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV decryptMessage(CK_SESSION_HANDLE hSession,
+                     CK_VOID_PTR       pParameter,
+                     CK_ULONG          ulParameterLen,
+                     CK_BYTE_PTR       pAssociatedData,
+                     CK_ULONG          ulAssociatedDataLen,
+                     CK_BYTE_PTR       pCiphertext,
+                     CK_ULONG          ulCiphertextLen,
+                     CK_BYTE_PTR       pPlaintext,
+                     CK_ULONG_PTR      pulPlaintextLen)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::decryptMessage(hSession,
+                                            pParameter,
+                                            ulParameterLen,
+                                            pAssociatedData,
+                                            ulAssociatedDataLen,
+                                            pCiphertext,
+                                            ulCiphertextLen,
+                                            pPlaintext,
+                                            pulPlaintextLen);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV decryptMessageBatch(CK_SESSION_HANDLE         hSession,
+                          CK_MESSAGE_BATCH_ITEM_PTR pItems,
+                          CK_ULONG                  ulCount)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::decryptMessageBatch(hSession,
+                                                 pItems,
+                                                 ulCount);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV messageDecryptFinal(CK_SESSION_HANDLE hSession)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::messageDecryptFinal(hSession);
 }
\ No newline at end of file
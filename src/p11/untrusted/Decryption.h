@@ -33,6 +33,7 @@
 #define DECRYPTION_H
 
 #include "cryptoki.h"
+#include "VendorDefs.h"
 
 //---------------------------------------------------------------------------------------------
 /**
@@ -91,4 +92,60 @@ CK_RV decryptFinal(CK_SESSION_HANDLE hSession,
                    CK_BYTE_PTR       pData,
                    CK_ULONG_PTR      pDataLen);
 
+//---------------------------------------------------------------------------------------------
+/**
+* Initializes a message-based decryption process; the key is set up once for all messages.
+* @param   hSession   The session handle.
+* @param   pMechanism Pointer to CK_MECHANISM structure.
+* @param   hKey       The key handle to be used for decryption.
+* @return  CK_RV      CKR_OK if messageDecryptInit is successful, error code otherwise
+*/
+CK_RV messageDecryptInit(CK_SESSION_HANDLE hSession,
+                         CK_MECHANISM_PTR  pMechanism,
+                         CK_OBJECT_HANDLE  hKey);
+
+//---------------------------------------------------------------------------------------------
+/**
+* Decrypts one message with its own IV, associated data and tag.
+* @param   hSession            The session handle.
+* @param   pParameter          Pointer to the per-message parameters (CK_GCM_MESSAGE_PARAMS).
+* @param   ulParameterLen      The size of the per-message parameters.
+* @param   pAssociatedData     Pointer to the associated data.
+* @param   ulAssociatedDataLen The size of the associated data.
+* @param   pCiphertext         Pointer to data to be decrypted.
+* @param   ulCiphertextLen     The size of data to be decrypted.
+* @param   pPlaintext          Pointer where decrypted data is to be populated.
+* @param   pulPlaintextLen     Pointer to size of decrypted data.
+* @return  CK_RV               CKR_OK if decryptMessage is successful, error code otherwise
+*/
+CK_RV decryptMessage(CK_SESSION_HANDLE hSession,
+                     CK_VOID_PTR       pParameter,
+                     CK_ULONG          ulParameterLen,
+                     CK_BYTE_PTR       pAssociatedData,
+                     CK_ULONG          ulAssociatedDataLen,
+                     CK_BYTE_PTR       pCiphertext,
+                     CK_ULONG          ulCiphertextLen,
+                     CK_BYTE_PTR       pPlaintext,
+                     CK_ULONG_PTR      pulPlaintextLen);
+
+//---------------------------------------------------------------------------------------------
+/**
+* Decrypts a batch of messages of an active message-based operation in one call.
+* @param   hSession The session handle.
+* @param   pItems   Pointer to the messages; each item receives its output length and result.
+* @param   ulCount  The number of messages.
+* @return  CK_RV    CKR_OK if every message succeeded, the result of the first failed message otherwise
+*/
+CK_RV decryptMessageBatch(CK_SESSION_HANDLE         hSession,
+                          CK_MESSAGE_BATCH_ITEM_PTR pItems,
+                          CK_ULONG                  ulCount);
+
+//---------------------------------------------------------------------------------------------
+/**
+* Finalizes the message-based decryption process.
+* @param   hSession The session handle.
+* @return  CK_RV    CKR_OK if messageDecryptFinal is successful, error code otherwise
+*/
+CK_RV messageDecryptFinal(CK_SESSION_HANDLE hSession);
+
 #endif // DECRYPTION_H
\ No newline at end of file
@@ -96,3 +96,20 @@ CK_RV digestFinal(CK_SESSION_HANDLE hSession,
 
     return EnclaveInterface::digestFinal(hSession, pDigest, pulDigestLen);
 }
+
+//---------------------------------------------------------------------------------------------
+CK_RV digestBatch(CK_SESSION_HANDLE        hSession,
+                  CK_MECHANISM_PTR         pMechanism,
+                  CK_DIGEST_BATCH_ITEM_PTR pItems,
+                  CK_ULONG                 ulCount)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::digestBatch(hSession,
+                                         pMechanism,
+                                         pItems,
+                                         ulCount);
+}
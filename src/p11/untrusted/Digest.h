@@ -33,6 +33,7 @@
 #define DIGEST_H
 
 #include "cryptoki.h"
+#include "VendorDefs.h"
 
 //---------------------------------------------------------------------------------------------
 /**
@@ -86,4 +87,18 @@ CK_RV digestFinal(CK_SESSION_HANDLE hSession,
                   CK_BYTE_PTR       pDigest,
                   CK_ULONG_PTR      pulDigestLen);
 
+//---------------------------------------------------------------------------------------------
+/**
+* Digests a batch of records in one call, without an active digest operation.
+* @param   hSession   The session handle.
+* @param   pMechanism Pointer to the digest mechanism.
+* @param   pItems     Pointer to the records; each item receives its digest length and result.
+* @param   ulCount    The number of records.
+* @return  CK_RV      CKR_OK if every record was digested, the result of the first failed record otherwise
+*/
+CK_RV digestBatch(CK_SESSION_HANDLE        hSession,
+                  CK_MECHANISM_PTR         pMechanism,
+                  CK_DIGEST_BATCH_ITEM_PTR pItems,
+                  CK_ULONG                 ulCount);
+
 #endif //DIGEST_H
\ No newline at end of file
@@ -306,6 +306,166 @@ namespace EnclaveInterface
         return rv;
     }
 
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageEncryptInit(CK_SESSION_HANDLE hSession,
+                             CK_MECHANISM_PTR  pMechanism,
+                             CK_OBJECT_HANDLE  hKey)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_MessageEncryptInit(enclaveHelpers.getSgxEnclaveId(),
+                                             &rv,
+                                             hSession,
+                                             pMechanism,
+                                             hKey);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV encryptMessage(CK_SESSION_HANDLE hSession,
+                         CK_VOID_PTR       pParameter,
+                         CK_ULONG          ulParameterLen,
+                         CK_BYTE_PTR       pAssociatedData,
+                         CK_ULONG          ulAssociatedDataLen,
+                         CK_BYTE_PTR       pPlaintext,
+                         CK_ULONG          ulPlaintextLen,
+                         CK_BYTE_PTR       pCiphertext,
+                         CK_ULONG_PTR      pulCiphertextLen)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_EncryptMessage(enclaveHelpers.getSgxEnclaveId(),
+                                         &rv,
+                                         hSession,
+                                         pParameter,
+                                         ulParameterLen,
+                                         pAssociatedData,
+                                         ulAssociatedDataLen,
+                                         pPlaintext,
+                                         ulPlaintextLen,
+                                         pCiphertext,
+                                         pulCiphertextLen);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV encryptMessageBatch(CK_SESSION_HANDLE         hSession,
+                              CK_MESSAGE_BATCH_ITEM_PTR pItems,
+                              CK_ULONG                  ulCount)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_EncryptMessageBatch(enclaveHelpers.getSgxEnclaveId(),
+                                              &rv,
+                                              hSession,
+                                              pItems,
+                                              ulCount);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageEncryptFinal(CK_SESSION_HANDLE hSession)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_MessageEncryptFinal(enclaveHelpers.getSgxEnclaveId(),
+                                              &rv,
+                                              hSession);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageDecryptInit(CK_SESSION_HANDLE hSession,
+                             CK_MECHANISM_PTR  pMechanism,
+                             CK_OBJECT_HANDLE  hKey)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_MessageDecryptInit(enclaveHelpers.getSgxEnclaveId(),
+                                             &rv,
+                                             hSession,
+                                             pMechanism,
+                                             hKey);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV decryptMessage(CK_SESSION_HANDLE hSession,
+                         CK_VOID_PTR       pParameter,
+                         CK_ULONG          ulParameterLen,
+                         CK_BYTE_PTR       pAssociatedData,
+                         CK_ULONG          ulAssociatedDataLen,
+                         CK_BYTE_PTR       pCiphertext,
+                         CK_ULONG          ulCiphertextLen,
+                         CK_BYTE_PTR       pPlaintext,
+                         CK_ULONG_PTR      pulPlaintextLen)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_DecryptMessage(enclaveHelpers.getSgxEnclaveId(),
+                                         &rv,
+                                         hSession,
+                                         pParameter,
+                                         ulParameterLen,
+                                         pAssociatedData,
+                                         ulAssociatedDataLen,
+                                         pCiphertext,
+                                         ulCiphertextLen,
+                                         pPlaintext,
+                                         pulPlaintextLen);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV decryptMessageBatch(CK_SESSION_HANDLE         hSession,
+                              CK_MESSAGE_BATCH_ITEM_PTR pItems,
+                              CK_ULONG                  ulCount)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_DecryptMessageBatch(enclaveHelpers.getSgxEnclaveId(),
+                                              &rv,
+                                              hSession,
+                                              pItems,
+                                              ulCount);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageDecryptFinal(CK_SESSION_HANDLE hSession)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_MessageDecryptFinal(enclaveHelpers.getSgxEnclaveId(),
+                                              &rv,
+                                              hSession);
+
+        return rv;
+    }
+
     //---------------------------------------------------------------------------------------------
     CK_RV digestInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism)
     {
@@ -380,6 +540,26 @@ namespace EnclaveInterface
         return rv;
     }
 
+    //---------------------------------------------------------------------------------------------
+    CK_RV digestBatch(CK_SESSION_HANDLE        hSession,
+                      CK_MECHANISM_PTR         pMechanism,
+                      CK_DIGEST_BATCH_ITEM_PTR pItems,
+                      CK_ULONG                 ulCount)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_DigestBatch(enclaveHelpers.getSgxEnclaveId(),
+                                      &rv,
+                                      hSession,
+                                      pMechanism,
+                                      pItems,
+                                      ulCount);
+
+        return rv;
+    }
+
     //---------------------------------------------------------------------------------------------
     CK_RV signInit(CK_SESSION_HANDLE hSession,
                    CK_MECHANISM_PTR  pMechanism,
@@ -562,6 +742,76 @@ namespace EnclaveInterface
         return rv;
     }
 
+    //---------------------------------------------------------------------------------------------
+    CK_RV wrapKeyBatch(CK_SESSION_HANDLE      hSession,
+                       CK_MECHANISM_PTR       pMechanism,
+                       CK_OBJECT_HANDLE       hWrappingKey,
+                       CK_WRAP_BATCH_ITEM_PTR pItems,
+                       CK_ULONG               ulCount)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_WrapKeyBatch(enclaveHelpers.getSgxEnclaveId(),
+                                       &rv,
+                                       hSession,
+                                       pMechanism,
+                                       hWrappingKey,
+                                       pItems,
+                                       ulCount);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV unwrapKeyBatch(CK_SESSION_HANDLE        hSession,
+                         CK_MECHANISM_PTR         pMechanism,
+                         CK_OBJECT_HANDLE         hUnwrappingKey,
+                         CK_UNWRAP_BATCH_ITEM_PTR pItems,
+                         CK_ULONG                 ulCount)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_UnwrapKeyBatch(enclaveHelpers.getSgxEnclaveId(),
+                                         &rv,
+                                         hSession,
+                                         pMechanism,
+                                         hUnwrappingKey,
+                                         pItems,
+                                         ulCount);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV deriveKeyBatch(CK_SESSION_HANDLE        hSession,
+                         CK_MECHANISM_PTR         pMechanism,
+                         CK_OBJECT_HANDLE         hBaseKey,
+                         CK_ATTRIBUTE_PTR         pTemplate,
+                         CK_ULONG                 ulAttributeCount,
+                         CK_DERIVE_BATCH_ITEM_PTR pItems,
+                         CK_ULONG                 ulCount)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_DeriveKeyBatch(enclaveHelpers.getSgxEnclaveId(),
+                                         &rv,
+                                         hSession,
+                                         pMechanism,
+                                         hBaseKey,
+                                         pTemplate,
+                                         ulAttributeCount,
+                                         pItems,
+                                         ulCount);
+
+        return rv;
+    }
+
     //---------------------------------------------------------------------------------------------
     CK_RV getTokenInfo(CK_SLOT_ID        slotID,
                        CK_TOKEN_INFO_PTR pInfo)
@@ -1068,6 +1318,56 @@ namespace EnclaveInterface
         return rv;
     }
 
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_MessageSignInit(enclaveHelpers.getSgxEnclaveId(),
+                                          &rv,
+                                          hSession,
+                                          pMechanism,
+                                          hKey);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV signMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_SignMessage(enclaveHelpers.getSgxEnclaveId(),
+                                      &rv,
+                                      hSession,
+                                      pParameter,
+                                      ulParameterLen,
+                                      pData,
+                                      ulDataLen,
+                                      pSignature,
+                                      pulSignatureLen);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageSignFinal(CK_SESSION_HANDLE hSession)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_MessageSignFinal(enclaveHelpers.getSgxEnclaveId(),
+                                           &rv,
+                                           hSession);
+
+        return rv;
+    }
+
     //---------------------------------------------------------------------------------------------
     CK_RV signRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
     {
@@ -1138,6 +1438,74 @@ namespace EnclaveInterface
         return rv;
     }
 
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_MessageVerifyInit(enclaveHelpers.getSgxEnclaveId(),
+                                            &rv,
+                                            hSession,
+                                            pMechanism,
+                                            hKey);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV verifyMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_VerifyMessage(enclaveHelpers.getSgxEnclaveId(),
+                                        &rv,
+                                        hSession,
+                                        pParameter,
+                                        ulParameterLen,
+                                        pData,
+                                        ulDataLen,
+                                        pSignature,
+                                        ulSignatureLen);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageVerifyFinal(CK_SESSION_HANDLE hSession)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_MessageVerifyFinal(enclaveHelpers.getSgxEnclaveId(),
+                                             &rv,
+                                             hSession);
+
+        return rv;
+    }
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV verifyBatch(CK_SESSION_HANDLE        hSession,
+                      CK_VERIFY_BATCH_ITEM_PTR pItems,
+                      CK_ULONG                 ulCount)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_VerifyBatch(enclaveHelpers.getSgxEnclaveId(),
+                                      &rv,
+                                      hSession,
+                                      pItems,
+                                      ulCount);
+
+        return rv;
+    }
+
     //---------------------------------------------------------------------------------------------
     CK_RV verifyRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
     {
@@ -1179,8 +1547,7 @@ namespace EnclaveInterface
     //---------------------------------------------------------------------------------------------
     CK_RV digestEncryptUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen, CK_BYTE_PTR pEncryptedPart, CK_ULONG_PTR pulEncryptedPartLen)
     {
-        CK_RV rv = CKR_FUNCTION_NOT_SUPPORTED;
-#if 0 // Unsupported by Crypto API Toolkit
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
         sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
         P11Crypto::EnclaveHelpers enclaveHelpers;
 
@@ -1191,16 +1558,13 @@ namespace EnclaveInterface
                                               ulPartLen,
                                               pEncryptedPart,
                                               pulEncryptedPartLen);
-#endif // Unsupported by Crypto API Toolkit
-
         return rv;
     }
 
     //---------------------------------------------------------------------------------------------
     CK_RV decryptDigestUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen, CK_BYTE_PTR pDecryptedPart, CK_ULONG_PTR pulDecryptedPartLen)
     {
-        CK_RV rv = CKR_FUNCTION_NOT_SUPPORTED;
-#if 0 // Unsupported by Crypto API Toolkit
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
         sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
         P11Crypto::EnclaveHelpers enclaveHelpers;
 
@@ -1211,16 +1575,13 @@ namespace EnclaveInterface
                                               ulPartLen,
                                               pDecryptedPart,
                                               pulDecryptedPartLen);
-#endif // Unsupported by Crypto API Toolkit
-
         return rv;
     }
 
     //---------------------------------------------------------------------------------------------
     CK_RV signEncryptUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartLen, CK_BYTE_PTR pEncryptedPart, CK_ULONG_PTR pulEncryptedPartLen)
     {
-        CK_RV rv = CKR_FUNCTION_NOT_SUPPORTED;
-#if 0 // Unsupported by Crypto API Toolkit
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
         sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
         P11Crypto::EnclaveHelpers enclaveHelpers;
 
@@ -1231,16 +1592,13 @@ namespace EnclaveInterface
                                             ulPartLen,
                                             pEncryptedPart,
                                             pulEncryptedPartLen);
-#endif // Unsupported by Crypto API Toolkit
-
         return rv;
     }
 
     //---------------------------------------------------------------------------------------------
     CK_RV decryptVerifyUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pEncryptedPart, CK_ULONG ulEncryptedPartLen, CK_BYTE_PTR pPart, CK_ULONG_PTR pulPartLen)
     {
-        CK_RV rv = CKR_FUNCTION_NOT_SUPPORTED;
-#if 0 // Unsupported by Crypto API Toolkit
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
         sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
         P11Crypto::EnclaveHelpers enclaveHelpers;
 
@@ -1251,8 +1609,6 @@ namespace EnclaveInterface
                                               ulEncryptedPartLen,
                                               pPart,
                                               pulPartLen);
-#endif // Unsupported by Crypto API Toolkit
-
         return rv;
     }
 
@@ -1312,6 +1668,21 @@ namespace EnclaveInterface
         return rv;
     }
 
+    //---------------------------------------------------------------------------------------------
+    CK_RV precomputePools(CK_ULONG ulMaxCount, CK_ULONG_PTR pulCount)
+    {
+        CK_RV          rv            = CKR_FUNCTION_FAILED;
+        sgx_status_t   sgxStatus     = sgx_status_t::SGX_ERROR_UNEXPECTED;
+        P11Crypto::EnclaveHelpers enclaveHelpers;
+
+        sgxStatus = sgx_C_PrecomputePools(enclaveHelpers.getSgxEnclaveId(),
+                                          &rv,
+                                          ulMaxCount,
+                                          pulCount);
+
+        return rv;
+    }
+
     //---------------------------------------------------------------------------------------------
     CK_RV cancelFunction(CK_SESSION_HANDLE hSession)
     {
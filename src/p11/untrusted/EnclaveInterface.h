@@ -36,6 +36,7 @@
 #include <cstddef>
 
 #include "cryptoki.h"
+#include "VendorDefs.h"
 
 namespace EnclaveInterface
 {
@@ -107,6 +108,54 @@ namespace EnclaveInterface
                        CK_BYTE_PTR       pData,
                        CK_ULONG_PTR      pDataLen);
 
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageEncryptInit(CK_SESSION_HANDLE hSession,
+                             CK_MECHANISM_PTR  pMechanism,
+                             CK_OBJECT_HANDLE  hKey);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV encryptMessage(CK_SESSION_HANDLE hSession,
+                         CK_VOID_PTR       pParameter,
+                         CK_ULONG          ulParameterLen,
+                         CK_BYTE_PTR       pAssociatedData,
+                         CK_ULONG          ulAssociatedDataLen,
+                         CK_BYTE_PTR       pPlaintext,
+                         CK_ULONG          ulPlaintextLen,
+                         CK_BYTE_PTR       pCiphertext,
+                         CK_ULONG_PTR      pulCiphertextLen);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV encryptMessageBatch(CK_SESSION_HANDLE         hSession,
+                              CK_MESSAGE_BATCH_ITEM_PTR pItems,
+                              CK_ULONG                  ulCount);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageEncryptFinal(CK_SESSION_HANDLE hSession);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageDecryptInit(CK_SESSION_HANDLE hSession,
+                             CK_MECHANISM_PTR  pMechanism,
+                             CK_OBJECT_HANDLE  hKey);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV decryptMessage(CK_SESSION_HANDLE hSession,
+                         CK_VOID_PTR       pParameter,
+                         CK_ULONG          ulParameterLen,
+                         CK_BYTE_PTR       pAssociatedData,
+                         CK_ULONG          ulAssociatedDataLen,
+                         CK_BYTE_PTR       pCiphertext,
+                         CK_ULONG          ulCiphertextLen,
+                         CK_BYTE_PTR       pPlaintext,
+                         CK_ULONG_PTR      pulPlaintextLen);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV decryptMessageBatch(CK_SESSION_HANDLE         hSession,
+                              CK_MESSAGE_BATCH_ITEM_PTR pItems,
+                              CK_ULONG                  ulCount);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageDecryptFinal(CK_SESSION_HANDLE hSession);
+
     //---------------------------------------------------------------------------------------------
     CK_RV digestInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism);
 
@@ -128,6 +177,12 @@ namespace EnclaveInterface
                       CK_BYTE_PTR       pDigest,
                       CK_ULONG_PTR      pulDigestLen);
 
+    //---------------------------------------------------------------------------------------------
+    CK_RV digestBatch(CK_SESSION_HANDLE        hSession,
+                      CK_MECHANISM_PTR         pMechanism,
+                      CK_DIGEST_BATCH_ITEM_PTR pItems,
+                      CK_ULONG                 ulCount);
+
     //---------------------------------------------------------------------------------------------
     CK_RV signInit(CK_SESSION_HANDLE hSession,
                    CK_MECHANISM_PTR  pMechanism,
@@ -187,6 +242,29 @@ namespace EnclaveInterface
                     CK_ULONG             ulCount,
                     CK_OBJECT_HANDLE_PTR hKey);
 
+    //---------------------------------------------------------------------------------------------
+    CK_RV wrapKeyBatch(CK_SESSION_HANDLE      hSession,
+                       CK_MECHANISM_PTR       pMechanism,
+                       CK_OBJECT_HANDLE       hWrappingKey,
+                       CK_WRAP_BATCH_ITEM_PTR pItems,
+                       CK_ULONG               ulCount);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV unwrapKeyBatch(CK_SESSION_HANDLE        hSession,
+                         CK_MECHANISM_PTR         pMechanism,
+                         CK_OBJECT_HANDLE         hUnwrappingKey,
+                         CK_UNWRAP_BATCH_ITEM_PTR pItems,
+                         CK_ULONG                 ulCount);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV deriveKeyBatch(CK_SESSION_HANDLE        hSession,
+                         CK_MECHANISM_PTR         pMechanism,
+                         CK_OBJECT_HANDLE         hBaseKey,
+                         CK_ATTRIBUTE_PTR         pTemplate,
+                         CK_ULONG                 ulAttributeCount,
+                         CK_DERIVE_BATCH_ITEM_PTR pItems,
+                         CK_ULONG                 ulCount);
+
     //---------------------------------------------------------------------------------------------
     CK_RV getTokenInfo(CK_SLOT_ID        slotID,
                        CK_TOKEN_INFO_PTR pInfo);
@@ -318,6 +396,15 @@ namespace EnclaveInterface
     //---------------------------------------------------------------------------------------------
     CK_RV signFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen);
 
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV signMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageSignFinal(CK_SESSION_HANDLE hSession);
+
     //---------------------------------------------------------------------------------------------
     CK_RV signRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
 
@@ -330,6 +417,20 @@ namespace EnclaveInterface
     //---------------------------------------------------------------------------------------------
     CK_RV verifyFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen);
 
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV verifyMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV messageVerifyFinal(CK_SESSION_HANDLE hSession);
+
+    //---------------------------------------------------------------------------------------------
+    CK_RV verifyBatch(CK_SESSION_HANDLE        hSession,
+                      CK_VERIFY_BATCH_ITEM_PTR pItems,
+                      CK_ULONG                 ulCount);
+
     //---------------------------------------------------------------------------------------------
     CK_RV verifyRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
 
@@ -357,6 +458,9 @@ namespace EnclaveInterface
     //---------------------------------------------------------------------------------------------
     CK_RV generateRandom(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pRandomData, CK_ULONG ulRandomLen);
 
+    //---------------------------------------------------------------------------------------------
+    CK_RV precomputePools(CK_ULONG ulMaxCount, CK_ULONG_PTR pulCount);
+
     //---------------------------------------------------------------------------------------------
     CK_RV cancelFunction(CK_SESSION_HANDLE hSession);
 }
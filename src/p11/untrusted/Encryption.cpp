@@ -97,4 +97,72 @@ CK_RV encryptFinal(CK_SESSION_HANDLE hSession,
     return EnclaveInterface::encryptFinal(hSession,
                                        pEncryptedData,
                                        pulEncryptedDataLen);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV messageEncryptInit(CK_SESSION_HANDLE hSession,
+                         CK_MECHANISM_PTR  pMechanism,
+                         CK_OBJECT_HANDLE  hKey)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::messageEncryptInit(hSession,
+                                                pMechanism,
+                                                hKey);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV encryptMessage(CK_SESSION_HANDLE hSession,
+                     CK_VOID_PTR       pParameter,
+                     CK_ULONG          ulParameterLen,
+                     CK_BYTE_PTR       pAssociatedData,
+                     CK_ULONG          ulAssociatedDataLen,
+                     CK_BYTE_PTR       pPlaintext,
+                     CK_ULONG          ulPlaintextLen,
+                     CK_BYTE_PTR       pCiphertext,
+                     CK_ULONG_PTR      pulCiphertextLen)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::encryptMessage(hSession,
+                                            pParameter,
+                                            ulParameterLen,
+                                            pAssociatedData,
+                                            ulAssociatedDataLen,
+                                            pPlaintext,
+                                            ulPlaintextLen,
+                                            pCiphertext,
+                                            pulCiphertextLen);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV encryptMessageBatch(CK_SESSION_HANDLE         hSession,
+                          CK_MESSAGE_BATCH_ITEM_PTR pItems,
+                          CK_ULONG                  ulCount)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::encryptMessageBatch(hSession,
+                                                 pItems,
+                                                 ulCount);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV messageEncryptFinal(CK_SESSION_HANDLE hSession)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::messageEncryptFinal(hSession);
 }
\ No newline at end of file
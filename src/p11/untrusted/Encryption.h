@@ -33,6 +33,7 @@
 #define ENCRYPTION_H
 
 #include "cryptoki.h"
+#include "VendorDefs.h"
 
 //---------------------------------------------------------------------------------------------
 /**
@@ -89,4 +90,60 @@ CK_RV encryptFinal(CK_SESSION_HANDLE hSession,
                    CK_BYTE_PTR       pEncryptedData,
                    CK_ULONG_PTR      pulEncryptedDataLen);
 
+//---------------------------------------------------------------------------------------------
+/**
+* Initializes a message-based encryption process; the key is set up once for all messages.
+* @param   hSession   The session handle.
+* @param   pMechanism Pointer to CK_MECHANISM structure.
+* @param   hKey       The key handle to be used for encryption.
+* @return  CK_RV      CKR_OK if messageEncryptInit is successful, error code otherwise
+*/
+CK_RV messageEncryptInit(CK_SESSION_HANDLE hSession,
+                         CK_MECHANISM_PTR  pMechanism,
+                         CK_OBJECT_HANDLE  hKey);
+
+//---------------------------------------------------------------------------------------------
+/**
+* Encrypts one message with its own IV and associated data.
+* @param   hSession            The session handle.
+* @param   pParameter          Pointer to the per-message parameters (CK_GCM_MESSAGE_PARAMS).
+* @param   ulParameterLen      The size of the per-message parameters.
+* @param   pAssociatedData     Pointer to the associated data.
+* @param   ulAssociatedDataLen The size of the associated data.
+* @param   pPlaintext          Pointer to data to be encrypted.
+* @param   ulPlaintextLen      The size of data to be encrypted.
+* @param   pCiphertext         Pointer where encrypted data is to be populated.
+* @param   pulCiphertextLen    Pointer to size of encrypted data.
+* @return  CK_RV               CKR_OK if encryptMessage is successful, error code otherwise
+*/
+CK_RV encryptMessage(CK_SESSION_HANDLE hSession,
+                     CK_VOID_PTR       pParameter,
+                     CK_ULONG          ulParameterLen,
+                     CK_BYTE_PTR       pAssociatedData,
+                     CK_ULONG          ulAssociatedDataLen,
+                     CK_BYTE_PTR       pPlaintext,
+                     CK_ULONG          ulPlaintextLen,
+                     CK_BYTE_PTR       pCiphertext,
+                     CK_ULONG_PTR      pulCiphertextLen);
+
+//---------------------------------------------------------------------------------------------
+/**
+* Encrypts a batch of messages of an active message-based operation in one call.
+* @param   hSession The session handle.
+* @param   pItems   Pointer to the messages; each item receives its output length and result.
+* @param   ulCount  The number of messages.
+* @return  CK_RV    CKR_OK if every message succeeded, the result of the first failed message otherwise
+*/
+CK_RV encryptMessageBatch(CK_SESSION_HANDLE         hSession,
+                          CK_MESSAGE_BATCH_ITEM_PTR pItems,
+                          CK_ULONG                  ulCount);
+
+//---------------------------------------------------------------------------------------------
+/**
+* Finalizes the message-based encryption process.
+* @param   hSession The session handle.
+* @return  CK_RV    CKR_OK if messageEncryptFinal is successful, error code otherwise
+*/
+CK_RV messageEncryptFinal(CK_SESSION_HANDLE hSession);
+
 #endif //ENCRYPTION_H
\ No newline at end of file
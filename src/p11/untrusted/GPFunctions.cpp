@@ -156,3 +156,14 @@ CK_RV getFunctionList(CK_FUNCTION_LIST_PTR_PTR ppFunctionList)
 
     return CKR_OK;
 }
+
+//---------------------------------------------------------------------------------------------
+CK_RV precomputePools(CK_ULONG ulMaxCount, CK_ULONG_PTR pulCount)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::precomputePools(ulMaxCount, pulCount);
+}
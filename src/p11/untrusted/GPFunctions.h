@@ -64,4 +64,12 @@ CK_RV getInfo(CK_INFO_PTR pInfo);
 */
 CK_RV getFunctionList(CK_FUNCTION_LIST_PTR_PTR ppFunctionList);
 
+/**
+* Refills the enclave precomputation pools (vendor extension). Meant to be called while the application is idle.
+* @param  ulMaxCount     Maximum number of pool entries to compute in this call.
+* @param  pulCount       Pointer that will hold the number of entries actually computed.
+* @return CK_RV          CKR_OK if the pools were refilled, error code otherwise.
+*/
+CK_RV precomputePools(CK_ULONG ulMaxCount, CK_ULONG_PTR pulCount);
+
 #endif //GP_FUNCTIONS_H
\ No newline at end of file
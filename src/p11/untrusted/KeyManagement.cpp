@@ -206,6 +206,67 @@ CK_RV unwrapKey(CK_SESSION_HANDLE    hSession,
                                     hKey);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV wrapKeyBatch(CK_SESSION_HANDLE      hSession,
+                   CK_MECHANISM_PTR       pMechanism,
+                   CK_OBJECT_HANDLE       hWrappingKey,
+                   CK_WRAP_BATCH_ITEM_PTR pItems,
+                   CK_ULONG               ulCount)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::wrapKeyBatch(hSession,
+                                          pMechanism,
+                                          hWrappingKey,
+                                          pItems,
+                                          ulCount);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV unwrapKeyBatch(CK_SESSION_HANDLE        hSession,
+                     CK_MECHANISM_PTR         pMechanism,
+                     CK_OBJECT_HANDLE         hUnwrappingKey,
+                     CK_UNWRAP_BATCH_ITEM_PTR pItems,
+                     CK_ULONG                 ulCount)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::unwrapKeyBatch(hSession,
+                                            pMechanism,
+                                            hUnwrappingKey,
+                                            pItems,
+                                            ulCount);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV deriveKeyBatch(CK_SESSION_HANDLE        hSession,
+                     CK_MECHANISM_PTR         pMechanism,
+                     CK_OBJECT_HANDLE         hBaseKey,
+                     CK_ATTRIBUTE_PTR         pTemplate,
+                     CK_ULONG                 ulAttributeCount,
+                     CK_DERIVE_BATCH_ITEM_PTR pItems,
+                     CK_ULONG                 ulCount)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::deriveKeyBatch(hSession,
+                                            pMechanism,
+                                            hBaseKey,
+                                            pTemplate,
+                                            ulAttributeCount,
+                                            pItems,
+                                            ulCount);
+}
+
 //---------------------------------------------------------------------------------------------
 CK_RV deriveKey(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism,
                   CK_OBJECT_HANDLE hBaseKey, CK_ATTRIBUTE_PTR pTemplate,
@@ -33,6 +33,7 @@
 #define KEYMANAGEMENT_H
 
 #include "cryptoki.h"
+#include "VendorDefs.h"
 
 //---------------------------------------------------------------------------------------------
 /**
@@ -112,6 +113,59 @@ CK_RV unwrapKey(CK_SESSION_HANDLE    hSession,
                 CK_ULONG             ulCount,
                 CK_OBJECT_HANDLE_PTR hKey);
 
+//---------------------------------------------------------------------------------------------
+/**
+* Wraps a batch of keys with one AES wrapping key.
+* @param  hSession      The session handle.
+* @param  pMechanism    The key wrap mechanism (CKM_AES_KEY_WRAP or CKM_AES_KEY_WRAP_PAD).
+* @param  hWrappingKey  The wrapping key handle.
+* @param  pItems        The keys to be wrapped and their wrapped key buffers.
+* @param  ulCount       Number of items passed.
+* @return CK_RV         CKR_OK if all keys are successfully wrapped, the result of the first failed key otherwise.
+*/
+CK_RV wrapKeyBatch(CK_SESSION_HANDLE      hSession,
+                   CK_MECHANISM_PTR       pMechanism,
+                   CK_OBJECT_HANDLE       hWrappingKey,
+                   CK_WRAP_BATCH_ITEM_PTR pItems,
+                   CK_ULONG               ulCount);
+
+//---------------------------------------------------------------------------------------------
+/**
+* Unwraps a batch of keys with one unwrapping key; either all keys are created or none.
+* @param  hSession        The session handle.
+* @param  pMechanism      The mechanism to be used for key unwrapping.
+* @param  hUnwrappingKey  The key handle to be used for unwrapping.
+* @param  pItems          The wrapped keys, their templates and the key handles of the unwrapped keys.
+* @param  ulCount         Number of items passed.
+* @return CK_RV           CKR_OK if all keys are successfully unwrapped, the result of the failed key otherwise.
+*/
+CK_RV unwrapKeyBatch(CK_SESSION_HANDLE        hSession,
+                     CK_MECHANISM_PTR         pMechanism,
+                     CK_OBJECT_HANDLE         hUnwrappingKey,
+                     CK_UNWRAP_BATCH_ITEM_PTR pItems,
+                     CK_ULONG                 ulCount);
+
+//---------------------------------------------------------------------------------------------
+/**
+* Derives a batch of keys from one base key with HKDF, an SP 800-108 KDF or the TLS 1.2 PRF.
+* @param  hSession          The session handle.
+* @param  pMechanism        The key derivation mechanism (CKM_HKDF_DERIVE, CKM_SP800_108_COUNTER_KDF, CKM_SP800_108_FEEDBACK_KDF,
+*                           CKM_TLS12_PRF_SHA256, CKM_TLS12_MASTER_KEY_DERIVE or CKM_TLS12_KEY_AND_MAC_DERIVE).
+* @param  hBaseKey          The base key handle.
+* @param  pTemplate         The template of the derived keys.
+* @param  ulAttributeCount  Number of attributes in the template.
+* @param  pItems            The data of each key and its key handle or key material.
+* @param  ulCount           Number of items passed.
+* @return CK_RV             CKR_OK if all keys are successfully derived, the result of the first failed key otherwise.
+*/
+CK_RV deriveKeyBatch(CK_SESSION_HANDLE        hSession,
+                     CK_MECHANISM_PTR         pMechanism,
+                     CK_OBJECT_HANDLE         hBaseKey,
+                     CK_ATTRIBUTE_PTR         pTemplate,
+                     CK_ULONG                 ulAttributeCount,
+                     CK_DERIVE_BATCH_ITEM_PTR pItems,
+                     CK_ULONG                 ulCount);
+
 
 CK_RV deriveKey(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism,
                   CK_OBJECT_HANDLE hBaseKey, CK_ATTRIBUTE_PTR pTemplate,
@@ -151,6 +151,74 @@ CK_RV __attribute__((visibility("default"))) C_DecryptFinal(CK_SESSION_HANDLE hS
     return decryptFinal(hSession, pData, pDataLen);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_MessageEncryptInit(CK_SESSION_HANDLE hSession,
+                                                                  CK_MECHANISM_PTR  pMechanism,
+                                                                  CK_OBJECT_HANDLE  hKey)
+{
+    return messageEncryptInit(hSession, pMechanism, hKey);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_EncryptMessage(CK_SESSION_HANDLE hSession,
+                                                              CK_VOID_PTR       pParameter,
+                                                              CK_ULONG          ulParameterLen,
+                                                              CK_BYTE_PTR       pAssociatedData,
+                                                              CK_ULONG          ulAssociatedDataLen,
+                                                              CK_BYTE_PTR       pPlaintext,
+                                                              CK_ULONG          ulPlaintextLen,
+                                                              CK_BYTE_PTR       pCiphertext,
+                                                              CK_ULONG_PTR      pulCiphertextLen)
+{
+    return encryptMessage(hSession, pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen, pPlaintext, ulPlaintextLen, pCiphertext, pulCiphertextLen);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_EncryptMessageBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    return encryptMessageBatch(hSession, pItems, ulCount);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_MessageEncryptFinal(CK_SESSION_HANDLE hSession)
+{
+    return messageEncryptFinal(hSession);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_MessageDecryptInit(CK_SESSION_HANDLE hSession,
+                                                                  CK_MECHANISM_PTR  pMechanism,
+                                                                  CK_OBJECT_HANDLE  hKey)
+{
+    return messageDecryptInit(hSession, pMechanism, hKey);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_DecryptMessage(CK_SESSION_HANDLE hSession,
+                                                              CK_VOID_PTR       pParameter,
+                                                              CK_ULONG          ulParameterLen,
+                                                              CK_BYTE_PTR       pAssociatedData,
+                                                              CK_ULONG          ulAssociatedDataLen,
+                                                              CK_BYTE_PTR       pCiphertext,
+                                                              CK_ULONG          ulCiphertextLen,
+                                                              CK_BYTE_PTR       pPlaintext,
+                                                              CK_ULONG_PTR      pulPlaintextLen)
+{
+    return decryptMessage(hSession, pParameter, ulParameterLen, pAssociatedData, ulAssociatedDataLen, pCiphertext, ulCiphertextLen, pPlaintext, pulPlaintextLen);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_DecryptMessageBatch(CK_SESSION_HANDLE hSession, CK_MESSAGE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    return decryptMessageBatch(hSession, pItems, ulCount);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_MessageDecryptFinal(CK_SESSION_HANDLE hSession)
+{
+    return messageDecryptFinal(hSession);
+}
+
 //---------------------------------------------------------------------------------------------
 CK_RV __attribute__((visibility("default"))) C_DigestInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism)
 {
@@ -184,6 +252,12 @@ CK_RV __attribute__((visibility("default"))) C_DigestFinal(CK_SESSION_HANDLE hSe
     return digestFinal(hSession, pDigest,pulDigestLen);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_DigestBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_DIGEST_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    return digestBatch(hSession, pMechanism, pItems, ulCount);
+}
+
 //---------------------------------------------------------------------------------------------
 CK_RV __attribute__((visibility("default"))) C_SignInit(CK_SESSION_HANDLE hSession,
                                                         CK_MECHANISM_PTR  pMechanism,
@@ -274,6 +348,24 @@ CK_RV __attribute__((visibility("default"))) C_UnwrapKey(CK_SESSION_HANDLE    hS
                      pTemplate, ulCount, hKey);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_WrapKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hWrappingKey, CK_WRAP_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    return wrapKeyBatch(hSession, pMechanism, hWrappingKey, pItems, ulCount);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_UnwrapKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hUnwrappingKey, CK_UNWRAP_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    return unwrapKeyBatch(hSession, pMechanism, hUnwrappingKey, pItems, ulCount);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_DeriveKeyBatch(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hBaseKey, CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulAttributeCount, CK_DERIVE_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    return deriveKeyBatch(hSession, pMechanism, hBaseKey, pTemplate, ulAttributeCount, pItems, ulCount);
+}
+
 //---------------------------------------------------------------------------------------------
 CK_RV __attribute__((visibility("default"))) C_GetTokenInfo(CK_SLOT_ID        slotID,
                                                             CK_TOKEN_INFO_PTR pInfo)
@@ -494,6 +586,24 @@ CK_RV __attribute__((visibility("default"))) C_SignFinal(CK_SESSION_HANDLE hSess
     return signFinal(hSession, pSignature, pulSignatureLen);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_MessageSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    return messageSignInit(hSession, pMechanism, hKey);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_SignMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+    return signMessage(hSession, pParameter, ulParameterLen, pData, ulDataLen, pSignature, pulSignatureLen);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_MessageSignFinal(CK_SESSION_HANDLE hSession)
+{
+    return messageSignFinal(hSession);
+}
+
 //---------------------------------------------------------------------------------------------
 CK_RV __attribute__((visibility("default"))) C_SignRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
 {
@@ -518,6 +628,30 @@ CK_RV __attribute__((visibility("default"))) C_VerifyFinal(CK_SESSION_HANDLE hSe
     return verifyFinal(hSession, pSignature, ulSignatureLen);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_MessageVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    return messageVerifyInit(hSession, pMechanism, hKey);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_VerifyMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
+{
+    return verifyMessage(hSession, pParameter, ulParameterLen, pData, ulDataLen, pSignature, ulSignatureLen);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_MessageVerifyFinal(CK_SESSION_HANDLE hSession)
+{
+    return messageVerifyFinal(hSession);
+}
+
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_VerifyBatch(CK_SESSION_HANDLE hSession, CK_VERIFY_BATCH_ITEM_PTR pItems, CK_ULONG ulCount)
+{
+    return verifyBatch(hSession, pItems, ulCount);
+}
+
 //---------------------------------------------------------------------------------------------
 CK_RV __attribute__((visibility("default"))) C_VerifyRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
 {
@@ -572,6 +706,12 @@ CK_RV __attribute__((visibility("default"))) C_GenerateRandom(CK_SESSION_HANDLE
     return generateRandom(hSession, pRandomData, ulRandomLen);
 }
 
+//---------------------------------------------------------------------------------------------
+CK_RV __attribute__((visibility("default"))) C_PrecomputePools(CK_ULONG ulMaxCount, CK_ULONG_PTR pulCount)
+{
+    return precomputePools(ulMaxCount, pulCount);
+}
+
 //---------------------------------------------------------------------------------------------
 CK_RV __attribute__((visibility("default"))) C_CancelFunction(CK_SESSION_HANDLE hSession)
 {
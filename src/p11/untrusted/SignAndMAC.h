@@ -73,6 +73,21 @@ CK_RV signUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPartL
  */
 CK_RV signFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen);
 
+/**
+ * Initializes message-based signing; the key stays loaded until messageSignFinal.
+ */
+CK_RV messageSignInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+
+/**
+ * Signs one message with the key set up by messageSignInit.
+ */
+CK_RV signMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen);
+
+/**
+ * Finishes message-based signing.
+ */
+CK_RV messageSignFinal(CK_SESSION_HANDLE hSession);
+
 /**
  *
  */
@@ -87,6 +87,50 @@ CK_RV verifyFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG u
     return EnclaveInterface::verifyFinal(hSession, pSignature, ulSignatureLen);
 }
 
+CK_RV messageVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::messageVerifyInit(hSession, pMechanism, hKey);
+}
+
+CK_RV verifyMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::verifyMessage(hSession, pParameter, ulParameterLen, pData, ulDataLen, pSignature, ulSignatureLen);
+}
+
+CK_RV messageVerifyFinal(CK_SESSION_HANDLE hSession)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::messageVerifyFinal(hSession);
+}
+
+CK_RV verifyBatch(CK_SESSION_HANDLE        hSession,
+                  CK_VERIFY_BATCH_ITEM_PTR pItems,
+                  CK_ULONG                 ulCount)
+{
+    if (!isInitialized())
+    {
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    return EnclaveInterface::verifyBatch(hSession,
+                                         pItems,
+                                         ulCount);
+}
+
 CK_RV verifyRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
 {
     if (!isInitialized())
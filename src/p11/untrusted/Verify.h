@@ -33,6 +33,7 @@
 #define VERIFY_H
 
 #include "cryptoki.h"
+#include "VendorDefs.h"
 
 //---------------------------------------------------------------------------------------------
 /**
@@ -72,6 +73,27 @@ CK_RV verifyUpdate(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pPart, CK_ULONG ulPar
  */
 CK_RV verifyFinal(CK_SESSION_HANDLE hSession, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen);
 
+/**
+ * Initializes message-based verification; the key stays loaded until messageVerifyFinal.
+ */
+CK_RV messageVerifyInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
+
+/**
+ * Verifies one message with the key set up by messageVerifyInit.
+ */
+CK_RV verifyMessage(CK_SESSION_HANDLE hSession, CK_VOID_PTR pParameter, CK_ULONG ulParameterLen, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen);
+
+/**
+ * Finishes message-based verification.
+ */
+CK_RV messageVerifyFinal(CK_SESSION_HANDLE hSession);
+
+/**
+ * Verifies a batch of signatures, each with its own key and mechanism, without an active verify operation.
+ * Every item receives its own result; the result of the first failed signature is returned.
+ */
+CK_RV verifyBatch(CK_SESSION_HANDLE hSession, CK_VERIFY_BATCH_ITEM_PTR pItems, CK_ULONG ulCount);
+
 
 CK_RV verifyRecoverInit(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey);
 
@@ -29,6 +29,7 @@
 
  Contains test cases for:
 	 C_DeriveKey
+	 C_DeriveKeyBatch
 
  *****************************************************************************/
 
@@ -36,6 +37,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "DeriveTests.h"
+#include "VendorDefs.h"
 
 // CKA_TOKEN
 const CK_BBOOL ON_TOKEN = CK_TRUE;
@@ -857,3 +859,669 @@ void DeriveTests::testSymDerive()
 	symDerive(hSessionRW,hKeyAes,hDerive,CKM_AES_CBC_ENCRYPT_DATA,CKK_AES);
 }
 
+// Create a secret key for HMAC-SHA256 with a random value; C_CreateObject
+// generates the value of HMAC keys
+CK_RV DeriveTests::createHmacKey(CK_SESSION_HANDLE hSession, CK_ULONG bytes, CK_BBOOL bSensitive, CK_OBJECT_HANDLE &hKey)
+{
+	CK_OBJECT_CLASS keyClass = CKO_SECRET_KEY;
+	CK_KEY_TYPE keyType = CKK_SHA256_HMAC;
+	CK_BBOOL bExtractable = bSensitive ? CK_FALSE : CK_TRUE;
+	CK_BBOOL bFalse = CK_FALSE;
+	CK_BBOOL bTrue = CK_TRUE;
+	CK_ATTRIBUTE keyAttribs[] = {
+		{ CKA_CLASS, &keyClass, sizeof(keyClass) },
+		{ CKA_KEY_TYPE, &keyType, sizeof(keyType) },
+		{ CKA_TOKEN, &bFalse, sizeof(bFalse) },
+		{ CKA_PRIVATE, &bFalse, sizeof(bFalse) },
+		{ CKA_SENSITIVE, &bSensitive, sizeof(bSensitive) },
+		{ CKA_EXTRACTABLE, &bExtractable, sizeof(bExtractable) },
+		{ CKA_SIGN, &bTrue, sizeof(bTrue) },
+		{ CKA_DERIVE, &bTrue, sizeof(bTrue) },
+		{ CKA_VALUE_LEN, &bytes, sizeof(bytes) }
+	};
+
+	hKey = CK_INVALID_HANDLE;
+	return CRYPTOKI_F_PTR( C_CreateObject(hSession, keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE), &hKey) );
+}
+
+// Compute the 32 byte HMAC-SHA256 of the data with the key
+void DeriveTests::hmacSha256(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hKey, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pMac)
+{
+	CK_MECHANISM mechanism = { CKM_SHA256_HMAC, NULL_PTR, 0 };
+	CK_ULONG ulMacLen = 32;
+	CK_RV rv;
+
+	rv = CRYPTOKI_F_PTR( C_SignInit(hSession, &mechanism, hKey) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Sign(hSession, pData, ulDataLen, pMac, &ulMacLen) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(ulMacLen == 32);
+}
+
+void DeriveTests::testDeriveKeyBatch()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+
+	CK_BYTE info[] = {
+		0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+		0xf8, 0xf9
+	};
+	CK_BYTE iv[] = {
+		0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7
+	};
+	CK_BYTE tenant[] = "tenant-1";
+	const CK_ULONG tenantLen = sizeof(tenant) - 1;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	// Initialize the library and start the test.
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open read-write session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Login USER into the session so we can create private objects
+	rv = CRYPTOKI_F_PTR( C_Login(hSession,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The mechanisms are listed for derivation
+	CK_MECHANISM_TYPE kdfs[] = { CKM_HKDF_DERIVE, CKM_SP800_108_COUNTER_KDF, CKM_SP800_108_FEEDBACK_KDF };
+	for (unsigned int i = 0; i < sizeof(kdfs)/sizeof(CK_MECHANISM_TYPE); i++)
+	{
+		CK_MECHANISM_INFO info;
+		rv = CRYPTOKI_F_PTR( C_GetMechanismInfo(m_initializedTokenSlotID, kdfs[i], &info) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		CPPUNIT_ASSERT((info.flags & CKF_DERIVE) == CKF_DERIVE);
+	}
+
+	// The base key; the expected key material is computed with C_Sign
+	CK_OBJECT_HANDLE hBaseKey = CK_INVALID_HANDLE;
+	rv = createHmacKey(hSession, 32, CK_FALSE, hBaseKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// HKDF-Expand: T(1) = HMAC(PRK, info || 01), T(2) = HMAC(PRK, T(1) || info || 02)
+	CK_BYTE input[64];
+	CK_BYTE okm[64];
+	const CK_ULONG okmLen = 42;
+	memcpy(input, info, sizeof(info));
+	input[sizeof(info)] = 0x01;
+	hmacSha256(hSession, hBaseKey, input, sizeof(info) + 1, okm);
+	memcpy(input, okm, 32);
+	memcpy(input + 32, info, sizeof(info));
+	input[32 + sizeof(info)] = 0x02;
+	hmacSha256(hSession, hBaseKey, input, 32 + sizeof(info) + 1, okm + 32);
+
+	CK_HKDF_PARAMS hkdfParams = { CK_FALSE, CK_TRUE, CKM_SHA256, CKF_HKDF_SALT_NULL, NULL_PTR, 0, CK_INVALID_HANDLE, NULL_PTR, 0 };
+	CK_MECHANISM hkdfMechanism = { CKM_HKDF_DERIVE, &hkdfParams, sizeof(hkdfParams) };
+
+	// Raw key material, twice in one batch
+	CK_BYTE values[2][64];
+	CK_DERIVE_BATCH_ITEM items[3];
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		items[i].pData = info;
+		items[i].ulDataLen = sizeof(info);
+		items[i].pValue = values[i];
+		items[i].ulValueLen = okmLen;
+		items[i].hKey = CK_INVALID_HANDLE;
+		items[i].rv = CKR_GENERAL_ERROR;
+	}
+
+	rv = C_DeriveKeyBatch(hSession, &hkdfMechanism, hBaseKey, NULL_PTR, 0, NULL_PTR, 2);
+	CPPUNIT_ASSERT(rv == CKR_ARGUMENTS_BAD);
+	rv = C_DeriveKeyBatch(CK_INVALID_HANDLE, &hkdfMechanism, hBaseKey, NULL_PTR, 0, items, 2);
+	CPPUNIT_ASSERT(rv == CKR_SESSION_HANDLE_INVALID);
+
+	rv = C_DeriveKeyBatch(hSession, &hkdfMechanism, hBaseKey, NULL_PTR, 0, items, 2);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		CPPUNIT_ASSERT(items[i].rv == CKR_OK);
+		CPPUNIT_ASSERT(memcmp(values[i], okm, okmLen) == 0);
+	}
+
+	// The info of the parameters is a prefix of the info of the key
+	hkdfParams.pInfo = info;
+	hkdfParams.ulInfoLen = 4;
+	items[0].pData = info + 4;
+	items[0].ulDataLen = sizeof(info) - 4;
+	memset(values[0], 0, sizeof(values[0]));
+	rv = C_DeriveKeyBatch(hSession, &hkdfMechanism, hBaseKey, NULL_PTR, 0, items, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(values[0], okm, okmLen) == 0);
+
+	// HKDF-Extract first gives other key material, the same for equal info
+	hkdfParams.bExtract = CK_TRUE;
+	hkdfParams.pInfo = NULL_PTR;
+	hkdfParams.ulInfoLen = 0;
+	items[0].pData = info;
+	items[0].ulDataLen = sizeof(info);
+	rv = C_DeriveKeyBatch(hSession, &hkdfMechanism, hBaseKey, NULL_PTR, 0, items, 2);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(values[0], values[1], okmLen) == 0);
+	CPPUNIT_ASSERT(memcmp(values[0], okm, okmLen) != 0);
+
+	// SP 800-108 in counter mode: K(1) = HMAC(KI, [1]32 || fixed input)
+	CK_BYTE counterKey[32];
+	memset(input, 0, 3);
+	input[3] = 0x01;
+	memcpy(input + 4, tenant, tenantLen);
+	hmacSha256(hSession, hBaseKey, input, 4 + tenantLen, counterKey);
+
+	CK_SP800_108_BATCH_PARAMS counterParams = { CKM_SHA256_HMAC, NULL_PTR, 0 };
+	CK_MECHANISM counterMechanism = { CKM_SP800_108_COUNTER_KDF, &counterParams, sizeof(counterParams) };
+	items[0].pData = tenant;
+	items[0].ulDataLen = tenantLen;
+	items[0].ulValueLen = sizeof(counterKey);
+	rv = C_DeriveKeyBatch(hSession, &counterMechanism, hBaseKey, NULL_PTR, 0, items, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(values[0], counterKey, sizeof(counterKey)) == 0);
+
+	// Counter mode has no IV
+	counterParams.pIV = iv;
+	counterParams.ulIVLen = sizeof(iv);
+	rv = C_DeriveKeyBatch(hSession, &counterMechanism, hBaseKey, NULL_PTR, 0, items, 1);
+	CPPUNIT_ASSERT(rv == CKR_MECHANISM_PARAM_INVALID);
+
+	// SP 800-108 in feedback mode: K(1) = HMAC(KI, IV || [1]32 || fixed input),
+	// K(2) = HMAC(KI, K(1) || [2]32 || fixed input)
+	CK_BYTE feedbackKey[64];
+	memcpy(input, iv, sizeof(iv));
+	memset(input + sizeof(iv), 0, 3);
+	input[sizeof(iv) + 3] = 0x01;
+	memcpy(input + sizeof(iv) + 4, tenant, tenantLen);
+	hmacSha256(hSession, hBaseKey, input, sizeof(iv) + 4 + tenantLen, feedbackKey);
+	memcpy(input, feedbackKey, 32);
+	memset(input + 32, 0, 3);
+	input[32 + 3] = 0x02;
+	memcpy(input + 32 + 4, tenant, tenantLen);
+	hmacSha256(hSession, hBaseKey, input, 32 + 4 + tenantLen, feedbackKey + 32);
+
+	CK_MECHANISM feedbackMechanism = { CKM_SP800_108_FEEDBACK_KDF, &counterParams, sizeof(counterParams) };
+	items[0].ulValueLen = sizeof(feedbackKey);
+	rv = C_DeriveKeyBatch(hSession, &feedbackMechanism, hBaseKey, NULL_PTR, 0, items, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(values[0], feedbackKey, sizeof(feedbackKey)) == 0);
+
+	counterParams.pIV = NULL_PTR;
+	counterParams.ulIVLen = 0;
+
+	// Keys need a template
+	items[0].pValue = NULL_PTR;
+	rv = C_DeriveKeyBatch(hSession, &counterMechanism, hBaseKey, NULL_PTR, 0, items, 1);
+	CPPUNIT_ASSERT(rv == CKR_TEMPLATE_INCOMPLETE);
+	CPPUNIT_ASSERT(items[0].rv == CKR_TEMPLATE_INCOMPLETE);
+
+	// Derive generic secrets for HMAC; keys of the same data are the same
+	CK_KEY_TYPE genKeyType = CKK_GENERIC_SECRET;
+	CK_BBOOL bTrue = CK_TRUE;
+	CK_ULONG valueLen = 32;
+	CK_ATTRIBUTE keyAttribs[] = {
+		{ CKA_KEY_TYPE, &genKeyType, sizeof(genKeyType) },
+		{ CKA_SIGN, &bTrue, sizeof(bTrue) },
+		{ CKA_VALUE_LEN, &valueLen, sizeof(valueLen) }
+	};
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		items[i].pData = (i < 2) ? tenant : info;
+		items[i].ulDataLen = (i < 2) ? tenantLen : sizeof(info);
+		items[i].pValue = NULL_PTR;
+		items[i].ulValueLen = 0;
+		items[i].hKey = CK_INVALID_HANDLE;
+		items[i].rv = CKR_GENERAL_ERROR;
+	}
+	rv = C_DeriveKeyBatch(hSession, &counterMechanism, hBaseKey, keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE), items, 3);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		CPPUNIT_ASSERT(items[i].rv == CKR_OK);
+		CPPUNIT_ASSERT(items[i].hKey != CK_INVALID_HANDLE);
+	}
+	CPPUNIT_ASSERT(items[0].hKey != items[1].hKey);
+
+	CK_BYTE macs[3][32];
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		hmacSha256(hSession, items[i].hKey, tenant, tenantLen, macs[i]);
+	}
+	CPPUNIT_ASSERT(memcmp(macs[0], macs[1], 32) == 0);
+	CPPUNIT_ASSERT(memcmp(macs[0], macs[2], 32) != 0);
+
+	// A sensitive base key does not give out key material
+	CK_OBJECT_HANDLE hAesKey = CK_INVALID_HANDLE;
+	rv = generateAesKey(hSession, IN_SESSION, IS_PUBLIC, hAesKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	items[0].pValue = values[0];
+	items[0].ulValueLen = sizeof(counterKey);
+	rv = C_DeriveKeyBatch(hSession, &counterMechanism, hAesKey, NULL_PTR, 0, items, 1);
+	CPPUNIT_ASSERT(rv == CKR_KEY_FUNCTION_NOT_PERMITTED);
+	CPPUNIT_ASSERT(items[0].rv == CKR_KEY_FUNCTION_NOT_PERMITTED);
+
+	// But it derives keys
+	CK_KEY_TYPE aesKeyType = CKK_AES;
+	valueLen = 16;
+	CK_ATTRIBUTE aesAttribs[] = {
+		{ CKA_KEY_TYPE, &aesKeyType, sizeof(aesKeyType) },
+		{ CKA_ENCRYPT, &bTrue, sizeof(bTrue) },
+		{ CKA_VALUE_LEN, &valueLen, sizeof(valueLen) }
+	};
+	items[0].pValue = NULL_PTR;
+	rv = C_DeriveKeyBatch(hSession, &hkdfMechanism, hAesKey, aesAttribs, sizeof(aesAttribs)/sizeof(CK_ATTRIBUTE), items, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(items[0].rv == CKR_OK);
+	CPPUNIT_ASSERT(items[0].hKey != CK_INVALID_HANDLE);
+}
+
+#ifdef WITH_EDDSA
+void DeriveTests::testDeriveKeyBatchEcdh()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	const char* curves[] = { "X25519", "X448" };
+	const CK_ULONG secretLens[] = { 32, 56 };
+	CK_BYTE data[] = "client hello";
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	// Initialize the library and start the test.
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open read-write session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Login USER into the session so we can create private objects
+	rv = CRYPTOKI_F_PTR( C_Login(hSession,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	CK_MECHANISM_INFO info;
+	rv = CRYPTOKI_F_PTR( C_GetMechanismInfo(m_initializedTokenSlotID, CKM_ECDH1_DERIVE, &info) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT((info.flags & CKF_DERIVE) == CKF_DERIVE);
+
+	CK_ECDH1_DERIVE_PARAMS params = { CKD_NULL, 0, NULL_PTR, 0, NULL_PTR };
+	CK_MECHANISM mechanism = { CKM_ECDH1_DERIVE, &params, sizeof(params) };
+
+	for (unsigned int c = 0; c < sizeof(curves)/sizeof(curves[0]); c++)
+	{
+		// Both sides of the key agreement
+		CK_OBJECT_HANDLE hPuk[2];
+		CK_OBJECT_HANDLE hPrk[2];
+		CK_BYTE points[2][64];
+		CK_ULONG pointLens[2];
+		for (unsigned int i = 0; i < 2; i++)
+		{
+			rv = generateEdKeyPair(curves[c], hSession, IN_SESSION, IS_PUBLIC, IN_SESSION, IS_PUBLIC, hPuk[i], hPrk[i]);
+			CPPUNIT_ASSERT(rv == CKR_OK);
+
+			CK_ATTRIBUTE pointAttrib = { CKA_EC_POINT, points[i], sizeof(points[i]) };
+			rv = CRYPTOKI_F_PTR( C_GetAttributeValue(hSession, hPuk[i], &pointAttrib, 1) );
+			CPPUNIT_ASSERT(rv == CKR_OK);
+			CPPUNIT_ASSERT(pointAttrib.ulValueLen == 2 + secretLens[c]);
+			pointLens[i] = pointAttrib.ulValueLen;
+		}
+
+		// The shared secret as a generic secret for HMAC
+		CK_KEY_TYPE genKeyType = CKK_GENERIC_SECRET;
+		CK_BBOOL bTrue = CK_TRUE;
+		CK_ULONG valueLen = secretLens[c];
+		CK_ATTRIBUTE keyAttribs[] = {
+			{ CKA_KEY_TYPE, &genKeyType, sizeof(genKeyType) },
+			{ CKA_SIGN, &bTrue, sizeof(bTrue) },
+			{ CKA_VALUE_LEN, &valueLen, sizeof(valueLen) }
+		};
+
+		// One side takes the raw public key of the other and its DER octet
+		// string; the other side takes the raw public key
+		CK_DERIVE_BATCH_ITEM items[3];
+		memset(items, 0, sizeof(items));
+		items[0].pData = points[1] + 2;
+		items[0].ulDataLen = pointLens[1] - 2;
+		items[1].pData = points[1];
+		items[1].ulDataLen = pointLens[1];
+		items[2].pData = points[0] + 2;
+		items[2].ulDataLen = pointLens[0] - 2;
+		rv = C_DeriveKeyBatch(hSession, &mechanism, hPrk[0], keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE), items, 2);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		rv = C_DeriveKeyBatch(hSession, &mechanism, hPrk[1], keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE), items + 2, 1);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		CK_BYTE macs[3][32];
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			CPPUNIT_ASSERT(items[i].rv == CKR_OK);
+			hmacSha256(hSession, items[i].hKey, data, sizeof(data) - 1, macs[i]);
+		}
+		CPPUNIT_ASSERT(memcmp(macs[0], macs[1], 32) == 0);
+		CPPUNIT_ASSERT(memcmp(macs[0], macs[2], 32) == 0);
+
+		// A bad public key does not stop the batch
+		items[0].ulDataLen = pointLens[1] - 3;
+		items[1].hKey = CK_INVALID_HANDLE;
+		rv = C_DeriveKeyBatch(hSession, &mechanism, hPrk[0], keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE), items, 2);
+		CPPUNIT_ASSERT(rv != CKR_OK);
+		CPPUNIT_ASSERT(items[0].rv != CKR_OK);
+		CPPUNIT_ASSERT(items[1].rv == CKR_OK);
+		CPPUNIT_ASSERT(items[1].hKey != CK_INVALID_HANDLE);
+
+		// The shared secret of a sensitive private key stays in the token
+		CK_BYTE value[56];
+		items[1].pValue = value;
+		items[1].ulValueLen = secretLens[c];
+		rv = C_DeriveKeyBatch(hSession, &mechanism, hPrk[0], NULL_PTR, 0, items + 1, 1);
+		CPPUNIT_ASSERT(rv == CKR_KEY_FUNCTION_NOT_PERMITTED);
+
+		// The public key is not a base key
+		items[1].pValue = NULL_PTR;
+		items[1].ulValueLen = 0;
+		rv = C_DeriveKeyBatch(hSession, &mechanism, hPuk[0], keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE), items + 1, 1);
+		CPPUNIT_ASSERT(rv == CKR_KEY_TYPE_INCONSISTENT);
+	}
+
+	// The shared secret is used as it is
+	CK_OBJECT_HANDLE hPuk, hPrk;
+	rv = generateEdKeyPair("X25519", hSession, IN_SESSION, IS_PUBLIC, IN_SESSION, IS_PUBLIC, hPuk, hPrk);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CK_BYTE peer[32] = { 9 };
+	CK_DERIVE_BATCH_ITEM item = { peer, sizeof(peer), NULL_PTR, 0, CK_INVALID_HANDLE, CKR_GENERAL_ERROR };
+	params.kdf = CKD_SHA256_KDF;
+	rv = C_DeriveKeyBatch(hSession, &mechanism, hPrk, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_MECHANISM_PARAM_INVALID);
+
+	// The peer key is the data of the items
+	params.kdf = CKD_NULL;
+	params.pPublicData = peer;
+	params.ulPublicDataLen = sizeof(peer);
+	rv = C_DeriveKeyBatch(hSession, &mechanism, hPrk, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_MECHANISM_PARAM_INVALID);
+
+	// Secret keys do not agree on keys
+	CK_OBJECT_HANDLE hAesKey = CK_INVALID_HANDLE;
+	rv = generateAesKey(hSession, IN_SESSION, IS_PUBLIC, hAesKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	params.pPublicData = NULL_PTR;
+	params.ulPublicDataLen = 0;
+	rv = C_DeriveKeyBatch(hSession, &mechanism, hAesKey, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_KEY_TYPE_INCONSISTENT);
+}
+#endif
+
+// P_SHA256(secret, label || seed) of RFC 5246, section 5, computed with C_Sign:
+// A(i) = HMAC(secret, A(i-1)), block i = HMAC(secret, A(i) || label || seed)
+void DeriveTests::tlsPrf(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hSecret, const char* label, CK_BYTE_PTR pSeed, CK_ULONG ulSeedLen, CK_BYTE_PTR pOut, CK_ULONG ulOutLen)
+{
+	CK_BYTE input[32 + 128];
+	CK_BYTE a[32];
+	CK_BYTE block[32];
+	CK_ULONG labelSeedLen = strlen(label) + ulSeedLen;
+
+	CPPUNIT_ASSERT(labelSeedLen <= sizeof(input) - 32);
+	memcpy(input + 32, label, strlen(label));
+	memcpy(input + 32 + strlen(label), pSeed, ulSeedLen);
+
+	hmacSha256(hSession, hSecret, input + 32, labelSeedLen, a);
+	for (CK_ULONG offset = 0; offset < ulOutLen; offset += 32)
+	{
+		memcpy(input, a, 32);
+		hmacSha256(hSession, hSecret, input, 32 + labelSeedLen, block);
+		memcpy(pOut + offset, block, ulOutLen - offset < 32 ? ulOutLen - offset : 32);
+		hmacSha256(hSession, hSecret, a, 32, a);
+	}
+}
+
+void DeriveTests::testTls12KeySchedule()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+
+	CK_BYTE clientRandom[32];
+	CK_BYTE serverRandom[32];
+	CK_BYTE handshakeHash[32];
+	for (unsigned int i = 0; i < 32; i++)
+	{
+		clientRandom[i] = i;
+		serverRandom[i] = 0x20 + i;
+		handshakeHash[i] = 0x40 + i;
+	}
+	CK_BYTE randoms[64];
+	memcpy(randoms, clientRandom, 32);
+	memcpy(randoms + 32, serverRandom, 32);
+	CK_BYTE swappedRandoms[64];
+	memcpy(swappedRandoms, serverRandom, 32);
+	memcpy(swappedRandoms + 32, clientRandom, 32);
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	// Initialize the library and start the test.
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open read-write session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Login USER into the session so we can create private objects
+	rv = CRYPTOKI_F_PTR( C_Login(hSession,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The mechanisms are listed for derivation
+	CK_MECHANISM_TYPE kdfs[] = { CKM_TLS12_PRF_SHA256, CKM_TLS12_MASTER_KEY_DERIVE, CKM_TLS12_KEY_AND_MAC_DERIVE };
+	for (unsigned int i = 0; i < sizeof(kdfs)/sizeof(CK_MECHANISM_TYPE); i++)
+	{
+		CK_MECHANISM_INFO info;
+		rv = CRYPTOKI_F_PTR( C_GetMechanismInfo(m_initializedTokenSlotID, kdfs[i], &info) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		CPPUNIT_ASSERT((info.flags & CKF_DERIVE) == CKF_DERIVE);
+	}
+
+	// The TLS 1.0/1.1 PRF is not
+	CK_MECHANISM_INFO tls10Info;
+	rv = CRYPTOKI_F_PTR( C_GetMechanismInfo(m_initializedTokenSlotID, CKM_TLS_PRF, &tls10Info) );
+	CPPUNIT_ASSERT(rv == CKR_MECHANISM_INVALID);
+
+	// The pre-master secret; the expected values are computed with C_Sign
+	CK_OBJECT_HANDLE hPreMaster = CK_INVALID_HANDLE;
+	rv = createHmacKey(hSession, 48, CK_FALSE, hPreMaster);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// PRF(pre_master_secret, "master secret", client_random + server_random)
+	CK_BYTE masterSecret[48];
+	tlsPrf(hSession, hPreMaster, "master secret", randoms, sizeof(randoms), masterSecret, sizeof(masterSecret));
+
+	// Derive the master secret
+	CK_VERSION version = { 0, 0 };
+	CK_TLS12_MASTER_KEY_DERIVE_PARAMS masterParams;
+	masterParams.RandomInfo.pClientRandom = clientRandom;
+	masterParams.RandomInfo.ulClientRandomLen = sizeof(clientRandom);
+	masterParams.RandomInfo.pServerRandom = serverRandom;
+	masterParams.RandomInfo.ulServerRandomLen = sizeof(serverRandom);
+	masterParams.pVersion = &version;
+	masterParams.prfHashMechanism = CKM_SHA256;
+	CK_MECHANISM masterMechanism = { CKM_TLS12_MASTER_KEY_DERIVE, &masterParams, sizeof(masterParams) };
+
+	CK_BYTE value[sizeof(masterSecret)];
+	CK_DERIVE_BATCH_ITEM item = { NULL_PTR, 0, value, sizeof(value), CK_INVALID_HANDLE, CKR_GENERAL_ERROR };
+	rv = C_DeriveKeyBatch(hSession, &masterMechanism, hPreMaster, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(item.rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(value, masterSecret, sizeof(masterSecret)) == 0);
+
+	// The master secret has 48 bytes
+	item.ulValueLen = 32;
+	rv = C_DeriveKeyBatch(hSession, &masterMechanism, hPreMaster, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_ARGUMENTS_BAD);
+
+	// The extended master secret
+	CK_BYTE extendedMasterSecret[48];
+	tlsPrf(hSession, hPreMaster, "extended master secret", handshakeHash, sizeof(handshakeHash), extendedMasterSecret, sizeof(extendedMasterSecret));
+	masterParams.pVersion = NULL_PTR;
+	item.pData = handshakeHash;
+	item.ulDataLen = sizeof(handshakeHash);
+	item.ulValueLen = sizeof(value);
+	rv = C_DeriveKeyBatch(hSession, &masterMechanism, hPreMaster, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(value, extendedMasterSecret, sizeof(extendedMasterSecret)) == 0);
+
+	// The master secret as a key
+	CK_BBOOL bTrue = CK_TRUE;
+	CK_BBOOL bFalse = CK_FALSE;
+	CK_ATTRIBUTE masterAttribs[] = {
+		{ CKA_PRIVATE, &bFalse, sizeof(bFalse) },
+		{ CKA_SENSITIVE, &bFalse, sizeof(bFalse) },
+		{ CKA_EXTRACTABLE, &bTrue, sizeof(bTrue) },
+		{ CKA_SIGN, &bTrue, sizeof(bTrue) },
+		{ CKA_DERIVE, &bTrue, sizeof(bTrue) }
+	};
+	item.pData = NULL_PTR;
+	item.ulDataLen = 0;
+	item.pValue = NULL_PTR;
+	rv = C_DeriveKeyBatch(hSession, &masterMechanism, hPreMaster, masterAttribs, sizeof(masterAttribs)/sizeof(CK_ATTRIBUTE), &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(item.hKey != CK_INVALID_HANDLE);
+	CK_OBJECT_HANDLE hMaster = item.hKey;
+
+	// PRF(master_secret, "key expansion", server_random + client_random) of
+	// AES-128-GCM: two keys and two implicit nonces
+	CK_BYTE keyBlock[40];
+	tlsPrf(hSession, hMaster, "key expansion", swappedRandoms, sizeof(swappedRandoms), keyBlock, sizeof(keyBlock));
+
+	CK_BYTE expansionLabel[] = "key expansion";
+	CK_TLS_PRF_PARAMS prfParams = { swappedRandoms, sizeof(swappedRandoms), expansionLabel, sizeof(expansionLabel) - 1, NULL_PTR, NULL_PTR };
+	CK_MECHANISM prfMechanism = { CKM_TLS12_PRF_SHA256, &prfParams, sizeof(prfParams) };
+	item.pValue = value;
+	item.ulValueLen = sizeof(keyBlock);
+	rv = C_DeriveKeyBatch(hSession, &prfMechanism, hMaster, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(value, keyBlock, sizeof(keyBlock)) == 0);
+
+	// The keys of AES-128-GCM
+	CK_BYTE clientIV[4];
+	CK_BYTE serverIV[4];
+	CK_SSL3_KEY_MAT_OUT keyMat = { CK_INVALID_HANDLE, CK_INVALID_HANDLE, CK_INVALID_HANDLE, CK_INVALID_HANDLE, clientIV, serverIV };
+	CK_TLS12_KEY_MAT_PARAMS keyMatParams;
+	keyMatParams.ulMacSizeInBits = 0;
+	keyMatParams.ulKeySizeInBits = 128;
+	keyMatParams.ulIVSizeInBits = 32;
+	keyMatParams.bIsExport = CK_FALSE;
+	keyMatParams.RandomInfo = masterParams.RandomInfo;
+	keyMatParams.pReturnedKeyMaterial = &keyMat;
+	keyMatParams.prfHashMechanism = CKM_SHA256;
+	CK_MECHANISM keyMatMechanism = { CKM_TLS12_KEY_AND_MAC_DERIVE, &keyMatParams, sizeof(keyMatParams) };
+
+	CK_KEY_TYPE aesKeyType = CKK_AES;
+	CK_ATTRIBUTE keyAttribs[] = {
+		{ CKA_KEY_TYPE, &aesKeyType, sizeof(aesKeyType) },
+		{ CKA_PRIVATE, &bFalse, sizeof(bFalse) },
+		{ CKA_SENSITIVE, &bTrue, sizeof(bTrue) },
+		{ CKA_EXTRACTABLE, &bFalse, sizeof(bFalse) },
+		{ CKA_ENCRYPT, &bTrue, sizeof(bTrue) },
+		{ CKA_DECRYPT, &bTrue, sizeof(bTrue) }
+	};
+	CK_DERIVE_BATCH_ITEM items[2];
+	memset(items, 0, sizeof(items));
+
+	// The key block belongs to one item
+	rv = C_DeriveKeyBatch(hSession, &keyMatMechanism, hMaster, keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE), items, 2);
+	CPPUNIT_ASSERT(rv == CKR_ARGUMENTS_BAD);
+
+	rv = C_DeriveKeyBatch(hSession, &keyMatMechanism, hMaster, keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE), items, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(items[0].rv == CKR_OK);
+	CPPUNIT_ASSERT(keyMat.hClientMacSecret == CK_INVALID_HANDLE);
+	CPPUNIT_ASSERT(keyMat.hServerMacSecret == CK_INVALID_HANDLE);
+	CPPUNIT_ASSERT(keyMat.hClientKey != CK_INVALID_HANDLE);
+	CPPUNIT_ASSERT(keyMat.hServerKey != CK_INVALID_HANDLE);
+	CPPUNIT_ASSERT(items[0].hKey == keyMat.hClientKey);
+	CPPUNIT_ASSERT(memcmp(clientIV, keyBlock + 32, sizeof(clientIV)) == 0);
+	CPPUNIT_ASSERT(memcmp(serverIV, keyBlock + 36, sizeof(serverIV)) == 0);
+
+	// CBC with HMAC-SHA256 also gets MAC keys
+	keyMatParams.ulMacSizeInBits = 256;
+	keyMatParams.ulIVSizeInBits = 0;
+	rv = C_DeriveKeyBatch(hSession, &keyMatMechanism, hMaster, keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE), items, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(keyMat.hClientMacSecret != CK_INVALID_HANDLE);
+	CPPUNIT_ASSERT(keyMat.hServerMacSecret != CK_INVALID_HANDLE);
+	CPPUNIT_ASSERT(keyMat.hClientKey != CK_INVALID_HANDLE);
+	CPPUNIT_ASSERT(keyMat.hServerKey != CK_INVALID_HANDLE);
+
+	// PRF(master_secret, "client finished", handshake_hash)
+	CK_BYTE clientFinished[12];
+	tlsPrf(hSession, hMaster, "client finished", handshakeHash, sizeof(handshakeHash), clientFinished, sizeof(clientFinished));
+
+	// The Finished verify data
+	CK_BYTE clientLabel[] = "client finished";
+	prfParams.pSeed = handshakeHash;
+	prfParams.ulSeedLen = sizeof(handshakeHash);
+	prfParams.pLabel = clientLabel;
+	prfParams.ulLabelLen = sizeof(clientLabel) - 1;
+	CK_BYTE verifyData[sizeof(clientFinished)];
+	item.pValue = verifyData;
+	item.ulValueLen = sizeof(verifyData);
+	rv = C_DeriveKeyBatch(hSession, &prfMechanism, hMaster, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(verifyData, clientFinished, sizeof(clientFinished)) == 0);
+
+	// A sensitive master secret only gives the Finished verify data
+	masterAttribs[1].pValue = &bTrue;
+	masterAttribs[2].pValue = &bFalse;
+	item.pValue = NULL_PTR;
+	item.ulValueLen = 0;
+	rv = C_DeriveKeyBatch(hSession, &masterMechanism, hPreMaster, masterAttribs, sizeof(masterAttribs)/sizeof(CK_ATTRIBUTE), &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CK_OBJECT_HANDLE hSensitiveMaster = item.hKey;
+
+	item.pValue = verifyData;
+	item.ulValueLen = sizeof(verifyData);
+	memset(verifyData, 0, sizeof(verifyData));
+	rv = C_DeriveKeyBatch(hSession, &prfMechanism, hSensitiveMaster, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(verifyData, clientFinished, sizeof(clientFinished)) == 0);
+
+	CK_BYTE serverLabel[] = "server finished";
+	prfParams.pLabel = serverLabel;
+	prfParams.ulLabelLen = sizeof(serverLabel) - 1;
+	rv = C_DeriveKeyBatch(hSession, &prfMechanism, hSensitiveMaster, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(verifyData, clientFinished, sizeof(clientFinished)) != 0);
+
+	// No other output length
+	prfParams.pLabel = clientLabel;
+	prfParams.ulLabelLen = sizeof(clientLabel) - 1;
+	item.pValue = value;
+	item.ulValueLen = 16;
+	rv = C_DeriveKeyBatch(hSession, &prfMechanism, hSensitiveMaster, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_KEY_FUNCTION_NOT_PERMITTED);
+	CPPUNIT_ASSERT(item.rv == CKR_KEY_FUNCTION_NOT_PERMITTED);
+
+	// No other label, not even with the length of the verify data
+	prfParams.pSeed = swappedRandoms;
+	prfParams.ulSeedLen = sizeof(swappedRandoms);
+	prfParams.pLabel = expansionLabel;
+	prfParams.ulLabelLen = sizeof(expansionLabel) - 1;
+	item.pData = NULL_PTR;
+	item.ulDataLen = 0;
+	item.ulValueLen = sizeof(keyBlock);
+	rv = C_DeriveKeyBatch(hSession, &prfMechanism, hSensitiveMaster, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_KEY_FUNCTION_NOT_PERMITTED);
+	item.ulValueLen = sizeof(verifyData);
+	rv = C_DeriveKeyBatch(hSession, &prfMechanism, hSensitiveMaster, NULL_PTR, 0, &item, 1);
+	CPPUNIT_ASSERT(rv == CKR_KEY_FUNCTION_NOT_PERMITTED);
+
+	// The key block still goes into keys
+	keyMatParams.ulMacSizeInBits = 0;
+	keyMatParams.ulIVSizeInBits = 32;
+	rv = C_DeriveKeyBatch(hSession, &keyMatMechanism, hSensitiveMaster, keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE), items, 1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(keyMat.hClientKey != CK_INVALID_HANDLE);
+	CPPUNIT_ASSERT(memcmp(clientIV, keyBlock + 32, sizeof(clientIV)) == 0);
+	CPPUNIT_ASSERT(memcmp(serverIV, keyBlock + 36, sizeof(serverIV)) == 0);
+}
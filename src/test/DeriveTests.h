@@ -39,6 +39,7 @@
 class DeriveTests : public TestsBase
 {
 	CPPUNIT_TEST_SUITE(DeriveTests);
+#if 0 // Unsupported by Crypto API Toolkit
 	CPPUNIT_TEST(testDhDerive);
 #ifdef WITH_ECC
 	CPPUNIT_TEST(testEcdsaDerive);
@@ -47,6 +48,12 @@ class DeriveTests : public TestsBase
 	CPPUNIT_TEST(testEddsaDerive);
 #endif
 	CPPUNIT_TEST(testSymDerive);
+#endif // Unsupported by Crypto API Toolkit
+	CPPUNIT_TEST(testDeriveKeyBatch);
+#ifdef WITH_EDDSA
+	CPPUNIT_TEST(testDeriveKeyBatchEcdh);
+#endif
+	CPPUNIT_TEST(testTls12KeySchedule);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -58,6 +65,11 @@ public:
 	void testEddsaDerive();
 #endif
 	void testSymDerive();
+	void testDeriveKeyBatch();
+#ifdef WITH_EDDSA
+	void testDeriveKeyBatchEcdh();
+#endif
+	void testTls12KeySchedule();
 
 protected:
 	CK_RV generateDhKeyPair(CK_SESSION_HANDLE hSession, CK_BBOOL bTokenPuk, CK_BBOOL bPrivatePuk, CK_BBOOL bTokenPrk, CK_BBOOL bPrivatePrk, CK_OBJECT_HANDLE &hPuk, CK_OBJECT_HANDLE &hPrk);
@@ -79,6 +91,9 @@ protected:
 #endif
 	bool compareSecret(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hKey1, CK_OBJECT_HANDLE hKey2);
 	void symDerive(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hKey, CK_OBJECT_HANDLE &hDerive, CK_MECHANISM_TYPE mechType, CK_KEY_TYPE keyType);
+	CK_RV createHmacKey(CK_SESSION_HANDLE hSession, CK_ULONG bytes, CK_BBOOL bSensitive, CK_OBJECT_HANDLE &hKey);
+	void hmacSha256(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hKey, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pMac);
+	void tlsPrf(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hSecret, const char* label, CK_BYTE_PTR pSeed, CK_ULONG ulSeedLen, CK_BYTE_PTR pOut, CK_ULONG ulOutLen);
 };
 
 #endif // !_SOFTHSM_V2_DERIVETESTS_H
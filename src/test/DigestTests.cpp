@@ -65,6 +65,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "DigestTests.h"
+#include "VendorDefs.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(DigestTests);
 
@@ -361,3 +362,145 @@ void DigestTests::testDigestAll()
 		free(digest);
 	}
 }
+
+void DigestTests::testDigestBatch()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_MECHANISM mechanism = { CKM_SHA384, NULL_PTR, 0 };
+	CK_MECHANISM badMechanism = { CKM_AES_ECB, NULL_PTR, 0 };
+	CK_BYTE data1[] = {"Text to digest"};
+	CK_BYTE data2[] = {"Another text to digest"};
+	CK_BYTE empty[] = {""};
+	CK_BYTE expected[3][48];
+	CK_BYTE digests[3][48];
+	CK_ULONG digestLen;
+	CK_DIGEST_BATCH_ITEM items[3] = {
+		{ data1, sizeof(data1)-1, NULL_PTR, 0, CKR_OK },
+		{ data2, sizeof(data2)-1, NULL_PTR, 0, CKR_OK },
+		{ empty, 0, NULL_PTR, 0, CKR_OK },
+	};
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Reference digests
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		rv = CRYPTOKI_F_PTR( C_DigestInit(hSession, &mechanism) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		digestLen = sizeof(expected[i]);
+		rv = CRYPTOKI_F_PTR( C_Digest(hSession, items[i].pData, items[i].ulDataLen, expected[i], &digestLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		CPPUNIT_ASSERT(digestLen == 48);
+	}
+
+	rv = C_DigestBatch(hSession, &mechanism, NULL_PTR, 3);
+	CPPUNIT_ASSERT(rv == CKR_ARGUMENTS_BAD);
+	rv = C_DigestBatch(hSession, &mechanism, items, 0);
+	CPPUNIT_ASSERT(rv == CKR_ARGUMENTS_BAD);
+	rv = C_DigestBatch(CK_INVALID_HANDLE, &mechanism, items, 3);
+	CPPUNIT_ASSERT(rv == CKR_SESSION_HANDLE_INVALID);
+	rv = C_DigestBatch(hSession, &badMechanism, items, 3);
+	CPPUNIT_ASSERT(rv == CKR_MECHANISM_INVALID);
+
+	// Size query
+	rv = C_DigestBatch(hSession, &mechanism, items, 3);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		CPPUNIT_ASSERT(items[i].rv == CKR_OK);
+		CPPUNIT_ASSERT(items[i].ulDigestLen == 48);
+		items[i].pDigest = digests[i];
+	}
+
+	// One short buffer does not stop the other records
+	items[1].ulDigestLen = 47;
+	rv = C_DigestBatch(hSession, &mechanism, items, 3);
+	CPPUNIT_ASSERT(rv == CKR_BUFFER_TOO_SMALL);
+	CPPUNIT_ASSERT(items[0].rv == CKR_OK);
+	CPPUNIT_ASSERT(items[1].rv == CKR_BUFFER_TOO_SMALL);
+	CPPUNIT_ASSERT(items[1].ulDigestLen == 48);
+	CPPUNIT_ASSERT(items[2].rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(digests[0], expected[0], 48) == 0);
+	CPPUNIT_ASSERT(memcmp(digests[2], expected[2], 48) == 0);
+
+	rv = C_DigestBatch(hSession, &mechanism, items, 3);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		CPPUNIT_ASSERT(items[i].rv == CKR_OK);
+		CPPUNIT_ASSERT(memcmp(digests[i], expected[i], 48) == 0);
+	}
+
+	// The batch does not touch an active digest operation
+	rv = CRYPTOKI_F_PTR( C_DigestInit(hSession, &mechanism) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = C_DigestBatch(hSession, &mechanism, items, 3);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	digestLen = sizeof(digests[0]);
+	rv = CRYPTOKI_F_PTR( C_Digest(hSession, data1, sizeof(data1)-1, digests[0], &digestLen) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(digests[0], expected[0], 48) == 0);
+}
+
+void DigestTests::testDigestReuse()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession1 = CK_INVALID_HANDLE;
+	CK_SESSION_HANDLE hSession2 = CK_INVALID_HANDLE;
+	CK_MECHANISM mechanism = {
+		CKM_SHA256, NULL_PTR, 0
+	};
+	CK_BYTE data[] = {"abc"};
+	CK_BYTE other[] = {"Text to digest"};
+	CK_BYTE expected[] = {
+		0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+		0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+		0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+		0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+	};
+	CK_BYTE digest[32];
+	CK_ULONG digestLen;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSession1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSession2) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Leave an operation unfinished; its algorithm instance is recycled
+	rv = CRYPTOKI_F_PTR( C_DigestInit(hSession1, &mechanism) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_DigestUpdate(hSession1, other, sizeof(other)-1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_CloseSession(hSession1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// A reused instance must start from a clean state every time
+	for (int i = 0; i < 3; i++)
+	{
+		rv = CRYPTOKI_F_PTR( C_DigestInit(hSession2, &mechanism) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		digestLen = sizeof(digest);
+		rv = CRYPTOKI_F_PTR( C_Digest(hSession2, data, sizeof(data)-1, digest, &digestLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		CPPUNIT_ASSERT(digestLen == sizeof(expected));
+		CPPUNIT_ASSERT(memcmp(digest, expected, sizeof(expected)) == 0);
+	}
+}
+
@@ -78,6 +78,8 @@ class DigestTests : public TestsNoPINInitBase
 #endif // Unsupported by Crypto API Toolkit
 	CPPUNIT_TEST(testDigestFinal);
 	CPPUNIT_TEST(testDigestAll);
+	CPPUNIT_TEST(testDigestBatch);
+	CPPUNIT_TEST(testDigestReuse);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -89,6 +91,8 @@ public:
 #endif // Unsupported by Crypto API Toolkit
 	void testDigestFinal();
 	void testDigestAll();
+	void testDigestBatch();
+	void testDigestReuse();
 };
 
 #endif // !_SOFTHSM_V2_DIGESTTESTS_H
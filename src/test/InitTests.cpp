@@ -67,6 +67,7 @@
 #include <cppunit/extensions/HelperMacros.h>
 #include "InitTests.h"
 #include "cryptoki.h"
+#include "VendorDefs.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(InitTests);
 
@@ -252,6 +253,68 @@ void InitTests::testInit6()
 	CPPUNIT_ASSERT(rv == CKR_OK);
 }
 
+void InitTests::testInit7()
+{
+	CK_C_INITIALIZE_ARGS InitArgs;
+	CK_RV rv;
+	CK_ULONG nrOfSlots;
+	CK_SLOT_ID slotID;
+	CK_TOKEN_INFO tokenInfo;
+	CK_UTF8CHAR label[32];
+
+	memset(label, ' ', 32);
+	memcpy(label, "memtoken", strlen("memtoken"));
+
+	InitArgs.CreateMutex = NULL_PTR;
+	InitArgs.DestroyMutex = NULL_PTR;
+	InitArgs.LockMutex = NULL_PTR;
+	InitArgs.UnlockMutex = NULL_PTR;
+	InitArgs.flags = CKF_OS_LOCKING_OK | CKF_MEMORY_OBJECTSTORE;
+	InitArgs.pReserved = NULL_PTR;
+
+	// Just make sure that we finalize any previous failed tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	rv = CRYPTOKI_F_PTR( C_Initialize((CK_VOID_PTR)&InitArgs) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Tokens on disk are not visible, only a single free slot is present
+	rv = CRYPTOKI_F_PTR( C_GetSlotList(CK_TRUE, NULL_PTR, &nrOfSlots) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(nrOfSlots == 1);
+
+	rv = CRYPTOKI_F_PTR( C_GetSlotList(CK_TRUE, &slotID, &nrOfSlots) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_GetTokenInfo(slotID, &tokenInfo) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT((tokenInfo.flags & CKF_TOKEN_INITIALIZED) == 0);
+
+	rv = CRYPTOKI_F_PTR( C_InitToken(slotID, m_soPin1, m_soPin1Length, label) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The memory token is gone after finalization
+	rv = CRYPTOKI_F_PTR( C_Initialize((CK_VOID_PTR)&InitArgs) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_GetSlotList(CK_TRUE, NULL_PTR, &nrOfSlots) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(nrOfSlots == 1);
+
+	rv = CRYPTOKI_F_PTR( C_GetSlotList(CK_TRUE, &slotID, &nrOfSlots) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_GetTokenInfo(slotID, &tokenInfo) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT((tokenInfo.flags & CKF_TOKEN_INITIALIZED) == 0);
+
+	rv = CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+}
+
 void InitTests::testFinal()
 {
 	CK_RV rv;
@@ -45,6 +45,7 @@ class InitTests : public TestsNoPINInitBase
 	CPPUNIT_TEST(testInit4);
 	CPPUNIT_TEST(testInit5);
 	CPPUNIT_TEST(testInit6);
+	CPPUNIT_TEST(testInit7);
 	CPPUNIT_TEST(testFinal);
 	CPPUNIT_TEST_SUITE_END();
 
@@ -55,6 +56,7 @@ public:
 	void testInit4();
 	void testInit5();
 	void testInit6();
+	void testInit7();
 	void testFinal();
 
 	virtual void setUp();
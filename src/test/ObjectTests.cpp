@@ -1549,6 +1549,301 @@ void ObjectTests::testFindObjects()
 	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSessionRW) );
 }
 
+void ObjectTests::testFindObjectsIndexed()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_HANDLE hObjectSessionPrivate;
+	CK_OBJECT_HANDLE hObjectTokenPublic;
+	CK_OBJECT_HANDLE hObjectTokenPrivate;
+	CK_OBJECT_HANDLE hObjects[16];
+	CK_ULONG ulObjectCount = 0;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Login(hSession,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	rv = createDataObjectMinimal(hSession, IN_SESSION, IS_PRIVATE, hObjectSessionPrivate);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = createDataObjectMinimal(hSession, ON_TOKEN, IS_PUBLIC, hObjectTokenPublic);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = createDataObjectMinimal(hSession, ON_TOKEN, IS_PRIVATE, hObjectTokenPrivate);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	CK_OBJECT_CLASS cClass = CKO_DATA;
+	const char *pLabel = "Indexed label";
+	const char *pOtherLabel = "Other indexed label";
+	CK_ATTRIBUTE attribs[] = {
+		{ CKA_LABEL, (CK_UTF8CHAR_PTR)pLabel, strlen(pLabel) },
+		{ CKA_CLASS, &cClass, sizeof(cClass) }
+	};
+	CK_ATTRIBUTE otherAttribs[] = {
+		{ CKA_LABEL, (CK_UTF8CHAR_PTR)pOtherLabel, strlen(pOtherLabel) },
+		{ CKA_CLASS, &cClass, sizeof(cClass) }
+	};
+
+	rv = CRYPTOKI_F_PTR( C_SetAttributeValue(hSession,hObjectSessionPrivate,&attribs[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_SetAttributeValue(hSession,hObjectTokenPublic,&attribs[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_SetAttributeValue(hSession,hObjectTokenPrivate,&attribs[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Search on the label and the class finds the public and private objects
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession,&attribs[0],2) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[0],16,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(3 == ulObjectCount);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Changing the label moves the object to the other label
+	rv = CRYPTOKI_F_PTR( C_SetAttributeValue(hSession,hObjectTokenPublic,&otherAttribs[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession,&attribs[0],2) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[0],16,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(2 == ulObjectCount);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession,&otherAttribs[0],2) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[0],16,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(1 == ulObjectCount);
+	CPPUNIT_ASSERT(hObjects[0] == hObjectTokenPublic);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Destroyed objects are no longer found
+	rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession,hObjectTokenPrivate) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession,hObjectTokenPublic) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession,&attribs[0],2) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[0],16,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(1 == ulObjectCount);
+	CPPUNIT_ASSERT(hObjects[0] == hObjectSessionPrivate);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+}
+
+void ObjectTests::testFindObjectsBlindIndex()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_HANDLE hObjectSessionPrivate;
+	CK_OBJECT_HANDLE hObjectTokenPrivate1;
+	CK_OBJECT_HANDLE hObjectTokenPrivate2;
+	CK_OBJECT_HANDLE hObjects[16];
+	CK_ULONG ulObjectCount = 0;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Login(hSession,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	rv = createDataObjectMinimal(hSession, IN_SESSION, IS_PRIVATE, hObjectSessionPrivate);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = createDataObjectMinimal(hSession, ON_TOKEN, IS_PRIVATE, hObjectTokenPrivate1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = createDataObjectMinimal(hSession, ON_TOKEN, IS_PRIVATE, hObjectTokenPrivate2);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	CK_BYTE id1[] = { 0x42, 0x4c, 0x01 };
+	CK_BYTE id2[] = { 0x42, 0x4c, 0x02 };
+	CK_ATTRIBUTE attribs1[] = {
+		{ CKA_ID, id1, sizeof(id1) }
+	};
+	CK_ATTRIBUTE attribs2[] = {
+		{ CKA_ID, id2, sizeof(id2) }
+	};
+
+	rv = CRYPTOKI_F_PTR( C_SetAttributeValue(hSession,hObjectSessionPrivate,&attribs1[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_SetAttributeValue(hSession,hObjectTokenPrivate1,&attribs1[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_SetAttributeValue(hSession,hObjectTokenPrivate2,&attribs2[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The encrypted identifiers of private objects are matched by their blind index
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession,&attribs1[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[0],16,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(2 == ulObjectCount);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession,&attribs2[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[0],16,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(1 == ulObjectCount);
+	CPPUNIT_ASSERT(hObjects[0] == hObjectTokenPrivate2);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Changing the identifier moves the object to the other blind index
+	rv = CRYPTOKI_F_PTR( C_SetAttributeValue(hSession,hObjectTokenPrivate1,&attribs2[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession,&attribs2[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[0],16,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(2 == ulObjectCount);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Private objects are not found after logging out
+	rv = CRYPTOKI_F_PTR( C_Logout(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession,&attribs2[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[0],16,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(0 == ulObjectCount);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The blind indexes are stored with the token objects
+	rv = CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_Login(hSession,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession,&attribs2[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[0],16,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(2 == ulObjectCount);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession,hObjects[0]) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession,hObjects[1]) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+}
+
+void ObjectTests::testFindObjectsPaged()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_HANDLE hObjectTokenPublic[3];
+	CK_OBJECT_HANDLE hObjects[16];
+	CK_ULONG ulObjectCount = 0;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Login(hSession,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	const char *pLabel = "Paged label";
+	CK_ATTRIBUTE attribs[] = {
+		{ CKA_LABEL, (CK_UTF8CHAR_PTR)pLabel, strlen(pLabel) }
+	};
+
+	for (int i = 0; i < 3; i++)
+	{
+		rv = createDataObjectMinimal(hSession, ON_TOKEN, IS_PUBLIC, hObjectTokenPublic[i]);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		rv = CRYPTOKI_F_PTR( C_SetAttributeValue(hSession,hObjectTokenPublic[i],&attribs[0],1) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+
+	// Asking for no objects does not advance the search
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession,&attribs[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[0],0,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(0 == ulObjectCount);
+
+	// Paging through the results returns every object once
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[0],1,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(1 == ulObjectCount);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[1],1,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(1 == ulObjectCount);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[2],16,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(1 == ulObjectCount);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[3],16,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(0 == ulObjectCount);
+	CPPUNIT_ASSERT(hObjects[0] != hObjects[1]);
+	CPPUNIT_ASSERT(hObjects[0] != hObjects[2]);
+	CPPUNIT_ASSERT(hObjects[1] != hObjects[2]);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Objects destroyed while the search is active are skipped
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession,&attribs[0],1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[0],1,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(1 == ulObjectCount);
+	for (int i = 0; i < 3; i++)
+	{
+		if (hObjectTokenPublic[i] == hObjects[0]) continue;
+
+		rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession,hObjectTokenPublic[i]) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession,&hObjects[1],16,&ulObjectCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(0 == ulObjectCount);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession,hObjects[0]) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+}
 
 void ObjectTests::testGenerateKeys()
 {
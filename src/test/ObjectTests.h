@@ -81,6 +81,9 @@ class ObjectTests : public TestsBase
 	CPPUNIT_TEST(testGetAttributeValue);
 	CPPUNIT_TEST(testSetAttributeValue);
 	CPPUNIT_TEST(testFindObjects);
+	CPPUNIT_TEST(testFindObjectsIndexed);
+	CPPUNIT_TEST(testFindObjectsBlindIndex);
+	CPPUNIT_TEST(testFindObjectsPaged);
 	CPPUNIT_TEST(testGenerateKeys);
 	CPPUNIT_TEST(testCreateCertificates);
 	CPPUNIT_TEST(testDefaultDataAttributes);
@@ -113,6 +116,9 @@ public:
 	void testGetAttributeValue();
 	void testSetAttributeValue();
 	void testFindObjects();
+	void testFindObjectsIndexed();
+	void testFindObjectsBlindIndex();
+	void testFindObjectsPaged();
 	void testGenerateKeys();
 	void testCreateCertificates();
 	void testDefaultDataAttributes();
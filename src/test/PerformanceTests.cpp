@@ -0,0 +1,1237 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*****************************************************************************
+ PerformanceTests.cpp
+
+ Contains timing tests for the batched and fused calls
+ *****************************************************************************/
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include "PerformanceTests.h"
+#include "VendorDefs.h"
+
+// Registered apart from the other suites, so that a plain ./p11test does not
+// run the timing loops; p11test only adds them when they are named
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(PerformanceTests, "PerformanceTests");
+
+// The number of token objects in the object store tests
+static const CK_ULONG nrOfTokenObjects = 100000;
+
+// Seconds since start
+static double elapsed(const struct timespec& start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Print the rate of a timed run
+static void report(const char* name, unsigned long ops, unsigned long bytes, double seconds)
+{
+	if (seconds <= 0) seconds = 1e-9;
+
+	printf("\n  %-40s %10.0f ops/s %10.1f MB/s", name, ops / seconds, bytes / seconds / (1024 * 1024));
+	fflush(stdout);
+}
+
+// Print the median and 99th percentile of single timed operations
+static void reportLatency(const char* name, std::vector<double>& seconds)
+{
+	std::sort(seconds.begin(), seconds.end());
+
+	printf("\n  %-40s p50 %9.3f ms  p99 %9.3f ms", name, seconds[seconds.size() / 2] * 1000, seconds[(seconds.size() * 99) / 100] * 1000);
+	fflush(stdout);
+}
+
+CK_RV PerformanceTests::openUserSession(CK_SESSION_HANDLE& hSession)
+{
+	CK_RV rv;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	if (rv != CKR_OK) return rv;
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	if (rv != CKR_OK) return rv;
+
+	return CRYPTOKI_F_PTR( C_Login(hSession, CKU_USER, m_userPin1, m_userPin1Length) );
+}
+
+// Open a user session on a new token of the in-memory object store
+CK_RV PerformanceTests::openMemoryUserSession(CK_SESSION_HANDLE& hSession)
+{
+	CK_C_INITIALIZE_ARGS InitArgs = { NULL_PTR, NULL_PTR, NULL_PTR, NULL_PTR, CKF_OS_LOCKING_OK | CKF_MEMORY_OBJECTSTORE, NULL_PTR };
+	CK_UTF8CHAR label[32];
+	CK_SLOT_ID slotID;
+	CK_ULONG nrOfSlots = 1;
+	CK_RV rv;
+
+	memset(label, ' ', sizeof(label));
+	memcpy(label, "memtoken", strlen("memtoken"));
+
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	rv = CRYPTOKI_F_PTR( C_Initialize((CK_VOID_PTR)&InitArgs) );
+	if (rv != CKR_OK) return rv;
+
+	rv = CRYPTOKI_F_PTR( C_GetSlotList(CK_TRUE, &slotID, &nrOfSlots) );
+	if (rv != CKR_OK) return rv;
+
+	rv = CRYPTOKI_F_PTR( C_InitToken(slotID, m_soPin1, m_soPin1Length, label) );
+	if (rv != CKR_OK) return rv;
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(slotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	if (rv != CKR_OK) return rv;
+
+	rv = CRYPTOKI_F_PTR( C_Login(hSession, CKU_SO, m_soPin1, m_soPin1Length) );
+	if (rv != CKR_OK) return rv;
+
+	rv = CRYPTOKI_F_PTR( C_InitPIN(hSession, m_userPin1, m_userPin1Length) );
+	if (rv != CKR_OK) return rv;
+
+	rv = CRYPTOKI_F_PTR( C_Logout(hSession) );
+	if (rv != CKR_OK) return rv;
+
+	return CRYPTOKI_F_PTR( C_Login(hSession, CKU_USER, m_userPin1, m_userPin1Length) );
+}
+
+CK_RV PerformanceTests::generateAesKey(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE &hKey)
+{
+	CK_MECHANISM mechanism = { CKM_AES_KEY_GEN, NULL_PTR, 0 };
+	CK_ULONG bytes = 32;
+	CK_BBOOL bFalse = CK_FALSE;
+	CK_BBOOL bTrue = CK_TRUE;
+
+	CK_ATTRIBUTE keyAttribs[] = {
+		{ CKA_TOKEN, &bFalse, sizeof(bFalse) },
+		{ CKA_PRIVATE, &bFalse, sizeof(bFalse) },
+		{ CKA_ENCRYPT, &bTrue, sizeof(bTrue) },
+		{ CKA_DECRYPT, &bTrue, sizeof(bTrue) },
+		{ CKA_VALUE_LEN, &bytes, sizeof(bytes) },
+	};
+
+	hKey = CK_INVALID_HANDLE;
+	return CRYPTOKI_F_PTR( C_GenerateKey(hSession, &mechanism,
+					     keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE),
+					     &hKey) );
+}
+
+// Single-part encryption into a buffer of the size the token asks for
+CK_RV PerformanceTests::encryptAll(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey, std::vector<CK_BYTE>& in, std::vector<CK_BYTE>& out)
+{
+	CK_RV rv;
+	CK_ULONG ulLen = 0;
+
+	rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession, pMechanism, hKey) );
+	if (rv != CKR_OK) return rv;
+
+	rv = CRYPTOKI_F_PTR( C_Encrypt(hSession, &in[0], in.size(), NULL_PTR, &ulLen) );
+	if (rv != CKR_OK) return rv;
+
+	out.resize(ulLen);
+	rv = CRYPTOKI_F_PTR( C_Encrypt(hSession, &in[0], in.size(), &out[0], &ulLen) );
+	out.resize(ulLen);
+
+	return rv;
+}
+
+// Multi-part decryption in parts of partLen bytes; firstOutput receives the
+// number of bytes passed in before the first plaintext came back
+CK_RV PerformanceTests::decryptInParts(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey, std::vector<CK_BYTE>& in, CK_ULONG partLen, std::vector<CK_BYTE>& out, CK_ULONG& firstOutput)
+{
+	CK_RV rv;
+	CK_ULONG ulOutLen = 0;
+	CK_ULONG ulLen;
+
+	out.resize(in.size());
+	firstOutput = 0;
+
+	rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession, pMechanism, hKey) );
+	if (rv != CKR_OK) return rv;
+
+	for (CK_ULONG i = 0; i < in.size(); i += partLen)
+	{
+		CK_ULONG ulPartLen = (in.size() - i < partLen) ? in.size() - i : partLen;
+
+		ulLen = out.size() - ulOutLen;
+		rv = CRYPTOKI_F_PTR( C_DecryptUpdate(hSession, &in[i], ulPartLen, &out[ulOutLen], &ulLen) );
+		if (rv != CKR_OK) return rv;
+
+		if (ulOutLen == 0 && ulLen > 0) firstOutput = i + ulPartLen;
+		ulOutLen += ulLen;
+	}
+
+	ulLen = out.size() - ulOutLen;
+	rv = CRYPTOKI_F_PTR( C_DecryptFinal(hSession, &out[ulOutLen], &ulLen) );
+	if (rv != CKR_OK) return rv;
+
+	if (ulOutLen == 0) firstOutput = in.size();
+	ulOutLen += ulLen;
+	out.resize(ulOutLen);
+
+	return CKR_OK;
+}
+
+// Generate an RSA key pair in the session; with primes 0 the token picks
+// the number of primes
+CK_RV PerformanceTests::generateRsaKeyPair(CK_SESSION_HANDLE hSession, CK_ULONG bits, CK_OBJECT_HANDLE &hPuk, CK_OBJECT_HANDLE &hPrk, CK_ULONG primes)
+{
+	CK_MECHANISM mechanism = { CKM_RSA_PKCS_KEY_PAIR_GEN, NULL_PTR, 0 };
+	CK_RSA_MULTI_PRIME_KEY_GEN_PARAMS params = { primes };
+	if (primes != 0)
+	{
+		mechanism.pParameter = &params;
+		mechanism.ulParameterLen = sizeof(params);
+	}
+	CK_BYTE pubExp[] = { 0x01, 0x00, 0x01 };
+	CK_BBOOL bFalse = CK_FALSE;
+	CK_BBOOL bTrue = CK_TRUE;
+
+	CK_ATTRIBUTE pukAttribs[] = {
+		{ CKA_TOKEN, &bFalse, sizeof(bFalse) },
+		{ CKA_VERIFY, &bTrue, sizeof(bTrue) },
+		{ CKA_MODULUS_BITS, &bits, sizeof(bits) },
+		{ CKA_PUBLIC_EXPONENT, pubExp, sizeof(pubExp) },
+	};
+	CK_ATTRIBUTE prkAttribs[] = {
+		{ CKA_TOKEN, &bFalse, sizeof(bFalse) },
+		{ CKA_PRIVATE, &bTrue, sizeof(bTrue) },
+		{ CKA_SENSITIVE, &bTrue, sizeof(bTrue) },
+		{ CKA_SIGN, &bTrue, sizeof(bTrue) },
+	};
+
+	hPuk = CK_INVALID_HANDLE;
+	hPrk = CK_INVALID_HANDLE;
+	return CRYPTOKI_F_PTR( C_GenerateKeyPair(hSession, &mechanism,
+						 pukAttribs, sizeof(pukAttribs)/sizeof(CK_ATTRIBUTE),
+						 prkAttribs, sizeof(prkAttribs)/sizeof(CK_ATTRIBUTE),
+						 &hPuk, &hPrk) );
+}
+
+#ifdef WITH_ECC
+// Generate a P-256 key pair in the session
+CK_RV PerformanceTests::generateEcKeyPair(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE &hPuk, CK_OBJECT_HANDLE &hPrk)
+{
+	CK_MECHANISM mechanism = { CKM_EC_KEY_PAIR_GEN, NULL_PTR, 0 };
+	CK_BYTE oidP256[] = { 0x06, 0x08, 0x2A, 0x86, 0x48, 0xCE, 0x3D, 0x03, 0x01, 0x07 };
+	CK_BBOOL bFalse = CK_FALSE;
+	CK_BBOOL bTrue = CK_TRUE;
+
+	CK_ATTRIBUTE pukAttribs[] = {
+		{ CKA_EC_PARAMS, oidP256, sizeof(oidP256) },
+		{ CKA_TOKEN, &bFalse, sizeof(bFalse) },
+		{ CKA_VERIFY, &bTrue, sizeof(bTrue) },
+	};
+	CK_ATTRIBUTE prkAttribs[] = {
+		{ CKA_TOKEN, &bFalse, sizeof(bFalse) },
+		{ CKA_PRIVATE, &bTrue, sizeof(bTrue) },
+		{ CKA_SENSITIVE, &bTrue, sizeof(bTrue) },
+		{ CKA_SIGN, &bTrue, sizeof(bTrue) },
+	};
+
+	hPuk = CK_INVALID_HANDLE;
+	hPrk = CK_INVALID_HANDLE;
+	return CRYPTOKI_F_PTR( C_GenerateKeyPair(hSession, &mechanism,
+						 pukAttribs, sizeof(pukAttribs)/sizeof(CK_ATTRIBUTE),
+						 prkAttribs, sizeof(prkAttribs)/sizeof(CK_ATTRIBUTE),
+						 &hPuk, &hPrk) );
+}
+#endif
+
+// Generate count AES keys on the token; the CKA_ID of each key is its
+// index in handles
+CK_RV PerformanceTests::createTokenKeys(CK_SESSION_HANDLE hSession, CK_ULONG count, std::vector<CK_OBJECT_HANDLE>& handles)
+{
+	CK_RV rv;
+	CK_MECHANISM mechanism = { CKM_AES_KEY_GEN, NULL_PTR, 0 };
+	CK_ULONG bytes = 16;
+	CK_ULONG id;
+	CK_BBOOL bFalse = CK_FALSE;
+	CK_BBOOL bTrue = CK_TRUE;
+
+	CK_ATTRIBUTE keyAttribs[] = {
+		{ CKA_TOKEN, &bTrue, sizeof(bTrue) },
+		{ CKA_PRIVATE, &bFalse, sizeof(bFalse) },
+		{ CKA_ENCRYPT, &bTrue, sizeof(bTrue) },
+		{ CKA_VALUE_LEN, &bytes, sizeof(bytes) },
+		{ CKA_ID, &id, sizeof(id) },
+	};
+
+	handles.resize(count, CK_INVALID_HANDLE);
+
+	for (id = 0; id < count; id++)
+	{
+		rv = CRYPTOKI_F_PTR( C_GenerateKey(hSession, &mechanism,
+						   keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE),
+						   &handles[id]) );
+		if (rv != CKR_OK) return rv;
+	}
+
+	return CKR_OK;
+}
+
+void PerformanceTests::testDigestBatchThroughput()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_MECHANISM mechanism = { CKM_SHA256, NULL_PTR, 0 };
+	struct timespec start;
+
+	// Many short records, as in a transparency log
+	const CK_ULONG nrOfRecords = 5000;
+	const CK_ULONG recordLen = 64;
+	const CK_ULONG batchSize = 500;
+
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	std::vector<CK_BYTE> data(nrOfRecords * recordLen);
+	std::vector<CK_BYTE> single(nrOfRecords * 32);
+	std::vector<CK_BYTE> batched(nrOfRecords * 32);
+	std::vector<CK_DIGEST_BATCH_ITEM> items(nrOfRecords);
+
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, &data[0], data.size()) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Two calls per record
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (CK_ULONG i = 0; i < nrOfRecords; i++)
+	{
+		CK_ULONG ulLen = 32;
+
+		rv = CRYPTOKI_F_PTR( C_DigestInit(hSession, &mechanism) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		rv = CRYPTOKI_F_PTR( C_Digest(hSession, &data[i * recordLen], recordLen, &single[i * 32], &ulLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+	report("C_DigestInit + C_Digest", nrOfRecords, data.size(), elapsed(start));
+
+	// One call per batch
+	for (CK_ULONG i = 0; i < nrOfRecords; i++)
+	{
+		CK_DIGEST_BATCH_ITEM item = { &data[i * recordLen], recordLen, &batched[i * 32], 32, CKR_GENERAL_ERROR };
+		items[i] = item;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (CK_ULONG i = 0; i < nrOfRecords; i += batchSize)
+	{
+		rv = C_DigestBatch(hSession, &mechanism, &items[i], batchSize);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+	report("C_DigestBatch (500 per call)", nrOfRecords, data.size(), elapsed(start));
+
+	CPPUNIT_ASSERT(single == batched);
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+// Short operations spend most of their time setting up the algorithm; build
+// with ALGORITHM_POOL_SIZE=0 for the rates without pooled instances. Only
+// the rates are printed: the allocations happen inside the enclave, where
+// this program cannot count them.
+void PerformanceTests::testShortOperationRate()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_HANDLE hKey;
+	CK_BYTE iv[16];
+	CK_MECHANISM cbc = { CKM_AES_CBC, iv, sizeof(iv) };
+	CK_MECHANISM sha256 = { CKM_SHA256, NULL_PTR, 0 };
+	struct timespec start;
+	CK_BYTE data[64];
+	CK_BYTE first[64];
+	CK_BYTE out[64];
+	CK_ULONG ulLen;
+
+	const CK_ULONG nrOfOperations = 5000;
+
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = generateAesKey(hSession, hKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, iv, sizeof(iv)) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, data, sizeof(data)) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (CK_ULONG i = 0; i < nrOfOperations; i++)
+	{
+		rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession, &cbc, hKey) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		ulLen = sizeof(out);
+		rv = CRYPTOKI_F_PTR( C_Encrypt(hSession, data, sizeof(data), out, &ulLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		CPPUNIT_ASSERT(ulLen == sizeof(data));
+
+		// A reused instance gives the same result
+		if (i == 0) memcpy(first, out, ulLen);
+		CPPUNIT_ASSERT(memcmp(first, out, ulLen) == 0);
+	}
+	report("AES-CBC of 64 bytes", nrOfOperations, nrOfOperations * sizeof(data), elapsed(start));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (CK_ULONG i = 0; i < nrOfOperations; i++)
+	{
+		rv = CRYPTOKI_F_PTR( C_DigestInit(hSession, &sha256) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		ulLen = sizeof(out);
+		rv = CRYPTOKI_F_PTR( C_Digest(hSession, data, sizeof(data), out, &ulLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		CPPUNIT_ASSERT(ulLen == 32);
+
+		if (i == 0) memcpy(first, out, ulLen);
+		CPPUNIT_ASSERT(memcmp(first, out, ulLen) == 0);
+	}
+	report("SHA-256 of 64 bytes", nrOfOperations, nrOfOperations * sizeof(data), elapsed(start));
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+// The three ways random data is served: from the buffer, by one generate
+// call, and by generate calls whose output is produced outside the lock
+void PerformanceTests::testRandomThroughput()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	struct timespec start;
+	const CK_ULONG sizes[] = { 32, 4096, 4 * 1024 * 1024 };
+	const CK_ULONG counts[] = { 20000, 2000, 10 };
+	const char* names[] = { "C_GenerateRandom 32 bytes", "C_GenerateRandom 4 KB", "C_GenerateRandom 4 MB" };
+
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	for (size_t n = 0; n < sizeof(sizes)/sizeof(sizes[0]); n++)
+	{
+		std::vector<CK_BYTE> first(sizes[n]);
+		std::vector<CK_BYTE> out(sizes[n]);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (CK_ULONG i = 0; i < counts[n]; i++)
+		{
+			rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, &out[0], out.size()) );
+			CPPUNIT_ASSERT(rv == CKR_OK);
+
+			if (i == 0) first = out;
+		}
+		report(names[n], counts[n], counts[n] * sizes[n], elapsed(start));
+
+		// No output is handed out twice
+		CPPUNIT_ASSERT(first != out);
+	}
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+void PerformanceTests::testDualFunctionThroughput()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_SESSION_HANDLE hDigestSession;
+	CK_OBJECT_HANDLE hKey;
+	CK_BYTE iv[16] = { 0 };
+	CK_MECHANISM cbc = { CKM_AES_CBC, iv, sizeof(iv) };
+	CK_MECHANISM sha256 = { CKM_SHA256, NULL_PTR, 0 };
+	struct timespec start;
+	CK_BYTE separateDigest[32];
+	CK_BYTE fusedDigest[32];
+	CK_BYTE tail[16];
+	CK_ULONG ulLen;
+
+	const CK_ULONG dataLen = 4 * 1024 * 1024;
+	const CK_ULONG partLen = 64 * 1024;
+
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hDigestSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = generateAesKey(hSession, hKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	std::vector<CK_BYTE> data(dataLen);
+	std::vector<CK_BYTE> separate(dataLen);
+	std::vector<CK_BYTE> fused(dataLen);
+
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, &data[0], data.size()) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Two calls per part, each passing the part in
+	rv = CRYPTOKI_F_PTR( C_DigestInit(hDigestSession, &sha256) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession, &cbc, hKey) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (CK_ULONG i = 0; i < dataLen; i += partLen)
+	{
+		rv = CRYPTOKI_F_PTR( C_DigestUpdate(hDigestSession, &data[i], partLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		ulLen = partLen;
+		rv = CRYPTOKI_F_PTR( C_EncryptUpdate(hSession, &data[i], partLen, &separate[i], &ulLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+	ulLen = sizeof(tail);
+	rv = CRYPTOKI_F_PTR( C_EncryptFinal(hSession, tail, &ulLen) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	ulLen = sizeof(separateDigest);
+	rv = CRYPTOKI_F_PTR( C_DigestFinal(hDigestSession, separateDigest, &ulLen) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	report("C_DigestUpdate + C_EncryptUpdate", dataLen / partLen, dataLen, elapsed(start));
+
+	// One call per part
+	rv = CRYPTOKI_F_PTR( C_DigestInit(hSession, &sha256) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession, &cbc, hKey) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (CK_ULONG i = 0; i < dataLen; i += partLen)
+	{
+		ulLen = partLen;
+		rv = CRYPTOKI_F_PTR( C_DigestEncryptUpdate(hSession, &data[i], partLen, &fused[i], &ulLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+	ulLen = sizeof(tail);
+	rv = CRYPTOKI_F_PTR( C_EncryptFinal(hSession, tail, &ulLen) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	ulLen = sizeof(fusedDigest);
+	rv = CRYPTOKI_F_PTR( C_DigestFinal(hSession, fusedDigest, &ulLen) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	report("C_DigestEncryptUpdate", dataLen / partLen, dataLen, elapsed(start));
+
+	CPPUNIT_ASSERT(separate == fused);
+	CPPUNIT_ASSERT(memcmp(separateDigest, fusedDigest, sizeof(fusedDigest)) == 0);
+
+	CRYPTOKI_F_PTR( C_CloseSession(hDigestSession) );
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+// The key schedule of a TLS 1.2 handshake with AES-128-GCM: the master
+// secret, the traffic keys and IVs, and the Finished verify data of both
+// sides. The verify data is also timed against the TLS PRF done with C_Sign
+void PerformanceTests::testTlsHandshakeRate()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	struct timespec start;
+	CK_BYTE randoms[64];
+	CK_BYTE handshakeHash[32];
+	CK_BYTE clientFinished[12];
+	CK_BYTE serverFinished[12];
+	CK_BYTE clientIV[4];
+	CK_BYTE serverIV[4];
+	CK_BYTE input[32 + 15 + sizeof(handshakeHash)];
+	CK_BYTE a[32];
+	CK_BYTE block[32];
+	CK_ULONG ulLen;
+
+	const CK_ULONG nrOfHandshakes = 500;
+	const CK_ULONG nrOfOperations = 5000;
+
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, randoms, sizeof(randoms)) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, handshakeHash, sizeof(handshakeHash)) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The pre-master secret; C_CreateObject generates the value of HMAC keys
+	CK_OBJECT_CLASS secretClass = CKO_SECRET_KEY;
+	CK_KEY_TYPE hmacKeyType = CKK_SHA256_HMAC;
+	CK_KEY_TYPE aesKeyType = CKK_AES;
+	CK_ULONG preMasterLen = 48;
+	CK_BBOOL bFalse = CK_FALSE;
+	CK_BBOOL bTrue = CK_TRUE;
+	CK_ATTRIBUTE preMasterAttribs[] = {
+		{ CKA_CLASS, &secretClass, sizeof(secretClass) },
+		{ CKA_KEY_TYPE, &hmacKeyType, sizeof(hmacKeyType) },
+		{ CKA_TOKEN, &bFalse, sizeof(bFalse) },
+		{ CKA_PRIVATE, &bFalse, sizeof(bFalse) },
+		{ CKA_DERIVE, &bTrue, sizeof(bTrue) },
+		{ CKA_VALUE_LEN, &preMasterLen, sizeof(preMasterLen) }
+	};
+	CK_OBJECT_HANDLE hPreMaster = CK_INVALID_HANDLE;
+	rv = CRYPTOKI_F_PTR( C_CreateObject(hSession, preMasterAttribs, sizeof(preMasterAttribs)/sizeof(CK_ATTRIBUTE), &hPreMaster) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	CK_TLS12_MASTER_KEY_DERIVE_PARAMS masterParams;
+	masterParams.RandomInfo.pClientRandom = randoms;
+	masterParams.RandomInfo.ulClientRandomLen = 32;
+	masterParams.RandomInfo.pServerRandom = randoms + 32;
+	masterParams.RandomInfo.ulServerRandomLen = 32;
+	masterParams.pVersion = NULL_PTR;
+	masterParams.prfHashMechanism = CKM_SHA256;
+	CK_MECHANISM masterMechanism = { CKM_TLS12_MASTER_KEY_DERIVE, &masterParams, sizeof(masterParams) };
+	CK_ATTRIBUTE masterAttribs[] = {
+		{ CKA_PRIVATE, &bFalse, sizeof(bFalse) },
+		{ CKA_SENSITIVE, &bTrue, sizeof(bTrue) },
+		{ CKA_EXTRACTABLE, &bFalse, sizeof(bFalse) },
+		{ CKA_SIGN, &bTrue, sizeof(bTrue) },
+		{ CKA_DERIVE, &bTrue, sizeof(bTrue) }
+	};
+
+	CK_SSL3_KEY_MAT_OUT keyMat = { CK_INVALID_HANDLE, CK_INVALID_HANDLE, CK_INVALID_HANDLE, CK_INVALID_HANDLE, clientIV, serverIV };
+	CK_TLS12_KEY_MAT_PARAMS keyMatParams;
+	keyMatParams.ulMacSizeInBits = 0;
+	keyMatParams.ulKeySizeInBits = 128;
+	keyMatParams.ulIVSizeInBits = 32;
+	keyMatParams.bIsExport = CK_FALSE;
+	keyMatParams.RandomInfo = masterParams.RandomInfo;
+	keyMatParams.pReturnedKeyMaterial = &keyMat;
+	keyMatParams.prfHashMechanism = CKM_SHA256;
+	CK_MECHANISM keyMatMechanism = { CKM_TLS12_KEY_AND_MAC_DERIVE, &keyMatParams, sizeof(keyMatParams) };
+	CK_ATTRIBUTE keyAttribs[] = {
+		{ CKA_KEY_TYPE, &aesKeyType, sizeof(aesKeyType) },
+		{ CKA_PRIVATE, &bFalse, sizeof(bFalse) },
+		{ CKA_ENCRYPT, &bTrue, sizeof(bTrue) },
+		{ CKA_DECRYPT, &bTrue, sizeof(bTrue) }
+	};
+
+	CK_BYTE clientLabel[] = "client finished";
+	CK_BYTE serverLabel[] = "server finished";
+	CK_TLS_PRF_PARAMS clientParams = { handshakeHash, sizeof(handshakeHash), clientLabel, sizeof(clientLabel) - 1, NULL_PTR, NULL_PTR };
+	CK_TLS_PRF_PARAMS serverParams = { handshakeHash, sizeof(handshakeHash), serverLabel, sizeof(serverLabel) - 1, NULL_PTR, NULL_PTR };
+	CK_MECHANISM clientMechanism = { CKM_TLS12_PRF_SHA256, &clientParams, sizeof(clientParams) };
+	CK_MECHANISM serverMechanism = { CKM_TLS12_PRF_SHA256, &serverParams, sizeof(serverParams) };
+
+	CK_DERIVE_BATCH_ITEM item;
+	CK_OBJECT_HANDLE hMaster = CK_INVALID_HANDLE;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (CK_ULONG i = 0; i < nrOfHandshakes; i++)
+	{
+		memset(&item, 0, sizeof(item));
+		rv = C_DeriveKeyBatch(hSession, &masterMechanism, hPreMaster, masterAttribs, sizeof(masterAttribs)/sizeof(CK_ATTRIBUTE), &item, 1);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		hMaster = item.hKey;
+
+		memset(&item, 0, sizeof(item));
+		rv = C_DeriveKeyBatch(hSession, &keyMatMechanism, hMaster, keyAttribs, sizeof(keyAttribs)/sizeof(CK_ATTRIBUTE), &item, 1);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		memset(&item, 0, sizeof(item));
+		item.pValue = clientFinished;
+		item.ulValueLen = sizeof(clientFinished);
+		rv = C_DeriveKeyBatch(hSession, &clientMechanism, hMaster, NULL_PTR, 0, &item, 1);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		item.pValue = serverFinished;
+		rv = C_DeriveKeyBatch(hSession, &serverMechanism, hMaster, NULL_PTR, 0, &item, 1);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession, keyMat.hClientKey) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession, keyMat.hServerKey) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		// The last master secret is kept for the Finished timing below
+		if (i + 1 == nrOfHandshakes) break;
+		rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession, hMaster) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+	report("TLS 1.2 handshake key schedule", nrOfHandshakes, 0, elapsed(start));
+
+	// Finished verify data with C_DeriveKeyBatch
+	CK_BYTE fastFinished[12];
+	memset(&item, 0, sizeof(item));
+	item.pValue = fastFinished;
+	item.ulValueLen = sizeof(fastFinished);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (CK_ULONG i = 0; i < nrOfOperations; i++)
+	{
+		rv = C_DeriveKeyBatch(hSession, &clientMechanism, hMaster, NULL_PTR, 0, &item, 1);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+	report("Finished with C_DeriveKeyBatch", nrOfOperations, 0, elapsed(start));
+
+	// The same with C_Sign: A(1) = HMAC(master, seed), HMAC(master, A(1) || seed)
+	CK_MECHANISM hmac = { CKM_SHA256_HMAC, NULL_PTR, 0 };
+	CK_ULONG seedLen = sizeof(clientLabel) - 1 + sizeof(handshakeHash);
+	memcpy(input + 32, clientLabel, sizeof(clientLabel) - 1);
+	memcpy(input + 32 + sizeof(clientLabel) - 1, handshakeHash, sizeof(handshakeHash));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (CK_ULONG i = 0; i < nrOfOperations; i++)
+	{
+		rv = CRYPTOKI_F_PTR( C_SignInit(hSession, &hmac, hMaster) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		ulLen = sizeof(a);
+		rv = CRYPTOKI_F_PTR( C_Sign(hSession, input + 32, seedLen, a, &ulLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		memcpy(input, a, sizeof(a));
+		rv = CRYPTOKI_F_PTR( C_SignInit(hSession, &hmac, hMaster) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		ulLen = sizeof(block);
+		rv = CRYPTOKI_F_PTR( C_Sign(hSession, input, 32 + seedLen, block, &ulLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+	report("Finished with C_Sign", nrOfOperations, 0, elapsed(start));
+
+	CPPUNIT_ASSERT(memcmp(fastFinished, block, sizeof(fastFinished)) == 0);
+	CPPUNIT_ASSERT(memcmp(fastFinished, clientFinished, sizeof(fastFinished)) == 0);
+	CPPUNIT_ASSERT(memcmp(serverFinished, clientFinished, sizeof(serverFinished)) != 0);
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+// The token object store at 100k objects: creating the objects one commit
+// at a time, loading them again on C_Initialize and destroying them. The
+// backend is the one the library was configured with
+// (--with-objectstore-backend=file or log)
+void PerformanceTests::testTokenObjectScaling()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_CLASS keyClass = CKO_SECRET_KEY;
+	CK_ATTRIBUTE findTemplate[] = {
+		{ CKA_CLASS, &keyClass, sizeof(keyClass) },
+	};
+	std::vector<CK_OBJECT_HANDLE> handles;
+	std::vector<CK_OBJECT_HANDLE> found(nrOfTokenObjects + 1);
+	struct timespec start;
+	CK_ULONG ulCount;
+
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rv = createTokenKeys(hSession, nrOfTokenObjects, handles);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	report("C_GenerateKey on the token", nrOfTokenObjects, 0, elapsed(start));
+
+	// The objects are read back when the token is accessed again
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession, findTemplate, sizeof(findTemplate)/sizeof(CK_ATTRIBUTE)) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession, &found[0], found.size(), &ulCount) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	report("Token objects loaded", ulCount, 0, elapsed(start));
+	CPPUNIT_ASSERT(ulCount == nrOfTokenObjects);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (CK_ULONG i = 0; i < ulCount; i++)
+	{
+		rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession, found[i]) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+	report("C_DestroyObject on the token", ulCount, 0, elapsed(start));
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+// C_FindObjectsInit by CKA_CLASS and CKA_ID among 100k token objects, in
+// the object store the library was configured with and in the in-memory
+// store. The log and memory stores keep an attribute index; the file store
+// only keeps it when built with --disable-multiprocess-support, otherwise
+// its time is that of a scan over all objects
+void PerformanceTests::testFindLatency()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_CLASS keyClass = CKO_SECRET_KEY;
+	CK_ULONG id;
+	CK_ATTRIBUTE findTemplate[] = {
+		{ CKA_CLASS, &keyClass, sizeof(keyClass) },
+		{ CKA_ID, &id, sizeof(id) },
+	};
+	std::vector<CK_OBJECT_HANDLE> handles;
+	std::vector<double> samples(1000);
+	struct timespec start;
+	CK_OBJECT_HANDLE hFound[2];
+	CK_ULONG ulCount;
+
+	const char* names[] = { "C_FindObjects by CKA_ID, configured store", "C_FindObjects by CKA_ID, memory store" };
+
+	for (int store = 0; store < 2; store++)
+	{
+		rv = (store == 0) ? openUserSession(hSession) : openMemoryUserSession(hSession);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		rv = createTokenKeys(hSession, nrOfTokenObjects, handles);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			// Spread the lookups over the whole token
+			id = (i * 7919) % nrOfTokenObjects;
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession, findTemplate, sizeof(findTemplate)/sizeof(CK_ATTRIBUTE)) );
+			CPPUNIT_ASSERT(rv == CKR_OK);
+			rv = CRYPTOKI_F_PTR( C_FindObjects(hSession, hFound, 2, &ulCount) );
+			CPPUNIT_ASSERT(rv == CKR_OK);
+			rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+			CPPUNIT_ASSERT(rv == CKR_OK);
+			samples[i] = elapsed(start);
+
+			CPPUNIT_ASSERT(ulCount == 1);
+			CPPUNIT_ASSERT(hFound[0] == handles[id]);
+		}
+		reportLatency(names[store], samples);
+
+		CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+	}
+
+	// Leave the configured store to the next test
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+}
+
+#ifdef WITH_ECC
+// P-256 CKM_ECDSA signatures as on the TLS handshake path, each with a
+// precomputed nonce; C_PrecomputePools tops the pool up between the timed
+// signatures. Build with ECDSA_NONCE_POOL_SIZE=0 for the latency with the
+// nonce computed inline
+void PerformanceTests::testEcdsaSignLatency()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_HANDLE hPuk;
+	CK_OBJECT_HANDLE hPrk;
+	CK_MECHANISM mechanism = { CKM_ECDSA, NULL_PTR, 0 };
+	CK_BYTE hash[32];
+	CK_BYTE signature[64];
+	std::vector<double> samples(2000);
+	struct timespec start;
+	CK_ULONG ulLen;
+	CK_ULONG ulCount;
+
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = generateEcKeyPair(hSession, hPuk, hPrk);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, hash, sizeof(hash)) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		rv = C_PrecomputePools(1, &ulCount);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		rv = CRYPTOKI_F_PTR( C_SignInit(hSession, &mechanism, hPrk) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		ulLen = sizeof(signature);
+		rv = CRYPTOKI_F_PTR( C_Sign(hSession, hash, sizeof(hash), signature, &ulLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		samples[i] = elapsed(start);
+	}
+	reportLatency("CKM_ECDSA P-256 sign", samples);
+
+	// The last signature is valid
+	rv = CRYPTOKI_F_PTR( C_VerifyInit(hSession, &mechanism, hPuk) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_Verify(hSession, hash, sizeof(hash), signature, ulLen) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+#endif
+
+// C_GenerateKeyPair of 2048 and 3072-bit RSA keys. When built with
+// --enable-rsa-key-pool, C_PrecomputePools puts a key pair in the pool
+// between the timed calls, so every call is served from the pool; otherwise
+// every key pair is generated inline
+void PerformanceTests::testRsaKeyGenLatency()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_HANDLE hPuk;
+	CK_OBJECT_HANDLE hPrk;
+	std::vector<double> samples(20);
+	struct timespec start;
+	CK_ULONG ulCount;
+	CK_ULONG ulPooled;
+	char name[64];
+
+	const CK_ULONG sizes[] = { 2048, 3072 };
+
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	for (size_t n = 0; n < sizeof(sizes)/sizeof(sizes[0]); n++)
+	{
+		// The first key pair of a size lets the pool know the size
+		rv = generateRsaKeyPair(hSession, sizes[n], hPuk, hPrk);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		// Fill all pools, so that the entries added below are key pairs
+		// that replace the ones taken
+		rv = C_PrecomputePools(1024, &ulCount);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		ulPooled = 0;
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			rv = C_PrecomputePools(64, &ulCount);
+			CPPUNIT_ASSERT(rv == CKR_OK);
+			ulPooled += ulCount;
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			rv = generateRsaKeyPair(hSession, sizes[n], hPuk, hPrk);
+			CPPUNIT_ASSERT(rv == CKR_OK);
+			samples[i] = elapsed(start);
+
+			rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession, hPuk) );
+			CPPUNIT_ASSERT(rv == CKR_OK);
+			rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession, hPrk) );
+			CPPUNIT_ASSERT(rv == CKR_OK);
+		}
+
+		snprintf(name, sizeof(name), "RSA-%lu key pair, %s", sizes[n], (ulPooled > 0) ? "pooled" : "inline");
+		reportLatency(name, samples);
+	}
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+// CKM_SHA256_RSA_PKCS signatures with 2, 3 and 4-prime keys. OpenSSL
+// allows 3 primes from 1024 bits and 4 primes from 4096 bits; the prime
+// counts it rejects for a modulus size are skipped
+void PerformanceTests::testRsaMultiPrimeSignThroughput()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_HANDLE hPuk;
+	CK_OBJECT_HANDLE hPrk;
+	CK_MECHANISM mechanism = { CKM_SHA256_RSA_PKCS, NULL_PTR, 0 };
+	CK_BYTE data[64];
+	CK_BYTE signature[512];
+	struct timespec start;
+	CK_ULONG ulLen;
+	char name[64];
+
+	const CK_ULONG sizes[] = { 2048, 3072, 4096 };
+	const CK_ULONG nrOfSignatures = 200;
+
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, data, sizeof(data)) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	for (size_t n = 0; n < sizeof(sizes)/sizeof(sizes[0]); n++)
+	{
+		for (CK_ULONG primes = 2; primes <= 4; primes++)
+		{
+			// The limit of RSA_generate_multi_prime_key
+			CK_ULONG maxPrimes = (sizes[n] < 1024) ? 2 : (sizes[n] < 4096) ? 3 : 4;
+
+			snprintf(name, sizeof(name), "RSA-%lu sign, %lu primes", sizes[n], primes);
+
+			if (primes > maxPrimes)
+			{
+				printf("\n  %-40s skipped, OpenSSL allows %lu primes", name, maxPrimes);
+				continue;
+			}
+
+			rv = generateRsaKeyPair(hSession, sizes[n], hPuk, hPrk, primes);
+			CPPUNIT_ASSERT(rv == CKR_OK);
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			for (CK_ULONG i = 0; i < nrOfSignatures; i++)
+			{
+				rv = CRYPTOKI_F_PTR( C_SignInit(hSession, &mechanism, hPrk) );
+				CPPUNIT_ASSERT(rv == CKR_OK);
+				ulLen = sizeof(signature);
+				rv = CRYPTOKI_F_PTR( C_Sign(hSession, data, sizeof(data), signature, &ulLen) );
+				CPPUNIT_ASSERT(rv == CKR_OK);
+			}
+			report(name, nrOfSignatures, nrOfSignatures * sizeof(data), elapsed(start));
+
+			// The signature of a multi-prime key verifies like any other
+			rv = CRYPTOKI_F_PTR( C_VerifyInit(hSession, &mechanism, hPuk) );
+			CPPUNIT_ASSERT(rv == CKR_OK);
+			rv = CRYPTOKI_F_PTR( C_Verify(hSession, data, sizeof(data), signature, ulLen) );
+			CPPUNIT_ASSERT(rv == CKR_OK);
+
+			rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession, hPuk) );
+			CPPUNIT_ASSERT(rv == CKR_OK);
+			rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession, hPrk) );
+			CPPUNIT_ASSERT(rv == CKR_OK);
+		}
+	}
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+// CKM_AES_CTR from 1 MB, where the enclave starts splitting an update over
+// its worker threads, up to the 50 MB input limit. A single-part C_Encrypt
+// holds the ECALL copy of the input, the ByteString copy of it and the
+// output in the 10 MB enclave heap at the same time, so the single-part
+// runs stop at the first size the token refuses and the test says which.
+// The same sizes are also passed in 2 MB C_EncryptUpdate parts, which
+// keep every part on the parallel path and fit in the heap up to 50 MB
+void PerformanceTests::testCtrScaling()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_HANDLE hKey;
+	CK_AES_CTR_PARAMS ctrParams;
+	CK_MECHANISM mechanism = { CKM_AES_CTR, &ctrParams, sizeof(ctrParams) };
+	std::vector<CK_BYTE> data;
+	std::vector<CK_BYTE> encrypted;
+	std::vector<CK_BYTE> encryptedInParts;
+	struct timespec start;
+	CK_ULONG ulLen;
+	bool singlePart = true;
+	char name[64];
+
+	const CK_ULONG sizes[] = { 1, 2, 4, 8, 16, 32, 50 };
+	const CK_ULONG partLen = 2 * 1024 * 1024;
+
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = generateAesKey(hSession, hKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	ctrParams.ulCounterBits = 128;
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, ctrParams.cb, sizeof(ctrParams.cb)) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	for (size_t n = 0; n < sizeof(sizes)/sizeof(sizes[0]); n++)
+	{
+		CK_ULONG dataLen = sizes[n] * 1024 * 1024;
+
+		data.assign(dataLen, 0x5A);
+		encrypted.clear();
+
+		if (singlePart)
+		{
+			snprintf(name, sizeof(name), "CKM_AES_CTR C_Encrypt of %lu MB", sizes[n]);
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			rv = encryptAll(hSession, &mechanism, hKey, data, encrypted);
+			if (rv == CKR_OK)
+			{
+				report(name, 1, dataLen, elapsed(start));
+			}
+			else
+			{
+				// 1 MB has to fit; past that the heap decides
+				CPPUNIT_ASSERT(n > 0);
+				printf("\n  %-40s stops here, rv 0x%08lX", name, rv);
+				fflush(stdout);
+				singlePart = false;
+				encrypted.clear();
+			}
+		}
+
+		snprintf(name, sizeof(name), "CKM_AES_CTR 2 MB parts of %lu MB", sizes[n]);
+		encryptedInParts.resize(dataLen);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession, &mechanism, hKey) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		for (CK_ULONG i = 0; i < dataLen; i += partLen)
+		{
+			CK_ULONG ulPartLen = (dataLen - i < partLen) ? dataLen - i : partLen;
+
+			ulLen = ulPartLen;
+			rv = CRYPTOKI_F_PTR( C_EncryptUpdate(hSession, &data[i], ulPartLen, &encryptedInParts[i], &ulLen) );
+			CPPUNIT_ASSERT(rv == CKR_OK);
+			CPPUNIT_ASSERT(ulLen == ulPartLen);
+		}
+		ulLen = 0;
+		rv = CRYPTOKI_F_PTR( C_EncryptFinal(hSession, NULL_PTR, &ulLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		CPPUNIT_ASSERT(ulLen == 0);
+		report(name, dataLen / partLen + (dataLen % partLen != 0), dataLen, elapsed(start));
+
+		// Both ways run the same key stream
+		if (!encrypted.empty())
+		{
+			CPPUNIT_ASSERT(encrypted == encryptedInParts);
+		}
+	}
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+#ifdef SGXHSM
+#ifdef WITH_AES_GCM
+void PerformanceTests::testMessageBatchThroughput()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_HANDLE hKey;
+	CK_MECHANISM mechanism = { CKM_AES_GCM, NULL_PTR, 0 };
+	struct timespec start;
+
+	// Many small records, as in a record layer
+	const CK_ULONG nrOfMessages = 2000;
+	const CK_ULONG messageLen = 256;
+	const CK_ULONG batchSize = 100;
+
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = generateAesKey(hSession, hKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	std::vector<CK_BYTE> data(nrOfMessages * messageLen);
+	std::vector<CK_BYTE> ivs(nrOfMessages * 12);
+	std::vector<CK_BYTE> single(nrOfMessages * messageLen);
+	std::vector<CK_BYTE> singleTags(nrOfMessages * 16);
+	std::vector<CK_BYTE> batched(nrOfMessages * messageLen);
+	std::vector<CK_BYTE> batchedTags(nrOfMessages * 16);
+	std::vector<CK_GCM_MESSAGE_PARAMS> params(nrOfMessages);
+	std::vector<CK_MESSAGE_BATCH_ITEM> items(nrOfMessages);
+	CK_BYTE aad[] = { 0x17, 0x03, 0x03, 0x01, 0x00 };
+
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, &data[0], data.size()) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, &ivs[0], ivs.size()) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = C_MessageEncryptInit(hSession, &mechanism, hKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// One call per message
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (CK_ULONG i = 0; i < nrOfMessages; i++)
+	{
+		CK_GCM_MESSAGE_PARAMS messageParams = { &ivs[i * 12], 12, 0, CKG_NO_GENERATE, &singleTags[i * 16], 128 };
+		CK_ULONG ulLen = messageLen;
+
+		rv = C_EncryptMessage(hSession, &messageParams, sizeof(messageParams), aad, sizeof(aad), &data[i * messageLen], messageLen, &single[i * messageLen], &ulLen);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+	report("C_EncryptMessage", nrOfMessages, data.size(), elapsed(start));
+
+	// One call per batch
+	for (CK_ULONG i = 0; i < nrOfMessages; i++)
+	{
+		CK_GCM_MESSAGE_PARAMS messageParams = { &ivs[i * 12], 12, 0, CKG_NO_GENERATE, &batchedTags[i * 16], 128 };
+		params[i] = messageParams;
+
+		CK_MESSAGE_BATCH_ITEM item = { &params[i], sizeof(params[i]), aad, sizeof(aad), &data[i * messageLen], messageLen, &batched[i * messageLen], messageLen, CKR_GENERAL_ERROR };
+		items[i] = item;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (CK_ULONG i = 0; i < nrOfMessages; i += batchSize)
+	{
+		rv = C_EncryptMessageBatch(hSession, &items[i], batchSize);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+	report("C_EncryptMessageBatch (100 per call)", nrOfMessages, data.size(), elapsed(start));
+
+	CPPUNIT_ASSERT(single == batched);
+	CPPUNIT_ASSERT(singleTags == batchedTags);
+
+	rv = C_MessageEncryptFinal(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+void PerformanceTests::testGcmStreamThroughput()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_HANDLE hKey;
+	struct timespec start;
+	CK_ULONG firstOutput;
+
+	// A large object read back in parts
+	const CK_ULONG dataLen = 4 * 1024 * 1024;
+	const CK_ULONG partLen = 64 * 1024;
+
+	rv = openUserSession(hSession);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = generateAesKey(hSession, hKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	std::vector<CK_BYTE> data(dataLen);
+	std::vector<CK_BYTE> encrypted;
+	std::vector<CK_BYTE> decrypted;
+	CK_BYTE iv[12];
+	CK_BYTE noncePrefix[7];
+	CK_BYTE aad[] = { 0xFE, 0xED, 0xFA, 0xCE, 0xDE, 0xAD, 0xBE, 0xEF };
+
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, &data[0], data.size()) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, iv, sizeof(iv)) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, noncePrefix, sizeof(noncePrefix)) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// AES-GCM holds back all plaintext until the tag is checked
+	CK_GCM_PARAMS gcmParams = { iv, sizeof(iv), sizeof(iv) * 8, aad, sizeof(aad), 128 };
+	CK_MECHANISM gcm = { CKM_AES_GCM, &gcmParams, sizeof(gcmParams) };
+
+	rv = encryptAll(hSession, &gcm, hKey, data, encrypted);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rv = decryptInParts(hSession, &gcm, hKey, encrypted, partLen, decrypted, firstOutput);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	report("CKM_AES_GCM decrypt", 1, dataLen, elapsed(start));
+	printf(", first plaintext after %lu bytes", firstOutput);
+	CPPUNIT_ASSERT(decrypted == data);
+
+	// The segmented stream releases every segment once it is complete
+	CK_AES_GCM_STREAM_PARAMS streamParams = { noncePrefix, sizeof(noncePrefix), aad, sizeof(aad), partLen, 128 };
+	CK_MECHANISM stream = { CKM_AES_GCM_STREAM, &streamParams, sizeof(streamParams) };
+
+	rv = encryptAll(hSession, &stream, hKey, data, encrypted);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rv = decryptInParts(hSession, &stream, hKey, encrypted, partLen, decrypted, firstOutput);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	report("CKM_AES_GCM_STREAM decrypt", 1, dataLen, elapsed(start));
+	printf(", first plaintext after %lu bytes", firstOutput);
+	CPPUNIT_ASSERT(decrypted == data);
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+#endif
+#endif
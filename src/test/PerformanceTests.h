@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019-2020 Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ *   3. Neither the name of Intel Corporation nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*****************************************************************************
+ PerformanceTests.h
+
+ Contains timing tests for the batched and fused calls; every test checks
+ that the fast path gives the same result as the regular calls and prints
+ the throughput of both
+ *****************************************************************************/
+
+#ifndef _SOFTHSM_V2_PERFORMANCETESTS_H
+#define _SOFTHSM_V2_PERFORMANCETESTS_H
+
+#include "TestsBase.h"
+#include <cppunit/extensions/HelperMacros.h>
+#include <vector>
+
+class PerformanceTests : public TestsBase
+{
+	CPPUNIT_TEST_SUITE(PerformanceTests);
+	CPPUNIT_TEST(testDigestBatchThroughput);
+	CPPUNIT_TEST(testShortOperationRate);
+	CPPUNIT_TEST(testRandomThroughput);
+	CPPUNIT_TEST(testDualFunctionThroughput);
+	CPPUNIT_TEST(testTlsHandshakeRate);
+	CPPUNIT_TEST(testTokenObjectScaling);
+	CPPUNIT_TEST(testFindLatency);
+	CPPUNIT_TEST(testRsaKeyGenLatency);
+	CPPUNIT_TEST(testRsaMultiPrimeSignThroughput);
+	CPPUNIT_TEST(testCtrScaling);
+#ifdef WITH_ECC
+	CPPUNIT_TEST(testEcdsaSignLatency);
+#endif
+#ifdef SGXHSM
+#ifdef WITH_AES_GCM
+	CPPUNIT_TEST(testMessageBatchThroughput);
+	CPPUNIT_TEST(testGcmStreamThroughput);
+#endif
+#endif
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void testDigestBatchThroughput();
+	void testShortOperationRate();
+	void testRandomThroughput();
+	void testDualFunctionThroughput();
+	void testTlsHandshakeRate();
+	void testTokenObjectScaling();
+	void testFindLatency();
+	void testRsaKeyGenLatency();
+	void testRsaMultiPrimeSignThroughput();
+	void testCtrScaling();
+#ifdef WITH_ECC
+	void testEcdsaSignLatency();
+#endif
+#ifdef SGXHSM
+#ifdef WITH_AES_GCM
+	void testMessageBatchThroughput();
+	void testGcmStreamThroughput();
+#endif
+#endif
+
+protected:
+	CK_RV openUserSession(CK_SESSION_HANDLE& hSession);
+	CK_RV openMemoryUserSession(CK_SESSION_HANDLE& hSession);
+	CK_RV generateAesKey(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE &hKey);
+	CK_RV generateRsaKeyPair(CK_SESSION_HANDLE hSession, CK_ULONG bits, CK_OBJECT_HANDLE &hPuk, CK_OBJECT_HANDLE &hPrk, CK_ULONG primes = 0);
+#ifdef WITH_ECC
+	CK_RV generateEcKeyPair(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE &hPuk, CK_OBJECT_HANDLE &hPrk);
+#endif
+	CK_RV createTokenKeys(CK_SESSION_HANDLE hSession, CK_ULONG count, std::vector<CK_OBJECT_HANDLE>& handles);
+	CK_RV encryptAll(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey, std::vector<CK_BYTE>& in, std::vector<CK_BYTE>& out);
+	CK_RV decryptInParts(CK_SESSION_HANDLE hSession, CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey, std::vector<CK_BYTE>& in, CK_ULONG partLen, std::vector<CK_BYTE>& out, CK_ULONG& firstOutput);
+};
+
+#endif // !_SOFTHSM_V2_PERFORMANCETESTS_H
@@ -125,3 +125,55 @@ void RandomTests::testGenerateRandom()
 	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, randomData, 40) );
 	CPPUNIT_ASSERT(rv == CKR_OK);
 }
+
+void RandomTests::testGenerateRandomSizes()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	// Buffered, direct and keystream requests
+	CK_ULONG sizes[] = { 1, 16, 256, 257, 4096, 4097, 1024 * 1024 + 3 };
+	CK_BYTE_PTR first;
+	CK_BYTE_PTR second;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	first = (CK_BYTE_PTR)malloc(sizes[6]);
+	second = (CK_BYTE_PTR)malloc(sizes[6]);
+	CPPUNIT_ASSERT(first != NULL_PTR && second != NULL_PTR);
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		memset(first, 0, sizes[i]);
+		memset(second, 0, sizes[i]);
+
+		rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, first, sizes[i]) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, second, sizes[i]) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		// Two requests never return the same bytes
+		if (sizes[i] >= 16)
+		{
+			CPPUNIT_ASSERT(memcmp(first, second, sizes[i]) != 0);
+		}
+
+		// The end of a request is filled as well
+		if (sizes[i] >= 4096)
+		{
+			CK_BYTE zeroes[16] = { 0 };
+			CPPUNIT_ASSERT(memcmp(first + sizes[i] - 16, zeroes, 16) != 0);
+		}
+	}
+
+	free(first);
+	free(second);
+}
+
@@ -74,6 +74,7 @@ class RandomTests : public TestsNoPINInitBase
 	CPPUNIT_TEST(testSeedRandom);
 #endif // Unsupported by Crypto API Toolkit
 	CPPUNIT_TEST(testGenerateRandom);
+	CPPUNIT_TEST(testGenerateRandomSizes);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -81,6 +82,7 @@ public:
 	void testSeedRandom();
 #endif // Unsupported by Crypto API Toolkit
 	void testGenerateRandom();
+	void testGenerateRandomSizes();
 };
 
 #endif // !_SOFTHSM_V2_RANDOMTESTS_H
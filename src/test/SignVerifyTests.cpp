@@ -73,7 +73,9 @@
 #include <config.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "SignVerifyTests.h"
+#include "VendorDefs.h"
 
 // CKA_TOKEN
 const CK_BBOOL ON_TOKEN = CK_TRUE;
@@ -86,9 +88,15 @@ const CK_BBOOL IS_PUBLIC = CK_FALSE;
 
 CPPUNIT_TEST_SUITE_REGISTRATION(SignVerifyTests);
 
-CK_RV SignVerifyTests::generateRSA(CK_SESSION_HANDLE hSession, CK_BBOOL bTokenPuk, CK_BBOOL bPrivatePuk, CK_BBOOL bTokenPrk, CK_BBOOL bPrivatePrk, CK_OBJECT_HANDLE &hPuk, CK_OBJECT_HANDLE &hPrk)
+CK_RV SignVerifyTests::generateRSA(CK_SESSION_HANDLE hSession, CK_BBOOL bTokenPuk, CK_BBOOL bPrivatePuk, CK_BBOOL bTokenPrk, CK_BBOOL bPrivatePrk, CK_OBJECT_HANDLE &hPuk, CK_OBJECT_HANDLE &hPrk, CK_ULONG primes)
 {
 	CK_MECHANISM mechanism = { CKM_RSA_PKCS_KEY_PAIR_GEN, NULL_PTR, 0 };
+	CK_RSA_MULTI_PRIME_KEY_GEN_PARAMS params = { primes };
+	if (primes != 0)
+	{
+		mechanism.pParameter = &params;
+		mechanism.ulParameterLen = sizeof(params);
+	}
 	CK_KEY_TYPE keyType = CKK_RSA;
 	CK_ULONG bits = 2048;
 	CK_BYTE pubExp[] = {0x01, 0x00, 0x01};
@@ -495,6 +503,113 @@ void SignVerifyTests::testRsaSignVerify()
 	signVerifyMulti(CKM_SHA512_RSA_PKCS_PSS, hSessionRW, hPuk,hPrk, &params[4], sizeof(params[4]));
 }
 
+void SignVerifyTests::testRsaSignVerifyPrecomputed()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSessionRO;
+	CK_SESSION_HANDLE hSessionRW;
+	CK_ULONG ulCount = 0;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	// Initialize the library and start the test.
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open read-only session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSessionRO) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open read-write session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSessionRW) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Login(hSessionRO,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	CK_OBJECT_HANDLE hPuk = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hPrk = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hPuk2 = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hPrk2 = CK_INVALID_HANDLE;
+
+	// The first key pair of a size is generated inline
+	rv = generateRSA(hSessionRW,IN_SESSION,IS_PUBLIC,IN_SESSION,IS_PRIVATE,hPuk,hPrk);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The size is now known, so with --enable-rsa-key-pool key pairs are
+	// generated ahead of time; without it the next key pair is generated
+	// inline as well
+	rv = C_PrecomputePools(64, &ulCount);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = generateRSA(hSessionRW,IN_SESSION,IS_PUBLIC,IN_SESSION,IS_PRIVATE,hPuk2,hPrk2);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	signVerifySingle(CKM_SHA256_RSA_PKCS, hSessionRO, hPuk2,hPrk2);
+
+	// Pooled key pairs are handed out only once
+	CK_BYTE modulus[256];
+	CK_BYTE modulus2[256];
+	CK_ATTRIBUTE attribs[] = { { CKA_MODULUS, modulus, sizeof(modulus) } };
+	CK_ATTRIBUTE attribs2[] = { { CKA_MODULUS, modulus2, sizeof(modulus2) } };
+	rv = CRYPTOKI_F_PTR( C_GetAttributeValue(hSessionRO, hPuk, attribs, 1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_GetAttributeValue(hSessionRO, hPuk2, attribs2, 1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(modulus, modulus2, sizeof(modulus)) != 0);
+
+	rv = CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+}
+
+void SignVerifyTests::testRsaMultiPrimeSignVerify()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSessionRO;
+	CK_SESSION_HANDLE hSessionRW;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	// Initialize the library and start the test.
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open read-only session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSessionRO) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open read-write session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSessionRW) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Login(hSessionRO,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	CK_OBJECT_HANDLE hPuk = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hPrk = CK_INVALID_HANDLE;
+
+	// The number of primes must be in range
+	rv = generateRSA(hSessionRW,IN_SESSION,IS_PUBLIC,IN_SESSION,IS_PRIVATE,hPuk,hPrk,1);
+	CPPUNIT_ASSERT(rv == CKR_MECHANISM_PARAM_INVALID);
+	rv = generateRSA(hSessionRW,IN_SESSION,IS_PUBLIC,IN_SESSION,IS_PRIVATE,hPuk,hPrk,5);
+	CPPUNIT_ASSERT(rv == CKR_MECHANISM_PARAM_INVALID);
+
+	// Three-prime session and token keys
+	rv = generateRSA(hSessionRW,IN_SESSION,IS_PUBLIC,IN_SESSION,IS_PRIVATE,hPuk,hPrk,3);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	signVerifySingle(CKM_SHA256_RSA_PKCS, hSessionRO, hPuk,hPrk);
+	signVerifySingle(CKM_RSA_PKCS, hSessionRO, hPuk,hPrk);
+
+	rv = generateRSA(hSessionRW,ON_TOKEN,IS_PUBLIC,ON_TOKEN,IS_PRIVATE,hPuk,hPrk,3);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	signVerifyMulti(CKM_SHA256_RSA_PKCS, hSessionRO, hPuk,hPrk);
+
+	rv = generateRSA(hSessionRW,ON_TOKEN,IS_PUBLIC,ON_TOKEN,IS_PUBLIC,hPuk,hPrk,3);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	signVerifySingle(CKM_SHA256_RSA_PKCS, hSessionRO, hPuk,hPrk);
+}
+
 #ifdef WITH_ECC
 void SignVerifyTests::testEcSignVerify()
 {
@@ -572,6 +687,81 @@ void SignVerifyTests::testEcSignVerify()
 	CPPUNIT_ASSERT(rv == CKR_OK);
 	signVerifySingle(CKM_ECDSA, hSessionRO, hPuk,hPrk);
 }
+
+void SignVerifyTests::testEcSignVerifyPrecomputed()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSessionRO;
+	CK_SESSION_HANDLE hSessionRW;
+	CK_ULONG ulCount = 0;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	// Refilling the pools without initializing the library should fail
+	rv = C_PrecomputePools(8, &ulCount);
+	CPPUNIT_ASSERT(rv == CKR_CRYPTOKI_NOT_INITIALIZED);
+
+	// Initialize the library and start the test.
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = C_PrecomputePools(8, NULL_PTR);
+	CPPUNIT_ASSERT(rv == CKR_ARGUMENTS_BAD);
+
+	// Open read-only session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSessionRO) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open read-write session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSessionRW) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Login(hSessionRO,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	CK_OBJECT_HANDLE hPuk = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hPrk = CK_INVALID_HANDLE;
+
+	// The first signature on a curve is computed without a pooled nonce
+	rv = generateEC("P-256", hSessionRW,IN_SESSION,IS_PUBLIC,IN_SESSION,IS_PRIVATE,hPuk,hPrk);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	signVerifySingle(CKM_ECDSA, hSessionRO, hPuk,hPrk);
+
+	// The curve is now known, so the pools can be refilled; the background
+	// refill may already have done so
+	rv = C_PrecomputePools(8, &ulCount);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(ulCount <= 8);
+
+	// Signatures made with pooled nonces must verify
+	for (CK_ULONG i = 0; i < ulCount + 1; i++)
+	{
+		signVerifySingle(CKM_ECDSA, hSessionRO, hPuk,hPrk);
+	}
+
+	// So must signatures made with pooled key pairs
+	rv = C_PrecomputePools(64, &ulCount);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = generateEC("P-256", hSessionRW,IN_SESSION,IS_PUBLIC,IN_SESSION,IS_PRIVATE,hPuk,hPrk);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	signVerifySingle(CKM_ECDSA, hSessionRO, hPuk,hPrk);
+
+	// Draining the nonces starts the background refill, which tops up all
+	// pools without the application calling C_PrecomputePools
+	for (CK_ULONG i = 0; i < 32; i++)
+	{
+		signVerifySingle(CKM_ECDSA, hSessionRO, hPuk,hPrk);
+	}
+	sleep(2);
+	rv = C_PrecomputePools(64, &ulCount);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(ulCount == 0);
+
+	// The pool is dropped with the library
+	rv = CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+}
 #endif
 
 #ifdef WITH_EDDSA
@@ -1041,3 +1231,567 @@ void SignVerifyTests::testMacSignVerify()
 #endif // Unsupported by Crypto API Toolkit
 }
 
+void SignVerifyTests::macSign(CK_MECHANISM_TYPE mechanismType, CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hKey, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	CK_RV rv;
+	CK_MECHANISM mechanism = { mechanismType, NULL_PTR, 0 };
+	CK_BYTE data[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,0x0C, 0x0D, 0x0F };
+
+	rv = CRYPTOKI_F_PTR( C_SignInit(hSession,&mechanism,hKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Sign(hSession,data,sizeof(data),pSignature,pulSignatureLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+}
+
+void SignVerifyTests::testMacKeyStateReuse()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_HANDLE hKey1 = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hKey2 = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hKey3 = CK_INVALID_HANDLE;
+	CK_BYTE signature1[64], signature2[64], signature3[64], again[64];
+	CK_ULONG ulSignatureLen;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Login(hSession,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	rv = generateKey(hSession,CKK_SHA256_HMAC,IN_SESSION,IS_PUBLIC,hKey1);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = generateKey(hSession,CKK_SHA256_HMAC,IN_SESSION,IS_PUBLIC,hKey2);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The second operation with a key starts from its cached state
+	ulSignatureLen = sizeof(signature1);
+	macSign(CKM_SHA256_HMAC, hSession, hKey1, signature1, &ulSignatureLen);
+	CPPUNIT_ASSERT(ulSignatureLen == 32);
+	ulSignatureLen = sizeof(again);
+	macSign(CKM_SHA256_HMAC, hSession, hKey1, again, &ulSignatureLen);
+	CPPUNIT_ASSERT(memcmp(signature1, again, 32) == 0);
+	ulSignatureLen = sizeof(signature2);
+	macSign(CKM_SHA256_HMAC, hSession, hKey2, signature2, &ulSignatureLen);
+	CPPUNIT_ASSERT(memcmp(signature1, signature2, 32) != 0);
+	macSignVerifySingle(CKM_SHA256_HMAC, hSession, hKey1);
+
+	// A new key must not get the state of a destroyed one
+	rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession, hKey1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = generateKey(hSession,CKK_SHA256_HMAC,IN_SESSION,IS_PUBLIC,hKey3);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	ulSignatureLen = sizeof(signature3);
+	macSign(CKM_SHA256_HMAC, hSession, hKey3, signature3, &ulSignatureLen);
+	CPPUNIT_ASSERT(memcmp(signature1, signature3, 32) != 0);
+	macSignVerify(CKM_SHA256_HMAC, hSession, hKey3);
+
+	// Closing a session removes its objects together with their states
+	CK_SESSION_HANDLE hSession2;
+	CK_OBJECT_HANDLE hKey4 = CK_INVALID_HANDLE;
+	CK_BYTE signature4[64];
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession2) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = generateKey(hSession2,CKK_SHA256_HMAC,IN_SESSION,IS_PUBLIC,hKey4);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	ulSignatureLen = sizeof(signature4);
+	macSign(CKM_SHA256_HMAC, hSession2, hKey4, signature4, &ulSignatureLen);
+	rv = CRYPTOKI_F_PTR( C_CloseSession(hSession2) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession2) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = generateKey(hSession2,CKK_SHA256_HMAC,IN_SESSION,IS_PUBLIC,hKey4);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	ulSignatureLen = sizeof(again);
+	macSign(CKM_SHA256_HMAC, hSession2, hKey4, again, &ulSignatureLen);
+	CPPUNIT_ASSERT(memcmp(signature4, again, 32) != 0);
+	macSignVerify(CKM_SHA256_HMAC, hSession2, hKey4);
+	rv = CRYPTOKI_F_PTR( C_CloseSession(hSession2) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The states are wiped on logout and computed again afterwards
+	rv = CRYPTOKI_F_PTR( C_Logout(hSession) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	ulSignatureLen = sizeof(again);
+	macSign(CKM_SHA256_HMAC, hSession, hKey2, again, &ulSignatureLen);
+	CPPUNIT_ASSERT(memcmp(signature2, again, 32) == 0);
+}
+
+void SignVerifyTests::signVerifyMessage(CK_MECHANISM_TYPE mechanismType, CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hPublicKey, CK_OBJECT_HANDLE hPrivateKey)
+{
+	CK_RV rv;
+	CK_MECHANISM mechanism = { mechanismType, NULL_PTR, 0 };
+	CK_BYTE data[3][16];
+	CK_BYTE signature[3][256];
+	CK_ULONG ulSignatureLen[3];
+	CK_ULONG i;
+
+	for (i = 0; i < 3; i++)
+		memset(data[i], (int)i + 1, sizeof(data[i]));
+
+	rv = C_MessageSignInit(hSession,&mechanism,hPrivateKey);
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	// A single-part operation cannot run alongside
+	ulSignatureLen[0] = sizeof(signature[0]);
+	rv = CRYPTOKI_F_PTR( C_Sign(hSession,data[0],sizeof(data[0]),signature[0],&ulSignatureLen[0]) );
+	CPPUNIT_ASSERT(rv==CKR_OPERATION_NOT_INITIALIZED);
+
+	// Sign several messages with one key setup
+	for (i = 0; i < 3; i++)
+	{
+		ulSignatureLen[i] = 0;
+		rv = C_SignMessage(hSession,NULL_PTR,0,data[i],sizeof(data[i]),NULL_PTR,&ulSignatureLen[i]);
+		CPPUNIT_ASSERT(rv==CKR_OK);
+		CPPUNIT_ASSERT(ulSignatureLen[i] <= sizeof(signature[i]));
+
+		rv = C_SignMessage(hSession,NULL_PTR,0,data[i],sizeof(data[i]),signature[i],&ulSignatureLen[i]);
+		CPPUNIT_ASSERT(rv==CKR_OK);
+	}
+
+	rv = C_MessageSignFinal(hSession);
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = C_SignMessage(hSession,NULL_PTR,0,data[0],sizeof(data[0]),signature[0],&ulSignatureLen[0]);
+	CPPUNIT_ASSERT(rv==CKR_OPERATION_NOT_INITIALIZED);
+
+	rv = C_MessageVerifyInit(hSession,&mechanism,hPublicKey);
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	for (i = 0; i < 3; i++)
+	{
+		rv = C_VerifyMessage(hSession,NULL_PTR,0,data[i],sizeof(data[i]),signature[i],ulSignatureLen[i]);
+		CPPUNIT_ASSERT(rv==CKR_OK);
+	}
+
+	// A bad signature does not end the operation
+	rv = C_VerifyMessage(hSession,NULL_PTR,0,data[0],sizeof(data[0]),signature[1],ulSignatureLen[1]);
+	CPPUNIT_ASSERT(rv==CKR_SIGNATURE_INVALID);
+	rv = C_VerifyMessage(hSession,NULL_PTR,0,data[2],sizeof(data[2]),signature[2],ulSignatureLen[2]);
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	rv = C_MessageVerifyFinal(hSession);
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = C_MessageVerifyFinal(hSession);
+	CPPUNIT_ASSERT(rv==CKR_OPERATION_NOT_INITIALIZED);
+}
+
+void SignVerifyTests::testSignVerifyMessage()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSessionRO;
+	CK_SESSION_HANDLE hSessionRW;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	// Initialize the library and start the test.
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open read-only session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSessionRO) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open read-write session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSessionRW) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Login(hSessionRO,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	CK_OBJECT_HANDLE hPuk = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hPrk = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hKey = CK_INVALID_HANDLE;
+
+	// Hashing and raw RSA mechanisms
+	rv = generateRSA(hSessionRW,IN_SESSION,IS_PUBLIC,IN_SESSION,IS_PRIVATE,hPuk,hPrk);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	signVerifyMessage(CKM_SHA256_RSA_PKCS, hSessionRO, hPuk,hPrk);
+	signVerifyMessage(CKM_RSA_PKCS, hSessionRO, hPuk,hPrk);
+
+#ifdef WITH_ECC
+	rv = generateEC("P-256", hSessionRW,IN_SESSION,IS_PUBLIC,IN_SESSION,IS_PRIVATE,hPuk,hPrk);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	signVerifyMessage(CKM_ECDSA, hSessionRO, hPuk,hPrk);
+#endif
+
+	// The MAC key is used for both directions
+	rv = generateKey(hSessionRW,CKK_SHA256_HMAC,IN_SESSION,IS_PUBLIC,hKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	signVerifyMessage(CKM_SHA256_HMAC, hSessionRO, hKey,hKey);
+}
+
+void SignVerifyTests::signData(CK_MECHANISM_TYPE mechanismType, CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hPrivateKey, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+	CK_RV rv;
+	CK_MECHANISM mechanism = { mechanismType, NULL_PTR, 0 };
+
+	rv = CRYPTOKI_F_PTR( C_SignInit(hSession,&mechanism,hPrivateKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Sign(hSession,pData,ulDataLen,pSignature,pulSignatureLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+}
+
+void SignVerifyTests::testVerifyBatch()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSessionRO;
+	CK_SESSION_HANDLE hSessionRW;
+	CK_OBJECT_HANDLE hRsaPuk = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hRsaPrk = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hEcPuk = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hEcPrk = CK_INVALID_HANDLE;
+	CK_BYTE data[4][32];
+	CK_BYTE signature[4][256];
+	CK_ULONG ulSignatureLen[4];
+	CK_VERIFY_BATCH_ITEM items[4];
+	CK_ULONG ulCount = 0;
+	CK_ULONG i;
+
+	for (i = 0; i < 4; i++)
+		memset(data[i], (int)i + 1, sizeof(data[i]));
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSessionRO) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSessionRW) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Login(hSessionRO,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	rv = generateRSA(hSessionRW,IN_SESSION,IS_PUBLIC,IN_SESSION,IS_PRIVATE,hRsaPuk,hRsaPrk);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Two signatures with one RSA key and one with raw RSA
+	for (i = 0; i < 2; i++)
+	{
+		ulSignatureLen[i] = sizeof(signature[i]);
+		signData(CKM_SHA256_RSA_PKCS, hSessionRO, hRsaPrk, data[i], sizeof(data[i]), signature[i], &ulSignatureLen[i]);
+		items[ulCount].hKey = hRsaPuk;
+		items[ulCount].mechanism = CKM_SHA256_RSA_PKCS;
+		ulCount++;
+	}
+	ulSignatureLen[2] = sizeof(signature[2]);
+	signData(CKM_RSA_PKCS, hSessionRO, hRsaPrk, data[2], sizeof(data[2]), signature[2], &ulSignatureLen[2]);
+	items[ulCount].hKey = hRsaPuk;
+	items[ulCount].mechanism = CKM_RSA_PKCS;
+	ulCount++;
+
+#ifdef WITH_ECC
+	rv = generateEC("P-256", hSessionRW,IN_SESSION,IS_PUBLIC,IN_SESSION,IS_PRIVATE,hEcPuk,hEcPrk);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	ulSignatureLen[3] = sizeof(signature[3]);
+	signData(CKM_ECDSA, hSessionRO, hEcPrk, data[3], sizeof(data[3]), signature[3], &ulSignatureLen[3]);
+	items[ulCount].hKey = hEcPuk;
+	items[ulCount].mechanism = CKM_ECDSA;
+	ulCount++;
+#endif
+
+	for (i = 0; i < ulCount; i++)
+	{
+		items[i].pData = data[i];
+		items[i].ulDataLen = sizeof(data[i]);
+		items[i].pSignature = signature[i];
+		items[i].ulSignatureLen = ulSignatureLen[i];
+		items[i].rv = CKR_GENERAL_ERROR;
+	}
+
+	rv = C_VerifyBatch(hSessionRO, NULL_PTR, ulCount);
+	CPPUNIT_ASSERT(rv==CKR_ARGUMENTS_BAD);
+	rv = C_VerifyBatch(hSessionRO, items, 0);
+	CPPUNIT_ASSERT(rv==CKR_ARGUMENTS_BAD);
+
+	// All signatures verify in one call
+	rv = C_VerifyBatch(hSessionRO, items, ulCount);
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	for (i = 0; i < ulCount; i++)
+		CPPUNIT_ASSERT(items[i].rv==CKR_OK);
+
+	// A bad item only fails itself; the keys now come from the cache
+	signature[1][0] ^= 0x01;
+	items[2].mechanism = CKM_SHA1_RSA_PKCS;
+	rv = C_VerifyBatch(hSessionRO, items, ulCount);
+	CPPUNIT_ASSERT(rv==CKR_SIGNATURE_INVALID);
+	CPPUNIT_ASSERT(items[0].rv==CKR_OK);
+	CPPUNIT_ASSERT(items[1].rv==CKR_SIGNATURE_INVALID);
+	CPPUNIT_ASSERT(items[2].rv==CKR_SIGNATURE_INVALID);
+	signature[1][0] ^= 0x01;
+	items[2].mechanism = CKM_RSA_PKCS;
+
+#ifdef WITH_ECC
+	// The mechanism must match the key type
+	items[3].mechanism = CKM_SHA256_RSA_PKCS;
+	rv = C_VerifyBatch(hSessionRO, items, ulCount);
+	CPPUNIT_ASSERT(rv==CKR_KEY_TYPE_INCONSISTENT);
+	CPPUNIT_ASSERT(items[0].rv==CKR_OK);
+	CPPUNIT_ASSERT(items[3].rv==CKR_KEY_TYPE_INCONSISTENT);
+	items[3].mechanism = CKM_ECDSA;
+#endif
+
+	// Mechanisms with parameters are not batched
+	items[0].mechanism = CKM_SHA256_RSA_PKCS_PSS;
+	rv = C_VerifyBatch(hSessionRO, items, ulCount);
+	CPPUNIT_ASSERT(rv==CKR_MECHANISM_INVALID);
+	CPPUNIT_ASSERT(items[0].rv==CKR_MECHANISM_INVALID);
+	CPPUNIT_ASSERT(items[1].rv==CKR_OK);
+	items[0].mechanism = CKM_SHA256_RSA_PKCS;
+
+	// A destroyed key is not used from the cache
+	rv = CRYPTOKI_F_PTR( C_DestroyObject(hSessionRW, hRsaPuk) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = C_VerifyBatch(hSessionRO, items, ulCount);
+	CPPUNIT_ASSERT(rv==CKR_OBJECT_HANDLE_INVALID);
+	CPPUNIT_ASSERT(items[0].rv==CKR_OBJECT_HANDLE_INVALID);
+#ifdef WITH_ECC
+	CPPUNIT_ASSERT(items[3].rv==CKR_OK);
+#endif
+}
+
+void SignVerifyTests::testDualFunctionUpdates()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+	CK_OBJECT_HANDLE hMacKey = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hAesKey = CK_INVALID_HANDLE;
+	CK_BYTE iv[16] = { 0 };
+	CK_MECHANISM cipherMech = { CKM_AES_CBC, iv, sizeof(iv) };
+	CK_MECHANISM digestMech = { CKM_SHA256, NULL_PTR, 0 };
+	CK_MECHANISM macMech = { CKM_SHA256_HMAC, NULL_PTR, 0 };
+	const CK_ULONG partLen = 64;
+	const CK_ULONG nrOfParts = 4;
+	CK_BYTE data[partLen * nrOfParts];
+	CK_BYTE refCipher[sizeof(data)], refDigest[32], refMac[32];
+	CK_BYTE out[sizeof(data)], digest[32], mac[32];
+	CK_ULONG ulLen, i;
+
+	for (i = 0; i < sizeof(data); i++) data[i] = (CK_BYTE)i;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_Login(hSession,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	rv = generateKey(hSession,CKK_SHA256_HMAC,IN_SESSION,IS_PUBLIC,hMacKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = generateAesKey(hSession,IN_SESSION,IS_PUBLIC,hAesKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Reference results from the single-function operations
+	rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession,&cipherMech,hAesKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	ulLen = sizeof(refCipher);
+	rv = CRYPTOKI_F_PTR( C_Encrypt(hSession,data,sizeof(data),refCipher,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	CPPUNIT_ASSERT(ulLen == sizeof(data));
+
+	rv = CRYPTOKI_F_PTR( C_DigestInit(hSession,&digestMech) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	ulLen = sizeof(refDigest);
+	rv = CRYPTOKI_F_PTR( C_Digest(hSession,data,sizeof(data),refDigest,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_SignInit(hSession,&macMech,hMacKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	ulLen = sizeof(refMac);
+	rv = CRYPTOKI_F_PTR( C_Sign(hSession,data,sizeof(data),refMac,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	// Digest and encrypt
+	rv = CRYPTOKI_F_PTR( C_DigestInit(hSession,&digestMech) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession,&cipherMech,hAesKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_DigestUpdate(hSession,data,partLen) );
+	CPPUNIT_ASSERT(rv==CKR_OPERATION_NOT_INITIALIZED);
+	for (i = 0; i < nrOfParts; i++)
+	{
+		// A length query does not feed the digest
+		ulLen = 0;
+		rv = CRYPTOKI_F_PTR( C_DigestEncryptUpdate(hSession,data+i*partLen,partLen,NULL_PTR,&ulLen) );
+		CPPUNIT_ASSERT(rv==CKR_OK);
+		CPPUNIT_ASSERT(ulLen == partLen);
+		rv = CRYPTOKI_F_PTR( C_DigestEncryptUpdate(hSession,data+i*partLen,partLen,out+i*partLen,&ulLen) );
+		CPPUNIT_ASSERT(rv==CKR_OK);
+		CPPUNIT_ASSERT(ulLen == partLen);
+	}
+	ulLen = 0;
+	rv = CRYPTOKI_F_PTR( C_EncryptFinal(hSession,out,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	CPPUNIT_ASSERT(ulLen == 0);
+	ulLen = sizeof(digest);
+	rv = CRYPTOKI_F_PTR( C_DigestFinal(hSession,digest,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	CPPUNIT_ASSERT(memcmp(out, refCipher, sizeof(data)) == 0);
+	CPPUNIT_ASSERT(memcmp(digest, refDigest, sizeof(digest)) == 0);
+
+	// Decrypt and digest; the digest can be finished first
+	rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession,&cipherMech,hAesKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_DigestInit(hSession,&digestMech) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	for (i = 0; i < nrOfParts; i++)
+	{
+		ulLen = partLen;
+		rv = CRYPTOKI_F_PTR( C_DecryptDigestUpdate(hSession,refCipher+i*partLen,partLen,out+i*partLen,&ulLen) );
+		CPPUNIT_ASSERT(rv==CKR_OK);
+		CPPUNIT_ASSERT(ulLen == partLen);
+	}
+	ulLen = sizeof(digest);
+	rv = CRYPTOKI_F_PTR( C_DigestFinal(hSession,digest,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	ulLen = 0;
+	rv = CRYPTOKI_F_PTR( C_DecryptFinal(hSession,out,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	CPPUNIT_ASSERT(ulLen == 0);
+	CPPUNIT_ASSERT(memcmp(out, data, sizeof(data)) == 0);
+	CPPUNIT_ASSERT(memcmp(digest, refDigest, sizeof(digest)) == 0);
+
+	// Sign and encrypt
+	rv = CRYPTOKI_F_PTR( C_SignInit(hSession,&macMech,hMacKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession,&cipherMech,hAesKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	for (i = 0; i < nrOfParts; i++)
+	{
+		ulLen = partLen;
+		rv = CRYPTOKI_F_PTR( C_SignEncryptUpdate(hSession,data+i*partLen,partLen,out+i*partLen,&ulLen) );
+		CPPUNIT_ASSERT(rv==CKR_OK);
+		CPPUNIT_ASSERT(ulLen == partLen);
+	}
+	ulLen = sizeof(mac);
+	rv = CRYPTOKI_F_PTR( C_SignFinal(hSession,mac,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	ulLen = 0;
+	rv = CRYPTOKI_F_PTR( C_EncryptFinal(hSession,out,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	CPPUNIT_ASSERT(memcmp(out, refCipher, sizeof(data)) == 0);
+	CPPUNIT_ASSERT(memcmp(mac, refMac, sizeof(mac)) == 0);
+
+	// Decrypt and verify
+	rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession,&cipherMech,hAesKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_VerifyInit(hSession,&macMech,hMacKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	for (i = 0; i < nrOfParts; i++)
+	{
+		ulLen = partLen;
+		rv = CRYPTOKI_F_PTR( C_DecryptVerifyUpdate(hSession,refCipher+i*partLen,partLen,out+i*partLen,&ulLen) );
+		CPPUNIT_ASSERT(rv==CKR_OK);
+		CPPUNIT_ASSERT(ulLen == partLen);
+	}
+	ulLen = 0;
+	rv = CRYPTOKI_F_PTR( C_DecryptFinal(hSession,out,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_VerifyFinal(hSession,refMac,sizeof(refMac)) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	CPPUNIT_ASSERT(memcmp(out, data, sizeof(data)) == 0);
+
+	// Padded encryption pairs up; the digest covers the input
+	CK_MECHANISM padMech = { CKM_AES_CBC_PAD, iv, sizeof(iv) };
+	CK_BYTE padded[sizeof(data) + 16];
+	CK_ULONG ulPaddedLen = 0;
+	rv = CRYPTOKI_F_PTR( C_DigestInit(hSession,&digestMech) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession,&padMech,hAesKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	for (i = 0; i < nrOfParts; i++)
+	{
+		ulLen = sizeof(padded) - ulPaddedLen;
+		rv = CRYPTOKI_F_PTR( C_DigestEncryptUpdate(hSession,data+i*partLen,partLen,padded+ulPaddedLen,&ulLen) );
+		CPPUNIT_ASSERT(rv==CKR_OK);
+		ulPaddedLen += ulLen;
+	}
+	ulLen = sizeof(padded) - ulPaddedLen;
+	rv = CRYPTOKI_F_PTR( C_EncryptFinal(hSession,padded+ulPaddedLen,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	ulPaddedLen += ulLen;
+	CPPUNIT_ASSERT(ulPaddedLen == sizeof(padded));
+	ulLen = sizeof(digest);
+	rv = CRYPTOKI_F_PTR( C_DigestFinal(hSession,digest,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	CPPUNIT_ASSERT(memcmp(digest, refDigest, sizeof(digest)) == 0);
+
+	// Padded decryption holds back the last block until C_DecryptFinal and
+	// does not pair up, in either order
+	rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession,&padMech,hAesKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_DigestInit(hSession,&digestMech) );
+	CPPUNIT_ASSERT(rv==CKR_OPERATION_ACTIVE);
+	rv = CRYPTOKI_F_PTR( C_VerifyInit(hSession,&macMech,hMacKey) );
+	CPPUNIT_ASSERT(rv==CKR_OPERATION_ACTIVE);
+	ulLen = sizeof(out);
+	rv = CRYPTOKI_F_PTR( C_Decrypt(hSession,padded,ulPaddedLen,out,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	CPPUNIT_ASSERT(ulLen == sizeof(data));
+	CPPUNIT_ASSERT(memcmp(out, data, sizeof(data)) == 0);
+
+	rv = CRYPTOKI_F_PTR( C_VerifyInit(hSession,&macMech,hMacKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession,&padMech,hAesKey) );
+	CPPUNIT_ASSERT(rv==CKR_OPERATION_ACTIVE);
+	rv = CRYPTOKI_F_PTR( C_Verify(hSession,data,sizeof(data),refMac,sizeof(refMac)) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+#ifdef WITH_AES_GCM
+	// GCM holds back all plaintext until the tag is checked
+	CK_GCM_PARAMS gcmParams = { iv, 12, 96, NULL_PTR, 0, 128 };
+	CK_MECHANISM gcmMech = { CKM_AES_GCM, &gcmParams, sizeof(gcmParams) };
+	CK_BYTE sealed[sizeof(data) + 16];
+	rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession,&gcmMech,hAesKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	ulLen = sizeof(sealed);
+	rv = CRYPTOKI_F_PTR( C_Encrypt(hSession,data,sizeof(data),sealed,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	CPPUNIT_ASSERT(ulLen == sizeof(sealed));
+
+	rv = CRYPTOKI_F_PTR( C_DigestInit(hSession,&digestMech) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession,&gcmMech,hAesKey) );
+	CPPUNIT_ASSERT(rv==CKR_OPERATION_ACTIVE);
+	ulLen = sizeof(digest);
+	rv = CRYPTOKI_F_PTR( C_Digest(hSession,data,sizeof(data),digest,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	CPPUNIT_ASSERT(memcmp(digest, refDigest, sizeof(digest)) == 0);
+
+	rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession,&gcmMech,hAesKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_DigestInit(hSession,&digestMech) );
+	CPPUNIT_ASSERT(rv==CKR_OPERATION_ACTIVE);
+	ulLen = sizeof(out);
+	rv = CRYPTOKI_F_PTR( C_Decrypt(hSession,sealed,sizeof(sealed),out,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	CPPUNIT_ASSERT(ulLen == sizeof(data));
+	CPPUNIT_ASSERT(memcmp(out, data, sizeof(data)) == 0);
+#endif
+
+	// A MAC does not pair up with a digest
+	rv = CRYPTOKI_F_PTR( C_SignInit(hSession,&macMech,hMacKey) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_DigestInit(hSession,&digestMech) );
+	CPPUNIT_ASSERT(rv==CKR_OPERATION_ACTIVE);
+	rv = CRYPTOKI_F_PTR( C_SignEncryptUpdate(hSession,data,partLen,out,&ulLen) );
+	CPPUNIT_ASSERT(rv==CKR_OPERATION_NOT_INITIALIZED);
+}
@@ -73,27 +73,41 @@ class SignVerifyTests : public TestsBase
 {
 	CPPUNIT_TEST_SUITE(SignVerifyTests);
 	CPPUNIT_TEST(testRsaSignVerify);
+	CPPUNIT_TEST(testRsaSignVerifyPrecomputed);
+	CPPUNIT_TEST(testRsaMultiPrimeSignVerify);
 #ifdef WITH_ECC
 	CPPUNIT_TEST(testEcSignVerify);
+	CPPUNIT_TEST(testEcSignVerifyPrecomputed);
 #endif
 #ifdef WITH_EDDSA
 	CPPUNIT_TEST(testEdSignVerify);
 #endif
 	CPPUNIT_TEST(testMacSignVerify);
+	CPPUNIT_TEST(testMacKeyStateReuse);
+	CPPUNIT_TEST(testSignVerifyMessage);
+	CPPUNIT_TEST(testVerifyBatch);
+	CPPUNIT_TEST(testDualFunctionUpdates);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
 	void testRsaSignVerify();
+	void testRsaSignVerifyPrecomputed();
+	void testRsaMultiPrimeSignVerify();
 #ifdef WITH_ECC
 	void testEcSignVerify();
+	void testEcSignVerifyPrecomputed();
 #endif
 #ifdef WITH_EDDSA
 	void testEdSignVerify();
 #endif
 	void testMacSignVerify();
+	void testMacKeyStateReuse();
+	void testSignVerifyMessage();
+	void testVerifyBatch();
+	void testDualFunctionUpdates();
 
 protected:
-	CK_RV generateRSA(CK_SESSION_HANDLE hSession, CK_BBOOL bTokenPuk, CK_BBOOL bPrivatePuk, CK_BBOOL bTokenPrk, CK_BBOOL bPrivatePrk, CK_OBJECT_HANDLE &hPuk, CK_OBJECT_HANDLE &hPrk);
+	CK_RV generateRSA(CK_SESSION_HANDLE hSession, CK_BBOOL bTokenPuk, CK_BBOOL bPrivatePuk, CK_BBOOL bTokenPrk, CK_BBOOL bPrivatePrk, CK_OBJECT_HANDLE &hPuk, CK_OBJECT_HANDLE &hPrk, CK_ULONG primes = 0);
 #ifdef WITH_ECC
 	CK_RV generateEC(const char* curve, CK_SESSION_HANDLE hSession, CK_BBOOL bTokenPuk, CK_BBOOL bPrivatePuk, CK_BBOOL bTokenPrk, CK_BBOOL bPrivatePrk, CK_OBJECT_HANDLE &hPuk, CK_OBJECT_HANDLE &hPrk);
 #endif
@@ -111,6 +125,9 @@ protected:
 	CK_RV generateAesKey(CK_SESSION_HANDLE hSession, CK_BBOOL bToken, CK_BBOOL bPrivate, CK_OBJECT_HANDLE &hKey);
 	void macSignVerify(CK_MECHANISM_TYPE mechanismType, CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hKey);
 	void macSignVerifySingle(CK_MECHANISM_TYPE mechanismType, CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hKey);
+	void macSign(CK_MECHANISM_TYPE mechanismType, CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hKey, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen);
+	void signVerifyMessage(CK_MECHANISM_TYPE mechanismType, CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hPublicKey, CK_OBJECT_HANDLE hPrivateKey);
+	void signData(CK_MECHANISM_TYPE mechanismType, CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hPrivateKey, CK_BYTE_PTR pData, CK_ULONG ulDataLen, CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen);
 };
 
 #endif // !_SOFTHSM_V2_SIGNVERIFYTESTS_H
@@ -34,8 +34,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <climits>
+#include <pthread.h>
 //#include <iomanip>
 #include "SymmetricAlgorithmTests.h"
+#include "VendorDefs.h"
 
 #include <openssl/rsa.h>
 #include <openssl/evp.h>
@@ -919,6 +921,261 @@ void SymmetricAlgorithmTests::testAesWrapUnwrap()
 #endif
 }
 
+#ifdef HAVE_AES_KEY_WRAP_PAD
+void SymmetricAlgorithmTests::testAesKeyWrapBatch()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	// Initialize the library and start the test.
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Login USER into the session so we can create a private object
+	rv = CRYPTOKI_F_PTR( C_Login(hSession,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	CK_MECHANISM mechanism = { CKM_AES_KEY_WRAP_PAD, NULL_PTR, 0 };
+	CK_OBJECT_HANDLE hKey = CK_INVALID_HANDLE;
+	const CK_ULONG nrOfKeys = 3;
+	CK_OBJECT_HANDLE hKeys[nrOfKeys];
+	CK_BYTE wrapped[nrOfKeys][24];
+	CK_BYTE rewrapped[nrOfKeys][24];
+	CK_WRAP_BATCH_ITEM wrapItems[nrOfKeys];
+	CK_UNWRAP_BATCH_ITEM unwrapItems[nrOfKeys];
+
+	rv = generateAesKey(hSession, IN_SESSION, IS_PUBLIC, hKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	for (CK_ULONG i = 0; i < nrOfKeys; i++)
+	{
+		rv = generateAesKey(hSession, IN_SESSION, IS_PUBLIC, hKeys[i]);
+		CPPUNIT_ASSERT(rv == CKR_OK);
+
+		wrapItems[i].hKey = hKeys[i];
+		wrapItems[i].pWrappedKey = NULL_PTR;
+		wrapItems[i].ulWrappedKeyLen = 0;
+		wrapItems[i].rv = CKR_GENERAL_ERROR;
+	}
+
+	rv = CRYPTOKI_F_PTR( C_WrapKeyBatch(hSession, &mechanism, hKey, wrapItems, 0) );
+	CPPUNIT_ASSERT(rv == CKR_ARGUMENTS_BAD);
+
+	// Get the wrapped key lengths
+	rv = CRYPTOKI_F_PTR( C_WrapKeyBatch(hSession, &mechanism, hKey, wrapItems, nrOfKeys) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	for (CK_ULONG i = 0; i < nrOfKeys; i++)
+	{
+		CPPUNIT_ASSERT(wrapItems[i].rv == CKR_OK);
+		CPPUNIT_ASSERT(wrapItems[i].ulWrappedKeyLen == sizeof(wrapped[i]));
+
+		wrapItems[i].pWrappedKey = wrapped[i];
+	}
+
+	rv = CRYPTOKI_F_PTR( C_WrapKeyBatch(hSession, &mechanism, hKey, wrapItems, nrOfKeys) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Unwrap all keys in one batch
+	CK_OBJECT_CLASS secretClass = CKO_SECRET_KEY;
+	CK_KEY_TYPE keyType = CKK_AES;
+	CK_BBOOL bFalse = CK_FALSE;
+	CK_BBOOL bTrue = CK_TRUE;
+	CK_ATTRIBUTE unwrapTemplate[] = {
+		{ CKA_CLASS, &secretClass, sizeof(secretClass) },
+		{ CKA_KEY_TYPE, &keyType, sizeof(keyType) },
+		{ CKA_TOKEN, &bFalse, sizeof(bFalse) },
+		{ CKA_PRIVATE, &bFalse, sizeof(bFalse) },
+		{ CKA_EXTRACTABLE, &bTrue, sizeof(bTrue) }
+	};
+
+	for (CK_ULONG i = 0; i < nrOfKeys; i++)
+	{
+		unwrapItems[i].pWrappedKey = wrapped[i];
+		unwrapItems[i].ulWrappedKeyLen = sizeof(wrapped[i]);
+		unwrapItems[i].pTemplate = unwrapTemplate;
+		unwrapItems[i].ulAttributeCount = sizeof(unwrapTemplate)/sizeof(CK_ATTRIBUTE);
+		unwrapItems[i].hKey = CK_INVALID_HANDLE;
+		unwrapItems[i].rv = CKR_GENERAL_ERROR;
+	}
+
+	rv = CRYPTOKI_F_PTR( C_UnwrapKeyBatch(hSession, &mechanism, hKey, unwrapItems, nrOfKeys) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The unwrapped keys wrap to the same blobs as the original keys
+	for (CK_ULONG i = 0; i < nrOfKeys; i++)
+	{
+		CPPUNIT_ASSERT(unwrapItems[i].rv == CKR_OK);
+		CPPUNIT_ASSERT(unwrapItems[i].hKey != CK_INVALID_HANDLE);
+
+		wrapItems[i].hKey = unwrapItems[i].hKey;
+		wrapItems[i].pWrappedKey = rewrapped[i];
+		wrapItems[i].ulWrappedKeyLen = sizeof(rewrapped[i]);
+	}
+
+	rv = CRYPTOKI_F_PTR( C_WrapKeyBatch(hSession, &mechanism, hKey, wrapItems, nrOfKeys) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(wrapped, rewrapped, sizeof(wrapped)) == 0);
+
+	// A corrupted blob cancels the whole batch
+	wrapped[1][5] ^= 0x01;
+
+	rv = CRYPTOKI_F_PTR( C_UnwrapKeyBatch(hSession, &mechanism, hKey, unwrapItems, nrOfKeys) );
+	CPPUNIT_ASSERT(rv != CKR_OK);
+	CPPUNIT_ASSERT(unwrapItems[0].rv == CKR_FUNCTION_CANCELED);
+	CPPUNIT_ASSERT(unwrapItems[1].rv == rv);
+	CPPUNIT_ASSERT(unwrapItems[2].rv == CKR_FUNCTION_CANCELED);
+
+	for (CK_ULONG i = 0; i < nrOfKeys; i++)
+	{
+		CPPUNIT_ASSERT(unwrapItems[i].hKey == CK_INVALID_HANDLE);
+	}
+
+	wrapped[1][5] ^= 0x01;
+
+	// Unwrap token objects
+	CK_UTF8CHAR label[] = "unwrap batch token key";
+	CK_ATTRIBUTE tokenTemplate[] = {
+		{ CKA_CLASS, &secretClass, sizeof(secretClass) },
+		{ CKA_KEY_TYPE, &keyType, sizeof(keyType) },
+		{ CKA_TOKEN, &bTrue, sizeof(bTrue) },
+		{ CKA_PRIVATE, &bTrue, sizeof(bTrue) },
+		{ CKA_EXTRACTABLE, &bTrue, sizeof(bTrue) },
+		{ CKA_LABEL, label, sizeof(label)-1 }
+	};
+	CK_ATTRIBUTE findTemplate[] = {
+		{ CKA_LABEL, label, sizeof(label)-1 }
+	};
+	CK_OBJECT_HANDLE hFound[nrOfKeys + 1];
+	CK_ULONG ulFound;
+
+	for (CK_ULONG i = 0; i < nrOfKeys; i++)
+	{
+		unwrapItems[i].pTemplate = tokenTemplate;
+		unwrapItems[i].ulAttributeCount = sizeof(tokenTemplate)/sizeof(CK_ATTRIBUTE);
+	}
+
+	rv = CRYPTOKI_F_PTR( C_UnwrapKeyBatch(hSession, &mechanism, hKey, unwrapItems, nrOfKeys) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession, findTemplate, 1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession, hFound, nrOfKeys + 1, &ulFound) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(ulFound == nrOfKeys);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	for (CK_ULONG i = 0; i < nrOfKeys; i++)
+	{
+		CPPUNIT_ASSERT(unwrapItems[i].rv == CKR_OK);
+
+		wrapItems[i].hKey = unwrapItems[i].hKey;
+		wrapItems[i].pWrappedKey = rewrapped[i];
+		wrapItems[i].ulWrappedKeyLen = sizeof(rewrapped[i]);
+	}
+
+	rv = CRYPTOKI_F_PTR( C_WrapKeyBatch(hSession, &mechanism, hKey, wrapItems, nrOfKeys) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(wrapped, rewrapped, sizeof(wrapped)) == 0);
+
+	for (CK_ULONG i = 0; i < nrOfKeys; i++)
+	{
+		rv = CRYPTOKI_F_PTR( C_DestroyObject(hSession, unwrapItems[i].hKey) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+	}
+
+	// A corrupted last blob leaves no token object behind
+	wrapped[nrOfKeys - 1][5] ^= 0x01;
+
+	rv = CRYPTOKI_F_PTR( C_UnwrapKeyBatch(hSession, &mechanism, hKey, unwrapItems, nrOfKeys) );
+	CPPUNIT_ASSERT(rv != CKR_OK);
+	CPPUNIT_ASSERT(unwrapItems[0].rv == CKR_FUNCTION_CANCELED);
+	CPPUNIT_ASSERT(unwrapItems[1].rv == CKR_FUNCTION_CANCELED);
+	CPPUNIT_ASSERT(unwrapItems[nrOfKeys - 1].rv == rv);
+
+	rv = CRYPTOKI_F_PTR( C_FindObjectsInit(hSession, findTemplate, 1) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	rv = CRYPTOKI_F_PTR( C_FindObjects(hSession, hFound, nrOfKeys + 1, &ulFound) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(ulFound == 0);
+	rv = CRYPTOKI_F_PTR( C_FindObjectsFinal(hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	wrapped[nrOfKeys - 1][5] ^= 0x01;
+
+	// Unwrap keys wrapped with RSA-OAEP
+	CK_MECHANISM rsaKeyGen = { CKM_RSA_PKCS_KEY_PAIR_GEN, NULL_PTR, 0 };
+	CK_ULONG bits = 2048;
+	CK_BYTE pubExp[] = {0x01, 0x00, 0x01};
+	CK_ATTRIBUTE pubAttribs[] = {
+		{ CKA_TOKEN, &bFalse, sizeof(bFalse) },
+		{ CKA_WRAP, &bTrue, sizeof(bTrue) },
+		{ CKA_MODULUS_BITS, &bits, sizeof(bits) },
+		{ CKA_PUBLIC_EXPONENT, &pubExp[0], sizeof(pubExp) }
+	};
+	CK_ATTRIBUTE privAttribs[] = {
+		{ CKA_TOKEN, &bFalse, sizeof(bFalse) },
+		{ CKA_PRIVATE, &bTrue, sizeof(bTrue) },
+		{ CKA_SENSITIVE, &bTrue, sizeof(bTrue) },
+		{ CKA_UNWRAP, &bTrue, sizeof(bTrue) }
+	};
+	CK_OBJECT_HANDLE hPub = CK_INVALID_HANDLE;
+	CK_OBJECT_HANDLE hPriv = CK_INVALID_HANDLE;
+
+	rv = CRYPTOKI_F_PTR( C_GenerateKeyPair(hSession, &rsaKeyGen,
+			       pubAttribs, sizeof(pubAttribs)/sizeof(CK_ATTRIBUTE),
+			       privAttribs, sizeof(privAttribs)/sizeof(CK_ATTRIBUTE),
+			       &hPub, &hPriv) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	CK_RSA_PKCS_OAEP_PARAMS oaepParams = { CKM_SHA_1, CKG_MGF1_SHA1, CKZ_DATA_SPECIFIED, NULL_PTR, 0 };
+	CK_MECHANISM oaep = { CKM_RSA_PKCS_OAEP, &oaepParams, sizeof(oaepParams) };
+	CK_BYTE rsaWrapped[nrOfKeys][256];
+
+	for (CK_ULONG i = 0; i < nrOfKeys; i++)
+	{
+		CK_ULONG ulRsaWrappedLen = sizeof(rsaWrapped[i]);
+		rv = CRYPTOKI_F_PTR( C_WrapKey(hSession, &oaep, hPub, hKeys[i], rsaWrapped[i], &ulRsaWrappedLen) );
+		CPPUNIT_ASSERT(rv == CKR_OK);
+		CPPUNIT_ASSERT(ulRsaWrappedLen == sizeof(rsaWrapped[i]));
+
+		unwrapItems[i].pWrappedKey = rsaWrapped[i];
+		unwrapItems[i].ulWrappedKeyLen = ulRsaWrappedLen;
+		unwrapItems[i].pTemplate = unwrapTemplate;
+		unwrapItems[i].ulAttributeCount = sizeof(unwrapTemplate)/sizeof(CK_ATTRIBUTE);
+	}
+
+	rv = CRYPTOKI_F_PTR( C_UnwrapKeyBatch(hSession, &oaep, hPriv, unwrapItems, nrOfKeys) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The keys match the originals, compared through their AES wrapped blobs
+	for (CK_ULONG i = 0; i < nrOfKeys; i++)
+	{
+		CPPUNIT_ASSERT(unwrapItems[i].rv == CKR_OK);
+
+		wrapItems[i].hKey = unwrapItems[i].hKey;
+		wrapItems[i].pWrappedKey = rewrapped[i];
+		wrapItems[i].ulWrappedKeyLen = sizeof(rewrapped[i]);
+	}
+
+	rv = CRYPTOKI_F_PTR( C_WrapKeyBatch(hSession, &mechanism, hKey, wrapItems, nrOfKeys) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+	CPPUNIT_ASSERT(memcmp(wrapped, rewrapped, sizeof(wrapped)) == 0);
+
+	// The OAEP blobs do not unwrap with the AES key
+	rv = CRYPTOKI_F_PTR( C_UnwrapKeyBatch(hSession, &oaep, hKey, unwrapItems, nrOfKeys) );
+	CPPUNIT_ASSERT(rv == CKR_UNWRAPPING_KEY_TYPE_INCONSISTENT);
+}
+#endif
+
 #if 0 // Unsupported by Crypto API Toolkit
 void SymmetricAlgorithmTests::testDesEncryptDecrypt()
 {
@@ -1303,6 +1560,235 @@ void SymmetricAlgorithmTests::testAesCtrOverflow()
 	CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_ENCRYPTED_DATA_LEN_RANGE, rv );
 }
 
+void SymmetricAlgorithmTests::testAesCtrLargeBuffer()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	// Initialize the library and start the test.
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open read-write session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Login USER into the session so we can create a private objects
+	rv = CRYPTOKI_F_PTR( C_Login(hSession,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	CK_OBJECT_HANDLE hKey = CK_INVALID_HANDLE;
+
+	// Generate a session keys.
+	rv = generateAesKey(hSession,IN_SESSION,IS_PUBLIC,hKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The counter block wraps around within the buffer
+	CK_MECHANISM mechanism = { CKM_AES_CTR, NULL_PTR, 0 };
+	CK_AES_CTR_PARAMS ctrParams =
+	{
+		128,
+		{
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0
+		}
+	};
+	mechanism.pParameter = &ctrParams;
+	mechanism.ulParameterLen = sizeof(ctrParams);
+
+	// Large enough to be split over worker threads
+	const CK_ULONG ulSize = 2 * 1024 * 1024 + 5;
+	const CK_ULONG ulPartSize = 4096;
+	std::vector<CK_BYTE> vData(ulSize);
+	std::vector<CK_BYTE> vEncryptedData(ulSize);
+	std::vector<CK_BYTE> vEncryptedDataParted(ulSize);
+	std::vector<CK_BYTE> vDecryptedData(ulSize);
+	CK_BYTE finalBlock[16];
+	CK_ULONG ulLen;
+
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession,&vData.front(),ulSize) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Single-part encryption takes the parallel path
+	rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession,&mechanism,hKey) );
+	CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, rv );
+	ulLen = ulSize;
+	rv = CRYPTOKI_F_PTR( C_Encrypt(hSession,&vData.front(),ulSize,&vEncryptedData.front(),&ulLen) );
+	CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, rv );
+	CPPUNIT_ASSERT(ulLen == ulSize);
+
+	// Multi-part encryption in small parts stays serial
+	rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession,&mechanism,hKey) );
+	CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, rv );
+	for (CK_ULONG i = 0; i < ulSize; i += ulPartSize)
+	{
+		CK_ULONG ulPartLen = (ulSize - i < ulPartSize) ? ulSize - i : ulPartSize;
+		ulLen = ulPartLen;
+		rv = CRYPTOKI_F_PTR( C_EncryptUpdate(hSession,&vData[i],ulPartLen,&vEncryptedDataParted[i],&ulLen) );
+		CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, rv );
+		CPPUNIT_ASSERT(ulLen == ulPartLen);
+	}
+	ulLen = sizeof(finalBlock);
+	rv = CRYPTOKI_F_PTR( C_EncryptFinal(hSession,finalBlock,&ulLen) );
+	CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, rv );
+	CPPUNIT_ASSERT(ulLen == 0);
+	CPPUNIT_ASSERT(vEncryptedData == vEncryptedDataParted);
+
+	// A large update after the first block continues the counter
+	rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession,&mechanism,hKey) );
+	CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, rv );
+	ulLen = 16;
+	rv = CRYPTOKI_F_PTR( C_DecryptUpdate(hSession,&vEncryptedData.front(),16,&vDecryptedData.front(),&ulLen) );
+	CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, rv );
+	ulLen = ulSize - 16;
+	rv = CRYPTOKI_F_PTR( C_DecryptUpdate(hSession,&vEncryptedData[16],ulSize - 16,&vDecryptedData[16],&ulLen) );
+	CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, rv );
+	CPPUNIT_ASSERT(ulLen == ulSize - 16);
+	ulLen = sizeof(finalBlock);
+	rv = CRYPTOKI_F_PTR( C_DecryptFinal(hSession,finalBlock,&ulLen) );
+	CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, rv );
+	CPPUNIT_ASSERT(ulLen == 0);
+	CPPUNIT_ASSERT(vDecryptedData == vData);
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+struct ConcurrentCtrJob
+{
+	CK_SLOT_ID slotID;
+	CK_OBJECT_HANDLE hKey;
+	CK_MECHANISM_PTR pMechanism;
+	const std::vector<CK_BYTE>* data;
+	const std::vector<CK_BYTE>* expected;
+	CK_RV rv;
+	bool matches;
+};
+
+// Encrypt and draw a large random buffer in a session of its own
+static void* concurrentCtrWorker(void* arg)
+{
+	ConcurrentCtrJob* job = (ConcurrentCtrJob*) arg;
+	CK_SESSION_HANDLE hSession;
+	CK_ULONG ulSize = job->data->size();
+	std::vector<CK_BYTE> vEncryptedData(ulSize);
+	std::vector<CK_BYTE> vRandom(ulSize);
+	CK_ULONG ulLen = ulSize;
+
+	job->matches = false;
+
+	job->rv = CRYPTOKI_F_PTR( C_OpenSession(job->slotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	if (job->rv != CKR_OK) return NULL;
+
+	job->rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession,job->pMechanism,job->hKey) );
+	if (job->rv == CKR_OK)
+	{
+		job->rv = CRYPTOKI_F_PTR( C_Encrypt(hSession,const_cast<CK_BYTE_PTR>(&job->data->front()),ulSize,&vEncryptedData.front(),&ulLen) );
+	}
+	job->matches = (job->rv == CKR_OK) && (ulLen == ulSize) && (vEncryptedData == *job->expected);
+
+	if (job->rv == CKR_OK)
+	{
+		job->rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession,&vRandom.front(),ulSize) );
+	}
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+
+	return NULL;
+}
+
+void SymmetricAlgorithmTests::testAesCtrConcurrent()
+{
+	CK_RV rv;
+	CK_SESSION_HANDLE hSession;
+
+	// Just make sure that we finalize any previous tests
+	CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+	// Initialize the library and start the test.
+	rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Open read-write session
+	rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// Login USER into the session so we can create a private objects
+	rv = CRYPTOKI_F_PTR( C_Login(hSession,CKU_USER,m_userPin1,m_userPin1Length) );
+	CPPUNIT_ASSERT(rv==CKR_OK);
+
+	CK_OBJECT_HANDLE hKey = CK_INVALID_HANDLE;
+
+	// Generate a session keys.
+	rv = generateAesKey(hSession,IN_SESSION,IS_PUBLIC,hKey);
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	CK_MECHANISM mechanism = { CKM_AES_CTR, NULL_PTR, 0 };
+	CK_AES_CTR_PARAMS ctrParams =
+	{
+		128,
+		{
+			0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+			0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F
+		}
+	};
+	mechanism.pParameter = &ctrParams;
+	mechanism.ulParameterLen = sizeof(ctrParams);
+
+	const CK_ULONG ulSize = 2 * 1024 * 1024;
+	const CK_ULONG ulPartSize = 4096;
+	std::vector<CK_BYTE> vData(ulSize);
+	std::vector<CK_BYTE> vExpected(ulSize);
+	CK_BYTE finalBlock[16];
+	CK_ULONG ulLen;
+
+	rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession,&vData.front(),ulSize) );
+	CPPUNIT_ASSERT(rv == CKR_OK);
+
+	// The reference is encrypted serially in small parts
+	rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession,&mechanism,hKey) );
+	CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, rv );
+	for (CK_ULONG i = 0; i < ulSize; i += ulPartSize)
+	{
+		ulLen = ulPartSize;
+		rv = CRYPTOKI_F_PTR( C_EncryptUpdate(hSession,&vData[i],ulPartSize,&vExpected[i],&ulLen) );
+		CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, rv );
+	}
+	ulLen = sizeof(finalBlock);
+	rv = CRYPTOKI_F_PTR( C_EncryptFinal(hSession,finalBlock,&ulLen) );
+	CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, rv );
+
+	// Two application calls at once want more worker threads than there are
+	// spare TCS, so some of their slices fall back to the calling thread
+	const size_t nrOfJobs = 2;
+	ConcurrentCtrJob jobs[nrOfJobs];
+	pthread_t threads[nrOfJobs];
+
+	for (size_t i = 0; i < nrOfJobs; i++)
+	{
+		jobs[i].slotID = m_initializedTokenSlotID;
+		jobs[i].hKey = hKey;
+		jobs[i].pMechanism = &mechanism;
+		jobs[i].data = &vData;
+		jobs[i].expected = &vExpected;
+		jobs[i].rv = CKR_GENERAL_ERROR;
+		jobs[i].matches = false;
+
+		CPPUNIT_ASSERT(pthread_create(&threads[i], NULL, concurrentCtrWorker, &jobs[i]) == 0);
+	}
+
+	for (size_t i = 0; i < nrOfJobs; i++)
+	{
+		CPPUNIT_ASSERT(pthread_join(threads[i], NULL) == 0);
+		CPPUNIT_ASSERT_EQUAL( (CK_RV)CKR_OK, jobs[i].rv );
+		CPPUNIT_ASSERT(jobs[i].matches);
+	}
+
+	CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
 #if 0 // Unsupported by Crypto API Toolkit
 void SymmetricAlgorithmTests::testGenericKey()
 {
@@ -2453,5 +2939,412 @@ void SymmetricAlgorithmTests::testAesGcmEncryptDecrypt()
     encryptDecrypt(CKM_AES_GCM, blockSize, hSession, hKey, blockSize*NR_OF_BLOCKS_IN_TEST+1);
     encryptDecrypt(CKM_AES_GCM, blockSize, hSession, hKey, blockSize*NR_OF_BLOCKS_IN_TEST);
 }
+
+void SymmetricAlgorithmTests::testAesGcmMessageEncryptDecrypt()
+{
+    CK_RV rv;
+    CK_SESSION_HANDLE hSession;
+
+    // Just make sure that we finalize any previous tests
+    CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+    // Initialize the library and start the test.
+    rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    // Open session
+    rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    // Login USER into the session so we can create a private object
+    rv = CRYPTOKI_F_PTR( C_Login(hSession, CKU_USER, m_userPin1, m_userPin1Length) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    CK_OBJECT_HANDLE hKey = CK_INVALID_HANDLE;
+
+    rv = generateAesKey(hSession, IN_SESSION, IS_PUBLIC, hKey);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    CK_MECHANISM mechanism = { CKM_AES_GCM, NULL_PTR, 0 };
+
+    const size_t nrOfMessages = 3;
+    CK_BYTE data[nrOfMessages][100];
+    CK_BYTE encryptedData[nrOfMessages][100];
+    CK_BYTE ivs[nrOfMessages][12];
+    CK_BYTE tags[nrOfMessages][16];
+    CK_BYTE aad[] = { 0xFE, 0xED, 0xFA, 0xCE, 0xDE, 0xAD, 0xBE, 0xEF };
+    CK_ULONG ulEncryptedDataLen;
+
+    rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, &data[0][0], sizeof(data)) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, &ivs[0][0], sizeof(ivs)) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    // Messages cannot be encrypted before C_MessageEncryptInit
+    CK_GCM_MESSAGE_PARAMS messageParams = { &ivs[0][0], sizeof(ivs[0]), 0, CKG_NO_GENERATE, &tags[0][0], sizeof(tags[0])*8 };
+    ulEncryptedDataLen = sizeof(encryptedData[0]);
+    rv = C_EncryptMessage(hSession, &messageParams, sizeof(messageParams), aad, sizeof(aad), data[0], sizeof(data[0]), encryptedData[0], &ulEncryptedDataLen);
+    CPPUNIT_ASSERT(CKR_OPERATION_NOT_INITIALIZED == rv);
+
+    // One key set-up serves all messages, each with its own IV
+    rv = C_MessageEncryptInit(hSession, &mechanism, hKey);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    // Get the output size
+    rv = C_EncryptMessage(hSession, &messageParams, sizeof(messageParams), aad, sizeof(aad), data[0], sizeof(data[0]), NULL_PTR, &ulEncryptedDataLen);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    CPPUNIT_ASSERT(sizeof(data[0]) == ulEncryptedDataLen);
+
+    // The tag buffer is mandatory
+    messageParams.pTag = NULL_PTR;
+    rv = C_EncryptMessage(hSession, &messageParams, sizeof(messageParams), aad, sizeof(aad), data[0], sizeof(data[0]), encryptedData[0], &ulEncryptedDataLen);
+    CPPUNIT_ASSERT(CKR_ARGUMENTS_BAD == rv);
+
+    for (size_t i = 0; i < nrOfMessages; i++)
+    {
+        messageParams.pIv = ivs[i];
+        messageParams.pTag = tags[i];
+        ulEncryptedDataLen = sizeof(encryptedData[i]);
+        rv = C_EncryptMessage(hSession, &messageParams, sizeof(messageParams), aad, sizeof(aad), data[i], sizeof(data[i]), encryptedData[i], &ulEncryptedDataLen);
+        CPPUNIT_ASSERT(CKR_OK == rv);
+        CPPUNIT_ASSERT(sizeof(data[i]) == ulEncryptedDataLen);
+    }
+
+    // A token generated IV keeps the fixed part
+    CK_BYTE randomIv[12] = { 0x01, 0x02, 0x03, 0x04 };
+    CK_BYTE randomTag[16];
+    CK_BYTE randomEncryptedData[sizeof(data[0])];
+    CK_GCM_MESSAGE_PARAMS randomParams = { randomIv, sizeof(randomIv), 32, CKG_GENERATE_RANDOM, randomTag, sizeof(randomTag)*8 };
+    ulEncryptedDataLen = sizeof(randomEncryptedData);
+    rv = C_EncryptMessage(hSession, &randomParams, sizeof(randomParams), NULL_PTR, 0, data[0], sizeof(data[0]), randomEncryptedData, &ulEncryptedDataLen);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    CPPUNIT_ASSERT(randomIv[0] == 0x01 && randomIv[1] == 0x02 && randomIv[2] == 0x03 && randomIv[3] == 0x04);
+
+    rv = C_MessageEncryptFinal(hSession);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    rv = C_MessageEncryptFinal(hSession);
+    CPPUNIT_ASSERT(CKR_OPERATION_NOT_INITIALIZED == rv);
+
+    // The output equals a single part C_Encrypt with the same IV and AAD
+    CK_GCM_PARAMS gcmParams = { ivs[1], sizeof(ivs[1]), sizeof(ivs[1])*8, aad, sizeof(aad), sizeof(tags[1])*8 };
+    mechanism.pParameter = &gcmParams;
+    mechanism.ulParameterLen = sizeof(gcmParams);
+    CK_BYTE singlePart[sizeof(data[1]) + sizeof(tags[1])];
+    ulEncryptedDataLen = sizeof(singlePart);
+    rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession, &mechanism, hKey) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    rv = CRYPTOKI_F_PTR( C_Encrypt(hSession, data[1], sizeof(data[1]), singlePart, &ulEncryptedDataLen) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    CPPUNIT_ASSERT(sizeof(singlePart) == ulEncryptedDataLen);
+    CPPUNIT_ASSERT(memcmp(singlePart, encryptedData[1], sizeof(data[1])) == 0);
+    CPPUNIT_ASSERT(memcmp(singlePart + sizeof(data[1]), tags[1], sizeof(tags[1])) == 0);
+
+    // Decrypt the messages in a different order
+    mechanism.pParameter = NULL_PTR;
+    mechanism.ulParameterLen = 0;
+    rv = C_MessageDecryptInit(hSession, &mechanism, hKey);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    CK_BYTE decryptedData[sizeof(data[0])];
+    CK_ULONG ulDecryptedDataLen;
+    for (size_t n = nrOfMessages; n > 0; n--)
+    {
+        size_t i = n - 1;
+        messageParams.pIv = ivs[i];
+        messageParams.pTag = tags[i];
+        ulDecryptedDataLen = sizeof(decryptedData);
+        rv = C_DecryptMessage(hSession, &messageParams, sizeof(messageParams), aad, sizeof(aad), encryptedData[i], sizeof(encryptedData[i]), decryptedData, &ulDecryptedDataLen);
+        CPPUNIT_ASSERT(CKR_OK == rv);
+        CPPUNIT_ASSERT(sizeof(data[i]) == ulDecryptedDataLen);
+        CPPUNIT_ASSERT(memcmp(decryptedData, data[i], sizeof(data[i])) == 0);
+    }
+
+    ulDecryptedDataLen = sizeof(decryptedData);
+    rv = C_DecryptMessage(hSession, &randomParams, sizeof(randomParams), NULL_PTR, 0, randomEncryptedData, sizeof(randomEncryptedData), decryptedData, &ulDecryptedDataLen);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    CPPUNIT_ASSERT(memcmp(decryptedData, data[0], sizeof(data[0])) == 0);
+
+    // A tampered tag fails only that message
+    tags[0][0] ^= 0x01;
+    messageParams.pIv = ivs[0];
+    messageParams.pTag = tags[0];
+    ulDecryptedDataLen = sizeof(decryptedData);
+    rv = C_DecryptMessage(hSession, &messageParams, sizeof(messageParams), aad, sizeof(aad), encryptedData[0], sizeof(encryptedData[0]), decryptedData, &ulDecryptedDataLen);
+    CPPUNIT_ASSERT(CKR_ENCRYPTED_DATA_INVALID == rv);
+    tags[0][0] ^= 0x01;
+    ulDecryptedDataLen = sizeof(decryptedData);
+    rv = C_DecryptMessage(hSession, &messageParams, sizeof(messageParams), aad, sizeof(aad), encryptedData[0], sizeof(encryptedData[0]), decryptedData, &ulDecryptedDataLen);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    rv = C_MessageDecryptFinal(hSession);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+void SymmetricAlgorithmTests::testAesGcmMessageBatch()
+{
+    CK_RV rv;
+    CK_SESSION_HANDLE hSession;
+
+    // Just make sure that we finalize any previous tests
+    CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+    // Initialize the library and start the test.
+    rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    // Open session
+    rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    // Login USER into the session so we can create a private object
+    rv = CRYPTOKI_F_PTR( C_Login(hSession, CKU_USER, m_userPin1, m_userPin1Length) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    CK_OBJECT_HANDLE hKey = CK_INVALID_HANDLE;
+
+    rv = generateAesKey(hSession, IN_SESSION, IS_PUBLIC, hKey);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    CK_MECHANISM mechanism = { CKM_AES_GCM, NULL_PTR, 0 };
+
+    const size_t nrOfMessages = 4;
+    CK_BYTE data[nrOfMessages][200];
+    CK_BYTE encryptedData[nrOfMessages][200];
+    CK_BYTE decryptedData[nrOfMessages][200];
+    CK_BYTE ivs[nrOfMessages][12];
+    CK_BYTE tags[nrOfMessages][16];
+    CK_BYTE aad[] = { 0xFE, 0xED, 0xFA, 0xCE, 0xDE, 0xAD, 0xBE, 0xEF };
+    CK_GCM_MESSAGE_PARAMS messageParams[nrOfMessages];
+    CK_MESSAGE_BATCH_ITEM items[nrOfMessages];
+
+    rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, &data[0][0], sizeof(data)) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, &ivs[0][0], sizeof(ivs)) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    for (size_t i = 0; i < nrOfMessages; i++)
+    {
+        CK_GCM_MESSAGE_PARAMS params = { ivs[i], sizeof(ivs[i]), 0, CKG_NO_GENERATE, tags[i], sizeof(tags[i])*8 };
+        messageParams[i] = params;
+
+        CK_MESSAGE_BATCH_ITEM item = { &messageParams[i], sizeof(messageParams[i]), aad, sizeof(aad), data[i], sizeof(data[i]), encryptedData[i], sizeof(encryptedData[i]), CKR_GENERAL_ERROR };
+        items[i] = item;
+    }
+
+    // A batch needs an active message-based operation
+    rv = C_EncryptMessageBatch(hSession, items, nrOfMessages);
+    CPPUNIT_ASSERT(CKR_OPERATION_NOT_INITIALIZED == rv);
+
+    rv = C_MessageEncryptInit(hSession, &mechanism, hKey);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    rv = C_EncryptMessageBatch(hSession, items, 0);
+    CPPUNIT_ASSERT(CKR_ARGUMENTS_BAD == rv);
+
+    rv = C_EncryptMessageBatch(hSession, items, nrOfMessages);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    for (size_t i = 0; i < nrOfMessages; i++)
+    {
+        CPPUNIT_ASSERT(CKR_OK == items[i].rv);
+        CPPUNIT_ASSERT(sizeof(data[i]) == items[i].ulOutLen);
+    }
+
+    // The output equals that of a single C_EncryptMessage
+    CK_BYTE singleEncryptedData[sizeof(data[2])];
+    CK_BYTE singleTag[sizeof(tags[2])];
+    CK_GCM_MESSAGE_PARAMS singleParams = { ivs[2], sizeof(ivs[2]), 0, CKG_NO_GENERATE, singleTag, sizeof(singleTag)*8 };
+    CK_ULONG ulEncryptedDataLen = sizeof(singleEncryptedData);
+    rv = C_EncryptMessage(hSession, &singleParams, sizeof(singleParams), aad, sizeof(aad), data[2], sizeof(data[2]), singleEncryptedData, &ulEncryptedDataLen);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    CPPUNIT_ASSERT(memcmp(singleEncryptedData, encryptedData[2], sizeof(singleEncryptedData)) == 0);
+    CPPUNIT_ASSERT(memcmp(singleTag, tags[2], sizeof(singleTag)) == 0);
+
+    rv = C_MessageEncryptFinal(hSession);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    rv = C_MessageDecryptInit(hSession, &mechanism, hKey);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    for (size_t i = 0; i < nrOfMessages; i++)
+    {
+        items[i].pIn = encryptedData[i];
+        items[i].ulInLen = sizeof(encryptedData[i]);
+        items[i].pOut = decryptedData[i];
+        items[i].ulOutLen = sizeof(decryptedData[i]);
+    }
+
+    // A tampered tag and a short output buffer fail only their own message
+    tags[1][0] ^= 0x01;
+    items[3].ulOutLen = sizeof(decryptedData[3]) - 1;
+    rv = C_DecryptMessageBatch(hSession, items, nrOfMessages);
+    CPPUNIT_ASSERT(CKR_ENCRYPTED_DATA_INVALID == rv);
+    CPPUNIT_ASSERT(CKR_OK == items[0].rv);
+    CPPUNIT_ASSERT(CKR_ENCRYPTED_DATA_INVALID == items[1].rv);
+    CPPUNIT_ASSERT(CKR_OK == items[2].rv);
+    CPPUNIT_ASSERT(CKR_BUFFER_TOO_SMALL == items[3].rv);
+    CPPUNIT_ASSERT(sizeof(encryptedData[3]) == items[3].ulOutLen);
+    tags[1][0] ^= 0x01;
+
+    rv = C_DecryptMessageBatch(hSession, items, nrOfMessages);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    for (size_t i = 0; i < nrOfMessages; i++)
+    {
+        CPPUNIT_ASSERT(CKR_OK == items[i].rv);
+        CPPUNIT_ASSERT(sizeof(data[i]) == items[i].ulOutLen);
+        CPPUNIT_ASSERT(memcmp(decryptedData[i], data[i], sizeof(data[i])) == 0);
+    }
+
+    rv = C_MessageDecryptFinal(hSession);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
+
+void SymmetricAlgorithmTests::testAesGcmStream()
+{
+    CK_RV rv;
+    CK_SESSION_HANDLE hSession;
+
+    // Just make sure that we finalize any previous tests
+    CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
+
+    // Initialize the library and start the test.
+    rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    // Open session
+    rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION | CKF_RW_SESSION, NULL_PTR, NULL_PTR, &hSession) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    // Login USER into the session so we can create a private object
+    rv = CRYPTOKI_F_PTR( C_Login(hSession, CKU_USER, m_userPin1, m_userPin1Length) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    CK_OBJECT_HANDLE hKey = CK_INVALID_HANDLE;
+
+    rv = generateAesKey(hSession, IN_SESSION, IS_PUBLIC, hKey);
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    const CK_ULONG segmentSize = 64;
+    const CK_ULONG tagSize = 16;
+    const CK_ULONG chunkSize = segmentSize + tagSize;
+    const CK_ULONG nrOfSegments = 1000 / segmentSize + 1;
+
+    CK_BYTE data[1000];
+    CK_BYTE encryptedData[sizeof(data) + nrOfSegments * tagSize];
+    CK_BYTE singleEncryptedData[sizeof(encryptedData)];
+    CK_BYTE decryptedData[sizeof(encryptedData)];
+    CK_BYTE noncePrefix[7];
+    CK_BYTE aad[] = { 0xFE, 0xED, 0xFA, 0xCE, 0xDE, 0xAD, 0xBE, 0xEF };
+    CK_ULONG ulLen;
+    CK_ULONG ulEncryptedDataLen = 0;
+    CK_ULONG ulDecryptedDataLen = 0;
+
+    rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, data, sizeof(data)) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    rv = CRYPTOKI_F_PTR( C_GenerateRandom(hSession, noncePrefix, sizeof(noncePrefix)) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+
+    CK_AES_GCM_STREAM_PARAMS params = { noncePrefix, sizeof(noncePrefix), aad, sizeof(aad), segmentSize, tagSize * 8 };
+    CK_MECHANISM mechanism = { CKM_AES_GCM_STREAM, &params, sizeof(params) };
+
+    // The nonce prefix has a fixed size
+    params.ulNoncePrefixLen = 12;
+    rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession, &mechanism, hKey) );
+    CPPUNIT_ASSERT(CKR_MECHANISM_PARAM_INVALID == rv);
+    params.ulNoncePrefixLen = sizeof(noncePrefix);
+
+    // Multi-part encryption outputs complete segments only
+    rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession, &mechanism, hKey) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    for (CK_ULONG i = 0; i < sizeof(data); i += 37)
+    {
+        CK_ULONG ulPartLen = (sizeof(data) - i < 37) ? sizeof(data) - i : 37;
+        ulLen = sizeof(encryptedData) - ulEncryptedDataLen;
+        rv = CRYPTOKI_F_PTR( C_EncryptUpdate(hSession, &data[i], ulPartLen, &encryptedData[ulEncryptedDataLen], &ulLen) );
+        CPPUNIT_ASSERT(CKR_OK == rv);
+        CPPUNIT_ASSERT(0 == ulLen % chunkSize);
+        ulEncryptedDataLen += ulLen;
+    }
+    ulLen = sizeof(encryptedData) - ulEncryptedDataLen;
+    rv = CRYPTOKI_F_PTR( C_EncryptFinal(hSession, &encryptedData[ulEncryptedDataLen], &ulLen) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    ulEncryptedDataLen += ulLen;
+    CPPUNIT_ASSERT(sizeof(encryptedData) == ulEncryptedDataLen);
+
+    // Single-part encryption gives the same stream
+    rv = CRYPTOKI_F_PTR( C_EncryptInit(hSession, &mechanism, hKey) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    ulLen = 0;
+    rv = CRYPTOKI_F_PTR( C_Encrypt(hSession, data, sizeof(data), NULL_PTR, &ulLen) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    CPPUNIT_ASSERT(sizeof(singleEncryptedData) == ulLen);
+    rv = CRYPTOKI_F_PTR( C_Encrypt(hSession, data, sizeof(data), singleEncryptedData, &ulLen) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    CPPUNIT_ASSERT(memcmp(singleEncryptedData, encryptedData, sizeof(encryptedData)) == 0);
+
+    // Multi-part decryption releases every segment as soon as it is complete
+    rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession, &mechanism, hKey) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    for (CK_ULONG i = 0; i < ulEncryptedDataLen; i += 100)
+    {
+        CK_ULONG ulPartLen = (ulEncryptedDataLen - i < 100) ? ulEncryptedDataLen - i : 100;
+        ulLen = sizeof(decryptedData) - ulDecryptedDataLen;
+        rv = CRYPTOKI_F_PTR( C_DecryptUpdate(hSession, &encryptedData[i], ulPartLen, &decryptedData[ulDecryptedDataLen], &ulLen) );
+        CPPUNIT_ASSERT(CKR_OK == rv);
+        ulDecryptedDataLen += ulLen;
+        CPPUNIT_ASSERT(((i + ulPartLen) / chunkSize) * segmentSize == ulDecryptedDataLen);
+    }
+    ulLen = sizeof(decryptedData) - ulDecryptedDataLen;
+    rv = CRYPTOKI_F_PTR( C_DecryptFinal(hSession, &decryptedData[ulDecryptedDataLen], &ulLen) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    ulDecryptedDataLen += ulLen;
+    CPPUNIT_ASSERT(sizeof(data) == ulDecryptedDataLen);
+    CPPUNIT_ASSERT(memcmp(decryptedData, data, sizeof(data)) == 0);
+
+    // A modified segment is rejected when it is reached
+    encryptedData[chunkSize + 3] ^= 0x01;
+    rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession, &mechanism, hKey) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    ulLen = sizeof(decryptedData);
+    rv = CRYPTOKI_F_PTR( C_DecryptUpdate(hSession, encryptedData, chunkSize, decryptedData, &ulLen) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    CPPUNIT_ASSERT(segmentSize == ulLen);
+    ulLen = sizeof(decryptedData);
+    rv = CRYPTOKI_F_PTR( C_DecryptUpdate(hSession, &encryptedData[chunkSize], chunkSize, decryptedData, &ulLen) );
+    CPPUNIT_ASSERT(CKR_GENERAL_ERROR == rv);
+    encryptedData[chunkSize + 3] ^= 0x01;
+
+    // A stream that is cut at a segment boundary does not authenticate
+    rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession, &mechanism, hKey) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    ulLen = sizeof(decryptedData);
+    rv = CRYPTOKI_F_PTR( C_DecryptUpdate(hSession, encryptedData, 2 * chunkSize, decryptedData, &ulLen) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    ulLen = sizeof(decryptedData);
+    rv = CRYPTOKI_F_PTR( C_DecryptFinal(hSession, decryptedData, &ulLen) );
+    CPPUNIT_ASSERT(CKR_GENERAL_ERROR == rv);
+
+    // As does one decrypted with other AAD
+    aad[0] ^= 0x01;
+    rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession, &mechanism, hKey) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    ulLen = sizeof(decryptedData);
+    rv = CRYPTOKI_F_PTR( C_Decrypt(hSession, encryptedData, ulEncryptedDataLen, decryptedData, &ulLen) );
+    CPPUNIT_ASSERT(CKR_GENERAL_ERROR == rv);
+    aad[0] ^= 0x01;
+
+    rv = CRYPTOKI_F_PTR( C_DecryptInit(hSession, &mechanism, hKey) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    ulLen = sizeof(decryptedData);
+    rv = CRYPTOKI_F_PTR( C_Decrypt(hSession, encryptedData, ulEncryptedDataLen, decryptedData, &ulLen) );
+    CPPUNIT_ASSERT(CKR_OK == rv);
+    CPPUNIT_ASSERT(sizeof(data) == ulLen);
+    CPPUNIT_ASSERT(memcmp(decryptedData, data, sizeof(data)) == 0);
+
+    CRYPTOKI_F_PTR( C_CloseSession(hSession) );
+}
 #endif
 #endif
\ No newline at end of file
@@ -44,10 +44,16 @@ class SymmetricAlgorithmTests : public TestsBase
 	CPPUNIT_TEST(testDesEncryptDecrypt);
 #endif // Unsupported by Crypto API Toolkit
     CPPUNIT_TEST(testAesWrapUnwrap);
+#ifdef HAVE_AES_KEY_WRAP_PAD
+    CPPUNIT_TEST(testAesKeyWrapBatch);
+#endif
 #ifdef SGXHSM
     CPPUNIT_TEST(testAesWrapUnwrapTokenObject);
 #ifdef WITH_AES_GCM
     CPPUNIT_TEST(testAesGcmEncryptDecrypt);
+    CPPUNIT_TEST(testAesGcmMessageEncryptDecrypt);
+    CPPUNIT_TEST(testAesGcmMessageBatch);
+    CPPUNIT_TEST(testAesGcmStream);
 #endif
 #endif
     CPPUNIT_TEST(testNullTemplate);
@@ -56,6 +62,8 @@ class SymmetricAlgorithmTests : public TestsBase
 #endif // Unsupported by Crypto API Toolkit
     CPPUNIT_TEST(testCheckValue);
     CPPUNIT_TEST(testAesCtrOverflow);
+    CPPUNIT_TEST(testAesCtrLargeBuffer);
+    CPPUNIT_TEST(testAesCtrConcurrent);
 #if 0 // Unsupported by Crypto API Toolkit
     CPPUNIT_TEST(testGenericKey);
 #endif // Unsupported by Crypto API Toolkit
@@ -69,18 +77,26 @@ public:
     void testAesWrapUnwrapTokenObject();
 #ifdef WITH_AES_GCM
     void testAesGcmEncryptDecrypt();
+    void testAesGcmMessageEncryptDecrypt();
+    void testAesGcmMessageBatch();
+    void testAesGcmStream();
 #endif
 #endif
 #if 0 // Unsupported by Crypto API Toolkit
 	void testDesEncryptDecrypt();
 #endif // Unsupported by Crypto API Toolkit
 	void testAesWrapUnwrap();
+#ifdef HAVE_AES_KEY_WRAP_PAD
+	void testAesKeyWrapBatch();
+#endif
 	void testNullTemplate();
 #if 0 // Unsupported by Crypto API Toolkit
 	void testNonModifiableDesKeyGeneration();
 #endif // Unsupported by Crypto API Toolkit
 	void testCheckValue();
 	void testAesCtrOverflow();
+	void testAesCtrLargeBuffer();
+	void testAesCtrConcurrent();
 #if 0 // Unsupported by Crypto API Toolkit
 	void testGenericKey();
 #endif // Unsupported by Crypto API Toolkit
@@ -234,98 +234,6 @@ void UnsupportedAPITests::testVerifyRecover()
     CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
 }
 
-void UnsupportedAPITests::testDigestEncryptUpdate()
-{
-    CK_RV rv;
-    CK_SESSION_HANDLE hSession;
-
-    // Just make sure that we finalize any previous tests
-    CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
-
-    rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
-    CPPUNIT_ASSERT(rv == CKR_OK);
-
-    rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSession) );
-    CPPUNIT_ASSERT(rv == CKR_OK);
-
-    rv = CRYPTOKI_F_PTR( C_DigestEncryptUpdate(hSession, NULL_PTR, 0, NULL_PTR, NULL_PTR) );
-    CPPUNIT_ASSERT(rv == CKR_FUNCTION_NOT_SUPPORTED);
-
-    rv = CRYPTOKI_F_PTR( C_CloseSession(hSession) );
-    CPPUNIT_ASSERT(rv == CKR_OK);
-
-    CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
-}
-
-void UnsupportedAPITests::testDecryptDigestUpdate()
-{
-    CK_RV rv;
-    CK_SESSION_HANDLE hSession;
-
-    // Just make sure that we finalize any previous tests
-    CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
-
-    rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
-    CPPUNIT_ASSERT(rv == CKR_OK);
-
-    rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSession) );
-    CPPUNIT_ASSERT(rv == CKR_OK);
-
-    rv = CRYPTOKI_F_PTR( C_DecryptDigestUpdate(hSession, NULL_PTR, 0, NULL_PTR, NULL_PTR) );
-    CPPUNIT_ASSERT(rv == CKR_FUNCTION_NOT_SUPPORTED);
-
-    rv = CRYPTOKI_F_PTR( C_CloseSession(hSession) );
-    CPPUNIT_ASSERT(rv == CKR_OK);
-
-    CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
-}
-
-void UnsupportedAPITests::testSignEncryptUpdate()
-{
-    CK_RV rv;
-    CK_SESSION_HANDLE hSession;
-
-    // Just make sure that we finalize any previous tests
-    CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
-
-    rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
-    CPPUNIT_ASSERT(rv == CKR_OK);
-
-    rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSession) );
-    CPPUNIT_ASSERT(rv == CKR_OK);
-
-    rv = CRYPTOKI_F_PTR( C_SignEncryptUpdate(hSession, NULL_PTR, 0, NULL_PTR, NULL_PTR) );
-    CPPUNIT_ASSERT(rv == CKR_FUNCTION_NOT_SUPPORTED);
-
-    rv = CRYPTOKI_F_PTR( C_CloseSession(hSession) );
-    CPPUNIT_ASSERT(rv == CKR_OK);
-
-    CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
-}
-
-void UnsupportedAPITests::testDecryptVerifyUpdate()
-{
-    CK_RV rv;
-    CK_SESSION_HANDLE hSession;
-
-    // Just make sure that we finalize any previous tests
-    CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
-
-    rv = CRYPTOKI_F_PTR( C_Initialize(NULL_PTR) );
-    CPPUNIT_ASSERT(rv == CKR_OK);
-
-    rv = CRYPTOKI_F_PTR( C_OpenSession(m_initializedTokenSlotID, CKF_SERIAL_SESSION, NULL_PTR, NULL_PTR, &hSession) );
-    CPPUNIT_ASSERT(rv == CKR_OK);
-
-    rv = CRYPTOKI_F_PTR( C_DecryptVerifyUpdate(hSession, NULL_PTR, 0, NULL_PTR, NULL_PTR) );
-    CPPUNIT_ASSERT(rv == CKR_FUNCTION_NOT_SUPPORTED);
-
-    rv = CRYPTOKI_F_PTR( C_CloseSession(hSession) );
-    CPPUNIT_ASSERT(rv == CKR_OK);
-
-    CRYPTOKI_F_PTR( C_Finalize(NULL_PTR) );
-}
-
 void UnsupportedAPITests::testDeriveKey()
 {
     CK_RV rv;
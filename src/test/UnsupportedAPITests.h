@@ -77,10 +77,6 @@ class UnsupportedAPITests : public TestsNoPINInitBase
     CPPUNIT_TEST(testSignRecover);
     CPPUNIT_TEST(testVerifyRecoverInit);
     CPPUNIT_TEST(testVerifyRecover);
-    CPPUNIT_TEST(testDigestEncryptUpdate);
-    CPPUNIT_TEST(testDecryptDigestUpdate);
-    CPPUNIT_TEST(testSignEncryptUpdate);
-    CPPUNIT_TEST(testDecryptVerifyUpdate);
     CPPUNIT_TEST(testDeriveKey);
     CPPUNIT_TEST(testSeedRandom);
     CPPUNIT_TEST(testWaitForSlotEvent);
@@ -96,10 +92,6 @@ public:
     void testSignRecover();
     void testVerifyRecoverInit();
     void testVerifyRecover();
-    void testDigestEncryptUpdate();
-    void testDecryptDigestUpdate();
-    void testSignEncryptUpdate();
-    void testDecryptVerifyUpdate();
     void testDeriveKey();
     void testSeedRandom();
     void testWaitForSlotEvent();
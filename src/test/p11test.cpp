@@ -71,6 +71,7 @@
 #include <cppunit/Exception.h>
 #include <cppunit/XmlOutputter.h>
 #include <fstream>
+#include <string>
 #include <stdlib.h>
 #include <iostream>
 #ifdef _WIN32
@@ -104,6 +105,9 @@ int main(int argc, char**const argv)
 	if ( argc<2 ) {
 		return runner.run() ? 0 : 1;
 	}
+	if ( std::string(*(argv+1)).compare(0, 16, "PerformanceTests")==0 ) {
+		runner.addTest(CPPUNIT_NS::TestFactoryRegistry::getRegistry("PerformanceTests").makeTest());
+	}
 	if ( std::string("direct").find(*(argv+1))==std::string::npos ) {
 		return runner.run(*(argv+1)) ? 0 : 1;
 	}